@@ -1,11 +1,14 @@
 #!/bin/sh
 #
-echo make_bench.sh will make the benchmark files 
-echo This should always be done on the same machine.
-echo All options should be enabled '(-e all)'
-for drive in nps-2009-domexusers nps-2009-ubnist1.gen3 nps-2010-emails nps-2009-casper-rw ; do
-  #/bin/rm -rf $drive
-  fn=/corp/nps/drives/`basename $drive .gen3`/$drive.E01
-  if [ ! -r $fn ] ; then echo $fn not found ; exit 1 ; fi
-  src/bulk_extractor -e all -o $drive $fn
+# make_bench.sh: run the benchmark matrix (tests/bench.py) over the synthetic and bundled
+# images, plus any images given on the command line (for example the NPS drives).
+# Compare two runs with: python3 tests/bench.py --compare old.json new.json
+# This should always be done on the same machine.
+#
+# usage: make_bench.sh [image ...]
+images=""
+for img in "$@" ; do
+  if [ ! -r "$img" ] ; then echo "$img" not found ; exit 1 ; fi
+  images="$images --image $img"
 done
+exec python3 `dirname $0`/tests/bench.py --json bench-`date +%Y%m%d-%H%M%S`.json $images
@@ -11,6 +11,11 @@ b.carved_files()  = List of carved files
 b.histogram_files()    = List of histograms
 b.read_histogram() = Returns a dictionary of the histogram
 b.open(fname)     = Opens a feature file in the report
+b.shards(fname)   = The per-thread files of a feature file made with -S feature_shards
+b.frames(fname)   = The frames of a feature file compressed with -S gzip_feature_files
+b.open_frame(fname,i) = Opens frame i of a compressed feature file
+b.read_columns(fname) = Reads the columnar copy of a feature file made with -S columnar_feature_files
+b.read_features_in_range(fname,start,end) = The features between two offsets, using the index made with -S index_feature_files
 BulkReport.is_comment_line(line) - returns true if line is a commont line
 
 Note: files are always opened in binary mode and converted line-by-line
@@ -18,19 +23,40 @@ to text mode. The confusion is that ZIP files are always opened as binary
 and the "b" cannot be applied, but disk files are default opened in text mode,
 so the "b" must be added.
 
+A report made with -S gzip_feature_files=YES has email.txt.gz and its index
+email.txt.gz.idx instead of email.txt. It is still called email.txt here,
+and opened with gzip.
+
+A report made with -S columnar_feature_files=YES also has email.col, a
+binary copy of email.txt with the forensic path, feature and context in
+separate, dictionary encoded columns (see src/feature_file_columnar.h).
+read_features() reads it instead of email.txt when it is there.
+
+A report made with -S feature_shards=email -S feature_shards_merge=NO has
+a file for each thread, email.t00.txt, email.t01.txt and their histograms
+email.t00_histogram.txt ..., instead of all of email.txt. They are still
+called email.txt and email_histogram.txt here, and opened as one file;
+read_histogram() adds up the counts of the shards.
+
 """
 
 
-__version__ = "1.5.0"
+__version__ = "1.8.0"
 
 b'This module needs Python 2.7 or later.'
-import zipfile,os,os.path,glob,codecs,re
+import zipfile,os,os.path,glob,codecs,re,gzip,io,struct,array,sys
 
 property_re = re.compile("# ([a-z0-9\-_]+):(.*)",re.I)
 
 MIN_FIELDS_PER_FEATURE_FILE_LINE = 3
 MAX_FIELDS_PER_FEATURE_FILE_LINE = 11
 
+COLUMNAR_MAGIC   = b"BECOL001"
+COLUMNAR_NO_POS0 = 2**64-1
+COLUMNAR_NONE    = 2**32-1
+
+shard_re = re.compile(r"^(.+)\.t(\d+)(_.*)?\.txt$")
+
 def be_version(exe):
     """Returns the version number for a bulk_extractor executable"""
     from subprocess import Popen,PIPE
@@ -110,6 +136,60 @@ def is_feature_line(line):
     else:
         return False
 
+class ColumnarFeatures:
+    """The columns of a .col file: pos0, path, feature and context, one entry per line of the
+    feature file. path, feature and context are indexes into path_dict, feature_dict and
+    context_dict (COLUMNAR_NONE if the line did not have the field); pos0 is the leading offset
+    of the forensic path (COLUMNAR_NO_POS0 if it had none)."""
+    def __init__(self,data):
+        if data[0:8]!=COLUMNAR_MAGIC or data[-8:]!=COLUMNAR_MAGIC:
+            raise ValueError("not a columnar feature file")
+        (groups,rows) = struct.unpack("<QQ",data[-24:-8])
+        self.pos0    = array.array('Q')
+        self.path    = array.array('I')
+        self.feature = array.array('I')
+        self.context = array.array('I')
+        self.path_dict    = []
+        self.feature_dict = []
+        self.context_dict = []
+        pos = 8
+        for g in range(groups):
+            (n,) = struct.unpack_from("<Q",data,pos)
+            added = struct.unpack_from("<III",data,pos+8)
+            pos += 20
+            for (count,d) in zip(added,(self.path_dict,self.feature_dict,self.context_dict)):
+                lengths = struct.unpack_from("<%dI" % count,data,pos)
+                pos += 4*count
+                for length in lengths:
+                    d.append(data[pos:pos+length])
+                    pos += length
+            for (column,size) in ((self.pos0,8),(self.path,4),(self.feature,4),(self.context,4)):
+                column.frombytes(data[pos:pos+n*size])
+                pos += n*size
+        if sys.byteorder!='little':
+            for column in (self.pos0,self.path,self.feature,self.context):
+                column.byteswap()
+        if len(self.pos0)!=rows:
+            raise ValueError("bad columnar feature file footer")
+
+    def __len__(self):
+        return len(self.pos0)
+
+    def forensic_path(self,i):
+        """Returns the forensic path of row i, as bytes"""
+        pos0 = b"" if self.pos0[i]==COLUMNAR_NO_POS0 else str(self.pos0[i]).encode('ascii')
+        return pos0 + self.path_dict[self.path[i]]
+
+    def fields(self,i):
+        """Returns row i as the fields of its line in the feature file, like parse_feature_line()"""
+        ret = [self.forensic_path(i)]
+        if self.feature[i]!=COLUMNAR_NONE:
+            ret.append(self.feature_dict[self.feature[i]])
+            if self.context[i]!=COLUMNAR_NONE:
+                ret.append(self.context_dict[self.context[i]])
+        return ret
+
+
 def is_histogram_filename(fname):
     """Returns true if this is a histogram file"""
     if "_histogram" in fname: return True
@@ -129,6 +209,36 @@ def is_feature_filename(fname):
     return None                 # don't know
 
 
+def shard_merged_name(fname):
+    """Returns the name of the file that the per-thread shard fname is part of (email.txt for
+    email.t03.txt), or None if it is not a shard"""
+    m = shard_re.match(fname)
+    return m.group(1)+(m.group(3) or "")+".txt" if m else None
+
+class ConcatenatedFile(io.RawIOBase):
+    """The files fnames read one after the other, as one file"""
+    def __init__(self,fnames):
+        self.fnames = list(fnames)
+        self.f = None
+
+    def readable(self):
+        return True
+
+    def readinto(self,b):
+        while True:
+            if self.f is None:
+                if not self.fnames: return 0
+                self.f = open(self.fnames.pop(0),"rb")
+            n = self.f.readinto(b)
+            if n: return n
+            self.f.close()
+            self.f = None
+
+    def close(self):
+        if self.f: self.f.close()
+        self.f = None
+        super().close()
+
 class BulkReport:
     """Creates an object from a bulk_extractor report. The report can be a directory or a ZIP of a directory.
     Methods that you may find useful:
@@ -160,7 +270,18 @@ class BulkReport:
             self.zipfile = None
             self.dname = fn
             self.all_files = set([os.path.basename(x) for x in glob.glob(os.path.join(fn,"*"))])
+            self.map   = dict((x,x) for x in self.all_files)
             self.files = set([os.path.basename(x) for x in glob.glob(os.path.join(fn,"*.txt"))])
+            self.gz_files = set([os.path.basename(x)[:-3] for x in glob.glob(os.path.join(fn,"*.txt.gz"))])
+            self.files |= self.gz_files
+            self.shard_map = dict()
+            for x in sorted(self.files):
+                merged = shard_merged_name(x)
+                if merged: self.shard_map.setdefault(merged,[]).append(x)
+            for (merged,shards) in self.shard_map.items():
+                shards.sort(key=lambda x:int(shard_re.match(x).group(2)))
+                self.files -= set(shards)
+                self.files.add(merged)
             if do_validate: validate()
             return
 
@@ -236,12 +357,90 @@ class BulkReport:
         if self.zipfile:
             mode = mode.replace("b","")
             f = self.zipfile.open(self.map[fname],mode=mode)
+        elif fname in self.shard_map:
+            parts = ([fname] if fname in self.all_files else []) + self.shard_map[fname]
+            f = io.BufferedReader(ConcatenatedFile([os.path.join(self.dname,x) for x in parts]))
+        elif fname in self.gz_files:
+            f = gzip.open(os.path.join(self.dname,fname+".gz"),mode="rb")
         else:
             mode = mode.replace("b","")+"b"
             fn = os.path.join(self.dname,fname)
             f = open(fn,mode=mode)
         return f
 
+    def shards(self,fname):
+        """Returns the per-thread shards of fname, in order, or [] if it has none"""
+        return getattr(self,'shard_map',{}).get(fname,[])
+
+    def frames(self,fname):
+        """Returns the frames of a compressed feature file as (offset, gz_offset) pairs: the offset of
+        the frame's first line in the uncompressed file, and of the frame in the .gz. The last pair
+        has the sizes of the two files."""
+        ret = []
+        with open(os.path.join(self.dname,fname+".gz.idx")) as f:
+            for line in f:
+                if line.startswith("#") or not line.strip(): continue
+                (offset,gz_offset) = line.split("\t")
+                ret.append((int(offset),int(gz_offset)))
+        return ret
+
+    def open_frame(self,fname,i,frames=None):
+        """Opens frame i of a compressed feature file, which has whole lines. Pass the result of
+        frames() when opening many frames of one file."""
+        frames = frames or self.frames(fname)
+        with open(os.path.join(self.dname,fname+".gz"),"rb") as f:
+            f.seek(frames[i][1])
+            member = f.read(frames[i+1][1]-frames[i][1])
+        return io.BytesIO(gzip.decompress(member))
+
+    def columnar_name(self,fname):
+        """Returns the name of the columnar copy of the feature file fname, or None if there is none"""
+        col = os.path.splitext(fname)[0]+".col"
+        return col if col in self.map else None
+
+    def read_columns(self,fname):
+        """Reads the columnar copy of the feature file fname and returns a ColumnarFeatures"""
+        col = self.columnar_name(fname) or (os.path.splitext(fname)[0]+".col")
+        with self.open(col,"rb") as f:
+            return ColumnarFeatures(f.read())
+
+    def read_index(self,fname):
+        """Returns the blocks of the index of feature file fname made with -S index_feature_files, as
+        (offset, length, min_pos0, max_pos0, lines, other_lines) tuples."""
+        ret = []
+        for line in self.open(fname+".index","rb"):
+            if line.startswith(b"#") or not line.strip(): continue
+            ret.append(tuple(int(x) for x in line.split(b"\t")))
+        return ret
+
+    def read_bytes(self,fname,offset,length):
+        """Returns length bytes of feature file fname from offset, from the frames if it is compressed"""
+        if fname in getattr(self,'gz_files',()):
+            frames = self.frames(fname)
+            ret = b""
+            for i in range(len(frames)-1):
+                if frames[i+1][0] <= offset: continue
+                if frames[i][0] >= offset+length: break
+                data = self.open_frame(fname,i,frames).read()
+                ret += data[max(0,offset-frames[i][0]):offset+length-frames[i][0]]
+            return ret
+        with self.open(fname,"rb") as f:
+            f.seek(offset)
+            return f.read(length)
+
+    def read_features_in_range(self,fname,start,end,index=None):
+        """Yields the features of feature file fname whose forensic path starts with an offset in
+        [start,end), reading only the blocks of the file that the index says have them. Pass the
+        result of read_index() when reading many ranges of one file."""
+        leading = re.compile(b"^([0-9]+)")
+        for (offset,length,min_pos0,max_pos0,lines,other_lines) in (index or self.read_index(fname)):
+            if lines==0 or max_pos0<start or min_pos0>=end: continue
+            for line in self.read_bytes(fname,offset,length).split(b"\n"):
+                m = leading.match(line)
+                if m and start<=int(m.group(1))<end:
+                    r = parse_feature_line(line)
+                    if r: yield r
+
     def count_lines(self,fname):
         count = 0
         for line in self.open(fname):
@@ -300,12 +499,22 @@ class BulkReport:
         """Read a histogram file and return a dictonary of the histogram. Removes \t(utf16=...) """
         ret = {}
         for (k,v) in self.read_histogram_entries(fn):
-            ret[k] = int(v)
+            ret[k] = ret.get(k,0)+int(v)    # a key is in each shard's histogram
         return ret
 
     def read_features(self,fname):
         """Just read the features out of a feature file"""
         """Usage: for (pos,feature,context) in br.read_features("fname")"""
+        if self.columnar_name(fname):
+            cols = self.read_columns(fname)
+            for i in range(len(cols)):
+                r = cols.fields(i)
+                if len(r)==3: r[2:] = r[2].split(b"\t")
+                if len(r)<MIN_FIELDS_PER_FEATURE_FILE_LINE or len(r)>MAX_FIELDS_PER_FEATURE_FILE_LINE: continue
+                if r[0][0:1].isdigit() or b"\xf4\x80\x80\x9c" in r[0]:
+                    r[-1] += b"\n"  # as read from the text file
+                    yield r
+            return
         for line in self.open(fname,"rb"):
             r = parse_feature_line(line)
             if r:
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+# coding=UTF-8
+#
+# bulk_shard.py:
+# Split a bulk_extractor run into shards and merge the shards' output directories.
+#
+# bulk_extractor --shard i/n scans the i'th of n page-aligned ranges of the image.
+# Shards can run on different machines; the merge step combines their outputs into one
+# output directory, as if the image had been scanned by a single run.
+
+"""
+Usage:
+    bulk_shard.py plan  --shards N [--outdir DIR] IMAGE [-- bulk_extractor args]
+        prints one bulk_extractor command per shard
+    bulk_shard.py run   --shards N [--jobs J] --outdir DIR IMAGE [-- bulk_extractor args]
+        runs the shards on this machine, J at a time, then merges them into DIR
+    bulk_shard.py merge --outdir DIR SHARD_DIR [SHARD_DIR ...]
+        merges shard output directories (in shard order) into DIR
+"""
+
+__version__ = '2.0.0-dev'
+
+import os
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+import xml.etree.ElementTree as ET
+from concurrent.futures import ThreadPoolExecutor
+
+HISTOGRAM_RE = re.compile(rb"^n=(\d+)\t(.*?)(?:\t\(utf16=(\d+)\))?$")
+
+def shard_dir(outdir, i):
+    return os.path.join(outdir, "shard-{:04d}".format(i))
+
+def shard_command(exe, image, outdir, i, n, extra):
+    return [exe, "--shard", "{}/{}".format(i, n), "-o", shard_dir(outdir, i)] + extra + [image]
+
+def is_histogram(fname):
+    """Histograms are known by their lines (n=COUNT<tab>FEATURE), as bulk_extractor knows them: scan_email's
+    url_services.txt and url_searches.txt, among others, are histograms without _histogram in their names."""
+    with open(fname, "rb") as f:
+        for line in f:
+            if line.startswith(b"#") or not line.strip():
+                continue
+            return HISTOGRAM_RE.match(line.rstrip(b"\n")) is not None
+    return False
+
+def merge_histograms(fnames, dest):
+    """Sum the counts (and utf16 counts) of each feature; order as bulk_extractor does, by count then feature."""
+    counts = {}
+    utf16 = {}
+    for fname in fnames:
+        with open(fname, "rb") as f:
+            for line in f:
+                m = HISTOGRAM_RE.match(line.rstrip(b"\n"))
+                if not m:
+                    continue
+                feature = m.group(2)
+                counts[feature] = counts.get(feature, 0) + int(m.group(1))
+                if m.group(3):
+                    utf16[feature] = utf16.get(feature, 0) + int(m.group(3))
+    with open(dest, "wb") as out:
+        for feature in sorted(counts, key=lambda k: (-counts[k], k)):
+            out.write(b"n=%d\t%s" % (counts[feature], feature))
+            if feature in utf16:
+                out.write(b"\t(utf16=%d)" % utf16[feature])
+            out.write(b"\n")
+
+def merge_feature_files(fnames, dest):
+    """Concatenate in shard order, which is image order, keeping the first shard's header comments."""
+    with open(dest, "wb") as out:
+        for n, fname in enumerate(fnames):
+            with open(fname, "rb") as f:
+                for line in f:
+                    if line.startswith(b"#") and n > 0:
+                        continue
+                    out.write(line)
+
+def numeric(text):
+    try:
+        return int(text)
+    except (TypeError, ValueError):
+        return None
+
+def merge_reports(fnames, dest):
+    """The first shard's report, with a <shards> element listing every shard. Numeric leaf elements of
+    <runtime> are summed, and the image hash is dropped, since no shard hashed the whole image."""
+    trees = [ET.parse(fname) for fname in fnames]
+    root = trees[0].getroot()
+    runtime = root.find("runtime")
+    if runtime is not None:
+        for elem in runtime:
+            if len(elem) or numeric(elem.text) is None:
+                continue
+            total = 0
+            for tree in trees:
+                other = tree.getroot().find("runtime/" + elem.tag)
+                if other is not None:
+                    total += numeric(other.text) or 0
+            elem.text = str(total)
+    source = root.find("source")
+    if source is not None:
+        for h in source.findall("hashdigest"):
+            source.remove(h)
+    shards = ET.SubElement(root, "shards")
+    for fname, tree in zip(fnames, trees):
+        shard = tree.getroot().find("configuration/shard")
+        e = ET.SubElement(shards, "shard", shard.attrib if shard is not None else {})
+        e.set("report", fname)
+    trees[0].write(dest, encoding="UTF-8", xml_declaration=True)
+
+def merge(outdir, shard_dirs):
+    os.makedirs(outdir, exist_ok=True)
+    names = {}                          # relative path -> list of the shards' copies
+    for sd in shard_dirs:
+        for dirpath, dirnames, filenames in os.walk(sd):
+            for fn in filenames:
+                rel = os.path.relpath(os.path.join(dirpath, fn), sd)
+                names.setdefault(rel, []).append(os.path.join(dirpath, fn))
+    for rel, fnames in sorted(names.items()):
+        dest = os.path.join(outdir, rel)
+        os.makedirs(os.path.dirname(dest) or outdir, exist_ok=True)
+        if rel == "report.xml":
+            merge_reports(fnames, dest)
+        elif os.path.dirname(rel):      # carved files; their names include their offsets
+            for fname in fnames:
+                shutil.copy2(fname, dest)
+        elif rel.endswith(".txt") and any(is_histogram(fname) for fname in fnames):
+            merge_histograms(fnames, dest)
+        elif rel.endswith(".txt"):
+            merge_feature_files(fnames, dest)
+        else:
+            shutil.copy2(fnames[0], dest)
+
+if __name__ == "__main__":
+    import argparse
+    argv = sys.argv[1:]
+    extra = []
+    if "--" in argv:
+        extra = argv[argv.index("--")+1:]
+        argv = argv[:argv.index("--")]
+    parser = argparse.ArgumentParser(description="Run bulk_extractor in shards and merge the results",
+                                     formatter_class=argparse.RawDescriptionHelpFormatter, epilog=__doc__)
+    parser.add_argument("command", choices=["plan", "run", "merge"])
+    parser.add_argument("--shards", type=int, help="number of shards")
+    parser.add_argument("--jobs", type=int, default=1, help="shards to run at once (run)")
+    parser.add_argument("--outdir", default="out", help="output directory")
+    parser.add_argument("--exe", default="bulk_extractor", help="bulk_extractor executable")
+    parser.add_argument("args", nargs="+", help="the image, or the shard directories to merge")
+    args = parser.parse_args(argv)
+
+    if args.command == "merge":
+        merge(args.outdir, args.args)
+        sys.exit(0)
+
+    if not args.shards or args.shards < 1:
+        parser.error("--shards N is required")
+    image = args.args[0]
+    commands = [shard_command(args.exe, image, args.outdir, i, args.shards, extra) for i in range(args.shards)]
+    if args.command == "plan":
+        for c in commands:
+            print(" ".join(shlex.quote(a) for a in c))
+        sys.exit(0)
+
+    os.makedirs(args.outdir, exist_ok=True)
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        results = list(pool.map(subprocess.call, commands))
+    if any(results):
+        print("shards failed:", [i for i, r in enumerate(results) if r], file=sys.stderr)
+        sys.exit(1)
+    merge(args.outdir, [shard_dir(args.outdir, i) for i in range(args.shards)])
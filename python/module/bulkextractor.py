@@ -115,10 +115,16 @@ class Session(object):
             configure(self._handle, MEMHIST_LIMIT, featurefile,
                     histogram_limit);
 
-    def analyze_buffer(self, buf):
-        """Run bulk_extractor over the supplied buffer."""
+    def analyze_buffer(self, buf, offset=None):
+        """
+        Run bulk_extractor over the supplied buffer, which is not copied.  Its
+        features are reported at offset, or after the previous buffer.
+        """
         handle = self._get_handle()
-        analyze_buffer(handle, buf)
+        if offset is None:
+            analyze_buffer(handle, buf)
+        else:
+            analyze_buffer_at(handle, buf, offset)
 
     def analyze_device(self, path, sample_rate, sample_size):
         """
@@ -262,6 +268,12 @@ def analyze_buffer(handle, buf):
     given handle's callback.  Buf can be either a bytes object or a string.
     """
     return lib_be.bulk_extractor_analyze_buf(handle, buf, len(buf))
+def analyze_buffer_at(handle, buf, offset):
+    """
+    Analyze the supplied buffer as analyze_buffer() does, reporting its
+    features at the given logical offset.
+    """
+    return lib_be.bulk_extractor_analyze_buf_at(handle, buf, len(buf), offset)
 def analyze_device(handle, path, sample_rate, sample_size):
     """
     Analyze the device at the given path with bulk_extractor, returning results
@@ -312,6 +324,13 @@ def lib_init(lib_name=None):
             c_char_p, # the buffer
             c_size_t, # buffer length
             ]
+    lib_be.bulk_extractor_analyze_buf_at.restype = c_int
+    lib_be.bulk_extractor_analyze_buf_at.argtypes = [
+            BeHandle, # session obtained from bulk_extractor_open
+            c_char_p, # the buffer
+            c_size_t, # buffer length
+            c_uint64, # logical offset of the buffer
+            ]
     lib_be.bulk_extractor_analyze_dev.restype = c_int
     lib_be.bulk_extractor_analyze_dev.argtypes = [
             BeHandle, # session obtained from bulk_extractor_open
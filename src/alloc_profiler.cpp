@@ -0,0 +1,60 @@
+#include "config.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define ALLOC_USABLE_SIZE(p) malloc_usable_size(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define ALLOC_USABLE_SIZE(p) malloc_size(p)
+#endif
+
+#include "alloc_profiler.h"
+
+namespace {
+    thread_local alloc_profiler::counts mine {};
+}
+
+alloc_profiler::counts &alloc_profiler::current()
+{
+    return mine;
+}
+
+void alloc_profiler::reset_peak()
+{
+    mine.peak = mine.outstanding;
+}
+
+void *alloc_profiler::allocate(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    if (enabled.load(std::memory_order_relaxed)) {
+        counts &c = mine;
+        c.allocations++;
+        c.bytes += size;
+#ifdef ALLOC_USABLE_SIZE
+        c.outstanding += ALLOC_USABLE_SIZE(p);
+        if (c.outstanding > c.peak) c.peak = c.outstanding;
+#endif
+    }
+    return p;
+}
+
+void alloc_profiler::release(void *p) noexcept
+{
+#ifdef ALLOC_USABLE_SIZE
+    if (p != nullptr && enabled.load(std::memory_order_relaxed)) mine.outstanding -= ALLOC_USABLE_SIZE(p);
+#endif
+    free(p);
+}
+
+/* The replacements; the nothrow and sized forms of the library call these */
+void *operator new(size_t size) { return alloc_profiler::allocate(size); }
+void *operator new[](size_t size) { return alloc_profiler::allocate(size); }
+void operator delete(void *p) noexcept { alloc_profiler::release(p); }
+void operator delete[](void *p) noexcept { alloc_profiler::release(p); }
+void operator delete(void *p, size_t) noexcept { alloc_profiler::release(p); }
+void operator delete[](void *p, size_t) noexcept { alloc_profiler::release(p); }
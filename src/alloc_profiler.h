@@ -0,0 +1,39 @@
+#ifndef ALLOC_PROFILER_H
+#define ALLOC_PROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * alloc_profiler:
+ * Counts the allocations made through operator new, for each thread, so that scanner_watchdog can
+ * charge them to the scanner that the thread is running. alloc_profiler.cpp replaces the global
+ * operator new and delete; they count only while enabled (-S profile_allocations=YES), so that an
+ * ordinary run pays for one test of a flag per allocation.
+ *
+ * Outstanding bytes are the allocator's usable sizes of the blocks this thread allocated, less those
+ * it freed, so a block freed by another thread makes this thread's count low and that thread's high.
+ * Where the usable size of a block is not known (neither glibc nor macOS), bytes are counted but
+ * outstanding bytes are not.
+ */
+
+class alloc_profiler {
+public:
+    struct counts {
+        uint64_t allocations {0};
+        uint64_t bytes {0};             // bytes requested
+        int64_t  outstanding {0};       // bytes allocated and not yet freed, by this thread
+        int64_t  peak {0};              // the most outstanding since reset_peak()
+    };
+
+    static inline std::atomic<bool> enabled {false};
+
+    static counts &current();               // this thread's
+    static void reset_peak();
+
+    static void *allocate(size_t size);     // for operator new
+    static void release(void *p) noexcept;  // for operator delete
+};
+
+#endif
@@ -49,11 +49,18 @@
 #include <cstring>
 #include <cinttypes>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define B64_DECODE_SSSE3
+#endif
+
+#include "base64_forensic.h"
+#include "cpu_dispatch.h"
+#include "scanner_tables.h"
+
 
 #define Assert(Cond) if (!(Cond)) abort()
 
-static const char Base64[] =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static const char Pad64 = '=';
 
 /* (From RFC1521 and draft-ietf-dnssec-secext-03.txt)
@@ -125,10 +132,60 @@ static const char Pad64 = '=';
  */
 #define puts(x) {}
 
+#ifdef B64_DECODE_SSSE3
+/*
+ * Decode 16 characters into 12 bytes, if all 16 are base64 characters (no whitespace, padding or
+ * anything else); otherwise return false and leave the characters to the byte-at-a-time decoder.
+ * The 6-bit values come from range compares, then pmaddubsw and pmaddwd merge them into 24-bit
+ * groups and pshufb packs those. 16 bytes are stored, so the target must have 16 bytes of room.
+ */
+__attribute__((target("ssse3")))
+static bool decode16_ssse3(const char *src, unsigned char *target)
+{
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    auto in_range = [&c](char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), c));
+    };
+    const __m128i upper = in_range('A', 'Z');
+    const __m128i lower = in_range('a', 'z');
+    const __m128i digit = in_range('0', '9');
+    const __m128i v62   = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')), _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+    const __m128i v63   = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(v62, v63)));
+    if (_mm_movemask_epi8(valid) != 0xffff) return false;
+
+    /* value = c + offset, where the offset depends on the class */
+    __m128i offset = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+    offset = _mm_or_si128(offset, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+    offset = _mm_or_si128(offset, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+    __m128i values = _mm_add_epi8(c, offset);
+    values = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(v62, v63), values),
+                          _mm_or_si128(_mm_and_si128(v62, _mm_set1_epi8(62)), _mm_and_si128(v63, _mm_set1_epi8(63))));
+
+    const __m128i ab_cd = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)); // a<<6|b, c<<6|d
+    const __m128i abcd  = _mm_madd_epi16(ab_cd, _mm_set1_epi32(0x00011000));     // ab<<12|cd
+    const __m128i out   = _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(target), out);
+    return true;
+}
+
+#endif
+
+/* No kernel: the characters are decoded one at a time */
+static cpu_dispatch::table<bool (*)(const char *src, unsigned char *target)> decode16_kernels("base64", {
+#ifdef B64_DECODE_SSSE3
+    {"ssse3", cpu_dispatch::SSSE3, decode16_ssse3},
+#endif
+    {"scalar", 0, nullptr},
+});
+
 int b64_pton_forensic(char const *src, int srclen, unsigned char *target, size_t targsize)
 {
         int tarindex=0, state=0, ch=0;
-        const char *pos=0;
+        int value=0;
+#ifdef B64_DECODE_SSSE3
+        const auto decode16 = decode16_kernels.fn();
+#endif
 
         state = 0;
         tarindex = 0;
@@ -137,6 +194,21 @@ int b64_pton_forensic(char const *src, int srclen, unsigned char *target, size_t
         // while ((ch = *src++) != '\0' && srclen>0){
         // should be:
         while ((srclen>0) && ((ch = *src++) != '\0') ){
+#ifdef B64_DECODE_SSSE3
+            /* At a group boundary, decode runs of 16 base64 characters at once */
+            if (state==0 && decode16 && target) {
+                src--;
+                while (srclen >= 16 && static_cast<size_t>(tarindex) + 16 <= targsize
+                       && decode16(src, target + tarindex)) {
+                    src += 16;
+                    srclen -= 16;
+                    tarindex += 12;
+                }
+                if (srclen<=0) break;   /* ch is the last character decoded */
+                ch = *src++;
+                if (ch=='\0') break;
+            }
+#endif
             srclen--;
                 if (isspace(ch))        /* Skip whitespace anywhere. */
                         continue;
@@ -148,9 +220,9 @@ int b64_pton_forensic(char const *src, int srclen, unsigned char *target, size_t
                 if(ch=='_') ch='/';
 
 
-                pos = strchr(Base64, ch);
+                value = scanner_tables::base64_values[static_cast<unsigned char>(ch)];
 
-                if (pos == 0){          /* A non-base64 character. */
+                if (value < 0){         /* A non-base64 character. */
                     puts("B64 Fail at 1");
                     /* return (-1);*/
                     return tarindex;
@@ -164,7 +236,7 @@ int b64_pton_forensic(char const *src, int srclen, unsigned char *target, size_t
                                 /* return (-1); */
                                 return tarindex;
                             }
-                            target[tarindex] = (pos - Base64) << 2;
+                            target[tarindex] = value << 2;
                         }
                         state = 1;
                         break;
@@ -176,8 +248,8 @@ int b64_pton_forensic(char const *src, int srclen, unsigned char *target, size_t
                                 return tarindex;
                                 
                             }
-                            target[tarindex]   |=  (pos - Base64) >> 4;
-                            target[tarindex+1]  = ((pos - Base64) & 0x0f) << 4 ;
+                            target[tarindex]   |=  value >> 4;
+                            target[tarindex+1]  = (value & 0x0f) << 4 ;
                         }
                         tarindex++;
                         state = 2;
@@ -189,8 +261,8 @@ int b64_pton_forensic(char const *src, int srclen, unsigned char *target, size_t
                                 /* return (-1);*/
                                 return tarindex;
                             }
-                            target[tarindex]   |=  (pos - Base64) >> 2;
-                            target[tarindex+1]  = ((pos - Base64) & 0x03) << 6;
+                            target[tarindex]   |=  value >> 2;
+                            target[tarindex+1]  = (value & 0x03) << 6;
                         }
                         tarindex++;
                         state = 3;
@@ -202,7 +274,7 @@ int b64_pton_forensic(char const *src, int srclen, unsigned char *target, size_t
                                 /* return (-1); */
                                 return tarindex;
                             }
-                            target[tarindex] |= (pos - Base64);
+                            target[tarindex] |= value;
                         }
                         tarindex++;
                         state = 0;
@@ -0,0 +1,255 @@
+/**
+ * bulk_diff.cpp:
+ * The differences between two output directories; see bulk_diff.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bulk_diff.h"
+#include "feature_file_sort.h"
+#include "feature_files.h"
+
+namespace {
+    /* The field after the first tab of a line: the feature of a feature file, the value of a histogram */
+    std::string_view second_field(std::string_view line) {
+        const size_t tab1 = line.find('\t');
+        if (tab1 == std::string_view::npos) return {};
+        const size_t tab2 = line.find('\t', tab1 + 1);
+        return line.substr(tab1 + 1, tab2 == std::string_view::npos ? std::string_view::npos : tab2 - tab1 - 1);
+    }
+
+    std::string_view path_of(std::string_view line) {
+        return line.substr(0, line.find('\t'));
+    }
+
+    std::set<std::filesystem::path> files_under(const std::filesystem::path &dir) {
+        std::set<std::filesystem::path> ret;
+        for (const auto &it : std::filesystem::recursive_directory_iterator(dir)) {
+            if (it.is_regular_file()) ret.insert(std::filesystem::relative(it.path(), dir));
+        }
+        return ret;
+    }
+
+    /* The lines of a feature file that are not comments, one at a time */
+    struct cursor {
+        std::ifstream in;
+        std::string line {};
+        bool ok {false};
+        explicit cursor(const std::filesystem::path &txt): in(txt, std::ios::binary) {
+            if (!in) throw std::runtime_error("bulk_diff: cannot open " + txt.string());
+            next();
+        }
+        void next() {
+            while ((ok = static_cast<bool>(std::getline(in, line)))) {
+                if (!line.empty() && line[0] != '#') return;
+            }
+        }
+    };
+
+    /* A feature file in the order of feature_line_before(): txt, or a sorted copy of it, removed with the object */
+    class sorted_file {
+    public:
+        explicit sorted_file(const std::filesystem::path &txt): path(txt) {
+            if (bulk_diff::is_sorted(txt)) return;
+            static std::atomic<unsigned> count {0};
+            tmpdir = std::filesystem::temp_directory_path() /
+                ("bulk_diff." + std::to_string(getpid()) + "." + std::to_string(count++));
+            std::filesystem::create_directories(tmpdir);
+            path = tmpdir / txt.filename();
+            std::filesystem::copy_file(txt, path);
+            sort_feature_file(path, SORT_MEMORY_DEFAULT, std::max(std::thread::hardware_concurrency(), 1U));
+        }
+        ~sorted_file() {
+            std::error_code ec;
+            if (!tmpdir.empty()) std::filesystem::remove_all(tmpdir, ec);
+        }
+        sorted_file(const sorted_file &) = delete;
+        sorted_file &operator=(const sorted_file &) = delete;
+        std::filesystem::path path;
+    private:
+        std::filesystem::path tmpdir {};
+    };
+}
+
+uint64_t bulk_diff::count_lines(const std::filesystem::path &txt)
+{
+    std::ifstream in(txt, std::ios::binary);
+    uint64_t lines = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#') lines++;
+    }
+    return lines;
+}
+
+bool bulk_diff::is_sorted(const std::filesystem::path &txt)
+{
+    cursor c(txt);
+    std::string prev;
+    for (; c.ok; c.next()) {
+        if (!prev.empty() && feature_line_before(c.line, prev)) return false;
+        prev.swap(c.line);
+    }
+    return true;
+}
+
+void bulk_diff::compare_files(const std::filesystem::path &pre, const std::filesystem::path &post,
+                              const options &opts, std::ostream &out)
+{
+    const auto pre_files = files_under(pre);
+    const auto post_files = files_under(post);
+    for (const auto &[a, a_files, b_files] : {std::tie(pre, pre_files, post_files), std::tie(post, post_files, pre_files)}) {
+        std::vector<std::filesystem::path> only;
+        std::set_difference(a_files.begin(), a_files.end(), b_files.begin(), b_files.end(), std::back_inserter(only));
+        if (only.empty() && !opts.both) continue;
+        out << "Files only in " << a.string() << ":\n";
+        for (const auto &f : only) {
+            out << "     " << f.string();
+            if (f.extension() == ".txt") out << " (" << count_lines(a / f) << " lines)";
+            out << "\n";
+        }
+    }
+}
+
+void bulk_diff::compare_histogram(const std::filesystem::path &pre, const std::filesystem::path &post,
+                                  const options &opts, std::ostream &out)
+{
+    auto read = [](const std::filesystem::path &txt, const std::function<void(std::string_view, uint64_t)> &fn) {
+        std::ifstream in(txt, std::ios::binary);
+        if (!in) throw std::runtime_error("bulk_diff: cannot open " + txt.string());
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.compare(0, 2, "n=") != 0) continue;
+            fn(second_field(line), strtoull(line.c_str() + 2, nullptr, 10));
+        }
+    };
+    std::unordered_map<std::string, uint64_t> pre_counts;
+    read(pre, [&pre_counts](std::string_view value, uint64_t count) { pre_counts[std::string(value)] += count; });
+
+    struct row {
+        uint64_t pre {0}, post {0};
+        std::string value {};
+        int64_t delta() const { return int64_t(post) - int64_t(pre); }
+    };
+    std::vector<row> rows;
+    uint64_t differences = 0;
+    auto add = [&](uint64_t v1, uint64_t v2, std::string value) {
+        if (v1 != v2) differences++;
+        if (v2 > v1 || (v2 == v1 && opts.same) || (v2 < v1 && opts.smaller)) rows.push_back(row{v1, v2, std::move(value)});
+    };
+    read(post, [&](std::string_view value, uint64_t count) {
+        auto it = pre_counts.find(std::string(value));
+        if (it == pre_counts.end()) {
+            add(0, count, std::string(value));
+        } else {
+            add(it->second, count, std::string(value));
+            pre_counts.erase(it);
+        }
+    });
+    for (auto &[value, count] : pre_counts) add(count, 0, value);
+
+    std::sort(rows.begin(), rows.end(), [](const row &a, const row &b) {
+        return std::make_tuple(-a.delta(), std::string_view(a.value), a.post, a.pre) <
+            std::make_tuple(-b.delta(), std::string_view(b.value), b.post, b.pre);
+    });
+    const std::string name = pre.filename().string();
+    if (!rows.empty()) {
+        out << name << "\n# in PRE\t# in POST\t" << "\xe2\x88\x86" << "\tValue\n";  // the increment sign
+        for (const auto &r : rows) out << r.pre << "\t" << r.post << "\t" << r.delta() << "\t" << r.value << "\n";
+    }
+    if (differences == 0 && opts.both) out << name << ": No differences\n";
+}
+
+void bulk_diff::compare_features(const std::filesystem::path &pre, const std::filesystem::path &post,
+                                 const options &opts, std::ostream &out)
+{
+    const sorted_file pre_sorted(pre), post_sorted(post);
+    cursor a(pre_sorted.path), b(post_sorted.path);
+    const std::string pre_name = pre.parent_path().string(), post_name = post.parent_path().string();
+    out << "Compare features " << pre.filename().string() << "\n";
+    while (a.ok || b.ok) {
+        const int c = !a.ok ? 1 : !b.ok ? -1 : compare_forensic_paths(path_of(a.line), path_of(b.line));
+        if (c < 0) {
+            out << path_of(a.line) << " " << second_field(a.line) << " is only in " << pre_name << "\n";
+            a.next();
+        } else if (c > 0) {
+            out << path_of(b.line) << " " << second_field(b.line) << " is only in " << post_name << "\n";
+            b.next();
+        } else {
+            /* the lines at this path in both */
+            const std::string path(path_of(a.line));
+            for (; a.ok && compare_forensic_paths(path_of(a.line), path) == 0; a.next()) {
+                if (opts.both) out << path << " " << second_field(a.line) << " IN BOTH\n";
+            }
+            for (; b.ok && compare_forensic_paths(path_of(b.line), path) == 0; b.next()) {}
+        }
+    }
+    if (a.in.bad() || b.in.bad()) throw std::runtime_error("bulk_diff: cannot read " + pre.filename().string());
+}
+
+void bulk_diff::diff(const std::filesystem::path &pre, const std::filesystem::path &post, const options &opts,
+                     std::ostream &out)
+{
+    for (const auto &dir : {pre, post}) {
+        if (!std::filesystem::is_directory(dir)) throw std::runtime_error("bulk_diff: " + dir.string() + " is not a directory");
+    }
+    compare_files(pre, post, opts, out);
+
+    std::set<std::string> pre_histograms, post_histograms, pre_features, post_features;
+    for (const auto &[dir, histograms, features] : {std::tie(pre, pre_histograms, pre_features),
+                                                    std::tie(post, post_histograms, post_features)}) {
+        for (const auto &txt : output_text_files(dir, false)) {
+            (is_histogram_file(txt) ? histograms : features).insert(txt.filename().string());
+        }
+    }
+    for (const auto &name : pre_histograms) {
+        if (post_histograms.count(name)) compare_histogram(pre / name, post / name, opts, out);
+    }
+    if (!opts.features) return;
+    for (const auto &name : pre_features) {
+        if (!opts.feature.empty() && name != opts.feature + ".txt") continue;
+        if (post_features.count(name)) compare_features(pre / name, post / name, opts, out);
+    }
+}
+
+int bulk_diff::main(int argc, char * const *argv, std::ostream &out, std::ostream &err)
+{
+    options opts;
+    std::vector<std::string> dirs;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--features") == 0) opts.features = true;
+        else if (strcmp(argv[i], "--same") == 0) opts.same = true;
+        else if (strcmp(argv[i], "--smaller") == 0) opts.smaller = true;
+        else if (strcmp(argv[i], "--both") == 0) opts.both = true;
+        else if (strcmp(argv[i], "--feature") == 0 && i + 1 < argc) {
+            opts.feature = argv[++i];
+            opts.features = true;
+        }
+        else dirs.push_back(argv[i]);
+    }
+    if (dirs.size() != 2) {
+        err << "usage: bulk_extractor --diff [--features] [--feature NAME] [--same] [--smaller] [--both] PRE POST\n";
+        return 1;
+    }
+    try {
+        diff(dirs[0], dirs[1], opts, out);
+    } catch (const std::exception &e) {
+        err << "bulk_extractor: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
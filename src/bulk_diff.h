@@ -0,0 +1,56 @@
+#ifndef BULK_DIFF_H
+#define BULK_DIFF_H
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+
+/**
+ * bulk_diff:
+ * bulk_extractor --diff [OPTIONS] PRE POST compares two output directories, as python/bulk_diff.py
+ * does, without holding their feature files in memory:
+ *
+ *   - the files that are only in one of them (with the lines of the *.txt files);
+ *   - for each histogram in both, the features whose counts went up (--same: or stayed the same;
+ *     --smaller: or went down), by how much they went up and then by feature;
+ *   - with --features, for each feature file in both (--feature NAME: the NAME.txt alone), the
+ *     forensic paths at which one has features and the other does not; --both also lists the
+ *     features at the paths in both.
+ *
+ * The feature files are compared with a merge join on their forensic paths, in the order of
+ * feature_file_sort, reading each file once; the files of a run with -S sort_feature_files=YES are in
+ * that order already, and any other is first sorted into a copy in a temporary directory, in bounded
+ * memory. A histogram is much smaller than its feature file, and the one of PRE is read into memory.
+ */
+
+class bulk_diff {
+public:
+    struct options {
+        bool features {false};
+        bool same {false};
+        bool smaller {false};
+        bool both {false};
+        std::string feature {};             // only this feature file, if not empty
+    };
+
+    /* argv[0] is "--diff"; returns the exit status */
+    static int main(int argc, char * const *argv, std::ostream &out, std::ostream &err);
+    /* Throws std::runtime_error if a directory or file cannot be read */
+    static void diff(const std::filesystem::path &pre, const std::filesystem::path &post, const options &opts,
+                     std::ostream &out);
+
+    static void compare_files(const std::filesystem::path &pre, const std::filesystem::path &post,
+                              const options &opts, std::ostream &out);
+    static void compare_histogram(const std::filesystem::path &pre, const std::filesystem::path &post,
+                                  const options &opts, std::ostream &out);
+    static void compare_features(const std::filesystem::path &pre, const std::filesystem::path &post,
+                                 const options &opts, std::ostream &out);
+
+    /* The lines of txt that are not comments */
+    static uint64_t count_lines(const std::filesystem::path &txt);
+    /* True if txt is in the order of feature_line_before() */
+    static bool is_sorted(const std::filesystem::path &txt);
+};
+
+#endif
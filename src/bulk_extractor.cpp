@@ -9,6 +9,9 @@
 
 #include <ctype.h>
 #include <fcntl.h>
+#include <algorithm>
+#include <fstream>
+#include <future>
 #include <set>
 #include <setjmp.h>
 #include <vector>
@@ -40,10 +43,48 @@ int _CRT_fmode = _O_BINARY;
 #include "be13_api/word_and_context_list.h"
 #include "be13_api/path_printer.h"
 
+#include "alloc_profiler.h"
+#include "candidate_offload.h"
 #include "bulk_extractor.h"
+#include "carve_extents.h"
+#include "carve_index.h"
+#include "carve_writer.h"
+#include "container_limits.h"
+#include "content_affinity.h"
+#include "content_cache.h"
+#include "cpu_dispatch.h"
+#include "feature_census.h"
+#include "feature_quotas.h"
+#include "feature_file_columnar.h"
+#include "feature_file_gzip.h"
+#include "feature_file_index.h"
+#include "feature_file_sort.h"
+#include "feature_shards.h"
+#include "feature_stream.h"
 #include "findopts.h"
+#include "fs_map.h"
+#include "heavy_hitters.h"
+#include "identify_filenames.h"
+#include "io_throttle.h"
 #include "image_process.h"
+#include "memory_governor.h"
+#include "net_flows.h"
+#include "output_checkpoint.h"
+#include "page_allocator.h"
+#include "page_dedup.h"
+#include "page_stash.h"
+#include "path_batch.h"
+#include "perf_counters.h"
 #include "phase1.h"
+#include "recorder_handle.h"
+#include "recursion_spill.h"
+#include "remote_workers.h"
+#include "scanner_priority.h"
+#include "scanner_tiles.h"
+#include "scanner_watchdog.h"
+#include "signature_prefilter.h"
+#include "state_dump.h"
+#include "trace_writer.h"
 
 /* Bring in the definitions  */
 #include "bulk_extractor_scanners.h"
@@ -95,7 +136,7 @@ int _CRT_fmode = _O_BINARY;
     std::cout << "   -f <regex>   - find occurrences of <regex>; may be repeated.\n";
     std::cout << "                  results go into find.txt\n";
     std::cout << "   -q           - quiet - no status output (changed in v2.0).\n";
-    std::cout << "   -s frac[:passes] - Set random sampling parameters\n";
+    std::cout << "   -s frac[:passes[:strata]] - Set random sampling parameters\n";
     std::cout << "   -0           - Do not run notification thread\n";
     std::cout << "   -1           - bulk_extractor v1.x legacy mode\n";
     std::cout << "\nTuning parameters:\n";
@@ -104,7 +145,9 @@ int _CRT_fmode = _O_BINARY;
     std::cout << "   -S fr:<name>:window_before=NN  specifies context window before to NN for recorder\n";
     std::cout << "   -S fr:<name>:window_after=NN   specifies context window after to NN for recorder\n";
     std::cout << "   -G NN        - specify the page size (default " << cfg.opt_pagesize << ")\n";
+    std::cout << "   -G auto      - choose the page size for the image, threads and scanners, and split the last pages\n";
     std::cout << "   -g NN        - specify margin (default " <<cfg.opt_marginsize << ")\n";
+    std::cout << "   -g auto      - the largest margin that the enabled scanners need\n";
     std::cout << "   -j NN        - Number of analysis threads to run (default " << std::thread::hardware_concurrency() << ")\n";
     std::cout << "   -J           - no threading: read and process data in the primary thread.\n";
     std::cout << "   -M nn        - sets max recursion depth (default " << scanner_config::DEFAULT_MAX_DEPTH << ")\n";
@@ -131,6 +174,8 @@ int _CRT_fmode = _O_BINARY;
  */
 void validate_path( const std::filesystem::path fn)
 {
+    if ( image_process::is_url( fn.string() ) || image_process::is_synthetic( fn.string() ) ||
+         image_process::is_remote( fn.string() )) return; // checked when it is opened
     if ( !std::filesystem::exists( fn )){
         std::cerr << "file does not exist: " << fn << std::endl ;
         throw std::runtime_error( "file not found." );
@@ -157,6 +202,23 @@ static void add_if_present( std::vector<std::string> &scanner_dirs,const std::st
     }
 }
 
+/* Stops a -S alert_sink or feature_sink stream once its lines are sent, and reports what it sent */
+static void stop_feature_stream( dfxml_writer &xreport, const std::string &element, feature_stream &stream)
+{
+    stream.stop();
+    xreport.xmlout( element, "",
+                    "sink='" + dfxml_writer::xmlescape( stream.sink_name() ) + "'"
+                    + " lines_sent='" + std::to_string( stream.lines_sent() ) + "'"
+                    + " lines_dropped='" + std::to_string( stream.lines_dropped() ) + "'"
+                    + " carves_sent='" + std::to_string( stream.carves_sent() ) + "'"
+                    + " carves_dropped='" + std::to_string( stream.carves_dropped() ) + "'",
+                    false );
+    if ( stream.lines_dropped() > 0 || stream.carves_dropped() > 0 ) {
+        std::cerr << stream.lines_dropped() << " lines and " << stream.carves_dropped()
+                  << " carved files could not be sent to " << stream.sink_name() << std::endl;
+    }
+}
+
 int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char * const *argv)
 {
     mtrace();
@@ -171,6 +233,7 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
     Phase1::Config   cfg;  // config for the image_processing system
 
     cfg.fraction_done = &fraction_done;
+    cfg.apply_container_limits( container_limits::read() );
 
 #ifdef USE_SQLITE
     bool        opt_write_feature_files = true;
@@ -243,15 +306,16 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
          "directories for scanner shared libraries. Multiple directories can be specified. "
          "Default directories include /usr/local/lib/bulk_extractor, /usr/lib/bulk_extractor "
          "and any directories specified in the BE_PATH environment variable.", cxxopts::value<std::vector<std::string>>())
-        ("p,path",         "print the value of <path>[:length][/h][/r] with optional length, hex output, or raw output.", cxxopts::value<std::string>())
+        ("p,path",         "print the value of <path>[:length][/h][/r] with optional length, hex output, or raw output; @FILE for the paths in FILE", cxxopts::value<std::string>())
         ("q,quit",         "no status output")
         ("r,alert_list",   "file to read alert list from", cxxopts::value<std::string>())
         ("R,recurse",      "treat image file as a directory to recursively explore")
         ("S,set",          "set a name=value option", cxxopts::value<std::vector<std::string>>())
-        ("s,sampling",     "random sampling parameter frac[:passes]", cxxopts::value<std::string>())
+        ("s,sampling",     "random sampling parameter frac[:passes[:strata]]", cxxopts::value<std::string>())
         ("V,version",      "Display PACKAGE_VERSION (currently) " PACKAGE_VERSION)
         ("w,stop_list",    "file to read stop list from", cxxopts::value<std::string>())
         ("Y,scan",         "specify <start>[-end] of area on disk to scan", cxxopts::value<std::string>())
+        ("shard",          "scan shard <index>/<count> of the image; merge the outputs with bulk_shard.py", cxxopts::value<std::string>())
         ("z,page_start",   "specify a starting page number", cxxopts::value<int>())
         ("Z,zap",          "wipe the output directory (recursively) before starting")
         ("0,no_notify",    "disable real-time notification")
@@ -304,8 +368,16 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
         }
     } catch ( cxxopts::option_has_no_value_exception &e ) { }
 
-    cfg.opt_pagesize   = scaled_stoi64( result["pagesize"].as<std::string>());
-    cfg.opt_marginsize = scaled_stoi64( result["marginsize"].as<std::string>());
+    if ( result["pagesize"].as<std::string>() == "auto" ) {
+        cfg.opt_auto_pagesize = true;   // chosen once the image is open
+    } else {
+        cfg.opt_pagesize   = scaled_stoi64( result["pagesize"].as<std::string>());
+    }
+    if ( result["marginsize"].as<std::string>() == "auto" ) {
+        cfg.opt_auto_marginsize = true; // chosen once the scanners are enabled
+    } else {
+        cfg.opt_marginsize = scaled_stoi64( result["marginsize"].as<std::string>());
+    }
     cfg.opt_info       = result.count( "info" );
 
     try {
@@ -361,6 +433,13 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
     } catch ( cxxopts::option_has_no_value_exception &e ) { }
 
 
+    try {
+        cfg.set_shard_parameters( result["shard"].as<std::string>());
+        if ( cfg.opt_scan_start || cfg.opt_scan_end ) {
+            throw std::runtime_error( "--shard cannot be used with -Y: each shard scans the range that --shard gives it" );
+        }
+    } catch ( cxxopts::option_has_no_value_exception &e ) { }
+
     try {
         cfg.opt_page_start = result["page_start"].as<int>();
     } catch ( cxxopts::option_has_no_value_exception &e ) { }
@@ -385,6 +464,101 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
     //sc.get_global_config( "write_feature_files",&opt_write_feature_files,"Write features to flat files" );
     //sc.get_global_config( "write_feature_sqlite3",&opt_write_sqlite3,"Write feature files to report.sqlite3" );
     sc.get_global_config( "report_read_errors",&cfg.opt_report_read_errors,"Report read errors" );
+    sc.get_global_config( "read_ahead_pages",&cfg.read_ahead_pages,"Number of pages read ahead of the scanners (0 to read inline)" );
+    sc.get_global_config( "small_input_pages",&cfg.small_input_pages,"Scan images of no more than this many pages in the main thread, without the worker threads, readers or notifier (0 to always use them)" );
+    sc.get_global_config( "read_threads",&cfg.read_threads,"Number of threads reading (and decompressing) pages from images that support it, such as E01" );
+    sc.get_global_config( "trace",&cfg.opt_trace,"Write a Chrome trace (for perfetto) of the scanner calls, reads and waits to trace.json" );
+    sc.get_global_config( "perf_counters",&cfg.opt_perf_counters,"Count the cycles, instructions, cache misses and branch misses of each scanner with perf_event_open (Linux), for the <scanner_time> elements of report.xml" );
+    sc.get_global_config( "profile_allocations",&cfg.opt_profile_allocations,"Count the allocations, bytes allocated and peak bytes outstanding of each scanner, for the <scanner_time> elements of report.xml" );
+    sc.get_global_config( "live_stats",&cfg.opt_live_stats,"Write stats.json and stats.prom (Prometheus) to the output directory as the scan runs" );
+    sc.get_global_config( "sort_feature_files",&cfg.opt_sort_feature_files,"Sort each feature file by forensic path at the end of the run, so that the output is the same however the threads ran" );
+    sc.get_global_config( "sort_memory",&cfg.sort_memory,"Bytes of lines the feature file sort holds in memory at once; larger files are sorted in runs and merged" );
+    sc.get_global_config( "identify_filenames",&cfg.identify_filenames_dfxml,"DFXML file map of the image (from fiwalk), read during the scan; at the end of the run, the feature files are annotated with the file of each feature in annotated/" );
+    sc.get_global_config( "index_feature_files",&cfg.opt_index_feature_files,"Write an index (*.txt.index) of where the features of each part of the image are in each feature file at the end of the run" );
+    sc.get_global_config( "index_block_size",&cfg.index_block_size,"Bytes of lines in each block of a feature file index" );
+    sc.get_global_config( "columnar_feature_files",&cfg.opt_columnar_feature_files,"Write a binary, columnar copy (*.col) of each feature file at the end of the run" );
+    sc.get_global_config( "columnar_dictionary_bytes",&cfg.columnar_dictionary_bytes,"Bytes of distinct values kept for dictionary encoding each column of a *.col file" );
+    sc.get_global_config( "gzip_feature_files",&cfg.opt_gzip_feature_files,"Compress the feature files and histograms to *.txt.gz, in frames with a *.txt.gz.idx index, at the end of the run" );
+    sc.get_global_config( "gzip_frame_size",&cfg.gzip_frame_size,"Bytes of lines in each frame of a compressed feature file" );
+    sc.get_global_config( "numa_readers",&cfg.opt_numa_readers,"Run at least one reader thread per NUMA node, pinned to that node" );
+    sc.get_global_config( "recycle_pages",&cfg.opt_recycle_pages,"Keep freed page buffers in the heap for reuse instead of returning them to the OS" );
+    sc.get_global_config( "huge_pages",&cfg.opt_huge_pages,"Back page buffers with transparent huge pages" );
+    sc.get_global_config( "dir_batch_files",&cfg.dir_batch_files,"With -R, the number of files read by each reader task" );
+    sc.get_global_config( "queue_high_water",&cfg.queue_high_water,"Bytes of queued pages at which reading pauses (0 for threads*(pagesize+marginsize))" );
+    sc.get_global_config( "queue_low_water",&cfg.queue_low_water,"Bytes of queued pages at which reading resumes (0 for half of queue_high_water)" );
+    sc.get_global_config( "queue_stash_bytes",&cfg.queue_stash_bytes,"Above queue_high_water, bytes of compressed pages that reading may run ahead into before it pauses (0 to pause at once)" );
+    sc.get_global_config( "memory_budget",&cfg.memory_budget,"Memory budget in bytes, of the heap in use (or the resident size where that is unknown); reading and large recursive allocations wait for it (0 for none)" );
+    sc.get_global_config( "memory_depth_reserve",&cfg.memory_depth_reserve,"With memory_budget, the fraction of each recursion depth's share of the budget left for the depths below it, so that shallow work waits before deep work (e.g. 0.25)" );
+    sc.get_global_config( "recursion_spill_dir",&cfg.recursion_spill_dir,"With memory_budget, a directory in which decoded children that would go over the budget wait, as files, to be scanned when memory frees up" );
+    sc.get_global_config( "io_bandwidth",&cfg.io_bandwidth,"Most bytes of the image read a second, for shared storage (0 for no limit)" );
+    sc.get_global_config( "io_iops",&cfg.io_iops,"Most reads of the image a second (0 for no limit)" );
+    sc.get_global_config( "io_control_file",&cfg.io_control_file,"File of bandwidth=N and iops=N lines that changes io_bandwidth and io_iops while the job runs; read again when it is modified or on SIGUSR1" );
+    sc.get_global_config( "dedup_recursion",&cfg.opt_dedup_recursion,"Do not rescan decompressed or decoded data identical to data already scanned at the same depth" );
+    sc.get_global_config( "dedup_recursion_memory",&cfg.dedup_recursion_memory,"With dedup_recursion, bytes of lock-free fingerprint table to remember the content in (0 for an exact set of every hash)" );
+    sc.get_global_config( "scanner_affinity",&cfg.opt_scanner_affinity,"Skip scanners that cannot match in recursed-into content (such as file system scanners on text extracted by msxml and pdf)" );
+    sc.get_global_config( "scanner_classes",&cfg.scanner_classes,"Priority classes of scanners (NAME:cheap, NAME:normal or NAME:expensive, separated by commas), in place of the built-in ones" );
+    sc.get_global_config( "scanner_class_threads",&cfg.scanner_class_threads,"Most worker threads in the scanners of each class (e.g. expensive:2,normal:6); the calls that wait are let in smallest sbuf first" );
+    sc.get_global_config( "auto_threads",&cfg.opt_auto_threads,"Move the number of workers scanning at once between 1 and -j while the job runs, from the producer's waits, the workers' idle time and the memory headroom" );
+    sc.get_global_config( "tiled_scanners",&cfg.tiled_scanners,"Scanners (separated by commas) run together over each page a tile at a time, so that the page is read from memory once for all of them (aes,windirs)" );
+    sc.get_global_config( "tile_bytes",&cfg.tile_bytes,"With tiled_scanners, the bytes of each tile (a multiple of 4096)" );
+    sc.get_global_config( "offload",&cfg.offload,"Backend that searches the depth-0 pages for AES key schedule candidates, which are validated on the CPU (cpu, or a device backend built in)" );
+    sc.get_global_config( "cpu_isa",&cfg.cpu_isa,"Use only the SIMD kernels of this level: native, scalar, sse2, ssse3, sse4.1, avx2 or avx512 (neon on aarch64), to test or time them" );
+    sc.get_global_config( "skip_high_entropy",&cfg.opt_skip_high_entropy,"Do not run the text scanners (email, accts, wordlist...) on pages that are compressed or encrypted throughout" );
+    sc.get_global_config( "histogram_only",&cfg.histogram_only,"Recorders (separated by commas) whose features go only to their histograms, with no feature file (e.g. domain,url)" );
+    sc.get_global_config( "approximate_histograms",&cfg.approximate_histograms,"Recorders (separated by commas) whose histograms list only their most frequent features, counted in bounded memory from the feature file (e.g. url,domain)" );
+    sc.get_global_config( "histogram_top_k",&cfg.histogram_top_k,"The features written to each approximate histogram" );
+    sc.get_global_config( "feature_shards",&cfg.feature_shards,"Recorders (separated by commas) that write a feature file for each thread, so that the threads do not wait on one file (e.g. email,url,domain)" );
+    sc.get_global_config( "feature_shards_merge",&cfg.feature_shards_merge,"Merge each recorder's per-thread files into its feature file and histograms at the end of the run (0 to leave them, as bulk_extractor_reader.py reads them)" );
+    sc.get_global_config( "page_dedup",&cfg.page_dedup,"Recorders (separated by commas, or all) that write a feature found again in a page with the same context once, with a count" );
+    sc.get_global_config( "carve_dedup",&cfg.carve_dedup,"Recorders (separated by commas, or all) that record objects carved before as references to the first copy instead of writing them again" );
+    sc.get_global_config( "carve_writer_threads",&cfg.carve_writer_threads,"Threads that write carved files, so that scanners do not wait for them (0 to carve in the scanner)" );
+    sc.get_global_config( "carve_queue_bytes",&cfg.carve_queue_bytes,"Bytes of carved objects queued for the carve writers; scanners wait when the queue is full" );
+    sc.get_global_config( "straggler_seconds",&cfg.straggler_seconds,"Report scanner calls that take longer than this many seconds, live and in the report" );
+    sc.get_global_config( "image_hash_alg",&cfg.image_hash_alg,"Algorithm used to hash the disk image (sha1 or sha256)" );
+    sc.get_global_config( "sampling_seed",&cfg.sampling_seed,"Seed for random sampling (-s); the same seed samples the same blocks" );
+    sc.get_global_config( "sampling_block",&cfg.sampling_block,"Bytes in each unit sampled by -s, up to the page size (0 for a page)" );
+    sc.get_global_config( "sampling_coalesce",&cfg.sampling_coalesce,"Read units sampled by -s together when they are no more than this many bytes apart" );
+    sc.get_global_config( "raw_mmap",&cfg.opt_raw_mmap,"Memory-map raw images instead of reading them (zero-copy pages)" );
+    sc.get_global_config( "raw_direct",&cfg.opt_raw_direct,"Read raw images and devices unbuffered (O_DIRECT), bypassing the page cache" );
+    sc.get_global_config( "http_cache_dir",&cfg.opt_http_cache_dir,"Directory in which to cache blocks of http://, https:// and s3:// images" );
+    sc.get_global_config( "ewf_cache_mb",&cfg.opt_ewf_cache_mb,"Megabytes of decompressed E01 chunks kept for all of the reader threads (0 for none)" );
+    sc.get_global_config( "skip_constant_pages",&cfg.opt_skip_constant_pages,"Hash but do not scan pages that are all 0x00 or all 0xFF" );
+    sc.get_global_config( "fs_priority",&cfg.fs_priority,"Scan the pages of NTFS and FAT volumes by class, in this order (e.g. unallocated,other,allocated); classes left out are not scanned" );
+    sc.get_global_config( "triage_minutes",&cfg.triage_minutes,"Scan a sample, then the regions with the most features in it, until this many minutes have passed (0 to scan the whole image)" );
+    sc.get_global_config( "triage_sample",&cfg.triage_sample,"With triage_minutes, the fraction of each region scanned in the sample" );
+    sc.get_global_config( "triage_regions",&cfg.triage_regions,"With triage_minutes, the number of regions ranked by the sample" );
+    sc.get_global_config( "known_blocks",&cfg.known_blocks_db,"Database of the 4 KiB blocks of known files (made with --build-known-blocks); runs of them are not scanned" );
+    sc.get_global_config( "alert_sink",&cfg.alert_sink,"Send alert-list hits as they are found to unix:PATH (a socket), fifo:PATH (a named pipe) or an http(s) URL (a webhook POST)" );
+    sc.get_global_config( "feature_sink",&cfg.feature_sink,"Send the features and carved files as they are written to dir:PATH, unix:PATH, fifo:PATH or an http(s) URL (see feature_sink.h)" );
+    sc.get_global_config( "remote_workers",&cfg.remote_workers,"[HOST:]PORT on which to give the pages of the image to remote workers (bulk_extractor remote:HOST:PORT) instead of scanning them" );
+    sc.get_global_config( "remote_token",&cfg.remote_token,"The secret that the remote workers and their producer must share" );
+    sc.get_global_config( "remote_queue_pages",&cfg.remote_queue_pages,"With remote_workers, the pages read and waiting for a worker" );
+    sc.get_global_config( "feature_quotas",&cfg.feature_quotas,"Features a recorder may write (NAME:N, separated by commas); once they are written, the scanners that write only to recorders past their quotas are not called" );
+    sc.get_global_config( "feature_quota_bytes",&cfg.feature_quota_bytes,"Bytes a recorder's feature file may have (NAME:BYTES, separated by commas; K, M and G may be used), as feature_quotas" );
+    sc.get_global_config( "feature_page_quotas",&cfg.feature_page_quotas,"Features a recorder may write on one page (NAME:N, separated by commas); the pages over them are counted in the report" );
+    sc.get_global_config( "feature_census",&cfg.opt_feature_census,"Count the features, distinct features (estimated) and features a second of each recorder as they are written, for the status display and the report" );
+    sc.get_global_config( "checkpoint_seconds",&cfg.checkpoint_seconds,"Seconds between rewrites of the restart checkpoint" );
+    sc.get_global_config( "checkpoint_outputs",&cfg.checkpoint_outputs,"Also checkpoint the feature files every checkpoint_seconds, waiting for the scanners to finish, so that a restart cuts them back instead of appending" );
+    sc.get_global_config( "state_dump",&cfg.state_dump,"Write a snapshot of each thread's scanner calls, the queue, the memory governor and the scanner totals to state_dump-N.json on SIGUSR1 or when outdir/dump_state is created" );
+    sc.get_global_config( "sector_aligned",&cfg.opt_sector_aligned,"Look for files such as LNK and prefetch only at sector boundaries of the image (faster on disk images; misses them elsewhere, as in memory images)" );
+
+    recorder_handle::set_histogram_only( cfg.histogram_only ); // before the scanners define their recorders
+    heavy_hitters::set_recorders( cfg.approximate_histograms, cfg.histogram_top_k ); // and their histograms
+    scanner_tiles::set_tile_bytes( cfg.tile_bytes );
+    try {
+        scanner_priority::set_classes( cfg.scanner_classes ); // before the wrappers look up their classes
+        feature_quotas::set( cfg.feature_quotas, cfg.feature_quota_bytes, cfg.feature_page_quotas ); // and their quotas
+        scanner_priority::set_threads( cfg.scanner_class_threads );
+        scanner_tiles::set_scanners( cfg.tiled_scanners );    // before the scanners enable themselves
+        cpu_dispatch::set_isa( cfg.cpu_isa );                 // before they scan
+        if ( candidate_offload::set_backend( cfg.offload ) != cfg.offload ) {
+            cerr << "offload backend " << cfg.offload << " is not built in or has no device; searching on the cpu" << std::endl;
+        }
+    }
+    catch ( const std::invalid_argument &e ) {
+        cerr << e.what() << std::endl;
+        return 1;
+    }
 
     /* If we are getting help or info scanners, make a fake scanner set with new output directory */
     if ( result.count( "help" ) || result.count( "info_scanners" )) {
@@ -440,6 +614,22 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
         std::filesystem::create_directory( sc.outdir); // make sure directory exists
     }
 
+    /* Small inputs are scanned in the main thread. This is decided before the scanners are loaded, as they
+     * define a shard of each -S feature_shards recorder for each thread that will write to it; the input is
+     * measured in pages of the -G page size (with -G auto, the largest it may choose). A stream is not opened
+     * twice, and is never small.
+     */
+    bool small_input = false;
+    if ( !cfg.opt_recurse && cfg.num_threads > 0 && !process_stream::is_stream( sc.input_fname )) {
+        std::unique_ptr<image_process> probe( image_process::open( sc.input_fname, false, cfg.opt_pagesize, cfg.opt_marginsize ));
+        small_input = probe->seekable() && cfg.small_input( probe->image_size() );
+    }
+    if ( small_input ) {
+        cfg.use_main_thread();
+        if ( !cfg.opt_quiet ) cout << "Small input: scanning in the main thread" << std::endl;
+    }
+    feature_shards::set_recorders( cfg.feature_shards, std::max( cfg.num_threads, 1U ));
+
     /* Load all the scanners and enable the ones we care about.  This
      * happens because:
      * - We need the scanners to generate the help message.
@@ -481,7 +671,88 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
         }
     }
 
+    if ( !cfg.fs_priority.empty() ) fs_map::parse_priority( cfg.fs_priority ); // throws if a class is unknown
+    if ( cfg.opt_auto_marginsize ) {
+        cfg.opt_marginsize = Phase1::Config::auto_marginsize( ss.get_enabled_scanners(), Phase1::Config().opt_marginsize );
+        if ( !cfg.opt_quiet ) cout << "Margin size: " << cfg.opt_marginsize << " (auto)" << std::endl;
+    }
+    remote_workers::set_token( cfg.remote_token );
     image_process *p = image_process::open( sc.input_fname, cfg.opt_recurse, cfg.opt_pagesize, cfg.opt_marginsize );
+    if ( !p->seekable() ) {
+        /* stdin or a FIFO is read once, in order, and its size is not known until it ends */
+        if ( cfg.sampling_fraction < 1.0 || cfg.opt_scan_start || cfg.opt_page_start || cfg.shard_count ) {
+            delete p;
+            throw std::runtime_error( "-Y, --page_start, --shard and sampling need an image that can be seeked, not a stream" );
+        }
+        cfg.opt_auto_pagesize = false;
+    }
+    if ( cfg.triage_minutes ) {
+        if ( cfg.sampling_fraction < 1.0 || !cfg.fs_priority.empty() || cfg.opt_scan_start || cfg.opt_scan_end || !p->seekable() ) {
+            delete p;
+            throw std::runtime_error( "-S triage_minutes cannot be used with sampling, fs_priority, -Y, --shard or an image that cannot be seeked" );
+        }
+    }
+    if ( !cfg.remote_workers.empty() ) {
+        if ( cfg.opt_recurse || cfg.triage_minutes || !p->seekable() ) {
+            delete p;
+            throw std::runtime_error( "-S remote_workers cannot be used with -R, triage_minutes or an image that cannot be seeked" );
+        }
+    }
+    if ( !cfg.fs_priority.empty() ) {
+        if ( cfg.sampling_fraction < 1.0 || !p->seekable() ) {
+            delete p;
+            throw std::runtime_error( "-S fs_priority cannot be used with sampling or with an image that cannot be seeked" );
+        }
+    }
+    if ( cfg.opt_auto_pagesize ) {
+        size_t pagesize = Phase1::Config::auto_pagesize( p->image_size(), cfg.num_threads,
+                                                         ss.get_enabled_scanners().size(), cfg.opt_marginsize );
+        if ( pagesize != cfg.opt_pagesize ) {
+            cfg.opt_pagesize = pagesize;
+            delete p;
+            p = image_process::open( sc.input_fname, cfg.opt_recurse, cfg.opt_pagesize, cfg.opt_marginsize );
+        }
+        if ( !cfg.opt_quiet ) cout << "Page size: " << cfg.opt_pagesize << " (auto)" << std::endl;
+    }
+    feature_quotas::set_pagesize( cfg.opt_pagesize ); // as -G auto chose it
+    if ( cfg.sampling_block > cfg.opt_pagesize ) {
+        delete p;
+        throw std::runtime_error( "-S sampling_block cannot be larger than the page size" );
+    }
+    p->set_use_mmap( cfg.opt_raw_mmap );
+    p->set_use_direct( cfg.opt_raw_direct );
+    if ( cfg.read_threads == Phase1::Config().read_threads && p->read_queue_depth() > cfg.read_threads ) {
+        cfg.read_threads = p->read_queue_depth(); // a solid-state drive wants several reads in flight
+        if ( !cfg.opt_quiet ) cout << "Read threads: " << cfg.read_threads << " (solid-state device)" << std::endl;
+    }
+    if ( !cfg.opt_http_cache_dir.empty() ) p->set_block_cache( cfg.opt_http_cache_dir );
+    p->set_chunk_cache( cfg.opt_ewf_cache_mb * 1024 * 1024 );
+    cfg.set_shard_range( p->image_size() );
+    memory_governor::set_budget( cfg.memory_budget );
+    memory_governor::set_depth_reserve( cfg.memory_depth_reserve );
+    recursion_spill::set_directory( cfg.recursion_spill_dir ); // may throw
+    page_stash::set_max_bytes( cfg.queue_stash_bytes );
+    io_throttle::set_limits( cfg.io_bandwidth, cfg.io_iops );
+    if ( !cfg.io_control_file.empty() ) io_throttle::set_control_file( cfg.io_control_file ); // may throw
+    page_allocator::huge_pages = cfg.opt_huge_pages;
+    if ( cfg.opt_recycle_pages ) {
+        /* pages queued, plus one being scanned by each worker and one being read by each reader */
+        page_allocator::configure( cfg.opt_pagesize + cfg.opt_marginsize,
+                                   cfg.num_threads + cfg.read_ahead_pages + cfg.read_threads + 1, cfg.opt_huge_pages,
+                                   cfg.memory_budget > 0 );
+    }
+    content_cache::enabled = cfg.opt_dedup_recursion;
+    content_cache::set_memory( cfg.dedup_recursion_memory );
+    content_affinity::enabled = cfg.opt_scanner_affinity;
+    content_affinity::skip_high_entropy = cfg.opt_skip_high_entropy;
+    carve_index::set_recorders( cfg.carve_dedup );
+    page_dedup::set_recorders( cfg.page_dedup, sc.context_window_default );
+    carve_writer::start( cfg.carve_writer_threads, cfg.carve_queue_bytes );
+    signature_prefilter::sector_aligned = cfg.opt_sector_aligned;
+    scanner_watchdog::threshold_seconds = cfg.straggler_seconds;
+    trace_writer::enabled = cfg.opt_trace;
+    alloc_profiler::enabled = cfg.opt_profile_allocations;
+    perf_counters::enabled = cfg.opt_perf_counters;
 
     /* are we supposed to run the path printer? */
     if ( result.count( "path" ) ) {
@@ -491,6 +762,15 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
             pp.process_http( std::cin);
         } else if ( opt_path=="-i" || opt_path=="-" ){
             pp.process_interactive( std::cin);
+        } else if ( opt_path.size() > 1 && opt_path[0]=='@' ){
+            std::ifstream in( opt_path.substr( 1 ));
+            if ( !in ) {
+                cerr << "Cannot open: " << opt_path.substr( 1 ) << std::endl;
+                return 1;
+            }
+            path_batch::run( in, cout, [&ss, p]( const std::string &path, std::ostream &os ) {
+                path_printer( &ss, p, os ).process_path( path );
+            });
         } else {
             pp.process_path( opt_path);
         }
@@ -553,6 +833,10 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
     if ( cfg.opt_notification) {
         notify_thread::launch_notify_thread( o);
     }
+    std::unique_ptr<state_dump> dumper;
+    if ( cfg.state_dump ) {
+        dumper = std::make_unique<state_dump>( sc.outdir, [&ss]() { return ss.get_realtime_stats(); } );
+    }
     ss.phase_scan();
 
 #ifdef USE_SQLITE3
@@ -565,7 +849,7 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
     if ( cfg.num_threads > 0){
         cout << "going multi-threaded...( " << cfg.num_threads << " )" << std::endl ;
         ss.launch_workers( cfg.num_threads);
-    } else {
+    } else if ( !small_input ) {
         cout << "running single-threaded (DEBUG)..." << std::endl ;
 
     }
@@ -574,11 +858,72 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
     xreport->xmlout( "provided_filename", sc.input_fname ); // save this information
     xreport->add_timestamp( "phase1 start" );
 
+    /* the alert recorder is flushed every poll, so that a hit is sent without waiting for its buffer to fill */
+    std::unique_ptr<feature_stream> alerts;
+    if ( !cfg.alert_sink.empty() ) {
+        auto flush_alerts = [&ss] {
+            try {
+                ss.fs.named_feature_recorder( feature_recorder_set::ALERT_RECORDER_NAME ).flush();
+            } catch ( const feature_recorder_set::NoSuchFeatureRecorder & ) {
+            }
+        };
+        alerts = std::make_unique<feature_stream>( feature_sink::make( cfg.alert_sink, false ), sc.outdir,
+                                                   std::set<std::string>{ feature_recorder_set::ALERT_RECORDER_NAME },
+                                                   flush_alerts );
+    }
+    std::unique_ptr<feature_stream> features;
+    if ( !cfg.feature_sink.empty() ) {
+        features = std::make_unique<feature_stream>( feature_sink::make( cfg.feature_sink, true ), sc.outdir );
+    }
+    std::unique_ptr<feature_stream> census;
+    feature_census *census_counts = nullptr;   // owned by census
+    if ( cfg.opt_feature_census ) {
+        auto sink = std::make_unique<feature_census>();
+        census_counts = sink.get();
+        census = std::make_unique<feature_stream>( std::move( sink ), sc.outdir );
+    }
+
+    /* the byte and page quotas are counted as the feature files are written */
+    std::unique_ptr<feature_stream> quotas;
+    if ( !feature_quotas::streamed_recorders().empty() ) {
+        quotas = std::make_unique<feature_stream>( std::make_unique<feature_quotas::stream_sink>(), sc.outdir,
+                                                   feature_quotas::streamed_recorders() );
+    }
+
+    /* the approximate histograms are counted as their feature files are written */
+    std::unique_ptr<feature_stream> approximate;
+    heavy_hitters::stream_sink *approximate_counts = nullptr;   // owned by approximate
+    if ( !heavy_hitters::deferred_recorders().empty() ) {
+        auto sink = std::make_unique<heavy_hitters::stream_sink>();
+        approximate_counts = sink.get();
+        approximate = std::make_unique<feature_stream>( std::move( sink ), sc.outdir, heavy_hitters::deferred_recorders() );
+    }
+
+    /* the pages go to the remote workers instead of the scanners; a remote worker sends its output back */
+    if ( !cfg.remote_workers.empty() ) {
+        remote_workers::start( cfg.remote_workers, *p, sc.outdir, cfg.remote_queue_pages );
+        if ( !cfg.opt_quiet ) cout << "Giving the pages to remote workers on " << cfg.remote_workers << std::endl;
+    }
+    std::unique_ptr<feature_stream> remote_features;
+    if ( remote_workers::worker() ) {
+        remote_features = std::make_unique<feature_stream>( remote_workers::make_sink(), sc.outdir );
+    }
+
+    /* the file map is read while the image is scanned */
+    std::future<identify_filenames> file_map;
+    if ( !cfg.identify_filenames_dfxml.empty() ) {
+        file_map = std::async( std::launch::async, []( std::string dfxml ) { return identify_filenames::read_dfxml( dfxml ); },
+                               cfg.identify_filenames_dfxml );
+    }
+
     try {
         phase1.phase1_run();
+        remote_workers::finish();           // wait for the remote workers to scan what they were given
         ss.join();                          // wait for threads to come together
+        carve_writer::drain();              // and for the carves they queued
     }
     catch ( const feature_recorder::DiskWriteError &e ) {
+        try { carve_writer::drain(); } catch ( ... ) { }
         cerr << "Disk write error during Phase 1 ( scanning). Disk is probably full." << std::endl
                   << "Remove extra files and restart bulk_extractor with the exact same command line to continue." << std::endl;
         return 6;
@@ -599,6 +944,7 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
         std::unique_lock<std::mutex> lock(o->Mphase);
         o->phase = 2;                        // will cause notify thread to shut down, and the notify thread will delete the object
     }
+    if ( dumper ) dumper->stop();       // before the scanners shut down
     if ( !cfg.opt_quiet) cout << "Phase 2. Shutting down scanners" << std::endl ;
     xreport->add_timestamp( "phase2 start" );
     try {
@@ -610,6 +956,124 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
                   << "Remove extra files and restart bulk_extractor with the exact same command line to continue." << std::endl;
         return 7;
     }
+    if ( approximate ) approximate->stop();  // once it has counted the lines flushed at shutdown
+    try {
+        heavy_hitters::make_histograms( sc.outdir, approximate_counts );
+    }
+    catch ( const std::exception &e ) {
+        cerr << "Cannot make the approximate histograms: " << e.what() << std::endl;
+    }
+
+    /* after the lines the recorders flushed at shutdown are sent */
+    if ( alerts ) stop_feature_stream( *xreport, "alert_stream", *alerts );
+    if ( features ) stop_feature_stream( *xreport, "feature_stream", *features );
+    if ( remote_features ) {
+        stop_feature_stream( *xreport, "remote_stream", *remote_features );
+        if ( remote_features->lines_dropped() || remote_features->carves_dropped() ) {
+            cerr << "Not all of the output reached the producer, which will give these pages to another worker" << std::endl;
+        } else {
+            try {
+                remote_workers::finish_worker( sc.outdir );
+            }
+            catch ( const std::exception &e ) {
+                cerr << "Cannot send the output to the producer: " << e.what() << std::endl;
+            }
+        }
+    }
+    if ( quotas ) quotas->stop();
+    if ( feature_quotas::any() ) {
+        xreport->push( "feature_quotas" );
+        for ( const auto &[name, attrs] : feature_quotas::xml_attributes() ) {
+            xreport->xmlout( "quota", "", "recorder='" + dfxml_writer::xmlescape( name ) + "' " + attrs, false );
+        }
+        xreport->pop( "feature_quotas" );
+    }
+    if ( census ) {
+        census->stop();
+        xreport->push( "feature_census" );
+        for ( const auto &[name, attrs] : census_counts->xml_attributes() ) {
+            xreport->xmlout( "recorder", "", "name='" + dfxml_writer::xmlescape( name ) + "' " + attrs, false );
+        }
+        xreport->pop( "feature_census" );
+    }
+
+    /* what the remote workers sent, before the merged files are sorted */
+    if ( !cfg.remote_workers.empty() ) {
+        if ( !cfg.opt_quiet) cout << "Merging the output of the remote workers..." << std::endl ;
+        try {
+            remote_workers::merge( sc.outdir );
+        }
+        catch ( const std::exception &e ) {
+            cerr << "Cannot merge the output of the remote workers: " << e.what() << std::endl
+                 << "What is not merged is left in " << remote_workers::DIR_PREFIX << "N." << std::endl;
+        }
+    }
+
+    /* after the streams have read the shards, and before the merged files are sorted */
+    if ( feature_shards::shards() > 1 && !cfg.feature_shards.empty() && cfg.feature_shards_merge ) {
+        if ( !cfg.opt_quiet) cout << "Merging the per-thread feature files..." << std::endl ;
+        try {
+            feature_shards::merge( sc.outdir );
+        }
+        catch ( const std::exception &e ) {
+            cerr << "Cannot merge the per-thread feature files: " << e.what() << std::endl
+                 << "The files not yet merged are left as they are." << std::endl;
+        }
+    }
+
+    /* before the text files are indexed and compressed */
+    if ( cfg.opt_sort_feature_files ) {
+        if ( !cfg.opt_quiet) cout << "Sorting feature files..." << std::endl ;
+        try {
+            sort_feature_files( sc.outdir, cfg.sort_memory, std::max( cfg.num_threads, 1U ));
+        }
+        catch ( const std::exception &e ) {
+            cerr << "Cannot sort the feature files: " << e.what() << std::endl
+                 << "The files not yet sorted are left as they are." << std::endl;
+        }
+    }
+    /* after they are sorted, so that the annotated files are too */
+    if ( file_map.valid() ) {
+        if ( !cfg.opt_quiet) cout << "Identifying the files of the features..." << std::endl ;
+        try {
+            const auto counts = file_map.get().annotate_files( sc.outdir, sc.outdir / "annotated", {}, true,
+                                                               std::max( cfg.num_threads, 1U ), "bulk_extractor -S identify_filenames=" + cfg.identify_filenames_dfxml );
+            xreport->xmlout( "identify_filenames", "", "features='" + std::to_string( counts.features ) +
+                             "' located='" + std::to_string( counts.located ) + "'", false );
+        }
+        catch ( const std::exception &e ) {
+            cerr << "Cannot identify the files of the features: " << e.what() << std::endl;
+        }
+    }
+    if ( cfg.opt_index_feature_files ) {
+        if ( !cfg.opt_quiet) cout << "Indexing feature files..." << std::endl ;
+        try {
+            index_feature_files( sc.outdir, cfg.index_block_size, std::max( cfg.num_threads, 1U ));
+        }
+        catch ( const std::exception &e ) {
+            cerr << "Cannot index the feature files: " << e.what() << std::endl;
+        }
+    }
+    if ( cfg.opt_columnar_feature_files ) {
+        if ( !cfg.opt_quiet) cout << "Writing columnar feature files..." << std::endl ;
+        try {
+            columnar_feature_files( sc.outdir, cfg.columnar_dictionary_bytes, std::max( cfg.num_threads, 1U ));
+        }
+        catch ( const std::exception &e ) {
+            cerr << "Cannot write the columnar feature files: " << e.what() << std::endl;
+        }
+    }
+
+    if ( cfg.opt_gzip_feature_files ) {
+        if ( !cfg.opt_quiet) cout << "Compressing feature files..." << std::endl ;
+        try {
+            gzip_feature_files( sc.outdir, cfg.gzip_frame_size, std::max( cfg.num_threads, 1U ));
+        }
+        catch ( const std::exception &e ) {
+            cerr << "Cannot compress the feature files: " << e.what() << std::endl
+                 << "The files not yet compressed are left as they are." << std::endl;
+        }
+    }
 
     xreport->add_timestamp( "phase2 end" );
     master_timer.stop();
@@ -621,6 +1085,47 @@ int bulk_extractor_main( std::ostream &cout, std::ostream &cerr, int argc,char *
     xreport->xmlout( "elapsed_seconds",master_timer.elapsed_seconds());
     xreport->xmlout( "max_depth_seen",ss.get_max_depth_seen());
     xreport->xmlout( "dup_bytes_encountered",ss.get_dup_bytes_encountered());
+    if ( page_dedup::enabled() ) {
+        xreport->xmlout( "page_dedup", "", "collapsed='" + std::to_string( page_dedup::collapsed ) + "'", false );
+    }
+    if ( carve_index::enabled() ) {
+        xreport->xmlout( "carve_dedup", "",
+                         "carves='" + std::to_string( carve_index::dup_carves ) +
+                         "' bytes='" + std::to_string( carve_index::dup_bytes ) + "'", false );
+    }
+    if ( cfg.carve_writer_threads ) {
+        xreport->xmlout( "carve_writer", "",
+                         "threads='" + std::to_string( cfg.carve_writer_threads ) +
+                         "' carves='" + std::to_string( carve_writer::carves ) +
+                         "' waits='" + std::to_string( carve_writer::waits ) + "'", false );
+    }
+    if ( carve_extents::joined ) {
+        xreport->xmlout( "carve_extents", "", "joined='" + std::to_string( carve_extents::joined ) + "'", false );
+    }
+    if ( cfg.checkpoint_outputs || output_checkpoint::truncated_bytes ) {
+        xreport->xmlout( "output_checkpoint", "", output_checkpoint::xml_attributes(), false );
+    }
+    if ( process_raw::bad_sector_bytes ) {
+        xreport->push( "bad_sectors", "bytes='" + std::to_string( process_raw::bad_sector_bytes ) +
+                       "' recovered_reads='" + std::to_string( process_raw::recovered_reads ) + "'" );
+        for ( const auto &run : process_raw::bad_runs() ) {
+            xreport->xmlout( "run", "", "offset='" + std::to_string( run.offset ) +
+                             "' length='" + std::to_string( run.length ) + "'", false );
+        }
+        xreport->pop( "bad_sectors" );
+    }
+    if ( state_dump::dumps ) {
+        xreport->xmlout( "state_dump", "", "dumps='" + std::to_string( state_dump::dumps ) + "'", false );
+    }
+    if ( !cfg.remote_workers.empty() ) {
+        xreport->xmlout( "remote_workers", "", remote_workers::xml_attributes(), false );
+    }
+    if ( !cfg.feature_shards.empty() ) {
+        xreport->xmlout( "feature_shards", "", feature_shards::xml_attributes(), false );
+    }
+    if ( net_flows::packets || net_flows::copies ) {
+        xreport->xmlout( "net_flows", "", net_flows::xml_attributes(), false );
+    }
     ss.dump_scanner_stats();
     ss.dump_name_count_stats();
     xreport->pop( "report" );
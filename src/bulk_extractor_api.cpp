@@ -0,0 +1,216 @@
+/*
+ * bulk_extractor_api.cpp:
+ * The C interface of libbulkextractor.so; see bulk_extractor_api.h.
+ */
+
+#include "config.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "be13_api/scanner_set.h"
+
+#include "bulk_extractor_api.h"
+#include "bulk_extractor_scanners.h"
+#include "feature_files.h"
+#include "image_process.h"
+#include "phase1.h"
+
+struct BEFILE_t {
+    void          *user {nullptr};
+    be_callback_t *cb {nullptr};
+    scanner_config sc {};
+    struct feature_recorder_set::flags_t flags {};
+    std::unique_ptr<scanner_set> ss {};
+    std::filesystem::path outdir {};
+    std::map<std::string,uint64_t> delivered {}; // bytes of each feature file that have been called back
+    uint64_t next_offset {0};           // of the next bulk_extractor_analyze_buf()
+    uint64_t histogram_limit {0};
+
+    int call(uint32_t code, uint64_t arg, const std::string &name, const std::string &pos0 = "",
+             const std::string &feature = "", const std::string &context = "") {
+        return (*cb)(user, code, arg, name.c_str(), pos0.c_str(), feature.c_str(), feature.size(),
+                     context.c_str(), context.size());
+    }
+    void start();                       // at BEAPI_PROCESS_COMMANDS, or the first buffer
+    int  deliver_features();            // the new complete lines of the feature files
+    int  deliver_histograms();
+    int  scan(sbuf_t *sbuf);
+};
+
+void BEFILE_t::start()
+{
+    if (ss) return;
+    ss = std::make_unique<scanner_set>(sc, flags, nullptr);
+    ss->add_scanners(scanners_builtin);
+    ss->apply_scanner_commands();
+    ss->phase_scan();
+}
+
+/* The recorders have no hook for each feature, so the features are read back from the files as they grow */
+int BEFILE_t::deliver_features()
+{
+    for (const auto &txt : output_text_files(outdir, true)) {
+        uint64_t &done = delivered[txt.string()];
+        std::ifstream in(txt, std::ios::binary);
+        in.seekg(done);
+        const std::string name = txt.stem().string();
+        std::string line;
+        while (std::getline(in, line)) {
+            if (in.eof()) break;        // not ended yet; the recorder is still writing it
+            done += line.size() + 1;
+            if (line.empty() || line[0]=='#') continue;
+            const size_t tab1 = line.find('\t');
+            if (tab1==std::string::npos) continue;
+            const size_t tab2 = line.find('\t', tab1 + 1);
+            const std::string feature = line.substr(tab1 + 1, tab2==std::string::npos ? std::string::npos : tab2 - tab1 - 1);
+            const std::string context = tab2==std::string::npos ? "" : line.substr(tab2 + 1);
+            if (int r = call(BEAPI_FEATURE, 0, name, line.substr(0, tab1), feature, context)) return r;
+        }
+    }
+    return 0;
+}
+
+int BEFILE_t::deliver_histograms()
+{
+    for (const auto &txt : output_text_files(outdir, false)) {
+        if (!is_histogram_file(txt)) continue;
+        std::ifstream in(txt, std::ios::binary);
+        const std::string name = txt.stem().string();
+        std::string line;
+        for (uint64_t entries = 0; std::getline(in, line) && (histogram_limit==0 || entries < histogram_limit); ) {
+            if (line.compare(0, 2, "n=") != 0) continue;
+            const size_t tab1 = line.find('\t');
+            if (tab1==std::string::npos) continue;
+            const size_t tab2 = line.find('\t', tab1 + 1);
+            const uint64_t count = strtoull(line.c_str() + 2, nullptr, 10);
+            entries++;
+            if (int r = call(BEAPI_HISTOGRAM, count, name, "",
+                             line.substr(tab1 + 1, tab2==std::string::npos ? std::string::npos : tab2 - tab1 - 1))) return r;
+        }
+    }
+    return 0;
+}
+
+int BEFILE_t::scan(sbuf_t *sbuf)
+{
+    start();
+    ss->schedule_sbuf(sbuf);            // scans on this thread and deletes the sbuf
+    if (int r = deliver_features()) return r;
+    return call(BEAPI_HEARTBEAT, 0, "");
+}
+
+extern "C"
+BEFILE_t *bulk_extractor_open(void *user, be_callback_t *cb)
+{
+    auto *bef = new BEFILE_t;
+    bef->user = user;
+    bef->cb = cb;
+    const std::filesystem::path tmpl = std::filesystem::temp_directory_path() / "bulk_extractor-XXXXXX";
+    std::string dir = tmpl.string();
+    if (mkdtemp(dir.data())==nullptr) {
+        bef->call(BEAPI_EXCEPTION, 0, "cannot make a temporary directory for the feature files", tmpl.string());
+        delete bef;
+        return nullptr;
+    }
+    bef->outdir = dir;
+    bef->sc.outdir = dir;
+    return bef;
+}
+
+extern "C"
+void bulk_extractor_config(BEFILE_t *bef, uint32_t cmd, const char *scanner, int64_t arg)
+{
+    try {
+        switch (cmd) {
+        case BEAPI_PROCESS_COMMANDS: bef->start(); break;
+        case BEAPI_SCANNER_DISABLE:
+            bef->sc.push_scanner_command(scanner, scanner_config::scanner_command::DISABLE); break;
+        case BEAPI_SCANNER_ENABLE:
+            bef->sc.push_scanner_command(scanner, scanner_config::scanner_command::ENABLE); break;
+        case BEAPI_DISABLE_ALL:
+            bef->sc.push_scanner_command("all", scanner_config::scanner_command::DISABLE); break;
+        case BEAPI_MEMHIST_LIMIT:
+            bef->histogram_limit = arg > 0 ? arg : 0; break;
+        case BEAPI_FEATURE_LIST:
+            bef->start();
+            for (const auto &name : bef->ss->feature_file_list()) bef->call(BEAPI_FEATURELIST, 0, name);
+            break;
+        case BEAPI_SCANNER_LIST:
+            bef->start();
+            for (const auto &name : bef->ss->get_enabled_scanners()) bef->call(BEAPI_FEATURELIST, 0, name);
+            break;
+        case BEAPI_FEATURE_DISABLE: case BEAPI_FEATURE_ENABLE: case BEAPI_MEMHIST_ENABLE:
+            break;
+        default:
+            bef->call(BEAPI_EXCEPTION, 0, "unknown bulk_extractor_config command " + std::to_string(cmd));
+        }
+    } catch (const std::exception &e) {
+        bef->call(BEAPI_EXCEPTION, 0, e.what());
+    }
+}
+
+extern "C"
+int bulk_extractor_analyze_buf_at(BEFILE_t *bef, const uint8_t *buf, size_t buflen, uint64_t offset)
+{
+    try {
+        bef->next_offset = offset + buflen;
+        return bef->scan(new sbuf_t(pos0_t("", offset), buf, buflen)); // a view of buf; it is not copied
+    } catch (const std::exception &e) {
+        bef->call(BEAPI_EXCEPTION, 0, e.what(), std::to_string(offset));
+        return -1;
+    }
+}
+
+extern "C"
+int bulk_extractor_analyze_buf(BEFILE_t *bef, const uint8_t *buf, size_t buflen)
+{
+    return bulk_extractor_analyze_buf_at(bef, buf, buflen, bef->next_offset);
+}
+
+/* Scans the pages of an image, or a random frac of them */
+extern "C"
+int bulk_extractor_analyze_dev(BEFILE_t *bef, const char *fname, float frac, int pagesize)
+{
+    try {
+        Phase1::Config cfg;
+        if (pagesize > 0) cfg.opt_pagesize = pagesize;
+        std::unique_ptr<image_process> p(image_process::open(fname, false, cfg.opt_pagesize, cfg.opt_marginsize));
+        std::mt19937_64 rng(cfg.sampling_seed);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        for (auto it = p->begin(); it != p->end(); ++it) {
+            if (frac < 1 && uniform(rng) >= frac) continue;
+            if (int r = bef->scan(it.sbuf_alloc())) return r;
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        bef->call(BEAPI_EXCEPTION, 0, e.what(), fname);
+        return -1;
+    }
+}
+
+extern "C"
+int bulk_extractor_close(BEFILE_t *bef)
+{
+    int r = 0;
+    try {
+        if (bef->ss) {
+            bef->ss->shutdown();        // flushes the recorders and makes the histograms
+            r = bef->deliver_features();
+            if (r==0) r = bef->deliver_histograms();
+        }
+    } catch (const std::exception &e) {
+        bef->call(BEAPI_EXCEPTION, 0, e.what());
+        r = -1;
+    }
+    bef->ss.reset();
+    std::error_code ec;
+    std::filesystem::remove_all(bef->outdir, ec);
+    delete bef;
+    return r;
+}
@@ -0,0 +1,77 @@
+#ifndef BULK_EXTRACTOR_API_H
+#define BULK_EXTRACTOR_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * bulk_extractor_api:
+ * The C interface of libbulkextractor.so ("make lib"), which python/module/bulkextractor.py loads:
+ * scan buffers that are in memory, without spooling them to a file, and receive the features through
+ * a callback.
+ *
+ *     BEFILE_t *bef = bulk_extractor_open(user, callback);
+ *     bulk_extractor_config(bef, BEAPI_DISABLE_ALL, "", 0);
+ *     bulk_extractor_config(bef, BEAPI_SCANNER_ENABLE, "email", 0);
+ *     bulk_extractor_config(bef, BEAPI_PROCESS_COMMANDS, "", 0);
+ *     bulk_extractor_analyze_buf_at(bef, buf, len, offset);  // as many times as there are buffers
+ *     bulk_extractor_close(bef);                              // the histograms are called back
+ *
+ * Each buffer is scanned on the calling thread, in place, as a depth-0 sbuf whose pos0 is the logical
+ * offset given (bulk_extractor_analyze_buf() gives each buffer the offset after the previous one), and
+ * the buffer may be reused as soon as the call returns. An object that straddles two buffers is found in
+ * neither unless the caller overlaps them, as phase 1 does with its margin.
+ *
+ * The features that a call found are called back (BEAPI_FEATURE, with the recorder's name, the forensic
+ * path, and the feature and context as they are written in the feature files) before the call returns,
+ * except those that the feature recorders still hold in their buffers, which are called back by a later
+ * call or by bulk_extractor_close(). The features reach the callback by way of the feature files: the
+ * session writes them to a temporary directory of its own, reads back what is new after each call, and
+ * removes the directory at bulk_extractor_close(). A callback that returns non-zero stops the call.
+ *
+ * A session is not thread-safe, and the scanners keep their configuration in statics, so a process runs
+ * one session at a time.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* callback codes */
+#define BEAPI_HEARTBEAT    0            // after each buffer
+#define BEAPI_FEATURE      1            // name is the recorder
+#define BEAPI_HISTOGRAM    2            // name is the histogram, arg the count
+#define BEAPI_CARVED       3            // not called
+#define BEAPI_FEATURELIST 10            // name is a feature file, for BEAPI_FEATURE_LIST
+#define BEAPI_EXCEPTION 1000            // name is the error
+
+/* bulk_extractor_config() commands */
+#define BEAPI_PROCESS_COMMANDS 0        // apply the enable and disable commands and start the scanners
+#define BEAPI_SCANNER_DISABLE  1
+#define BEAPI_SCANNER_ENABLE   2
+#define BEAPI_FEATURE_DISABLE  3        // accepted; the feature files are temporary
+#define BEAPI_FEATURE_ENABLE   4        // accepted
+#define BEAPI_MEMHIST_ENABLE   5        // accepted; the histograms are always called back
+#define BEAPI_MEMHIST_LIMIT    6        // call back at most arg entries of the scanner's histograms; 0 for all
+#define BEAPI_DISABLE_ALL      7
+#define BEAPI_FEATURE_LIST     8        // call back BEAPI_FEATURELIST for each feature file
+#define BEAPI_SCANNER_LIST     9        // call back BEAPI_FEATURELIST for each enabled scanner
+
+typedef struct BEFILE_t BEFILE_t;
+typedef int be_callback_t(void *user, uint32_t code, uint64_t arg,
+                          const char *name, const char *pos0,
+                          const char *feature, size_t feature_len,
+                          const char *context, size_t context_len);
+
+BEFILE_t *bulk_extractor_open(void *user, be_callback_t *cb);
+void bulk_extractor_config(BEFILE_t *bef, uint32_t cmd, const char *scanner, int64_t arg);
+int bulk_extractor_analyze_buf(BEFILE_t *bef, const uint8_t *buf, size_t buflen);
+int bulk_extractor_analyze_buf_at(BEFILE_t *bef, const uint8_t *buf, size_t buflen, uint64_t offset);
+int bulk_extractor_analyze_dev(BEFILE_t *bef, const char *fname, float frac, int pagesize);
+int bulk_extractor_close(BEFILE_t *bef);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define HAVE_BATCH
+#endif
+
+#include "bulk_extractor.h"
+#include "bulk_extractor_batch.h"
+#include "image_process.h"
+#include "phase1.h"
+
+bool bulk_extractor_batch::parse_line(const std::string &line, job &j)
+{
+    j = job();
+    if (line.empty() || line[0]=='#') return false;
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t tab = line.find('\t'); ; tab = line.find('\t', start)) {
+        std::string field = line.substr(start, tab==std::string::npos ? std::string::npos : tab - start);
+        if (!field.empty() && field.back()=='\r') field.pop_back();
+        if (!field.empty()) fields.push_back(field);
+        if (tab==std::string::npos) break;
+        start = tab + 1;
+    }
+    if (fields.empty()) return false;
+    if (fields.size() < 2) throw std::invalid_argument("no output directory for " + fields[0]);
+    j.image  = fields[0];
+    j.outdir = fields[1];
+    j.options.assign(fields.begin() + 2, fields.end());
+    return true;
+}
+
+unsigned bulk_extractor_batch::threads_for(uint64_t image_size, unsigned threads)
+{
+    static const uint64_t PAGES_PER_THREAD = 16; // as Phase1::Config::auto_pagesize()
+    const uint64_t per_thread = Phase1::Config().opt_pagesize * PAGES_PER_THREAD;
+    return static_cast<unsigned>(std::clamp<uint64_t>(image_size / per_thread, 1, std::max(threads, 1U)));
+}
+
+ssize_t bulk_extractor_batch::next_job(const std::vector<job> &pending, unsigned free_threads)
+{
+    for (size_t i=0; i<pending.size(); i++) {
+        if (pending[i].threads <= free_threads) return i;
+    }
+    return -1;
+}
+
+#ifdef HAVE_BATCH
+namespace {
+/* In the child: run the job with its output in OUTDIR.log */
+[[noreturn]] void run_job(const bulk_extractor_batch::job &j)
+{
+    const std::string log = j.outdir + ".log";
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    std::vector<std::string> args {"bulk_extractor"};
+    args.insert(args.end(), j.options.begin(), j.options.end());
+    args.insert(args.end(), {"-j", std::to_string(j.threads), "-o", j.outdir, j.image});
+    std::vector<char *> argv;
+    for (auto &arg : args) argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    int code = 1;
+    try {
+        code = bulk_extractor_main(std::cout, std::cerr, argv.size() - 1, argv.data());
+    } catch (const std::exception &e) {
+        std::cerr << "bulk_extractor: " << e.what() << std::endl;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+    _exit(code);
+}
+}
+
+int bulk_extractor_batch::run(const std::string &batch_file, unsigned threads, std::ostream &cout, std::ostream &cerr)
+{
+    if (threads==0) threads = std::max(std::thread::hardware_concurrency(), 1U);
+    std::ifstream in(batch_file);
+    if (!in.is_open()) {
+        cerr << "bulk_extractor: cannot open " << batch_file << std::endl;
+        return -1;
+    }
+    std::vector<job> pending;
+    std::string line;
+    for (unsigned lineno=1; std::getline(in, line); lineno++) {
+        job j;
+        try {
+            if (!parse_line(line, j)) continue;
+            const bool recurse = std::find(j.options.begin(), j.options.end(), "-R") != j.options.end();
+            image_process *p = image_process::open(j.image, recurse, Phase1::Config().opt_pagesize, Phase1::Config().opt_marginsize);
+            j.image_size = p->image_size();
+            delete p;
+        } catch (const std::exception &e) {
+            cerr << batch_file << ":" << lineno << ": " << e.what() << std::endl;
+            return -1;
+        }
+        j.threads = threads_for(j.image_size, threads);
+        pending.push_back(std::move(j));
+    }
+    std::stable_sort(pending.begin(), pending.end(), [](const job &a, const job &b){ return a.image_size > b.image_size; });
+    cout << "bulk_extractor: " << pending.size() << " jobs on " << threads << " threads" << std::endl;
+
+    struct started {
+        job j;
+        std::chrono::steady_clock::time_point start;
+    };
+    std::map<pid_t, started> running;
+    unsigned free_threads = threads;
+    int failed = 0;
+    while (!pending.empty() || !running.empty()) {
+        for (ssize_t i; (i = next_job(pending, free_threads)) >= 0; ) {
+            job j = std::move(pending[i]);
+            pending.erase(pending.begin() + i);
+            cout.flush();
+            pid_t pid = fork();
+            if (pid == 0) run_job(j);
+            if (pid < 0) {
+                cerr << "bulk_extractor: cannot fork for " << j.image << ": " << strerror(errno) << std::endl;
+                failed++;
+                continue;
+            }
+            free_threads -= j.threads;
+            running[pid] = started{std::move(j), std::chrono::steady_clock::now()};
+        }
+        if (running.empty()) continue;
+        int status = 0;
+        const pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        auto it = running.find(pid);
+        if (it == running.end()) continue;
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - it->second.start;
+        const bool ok = WIFEXITED(status) && WEXITSTATUS(status)==0;
+        if (!ok) failed++;
+        cout << it->second.j.image << ": " << (ok ? "done" : "FAILED")
+             << (WIFSIGNALED(status) ? " (signal " + std::to_string(WTERMSIG(status)) + ")"
+                                     : WEXITSTATUS(status) ? " (exit " + std::to_string(WEXITSTATUS(status)) + ")" : "")
+             << " in " << int(elapsed.count()) << "s with " << it->second.j.threads << " threads; output in "
+             << it->second.j.outdir << std::endl;
+        free_threads += it->second.j.threads;
+        running.erase(it);
+    }
+    return failed;
+}
+
+#else
+int bulk_extractor_batch::run(const std::string &, unsigned, std::ostream &, std::ostream &cerr)
+{
+    cerr << "bulk_extractor: --batch needs fork(), which this platform does not have" << std::endl;
+    return -1;
+}
+#endif
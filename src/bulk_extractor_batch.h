@@ -0,0 +1,49 @@
+#ifndef BULK_EXTRACTOR_BATCH_H
+#define BULK_EXTRACTOR_BATCH_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/**
+ * bulk_extractor_batch:
+ * bulk_extractor --batch FILE [THREADS] processes a batch of images, sharing THREADS (default: the cores)
+ * among them so that a batch of mixed sizes keeps every core busy without oversubscribing it.
+ *
+ * Each line of FILE is one job: the image, its output directory and then any other options, separated
+ * by tabs (lines that are empty or start with # are skipped). The options must not include -j, -o or
+ * the image. Each job is given threads in proportion to its size, as -G auto sizes its pages: one for
+ * every 16 default pages of the image, and at least one. The jobs are started largest first, and
+ * whenever threads are free the largest waiting job that fits in them is started. A job's output goes
+ * to OUTDIR.log beside its output directory, and a line is printed as each one finishes.
+ *
+ * Each job runs in a process forked from the batch runner, as the jobs of --serve do (see
+ * bulk_extractor_server.h), with its own scanner set, feature files and DFXML report.
+ */
+
+class bulk_extractor_batch {
+public:
+    struct job {
+        std::string image {};
+        std::string outdir {};
+        std::vector<std::string> options {};
+        uint64_t image_size {0};
+        unsigned threads {1};
+    };
+
+    /* Returns the number of jobs that failed, or -1 if FILE cannot be read */
+    static int run(const std::string &batch_file, unsigned threads, std::ostream &cout, std::ostream &cerr);
+
+    /* The job on a line of a batch file; false if the line has no job. Throws std::invalid_argument
+     * if it gives an image but no output directory.
+     */
+    static bool parse_line(const std::string &line, job &j);
+    static unsigned threads_for(uint64_t image_size, unsigned threads);
+    /* The index of the largest job in pending (which is largest first) that needs at most free threads, or -1 */
+    static ssize_t next_job(const std::vector<job> &pending, unsigned free_threads);
+};
+
+#endif
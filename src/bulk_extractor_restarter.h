@@ -4,22 +4,20 @@
 #include "config.h"
 
 #include <unistd.h>
+#include <cstring>
+#include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <exception>
 #include <filesystem>
 
 #include "be13_api/formatter.h"
 
-#ifdef HAVE_EXPAT_H
-#include <expat.h>
-#endif
-
+#include "output_checkpoint.h"
 #include "phase1.h"
 
 class bulk_extractor_restarter {
-    std::stringstream       cdata {};
-    std::string             thisElement {};
     std::string             provided_filename {};
     scanner_config          &sc;
     Phase1::Config          &cfg;
@@ -32,65 +30,118 @@ public:;
         CantRestart(std::string_view error): m_error(error) {};
         const char* what() const noexcept override { return m_error.c_str(); }
     };
-#ifdef HAVE_LIBEXPAT
-    static void startElement(void *userData, const char *name_, const char **attrs) {
-        class bulk_extractor_restarter &self = *(bulk_extractor_restarter *)userData;
-        self.cdata.str("");
-        self.thisElement = name_;
-        if (self.thisElement=="debug:work_start"){
-            for(int i=0;attrs[i] && attrs[i+1];i+=2){
-                if (strcmp(attrs[i],"pos0") == 0){
-                    self.cfg.seen_page_ids.insert(attrs[i+1]);
+    /* text with the XML entities in it decoded */
+    static std::string xml_decode(const std::string_view &text) {
+        static const std::pair<std::string_view, char> entities[] = {
+            {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+        std::string ret;
+        for (size_t k = 0; k < text.size(); k++) {
+            bool decoded = false;
+            if (text[k] == '&') {
+                for (const auto &e : entities) {
+                    if (text.substr(k, e.first.size()) == e.first) {
+                        ret.push_back(e.second);
+                        k += e.first.size() - 1;
+                        decoded = true;
+                        break;
+                    }
                 }
             }
+            if (!decoded) ret.push_back(text[k]);
         }
+        return ret;
     }
-    static void endElement(void *userData,const char *name_){
-        class bulk_extractor_restarter &self = *(bulk_extractor_restarter *)userData;
-        if (self.thisElement=="provided_filename") self.provided_filename = self.cdata.str();
-        self.cdata.str("");
+
+    /* The value of attribute name in the tag, decoded; false if it has none */
+    static bool attribute(const std::string_view &tag, const std::string &name, std::string &value) {
+        for (size_t pos = tag.find(name); pos != std::string_view::npos; pos = tag.find(name, pos + 1)) {
+            const size_t q = pos + name.size() + 1;
+            if (pos == 0 || tag[pos-1] != ' ' || q >= tag.size() || tag[q-1] != '=' ||
+                (tag[q] != '\'' && tag[q] != '"')) continue;
+            const size_t end = tag.find(tag[q], q + 1);
+            if (end == std::string_view::npos) return false;
+            value = xml_decode(tag.substr(q + 1, end - q - 1));
+            return true;
+        }
+        return false;
     }
-    static void characterDataHandler(void *userData,const XML_Char *s,int len){
-        class bulk_extractor_restarter &self = *(bulk_extractor_restarter *)userData;
-        self.cdata.write(s,len);
+
+    /*
+     * Adds the pages in a report.xml to pages. The report is read in blocks and only the
+     * debug:work_start and debug:restart_range tags are looked at, so a report that was cut off
+     * anywhere is read up to where it stops.
+     */
+    static void scan_report(std::istream &in, page_ranges &pages, std::string *provided_filename = nullptr) {
+        static const std::string WORK_START {"<debug:work_start "};
+        static const std::string RESTART_RANGE {"<debug:restart_range "};
+        static const std::string PROVIDED_FILENAME {"<provided_filename"};
+        const size_t BLOCK_SIZE {1024 * 1024};
+        std::string buf, value;
+        while (in) {
+            const size_t have = buf.size();
+            buf.resize(have + BLOCK_SIZE);
+            in.read(buf.data() + have, BLOCK_SIZE);
+            buf.resize(have + in.gcount());
+
+            /* look at each complete tag; keep an incomplete one for the next block */
+            size_t pos = 0;
+            while ((pos = buf.find('<', pos)) != std::string::npos) {
+                const size_t end = buf.find('>', pos);
+                if (end == std::string::npos) break;
+                const std::string_view tag(buf.data() + pos, end - pos);
+                if (tag.compare(0, WORK_START.size(), WORK_START) == 0) {
+                    if (attribute(tag, "pos0", value)) {
+                        const std::string pos0 = value;
+                        const uint64_t pagesize = attribute(tag, "pagesize", value) ? strtoull(value.c_str(), nullptr, 10) : 0;
+                        pages.add(pos0, pagesize);
+                    }
+                } else if (tag.compare(0, RESTART_RANGE.size(), RESTART_RANGE) == 0) {
+                    uint64_t start = 0, stop = 0;
+                    if (attribute(tag, "start", value)) start = strtoull(value.c_str(), nullptr, 10);
+                    if (attribute(tag, "end", value))   stop  = strtoull(value.c_str(), nullptr, 10);
+                    if (stop > start) pages.add(start, stop - start);
+                } else if (provided_filename && tag == PROVIDED_FILENAME) {
+                    const size_t close = buf.find('<', end);
+                    if (close == std::string::npos) break; // the text continues in the next block
+                    *provided_filename = xml_decode(std::string_view(buf).substr(end + 1, close - end - 1));
+                }
+                pos = end + 1;
+            }
+            buf.erase(0, pos == std::string::npos ? buf.size() : pos);
+        }
     }
+
     void restart() {
         std::filesystem::path report_path = sc.outdir / Phase1::REPORT_FILENAME;
+        std::filesystem::path checkpoint_path = sc.outdir / page_ranges::CHECKPOINT_FILENAME;
 
-        XML_Parser parser = XML_ParserCreate(NULL);
-        XML_SetUserData(parser, this);
-        XML_SetElementHandler(parser, startElement, endElement);
-        XML_SetCharacterDataHandler(parser,characterDataHandler);
-        std::fstream in(report_path);
-        if (!in.is_open()){
-            throw std::runtime_error( Formatter() << "Cannot open " << report_path << ": " << strerror(errno));
+        /* The output checkpoint has the pages whose features are in the feature files up to the lengths
+         * it gives; the files are cut back to them, and the pages after it are scanned again */
+        if (std::filesystem::exists(sc.outdir / output_checkpoint::FILENAME)) {
+            output_checkpoint::restore(sc.outdir, cfg.seen_pages);
+            std::filesystem::path report_path_bak = report_path.string() + "." + std::to_string(time( nullptr));
+            std::filesystem::rename(report_path, report_path_bak);
+            return;
         }
-        try {
-            bool error = false;
-            std::string line;
-            while(getline(in,line) && !error){
-                if (!XML_Parse(parser, line.c_str(), line.size(), 0)) {
-                    std::cout << "XML Error: " << XML_ErrorString(XML_GetErrorCode(parser))
-                              << " at line " << XML_GetCurrentLineNumber(parser) << "\n";
-                    error = true;
-                    break;
-                }
-            }
-            if (!error) XML_Parse(parser, "", 0, 1);    // clear the parser
+
+        /* The checkpoint has every page that was scheduled, as ranges, so there is no need to parse report.xml */
+        if (std::filesystem::exists(checkpoint_path)) {
+            cfg.seen_pages.load(checkpoint_path);
+            std::filesystem::path report_path_bak = report_path.string() + "." + std::to_string(time( nullptr));
+            std::filesystem::rename(report_path, report_path_bak);
+            return;
         }
-        catch (const std::exception &e) {
-            std::cout << "ERROR: " << e.what() << "\n";
+
+        /* Otherwise scan report.xml for the pages that were started */
+        std::ifstream in(report_path, std::ios::binary);
+        if (!in.is_open()){
+            throw std::runtime_error( Formatter() << "Cannot open " << report_path << ": " << strerror(errno));
         }
-        XML_ParserFree(parser);
+        scan_report(in, cfg.seen_pages, &provided_filename);
         in.close();
         /* Now rename the report filename */
         std::filesystem::path report_path_bak = report_path.string() + "." + std::to_string(time( nullptr));
         std::filesystem::rename(report_path, report_path_bak);
     }
-#else
-    void restart(Phase1::Config &cfg, scanner_config &sc) {
-        throw std::runtime_error("Compiled without libexpat; cannot restart.");
-    }
-#endif
 };
 #endif
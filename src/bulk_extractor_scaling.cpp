@@ -0,0 +1,297 @@
+/**
+ * bulk_extractor_scaling.cpp:
+ * The strong-scaling benchmark of bulk_extractor --benchmark-scaling; see bulk_extractor_scaling.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define HAVE_SCALING
+#endif
+
+#include "be13_api/utils.h"
+#include "dfxml_cpp/src/dfxml_writer.h"
+
+#include "bulk_extractor.h"
+#include "bulk_extractor_restarter.h"
+#include "bulk_extractor_scaling.h"
+#include "phase1.h"
+#include "synthetic_image.h"
+
+std::vector<unsigned> bulk_extractor_scaling::default_threads(unsigned cores)
+{
+    std::vector<unsigned> ret;
+    for (unsigned n = 1; n < cores; n *= 2) ret.push_back(n);
+    ret.push_back(std::max(cores, 1U));
+    return ret;
+}
+
+std::vector<uint64_t> bulk_extractor_scaling::parse_list(const std::string &list, bool scaled)
+{
+    std::vector<uint64_t> ret;
+    std::stringstream ss(list);
+    for (std::string item; std::getline(ss, item, ',');) {
+        const char *digits = scaled ? "0123456789kKmMgGtT" : "0123456789";
+        if (item.empty() || !isdigit(static_cast<unsigned char>(item[0])) || item.find_first_not_of(digits) != std::string::npos) {
+            throw std::invalid_argument("not a number: " + item);
+        }
+        const int64_t v = scaled ? scaled_stoi64(item) : std::stoll(item);
+        if (v <= 0) throw std::invalid_argument("must be more than 0: " + item);
+        ret.push_back(uint64_t(v));
+    }
+    if (ret.empty()) throw std::invalid_argument("empty list");
+    return ret;
+}
+
+namespace {
+    /* The text of the first <tag>, or "" */
+    std::string element_text(const std::string &xml, const std::string &tag) {
+        const std::string open = "<" + tag + ">";
+        const size_t start = xml.find(open);
+        if (start == std::string::npos) return "";
+        const size_t end = xml.find("</" + tag + ">", start);
+        return end == std::string::npos ? "" : xml.substr(start + open.size(), end - start - open.size());
+    }
+
+    /* The tags <tag .../> */
+    std::vector<std::string_view> empty_elements(const std::string &xml, const std::string &tag) {
+        std::vector<std::string_view> ret;
+        const std::string open = "<" + tag + " ";
+        for (size_t pos = xml.find(open); pos != std::string::npos; pos = xml.find(open, pos + 1)) {
+            const size_t end = xml.find('>', pos);
+            if (end == std::string::npos) break;
+            ret.push_back(std::string_view(xml).substr(pos, end - pos + 1));
+        }
+        return ret;
+    }
+}
+
+void bulk_extractor_scaling::read_report(const std::string &xml, point &p)
+{
+    p.bytes   = strtoull(element_text(xml, "total_bytes").c_str(), nullptr, 10);
+    p.seconds = strtod(element_text(xml, "elapsed_seconds").c_str(), nullptr);
+    p.producer_wait = 0;
+    for (const auto &tag : empty_elements(xml, "producer_wait")) {
+        /* every attribute is NAME_seconds='X' */
+        for (size_t q = tag.find("_seconds="); q != std::string_view::npos; q = tag.find("_seconds=", q + 1)) {
+            p.producer_wait += strtod(std::string(tag.substr(q + 10)).c_str(), nullptr);
+        }
+    }
+    p.scanner_seconds.clear();
+    for (const auto &tag : empty_elements(xml, "scanner_time")) {
+        std::string name, cpu;
+        if (bulk_extractor_restarter::attribute(tag, "name", name) &&
+            bulk_extractor_restarter::attribute(tag, "cpu_seconds", cpu)) {
+            p.scanner_seconds[name] += strtod(cpu.c_str(), nullptr);
+        }
+    }
+}
+
+std::string bulk_extractor_scaling::xml_attributes(const point &p, const point &baseline)
+{
+    const double speedup = p.seconds > 0 ? baseline.seconds / p.seconds : 0;
+    std::stringstream ss;
+    ss << "threads='" << p.threads << "' pagesize='" << p.pagesize << "' bytes='" << p.bytes
+       << "' seconds='" << p.seconds << "' mb_per_sec='" << p.mb_per_sec()
+       << "' speedup='" << speedup << "' efficiency='" << (speedup * baseline.threads / std::max(p.threads, 1U))
+       << "' producer_wait_seconds='" << p.producer_wait << "' peak_rss_bytes='" << p.peak_rss << "'";
+    return ss.str();
+}
+
+#ifdef HAVE_SCALING
+namespace {
+    struct settings {
+        std::vector<uint64_t> threads {};
+        std::vector<uint64_t> pagesizes {};
+        uint64_t bytes {1024ULL * 1024 * 1024};
+        bool keep {false};
+        std::string outdir {};
+        std::string image {};
+        std::vector<std::string> options {};
+    };
+
+    uint64_t peak_rss_bytes(const struct rusage &ru) {
+#ifdef __APPLE__
+        return ru.ru_maxrss;                    // bytes
+#else
+        return uint64_t(ru.ru_maxrss) * 1024;   // KiB
+#endif
+    }
+
+    /* Runs a point in a child, with its output in DIR.log; returns false if it failed */
+    bool run_point(const settings &s, const std::filesystem::path &dir, bulk_extractor_scaling::point &p, std::ostream &err) {
+        std::vector<std::string> args {"bulk_extractor"};
+        args.insert(args.end(), s.options.begin(), s.options.end());
+        args.insert(args.end(), {"-q", "-j", std::to_string(p.threads), "-G", std::to_string(p.pagesize),
+                                 "-Y", "0-" + std::to_string(s.bytes), "-o", dir.string(), s.image});
+        std::cout.flush();
+        const pid_t pid = fork();
+        if (pid < 0) {
+            err << "bulk_extractor: cannot fork: " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (pid == 0) {
+            const std::string log = dir.string() + ".log";
+            int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd >= 0) {
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+            std::vector<char *> argv;
+            for (auto &arg : args) argv.push_back(arg.data());
+            argv.push_back(nullptr);
+            int code = 1;
+            try {
+                code = bulk_extractor_main(std::cout, std::cerr, argv.size() - 1, argv.data());
+            } catch (const std::exception &e) {
+                std::cerr << "bulk_extractor: " << e.what() << std::endl;
+            }
+            std::cout.flush();
+            std::cerr.flush();
+            fflush(nullptr);
+            _exit(code);
+        }
+        int status = 0;
+        struct rusage ru;
+        memset(&ru, 0, sizeof(ru));
+        while (wait4(pid, &status, 0, &ru) < 0) {
+            if (errno != EINTR) return false;
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            err << "bulk_extractor: the run with -j " << p.threads << " -G " << p.pagesize << " failed; see "
+                << dir.string() << ".log" << std::endl;
+            return false;
+        }
+        std::ifstream in(dir / Phase1::REPORT_FILENAME);
+        if (!in) {
+            err << "bulk_extractor: " << (dir / Phase1::REPORT_FILENAME).string() << ": cannot open" << std::endl;
+            return false;
+        }
+        std::stringstream xml;
+        xml << in.rdbuf();
+        bulk_extractor_scaling::read_report(xml.str(), p);
+        p.peak_rss = peak_rss_bytes(ru);
+        return true;
+    }
+}
+
+int bulk_extractor_scaling::main(int argc, char * const *argv, std::ostream &out, std::ostream &err)
+{
+    settings s;
+    try {
+        s.threads = parse_list("1", false);
+        s.pagesizes = {Phase1::Config().opt_pagesize};
+        bool threads_given = false;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                s.threads = parse_list(argv[++i], false);
+                threads_given = true;
+            }
+            else if (strcmp(argv[i], "--pagesizes") == 0 && i + 1 < argc) s.pagesizes = parse_list(argv[++i], true);
+            else if (strcmp(argv[i], "--bytes") == 0 && i + 1 < argc) s.bytes = parse_list(argv[++i], true).at(0);
+            else if (strcmp(argv[i], "--keep") == 0) s.keep = true;
+            else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) s.outdir = argv[++i];
+            else if (strcmp(argv[i], "--") == 0) {
+                s.options.assign(argv + i + 1, argv + argc);
+                break;
+            }
+            else if (s.image.empty() && argv[i][0] != '-') s.image = argv[i];
+            else throw std::invalid_argument(std::string("unknown option ") + argv[i]);
+        }
+        if (!threads_given) {
+            s.threads.clear();
+            for (unsigned n : default_threads(std::thread::hardware_concurrency())) s.threads.push_back(n);
+        }
+    } catch (const std::exception &e) {
+        err << "bulk_extractor: --benchmark-scaling: " << e.what() << std::endl;
+        s.outdir.clear();
+    }
+    if (s.outdir.empty()) {
+        err << "usage: bulk_extractor --benchmark-scaling [--threads N,...] [--pagesizes SIZE,...] [--bytes SIZE] [--keep]\n"
+            << "           -o OUTDIR [IMAGE] [-- BULK_EXTRACTOR_OPTIONS]\n";
+        return 1;
+    }
+    if (s.image.empty()) s.image = synthetic_image::PREFIX + std::to_string(s.bytes);
+    std::sort(s.threads.begin(), s.threads.end());
+
+    const std::filesystem::path outdir(s.outdir);
+    std::error_code ec;
+    if (std::filesystem::exists(outdir / Phase1::REPORT_FILENAME, ec)) {
+        err << "bulk_extractor: " << outdir << " already has a " << Phase1::REPORT_FILENAME << std::endl;
+        return 1;
+    }
+    std::filesystem::create_directories(outdir, ec);
+
+    dfxml_writer xreport(outdir / Phase1::REPORT_FILENAME, false);
+    xreport.push("dfxml", "xmloutputversion='1.0'");
+    xreport.add_DFXML_creator(PACKAGE_NAME, PACKAGE_VERSION, "", argc, argv);
+    xreport.push("scaling", "image='" + dfxml_writer::xmlescape(s.image) + "' bytes='" + std::to_string(s.bytes) +
+                 "' cores='" + std::to_string(std::thread::hardware_concurrency()) + "'");
+    out << std::setw(8) << "threads" << std::setw(12) << "pagesize" << std::setw(10) << "MB/s" << std::setw(9) << "speedup"
+        << std::setw(12) << "wait (s)" << std::setw(14) << "peak RSS (MB)" << std::endl;
+    int failed = 0;
+    for (uint64_t pagesize : s.pagesizes) {
+        point baseline;
+        for (uint64_t threads : s.threads) {
+            point p;
+            p.threads  = unsigned(threads);
+            p.pagesize = pagesize;
+            const std::filesystem::path dir = outdir / ("scaling-j" + std::to_string(threads) + "-g" + std::to_string(pagesize));
+            std::filesystem::remove_all(dir, ec);
+            if (!run_point(s, dir, p, err)) {
+                failed++;
+                continue;
+            }
+            if (baseline.threads == 0) baseline = p;
+            double total = 0;
+            for (const auto &it : p.scanner_seconds) total += it.second;
+
+            xreport.push("point", xml_attributes(p, baseline));
+            for (const auto &[name, seconds] : p.scanner_seconds) {
+                std::stringstream attrs;
+                attrs << "name='" << dfxml_writer::xmlescape(name) << "' cpu_seconds='" << seconds
+                      << "' share='" << (total > 0 ? seconds / total : 0) << "'";
+                xreport.xmlout("scanner", "", attrs.str(), false);
+            }
+            xreport.pop("point");
+            out << std::setw(8) << p.threads << std::setw(12) << p.pagesize << std::setw(10) << std::fixed << std::setprecision(1)
+                << p.mb_per_sec() << std::setw(9) << std::setprecision(2) << (p.seconds > 0 ? baseline.seconds / p.seconds : 0)
+                << std::setw(12) << std::setprecision(1) << p.producer_wait << std::setw(14) << p.peak_rss / 1000000
+                << std::defaultfloat << std::endl;
+            if (!s.keep) {
+                std::filesystem::remove_all(dir, ec);
+                std::filesystem::remove(dir.string() + ".log", ec);
+            }
+        }
+    }
+    xreport.pop("scaling");
+    xreport.add_rusage();
+    xreport.pop("dfxml");
+    xreport.close();
+    return failed ? 1 : 0;
+}
+
+#else
+int bulk_extractor_scaling::main(int, char * const *, std::ostream &, std::ostream &err)
+{
+    err << "bulk_extractor: --benchmark-scaling needs fork(), which this platform does not have" << std::endl;
+    return 1;
+}
+#endif
@@ -0,0 +1,56 @@
+#ifndef BULK_EXTRACTOR_SCALING_H
+#define BULK_EXTRACTOR_SCALING_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * bulk_extractor_scaling:
+ * bulk_extractor --benchmark-scaling [OPTIONS] -o OUTDIR [IMAGE] [-- BULK_EXTRACTOR_OPTIONS]
+ * measures how a run scales, for choosing hardware and -j: it scans the same first bytes of IMAGE
+ * (by default a synthetic image, see synthetic_image.h) at each of a list of thread counts and page
+ * sizes, and writes what each point cost into the <scaling> section of OUTDIR/report.xml, so that the
+ * results are kept with the case and can be compared between machines.
+ *
+ *   --threads N,...     - the thread counts (default: 1, 2, 4, ... up to the cores, and the cores)
+ *   --pagesizes SIZE,...- the page sizes, with the suffixes of -G (default: the default page size)
+ *   --bytes SIZE        - the bytes of the image scanned at each point (default: 1g)
+ *   --keep              - keep the output directory of each point (OUTDIR/scaling-jN-gSIZE)
+ *
+ * Each point is a run of bulk_extractor (-j N -G SIZE -Y 0-BYTES, and the options after --) in a process
+ * forked from the benchmark, as the jobs of --batch are, so that its peak RSS is its own. Its <point>
+ * gives its MB/s (of the bytes its report says were processed, over the run's elapsed time), its speedup
+ * and efficiency over the point with the fewest threads at the same page size, the time the producer
+ * waited (the sum of <producer_wait>), its peak RSS, and each scanner's share of the scanners' CPU time.
+ */
+
+class bulk_extractor_scaling {
+public:
+    struct point {
+        unsigned threads {0};
+        uint64_t pagesize {0};
+        uint64_t bytes {0};                     // processed, from the run's report
+        double   seconds {0};                   // elapsed
+        double   producer_wait {0};             // seconds
+        uint64_t peak_rss {0};                  // bytes
+        std::map<std::string, double> scanner_seconds {};   // CPU
+        double mb_per_sec() const { return seconds > 0 ? bytes / 1e6 / seconds : 0; }
+    };
+
+    /* argv[0] is "--benchmark-scaling"; returns the exit status */
+    static int main(int argc, char * const *argv, std::ostream &out, std::ostream &err);
+
+    /* 1, 2, 4, ... below cores, and cores */
+    static std::vector<unsigned> default_threads(unsigned cores);
+    /* A list of N,...; with scaled, the suffixes of -G. Throws std::invalid_argument */
+    static std::vector<uint64_t> parse_list(const std::string &list, bool scaled);
+    /* Fills in what a run's report.xml says of the point: its bytes, seconds, producer wait and scanner times */
+    static void read_report(const std::string &xml, point &p);
+    /* The attributes of the <scaling> element's <point> for p, whose baseline is the point it is compared with */
+    static std::string xml_attributes(const point &p, const point &baseline);
+};
+
+#endif
@@ -25,8 +25,83 @@
 #include "bulk_extractor_scanners.h"
 #undef SCANNER
 
-#define SCANNER(scanner) scan_ ## scanner ,
+/* Each built-in scanner is called through a wrapper that skips sbufs it cannot match in
+ * and calls once its recorders have reached their quotas, waits for a thread of its priority class, gives it a scratch arena, runs its tile group
+ * (scanner_tiles.h) if it is in one, and tells the watchdog what it is scanning.
+ *
+ * The wrappers are made from a template, one for each scanner, with its entry points for
+ * each phase: the scanner is called directly (so that LTO can inline it into its wrapper),
+ * what the scan needs of its affinity and class is looked up once in PHASE_INIT rather than
+ * through a function-local static on every call, and the phase is decided once per call.
+ * be13_api's scanner_set still calls each wrapper through its scanner_t pointer.
+ */
+#include "content_affinity.h"
+#include "feature_quotas.h"
+#include "scanner_priority.h"
+#include "scanner_tiles.h"
+#include "scanner_watchdog.h"
+#include "scratch_arena.h"
+
+namespace {
+    template <scanner_t *SCAN, const char *NAME> struct builtin {
+        static inline unsigned accepts {0};
+        static inline scanner_priority::class_t priority {scanner_priority::NORMAL};
+        static inline feature_quotas::gate quota {};
+
+        /* the options are read and the scanner classes declared before the scanners are added */
+        static void init(scanner_params &sp) {
+            accepts = content_affinity::accepts(NAME);
+            priority = scanner_priority::class_of(NAME);
+            SCAN(sp);
+            quota.define(sp);                   // the recorders it defined
+        }
+
+        static void init2(scanner_params &sp) {
+            SCAN(sp);
+            quota.resolve(sp);
+        }
+
+        static void scan(scanner_params &sp) {
+            if (!content_affinity::relevant(accepts, sp)) return;
+            if (quota.stopped(sp)) return;
+            scanner_priority::slot slot(priority, sp);
+            scratch_arena::scope scratch;
+            if (scanner_tiles::scanned(NAME, sp)) return;  // with its tile group
+            scanner_watchdog::invocation inv(NAME, sp);
+            SCAN(sp);
+        }
+
+        static void call(scanner_params &sp) {
+            switch (sp.phase) {
+            case scanner_params::PHASE_INIT: init(sp); break;
+            case scanner_params::PHASE_INIT2: init2(sp); break;
+            case scanner_params::PHASE_SCAN: scan(sp); break;
+            default: SCAN(sp); break;             // enabled, scanners_initialized, shutdown...
+            }
+        }
+    };
+}
+
+#define SCANNER(scanner) static constexpr char name_ ## scanner[] = #scanner;
+#include "bulk_extractor_scanners.h"
+#undef SCANNER
+
+#define SCANNER(scanner) { name_ ## scanner, builtin<scan_ ## scanner, name_ ## scanner>::call, scan_ ## scanner },
+const builtin_scanner builtin_scanners[] = {
+#include "bulk_extractor_scanners.h"
+    {nullptr, nullptr, nullptr}};
+#undef SCANNER
+
+#define SCANNER(scanner) builtin<scan_ ## scanner, name_ ## scanner>::call ,
 scanner_t *scanners_builtin[] = {
 #include "bulk_extractor_scanners.h"
     0};
 #undef SCANNER
+
+const builtin_scanner *builtin_scanner::find(const std::string &name)
+{
+    for (const builtin_scanner *b = builtin_scanners; b->name; b++) {
+        if (name == b->name) return b;
+    }
+    return nullptr;
+}
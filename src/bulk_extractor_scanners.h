@@ -10,6 +10,16 @@
 #define BULK_EXTRACTOR_SCANNERS_H_FIRST_INCLUDE
 #include "be13_api/scanner_set.h"
 extern "C" scanner_t *scanners_builtin[];
+
+/* The built-in scanners, made at compile time from this list: each one's name, the wrapper that
+ * scanner_set calls, and the scanner itself. Ends with a null name. */
+struct builtin_scanner {
+    const char *name;
+    scanner_t  *call;
+    scanner_t  *scan;
+    static const builtin_scanner *find(const std::string &name); // nullptr if it is not built in
+};
+extern const builtin_scanner builtin_scanners[];
 #endif
 
 
@@ -18,7 +28,6 @@ extern "C" scanner_t *scanners_builtin[];
 #endif
 
 /* flex-based scanners */
-SCANNER(base16)
 SCANNER(email)
 SCANNER(accts)
 SCANNER(gps)
@@ -26,6 +35,7 @@ SCANNER(gps)
 /* Regular scanners */
 
 SCANNER(aes)
+SCANNER(base16)
 SCANNER(base64)
 SCANNER(elf)
 SCANNER(exif)    // JPEG carver
@@ -63,10 +73,11 @@ SCANNER(xor)
 SCANNER(zip)
 
 
+/* lightgrep-based scanners; all of their patterns are searched in a single pass */
 #ifdef HAVE_LIBLIGHTGREP
-//SCANNER(accts_lg)
-//SCANNER(base16_lg)
-//SCANNER(email_lg)
-//SCANNER(gps_lg)
-//SCANNER(lightgrep)
+SCANNER(accts_lg)
+SCANNER(base16_lg)
+SCANNER(email_lg)
+SCANNER(gps_lg)
+SCANNER(lightgrep)
 #endif
@@ -0,0 +1,238 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+#if defined(HAVE_SYS_SOCKET_H) && !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define HAVE_SERVER
+#endif
+
+#include "bulk_extractor.h"
+#include "bulk_extractor_server.h"
+
+bool bulk_extractor_server::parse_request(const std::string &buf, std::vector<std::string> &args)
+{
+    args.clear();
+    size_t start = 0;
+    for (size_t nul = buf.find('\0'); nul != std::string::npos; nul = buf.find('\0', start)) {
+        if (nul == start) return true; // the empty argument that ends the request
+        args.push_back(buf.substr(start, nul - start));
+        start = nul + 1;
+    }
+    args.clear();
+    if (buf.size() > MAX_REQUEST_BYTES) throw std::invalid_argument("request longer than MAX_REQUEST_BYTES");
+    return false;
+}
+
+#ifdef HAVE_SERVER
+namespace {
+volatile sig_atomic_t stopping = 0;
+void stop(int) { stopping = 1; }
+
+void send_line(int fd, const std::string &line)
+{
+    const std::string s = line + "\n";
+    ssize_t r = write(fd, s.data(), s.size()); // the client may have gone away already
+    (void)r;
+}
+
+struct job {
+    int fd {-1};
+    std::vector<std::string> args {};
+};
+
+/* A client whose request has not all arrived; its socket is non-blocking until it has */
+struct request {
+    std::string buf {};
+    std::chrono::steady_clock::time_point deadline {};
+};
+
+/* Reads what the client has sent; false with error if it cannot be a request, true with done if it is one */
+bool read_request(int fd, request &r, job &j, bool &done, std::string &error)
+{
+    char tmp[4096];
+    done = false;
+    try {
+        for (;;) {
+            const ssize_t n = read(fd, tmp, sizeof(tmp));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;   // the rest later
+            if (n <= 0) {
+                error = n == 0 ? "incomplete request" : strerror(errno);
+                return false;
+            }
+            r.buf.append(tmp, n);
+            if (bulk_extractor_server::parse_request(r.buf, j.args)) break;
+        }
+    } catch (const std::invalid_argument &e) {
+        error = e.what();
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);  // the job writes its output to it
+    j.fd = fd;
+    done = true;
+    return true;
+}
+
+/* In the child: run the job with its output on its socket */
+[[noreturn]] void run_job(const job &j)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);           // a client that goes away ends its job
+    dup2(j.fd, STDOUT_FILENO);
+    dup2(j.fd, STDERR_FILENO);
+    close(j.fd);
+
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>("bulk_extractor"));
+    for (const auto &arg : j.args) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+    int code = 1;
+    try {
+        code = bulk_extractor_main(std::cout, std::cerr, argv.size() - 1, argv.data());
+    } catch (const std::exception &e) {
+        std::cerr << "bulk_extractor: " << e.what() << std::endl;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+    _exit(code);
+}
+}
+
+int bulk_extractor_server::serve(const std::string &socket_path, unsigned jobs, std::ostream &cerr)
+{
+    jobs = std::max(jobs, 1U);
+    struct sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        cerr << "bulk_extractor: socket path too long: " << socket_path << std::endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    struct stat st;
+    if (stat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path.c_str()); // left by a server that died
+    /* a client runs any command line as this user, so only this user may connect to it */
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    const mode_t saved_umask = umask(077);
+    const bool bound = lfd >= 0 && bind(lfd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0;
+    umask(saved_umask);
+    if (!bound || listen(lfd, 64) != 0) {
+        cerr << "bulk_extractor: cannot listen on " << socket_path << ": " << strerror(errno) << std::endl;
+        if (lfd >= 0) close(lfd);
+        return 1;
+    }
+
+    struct sigaction sa {};
+    sa.sa_handler = stop;               // without SA_RESTART, so that poll() returns
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    cerr << "bulk_extractor: serving " << socket_path << " with " << jobs << " concurrent jobs" << std::endl;
+
+    std::deque<job> pending;
+    std::map<int, request> reading;     // by socket
+    std::map<pid_t, int> running;       // the socket of each job
+    auto reap = [&](int options) {
+        while (!running.empty()) {
+            int status = 0;
+            const pid_t pid = waitpid(-1, &status, options);
+            if (pid < 0 && errno == EINTR) continue;
+            if (pid <= 0) break;
+            auto it = running.find(pid);
+            if (it == running.end()) continue;
+            send_line(it->second, WIFSIGNALED(status) ? "bulk_extractor signal " + std::to_string(WTERMSIG(status))
+                                                      : "bulk_extractor exit " + std::to_string(WEXITSTATUS(status)));
+            close(it->second);
+            running.erase(it);
+        }
+    };
+
+    while (!stopping) {
+        /* the requests are read as they arrive, so that a slow client holds up no one else */
+        std::vector<struct pollfd> pfds {{lfd, POLLIN, 0}};
+        for (const auto &it : reading) pfds.push_back({it.first, POLLIN, 0});
+        const bool ready = poll(pfds.data(), pfds.size(), 500) > 0;
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t i = 1; i < pfds.size(); i++) {
+            const int fd = pfds[i].fd;
+            request &r = reading.at(fd);
+            job j;
+            bool done = false;
+            std::string error = "request not sent within " + std::to_string(REQUEST_SECONDS) + " seconds";
+            if ((!ready || pfds[i].revents == 0) && now < r.deadline) continue;
+            if (now < r.deadline && read_request(fd, r, j, done, error) && !done) continue;
+            if (done) {
+                pending.push_back(std::move(j));
+            } else {
+                send_line(fd, "bulk_extractor error " + error);
+                close(fd);
+            }
+            reading.erase(fd);
+        }
+        if (ready && (pfds[0].revents & POLLIN)) {
+            int fd = accept(lfd, nullptr, nullptr);
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                reading[fd] = request{"", now + std::chrono::seconds(REQUEST_SECONDS)};
+            }
+        }
+        reap(WNOHANG);
+        while (!pending.empty() && running.size() < jobs) {
+            job j = std::move(pending.front());
+            pending.pop_front();
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(lfd);
+                for (const auto &it : running) close(it.second);
+                for (const auto &p : pending) close(p.fd);
+                for (const auto &it : reading) close(it.first);
+                run_job(j);
+            }
+            if (pid < 0) {
+                send_line(j.fd, std::string("bulk_extractor error fork: ") + strerror(errno));
+                close(j.fd);
+                continue;
+            }
+            running[pid] = j.fd;
+        }
+    }
+
+    close(lfd);
+    unlink(socket_path.c_str());
+    for (const auto &j : pending) {
+        send_line(j.fd, "bulk_extractor error server stopped");
+        close(j.fd);
+    }
+    for (const auto &it : reading) {
+        send_line(it.first, "bulk_extractor error server stopped");
+        close(it.first);
+    }
+    cerr << "bulk_extractor: stopping; waiting for " << running.size() << " jobs" << std::endl;
+    reap(0);
+    return 0;
+}
+
+#else
+int bulk_extractor_server::serve(const std::string &, unsigned, std::ostream &cerr)
+{
+    cerr << "bulk_extractor: --serve needs Unix-domain sockets, which this platform does not have" << std::endl;
+    return 1;
+}
+#endif
@@ -0,0 +1,51 @@
+#ifndef BULK_EXTRACTOR_SERVER_H
+#define BULK_EXTRACTOR_SERVER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * bulk_extractor_server:
+ * bulk_extractor --serve SOCKET [JOBS] runs as a server for pipelines that run many small jobs, where
+ * starting the program is most of the cost of each one.
+ *
+ * A client connects to the Unix-domain socket SOCKET and sends the command line of one job: its arguments
+ * (as they would follow "bulk_extractor"), each ended with a NUL, and then an empty argument. It then reads
+ * the job's output (what bulk_extractor writes to stdout and stderr) until the last line, which is
+ * "bulk_extractor exit N" with the job's exit status, or "bulk_extractor signal N" if it was killed.
+ * At most JOBS jobs run at once (default: 1); the others wait in the order they arrived. Each job's
+ * command line gives its own -j, which should be small when JOBS is not.
+ *
+ * A client has REQUEST_SECONDS from connecting to send its whole request. Requests are read as they
+ * arrive, so a slow client delays no one else.
+ *
+ * A job runs as the server's user, so the socket is bound under umask 077 and only that user can connect,
+ * whatever the server's umask. Jobs also run in the server's working directory: relative paths in a
+ * request (the image, -o, and the lists) are taken from where the server was started, not from where the
+ * client is, so clients should send absolute paths.
+ *
+ * Each job runs in a process forked from the server. Jobs are as isolated from each other as separate
+ * runs are (the scanners keep their configuration in statics, and a job that crashes takes only itself
+ * with it). A job saves only exec, loading and relocating the program and its libraries, and static
+ * initialization. It still initializes its scanners, loads its stop and alert lists and compiles its
+ * patterns, as a separate run does; lightgrep programs come from the on-disk cache (-S lightgrep_cache,
+ * see pattern_scanner.cpp), not from the server. Keeping one scanner set warm across jobs is in TODO.md.
+ * The server runs until SIGINT or SIGTERM, and then waits for the jobs that are running.
+ */
+
+class bulk_extractor_server {
+public:
+    static inline const size_t MAX_REQUEST_BYTES {64 * 1024};
+    static inline const unsigned REQUEST_SECONDS {10};      // that a client has to send its whole request
+
+    /* Returns the exit status of the server */
+    static int serve(const std::string &socket_path, unsigned jobs, std::ostream &cerr);
+
+    /* True if buf holds a whole request, which is then split into args; throws std::invalid_argument
+     * if buf is too long to be one.
+     */
+    static bool parse_request(const std::string &buf, std::vector<std::string> &args);
+};
+
+#endif
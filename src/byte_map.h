@@ -0,0 +1,18 @@
+#ifndef BYTE_MAP_H
+#define BYTE_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* Byte substitution kernels for the scanners that recurse into a transformed copy of a buffer
+ * (scan_outlook's compressible encryption, scan_xor). dst[i] = table[src[i]] for i < len;
+ * src and dst may be the same buffer but may not otherwise overlap.
+ */
+void byte_map(const uint8_t *src, uint8_t *dst, size_t len, const uint8_t table[256]); // the fastest kernel this CPU supports
+void byte_map_scalar(const uint8_t *src, uint8_t *dst, size_t len, const uint8_t table[256]);
+const char *byte_map_name();                                    // the kernel byte_map() uses
+
+/* dst[i] = src[i] ^ mask */
+void byte_map_xor(const uint8_t *src, uint8_t *dst, size_t len, uint8_t mask);
+
+#endif
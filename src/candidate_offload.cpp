@@ -0,0 +1,83 @@
+#include "config.h"
+
+#include <map>
+#include <mutex>
+
+#include "candidate_offload.h"
+#include "scan_aes.h"
+
+namespace {
+    bool cpu_available() { return true; }
+
+    bool cpu_aes_candidates(const uint8_t *buf, size_t bufsize, size_t begin, size_t end, unsigned sizes,
+                            std::vector<size_t> &offsets)
+    {
+        /* 32 offsets at a time; where the prefilter cannot read far enough every offset remains */
+        for (size_t pos = begin - begin % AES_PREFILTER_OFFSETS; pos < end; pos += AES_PREFILTER_OFFSETS) {
+            uint32_t m = (pos + AES_PREFILTER_READ_SIZE <= bufsize) ? aes_prefilter(buf + pos, sizes) : ~0U;
+            while (m) {
+                const size_t at = pos + __builtin_ctz(m);
+                m &= m - 1;
+                if (at >= begin && at < end) offsets.push_back(at);
+            }
+        }
+        return true;
+    }
+
+    const candidate_offload::backend cpu_backend {"cpu", cpu_available, cpu_aes_candidates};
+
+    struct state {
+        std::mutex M {};
+        std::map<std::string, candidate_offload::backend> backends {};
+        std::atomic<const candidate_offload::backend *> chosen {&cpu_backend};
+    };
+    state &the_state() {
+        static state s;
+        return s;
+    }
+}
+
+candidate_offload::registrar::registrar(const backend &b)
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    s.backends[b.name] = b;
+}
+
+std::string candidate_offload::set_backend(const std::string &name)
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    s.chosen = &cpu_backend;
+    auto it = s.backends.find(name);
+    if (it != s.backends.end() && it->second.available()) s.chosen = &it->second;
+    return s.chosen.load()->name;
+}
+
+const char *candidate_offload::backend_name()
+{
+    return the_state().chosen.load()->name;
+}
+
+void candidate_offload::aes_candidates(const uint8_t *buf, size_t bufsize, size_t begin, size_t end, unsigned sizes,
+                                       unsigned depth, std::vector<size_t> &offsets)
+{
+    const backend *b = the_state().chosen;
+    if (depth == 0 && b != &cpu_backend) {
+        const size_t before = offsets.size();
+        if (b->aes_candidates(buf, bufsize, begin, end, sizes, offsets)) {
+            pages++;
+            candidates += offsets.size() - before;
+            return;
+        }
+        offsets.resize(before);
+        fallbacks++;
+    }
+    cpu_aes_candidates(buf, bufsize, begin, end, sizes, offsets);
+}
+
+std::string candidate_offload::xml_attributes()
+{
+    return "backend='" + std::string(backend_name()) + "' pages='" + std::to_string(pages) +
+        "' candidates='" + std::to_string(candidates) + "' fallbacks='" + std::to_string(fallbacks) + "'";
+}
@@ -0,0 +1,57 @@
+#ifndef CANDIDATE_OFFLOAD_H
+#define CANDIDATE_OFFLOAD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * candidate_offload:
+ * Backends that search a whole page at once for the offsets where a structure may start, so that only
+ * those offsets are given to the scanner's validators on the CPU. The search is the part of scan_aes
+ * that is the same at every offset (the relation between the words of a key schedule; see
+ * aes_prefilter()), so a device can run it over every offset of the page in parallel.
+ *
+ * A backend is registered by a static of its file, as cpu_dispatch's tables are, with a probe for
+ * its device; -S offload=NAME chooses it before the scanners are loaded. When it was not built, or
+ * the probe does not find its device, the CPU backend is used, with a warning. Only the depth-0 pages
+ * go to a device: the sbufs of recursion are too small to be worth the copy. A page the backend
+ * fails on is searched on the CPU. The CPU backend is aes_prefilter() (with cpu_dispatch's kernel)
+ * over the page, and is the only one in this tree; a device backend is a file of its own that
+ * registers itself.
+ *
+ * A backend may return more offsets than can start a schedule, but none may be left out; each one is
+ * validated again on the CPU.
+ */
+
+class candidate_offload {
+public:
+    struct backend {
+        const char *name;
+        bool (*available)();
+        /* Appends the offsets in [begin, end) of buf that may start a schedule of one of the sizes
+         * (AES_PREFILTER_128...); false if it could not search the page */
+        bool (*aes_candidates)(const uint8_t *buf, size_t bufsize, size_t begin, size_t end, unsigned sizes,
+                               std::vector<size_t> &offsets);
+    };
+    struct registrar {
+        explicit registrar(const backend &b);
+    };
+
+    /* The backend in use: name, or "cpu" if it was not built or has no device */
+    static std::string set_backend(const std::string &name);
+    static const char *backend_name();
+
+    /* With the backend in use at depth 0, or on the CPU */
+    static void aes_candidates(const uint8_t *buf, size_t bufsize, size_t begin, size_t end, unsigned sizes,
+                               unsigned depth, std::vector<size_t> &offsets);
+
+    static inline std::atomic<uint64_t> pages {0};        // searched by the backend
+    static inline std::atomic<uint64_t> candidates {0};   // it returned
+    static inline std::atomic<uint64_t> fallbacks {0};    // pages it failed on
+    static std::string xml_attributes();                  // for the <candidate_offload> report element
+};
+
+#endif
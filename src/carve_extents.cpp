@@ -0,0 +1,146 @@
+#include "config.h"
+
+#include <cstring>
+
+#include "carve_extents.h"
+#include "carve_index.h"
+
+std::vector<carve_extents::extent> carve_extents::registry::add(extent piece)
+{
+    /* the piece before, if it goes on into this one */
+    auto it = extents.lower_bound(piece.start);
+    if (piece.open_start && it != extents.begin()) {
+        auto left = std::prev(it);
+        extent &l = left->second;
+        if (l.end == piece.start && l.open_end && l.ext == piece.ext) {
+            l.data.insert(l.data.end(), piece.data.begin(), piece.data.end());
+            l.end = piece.end;
+            l.last_page_end = piece.last_page_end;
+            l.open_end = piece.open_end;
+            l.pieces += piece.pieces;
+            piece = std::move(l);
+            extents.erase(left);
+        }
+    }
+    /* and the piece after, if this one goes on into it */
+    it = extents.find(piece.end);
+    if (piece.open_end && it != extents.end() && it->second.open_start && it->second.ext == piece.ext) {
+        extent &r = it->second;
+        piece.data.insert(piece.data.end(), r.data.begin(), r.data.end());
+        piece.end = r.end;
+        piece.last_page_end = r.last_page_end;
+        piece.open_end = r.open_end;
+        piece.pieces += r.pieces;
+        extents.erase(it);
+    }
+    const uint64_t start = piece.start;
+    extents[start] = std::move(piece);
+    return take_whole();
+}
+
+std::vector<carve_extents::extent> carve_extents::registry::page_done(uint64_t start, uint64_t end)
+{
+    done_starts.insert(start);
+    done_ends.insert(end);
+    return take_whole();
+}
+
+bool carve_extents::registry::whole(const extent &e) const
+{
+    const bool start_known = !e.open_start || e.first_page == 0 || done_ends.count(e.first_page);
+    const bool end_known = !e.open_end || done_starts.count(e.last_page_end);
+    return start_known && end_known;
+}
+
+std::vector<carve_extents::extent> carve_extents::registry::take_whole()
+{
+    std::vector<extent> ret;
+    for (auto it = extents.begin(); it != extents.end();) {
+        if (whole(it->second)) {
+            ret.push_back(std::move(it->second));
+            it = extents.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return ret;
+}
+
+std::vector<carve_extents::extent> carve_extents::registry::take_all()
+{
+    std::vector<extent> ret;
+    for (auto &it : extents) ret.push_back(std::move(it.second));
+    extents.clear();
+    return ret;
+}
+
+carve_extents::page::page(feature_recorder &fr_, const sbuf_t &sbuf_):
+    fr(fr_), sbuf(sbuf_), merging(sbuf_.depth() == 0 && sbuf_.pos0.path.empty())
+{
+}
+
+void carve_extents::page::carve(size_t offset, size_t len, size_t record_size, bool continues, const std::string &ext)
+{
+    const bool open_start = offset < record_size;
+    if (!merging || (!open_start && !continues) || pending_bytes + len > MAX_PENDING_BYTES) {
+        carve_index::carve(fr, sbuf_t(sbuf, offset, len), ext);
+        return;
+    }
+    extent e;
+    e.start = sbuf.pos0.offset + offset;
+    e.end = e.start + len;
+    e.first_page = sbuf.pos0.offset;
+    e.last_page_end = sbuf.pos0.offset + sbuf.pagesize;
+    e.open_start = open_start;
+    e.open_end = continues;
+    e.ext = ext;
+    e.data.assign(sbuf.get_buf() + offset, sbuf.get_buf() + offset + len);
+    pending_bytes += len;
+    pieces.push_back(std::move(e));
+}
+
+void carve_extents::page::finish()
+{
+    if (!merging) return;
+    std::vector<extent> whole;
+    {
+        std::lock_guard<std::mutex> lock(M);
+        registry &r = registries[&fr];
+        for (auto &e : pieces) {
+            for (auto &w : r.add(std::move(e))) whole.push_back(std::move(w));
+        }
+        for (auto &w : r.page_done(sbuf.pos0.offset, sbuf.pos0.offset + sbuf.pagesize)) whole.push_back(std::move(w));
+    }
+    pieces.clear();
+    carve_extents_of(fr, whole);
+}
+
+void carve_extents::flush(feature_recorder &fr)
+{
+    std::vector<extent> rest;
+    {
+        std::lock_guard<std::mutex> lock(M);
+        auto it = registries.find(&fr);
+        if (it == registries.end()) return;
+        rest = it->second.take_all();
+        registries.erase(it);
+    }
+    carve_extents_of(fr, rest);
+}
+
+void carve_extents::carve_extents_of(feature_recorder &fr, const std::vector<extent> &whole)
+{
+    for (const auto &e : whole) {
+        auto *buf = sbuf_t::sbuf_malloc(pos0_t("", e.start), e.data.size(), e.data.size());
+        memcpy(buf->malloc_buf(), e.data.data(), e.data.size());
+        pending_bytes -= e.data.size();
+        if (e.pieces > 1) joined += e.pieces;
+        try {
+            carve_index::carve(fr, *buf, e.ext);
+        } catch (...) {
+            delete buf;
+            throw;
+        }
+        delete buf;
+    }
+}
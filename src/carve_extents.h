@@ -0,0 +1,105 @@
+#ifndef CARVE_EXTENTS_H
+#define CARVE_EXTENTS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "be13_api/feature_recorder.h"
+#include "be13_api/sbuf.h"
+
+/**
+ * carve_extents:
+ * Carves a run of records that goes on past the end of its depth-0 page (a $LogFile's RCRD pages,
+ * a table of MFT records) as one file with the rest of the run in the next pages, in place of a file
+ * for each page. The scanners find the run only up to the end of their page, so a contiguous $LogFile
+ * or MFT had been dozens of carves per image, each of which had to be made, hashed and put back
+ * together.
+ *
+ * A scanner gives the run that may go on into the next page (its next record, in the margin, is
+ * valid) and the run that may be the end of one from the page before (it starts within a record of
+ * the page's start) to its page, and carves the others itself. The pieces are kept (copied) until
+ * the pages on either side have been scanned, and the pieces that meet end to end are joined. A run
+ * is carved once each of its ends is known to be an end: the first piece's page is the first of the
+ * image, or the page before it has been scanned without a run that goes on into it; and likewise at
+ * the last piece's end. Because the pages are scanned by different workers in any order, the join
+ * does not depend on which side is scanned first.
+ *
+ * What is left when the scanner shuts down (next to pages that were never scanned) is carved as it
+ * stands. Pieces are not kept past MAX_PENDING_BYTES: over it, a piece is carved by itself, as it
+ * would have been before. The sbufs of recursion are never merged.
+ *
+ * The recorder writes a carve from one buffer, so a joined run is copied into one before it is
+ * carved, and goes through carve_index::carve() as the scanners' other carves do.
+ */
+
+class carve_extents {
+public:
+    static inline const uint64_t MAX_PENDING_BYTES {256 * 1024 * 1024};
+    static inline std::atomic<uint64_t> joined {0};        // pieces carved as part of a longer run
+    static inline std::atomic<uint64_t> pending_bytes {0}; // of the pieces kept
+
+    /* A run, or a run put together from the pieces of several pages */
+    struct extent {
+        uint64_t start {0};             // in the image
+        uint64_t end {0};
+        uint64_t first_page {0};        // the start of the page of the first piece
+        uint64_t last_page_end {0};     // the end of the page of the last piece
+        bool open_start {false};        // may be the end of a run of the page before
+        bool open_end {false};          // goes on into the next page
+        uint64_t pieces {1};
+        std::string ext {};             // only pieces of one extension are joined
+        std::vector<uint8_t> data {};
+    };
+
+    /* The pieces of one recorder, and the pages scanned; the logic without a recorder */
+    class registry {
+    public:
+        /* Adds the piece (joined to its neighbours) and returns the extents that are now whole */
+        std::vector<extent> add(extent piece);
+        /* The page [start, end) has been scanned, with its pieces added; returns the extents that are now whole */
+        std::vector<extent> page_done(uint64_t start, uint64_t end);
+        std::vector<extent> take_all();
+        size_t size() const { return extents.size(); }
+    private:
+        std::map<uint64_t, extent> extents {};                  // by start
+        std::set<uint64_t> done_starts {};
+        std::set<uint64_t> done_ends {};
+        bool whole(const extent &e) const;
+        std::vector<extent> take_whole();
+    };
+
+    /*
+     * The boundary runs of one scanner call on a page. carve() carves the runs that cannot be part
+     * of another page's run at once, as carve_index::carve() would; finish() is called when the page
+     * has been scanned.
+     */
+    class page {
+    public:
+        page(feature_recorder &fr, const sbuf_t &sbuf);
+        page(const page &) = delete;
+        page &operator=(const page &) = delete;
+        /* [offset, offset+len) of the sbuf; continues if the next record after it, past the page, is valid */
+        void carve(size_t offset, size_t len, size_t record_size, bool continues, const std::string &ext);
+        void finish();
+    private:
+        feature_recorder &fr;
+        const sbuf_t &sbuf;
+        const bool merging;
+        std::vector<extent> pieces {};
+    };
+
+    /* At PHASE_SHUTDOWN: carve what the recorder has left */
+    static void flush(feature_recorder &fr);
+
+private:
+    static void carve_extents_of(feature_recorder &fr, const std::vector<extent> &whole);
+    static inline std::mutex M {};
+    static inline std::map<feature_recorder *, registry> registries {};
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "config.h"
+
+#include <cstring>
+#include <sstream>
+
+#include <strings.h>
+
+#include "dfxml_cpp/src/hash_t.h"  // needs config.h
+#include "be13_api/feature_recorder_set.h"
+
+
+#include "carve_index.h"
+
+carve_index::shard carve_index::shards[carve_index::SHARDS];
+
+void carve_index::set_recorders(const std::string &names)
+{
+    recorders.clear();
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (!name.empty()) recorders.insert(name);
+    }
+}
+
+bool carve_index::enabled(const feature_recorder &fr)
+{
+    return recorders.count("all") || recorders.count(fr.name);
+}
+
+std::string carve_index::carve_once(feature_recorder &fr, const pos0_t &pos0, const std::string &hash, size_t len,
+                                    const std::function<std::string()> &do_carve)
+{
+    shard &s = shards[std::hash<std::string>()(hash) % SHARDS];
+    {
+        std::unique_lock<std::mutex> lock(s.M);
+        auto it = s.carved.find(hash);
+        while (it != s.carved.end() && it->second.empty()) {
+            s.cv.wait(lock);            // another thread is carving it
+            it = s.carved.find(hash);
+        }
+        if (it != s.carved.end()) {
+            const std::string first = it->second;
+            lock.unlock();
+            dup_carves++;
+            dup_bytes += len;
+            fr.write(pos0, first,
+                     "<carved_duplicate filesize='" + std::to_string(len) + "' hashdigest='" + hash + "'/>");
+            return first;
+        }
+        if (entries >= MAX_ENTRIES) {
+            lock.unlock();
+            return do_carve();
+        }
+        s.carved.emplace(hash, "");
+        entries++;
+    }
+
+    /* carve without the lock; on failure, or if the recorder did not carve it, forget it */
+    std::string fname;
+    try {
+        fname = do_carve();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(s.M);
+        s.carved.erase(hash);
+        entries--;
+        s.cv.notify_all();
+        throw;
+    }
+    std::lock_guard<std::mutex> lock(s.M);
+    if (fname.empty()) {
+        s.carved.erase(hash);
+        entries--;
+    } else {
+        s.carved[hash] = fname;
+    }
+    s.cv.notify_all();
+    return fname;
+}
+
+sbuf_t *carve_index::copy(const sbuf_t &sbuf)
+{
+    auto *ret = sbuf_t::sbuf_malloc(sbuf.pos0, sbuf.bufsize, sbuf.bufsize);
+    memcpy(ret->malloc_buf(), sbuf.get_buf(), sbuf.bufsize);
+    return ret;
+}
+
+namespace {
+template <typename GENERATOR>
+std::string hash_segments(const sbuf_t &header, const sbuf_t &data)
+{
+    GENERATOR g;
+    g.update(header.get_buf(), header.bufsize);
+    g.update(data.get_buf(), data.bufsize);
+    return g.digest().hexdigest();
+}
+}
+
+/* The hash of the object as it is written, fed a segment at a time so that the header and data are
+ * not copied together; an algorithm dfxml does not have is given the two copied into one buffer.
+ */
+std::string carve_index::hash(const feature_recorder &fr, const sbuf_t &header, const sbuf_t &data)
+{
+    const std::string &alg = fr.fs.hasher.name;
+    if (strcasecmp(alg.c_str(), "sha1") == 0)   return hash_segments<dfxml::sha1_generator>(header, data);
+    if (strcasecmp(alg.c_str(), "sha256") == 0) return hash_segments<dfxml::sha256_generator>(header, data);
+    if (strcasecmp(alg.c_str(), "md5") == 0)    return hash_segments<dfxml::md5_generator>(header, data);
+
+    const size_t len = header.bufsize + data.bufsize;
+    auto *whole = sbuf_t::sbuf_malloc(data.pos0, len, len);
+    auto *buf = static_cast<uint8_t *>(whole->malloc_buf());
+    memcpy(buf, header.get_buf(), header.bufsize);
+    memcpy(buf + header.bufsize, data.get_buf(), data.bufsize);
+    const std::string ret = fr.hash(*whole);
+    delete whole;
+    return ret;
+}
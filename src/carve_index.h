@@ -0,0 +1,117 @@
+#ifndef CARVE_INDEX_H
+#define CARVE_INDEX_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "be13_api/feature_recorder.h"
+#include "be13_api/sbuf.h"
+
+#include "carve_writer.h"
+#include "feature_stream.h"
+
+/**
+ * carve_index:
+ * Remembers the hash of every object carved in the run, shared by all of the recorders that carve,
+ * so that the second and later copies of an object (in slack, in the pagefile, inside a ZIP that
+ * was recursed into, or carved by another recorder) are recorded as references instead of being
+ * written again.
+ *
+ * Enabled per recorder with -S carve_dedup=jpeg,sqlite,... (or "all"). For a duplicate, the
+ * recorder's feature file gets a line at the duplicate's position whose feature is the carved file
+ * of the first copy and whose context is <carved_duplicate filesize='' hashdigest=''/>.
+ *
+ * The key is the recorder's hash (-S hash_alg), so it is not fooled by crafted collisions. A thread
+ * that finds a copy still being carved by another thread waits for it. The index has shards with
+ * their own locks, and stops growing at MAX_ENTRIES.
+ *
+ * carve_index::carve() is also where carves are handed to carve_writer, and where the files carved
+ * are given to feature_stream, so every scanner's carves go through it whether or not they are deduplicated.
+ */
+
+class carve_index {
+public:
+    static inline std::atomic<uint64_t> dup_carves {0}; // duplicates that were not written
+    static inline std::atomic<uint64_t> dup_bytes {0};
+    static inline const size_t MAX_ENTRIES {4 * 1024 * 1024};
+
+    /* names is a list of recorder names separated by commas, "all", or "" to disable */
+    static void set_recorders(const std::string &names);
+    static bool enabled() { return !recorders.empty(); }
+    static bool enabled(const feature_recorder &fr);
+
+    /*
+     * fr.carve(sbuf, ext, mtime...), unless the same object has been carved before.
+     * With -S carve_writer_threads, the object is copied and carved later by carve_writer, and "" is returned.
+     */
+    template <typename... MTIME>
+    static std::string carve(feature_recorder &fr, const sbuf_t &sbuf, const std::string &ext, const MTIME &... mtime) {
+        if (carve_writer::enabled()) {
+            std::shared_ptr<sbuf_t> buf(copy(sbuf));
+            carve_writer::submit(sbuf.bufsize, [&fr, buf, ext, mtime...]() { carve_now(fr, *buf, ext, mtime...); });
+            return "";
+        }
+        return carve_now(fr, sbuf, ext, mtime...);
+    }
+    /*
+     * An object of two segments, such as a synthetic header a scanner makes (scan_evtx) and the data
+     * that follows it, which need not be copied together: the recorder writes them one after the other,
+     * and the hash is fed one and then the other.
+     */
+    template <typename... MTIME>
+    static std::string carve(feature_recorder &fr, const sbuf_t &header, const sbuf_t &data, const std::string &ext,
+                             const MTIME &... mtime) {
+        if (carve_writer::enabled()) {
+            std::shared_ptr<sbuf_t> hbuf(copy(header)), dbuf(copy(data));
+            carve_writer::submit(header.bufsize + data.bufsize, [&fr, hbuf, dbuf, ext, mtime...]() {
+                carve_now(fr, *hbuf, *dbuf, ext, mtime...);
+            });
+            return "";
+        }
+        return carve_now(fr, header, data, ext, mtime...);
+    }
+
+private:
+    template <typename... MTIME>
+    static std::string carve_now(feature_recorder &fr, const sbuf_t &sbuf, const std::string &ext, const MTIME &... mtime) {
+        if (!enabled(fr) || sbuf.bufsize == 0) return streamed(fr, fr.carve(sbuf, ext, mtime...));
+        return carve_once(fr, sbuf.pos0, fr.hash(sbuf), sbuf.bufsize,
+                          [&]() { return streamed(fr, fr.carve(sbuf, ext, mtime...)); });
+    }
+    template <typename... MTIME>
+    static std::string carve_now(feature_recorder &fr, const sbuf_t &header, const sbuf_t &data, const std::string &ext,
+                                 const MTIME &... mtime) {
+        if (!enabled(fr)) return streamed(fr, fr.carve(header, data, ext, mtime...));
+        return carve_once(fr, data.pos0, hash(fr, header, data), header.bufsize + data.bufsize,
+                          [&]() { return streamed(fr, fr.carve(header, data, ext, mtime...)); });
+    }
+
+    static inline const size_t SHARDS {64};
+    struct shard {
+        std::mutex M {};
+        std::condition_variable cv {};
+        std::unordered_map<std::string, std::string> carved {}; // hash to carved file; "" while it is carved
+    };
+    static shard shards[SHARDS];
+    static inline std::atomic<size_t> entries {0};
+    static inline std::set<std::string> recorders {};
+
+    static sbuf_t *copy(const sbuf_t &sbuf);
+    /* Tells the feature streams of a file that was carved; returns fname */
+    static std::string streamed(const feature_recorder &fr, std::string fname) {
+        if (feature_stream::enabled()) feature_stream::carved(fr.name, fname);
+        return fname;
+    }
+    static std::string hash(const feature_recorder &fr, const sbuf_t &header, const sbuf_t &data);
+    static std::string carve_once(feature_recorder &fr, const pos0_t &pos0, const std::string &hash, size_t len,
+                                  const std::function<std::string()> &do_carve);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "config.h"
+
+#include "carve_writer.h"
+
+void carve_writer::start(unsigned nthreads, uint64_t max_bytes_)
+{
+    if (nthreads == 0 || running) return;
+    max_bytes = max_bytes_;
+    stopping = false;
+    for (unsigned i = 0; i < nthreads; i++) threads.emplace_back(worker);
+    running = true;
+}
+
+void carve_writer::submit(uint64_t bytes, std::function<void()> job)
+{
+    std::unique_lock<std::mutex> lock(M);
+    /* a copy larger than the queue goes in when the queue is empty */
+    if (queued_bytes > 0 && queued_bytes + bytes > max_bytes) {
+        waits++;
+        has_room.wait(lock, [bytes] { return queued_bytes == 0 || queued_bytes + bytes <= max_bytes; });
+    }
+    queued_bytes += bytes;
+    queue.push_back(job_t{bytes, std::move(job)});
+    carves++;
+    has_job.notify_one();
+}
+
+void carve_writer::worker()
+{
+    std::unique_lock<std::mutex> lock(M);
+    while (true) {
+        has_job.wait(lock, [] { return stopping || !queue.empty(); });
+        if (queue.empty()) return;      // stopping, and nothing left
+        job_t job = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        try {
+            job.run();
+        } catch (...) {
+            std::lock_guard<std::mutex> elock(M);
+            if (!error) error = std::current_exception();
+        }
+        job.run = nullptr;              // free the copy before making room for the next one
+        lock.lock();
+        queued_bytes -= job.bytes;
+        has_room.notify_all();
+    }
+}
+
+void carve_writer::drain()
+{
+    if (!running) return;
+    {
+        std::lock_guard<std::mutex> lock(M);
+        stopping = true;
+    }
+    has_job.notify_all();
+    for (auto &it : threads) it.join();
+    threads.clear();
+    running = false;
+    if (error) {
+        auto e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
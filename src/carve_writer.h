@@ -0,0 +1,58 @@
+#ifndef CARVE_WRITER_H
+#define CARVE_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * carve_writer:
+ * Writes carved objects on threads of its own, so that a scanner that carves does not wait for the
+ * file to be created and written. On network storage, runs that carve many small objects are
+ * otherwise bound by the file creates, with the workers idle.
+ *
+ * Enabled with -S carve_writer_threads=N. carve_index::carve() copies the object and queues the
+ * carve; the queue holds at most -S carve_queue_bytes of copies, and a scanner that would pass that
+ * waits, so that a slow disk slows the scan rather than growing memory. The carved files and their
+ * feature lines are the same as those written inline, though the lines are in the order in which
+ * the writers get to them. drain() waits for the queue at the end of phase 1 and rethrows the first
+ * error a carve threw, such as feature_recorder::DiskWriteError.
+ */
+
+class carve_writer {
+public:
+    static inline std::atomic<uint64_t> carves {0};     // carves queued
+    static inline std::atomic<uint64_t> waits {0};      // times a scanner waited for room in the queue
+
+    static void start(unsigned threads, uint64_t max_bytes);
+    static bool enabled() { return running; }
+    /* Queues job, which holds bytes of copies; waits while the queue is full */
+    static void submit(uint64_t bytes, std::function<void()> job);
+    /* Waits for the queued carves and stops the threads */
+    static void drain();
+
+private:
+    struct job_t {
+        uint64_t bytes {0};
+        std::function<void()> run {};
+    };
+    static inline std::atomic<bool> running {false};
+    static inline uint64_t max_bytes {0};
+    static inline uint64_t queued_bytes {0};
+    static inline bool stopping {false};
+    static inline std::mutex M {};
+    static inline std::condition_variable has_job {};
+    static inline std::condition_variable has_room {};
+    static inline std::deque<job_t> queue {};
+    static inline std::vector<std::thread> threads {};
+    static inline std::exception_ptr error {};
+    static void worker();
+};
+
+#endif
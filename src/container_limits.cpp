@@ -0,0 +1,143 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "container_limits.h"
+
+namespace {
+    const uint64_t NO_MEMORY_LIMIT {1ULL << 60}; // cgroup v1 writes about 2^63 for none
+
+    bool read_line(const std::filesystem::path &path, std::string &line) {
+        std::ifstream in(path);
+        return static_cast<bool>(std::getline(in, line));
+    }
+
+    bool read_number(const std::filesystem::path &path, int64_t &value) {
+        std::string line;
+        if (!read_line(path, line)) return false;
+        try {
+            value = std::stoll(line);
+        } catch (const std::exception &) {
+            return false;
+        }
+        return true;
+    }
+
+    void least(double &limit, double value) {
+        if (value > 0 && (limit == 0 || value < limit)) limit = value;
+    }
+
+    void least(uint64_t &limit, uint64_t value) {
+        if (value > 0 && value < NO_MEMORY_LIMIT && (limit == 0 || value < limit)) limit = value;
+    }
+
+    /* dir and each of its ancestors up to root; only root if the cgroup is not in the mount,
+     * as when the container sees its own cgroup at the root of the file system */
+    std::vector<std::filesystem::path> cgroup_dirs(const std::filesystem::path &root, const std::string &cgroup) {
+        std::vector<std::filesystem::path> dirs;
+        std::filesystem::path rel = std::filesystem::path(cgroup).relative_path();
+        std::error_code ec;
+        if (!std::filesystem::is_directory(root / rel, ec)) rel.clear();
+        for (;;) {
+            dirs.push_back(root / rel);
+            if (rel.empty()) break;
+            rel = rel.parent_path();
+        }
+        return dirs;
+    }
+
+    void read_v2(container_limits &l, const std::filesystem::path &root, const std::string &cgroup) {
+        for (const auto &dir : cgroup_dirs(root, cgroup)) {
+            std::string line;
+            if (read_line(dir / "cpu.max", line)) {
+                std::stringstream ss(line);      // "max 100000" or "250000 100000"
+                std::string quota;
+                double period = 0;
+                if (ss >> quota >> period && quota != "max" && period > 0) {
+                    try {
+                        least(l.cpus, std::stod(quota) / period);
+                    } catch (const std::exception &) { }
+                }
+            }
+            int64_t bytes = 0;
+            if (read_number(dir / "memory.max", bytes) && bytes > 0) least(l.memory_bytes, uint64_t(bytes));
+        }
+    }
+
+    void read_v1(container_limits &l, const std::filesystem::path &root,
+                 const std::string &cpu_cgroup, const std::string &memory_cgroup) {
+        if (!cpu_cgroup.empty()) {
+            for (const char *mount : {"cpu,cpuacct", "cpu"}) {
+                if (!std::filesystem::exists(root / mount)) continue;
+                for (const auto &dir : cgroup_dirs(root / mount, cpu_cgroup)) {
+                    int64_t quota = 0, period = 0;
+                    if (read_number(dir / "cpu.cfs_quota_us", quota) && read_number(dir / "cpu.cfs_period_us", period) &&
+                        quota > 0 && period > 0) {
+                        least(l.cpus, double(quota) / period);
+                    }
+                }
+                break;
+            }
+        }
+        if (!memory_cgroup.empty()) {
+            for (const auto &dir : cgroup_dirs(root / "memory", memory_cgroup)) {
+                int64_t bytes = 0;
+                if (read_number(dir / "memory.limit_in_bytes", bytes) && bytes > 0) least(l.memory_bytes, uint64_t(bytes));
+            }
+        }
+    }
+}
+
+container_limits container_limits::read(const std::filesystem::path &proc_cgroup, const std::filesystem::path &root)
+{
+    container_limits l;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) l.affinity_cpus = CPU_COUNT(&set);
+#endif
+    /* each line is ID:CONTROLLERS:PATH; v2 has the one line 0::PATH */
+    std::ifstream in(proc_cgroup);
+    std::string v2, cpu, memory;
+    bool have_v2 = false;
+    for (std::string line; std::getline(in, line);) {
+        const size_t c1 = line.find(':');
+        const size_t c2 = c1 == std::string::npos ? c1 : line.find(':', c1 + 1);
+        if (c2 == std::string::npos) continue;
+        const std::string controllers = line.substr(c1 + 1, c2 - c1 - 1);
+        const std::string path = line.substr(c2 + 1);
+        if (line.compare(0, c1, "0") == 0 && controllers.empty()) {
+            v2 = path;
+            have_v2 = true;
+            continue;
+        }
+        std::stringstream ss(controllers);
+        for (std::string controller; std::getline(ss, controller, ',');) {
+            if (controller == "cpu") cpu = path;
+            if (controller == "memory") memory = path;
+        }
+    }
+    if (!cpu.empty() || !memory.empty()) {
+        read_v1(l, root, cpu, memory);
+        l.source = "cgroup1";
+    } else if (have_v2 && std::filesystem::exists(root / "cgroup.controllers")) {
+        read_v2(l, root, v2);
+        l.source = "cgroup2";
+    }
+    return l;
+}
+
+unsigned container_limits::threads(unsigned hardware) const
+{
+    unsigned n = std::max(hardware, 1U);
+    if (affinity_cpus > 0) n = std::min(n, affinity_cpus);
+    if (cpus > 0) n = std::min(n, std::max(unsigned(std::ceil(cpus - 0.01)), 1U));
+    return n;
+}
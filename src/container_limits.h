@@ -0,0 +1,34 @@
+#ifndef CONTAINER_LIMITS_H
+#define CONTAINER_LIMITS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * container_limits:
+ * The CPU and memory that the process may use, from the cgroup it runs in (v2, or v1's cpu and memory
+ * controllers) and its CPU affinity, for the defaults of -j, -G and -S memory_budget. In a container,
+ * std::thread::hardware_concurrency() counts the host's cores, not the quota, and nothing tells the
+ * page buffers about the memory limit; a job that uses them runs throttled and is killed for its memory.
+ *
+ * A cgroup's limit is the least of its own and its ancestors' (as far as the mount shows them).
+ * The options given on the command line override the defaults made from the limits.
+ */
+
+class container_limits {
+public:
+    double   cpus {0};              // the CPU quota in CPUs (e.g. 2.5); 0 for none
+    unsigned affinity_cpus {0};     // the CPUs the process may run on; 0 if not known
+    uint64_t memory_bytes {0};      // 0 for none
+    std::string source {};          // cgroup2, cgroup1 or empty
+
+    /* from /proc/self/cgroup and the cgroup file system mounted at root */
+    static container_limits read(const std::filesystem::path &proc_cgroup = "/proc/self/cgroup",
+                                 const std::filesystem::path &root = "/sys/fs/cgroup");
+
+    bool limited() const { return cpus > 0 || memory_bytes > 0 || affinity_cpus > 0; }
+    unsigned threads(unsigned hardware) const;  // the whole CPUs the quota allows, at least 1
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "config.h"
+
+#include <map>
+
+#include "content_affinity.h"
+#include "forensic_path.h"
+#include "page_classifier.h"
+
+unsigned content_affinity::accepts(const std::string &scanner)
+{
+    static const std::map<std::string,unsigned> table {
+        {"aes", BINARY | FILESYSTEM},   // key schedules are in memory images
+        {"elf", BINARY}, {"evtx", BINARY}, {"exif", BINARY}, {"exiv2", BINARY},
+        {"net", BINARY | FILESYSTEM},   // packets are in memory images too
+        {"outlook", BINARY}, {"sqlite", BINARY}, {"utmp", BINARY},
+        {"winlnk", BINARY}, {"winpe", BINARY}, {"winprefetch", BINARY}, {"xor", BINARY},
+        {"pdf", BINARY | COMPRESSED},
+        {"gzip", COMPRESSED}, {"rar", COMPRESSED}, {"zip", COMPRESSED},
+        {"hiberfile", FILESYSTEM}, {"ntfsindx", FILESYSTEM}, {"ntfslogfile", FILESYSTEM},
+        {"ntfsmft", FILESYSTEM}, {"ntfsusn", FILESYSTEM}, {"windirs", FILESYSTEM},
+        {"accts", TEXT}, {"base16", TEXT}, {"base64", TEXT}, {"email", TEXT}, {"facebook", TEXT},
+        {"gps", TEXT}, {"httplogs", TEXT}, {"json", TEXT}, {"kml", TEXT}, {"msxml", TEXT},
+        {"vcard", TEXT}, {"wordlist", TEXT},
+        {"accts_lg", TEXT}, {"base16_lg", TEXT}, {"email_lg", TEXT}, {"gps_lg", TEXT},
+    };
+    auto it = table.find(scanner);
+    return it==table.end() ? ANY : it->second;
+}
+
+unsigned content_affinity::produces(std::string_view recursion)
+{
+    if (recursion=="MSXML" || recursion=="PDF") return TEXT;
+    if (recursion=="BASE64" || recursion=="BASE16") return BINARY | TEXT | COMPRESSED; // attachments, not disks
+    return ANY;                         // GZIP, ZIP, RAR, XOR, HIBERFILE, OUTLOOK...
+}
+
+unsigned content_affinity::content_of(const sbuf_t &sbuf)
+{
+    const forensic_path::ancestors ancestors = forensic_path::ancestors_of(sbuf.pos0);
+    return ancestors.size() ? produces(ancestors[0]) : ANY;
+}
+
+bool content_affinity::relevant(unsigned scanner_accepts, const scanner_params &sp)
+{
+    if (scanner_accepts==ANY) return true;
+    if (sp.phase!=scanner_params::PHASE_SCAN || sp.sbuf==nullptr) return true;
+    if (enabled && sp.sbuf->depth()>0 && (scanner_accepts & content_of(*sp.sbuf))==0) {
+        skipped++;
+        return false;
+    }
+    if (skip_high_entropy && scanner_accepts==TEXT && page_classifier::of(*sp.sbuf).high_entropy()) {
+        skipped++;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef CONTENT_AFFINITY_H
+#define CONTENT_AFFINITY_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "be13_api/sbuf.h"
+#include "be13_api/scanner_params.h"
+
+/**
+ * content_affinity:
+ * Skips the scanners that cannot match in a recursed-into sbuf, given what the recursion made.
+ *
+ * Each built-in scanner accepts some kinds of content (accepts()), and the recursion that made an sbuf
+ * says what kinds it may contain (produces()). The recursion is named by the last element of the sbuf's
+ * pos0 path, which each parent already appends ("MSXML", "PDF", "BASE64"...), so the children are tagged
+ * without a field in sbuf_t. The text that msxml and pdf extract cannot hold an MFT record, a hibernation
+ * file or a zip file, so the structure scanners are not run on it; a decompressed or decrypted child may
+ * hold anything, so every scanner is. Depth 0 and unknown recursions may hold anything too.
+ *
+ * The kinds are what an sbuf may contain, so a page of binary data may contain text, and is given to the
+ * text scanners, unless page_classifier finds it compressed or encrypted throughout (-S skip_high_entropy=YES);
+ * that applies at every depth. The wrappers in bulk_extractor_scanners.cpp ask relevant() before each
+ * PHASE_SCAN call (-S scanner_affinity=NO to not test the recursion).
+ */
+
+class content_affinity {
+public:
+    enum : unsigned {
+        BINARY     = 1,                 // binary structures: executables, images, packets, databases, keys
+        TEXT       = 2,
+        COMPRESSED = 4,                 // gzip, zip and rar streams
+        FILESYSTEM = 8,                 // file system and memory image structures: MFT, directories, hiberfil
+        ANY        = BINARY | TEXT | COMPRESSED | FILESYSTEM
+    };
+
+    static inline std::atomic<bool> enabled {true};
+    static inline std::atomic<bool> skip_high_entropy {false}; // skip the text scanners on high-entropy sbufs
+    static inline std::atomic<uint64_t> skipped {0}; // scanner calls that were not made
+
+    static unsigned accepts(const std::string &scanner);      // what a scanner can match in
+    static unsigned produces(std::string_view recursion);     // what the children of a recursion may contain
+    static unsigned content_of(const sbuf_t &sbuf);           // from the last recursion in its pos0 path
+
+    /* true unless sp is a PHASE_SCAN call on an sbuf that holds nothing that accepts can match in */
+    static bool relevant(unsigned scanner_accepts, const scanner_params &sp);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "config.h"
+
+#include <cstring>
+
+#include "content_cache.h"
+#include "recursion_spill.h"
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/* splitmix64 finalizer */
+static inline uint64_t fmix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * Two 64-bit lanes over 16-byte blocks, in the style of MurmurHash3's x64 128-bit variant,
+ * with the length folded into the finalization.
+ */
+content_cache::hash128 content_cache::hash(const uint8_t *buf, size_t len, uint64_t seed)
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = seed;
+    uint64_t h2 = seed ^ 0x9e3779b97f4a7c15ULL;
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint64_t k1, k2;
+        memcpy(&k1, buf + i, 8);
+        memcpy(&k2, buf + i + 8, 8);
+        h1 ^= rotl64(k1 * c1, 31) * c2;
+        h1 = (rotl64(h1, 27) + h2) * 5 + 0x52dce729;
+        h2 ^= rotl64(k2 * c2, 33) * c1;
+        h2 = (rotl64(h2, 31) + h1) * 5 + 0x38495ab5;
+    }
+    uint8_t tail[16] = {0};
+    memcpy(tail, buf + i, len - i);
+    uint64_t k1, k2;
+    memcpy(&k1, tail, 8);
+    memcpy(&k2, tail + 8, 8);
+    h1 ^= rotl64(k1 * c1, 31) * c2;
+    h2 ^= rotl64(k2 * c2, 33) * c1;
+
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    return hash128{h1, h2};
+}
+
+bool content_cache::duplicate(const sbuf_t &sbuf)
+{
+    if (!enabled) return false;
+    const hash128 h = hash(sbuf.get_buf(), sbuf.bufsize, sbuf.depth());
+    if (!seen.check_for_presence_and_insert(h)) return false;
+    dup_sbufs++;
+    dup_bytes += sbuf.bufsize;
+    return true;
+}
+
+void content_cache::recurse(const scanner_params &sp, sbuf_t *child)
+{
+    if (duplicate(*child)) {
+        delete child;
+        return;
+    }
+    if (recursion_spill::spill(*child)) {
+        delete child;                   // phase 1 scans it when memory frees up
+        return;
+    }
+    sp.recurse(child);
+}
@@ -0,0 +1,57 @@
+#ifndef CONTENT_CACHE_H
+#define CONTENT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "be13_api/sbuf.h"
+#include "be13_api/scanner_params.h"
+
+#include "seen_set.h"
+
+/**
+ * content_cache:
+ * Remembers the content of the decoded and decompressed sbufs that have been recursed into, so that
+ * a disk full of copies of the same ZIP, DOCX or gzip payload is scanned once per depth.
+ *
+ * Enabled with -S dedup_recursion=YES. A duplicate is deleted instead of recursed into and is only
+ * counted, so features inside the second and later copies are not reported at those copies' locations.
+ *
+ * The hash is a fast 128-bit non-cryptographic hash, with the depth mixed in. It is mixed well enough
+ * that accidental collisions are not a concern, but it is not collision-resistant against crafted input.
+ * The hashes are kept in a seen_set, which stops growing at MAX_ENTRIES. With -S dedup_recursion_memory
+ * it keeps 64-bit fingerprints in a lock-free table of that many bytes instead.
+ */
+
+class content_cache {
+public:
+    struct hash128 {
+        uint64_t lo {0};
+        uint64_t hi {0};
+        bool operator==(const hash128 &that) const { return lo==that.lo && hi==that.hi; }
+    };
+    static hash128 hash(const uint8_t *buf, size_t len, uint64_t seed);
+
+    static inline std::atomic<bool> enabled {false};
+    static inline std::atomic<uint64_t> dup_sbufs {0}; // duplicates that were not recursed into
+    static inline std::atomic<uint64_t> dup_bytes {0};
+    static inline const size_t MAX_ENTRIES {16 * 1024 * 1024};
+
+    /* Keep the hashes as fingerprints in a table of at most bytes (0 for all of them); before scanning */
+    static void set_memory(size_t bytes) { seen.set_approximate(bytes); }
+    static uint64_t unrecorded() { return seen.dropped(); } // new content that did not fit
+
+    /* True if sbuf has the same content and depth as one seen before. Records it if not. */
+    static bool duplicate(const sbuf_t &sbuf);
+    /* sp.recurse(child), unless child is a duplicate, in which case it is deleted, or is spilled
+     * to wait for memory (see recursion_spill.h) */
+    static void recurse(const scanner_params &sp, sbuf_t *child);
+
+private:
+    struct hash128_hasher {
+        size_t operator()(const hash128 &h) const { return h.lo; }
+    };
+    static inline seen_set<hash128, hash128_hasher> seen {MAX_ENTRIES};
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "config.h"
+
+#include <mutex>
+#include <stdexcept>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#define CPU_DISPATCH_X86
+#elif defined(__aarch64__)
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define CPU_DISPATCH_ARM
+#endif
+
+#include "cpu_dispatch.h"
+
+namespace {
+    struct level {
+        const char *name;
+        unsigned features;
+    };
+
+    /* lowest first; each has the features of those before it. A level is its instruction set only:
+     * SHA, AES-NI and PCLMUL came with some of the processors of each level and not with others, so
+     * the kernels that use them ask for them, and a level allows none of them. */
+    const level levels[] = {
+        {"scalar", 0},
+#ifdef CPU_DISPATCH_X86
+        {"sse2",   cpu_dispatch::SSE2},
+        {"ssse3",  cpu_dispatch::SSE2 | cpu_dispatch::SSSE3},
+        {"sse4.1", cpu_dispatch::SSE2 | cpu_dispatch::SSSE3 | cpu_dispatch::SSE41},
+        {"avx2",   cpu_dispatch::SSE2 | cpu_dispatch::SSSE3 | cpu_dispatch::SSE41 | cpu_dispatch::AVX2},
+        {"avx512", cpu_dispatch::SSE2 | cpu_dispatch::SSSE3 | cpu_dispatch::SSE41 | cpu_dispatch::AVX2 |
+                   cpu_dispatch::AVX512BW | cpu_dispatch::AVX512VBMI},
+#endif
+#ifdef CPU_DISPATCH_ARM
+        {"neon",   cpu_dispatch::NEON},
+#endif
+    };
+
+    const char *const feature_names[] = {
+        "sse2", "ssse3", "sse4.1", "pclmul", "aes", "sha", "avx2", "avx512bw", "avx512vbmi",
+        "neon", "crc32", "sha2", "aes",
+    };
+
+    unsigned probe() {
+        unsigned f = 0;
+#ifdef CPU_DISPATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))       f |= cpu_dispatch::SSE2;
+        if (__builtin_cpu_supports("ssse3"))      f |= cpu_dispatch::SSSE3;
+        if (__builtin_cpu_supports("sse4.1"))     f |= cpu_dispatch::SSE41;
+        if (__builtin_cpu_supports("pclmul"))     f |= cpu_dispatch::PCLMUL;
+        if (__builtin_cpu_supports("aes"))        f |= cpu_dispatch::AESNI;
+        if (__builtin_cpu_supports("avx2"))       f |= cpu_dispatch::AVX2;
+        if (__builtin_cpu_supports("avx512bw"))   f |= cpu_dispatch::AVX512BW;
+        if (__builtin_cpu_supports("avx512vbmi")) f |= cpu_dispatch::AVX512VBMI;
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA)) f |= cpu_dispatch::SHA;
+#endif
+#ifdef CPU_DISPATCH_ARM
+        f |= cpu_dispatch::NEON;                // ASIMD is in every ARMv8-A
+#if defined(__linux__)
+        const unsigned long hwcap = getauxval(AT_HWCAP);
+        if (hwcap & HWCAP_CRC32) f |= cpu_dispatch::ARM_CRC32;
+        if (hwcap & HWCAP_SHA2)  f |= cpu_dispatch::ARM_SHA2;
+        if (hwcap & HWCAP_AES)   f |= cpu_dispatch::ARM_AES;
+#else
+        /* no way to ask: what the compiler was told the hosts have */
+#if defined(__ARM_FEATURE_CRC32)
+        f |= cpu_dispatch::ARM_CRC32;
+#endif
+#if defined(__ARM_FEATURE_SHA2)
+        f |= cpu_dispatch::ARM_SHA2;
+#endif
+#if defined(__ARM_FEATURE_CRYPTO)
+        f |= cpu_dispatch::ARM_AES;
+#endif
+#endif
+#endif
+        return f;
+    }
+
+    struct state {
+        std::mutex M {};
+        std::vector<cpu_dispatch::family *> families {};
+        std::string forced {"native"};
+        std::atomic<unsigned> mask {~0U};
+    };
+    /* the tables of the other files register themselves as they are constructed, before main() */
+    state &the_state() {
+        static state s;
+        return s;
+    }
+}
+
+unsigned cpu_dispatch::detected()
+{
+    static const unsigned f = probe();
+    return f;
+}
+
+unsigned cpu_dispatch::features()
+{
+    return detected() & the_state().mask;
+}
+
+void cpu_dispatch::set_isa(const std::string &name)
+{
+    unsigned mask = ~0U;
+    if (name != "native") {
+        const level *found = nullptr;
+        for (const auto &l : levels) {
+            if (name == l.name) found = &l;
+        }
+        if (found == nullptr) throw std::invalid_argument("cpu_dispatch: unknown cpu_isa " + name);
+        mask = found->features;
+    }
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    s.mask = mask;
+    s.forced = name;
+    for (auto *f : s.families) f->choose();
+}
+
+std::string cpu_dispatch::isa()
+{
+    const char *ret = levels[0].name;
+    for (const auto &l : levels) {
+        if (has(l.features)) ret = l.name;
+    }
+    return ret;
+}
+
+std::string cpu_dispatch::forced()
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    return s.forced;
+}
+
+std::string cpu_dispatch::names(unsigned f)
+{
+    std::string ret;
+    for (size_t i = 0; i < sizeof(feature_names) / sizeof(feature_names[0]); i++) {
+        if (f & (1U << i)) ret += (ret.empty() ? "" : " ") + std::string(feature_names[i]);
+    }
+    return ret;
+}
+
+std::string cpu_dispatch::xml_attributes()
+{
+    std::string ret = "isa='" + isa() + "' cpu_isa='" + forced() + "' detected='" + names(detected()) + "'";
+    for (const auto *f : families()) ret += std::string(" ") + f->name + "='" + f->chosen_name() + "'";
+    return ret;
+}
+
+const std::vector<cpu_dispatch::family *> &cpu_dispatch::families()
+{
+    return the_state().families;
+}
+
+cpu_dispatch::family::family(const char *name_) : name(name_)
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    s.families.push_back(this);
+}
@@ -0,0 +1,90 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <atomic>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/**
+ * cpu_dispatch:
+ * The CPU features the SIMD kernels may use, probed once at startup, and the tables from which each
+ * family of kernels (crc32, sha256, byte_map, the AES prefilter and key expansion, the base64 decoder,
+ * utf8_text) takes the best one the features allow. One binary built for the baseline of its
+ * architecture (SSE2, or NEON on aarch64) then uses AVX2, AVX-512, SHA or AES-NI where the host has them.
+ *
+ * A table lists its kernels best first, each with the features it needs; the last needs none. The
+ * code of a kernel built with __attribute__((target(...))) must only be in the table, never called
+ * directly, so that a host without its features never runs it. The kernels that need features the
+ * compiler cannot target (the aarch64 CRC, SHA2 and crypto extensions) are only in the table when
+ * they were built, and are still only chosen when the host has them.
+ *
+ * -S cpu_isa=LEVEL limits the features to those of LEVEL (scalar, sse2, ssse3, sse4.1, avx2 or
+ * avx512; scalar or neon on aarch64), so that each kernel can be tested and timed against the
+ * others on one host; native (the default) is what the CPU has. A level is its instruction set alone:
+ * the SHA, AES and carry-less multiply extensions (and the aarch64 CRC, SHA2 and crypto extensions)
+ * are only used natively, and isa() does not need them to name a level. It is set before the scanners are
+ * loaded, and every table chooses again. The level and the kernels chosen are in the
+ * <cpu_dispatch> element of the DFXML configuration.
+ *
+ * The loops that are SSE2 or NEON throughout (signature_prefilter, hex_runs, scan_base64) use what
+ * the architecture always has and are not in tables.
+ */
+
+class cpu_dispatch {
+public:
+    enum feature_t : unsigned {
+        SSE2 = 1 << 0, SSSE3 = 1 << 1, SSE41 = 1 << 2, PCLMUL = 1 << 3, AESNI = 1 << 4, SHA = 1 << 5,
+        AVX2 = 1 << 6, AVX512BW = 1 << 7, AVX512VBMI = 1 << 8,
+        NEON = 1 << 9, ARM_CRC32 = 1 << 10, ARM_SHA2 = 1 << 11, ARM_AES = 1 << 12,
+    };
+
+    static unsigned detected();             // what the CPU has
+    static unsigned features();             // what the kernels may use
+    static bool has(unsigned needs) { return (features() & needs) == needs; }
+
+    /* Throws std::invalid_argument for a level this architecture does not have */
+    static void set_isa(const std::string &level);
+    static std::string isa();               // the highest level within features()
+    static std::string forced();            // the level given to set_isa(), or native
+    static std::string names(unsigned features);
+    static std::string xml_attributes();    // for the <cpu_dispatch> report element
+
+    /* A family of kernels of one signature (FN: a function pointer, or a struct of them) */
+    template <class FN> struct kernel {
+        const char *name;
+        unsigned needs;
+        FN fn;
+    };
+
+    class family {
+    public:
+        explicit family(const char *name_);
+        virtual ~family() {}
+        family(const family &) = delete;
+        family &operator=(const family &) = delete;
+        const char *const name;
+        virtual const char *chosen_name() const = 0;
+        virtual void choose() = 0;
+    };
+
+    /* A table is a static of its file; so it is in families() from before main() to the end */
+    template <class FN> class table : public family {
+    public:
+        table(const char *name_, std::initializer_list<kernel<FN>> k) : family(name_), kernels(k) { choose(); }
+        const FN &fn() const { return kernels[chosen.load(std::memory_order_relaxed)].fn; }
+        const char *chosen_name() const override { return kernels[chosen.load(std::memory_order_relaxed)].name; }
+        void choose() override {
+            size_t i = 0;
+            while (i + 1 < kernels.size() && !has(kernels[i].needs)) i++;
+            chosen = i;
+        }
+    private:
+        const std::vector<kernel<FN>> kernels;
+        std::atomic<size_t> chosen {0};
+    };
+
+    static const std::vector<family *> &families();
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * crc32: CRC-32 eight bytes at a time, or with carry-less multiplication.
+ *
+ * x86-64 with PCLMULQDQ: the buffer is folded 64 bytes at a time into four 128-bit remainders,
+ * which are folded into one and reduced to 32 bits (Intel, "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction", 2009). The SSE4.2 crc32 instruction computes
+ * CRC-32C, a different polynomial, so it cannot be used here.
+ * aarch64 with the CRC extension: the crc32x instruction takes eight bytes at a time.
+ * Otherwise, and for the ends of buffers: slicing by 8, with the tables in scanner_tables.h.
+ */
+
+#include "config.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CRC32_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32_ARM
+#endif
+
+#include "cpu_dispatch.h"
+#include "crc32.h"
+#include "scanner_tables.h"
+
+uint32_t crc32_slice8(uint32_t crc, const void *buf, size_t len)
+{
+    const auto &t = scanner_tables::crc32_slices;
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    uint32_t c = ~crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        v ^= c;
+        c = t[7][v & 0xff]         ^ t[6][(v >> 8) & 0xff]  ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff] ^
+            t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+    }
+    for (; len > 0; p++, len--) {
+        c = t[0][(c ^ *p) & 0xff] ^ (c >> 8);
+    }
+    return ~c;
+}
+
+#ifdef CRC32_X86
+/* the folding constants for the reflected polynomial: x^(4*128+32), x^(4*128-32) mod P, and so on */
+alignas(16) static const uint64_t k1k2[2] = {0x0154442bd4, 0x01c6e41596};
+alignas(16) static const uint64_t k3k4[2] = {0x01751997d0, 0x00ccaa009e};
+alignas(16) static const uint64_t k5k0[2] = {0x0163cd6124, 0x0000000000};
+alignas(16) static const uint64_t poly[2] = {0x01db710641, 0x01f7011641}; // P and mu, for the Barrett reduction
+
+/* c is the inverted CRC; len is at least 64 and a multiple of 16 */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_fold(uint32_t c, const uint8_t *p, size_t len)
+{
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x00));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x10));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x20));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(c));
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+    p += 64;
+    len -= 64;
+
+    /* four remainders, each folded over the next 64 bytes */
+    for (; len >= 64; p += 64, len -= 64) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+        const __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+        const __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+        const __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0x30)));
+    }
+
+    /* fold the four into one, then the remaining 16-byte blocks into it */
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+    for (__m128i next : {x2, x3, x4}) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), next), x5);
+    }
+    for (; len >= 16; p += 16, len -= 16) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(p))), x5);
+    }
+
+    /* 128 bits to 64 */
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x2f = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2f);
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+    x2f = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00), x2f);
+
+    /* Barrett reduction to 32 bits */
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+    x2f = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+    x2f = _mm_clmulepi64_si128(_mm_and_si128(x2f, mask32), k, 0x00);
+    x1 = _mm_xor_si128(x1, x2f);
+    return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const void *buf, size_t len)
+{
+    if (len < 64) return crc32_slice8(crc, buf, len);
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    const size_t folded = len & ~static_cast<size_t>(15);
+    crc = ~crc32_fold(~crc, p, folded);
+    return crc32_slice8(crc, p + folded, len - folded);
+}
+#endif
+
+#ifdef CRC32_ARM
+static uint32_t crc32_arm(uint32_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    uint32_t c = ~crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __crc32d(c, v);
+    }
+    for (; len > 0; p++, len--) {
+        c = __crc32b(c, *p);
+    }
+    return ~c;
+}
+#endif
+
+static cpu_dispatch::table<uint32_t (*)(uint32_t crc, const void *buf, size_t len)> crc_kernels("crc32", {
+#ifdef CRC32_X86
+    {"pclmul", cpu_dispatch::PCLMUL | cpu_dispatch::SSE41, crc32_pclmul},
+#elif defined(CRC32_ARM)
+    {"armv8-crc", cpu_dispatch::ARM_CRC32, crc32_arm},
+#endif
+    {"slice8", 0, crc32_slice8},
+});
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len)
+{
+    return crc_kernels.fn()(crc, buf, len);
+}
+
+const char *crc32_name()
+{
+    return crc_kernels.chosen_name();
+}
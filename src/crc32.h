@@ -0,0 +1,18 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* CRC-32 (polynomial 0xEDB88320, as used by zip, gzip, RAR and EVTX), for the scanners that
+ * validate checksums. Like zlib's crc32(): start with 0 and pass the result of each piece to
+ * the next, so that
+ *     uint32_t crc = crc32_update(0, data_piece1, len1);
+ *     crc = crc32_update(crc, data_piece2, len2);
+ * is the CRC of the two pieces together.
+ */
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len); // the fastest kernel this CPU supports
+uint32_t crc32_slice8(uint32_t crc, const void *buf, size_t len);
+const char *crc32_name();                                         // the kernel crc32_update() uses
+
+#endif
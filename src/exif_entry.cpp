@@ -16,6 +16,7 @@
 #include <iomanip>
 #include <cassert>
 #include <algorithm>
+#include <charconv>
 #include "config.h"
 
 #include "be13_api/utf8.h" // for reading UTF16 and UTF32
@@ -42,15 +43,14 @@ static const uint16_t EXIF_SRATIONAL = 10;	// two SLONGs
 static const uint32_t MAX_IMAGE_SIZE = 65535;
 
 // private helpers
-static std::string get_value(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_generic_name(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static void add_entry(ifd_type_t ifd_type, const std::string &name, const std::string &value,
-                      entry_list_t &entries);
+static const std::string &get_value(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void add_entry(ifd_type_t ifd_type, std::string_view name, tiff_handle_t &tiff_handle,
+                      uint32_t ifd_entry_offset, entry_list_t &entries);
 static bool chars_match(const sbuf_t &sbuf, size_t count);
 static bool char_pairs_match(const sbuf_t &sbuf, size_t count);
-static std::string get_possible_utf8(const sbuf_t &sbuf, size_t count);
-static std::string get_possible_utf16(const sbuf_t sbuf, size_t count, sbuf_t::byte_order_t byte_order);
-static std::string get_possible_utf32(const sbuf_t &sbuf, size_t count, sbuf_t::byte_order_t byte_order);
+static void get_possible_utf8(const sbuf_t &sbuf, size_t count, std::string &out);
+static void get_possible_utf16(const sbuf_t sbuf, size_t count, sbuf_t::byte_order_t byte_order, std::string &out);
+static void get_possible_utf32(const sbuf_t &sbuf, size_t count, sbuf_t::byte_order_t byte_order, std::string &out);
 
 // IFD field readers for reading the 4 fields of a 12-byte IFD record
 inline static uint16_t get_entry_tag(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
@@ -59,60 +59,108 @@ inline static uint32_t get_entry_count(tiff_handle_t &tiff_handle, uint32_t ifd_
 inline static uint16_t get_data_offset(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
 inline static uint32_t get_ifd_offset(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
 
-// EXIF type readers to return strings customized for bulk_extractor
-static std::string get_exif_byte(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_exif_ascii(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_exif_short(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_exif_long(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_exif_rational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_exif_undefined(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_exif_slong(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-static std::string get_exif_srational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset);
-
-exif_entry::exif_entry(uint16_t ifd_type_, const std::string &name_, const std::string &value_)
-    :ifd_type(ifd_type_), name(name_), value(value_)
-{
-}
-
-// copy
-exif_entry::exif_entry(const exif_entry &that):
-    ifd_type(that.ifd_type), name(that.name), value(that.value)
-{
-}
-
-// move and copy are the same
-exif_entry::exif_entry(const exif_entry &&that):
-    ifd_type(that.ifd_type), name(that.name), value(that.value)
-{
+// EXIF type readers to append strings customized for bulk_extractor
+static void get_exif_byte(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void get_exif_ascii(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void get_exif_short(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void get_exif_long(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void get_exif_rational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void get_exif_undefined(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void get_exif_slong(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+static void get_exif_srational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out);
+
+// append an integer as std::stringstream would, without the stream
+template <typename T> static void append_number(std::string &out, T n) {
+    char digits[24];
+    const std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), n);
+    out.append(digits, res.ptr);
 }
 
-exif_entry::~exif_entry() {
-#ifdef DEBUG
-    std::cout << "exif_entry.~ " << name.length() << "val " << value.length() << "\n";
-#endif
-}
-
-const std::string exif_entry::get_full_name() const {
+void exif_entry::append_full_name(std::string &out) const {
     switch(ifd_type) {
     case IFD0_TIFF:
-        return "ifd0.tiff." + name;	// as labeled by Exif doc JEITA CP-3451B
+        out += "ifd0.tiff.";	// as labeled by Exif doc JEITA CP-3451B
+        break;
     case IFD0_EXIF:
-        return "ifd0.exif." + name;	// as labeled by Exif doc JEITA CP-3451B
+        out += "ifd0.exif.";	// as labeled by Exif doc JEITA CP-3451B
+        break;
     case IFD0_GPS:
-        return "ifd0.gps." + name;	// as labeled by Exif doc JEITA CP-3451B
+        out += "ifd0.gps.";	// as labeled by Exif doc JEITA CP-3451B
+        break;
     case IFD0_INTEROPERABILITY:
-        return "ifd0.interoperability." + name;
+        out += "ifd0.interoperability.";
+        break;
     case IFD1_TIFF:
-        return "ifd1.tiff." + name;	// as labeled by Exif doc JEITA CP-3451B
+        out += "ifd1.tiff.";	// as labeled by Exif doc JEITA CP-3451B
+        break;
     case IFD1_EXIF:
-        return "ifd1.exif." + name;	// as labeled by Exif doc JEITA CP-3451B
+        out += "ifd1.exif.";	// as labeled by Exif doc JEITA CP-3451B
+        break;
     case IFD1_GPS:
-        return "ifd1.gps." + name;	// as labeled by Exif doc JEITA CP-3451B
+        out += "ifd1.gps.";	// as labeled by Exif doc JEITA CP-3451B
+        break;
     case IFD1_INTEROPERABILITY:
-        return "ifd1.interoperability." + name;
+        out += "ifd1.interoperability.";
+        break;
     default:
-        return "unknown." + name;
+        out += "unknown.";
+        break;
+    }
+    if (!name.empty()) {
+        out += name;
+        return;
+    }
+    // Copyright (0x8298) of a TIFF IFD has always been reported without a name, as "ifd0.tiff."
+    if (tag == 0x8298 && (ifd_type == IFD0_TIFF || ifd_type == IFD1_TIFF)) return;
+
+    // a tag without a name is "entry_0xNNNN"
+    static const char hex[] = "0123456789abcdef";
+    out += "entry_0x";
+    for (int shift = 12; shift >= 0; shift -= 4) {
+        out += hex[(tag >> shift) & 0xf];
+    }
+}
+
+std::string exif_entry::get_full_name() const {
+    std::string full_name;
+    append_full_name(full_name);
+    return full_name;
+}
+
+std::string_view entry_list_t::copy(std::string_view value) {
+    if (value.empty()) return std::string_view();
+
+    // fill the blocks in order; a value too large for a block gets one of its own
+    while (block < blocks.size() && used + value.size() > blocks[block].size) {
+        block++;
+        used = 0;
+    }
+    if (block == blocks.size()) {
+        block_t b;
+        b.size = std::max(BLOCK_SIZE, value.size());
+        b.data = std::make_unique<char[]>(b.size);
+        blocks.push_back(std::move(b));
+        used = 0;
     }
+    char *dest = blocks[block].data.get() + used;
+    memcpy(dest, value.data(), value.size());
+    used += value.size();
+    return std::string_view(dest, value.size());
+}
+
+void entry_list_t::add(uint16_t ifd_type, uint16_t tag, std::string_view name, std::string_view value) {
+    exif_entry entry;
+    entry.ifd_type = ifd_type;
+    entry.tag = tag;
+    entry.name = name;            // a string literal
+    entry.value = copy(value);
+    entries.push_back(entry);
+}
+
+void entry_list_t::clear() {
+    entries.clear();
+    block = 0;
+    used = 0;
 }
 
 /**
@@ -180,156 +228,125 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
 #ifdef DEBUG
     std::cout << "exif_entry.parse_entry IFD type: " << (int)ifd_type << "\n";
 #endif
-    std::string generic_name;
-    std::string value_string;
     switch (ifd_type) {
     case IFD0_TIFF:	// see table Tag Support Levels(1) for 0th IFD TIFF Tags
     case IFD1_TIFF:	// see table Tag Support Levels(1) for 0th IFD TIFF Tags
         uint32_t forwarded_ifd_offset;
         switch (entry_tag) {
 	case 0x0100: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ImageWidth", value_string, entries);
+            add_entry(ifd_type, "ImageWidth", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0102: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "BitsPerSample", value_string, entries);
+            add_entry(ifd_type, "BitsPerSample", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0103: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Compression", value_string, entries);
+            add_entry(ifd_type, "Compression", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0106: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "PhotometricInterpreation", value_string, entries);
+            add_entry(ifd_type, "PhotometricInterpreation", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x010e: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ImageDescription", value_string, entries);
+            add_entry(ifd_type, "ImageDescription", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x010f: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Make", value_string, entries);
+            add_entry(ifd_type, "Make", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0110: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Model", value_string, entries);
+            add_entry(ifd_type, "Model", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0111: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "StripOffsets", value_string, entries);
+            add_entry(ifd_type, "StripOffsets", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0112: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Orientation", value_string, entries);
+            add_entry(ifd_type, "Orientation", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0115: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SamplesPerPixel", value_string, entries);
+            add_entry(ifd_type, "SamplesPerPixel", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0116: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "RowsPerStrip", value_string, entries);
+            add_entry(ifd_type, "RowsPerStrip", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0117: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "StripByteCounts", value_string, entries);
+            add_entry(ifd_type, "StripByteCounts", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x011a: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "XResolution", value_string, entries);
+            add_entry(ifd_type, "XResolution", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x011b: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "YResolution", value_string, entries);
+            add_entry(ifd_type, "YResolution", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x011c: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "PlanarConfiguration", value_string, entries);
+            add_entry(ifd_type, "PlanarConfiguration", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0128: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ResolutionUnit", value_string, entries);
+            add_entry(ifd_type, "ResolutionUnit", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x012d: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "TransferFunction", value_string, entries);
+            add_entry(ifd_type, "TransferFunction", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0131: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Software", value_string, entries);
+            add_entry(ifd_type, "Software", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0132: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "DateTime", value_string, entries);
+            add_entry(ifd_type, "DateTime", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x013b: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Artist", value_string, entries);
+            add_entry(ifd_type, "Artist", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x013e: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "WhitePoint", value_string, entries);
+            add_entry(ifd_type, "WhitePoint", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x013f: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "PrimaryChromaticities", value_string, entries);
+            add_entry(ifd_type, "PrimaryChromaticities", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0201: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "JPEGInterchangeFormat", value_string, entries);
+            add_entry(ifd_type, "JPEGInterchangeFormat", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0202: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "JPEGInterchangeFormatLength", value_string, entries);
+            add_entry(ifd_type, "JPEGInterchangeFormatLength", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0211: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "YCbCrCoefficients", value_string, entries);
+            add_entry(ifd_type, "YCbCrCoefficients", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0212: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "YCbCrSubSampling", value_string, entries);
+            add_entry(ifd_type, "YCbCrSubSampling", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0213: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "YCbCrPositioning", value_string, entries);
+            add_entry(ifd_type, "YCbCrPositioning", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0214: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ReferenceBlackWhite", value_string, entries);
+            add_entry(ifd_type, "ReferenceBlackWhite", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8298: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "", value_string, entries);
+            add_entry(ifd_type, "", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8769: // EXIF tag
@@ -370,9 +387,7 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
                 return;
             }
 
-            generic_name = get_generic_name(tiff_handle, ifd_entry_offset);
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, generic_name, value_string, entries);
+            add_entry(ifd_type, "", tiff_handle, ifd_entry_offset, entries);
             break;
         } // end default
         } // end switch entry_tag
@@ -381,209 +396,173 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
     case IFD1_EXIF:	// see table Tag Support Levels(1) for 0th IFD TIFF Tags
         switch (entry_tag) {
 	case 0x829a: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ExposureTime", value_string, entries);
+            add_entry(ifd_type, "ExposureTime", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x829d: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FNumber", value_string, entries);
+            add_entry(ifd_type, "FNumber", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8822: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ExposureProgram", value_string, entries);
+            add_entry(ifd_type, "ExposureProgram", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8824: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SpectralSensitivity", value_string, entries);
+            add_entry(ifd_type, "SpectralSensitivity", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8827: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "PhotographicSensitivity", value_string, entries);
+            add_entry(ifd_type, "PhotographicSensitivity", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8828: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "OECF", value_string, entries);
+            add_entry(ifd_type, "OECF", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8830: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SensitivityType", value_string, entries);
+            add_entry(ifd_type, "SensitivityType", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8831: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "StandardOutputSensitivity", value_string, entries);
+            add_entry(ifd_type, "StandardOutputSensitivity", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8832: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "RecommendedExposureIndex", value_string, entries);
+            add_entry(ifd_type, "RecommendedExposureIndex", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8833: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ISOSpeed", value_string, entries);
+            add_entry(ifd_type, "ISOSpeed", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8834: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ISOSpeedLatitudeyyy", value_string, entries);
+            add_entry(ifd_type, "ISOSpeedLatitudeyyy", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x8835: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "IOSpeedLatitudezzz", value_string, entries);
+            add_entry(ifd_type, "IOSpeedLatitudezzz", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9000: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ExifVersion", value_string, entries);
+            add_entry(ifd_type, "ExifVersion", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9003: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "DateTimeOriginal", value_string, entries);
+            add_entry(ifd_type, "DateTimeOriginal", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9004: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "DateTimeDigitized", value_string, entries);
+            add_entry(ifd_type, "DateTimeDigitized", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9101: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ComponentsConfiguration", value_string, entries);
+            add_entry(ifd_type, "ComponentsConfiguration", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9102: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "CompressedBitsPerPixel", value_string, entries);
+            add_entry(ifd_type, "CompressedBitsPerPixel", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9201: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ShutterSpeedValue", value_string, entries);
+            add_entry(ifd_type, "ShutterSpeedValue", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9202: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ApertureValue", value_string, entries);
+            add_entry(ifd_type, "ApertureValue", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9203: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "BrightnessValue", value_string, entries);
+            add_entry(ifd_type, "BrightnessValue", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9204: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ExposureBiasValue", value_string, entries);
+            add_entry(ifd_type, "ExposureBiasValue", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9205: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "MaxApertureValue", value_string, entries);
+            add_entry(ifd_type, "MaxApertureValue", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9206: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SubjectDistance", value_string, entries);
+            add_entry(ifd_type, "SubjectDistance", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9207: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "MeteringMode", value_string, entries);
+            add_entry(ifd_type, "MeteringMode", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9208: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "LightSource", value_string, entries);
+            add_entry(ifd_type, "LightSource", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9209: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Flash", value_string, entries);
+            add_entry(ifd_type, "Flash", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x920a: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FocalLength", value_string, entries);
+            add_entry(ifd_type, "FocalLength", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9214: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SubjectArea", value_string, entries);
+            add_entry(ifd_type, "SubjectArea", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x927c: {
             // currently, we skip the MakerNote entry rather than adding
             // it to entries, so no action.
 #ifdef DEBUG
-            value_string = get_value(tiff_handle, ifd_entry_offset);
+            const std::string &value_string = get_value(tiff_handle, ifd_entry_offset, entries.value_buf());
             std::cout << "exif_entry.add_entry ifd type: '" << (int)ifd_type << "' (skipped)\n";
             std::cout << "exif_entry.add_entry name: '" << "MakerNote" << "' (skipped)\n";
             std::cout << "exif_entry.add_entry value: '" << value_string << "' (skipped)\n";
 #endif
-            //value_string = get_value(tiff_handle, ifd_entry_offset);
-            //add_entry(ifd_type, "MakerNote", value_string, entries);
+            //add_entry(ifd_type, "MakerNote", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9286: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "UserComment", value_string, entries);
+            add_entry(ifd_type, "UserComment", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9290: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SubSecTime", value_string, entries);
+            add_entry(ifd_type, "SubSecTime", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9291: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SubSecTimeOriginal", value_string, entries);
+            add_entry(ifd_type, "SubSecTimeOriginal", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x9292: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SubSecTimeDigitized", value_string, entries);
+            add_entry(ifd_type, "SubSecTimeDigitized", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa000: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FlashpixVersion", value_string, entries);
+            add_entry(ifd_type, "FlashpixVersion", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa001: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ColorSpace", value_string, entries);
+            add_entry(ifd_type, "ColorSpace", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa002: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
+            const std::string &value_string = get_value(tiff_handle, ifd_entry_offset, entries.value_buf());
             uint32_t lx = atol(value_string.c_str());
             if (lx > MAX_IMAGE_SIZE) {
               throw exif_failure_exception_t();
             }
-            add_entry(ifd_type, "PixelXDimension", value_string, entries);
+            entries.add(ifd_type, entry_tag, "PixelXDimension", value_string);
             break;
         }
 	case 0xa003: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
+            const std::string &value_string = get_value(tiff_handle, ifd_entry_offset, entries.value_buf());
             uint32_t ly = atol(value_string.c_str());
             if (ly > MAX_IMAGE_SIZE) {
               throw exif_failure_exception_t();
             }
-            add_entry(ifd_type, "PixelYDimension", value_string, entries);
+            entries.add(ifd_type, entry_tag, "PixelYDimension", value_string);
             break;
         }
 	case 0xa004: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "RelatedSoundFile", value_string, entries);
+            add_entry(ifd_type, "RelatedSoundFile", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa005: // Interoperability tag
@@ -603,158 +582,127 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
             }
             break;
 	case 0xa20b: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FlashEnergy", value_string, entries);
+            add_entry(ifd_type, "FlashEnergy", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa20c: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SpatialFrequencyResponse", value_string, entries);
+            add_entry(ifd_type, "SpatialFrequencyResponse", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa20e: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FocalPlaneXResolution", value_string, entries);
+            add_entry(ifd_type, "FocalPlaneXResolution", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa20f: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FocalPlaneYResolution", value_string, entries);
+            add_entry(ifd_type, "FocalPlaneYResolution", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa210: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FocalPlaneResolutionUnit", value_string, entries);
+            add_entry(ifd_type, "FocalPlaneResolutionUnit", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa214: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SubjectLocation", value_string, entries);
+            add_entry(ifd_type, "SubjectLocation", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa215: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ExposureIndex", value_string, entries);
+            add_entry(ifd_type, "ExposureIndex", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa217: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SensingMethod", value_string, entries);
+            add_entry(ifd_type, "SensingMethod", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa300: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FileSource", value_string, entries);
+            add_entry(ifd_type, "FileSource", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa301: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SceneType", value_string, entries);
+            add_entry(ifd_type, "SceneType", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa302: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "CFAPattern", value_string, entries);
+            add_entry(ifd_type, "CFAPattern", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa401: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "CustomRendered", value_string, entries);
+            add_entry(ifd_type, "CustomRendered", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa402: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ExposureMode", value_string, entries);
+            add_entry(ifd_type, "ExposureMode", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa403: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "WhiteBalance", value_string, entries);
+            add_entry(ifd_type, "WhiteBalance", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa404: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "DigitalZoomRatio", value_string, entries);
+            add_entry(ifd_type, "DigitalZoomRatio", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa405: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "FocalLengthIn35mmFilm", value_string, entries);
+            add_entry(ifd_type, "FocalLengthIn35mmFilm", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa406: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SceneCaptureType", value_string, entries);
+            add_entry(ifd_type, "SceneCaptureType", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa407: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GainControl", value_string, entries);
+            add_entry(ifd_type, "GainControl", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa408: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Contrast", value_string, entries);
+            add_entry(ifd_type, "Contrast", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa409: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Saturation", value_string, entries);
+            add_entry(ifd_type, "Saturation", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa40a: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Sharpness", value_string, entries);
+            add_entry(ifd_type, "Sharpness", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa40b: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "DeviceSettingDescription", value_string, entries);
+            add_entry(ifd_type, "DeviceSettingDescription", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa40c: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "SubjectDistanceRange", value_string, entries);
+            add_entry(ifd_type, "SubjectDistanceRange", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa420: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "ImageUniqueID", value_string, entries);
+            add_entry(ifd_type, "ImageUniqueID", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa430: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "CameraOwnerName", value_string, entries);
+            add_entry(ifd_type, "CameraOwnerName", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa431: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "BodySerialNumber", value_string, entries);
+            add_entry(ifd_type, "BodySerialNumber", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa432: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "LensSpecification", value_string, entries);
+            add_entry(ifd_type, "LensSpecification", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa433: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "LensMake", value_string, entries);
+            add_entry(ifd_type, "LensMake", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa434: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "LensModel", value_string, entries);
+            add_entry(ifd_type, "LensModel", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa435: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "LensSerialNumber", value_string, entries);
+            add_entry(ifd_type, "LensSerialNumber", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0xa500: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "Gamma", value_string, entries);
+            add_entry(ifd_type, "Gamma", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	default: {
@@ -763,9 +711,7 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
                 return;
             }
 
-            generic_name = get_generic_name(tiff_handle, ifd_entry_offset);
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, generic_name, value_string, entries);
+            add_entry(ifd_type, "", tiff_handle, ifd_entry_offset, entries);
             break;
         } // end default
         } // end switch entry_tag
@@ -774,163 +720,131 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
     case IFD1_GPS:
         switch (entry_tag) {
 	case 0x0000: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSVersionID", value_string, entries);
+            add_entry(ifd_type, "GPSVersionID", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0001: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSLatitudeRef", value_string, entries);
+            add_entry(ifd_type, "GPSLatitudeRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0002: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSLatitude", value_string, entries);
+            add_entry(ifd_type, "GPSLatitude", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0003: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSLongitudeRef", value_string, entries);
+            add_entry(ifd_type, "GPSLongitudeRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0004: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSLongitude", value_string, entries);
+            add_entry(ifd_type, "GPSLongitude", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0005: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSAltitudeRef", value_string, entries);
+            add_entry(ifd_type, "GPSAltitudeRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0006: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSAltitude", value_string, entries);
+            add_entry(ifd_type, "GPSAltitude", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0007: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSTimeStamp", value_string, entries);
+            add_entry(ifd_type, "GPSTimeStamp", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0008: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSSatellites", value_string, entries);
+            add_entry(ifd_type, "GPSSatellites", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0009: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSStatus", value_string, entries);
+            add_entry(ifd_type, "GPSStatus", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x000a: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSMeasureMode", value_string, entries);
+            add_entry(ifd_type, "GPSMeasureMode", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x000b: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDOP", value_string, entries);
+            add_entry(ifd_type, "GPSDOP", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x000c: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSSpeedRef", value_string, entries);
+            add_entry(ifd_type, "GPSSpeedRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x000d: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSSpeed", value_string, entries);
+            add_entry(ifd_type, "GPSSpeed", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x000e: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSTrackRef", value_string, entries);
+            add_entry(ifd_type, "GPSTrackRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x000f: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSTrack", value_string, entries);
+            add_entry(ifd_type, "GPSTrack", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0010: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSImgDirectionRef", value_string, entries);
+            add_entry(ifd_type, "GPSImgDirectionRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0011: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSImgDirection", value_string, entries);
+            add_entry(ifd_type, "GPSImgDirection", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0012: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSMapDatum", value_string, entries);
+            add_entry(ifd_type, "GPSMapDatum", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0013: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestLatitudeRef", value_string, entries);
+            add_entry(ifd_type, "GPSDestLatitudeRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0014: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestLatitude", value_string, entries);
+            add_entry(ifd_type, "GPSDestLatitude", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0015: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestLongitudeRef", value_string, entries);
+            add_entry(ifd_type, "GPSDestLongitudeRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0016: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestLongitude", value_string, entries);
+            add_entry(ifd_type, "GPSDestLongitude", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0017: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestBearingRef", value_string, entries);
+            add_entry(ifd_type, "GPSDestBearingRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0018: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestBearing", value_string, entries);
+            add_entry(ifd_type, "GPSDestBearing", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x0019: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestDistanceRef", value_string, entries);
+            add_entry(ifd_type, "GPSDestDistanceRef", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x001a: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDestDistance", value_string, entries);
+            add_entry(ifd_type, "GPSDestDistance", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x001b: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSProcessingMethod", value_string, entries);
+            add_entry(ifd_type, "GPSProcessingMethod", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x001c: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSAreaInformation", value_string, entries);
+            add_entry(ifd_type, "GPSAreaInformation", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x001d: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDateStamp", value_string, entries);
+            add_entry(ifd_type, "GPSDateStamp", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x001e: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSDifferential", value_string, entries);
+            add_entry(ifd_type, "GPSDifferential", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	case 0x001f: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "GPSHPositioningError", value_string, entries);
+            add_entry(ifd_type, "GPSHPositioningError", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	default: {
@@ -939,9 +853,7 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
                 return;
             }
 
-            generic_name = get_generic_name(tiff_handle, ifd_entry_offset);
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, generic_name, value_string, entries);
+            add_entry(ifd_type, "", tiff_handle, ifd_entry_offset, entries);
             break;
         } // end default
         } // end switch entry_tag
@@ -950,8 +862,7 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
     case IFD1_INTEROPERABILITY:
         switch (entry_tag) {
 	case 0x0001: {
-            value_string = get_value(tiff_handle, ifd_entry_offset);
-            add_entry(ifd_type, "InteroperabilityIndex", value_string, entries);
+            add_entry(ifd_type, "InteroperabilityIndex", tiff_handle, ifd_entry_offset, entries);
             break;
         }
 	default: {
@@ -961,9 +872,7 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
             //    return;
             //}
 
-            //generic_name = get_generic_name(tiff_handle, ifd_entry_offset);
-            //value_string = get_value(tiff_handle, ifd_entry_offset);
-            //add_entry(ifd_type, generic_name, value_string, entries);
+            //add_entry(ifd_type, "", tiff_handle, ifd_entry_offset, entries);
             //break;
         } // end default
         } // end switch (entry_tag)
@@ -976,59 +885,54 @@ void entry_reader::parse_entry(ifd_type_t ifd_type, tiff_handle_t &tiff_handle,
     } // end switch ifd_type
 }
 
-// entry value
-static std::string get_value(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+// entry value, formatted into out, which is returned
+static const std::string &get_value(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
     // entry type and entry count
     const uint16_t entry_type = get_entry_type(tiff_handle, ifd_entry_offset);
 
     // value
+    out.clear();
     switch(entry_type) {
     case EXIF_BYTE:
-        return get_exif_byte(tiff_handle, ifd_entry_offset);
+        get_exif_byte(tiff_handle, ifd_entry_offset, out);
+        break;
     case EXIF_ASCII:
-        return get_exif_ascii(tiff_handle, ifd_entry_offset);
+        get_exif_ascii(tiff_handle, ifd_entry_offset, out);
+        break;
     case EXIF_SHORT:
-        return get_exif_short(tiff_handle, ifd_entry_offset);
+        get_exif_short(tiff_handle, ifd_entry_offset, out);
+        break;
     case EXIF_LONG:
-        return get_exif_long(tiff_handle, ifd_entry_offset);
+        get_exif_long(tiff_handle, ifd_entry_offset, out);
+        break;
     case EXIF_RATIONAL:
-        return get_exif_rational(tiff_handle, ifd_entry_offset);
+        get_exif_rational(tiff_handle, ifd_entry_offset, out);
+        break;
     case EXIF_UNDEFINED:
-        return get_exif_undefined(tiff_handle, ifd_entry_offset);
+        get_exif_undefined(tiff_handle, ifd_entry_offset, out);
+        break;
     case EXIF_SLONG:
-        return get_exif_slong(tiff_handle, ifd_entry_offset);
+        get_exif_slong(tiff_handle, ifd_entry_offset, out);
+        break;
     case EXIF_SRATIONAL:
-        return get_exif_srational(tiff_handle, ifd_entry_offset);
+        get_exif_srational(tiff_handle, ifd_entry_offset, out);
+        break;
     default:
         // NOTE: in future, we may wish to log the invalid entry_type to diagnostics
         //       when in full diagnostics mode.
 
         // the type is not valid, so use best-effort and return value for UNDEFINED type
-        return get_exif_undefined(tiff_handle, ifd_entry_offset);
+        get_exif_undefined(tiff_handle, ifd_entry_offset, out);
+        break;
     }
+    return out;
 }
 
-// generic entry value
-static std::string get_generic_name(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
-    // create a generic name as "entry(N)"
-    uint16_t entry_tag;
-    try {
-        entry_tag = tiff_handle.sbuf->get16u(ifd_entry_offset + 0, tiff_handle.byte_order);
-    } catch (const sbuf_t::range_exception_t &e) {
-        entry_tag = 0;
-    }
-    std::stringstream ss;
-    ss << "entry_0x";
-    ss.width(4);
-    ss.fill('0');
-    ss << std::hex << entry_tag;
-    std::string name = ss.str();
-
-    return name;
-}
+// name is a string literal, or "" for a tag without a name
+static void add_entry(ifd_type_t ifd_type, std::string_view name, tiff_handle_t &tiff_handle,
+                      uint32_t ifd_entry_offset, entry_list_t &entries) {
 
-static void add_entry(ifd_type_t ifd_type, const std::string &name, const std::string &value,
-                      entry_list_t &entries) {
+    const std::string &value = get_value(tiff_handle, ifd_entry_offset, entries.value_buf());
 
     // push the name and value onto entries
 #ifdef DEBUG
@@ -1037,7 +941,7 @@ static void add_entry(ifd_type_t ifd_type, const std::string &name, const std::s
     std::cout << "exif_entry.add_entry value: '" << value << "'\n";
 #endif
 
-    entries.push_back(std::make_unique<exif_entry>(ifd_type, name, value));
+    entries.add(ifd_type, get_entry_tag(tiff_handle, ifd_entry_offset), name, value);
 }
 
 inline static uint16_t get_entry_tag(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
@@ -1185,44 +1089,41 @@ static bool char_pairs_match(const sbuf_t &sbuf, size_t count) {
     return true;
 }
 
-static std::string get_possible_utf8(const sbuf_t &sbuf, size_t count) {
+static void get_possible_utf8(const sbuf_t &sbuf, size_t count, std::string &out) {
     if (chars_match(sbuf, count) || char_pairs_match(sbuf, count)) {
-        // this is an uninteresting sequence, so return ""
-        return "";
+        // this is an uninteresting sequence, so append nothing
+        return;
     } else {
         std::string s = sbuf.getUTF8(0, count);
         validateOrEscapeUTF8(s,true,false,true);
-        return s;
+        out += s;
     }
 }
 
-// read utf16 and return unvalidated utf8
-std::string get_possible_utf16(const sbuf_t sbuf, size_t count, sbuf_t::byte_order_t byte_order) {
+// read utf16 and append unvalidated utf8
+void get_possible_utf16(const sbuf_t sbuf, size_t count, sbuf_t::byte_order_t byte_order, std::string &out) {
 
     // check for sequence
     if (chars_match(sbuf, count) || char_pairs_match(sbuf, count)) {
-        // this is an uninteresting sequence, so return ""
-        return "";
+        // this is an uninteresting sequence, so append nothing
+        return;
     }
 
     // get wstring accounting for byte order
     std::wstring wstr = sbuf.getUTF16(0, count, byte_order);
 
     // convert wstring to string
-    std::string utf8_string = safe_utf16to8(wstr);
-
-    return utf8_string;
+    out += safe_utf16to8(wstr);
 }
 
-// read utf32 and return unvalidated utf8
-std::string get_possible_utf32(const sbuf_t &sbuf, size_t count, sbuf_t::byte_order_t byte_order) {
+// read utf32 and append unvalidated utf8
+void get_possible_utf32(const sbuf_t &sbuf, size_t count, sbuf_t::byte_order_t byte_order, std::string &utf8_string) {
 
     // check for sequence
     if (chars_match(sbuf, count) || char_pairs_match(sbuf, count)) {
-        // this is an uninteresting sequence, so return ""
-        return "";
+        // this is an uninteresting sequence, so append nothing
+        return;
     }
-    std::string utf8_string;
     std::back_insert_iterator<std::basic_string<char> > result = back_inserter(utf8_string);
 
     for (uint32_t i=0; i<count; i++) {
@@ -1245,7 +1146,6 @@ std::string get_possible_utf32(const sbuf_t &sbuf, size_t count, sbuf_t::byte_or
             break;
         }
     }
-    return utf8_string;
 }
 
 
@@ -1253,7 +1153,7 @@ std::string get_possible_utf32(const sbuf_t &sbuf, size_t count, sbuf_t::byte_or
 // END This section provides interfaces get_possible_utf16, and get_possible_utf32.
 // ************************************************************
 // ************************************************************
-// all these ifd value readers return string
+// all these ifd value readers append to out
 // ************************************************************
 // EXIF_BYTE uint8
 /**
@@ -1261,7 +1161,7 @@ std::string get_possible_utf32(const sbuf_t &sbuf, size_t count, sbuf_t::byte_or
  * such that further entry parsing would be invalid.
  * @Throws exif_failure_exception_t
  */
-static std::string get_exif_byte(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_byte(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
 
     uint32_t count = get_entry_count(tiff_handle, ifd_entry_offset);
     uint32_t offset = get_data_offset(tiff_handle, ifd_entry_offset);
@@ -1272,19 +1172,17 @@ static std::string get_exif_byte(tiff_handle_t &tiff_handle, uint32_t ifd_entry_
 
     if (count == 1) {
         // count is 1 so print the byte as an integer
-        std::stringstream ss;
         try {
-	    ss << (int)tiff_handle.sbuf->get8u(offset);
+	    append_number(out, (int)tiff_handle.sbuf->get8u(offset));
         } catch (const sbuf_t::range_exception_t &e) {
-            // add nothing to ss
+            // add nothing to out
         }
-        return ss.str();
 
     } else {
         // count is not 1 so return the bytes as utf8
         // TODO: replace this with sbuf mechanism to get UTF8?
         // return tiff_handle.getUTF8(offset, count, utf8_string)
-        return get_possible_utf8(tiff_handle.sbuf->slice(offset), count);
+        get_possible_utf8(tiff_handle.sbuf->slice(offset), count, out);
     }
 }
 
@@ -1294,7 +1192,7 @@ static std::string get_exif_byte(tiff_handle_t &tiff_handle, uint32_t ifd_entry_
  * such that further entry parsing would be invalid.
  * @Throws exif_failure_exception_t
  */
-static std::string get_exif_ascii(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_ascii(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
     // print each byte as a character in a string
     uint32_t count = get_entry_count(tiff_handle, ifd_entry_offset);
     uint32_t offset = get_data_offset(tiff_handle, ifd_entry_offset);
@@ -1316,7 +1214,7 @@ static std::string get_exif_ascii(tiff_handle_t &tiff_handle, uint32_t ifd_entry
     }
 
     // although 7-bit ascii is expected, parse using UTF-8
-    return get_possible_utf8(tiff_handle.sbuf->slice(offset), count);
+    get_possible_utf8(tiff_handle.sbuf->slice(offset), count, out);
 }
 
 // EXIF_SHORT uint16
@@ -1325,7 +1223,7 @@ static std::string get_exif_ascii(tiff_handle_t &tiff_handle, uint32_t ifd_entry
  * such that further entry parsing would be invalid.
  * @Throws exif_failure_exception_t
  */
-static std::string get_exif_short(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_short(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
     // print each short separated by a space
     uint32_t count = get_entry_count(tiff_handle, ifd_entry_offset);
     uint32_t offset = get_data_offset(tiff_handle, ifd_entry_offset);
@@ -1336,21 +1234,18 @@ static std::string get_exif_short(tiff_handle_t &tiff_handle, uint32_t ifd_entry
 
     if (count == 1) {
         // count is 1 so print the uint16 as an integer
-        std::stringstream ss;
         try {
-	    ss << (int)tiff_handle.sbuf->get16u(offset, tiff_handle.byte_order);
+	    append_number(out, (int)tiff_handle.sbuf->get16u(offset, tiff_handle.byte_order));
         } catch (const sbuf_t::range_exception_t &e) {
-            // add nothing to ss
+            // add nothing to out
         }
-        return ss.str();
 
     } else {
         // count is not 1 so print the uint16_t bytes as utf8
-        std::string s = get_possible_utf16( tiff_handle.sbuf->slice(offset), count, tiff_handle.byte_order);
+        get_possible_utf16( tiff_handle.sbuf->slice(offset), count, tiff_handle.byte_order, out);
 #ifdef DEBUG
-        std::cout << "exif_entry.get_exif_short (escaped): '" << validateOrEscapeUTF8(s, true, false) << "'\n";
+        std::cout << "exif_entry.get_exif_short (escaped): '" << validateOrEscapeUTF8(out, true, false) << "'\n";
 #endif
-        return s;
     }
 }
 
@@ -1360,7 +1255,7 @@ static std::string get_exif_short(tiff_handle_t &tiff_handle, uint32_t ifd_entry
  * such that further entry parsing would be invalid.
  * @Throws exif_failure_exception_t
  */
-static std::string get_exif_long(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_long(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
 
     // print each long separated by a space
     uint32_t count = get_entry_count(tiff_handle, ifd_entry_offset);
@@ -1372,21 +1267,18 @@ static std::string get_exif_long(tiff_handle_t &tiff_handle, uint32_t ifd_entry_
 
     if (count == 1) {
         // count is 1 so print the long directly
-        std::stringstream ss;
         try {
-	    ss << (uint32_t)tiff_handle.sbuf->get32u(offset, tiff_handle.byte_order);
+	    append_number(out, (uint32_t)tiff_handle.sbuf->get32u(offset, tiff_handle.byte_order));
         } catch (const sbuf_t::range_exception_t &e) {
-            // add nothing to ss
+            // add nothing to out
         }
-        return ss.str();
 
     } else {
         // count is not 1 so print the uint32_t bytes as utf8
-        std::string s = get_possible_utf32( tiff_handle.sbuf->slice(offset), count, tiff_handle.byte_order);
+        get_possible_utf32( tiff_handle.sbuf->slice(offset), count, tiff_handle.byte_order, out);
 #ifdef DEBUG
-        std::cout << "exif_entry.get_exif_short (escaped): '" << validateOrEscapeUTF8(s, true, false) << "'\n";
+        std::cout << "exif_entry.get_exif_short (escaped): '" << validateOrEscapeUTF8(out, true, false) << "'\n";
 #endif
-        return s;
     }
 }
 
@@ -1396,7 +1288,7 @@ static std::string get_exif_long(tiff_handle_t &tiff_handle, uint32_t ifd_entry_
  * such that further entry parsing would be invalid.
  * @Throws exif_failure_exception_t
  */
-static std::string get_exif_rational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_rational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
     // print each rational as 1'st uint32, "/", 2'nd uint32, separated by a space
     uint32_t count = get_entry_count(tiff_handle, ifd_entry_offset);
     uint32_t offset = get_data_offset(tiff_handle, ifd_entry_offset);
@@ -1405,26 +1297,25 @@ static std::string get_exif_rational(tiff_handle_t &tiff_handle, uint32_t ifd_en
     tiff_handle.bytes_read += count * 8; // exif standard: 1 exif rational is 8 bytes long
     if (count >= 0x2000 || tiff_handle.bytes_read >= 0x10000) throw exif_failure_exception_t();
 
-    std::stringstream ss;
     for (uint32_t i=0; i<count; i++) {
         try {
 	    // return 1'st uint32, "/", 2'nd uint32
-            ss << tiff_handle.sbuf->get32u(offset + i * 8, tiff_handle.byte_order) << "/"
-               << tiff_handle.sbuf->get32u(offset + i * 8 + 4, tiff_handle.byte_order);
+            append_number(out, tiff_handle.sbuf->get32u(offset + i * 8, tiff_handle.byte_order));
+            out += '/';
+            append_number(out, tiff_handle.sbuf->get32u(offset + i * 8 + 4, tiff_handle.byte_order));
 	    if (i + 1 < count) {
-	        ss << " ";
+	        out += ' ';
 	    }
         } catch (const sbuf_t::range_exception_t &e) {
             break;
         }
     }
-    return ss.str();
 }
 
 // EXIF_UNDEFINED byte whose value depends on the field definition
-static std::string get_exif_undefined(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_undefined(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
     // print UNDEFINED as byte
-    return get_exif_byte(tiff_handle, ifd_entry_offset);
+    get_exif_byte(tiff_handle, ifd_entry_offset, out);
 }
 
 // EXIF_SLONG int32
@@ -1433,7 +1324,7 @@ static std::string get_exif_undefined(tiff_handle_t &tiff_handle, uint32_t ifd_e
  * such that further entry parsing would be invalid.
  * @Throws exif_failure_exception_t
  */
-static  std::string get_exif_slong(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_slong(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
     // print each signed long
     uint32_t count = get_entry_count(tiff_handle, ifd_entry_offset);
     uint32_t offset = get_data_offset(tiff_handle, ifd_entry_offset);
@@ -1442,20 +1333,17 @@ static  std::string get_exif_slong(tiff_handle_t &tiff_handle, uint32_t ifd_entr
     tiff_handle.bytes_read += count * 4; // exif standard: 1 exif slong is 4 bytes long
     if (count >= 0x4000 || tiff_handle.bytes_read >= 0x10000) throw exif_failure_exception_t();
 
-    std::stringstream ss;
     for (uint32_t i=0; i<count; i++) {
         try {
-	    ss << tiff_handle.sbuf->get32i(offset + i * 4, tiff_handle.byte_order);
+	    append_number(out, tiff_handle.sbuf->get32i(offset + i * 4, tiff_handle.byte_order));
         } catch (const sbuf_t::range_exception_t &e) {
             // at end
             break;
         }
 	if (i + 1 < count) {
-	    ss << " ";
+	    out += ' ';
 	}
     }
-
-    return ss.str();
 }
 
 // EXIF_SRATIONAL int64
@@ -1464,7 +1352,7 @@ static  std::string get_exif_slong(tiff_handle_t &tiff_handle, uint32_t ifd_entr
  * such that further entry parsing would be invalid.
  * @Throws exif_failure_exception_t
  */
-static std::string get_exif_srational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset) {
+static void get_exif_srational(tiff_handle_t &tiff_handle, uint32_t ifd_entry_offset, std::string &out) {
     // print each rational as 1'st uint32, "/", 2'nd uint32, separated by a space
     uint32_t count = get_entry_count(tiff_handle, ifd_entry_offset);
     uint32_t offset = get_data_offset(tiff_handle, ifd_entry_offset);
@@ -1473,18 +1361,17 @@ static std::string get_exif_srational(tiff_handle_t &tiff_handle, uint32_t ifd_e
     tiff_handle.bytes_read += count * 8; // exif standard: 1 exif srational is 8 bytes long
     if (count >= 0x2000 || tiff_handle.bytes_read >= 0x10000) throw exif_failure_exception_t();
 
-    std::stringstream ss;
     for (uint32_t i=0; i<count; i++) {
         try {
 	    // return 1'st int32, "/", 2'nd int32
-            ss << tiff_handle.sbuf->get32i(offset + i * 8, tiff_handle.byte_order) << "/"
-               << tiff_handle.sbuf->get32i(offset + i * 8 + 4, tiff_handle.byte_order);
+            append_number(out, tiff_handle.sbuf->get32i(offset + i * 8, tiff_handle.byte_order));
+            out += '/';
+            append_number(out, tiff_handle.sbuf->get32i(offset + i * 8 + 4, tiff_handle.byte_order));
 	    if (i + 1 < count) {
-	        ss << " ";
+	        out += ' ';
 	    }
         } catch (const sbuf_t::range_exception_t &e) {
             break;
         }
     }
-    return ss.str();
 }
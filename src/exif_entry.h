@@ -1,26 +1,65 @@
 #ifndef EXIF_ENTRY_H
 #define EXIF_ENTRY_H
 
-#include <vector>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 
 
 /**
  * EXIF entry
+ * The name is a string literal, or empty for a tag that has no name, which is reported as
+ * entry_0xNNNN; the Copyright tag of a TIFF IFD is reported with no name at all, as it always was.
+ * The value is held by the entry_list_t that the entry is in.
+ */
+struct exif_entry {
+    uint16_t ifd_type {};
+    uint16_t tag {};
+    std::string_view name {};
+    std::string_view value {};
+    void append_full_name(std::string &out) const;  // e.g. "ifd0.exif.DateTimeOriginal"
+    std::string get_full_name() const;
+};
+
+/**
+ * The entries read from one TIFF structure.
+ * The values are copied into blocks that are kept when the list is cleared, so a list that is
+ * reused from one JPEG to the next stops allocating once it has seen the largest one.
+ * Clearing the list invalidates the entries' names and values.
  */
-class exif_entry {
-    const exif_entry &operator=(const exif_entry &that);
+class entry_list_t {
 public:
-    const uint16_t ifd_type {};
-    const std::string name {};
-    const std::string value {};
-    exif_entry(uint16_t ifd_type_, const std::string &name_, const std::string &value_);
-    exif_entry(const exif_entry &that);     // copy
-    exif_entry(const exif_entry &&that);     // move
-    ~exif_entry();
-    const std::string get_full_name() const;
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+    entry_list_t() {}
+    entry_list_t(const entry_list_t &) = delete;
+    entry_list_t &operator=(const entry_list_t &) = delete;
+
+    void add(uint16_t ifd_type, uint16_t tag, std::string_view name, std::string_view value);
+    std::string &value_buf() { return buf; } // for formatting a value before it is added
+    void clear();
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    const exif_entry &operator[](size_t i) const { return entries[i]; }
+    std::vector<exif_entry>::const_iterator begin() const { return entries.begin(); }
+    std::vector<exif_entry>::const_iterator end() const { return entries.end(); }
+
+private:
+    struct block_t {
+        std::unique_ptr<char[]> data {};
+        size_t size {0};
+    };
+    std::string_view copy(std::string_view value);
+
+    std::vector<exif_entry> entries {};
+    std::vector<block_t> blocks {};
+    size_t block {0};           // the block being filled
+    size_t used {0};            // the bytes of it that are in use
+    std::string buf {};
 };
-typedef std::vector< std::unique_ptr<exif_entry >> entry_list_t;
 
 #endif
@@ -0,0 +1,128 @@
+/**
+ * feature_census.cpp:
+ * Live counts of the features of each recorder; see feature_census.h.
+ */
+
+#include "config.h"
+
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+#include "feature_census.h"
+
+/* splitmix64 finalizer, as std::hash of a string need not mix its high bits */
+static inline uint64_t fmix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void hyperloglog::add(std::string_view s)
+{
+    add_hash(fmix64(std::hash<std::string_view>()(s)));
+}
+
+void hyperloglog::add_hash(uint64_t h)
+{
+    const size_t i = h >> (64 - P);
+    const uint64_t rest = h << P;
+    const uint8_t rank = rest ? __builtin_clzll(rest) + 1 : 64 - P + 1;
+    if (rank > registers[i]) registers[i] = rank;
+}
+
+void hyperloglog::merge(const hyperloglog &that)
+{
+    for (size_t i = 0; i < REGISTERS; i++) {
+        if (that.registers[i] > registers[i]) registers[i] = that.registers[i];
+    }
+}
+
+double hyperloglog::estimate() const
+{
+    const double m = REGISTERS;
+    double sum = 0;
+    size_t zeros = 0;
+    for (auto r : registers) {
+        sum += std::ldexp(1.0, -r);
+        if (r == 0) zeros++;
+    }
+    const double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) return m * std::log(m / zeros); // linear counting, for the small counts
+    return e;
+}
+
+feature_census::feature_census(): feature_sink("census")
+{
+    std::lock_guard<std::mutex> lock(Mcurrent);
+    current = this;
+}
+
+feature_census::~feature_census()
+{
+    std::lock_guard<std::mutex> lock(Mcurrent);
+    if (current == this) current = nullptr;
+}
+
+std::string_view feature_census::feature_of(std::string_view line)
+{
+    const size_t tab1 = line.find('\t');
+    if (tab1 == std::string_view::npos) return {};
+    const size_t tab2 = line.find_first_of("\t\n", tab1 + 1);
+    return line.substr(tab1 + 1, tab2 == std::string_view::npos ? std::string_view::npos : tab2 - tab1 - 1);
+}
+
+bool feature_census::write(const std::string &recorder, const std::string &lines)
+{
+    /* the sketch is updated outside the lock, which only notify_thread and the report contend for */
+    entry batch;
+    std::string_view rest(lines);
+    while (!rest.empty()) {
+        const size_t nl = rest.find('\n');
+        const std::string_view line = rest.substr(0, nl);
+        rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+        if (line.empty()) continue;
+        batch.features++;
+        batch.distinct.add(feature_of(line));
+    }
+    std::lock_guard<std::mutex> lock(M);
+    entry &e = entries[recorder];
+    e.features += batch.features;
+    e.distinct.merge(batch.distinct);
+    return true;
+}
+
+void feature_census::add_realtime_stats(std::map<std::string, std::string> &stats)
+{
+    std::lock_guard<std::mutex> lock_current(Mcurrent);
+    if (current == nullptr) return;
+    feature_census &c = *current;
+    std::lock_guard<std::mutex> lock(c.M);
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto &[name, e] : c.entries) {
+        std::stringstream ss;
+        ss << e.features << " features, ~" << std::llround(e.distinct.estimate()) << " distinct";
+        auto it = c.last.find(name);
+        if (it != c.last.end()) {
+            const double seconds = std::chrono::duration<double>(now - it->second.when).count();
+            if (seconds > 0) {
+                ss << ", " << std::fixed << std::setprecision(1) << (e.features - it->second.features) / seconds << "/s";
+            }
+        }
+        stats["census_" + name] = ss.str();
+        c.last[name] = sample{e.features, now};
+    }
+}
+
+std::map<std::string, std::string> feature_census::xml_attributes() const
+{
+    std::lock_guard<std::mutex> lock(M);
+    std::map<std::string, std::string> ret;
+    for (const auto &[name, e] : entries) {
+        ret[name] = "features='" + std::to_string(e.features) + "' distinct='"
+            + std::to_string(std::llround(e.distinct.estimate())) + "'";
+    }
+    return ret;
+}
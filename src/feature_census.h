@@ -0,0 +1,80 @@
+#ifndef FEATURE_CENSUS_H
+#define FEATURE_CENSUS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "feature_sink.h"
+
+/**
+ * hyperloglog:
+ * An estimate of the number of distinct strings added, in 2^P one-byte registers, within about
+ * 1.04/sqrt(2^P) (1.6% for P=12) of the true number; sketches of two streams merge into the sketch
+ * of both.
+ */
+class hyperloglog {
+public:
+    static inline const unsigned P {12};
+    static inline const size_t REGISTERS {size_t(1) << P};
+
+    void add(std::string_view s);
+    void add_hash(uint64_t h);
+    void merge(const hyperloglog &that);
+    double estimate() const;
+
+private:
+    uint8_t registers[REGISTERS] {};
+};
+
+/**
+ * feature_census:
+ * Live counts of the features of each recorder, of how many of them are distinct, and of how fast they
+ * are being found, so that a run can be judged (and stopped or re-planned) while it is still going.
+ *
+ * Enabled with -S feature_census=YES. The census is a feature_sink: a feature_stream follows every
+ * feature file and gives it the lines as they are written, so the scanners do nothing more for it and
+ * it works for every recorder, including those of scanners that write through be13_api alone. The
+ * lines come from the one stream thread, so each recorder has one sketch rather than one a thread.
+ * The recorders of -S histogram_only have no feature file and are not counted.
+ *
+ * add_realtime_stats() gives notify_thread a census_NAME line for each recorder, with the rate since
+ * the last call; the totals go in the report at the end of the run with xml_attributes().
+ */
+class feature_census : public feature_sink {
+public:
+    struct entry {
+        uint64_t    features {0};
+        hyperloglog distinct {};
+    };
+
+    feature_census();
+    ~feature_census();
+    bool write(const std::string &recorder, const std::string &lines) override;
+    bool carve(const std::string &, const std::filesystem::path &, const std::filesystem::path &) override { return true; }
+
+    /* The feature of a line of a feature file: the text between its first two tabs */
+    static std::string_view feature_of(std::string_view line);
+
+    /* census_NAME: "N features, ~D distinct, R/s", for the census that is running, if there is one */
+    static void add_realtime_stats(std::map<std::string, std::string> &stats);
+    /* recorder -> the attributes of its <recorder> element in the report */
+    std::map<std::string, std::string> xml_attributes() const;
+
+private:
+    mutable std::mutex M {};
+    std::map<std::string, entry> entries {};
+    struct sample {
+        uint64_t features {0};
+        std::chrono::steady_clock::time_point when {};
+    };
+    std::map<std::string, sample> last {};  // at the last add_realtime_stats()
+
+    static inline std::mutex Mcurrent {};
+    static inline feature_census *current {nullptr};
+};
+
+#endif
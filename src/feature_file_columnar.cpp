@@ -0,0 +1,219 @@
+/**
+ * feature_file_columnar: binary columnar copies of the feature files.
+ * See feature_file_columnar.h.
+ */
+
+#include "config.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "feature_file_columnar.h"
+#include "feature_files.h"
+
+namespace {
+    const std::string COL_EXTENSION {".col"};
+    const size_t MAGIC_LEN {sizeof(COLUMNAR_MAGIC) - 1};
+
+    void put_u32(std::string &out, uint32_t v) {
+        for (int i = 0; i < 4; i++) out.push_back(char((v >> (8 * i)) & 0xff));
+    }
+    void put_u64(std::string &out, uint64_t v) {
+        for (int i = 0; i < 8; i++) out.push_back(char((v >> (8 * i)) & 0xff));
+    }
+    uint64_t get_le(const std::string &in, size_t &pos, int bytes) {
+        if (pos + bytes > in.size()) throw std::runtime_error("feature_file_columnar: truncated file");
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) v |= uint64_t(uint8_t(in[pos + i])) << (8 * i);
+        pos += bytes;
+        return v;
+    }
+
+    /* A column's dictionary: the entries new in this row group, and a lookup of earlier ones while it fits */
+    class dictionary {
+        std::unordered_map<std::string, uint32_t> ids {};
+        size_t   lookup_bytes {0};
+        const size_t max_bytes;
+        uint32_t count {0};
+    public:
+        std::vector<std::string> added {};
+        explicit dictionary(size_t max_bytes_) : max_bytes(max_bytes_) {}
+        uint32_t id(const std::string &value) {
+            auto it = ids.find(value);
+            if (it != ids.end()) return it->second;
+            if (count == COLUMNAR_NONE) throw std::runtime_error("feature_file_columnar: too many values");
+            if (lookup_bytes < max_bytes) {
+                ids.emplace(value, count);
+                lookup_bytes += value.size() + sizeof(uint32_t);
+            }
+            added.push_back(value);
+            return count++;
+        }
+        void write_added(std::string &out) {
+            for (const auto &it : added) put_u32(out, it.size());
+            for (const auto &it : added) out += it;
+            added.clear();
+        }
+    };
+
+    /* Splits a forensic path such as "1024-GZIP-0" into 1024 and "-GZIP-0", if "1024" prints as it was written */
+    uint64_t split_pos0(const std::string &path, std::string &rest) {
+        size_t digits = 0;
+        while (digits < path.size() && path[digits] >= '0' && path[digits] <= '9') digits++;
+        if (digits == 0 || digits > 19 || (path[0] == '0' && digits > 1)) {
+            rest = path;
+            return COLUMNAR_NO_POS0;
+        }
+        rest = path.substr(digits);
+        return std::stoull(path.substr(0, digits));
+    }
+}
+
+std::string columnar_features::line(size_t row) const
+{
+    std::string ret = pos0[row] == COLUMNAR_NO_POS0 ? std::string() : std::to_string(pos0[row]);
+    ret += path_dict[path[row]];
+    if (feature[row] != COLUMNAR_NONE) {
+        ret += "\t" + feature_dict[feature[row]];
+        if (context[row] != COLUMNAR_NONE) ret += "\t" + context_dict[context[row]];
+    }
+    return ret;
+}
+
+uint64_t columnar_feature_file(const std::filesystem::path &txt, size_t dictionary_bytes)
+{
+    if (dictionary_bytes == 0) dictionary_bytes = COLUMNAR_DICTIONARY_BYTES_DEFAULT;
+    auto col = txt;
+    col.replace_extension(COL_EXTENSION);
+    const auto col_tmp = std::filesystem::path(col.string() + ".tmp");
+
+    try {
+        std::ifstream in(txt, std::ios::binary);
+        std::ofstream out(col_tmp, std::ios::binary);
+        if (!in || !out) throw std::runtime_error("feature_file_columnar: cannot open " + txt.string());
+        out.write(COLUMNAR_MAGIC, MAGIC_LEN);
+
+        dictionary paths(dictionary_bytes), features(dictionary_bytes), contexts(dictionary_bytes);
+        std::vector<uint64_t> pos0;
+        std::vector<uint32_t> path_ids, feature_ids, context_ids;
+        std::vector<uint64_t> group_offsets;
+        uint64_t offset = MAGIC_LEN, rows = 0;
+        std::string group;
+
+        auto write_group = [&]() {
+            group.clear();
+            put_u64(group, pos0.size());
+            put_u32(group, paths.added.size());
+            put_u32(group, features.added.size());
+            put_u32(group, contexts.added.size());
+            paths.write_added(group);
+            features.write_added(group);
+            contexts.write_added(group);
+            for (auto it : pos0) put_u64(group, it);
+            for (auto it : path_ids) put_u32(group, it);
+            for (auto it : feature_ids) put_u32(group, it);
+            for (auto it : context_ids) put_u32(group, it);
+            out.write(group.data(), group.size());
+            group_offsets.push_back(offset);
+            offset += group.size();
+            rows += pos0.size();
+            pos0.clear();
+            path_ids.clear();
+            feature_ids.clear();
+            context_ids.clear();
+        };
+
+        std::string line, rest;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            const size_t tab1 = line.find('\t');
+            const size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+            pos0.push_back(split_pos0(line.substr(0, tab1), rest));
+            path_ids.push_back(paths.id(rest));
+            feature_ids.push_back(tab1 == std::string::npos ? COLUMNAR_NONE :
+                                  features.id(line.substr(tab1 + 1, tab2 - tab1 - 1)));
+            context_ids.push_back(tab2 == std::string::npos ? COLUMNAR_NONE : contexts.id(line.substr(tab2 + 1)));
+            if (pos0.size() == COLUMNAR_GROUP_ROWS) write_group();
+        }
+        if (in.bad()) throw std::runtime_error("feature_file_columnar: cannot read " + txt.string());
+        if (!pos0.empty()) write_group();
+
+        std::string footer;
+        for (auto it : group_offsets) put_u64(footer, it);
+        put_u64(footer, group_offsets.size());
+        put_u64(footer, rows);
+        footer.append(COLUMNAR_MAGIC, MAGIC_LEN);
+        out.write(footer.data(), footer.size());
+        out.close();
+        if (!out) throw std::runtime_error("feature_file_columnar: cannot write " + col.string());
+        std::filesystem::rename(col_tmp, col);
+        return rows;
+    }
+    catch (const std::exception &e) {
+        std::error_code ec;
+        std::filesystem::remove(col_tmp, ec);
+        throw std::runtime_error(e.what());
+    }
+}
+
+std::vector<std::filesystem::path> columnar_feature_files(const std::filesystem::path &outdir, size_t dictionary_bytes,
+                                                          unsigned threads)
+{
+    const auto files = output_text_files(outdir, true);
+    for_each_file(files, threads, [dictionary_bytes](const std::filesystem::path &txt) {
+        columnar_feature_file(txt, dictionary_bytes);
+    });
+    return files;
+}
+
+columnar_features read_columnar_features(const std::filesystem::path &col)
+{
+    std::ifstream in(col, std::ios::binary);
+    if (!in) throw std::runtime_error("feature_file_columnar: cannot open " + col.string());
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < 2 * MAGIC_LEN + 16 || data.compare(0, MAGIC_LEN, COLUMNAR_MAGIC) != 0 ||
+        data.compare(data.size() - MAGIC_LEN, MAGIC_LEN, COLUMNAR_MAGIC) != 0) {
+        throw std::runtime_error("feature_file_columnar: not a columnar feature file: " + col.string());
+    }
+    size_t pos = data.size() - MAGIC_LEN - 16;
+    const uint64_t groups = get_le(data, pos, 8);
+    const uint64_t rows   = get_le(data, pos, 8);
+
+    columnar_features ret;
+    ret.pos0.reserve(rows);
+    ret.path.reserve(rows);
+    ret.feature.reserve(rows);
+    ret.context.reserve(rows);
+    pos = MAGIC_LEN;
+    for (uint64_t g = 0; g < groups; g++) {
+        const uint64_t n = get_le(data, pos, 8);
+        uint32_t added[3];
+        for (auto &it : added) it = get_le(data, pos, 4);
+        std::vector<std::string> *dicts[3] = {&ret.path_dict, &ret.feature_dict, &ret.context_dict};
+        for (int d = 0; d < 3; d++) {
+            std::vector<uint32_t> lengths;
+            for (uint32_t i = 0; i < added[d]; i++) lengths.push_back(get_le(data, pos, 4));
+            for (auto len : lengths) {
+                if (pos + len > data.size()) throw std::runtime_error("feature_file_columnar: truncated file");
+                dicts[d]->push_back(data.substr(pos, len));
+                pos += len;
+            }
+        }
+        for (uint64_t i = 0; i < n; i++) ret.pos0.push_back(get_le(data, pos, 8));
+        for (auto *column : {&ret.path, &ret.feature, &ret.context}) {
+            for (uint64_t i = 0; i < n; i++) column->push_back(get_le(data, pos, 4));
+        }
+    }
+    if (ret.rows() != rows) throw std::runtime_error("feature_file_columnar: bad footer in " + col.string());
+    for (size_t i = 0; i < rows; i++) {
+        if (ret.path[i] >= ret.path_dict.size() ||
+            (ret.feature[i] != COLUMNAR_NONE && ret.feature[i] >= ret.feature_dict.size()) ||
+            (ret.context[i] != COLUMNAR_NONE && ret.context[i] >= ret.context_dict.size())) {
+            throw std::runtime_error("feature_file_columnar: bad dictionary index in " + col.string());
+        }
+    }
+    return ret;
+}
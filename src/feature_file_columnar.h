@@ -0,0 +1,66 @@
+#ifndef FEATURE_FILE_COLUMNAR_H
+#define FEATURE_FILE_COLUMNAR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * feature_file_columnar:
+ * A binary, columnar copy of each feature file, so that post-processing does not have to split
+ * and parse the text files line by line. Enabled with -S columnar_feature_files=YES; at the end
+ * of phase 2 each feature file *.txt in the output directory gets a *.col beside it. Histograms
+ * are not converted.
+ *
+ * Each line of the feature file is a row of four columns:
+ *   pos0     the leading decimal offset of the forensic path (COLUMNAR_NO_POS0 if there is none)
+ *   path     the rest of the forensic path, such as "-GZIP-1024" (usually "")
+ *   feature  the feature, escaped as in the text file
+ *   context  the rest of the line after the second tab, escaped as in the text file
+ * so that the line is pos0 (if any), path, tab, feature, tab and context. The three string columns
+ * are dictionary encoded: a row holds the index of its value in the column's dictionary, or
+ * COLUMNAR_NONE for the feature of a line without a tab and the context of a line without a second
+ * one. Comment lines are dropped.
+ *
+ * The file is little endian: the magic, then row groups of up to COLUMNAR_GROUP_ROWS rows, then
+ * a footer. A row group is
+ *   u64 rows; u32 new entries for each of path, feature and context;
+ *   for each of the three dictionaries, u32 lengths[new entries] and then the entries' bytes;
+ *   u64 pos0[rows]; u32 path[rows]; u32 feature[rows]; u32 context[rows]
+ * The new entries are appended to the dictionaries, so the groups are read in order. The footer is
+ *   u64 group offsets[groups]; u64 groups; u64 rows; the magic.
+ * A dictionary that grows past dictionary_bytes stops looking values up and adds every new
+ * value, so that memory stays bounded; the entries are then no longer distinct.
+ */
+
+inline constexpr char     COLUMNAR_MAGIC[] {"BECOL001"};
+inline constexpr uint64_t COLUMNAR_NO_POS0 {~uint64_t(0)};
+inline constexpr uint32_t COLUMNAR_NONE {~uint32_t(0)};
+inline constexpr size_t   COLUMNAR_GROUP_ROWS {65536};
+inline constexpr size_t   COLUMNAR_DICTIONARY_BYTES_DEFAULT {64*1024*1024};
+
+struct columnar_features {
+    std::vector<uint64_t> pos0 {};
+    std::vector<uint32_t> path {};
+    std::vector<uint32_t> feature {};
+    std::vector<uint32_t> context {};
+    std::vector<std::string> path_dict {};
+    std::vector<std::string> feature_dict {};
+    std::vector<std::string> context_dict {};
+    size_t rows() const { return pos0.size(); }
+    std::string line(size_t row) const;                    // the row as the line of the feature file
+};
+
+/* Writes txt's .col beside it; returns the number of rows. Throws std::runtime_error if it cannot. */
+uint64_t columnar_feature_file(const std::filesystem::path &txt, size_t dictionary_bytes);
+
+/* Converts every feature file in outdir, largest first, in up to threads threads; returns the files converted */
+std::vector<std::filesystem::path> columnar_feature_files(const std::filesystem::path &outdir, size_t dictionary_bytes,
+                                                          unsigned threads);
+
+/* Reads a .col file into memory */
+columnar_features read_columnar_features(const std::filesystem::path &col);
+
+#endif
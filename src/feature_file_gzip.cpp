@@ -0,0 +1,139 @@
+/**
+ * feature_file_gzip: feature files compressed in independent frames, with an index.
+ * See feature_file_gzip.h.
+ */
+
+#include "config.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <zlib.h>
+
+#include "feature_file_gzip.h"
+#include "feature_files.h"
+
+namespace {
+    const std::string GZ_SUFFIX  {".gz"};
+    const std::string IDX_SUFFIX {".idx"};
+
+    std::filesystem::path with_suffix(const std::filesystem::path &p, const std::string &suffix) {
+        return std::filesystem::path(p.string() + suffix);
+    }
+
+    /* Compresses one frame into a gzip member of its own */
+    class frame_deflater {
+        z_stream zs {};
+        std::string out {};
+    public:
+        frame_deflater() {
+            if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("feature_file_gzip: deflateInit2 failed");
+            }
+        }
+        ~frame_deflater() { deflateEnd(&zs); }
+        frame_deflater(const frame_deflater &) = delete;
+        frame_deflater &operator=(const frame_deflater &) = delete;
+
+        const std::string &deflate_frame(const char *data, size_t len) {
+            if (deflateReset(&zs) != Z_OK) throw std::runtime_error("feature_file_gzip: deflateReset failed");
+            out.resize(deflateBound(&zs, len));
+            zs.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+            zs.avail_in  = len;
+            zs.next_out  = reinterpret_cast<Bytef *>(out.data());
+            zs.avail_out = out.size();
+            if (::deflate(&zs, Z_FINISH) != Z_STREAM_END) throw std::runtime_error("feature_file_gzip: deflate failed");
+            out.resize(out.size() - zs.avail_out);
+            return out;
+        }
+    };
+}
+
+void gzip_feature_file(const std::filesystem::path &txt, size_t frame_size)
+{
+    if (frame_size == 0) frame_size = GZIP_FRAME_SIZE_DEFAULT;
+    const auto gz      = with_suffix(txt, GZ_SUFFIX);
+    const auto idx     = with_suffix(gz, IDX_SUFFIX);
+    const auto gz_tmp  = with_suffix(gz, ".tmp");
+    const auto idx_tmp = with_suffix(idx, ".tmp");
+
+    try {
+        std::ifstream in(txt, std::ios::binary);
+        std::ofstream out(gz_tmp, std::ios::binary);
+        std::ofstream index(idx_tmp);
+        if (!in || !out || !index) throw std::runtime_error("feature_file_gzip: cannot open " + txt.string());
+        index << "# bulk_extractor feature file index: offset in " << txt.filename().string()
+              << "\toffset in " << gz.filename().string() << "\n";
+
+        frame_deflater deflater;
+        std::string buf;
+        uint64_t offset = 0, gz_offset = 0;
+        auto emit = [&](size_t len) {
+            const std::string &member = deflater.deflate_frame(buf.data(), len);
+            out.write(member.data(), member.size());
+            index << offset << "\t" << gz_offset << "\n";
+            offset    += len;
+            gz_offset += member.size();
+            buf.erase(0, len);
+        };
+
+        /* frames end at the first newline past frame_size, or at the end of the file */
+        bool eof = false;
+        while (!eof) {
+            const size_t have = buf.size();
+            buf.resize(have + frame_size);
+            in.read(buf.data() + have, frame_size);
+            buf.resize(have + in.gcount());
+            eof = !in;
+            while (buf.size() >= frame_size) {
+                const size_t nl = buf.find('\n', frame_size - 1);
+                if (nl == std::string::npos) break;
+                emit(nl + 1);
+            }
+        }
+        if (in.bad()) throw std::runtime_error("feature_file_gzip: cannot read " + txt.string());
+        if (!buf.empty()) emit(buf.size());
+        index << offset << "\t" << gz_offset << "\n";
+
+        out.close();
+        index.close();
+        if (!out || !index) throw std::runtime_error("feature_file_gzip: cannot write " + gz.string());
+        std::filesystem::rename(gz_tmp, gz);
+        std::filesystem::rename(idx_tmp, idx);
+        std::filesystem::remove(txt);
+    }
+    catch (const std::exception &e) {
+        std::error_code ec;
+        std::filesystem::remove(gz_tmp, ec);
+        std::filesystem::remove(idx_tmp, ec);
+        throw std::runtime_error(e.what());
+    }
+}
+
+std::vector<std::filesystem::path> gzip_feature_files(const std::filesystem::path &outdir, size_t frame_size,
+                                                      unsigned threads)
+{
+    const auto files = output_text_files(outdir, false);
+    for_each_file(files, threads, [frame_size](const std::filesystem::path &txt) {
+        gzip_feature_file(txt, frame_size);
+    });
+    return files;
+}
+
+std::vector<gzip_frame> read_gzip_index(const std::filesystem::path &idx)
+{
+    std::ifstream in(idx);
+    if (!in) throw std::runtime_error("feature_file_gzip: cannot open " + idx.string());
+    std::vector<gzip_frame> ret;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        gzip_frame f;
+        if (!(ss >> f.offset >> f.gz_offset)) throw std::runtime_error("feature_file_gzip: bad index line in " + idx.string());
+        ret.push_back(f);
+    }
+    return ret;
+}
@@ -0,0 +1,40 @@
+#ifndef FEATURE_FILE_GZIP_H
+#define FEATURE_FILE_GZIP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+/**
+ * feature_file_gzip:
+ * Compresses the finished feature files and histograms so that they can still be read at random.
+ * Enabled with -S gzip_feature_files=YES; at the end of phase 2 each *.txt in the output directory
+ * is replaced by *.txt.gz and its index, *.txt.gz.idx.
+ *
+ * The .gz is a series of gzip members (frames), each of whole lines and about frame_size bytes
+ * before compression, so gunzip and zcat read it as the original file and a reader can start at
+ * any frame. The index has a line for each frame: the offset of its first line in the original
+ * file and the offset of the frame in the .gz, separated by a tab. Its last line has the sizes of
+ * the two files, so that every frame's length is the difference of two lines. Lines starting with
+ * '#' are comments.
+ */
+
+inline constexpr size_t GZIP_FRAME_SIZE_DEFAULT {1024*1024};
+
+struct gzip_frame {
+    uint64_t offset {0};                // in the original file
+    uint64_t gz_offset {0};             // in the .gz
+};
+
+/* Writes txt.gz and txt.gz.idx and removes txt. Throws std::runtime_error and leaves txt if it cannot. */
+void gzip_feature_file(const std::filesystem::path &txt, size_t frame_size);
+
+/* Compresses every *.txt in outdir, largest first, in up to threads threads; returns the files compressed */
+std::vector<std::filesystem::path> gzip_feature_files(const std::filesystem::path &outdir, size_t frame_size,
+                                                      unsigned threads);
+
+/* Reads an index; the last entry has the sizes of the two files */
+std::vector<gzip_frame> read_gzip_index(const std::filesystem::path &idx);
+
+#endif
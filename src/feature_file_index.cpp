@@ -0,0 +1,109 @@
+/**
+ * feature_file_index: where the features of each part of the image are in a feature file.
+ * See feature_file_index.h.
+ */
+
+#include "config.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "feature_file_index.h"
+#include "feature_files.h"
+
+namespace {
+    const std::string INDEX_SUFFIX {".index"};
+
+    /* The leading decimal offset of a line's forensic path; false if it has none */
+    bool leading_pos0(const std::string &line, uint64_t &pos0) {
+        size_t digits = 0;
+        pos0 = 0;
+        while (digits < line.size() && digits < 20 && line[digits] >= '0' && line[digits] <= '9') {
+            pos0 = pos0 * 10 + (line[digits++] - '0');
+        }
+        return digits > 0 && digits < 20;
+    }
+}
+
+std::vector<feature_index_block> index_feature_file(const std::filesystem::path &txt, size_t block_size)
+{
+    if (block_size == 0) block_size = INDEX_BLOCK_SIZE_DEFAULT;
+    const auto idx     = std::filesystem::path(txt.string() + INDEX_SUFFIX);
+    const auto idx_tmp = std::filesystem::path(idx.string() + ".tmp");
+
+    std::vector<feature_index_block> blocks;
+    try {
+        std::ifstream in(txt, std::ios::binary);
+        std::ofstream out(idx_tmp);
+        if (!in || !out) throw std::runtime_error("feature_file_index: cannot open " + txt.string());
+        out << "# bulk_extractor feature file index of " << txt.filename().string()
+            << ": offset\tlength\tmin_pos0\tmax_pos0\tlines\tother_lines\n";
+
+        feature_index_block block;
+        auto emit = [&]() {
+            out << block.offset << "\t" << block.length << "\t" << block.min_pos0 << "\t" << block.max_pos0
+                << "\t" << block.lines << "\t" << block.other_lines << "\n";
+            blocks.push_back(block);
+            block = feature_index_block{block.offset + block.length};
+        };
+
+        std::string line;
+        while (std::getline(in, line)) {
+            const bool newline = !in.eof();
+            uint64_t pos0 = 0;
+            if (line.empty() || line[0] == '#') {
+                /* comments stay in the block, but do not count */
+            } else if (leading_pos0(line, pos0)) {
+                if (block.lines == 0 || pos0 < block.min_pos0) block.min_pos0 = pos0;
+                if (block.lines == 0 || pos0 > block.max_pos0) block.max_pos0 = pos0;
+                block.lines++;
+            } else {
+                block.other_lines++;
+            }
+            block.length += line.size() + (newline ? 1 : 0);
+            if (block.length >= block_size) emit();
+        }
+        if (in.bad()) throw std::runtime_error("feature_file_index: cannot read " + txt.string());
+        if (block.length > 0) emit();
+
+        out.close();
+        if (!out) throw std::runtime_error("feature_file_index: cannot write " + idx.string());
+        std::filesystem::rename(idx_tmp, idx);
+    }
+    catch (const std::exception &e) {
+        std::error_code ec;
+        std::filesystem::remove(idx_tmp, ec);
+        throw std::runtime_error(e.what());
+    }
+    return blocks;
+}
+
+std::vector<std::filesystem::path> index_feature_files(const std::filesystem::path &outdir, size_t block_size,
+                                                       unsigned threads)
+{
+    const auto files = output_text_files(outdir, true);
+    for_each_file(files, threads, [block_size](const std::filesystem::path &txt) {
+        index_feature_file(txt, block_size);
+    });
+    return files;
+}
+
+std::vector<feature_index_block> read_feature_index(const std::filesystem::path &idx)
+{
+    std::ifstream in(idx);
+    if (!in) throw std::runtime_error("feature_file_index: cannot open " + idx.string());
+    std::vector<feature_index_block> ret;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        feature_index_block b;
+        if (!(ss >> b.offset >> b.length >> b.min_pos0 >> b.max_pos0 >> b.lines >> b.other_lines)) {
+            throw std::runtime_error("feature_file_index: bad index line in " + idx.string());
+        }
+        ret.push_back(b);
+    }
+    return ret;
+}
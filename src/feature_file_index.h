@@ -0,0 +1,56 @@
+#ifndef FEATURE_FILE_INDEX_H
+#define FEATURE_FILE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+/**
+ * feature_file_index:
+ * An index of where in each feature file the features of each part of the image are, so that a
+ * viewer or a script can read the features near an offset without reading the whole file.
+ * Enabled with -S index_feature_files=YES; at the end of phase 2 each feature file *.txt in the
+ * output directory gets a *.txt.index beside it.
+ *
+ * The file is cut into blocks of whole lines of about block_size bytes. The index has a line for
+ * each block, with tabs between the fields:
+ *   offset  length  min_pos0  max_pos0  lines  other_lines
+ * offset and length are the block's bytes in the feature file; min_pos0 and max_pos0 are the
+ * smallest and largest leading offset of the forensic paths of its lines (for "1024-GZIP-0", 1024),
+ * and lines is the number of those lines; other_lines is the number of lines whose path has no
+ * leading offset, such as the files of a -R scan, which a search for a path has to read. The
+ * features of the image between start and end are in the blocks whose [min_pos0, max_pos0]
+ * overlaps it. Because the scanner threads write the pages roughly in order, those are a few
+ * blocks. Lines starting with '#' are comments.
+ *
+ * The index is made before -S gzip_feature_files, and its offsets are those of the uncompressed
+ * file, which are also the offsets of the frames in the *.txt.gz.idx.
+ */
+
+inline constexpr size_t INDEX_BLOCK_SIZE_DEFAULT {64*1024};
+
+struct feature_index_block {
+    uint64_t offset {0};
+    uint64_t length {0};
+    uint64_t min_pos0 {0};
+    uint64_t max_pos0 {0};
+    uint64_t lines {0};
+    uint64_t other_lines {0};
+    bool overlaps(uint64_t start, uint64_t end) const { return lines > 0 && min_pos0 < end && start <= max_pos0; }
+    bool operator==(const feature_index_block &that) const {
+        return offset == that.offset && length == that.length && min_pos0 == that.min_pos0 &&
+            max_pos0 == that.max_pos0 && lines == that.lines && other_lines == that.other_lines;
+    }
+};
+
+/* Writes txt.index; returns the blocks. Throws std::runtime_error if it cannot. */
+std::vector<feature_index_block> index_feature_file(const std::filesystem::path &txt, size_t block_size);
+
+/* Indexes every feature file in outdir, largest first, in up to threads threads; returns the files indexed */
+std::vector<std::filesystem::path> index_feature_files(const std::filesystem::path &outdir, size_t block_size,
+                                                       unsigned threads);
+
+std::vector<feature_index_block> read_feature_index(const std::filesystem::path &idx);
+
+#endif
@@ -0,0 +1,215 @@
+/**
+ * feature_file_sort: the feature files in the order of their forensic paths.
+ * See feature_file_sort.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+#include "feature_file_sort.h"
+#include "feature_files.h"
+
+namespace {
+    const size_t MAX_MERGE {128};              // runs open at once
+    const size_t MIN_CHUNK {64 * 1024};
+
+    /* The part of path at pos, up to the next '-'; pos is then after it, or npos after the last part */
+    std::string_view next_part(std::string_view path, size_t &pos) {
+        const size_t dash = path.find('-', pos);
+        const std::string_view part = path.substr(pos, dash == std::string_view::npos ? std::string_view::npos : dash - pos);
+        pos = dash == std::string_view::npos ? std::string_view::npos : dash + 1;
+        return part;
+    }
+
+    bool is_number(std::string_view s) {
+        return !s.empty() && std::all_of(s.begin(), s.end(), [](char ch) { return ch >= '0' && ch <= '9'; });
+    }
+
+    /* <0, 0 or >0; offsets as numbers, and before names */
+    int compare_parts(std::string_view a, std::string_view b) {
+        const bool na = is_number(a), nb = is_number(b);
+        if (na != nb) return na ? -1 : 1;
+        if (na) {
+            while (a.size() > 1 && a[0] == '0') a.remove_prefix(1);
+            while (b.size() > 1 && b[0] == '0') b.remove_prefix(1);
+            if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+        }
+        return a.compare(b);
+    }
+
+    std::string_view path_of(std::string_view line) {
+        return line.substr(0, line.find('\t'));
+    }
+
+    void write_lines(const std::filesystem::path &path, const std::vector<std::string> &header,
+                     const std::vector<std::string> &lines) {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) throw std::runtime_error("feature_file_sort: cannot create " + path.string());
+        for (const auto &line : header) out << line << '\n';
+        for (const auto &line : lines) out << line << '\n';
+        out.close();
+        if (!out) throw std::runtime_error("feature_file_sort: cannot write " + path.string());
+    }
+
+    /* Merges the sorted inputs into out, after header */
+    void merge(const std::vector<std::filesystem::path> &inputs, const std::filesystem::path &out_path,
+               const std::vector<std::string> &header) {
+        struct source {
+            std::ifstream in;
+            std::string line {};
+        };
+        std::vector<std::unique_ptr<source>> sources;
+        auto after = [&sources](size_t a, size_t b) { return feature_line_before(sources[b]->line, sources[a]->line); };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(after)> next(after);
+        for (const auto &path : inputs) {
+            sources.push_back(std::make_unique<source>());
+            source &s = *sources.back();
+            s.in.open(path, std::ios::binary);
+            if (!s.in) throw std::runtime_error("feature_file_sort: cannot open " + path.string());
+            if (std::getline(s.in, s.line)) next.push(sources.size() - 1);
+        }
+        std::ofstream out(out_path, std::ios::binary);
+        if (!out) throw std::runtime_error("feature_file_sort: cannot create " + out_path.string());
+        for (const auto &line : header) out << line << '\n';
+        while (!next.empty()) {
+            const size_t i = next.top();
+            next.pop();
+            out << sources[i]->line << '\n';
+            if (std::getline(sources[i]->in, sources[i]->line)) next.push(i);
+        }
+        for (const auto &s : sources) {
+            if (s->in.bad()) throw std::runtime_error("feature_file_sort: cannot read a run of " + out_path.string());
+        }
+        out.close();
+        if (!out) throw std::runtime_error("feature_file_sort: cannot write " + out_path.string());
+    }
+}
+
+int compare_forensic_paths(std::string_view a, std::string_view b)
+{
+    size_t i = 0, j = 0;
+    while (i != std::string_view::npos && j != std::string_view::npos) {
+        if (int c = compare_parts(next_part(a, i), next_part(b, j))) return c;
+    }
+    if (i == j) return 0;                   // both ended
+    return i == std::string_view::npos ? -1 : 1;
+}
+
+bool feature_line_before(std::string_view a, std::string_view b)
+{
+    if (int c = compare_forensic_paths(path_of(a), path_of(b))) return c < 0;
+    return a < b;
+}
+
+void sort_feature_file(const std::filesystem::path &txt, size_t memory, unsigned threads)
+{
+    if (memory == 0) memory = SORT_MEMORY_DEFAULT;
+    threads = std::max(threads, 1U);
+    /* the chunks being sorted, and the one being read */
+    const size_t chunk_bytes = std::max(memory / (threads + 1), MIN_CHUNK);
+    const auto sorted = std::filesystem::path(txt.string() + ".sorted.tmp");
+
+    std::vector<std::filesystem::path> runs;
+    std::deque<std::thread> sorters;
+    std::mutex Merror;
+    std::exception_ptr error;
+    auto join_all = [&]() {
+        while (!sorters.empty()) {
+            sorters.front().join();
+            sorters.pop_front();
+        }
+    };
+    auto remove_runs = [&]() {
+        std::error_code ec;
+        for (const auto &run : runs) std::filesystem::remove(run, ec);
+        runs.clear();
+    };
+    size_t run_count = 0;
+    auto next_run = [&txt, &runs, &run_count]() {
+        runs.push_back(txt.string() + ".sort" + std::to_string(run_count++) + ".tmp");
+        return runs.back();
+    };
+
+    try {
+        std::ifstream in(txt, std::ios::binary);
+        if (!in) throw std::runtime_error("feature_file_sort: cannot open " + txt.string());
+        std::vector<std::string> comments;
+        std::vector<std::string> chunk;
+        size_t bytes = 0;
+        auto sort_chunk = [&]() {
+            if (sorters.size() >= threads) {
+                sorters.front().join();
+                sorters.pop_front();
+            }
+            sorters.emplace_back([run = next_run(), lines = std::move(chunk), &Merror, &error]() mutable {
+                try {
+                    std::sort(lines.begin(), lines.end(), feature_line_before);
+                    write_lines(run, {}, lines);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(Merror);
+                    if (!error) error = std::current_exception();
+                }
+            });
+            chunk = {};
+            bytes = 0;
+        };
+
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty()) continue;
+            if (line[0] == '#') {
+                comments.push_back(std::move(line));
+                continue;
+            }
+            bytes += line.size() + sizeof(std::string);
+            chunk.push_back(std::move(line));
+            if (bytes >= chunk_bytes) sort_chunk();
+        }
+        if (in.bad()) throw std::runtime_error("feature_file_sort: cannot read " + txt.string());
+
+        if (runs.empty()) {
+            std::sort(chunk.begin(), chunk.end(), feature_line_before);
+            write_lines(sorted, comments, chunk);
+        } else {
+            if (!chunk.empty()) sort_chunk();
+            join_all();
+            if (error) std::rethrow_exception(error);
+            while (runs.size() > MAX_MERGE) {
+                const std::vector<std::filesystem::path> group(runs.begin(), runs.begin() + MAX_MERGE);
+                const std::filesystem::path merged = next_run();
+                merge(group, merged, {});
+                std::error_code ec;
+                for (const auto &run : group) std::filesystem::remove(run, ec);
+                runs.erase(runs.begin(), runs.begin() + MAX_MERGE);
+            }
+            merge(runs, sorted, comments);
+            remove_runs();
+        }
+        std::filesystem::rename(sorted, txt);
+    }
+    catch (const std::exception &e) {
+        join_all();
+        remove_runs();
+        std::error_code ec;
+        std::filesystem::remove(sorted, ec);
+        throw std::runtime_error(e.what());
+    }
+}
+
+std::vector<std::filesystem::path> sort_feature_files(const std::filesystem::path &outdir, size_t memory,
+                                                      unsigned threads)
+{
+    /* a file at a time, each with all of the threads and memory */
+    const auto files = output_text_files(outdir, true);
+    for (const auto &txt : files) sort_feature_file(txt, memory, threads);
+    return files;
+}
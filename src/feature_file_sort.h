@@ -0,0 +1,44 @@
+#ifndef FEATURE_FILE_SORT_H
+#define FEATURE_FILE_SORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * feature_file_sort:
+ * Sorts the finished feature files by forensic path, so that the output of a run does not depend on
+ * the order in which its threads happened to finish their pages, and what reads the files (bulk_diff,
+ * identify_filenames, a pipeline) can merge them instead of sorting them again.
+ * Enabled with -S sort_feature_files=YES; at the end of phase 2, before the files are indexed
+ * (which the sorted order makes tighter) and compressed, each feature file is replaced by its lines
+ * in order.
+ *
+ * The paths are compared part by part, the offsets as numbers, so 1000 comes before 1000-GZIP-0,
+ * which comes before 2000; a path with no leading offset (the files of a -R scan) comes after those
+ * that have one. Lines with the same path are in the order of the whole line, so the order is total.
+ * The comments are kept, before the features.
+ *
+ * It is an external merge sort in memory bytes. The file is read in chunks, which up to threads
+ * threads sort and write to runs beside it while the next chunks are read; the runs are then merged
+ * (MAX_MERGE at a time) into the sorted file, which replaces the original when it is complete.
+ */
+
+inline constexpr size_t SORT_MEMORY_DEFAULT {256 * 1024 * 1024};
+
+/* <0, 0 or >0 as the forensic path a comes before, is the same as or comes after b */
+int compare_forensic_paths(std::string_view a, std::string_view b);
+/* True if the feature line a comes before b */
+bool feature_line_before(std::string_view a, std::string_view b);
+
+/* Sorts txt in place. Throws std::runtime_error and leaves txt as it was if it cannot. */
+void sort_feature_file(const std::filesystem::path &txt, size_t memory, unsigned threads);
+
+/* Sorts every feature file in outdir, largest first; returns the files sorted */
+std::vector<std::filesystem::path> sort_feature_files(const std::filesystem::path &outdir, size_t memory,
+                                                      unsigned threads);
+
+#endif
@@ -0,0 +1,60 @@
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "feature_files.h"
+
+bool is_histogram_file(const std::filesystem::path &txt)
+{
+    if (txt.filename().string().find("_histogram") != std::string::npos) return true;
+    std::ifstream in(txt, std::ios::binary);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        return line.compare(0, 2, "n=") == 0;
+    }
+    return false;
+}
+
+std::vector<std::filesystem::path> output_text_files(const std::filesystem::path &outdir, bool feature_files_only)
+{
+    std::vector<std::pair<uintmax_t, std::filesystem::path>> files;
+    for (const auto &it : std::filesystem::directory_iterator(outdir)) {
+        if (it.is_regular_file() && it.path().extension() == ".txt" &&
+            !(feature_files_only && is_histogram_file(it.path()))) {
+            files.emplace_back(it.file_size(), it.path());
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    std::vector<std::filesystem::path> ret;
+    for (const auto &it : files) ret.push_back(it.second);
+    return ret;
+}
+
+void for_each_file(const std::vector<std::filesystem::path> &files, unsigned threads,
+                   const std::function<void(const std::filesystem::path &)> &fn)
+{
+    std::atomic<size_t> next {0};
+    std::vector<std::exception_ptr> errors(std::max(1U, std::min<unsigned>(threads, files.size())));
+    auto worker = [&](size_t t) {
+        try {
+            for (size_t i = next++; i < files.size(); i = next++) {
+                fn(files[i]);
+            }
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < errors.size(); t++) workers.emplace_back(worker, t);
+    worker(0);
+    for (auto &it : workers) it.join();
+    for (const auto &it : errors) {
+        if (it) std::rethrow_exception(it);
+    }
+}
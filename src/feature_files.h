@@ -0,0 +1,25 @@
+#ifndef FEATURE_FILES_H
+#define FEATURE_FILES_H
+
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+/**
+ * feature_files:
+ * The files in the output directory that the end-of-run passes (feature_file_index,
+ * feature_file_columnar and feature_file_gzip) work on, and a way to run a pass over them in
+ * parallel.
+ */
+
+/* True if txt is a histogram: its name has _histogram or its first line that is not a comment starts with n= */
+bool is_histogram_file(const std::filesystem::path &txt);
+
+/* The *.txt files in outdir, largest first; only the feature files if feature_files_only */
+std::vector<std::filesystem::path> output_text_files(const std::filesystem::path &outdir, bool feature_files_only);
+
+/* Calls fn for each file, in up to threads threads, each taking the next file; rethrows the first exception */
+void for_each_file(const std::vector<std::filesystem::path> &files, unsigned threads,
+                   const std::function<void(const std::filesystem::path &)> &fn);
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * feature_quotas.cpp:
+ * The per-recorder quotas of features, bytes and features a page; see feature_quotas.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#include "be13_api/utils.h"
+#include "dfxml_cpp/src/dfxml_writer.h"
+#include "feature_quotas.h"
+#include "feature_shards.h"
+
+namespace {
+    /* NAME:N,... -> NAME and N, with N scaled by K, M or G */
+    std::vector<std::pair<std::string, uint64_t>> quotas_of(const std::string &spec, const char *option) {
+        std::vector<std::pair<std::string, uint64_t>> ret;
+        std::stringstream ss(spec);
+        for (std::string item; std::getline(ss, item, ',');) {
+            if (item.empty()) continue;
+            const size_t colon = item.rfind(':');
+            const std::string n = colon == std::string::npos ? "" : item.substr(colon + 1);
+            if (colon == 0 || n.empty() || !isdigit(static_cast<unsigned char>(n[0])) ||
+                n.find_first_not_of("0123456789kKmMgG") != std::string::npos) {
+                throw std::invalid_argument(std::string("-S ") + option + ": must be NAME:N, not " + item);
+            }
+            const int64_t v = scaled_stoi64(n);
+            if (v <= 0) throw std::invalid_argument(std::string("-S ") + option + ": must be NAME:N, not " + item);
+            ret.emplace_back(item.substr(0, colon), uint64_t(v));
+        }
+        return ret;
+    }
+
+    /* The forensic path in the first column of a feature line */
+    std::string_view path_of(std::string_view line) {
+        return line.substr(0, line.find('\t'));
+    }
+}
+
+void feature_quotas::set(const std::string &features, const std::string &bytes, const std::string &per_page)
+{
+    std::map<std::string, quota> quotas;
+    for (const auto &[name, n] : quotas_of(features, "feature_quotas"))      quotas[name].max_features = n;
+    for (const auto &[name, n] : quotas_of(bytes, "feature_quota_bytes"))    quotas[name].max_bytes = n;
+    for (const auto &[name, n] : quotas_of(per_page, "feature_page_quotas")) quotas[name].max_per_page = n;
+    states.clear();
+    for (const auto &[name, q] : quotas) {
+        states[name] = std::make_unique<state>();
+        states[name]->q = q;
+    }
+}
+
+std::set<std::string> feature_quotas::streamed_recorders()
+{
+    std::set<std::string> ret;
+    for (const auto &[name, s] : states) {
+        if (s->q.max_bytes == 0 && s->q.max_per_page == 0) continue;
+        ret.insert(name);
+        if (feature_shards::defined(name)) {
+            for (unsigned i = 0; i < feature_shards::shards(); i++) ret.insert(feature_shards::shard_name(name, i));
+        }
+    }
+    return ret;
+}
+
+feature_quotas::state *feature_quotas::find(const std::string &recorder)
+{
+    auto it = states.find(feature_shards::recorder_of(recorder));
+    return it == states.end() ? nullptr : it->second.get();
+}
+
+uint64_t feature_quotas::state::features() const
+{
+    uint64_t n = 0;
+    for (const feature_recorder *fr : recorders) n += fr->features_written;
+    return n;
+}
+
+void feature_quotas::mark(state &s, const char *by, const std::string &where)
+{
+    bool expected = false;
+    if (!s.marking.compare_exchange_strong(expected, true)) return;   // another thread has marked it
+    s.reached_by = by;
+    s.cutoff = where;
+    s.reached = true;
+}
+
+bool feature_quotas::reached(state &s, const pos0_t &where)
+{
+    if (s.reached) return true;
+    if (s.q.max_features && s.features() >= s.q.max_features) {
+        mark(s, "features", where.str());
+        return true;
+    }
+    return false;
+}
+
+void feature_quotas::gate::define(const scanner_params &sp)
+{
+    recorders.clear();
+    gated = !states.empty();
+    for (const auto &def : sp.info->feature_defs) {
+        const std::string name = feature_shards::recorder_of(def.name);
+        if (std::find(recorders.begin(), recorders.end(), name) != recorders.end()) continue;
+        recorders.push_back(name);
+        const state *s = find(name);
+        if (s == nullptr || (s->q.max_features == 0 && s->q.max_bytes == 0)) gated = false;
+    }
+    if (recorders.empty()) gated = false;
+}
+
+void feature_quotas::gate::resolve(const scanner_params &sp)
+{
+    states_.clear();
+    for (const auto &name : recorders) {
+        state *s = find(name);
+        if (s == nullptr) continue;
+        s->recorders.clear();
+        s->recorders.push_back(&sp.named_feature_recorder(name));
+        if (feature_shards::defined(name)) {
+            for (unsigned i = 0; i < feature_shards::shards(); i++) {
+                s->recorders.push_back(&sp.named_feature_recorder(feature_shards::shard_name(name, i)));
+            }
+        }
+        if (gated) states_.push_back(s);
+    }
+}
+
+bool feature_quotas::gate::stopped(const scanner_params &sp)
+{
+    if (!gated || states_.empty()) return false;
+    for (state *s : states_) {
+        if (!reached(*s, sp.sbuf->pos0)) return false;
+    }
+    for (state *s : states_) s->skipped++;
+    return true;
+}
+
+uint64_t feature_quotas::page_of(const std::string &line, size_t pagesize)
+{
+    const uint64_t offset = strtoull(line.c_str(), nullptr, 10);
+    return pagesize ? offset / pagesize : offset;
+}
+
+bool feature_quotas::stream_sink::write(const std::string &recorder, const std::string &lines)
+{
+    state *s = find(recorder);
+    if (s == nullptr) return true;
+    std::unordered_map<uint64_t, uint64_t> &pages = page_lines[feature_shards::recorder_of(recorder)];
+    std::string_view rest(lines);
+    uint64_t bytes = 0;
+    std::string over;                   // the line at which the byte quota was reached
+    while (!rest.empty()) {
+        const size_t nl = rest.find('\n');
+        const std::string_view line = rest.substr(0, nl);
+        rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+        if (line.empty()) continue;
+        bytes += line.size() + 1;
+        if (s->q.max_bytes && over.empty() && s->bytes + bytes >= s->q.max_bytes) over = path_of(line);
+        if (s->q.max_per_page) {
+            const uint64_t n = ++pages[page_of(std::string(path_of(line)), pagesize_)];
+            if (n == s->q.max_per_page + 1) s->pages_over++;
+            if (n > s->q.max_per_page) s->lines_over_page++;
+        }
+    }
+    s->bytes += bytes;
+    if (!over.empty()) mark(*s, "bytes", over);
+    return true;
+}
+
+std::map<std::string, std::string> feature_quotas::xml_attributes()
+{
+    std::map<std::string, std::string> ret;
+    for (const auto &[name, s] : states) {
+        std::stringstream ss;
+        if (s->q.max_features) ss << "max_features='" << s->q.max_features << "' ";
+        if (s->q.max_bytes)    ss << "max_bytes='" << s->q.max_bytes << "' ";
+        if (s->q.max_per_page) ss << "max_per_page='" << s->q.max_per_page << "' ";
+        ss << "features='" << s->features() << "'";
+        if (s->q.max_bytes || s->q.max_per_page) ss << " bytes='" << s->bytes << "'";
+        if (s->q.max_per_page) ss << " pages_over='" << s->pages_over << "' lines_over_page='" << s->lines_over_page << "'";
+        if (s->reached) {
+            ss << " reached='" << s->reached_by << "' cutoff='" << dfxml_writer::xmlescape(s->cutoff)
+               << "' skipped_calls='" << s->skipped << "'";
+        }
+        ret[name] = ss.str();
+    }
+    return ret;
+}
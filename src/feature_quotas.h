@@ -0,0 +1,107 @@
+#ifndef FEATURE_QUOTAS_H
+#define FEATURE_QUOTAS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "be13_api/scanner_params.h"
+#include "feature_sink.h"
+
+/**
+ * feature_quotas:
+ * Limits on what a recorder is let write, for the images on which a few recorders (wordlist, url, ccn)
+ * write billions of lines that are thrown away downstream anyway:
+ *
+ *   -S feature_quotas=NAME:N,...           - features
+ *   -S feature_quota_bytes=NAME:BYTES,...  - bytes of its feature file (K, M and G may be used)
+ *   -S feature_page_quotas=NAME:N,...      - features on one page
+ *
+ * Once a recorder has reached its quota of features or bytes, the scanners that write only to the
+ * recorders that have reached theirs are no longer called: the wrappers in bulk_extractor_scanners.cpp
+ * ask stopped() before each PHASE_SCAN call, which compares features_written (of the recorder and its
+ * shards) with the quota. A scanner's recorders are those it defines; a scanner that also feeds a
+ * recorder without a quota (scan_email's email with url) goes on being called, and what it writes to
+ * a recorder past its quota is still written. Bytes are counted from the feature file, which a
+ * feature_stream follows, so the quota is reached up to a poll after the bytes are written.
+ *
+ * be13_api writes a scanner's features itself, so a scanner cannot be stopped in the middle of a page;
+ * the page quotas are measured from the feature file instead, and the report gives, for each recorder,
+ * the pages that went over and the lines over their quota, which say where the image is pathological.
+ *
+ * The report's <feature_quotas> element has a <quota> for each recorder: its quotas, what it wrote, and
+ * where it was cut off (the quota reached, the forensic path of the sbuf or line at which it was, and
+ * the scanner calls that were not made).
+ */
+
+class feature_quotas {
+    struct state;
+public:
+    struct quota {
+        uint64_t max_features {0};      // 0 for no quota
+        uint64_t max_bytes {0};
+        uint64_t max_per_page {0};
+    };
+
+    /* Each is NAME:N,... or ""; before the scanners are loaded. Throws std::invalid_argument */
+    static void set(const std::string &features, const std::string &bytes, const std::string &per_page);
+    /* The page size that the page quotas count by; once it is known (-G auto), before the stream starts */
+    static void set_pagesize(size_t pagesize) { pagesize_ = pagesize; }
+    static size_t pagesize() { return pagesize_; }
+    static bool any() { return !states.empty(); }
+    /* The feature files the stream follows: the recorders with a byte or page quota, and their shards */
+    static std::set<std::string> streamed_recorders();
+
+    /* The quota of a scanner's recorders, for its wrapper */
+    class gate {
+    public:
+        void define(const scanner_params &sp);          // after the scanner's PHASE_INIT
+        void resolve(const scanner_params &sp);         // at its PHASE_INIT2; finds the recorders with quotas
+        bool stopped(const scanner_params &sp);         // before its PHASE_SCAN calls
+    private:
+        std::vector<std::string> recorders {};
+        std::vector<state *> states_ {};
+        bool gated {false};                             // every recorder it defines has a quota
+    };
+
+    /* Counts the lines and bytes of the streamed feature files */
+    class stream_sink : public feature_sink {
+    public:
+        stream_sink(): feature_sink("feature_quotas") {}
+        bool write(const std::string &recorder, const std::string &lines) override;
+        bool carve(const std::string &, const std::filesystem::path &, const std::filesystem::path &) override { return true; }
+    private:
+        std::map<std::string, std::unordered_map<uint64_t, uint64_t>> page_lines {};   // recorder -> page -> lines
+    };
+
+    static uint64_t page_of(const std::string &line, size_t pagesize); // from the forensic path in its first column
+    /* recorder -> the attributes of its <quota> element in the report */
+    static std::map<std::string, std::string> xml_attributes();
+
+private:
+    struct state {
+        quota q {};
+        std::vector<feature_recorder *> recorders {};   // it and its shards
+        std::atomic<uint64_t> bytes {0};
+        std::atomic<uint64_t> pages_over {0};
+        std::atomic<uint64_t> lines_over_page {0};
+        std::atomic<uint64_t> skipped {0};              // scanner calls
+        std::atomic<bool>     reached {false};
+        std::string reached_by {};                      // "features" or "bytes", set with cutoff before reached
+        std::string cutoff {};                          // forensic path
+        std::atomic<bool>     marking {false};
+        uint64_t features() const;
+    };
+    static inline std::map<std::string, std::unique_ptr<state>> states {};
+    static inline size_t pagesize_ {0};
+    static state *find(const std::string &recorder);
+    static bool reached(state &s, const pos0_t &where);
+    static void mark(state &s, const char *by, const std::string &where);
+};
+
+#endif
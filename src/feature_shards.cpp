@@ -0,0 +1,207 @@
+/**
+ * feature_shards.cpp:
+ * The per-thread shards of the feature files, and merging them at the end of the run; see feature_shards.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "feature_files.h"
+#include "feature_shards.h"
+#include "heavy_hitters.h"
+#include "recorder_handle.h"
+
+void feature_shards::set_recorders(const std::string &names, unsigned shards)
+{
+    recorders.clear();
+    defined_.clear();
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (!name.empty()) recorders.insert(name);
+    }
+    shards_ = std::min(std::max(shards, 1U), MAX_SHARDS);
+}
+
+bool feature_shards::sharded(const std::string &recorder)
+{
+    return recorders.count(recorder) && !recorder_handle::histogram_only(recorder) && !heavy_hitters::approximate(recorder);
+}
+
+void feature_shards::add_defined(const std::string &recorder)
+{
+    defined_.insert(recorder);
+}
+
+bool feature_shards::defined(const std::string &recorder)
+{
+    return defined_.count(recorder) > 0;
+}
+
+std::string feature_shards::shard_name(const std::string &recorder, unsigned shard)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), ".t%02u", shard);
+    return recorder + buf;
+}
+
+unsigned feature_shards::thread_shard()
+{
+    thread_local const unsigned mine = next_shard++;
+    return mine % shards_;
+}
+
+bool feature_shards::merged_name(const std::string &fname, std::string &merged)
+{
+    const std::string TXT {".txt"};
+    if (fname.size() <= TXT.size() || fname.compare(fname.size() - TXT.size(), TXT.size(), TXT) != 0) return false;
+    const std::string stem = fname.substr(0, fname.size() - TXT.size());
+    for (size_t p = stem.find(".t"); p != std::string::npos; p = stem.find(".t", p + 1)) {
+        size_t end = p + 2;
+        while (end < stem.size() && isdigit(static_cast<unsigned char>(stem[end]))) end++;
+        if (end == p + 2 || (end < stem.size() && stem[end] != '_')) continue;
+        if (recorders.count(stem.substr(0, p)) == 0) continue;
+        merged = stem.substr(0, p) + stem.substr(end) + TXT;
+        return true;
+    }
+    return false;
+}
+
+std::string feature_shards::recorder_of(const std::string &name)
+{
+    std::string merged;
+    return merged_name(name + ".txt", merged) ? merged.substr(0, merged.size() - 4) : name;
+}
+
+void feature_shards::append_features(const std::filesystem::path &shard, const std::filesystem::path &out)
+{
+    std::error_code ec;
+    const bool fresh = std::filesystem::file_size(out, ec) == 0 || ec;   // it has no header yet
+    std::ifstream in(shard, std::ios::binary);
+    if (!in.is_open()) throw std::runtime_error("cannot open " + shard.string());
+    std::ofstream os(out, std::ios::binary | std::ios::app);
+    if (!os.is_open()) throw std::runtime_error("cannot open " + out.string());
+
+    const std::string RECORDER {"# Feature-Recorder: "};
+    const std::string recorder = out.stem().string();
+    std::string line;
+    uint64_t lines = 0;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] == '#') {
+            if (!fresh) continue;       // the header is the first file's
+            if (line.compare(0, RECORDER.size(), RECORDER) == 0) line = RECORDER + recorder;
+        } else {
+            lines++;
+        }
+        os << line << '\n';
+    }
+    os.close();
+    if (!os) throw std::runtime_error("cannot write " + out.string());
+    merged_lines += lines;
+}
+
+/* A histogram line is n=COUNT, a tab and the feature, then a tab and (utf16=COUNT) if any were UTF-16 */
+void feature_shards::add_histograms(const std::vector<std::filesystem::path> &parts, const std::filesystem::path &out)
+{
+    struct counts {
+        uint64_t n {0};
+        uint64_t utf16 {0};
+    };
+    const std::string UTF16 {"(utf16="};
+    std::map<std::string, counts> totals;
+    std::vector<std::string> header;
+    for (const auto &part : parts) {
+        std::ifstream in(part, std::ios::binary);
+        if (!in.is_open()) continue;
+        const bool first = header.empty();
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty()) continue;
+            if (line[0] == '#') {
+                if (first) header.push_back(line);
+                continue;
+            }
+            const size_t tab = line.find('\t');
+            if (line.compare(0, 2, "n=") != 0 || tab == std::string::npos) continue;
+            const size_t tab2 = line.find('\t', tab + 1);
+            counts &c = totals[line.substr(tab + 1, tab2 == std::string::npos ? std::string::npos : tab2 - tab - 1)];
+            c.n += strtoull(line.c_str() + 2, nullptr, 10);
+            if (tab2 != std::string::npos && line.compare(tab2 + 1, UTF16.size(), UTF16) == 0) {
+                c.utf16 += strtoull(line.c_str() + tab2 + 1 + UTF16.size(), nullptr, 10);
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string, counts>> sorted(totals.begin(), totals.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second.n > b.second.n; });
+    const std::filesystem::path tmp = out.string() + ".tmp";
+    {
+        std::ofstream os(tmp, std::ios::binary);
+        if (!os.is_open()) throw std::runtime_error("cannot create " + tmp.string());
+        for (const auto &h : header) os << h << '\n';
+        for (const auto &[key, c] : sorted) {
+            os << "n=" << c.n << '\t' << key;
+            if (c.utf16) os << "\t(utf16=" << c.utf16 << ")";
+            os << '\n';
+        }
+        os.close();
+        if (!os) throw std::runtime_error("cannot write " + tmp.string());
+    }
+    std::filesystem::rename(tmp, out);
+}
+
+std::vector<std::filesystem::path> feature_shards::merge(const std::filesystem::path &outdir)
+{
+    /* merged file -> its shards, in shard order */
+    std::map<std::string, std::map<unsigned, std::filesystem::path>> groups;
+    for (const auto &it : std::filesystem::directory_iterator(outdir)) {
+        if (!it.is_regular_file()) continue;
+        const std::string fname = it.path().filename().string();
+        std::string merged;
+        if (!merged_name(fname, merged)) continue;
+        /* the shard number: the digits after the recorder's name and ".t" */
+        unsigned shard = 0;
+        for (size_t q = fname.find(".t"); q != std::string::npos; q = fname.find(".t", q + 1)) {
+            if (recorders.count(fname.substr(0, q))) {
+                shard = strtoul(fname.c_str() + q + 2, nullptr, 10);
+                break;
+            }
+        }
+        groups[merged][shard] = it.path();
+    }
+
+    std::vector<std::filesystem::path> ret;
+    for (const auto &[merged, shards] : groups) {
+        const std::filesystem::path out = outdir / merged;
+        bool histogram = merged.find("_histogram") != std::string::npos;
+        for (const auto &it : shards) histogram = histogram || is_histogram_file(it.second);
+        if (histogram) {
+            std::vector<std::filesystem::path> parts;
+            if (std::filesystem::exists(out)) parts.push_back(out);
+            for (const auto &it : shards) parts.push_back(it.second);
+            add_histograms(parts, out);
+        } else {
+            for (const auto &it : shards) append_features(it.second, out);
+        }
+        for (const auto &it : shards) {
+            std::filesystem::remove(it.second);
+            merged_files++;
+        }
+        ret.push_back(out);
+    }
+    return ret;
+}
+
+std::string feature_shards::xml_attributes()
+{
+    std::stringstream ss;
+    ss << "shards='" << shards_ << "' merged_files='" << merged_files << "' merged_lines='" << merged_lines << "'";
+    return ss.str();
+}
@@ -0,0 +1,69 @@
+#ifndef FEATURE_SHARDS_H
+#define FEATURE_SHARDS_H
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * feature_shards:
+ * Per-thread feature files for the recorders that most of the features go to (-S feature_shards=email,url,...),
+ * so that the worker threads do not all wait on one file's lock. A sharded recorder is defined with a
+ * recorder for each of shards() shards, email.t00 to email.tNN, besides itself, and a recorder_handle gives
+ * each thread the shard it was dealt when it first wrote to one; each shard is written by its own
+ * threads (one, with -j threads), with its own feature file and histograms (email.t03.txt,
+ * email.t03_histogram.txt). The recorder itself still takes what the scanners that look it up by name
+ * write.
+ *
+ * At the end of the run (-S feature_shards_merge=YES, the default), merge() appends the feature files of
+ * the shards to the recorder's, and adds up their histograms into the recorder's, so that the output
+ * directory has the files it would have had; -S sort_feature_files then sorts them as any others. With
+ * -S feature_shards_merge=NO the shards are left for the consumers, which read them as one file
+ * (bulk_extractor_reader.py does).
+ *
+ * Only the recorders defined with recorder_handle::define() are sharded, and not those of
+ * -S histogram_only or -S approximate_histograms, which have no feature file to shard or are counted from it.
+ * Carving recorders are not sharded. The feature streams and the census see the shards by their own names.
+ */
+
+class feature_shards {
+public:
+    static inline const unsigned MAX_SHARDS {256};
+
+    /* names is a list of recorder names separated by commas, or "" for none; before the scanners are loaded */
+    static void set_recorders(const std::string &names, unsigned shards);
+    static bool sharded(const std::string &recorder);
+    static unsigned shards() { return shards_; }
+    /* recorder_handle::define() made the recorders of the shards of recorder, which give them histograms */
+    static void add_defined(const std::string &recorder);
+    static bool defined(const std::string &recorder);
+    static std::string shard_name(const std::string &recorder, unsigned shard); // email.t03
+    /* The shard of the calling thread, dealt in turn the first time it asks */
+    static unsigned thread_shard();
+
+    /* If fname is the file of a shard (email.t03.txt, email.t03_histogram.txt), sets merged to the file it
+     * is merged into (email.txt, email_histogram.txt) and returns true */
+    static bool merged_name(const std::string &fname, std::string &merged);
+    static std::string recorder_of(const std::string &name);   // email for email.t03, else name
+
+    /* Appends the feature files of the shards in outdir to their recorders' files, adds up their histograms,
+     * and removes them; returns the files merged into */
+    static std::vector<std::filesystem::path> merge(const std::filesystem::path &outdir);
+    static void append_features(const std::filesystem::path &shard, const std::filesystem::path &out);
+    static void add_histograms(const std::vector<std::filesystem::path> &parts, const std::filesystem::path &out);
+
+    static inline std::atomic<uint64_t> merged_files {0};  // shard files merged
+    static inline std::atomic<uint64_t> merged_lines {0};
+    static std::string xml_attributes();                   // for the <feature_shards> report element
+
+private:
+    static inline std::set<std::string> recorders {};
+    static inline std::set<std::string> defined_ {};
+    static inline unsigned shards_ {1};
+    static inline std::atomic<unsigned> next_shard {0};
+};
+
+#endif
@@ -0,0 +1,213 @@
+/**
+ * feature_sink.cpp:
+ * The sinks of feature_stream; see feature_sink.h.
+ */
+
+#include "config.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if defined(HAVE_LIBCURL) && !defined(HAVE_CURL_CURL_H)
+#undef HAVE_LIBCURL
+#endif
+
+#ifdef HAVE_LIBCURL
+#include <curl/curl.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#include "feature_sink.h"
+#include "file_copy.h"
+
+namespace {
+const int SEND_TIMEOUT_MS {1000};      // waiting for a full pipe or socket to drain
+const long HTTP_TIMEOUT_MS {10000};
+
+/* dir:PATH */
+class dir_sink : public feature_sink {
+public:
+    dir_sink(const std::string &spec_, const std::filesystem::path &dir_): feature_sink(spec_), dir(dir_) {
+        std::filesystem::create_directories(dir);
+    }
+    bool write(const std::string &recorder, const std::string &lines) override {
+        auto &out = files[recorder];
+        if (!out.is_open()) out.open(dir / (recorder + ".txt"), std::ios::binary | std::ios::app);
+        out.write(lines.data(), lines.size());
+        out.flush();
+        if (out.good()) return true;
+        files.erase(recorder);          // reopened, and the batch appended again, on the next try
+        return false;
+    }
+    bool carve(const std::string &, const std::filesystem::path &file, const std::filesystem::path &relpath) override {
+        std::error_code ec;
+        std::filesystem::create_directories((dir / relpath).parent_path(), ec);
+        try {
+            clone_file(file, dir / relpath); // a reflink if dir is on the same file system
+        } catch (const std::runtime_error &) {
+            return false;
+        }
+        return true;
+    }
+private:
+    const std::filesystem::path dir;
+    std::map<std::string, std::ofstream> files {};
+};
+
+/* unix:PATH and fifo:PATH */
+class stream_sink : public feature_sink {
+public:
+    stream_sink(const std::string &spec_, bool socket_, const std::string &path_, bool tagged_):
+        feature_sink(spec_), socket(socket_), path(path_), tagged(tagged_) {
+        if (socket && path.size() >= sizeof(sockaddr_un::sun_path)) {
+            throw std::invalid_argument(spec + ": socket path is too long");
+        }
+    }
+    ~stream_sink() override { disconnect(); }
+    bool write(const std::string &recorder, const std::string &lines) override {
+        if (fd < 0 && !connect()) return false;
+        if (!tagged) return send(lines);
+        std::string buf;
+        for (size_t start = 0, nl; (nl = lines.find('\n', start)) != std::string::npos; start = nl + 1) {
+            buf += recorder + "\t" + lines.substr(start, nl + 1 - start);
+        }
+        return send(buf);
+    }
+    bool carve(const std::string &, const std::filesystem::path &, const std::filesystem::path &) override {
+        return true;
+    }
+    void disconnect() override {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+private:
+    const bool socket;
+    const std::string path;
+    const bool tagged;
+    int fd {-1};
+
+    bool connect() {
+        if (socket) {
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) return false;
+            sockaddr_un addr {};
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+                disconnect();
+                return false;
+            }
+            return true;
+        }
+        /* ENXIO: there is no reader yet. Opening without blocking keeps a missing reader from stopping the stream */
+        fd = ::open(path.c_str(), O_WRONLY | O_NONBLOCK);
+        return fd >= 0;
+    }
+    bool send(const std::string &buf) {
+        for (size_t done = 0; done < buf.size(); ) {
+            const ssize_t n = socket ? ::send(fd, buf.data() + done, buf.size() - done, MSG_NOSIGNAL)
+                                     : ::write(fd, buf.data() + done, buf.size() - done);
+            if (n >= 0) {
+                done += n;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            /* Full; wait for the reader, but not forever. A batch cut short is sent again whole, so a line may be sent twice */
+            pollfd p {fd, POLLOUT, 0};
+            if (::poll(&p, 1, SEND_TIMEOUT_MS) <= 0 || (p.revents & (POLLERR | POLLHUP))) return false;
+        }
+        return true;
+    }
+};
+
+#ifdef HAVE_LIBCURL
+/* http://URL and https://URL */
+class http_sink : public feature_sink {
+public:
+    explicit http_sink(const std::string &spec_): feature_sink(spec_) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+    }
+    bool write(const std::string &recorder, const std::string &lines) override {
+        CURL *h = curl_easy_init();
+        if (h == nullptr) return false;
+        const std::string recorder_header = "X-Feature-Recorder: " + recorder;
+        curl_slist *headers = curl_slist_append(nullptr, "Content-Type: text/plain; charset=utf-8");
+        headers = curl_slist_append(headers, recorder_header.c_str());
+        curl_easy_setopt(h, CURLOPT_URL, spec.c_str());
+        curl_easy_setopt(h, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(h, CURLOPT_POSTFIELDS, lines.data());
+        curl_easy_setopt(h, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(lines.size()));
+        const bool ok = perform(h);
+        curl_slist_free_all(headers);
+        return ok;
+    }
+    bool carve(const std::string &recorder, const std::filesystem::path &file, const std::filesystem::path &relpath) override {
+        FILE *f = fopen(file.string().c_str(), "rb");
+        if (f == nullptr) return false;
+        CURL *h = curl_easy_init();
+        if (h == nullptr) {
+            fclose(f);
+            return false;
+        }
+        const std::string url = spec + (spec.back() == '/' ? "" : "/") + relpath.generic_string();
+        const std::string recorder_header = "X-Feature-Recorder: " + recorder;
+        curl_slist *headers = curl_slist_append(nullptr, recorder_header.c_str());
+        std::error_code ec;
+        curl_easy_setopt(h, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(h, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(h, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(h, CURLOPT_READDATA, f);
+        curl_easy_setopt(h, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(std::filesystem::file_size(file, ec)));
+        const bool ok = !ec && perform(h);
+        curl_slist_free_all(headers);
+        fclose(f);
+        return ok;
+    }
+private:
+    /* Performs and cleans up the request */
+    static bool perform(CURL *h) {
+        curl_easy_setopt(h, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(h, CURLOPT_TIMEOUT_MS, HTTP_TIMEOUT_MS);
+        const CURLcode res = curl_easy_perform(h);
+        curl_easy_cleanup(h);
+        return res == CURLE_OK;
+    }
+};
+#endif
+}
+
+std::unique_ptr<feature_sink> feature_sink::make(const std::string &spec, bool tagged)
+{
+    auto after = [&](size_t n) {
+        if (spec.size() == n) throw std::invalid_argument(spec + ": no path");
+        return spec.substr(n);
+    };
+    if (spec.substr(0, 4) == "dir:")  return std::make_unique<dir_sink>(spec, after(4));
+    if (spec.substr(0, 5) == "unix:") return std::make_unique<stream_sink>(spec, true, after(5), tagged);
+    if (spec.substr(0, 5) == "fifo:") return std::make_unique<stream_sink>(spec, false, after(5), tagged);
+    if (spec.substr(0, 7) == "http://" || spec.substr(0, 8) == "https://") {
+#ifdef HAVE_LIBCURL
+        return std::make_unique<http_sink>(spec);
+#else
+        throw std::invalid_argument(spec + ": this bulk_extractor was built without libcurl");
+#endif
+    }
+    throw std::invalid_argument(spec + ": a sink must be dir:PATH, unix:PATH, fifo:PATH or an http(s) URL");
+}
@@ -0,0 +1,55 @@
+#ifndef FEATURE_SINK_H
+#define FEATURE_SINK_H
+
+#include <filesystem>
+#include <memory>
+#include <string>
+
+/**
+ * feature_sink:
+ * Where feature_stream sends the lines of the feature files and the carved files while the run is
+ * still writing them, so that they get to a central store without a copy pass at the end. The files are
+ * still written to the output directory, which feature_stream reads them from. A sink is
+ * named by a string (-S feature_sink=SINK, and -S alert_sink=SINK for the alert file alone):
+ *
+ *   dir:PATH                - appends each recorder's lines to PATH/NAME.txt and copies the carved files
+ *                             under PATH, as they are in the output directory (e.g. a network mount)
+ *   unix:PATH               - writes the lines to a Unix-domain stream socket
+ *   fifo:PATH               - writes the lines to a named pipe, whenever a reader has it open
+ *   http://URL, https://URL - POSTs each batch of a recorder's lines to URL as text/plain, with the
+ *                             recorder in X-Feature-Recorder, and PUTs each carved file to URL/FILE
+ *                             (with libcurl), as an object store or WebDAV server takes them
+ *
+ * On a stream sink (unix: and fifo:), the lines of several recorders are told apart by the recorder's
+ * name and a tab before each line; a stream of one recorder's file (-S alert_sink) has the lines alone. Stream sinks do not take carves.
+ *
+ * The compressed output is not a sink: it is made from the finished feature files at the end of the run
+ * (-S gzip_feature_files), as the histograms need the files there.
+ *
+ * The sinks are called by one thread, feature_stream's, so they need no locks. write() and carve()
+ * return false if the sink cannot take the batch now (no reader, a refused connection, an HTTP error);
+ * feature_stream then tries it again.
+ */
+
+class feature_sink {
+public:
+    /* Throws std::invalid_argument for a sink that is not one of the above; tagged as described above */
+    static std::unique_ptr<feature_sink> make(const std::string &spec, bool tagged);
+
+    virtual ~feature_sink() {}
+    const std::string &name() const { return spec; }
+
+    /* Whole lines of recorder's feature file, each ended by '\n' */
+    virtual bool write(const std::string &recorder, const std::string &lines) = 0;
+    /* A file carved by recorder: file is its path, relpath the path under the output directory */
+    virtual bool carve(const std::string &recorder, const std::filesystem::path &file,
+                       const std::filesystem::path &relpath) = 0;
+    /* Drops a connection after a failure, so that the next try makes a new one */
+    virtual void disconnect() {}
+
+protected:
+    explicit feature_sink(const std::string &spec_): spec(spec_) {}
+    const std::string spec;
+};
+
+#endif
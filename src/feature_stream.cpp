@@ -0,0 +1,163 @@
+/**
+ * feature_stream.cpp:
+ * Following the feature files and sending their lines to a feature_sink; see feature_stream.h.
+ */
+
+#include "config.h"
+
+#include <cerrno>
+#include <csignal>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "feature_files.h"
+#include "feature_stream.h"
+
+feature_stream::feature_stream(std::unique_ptr<feature_sink> sink_, const std::filesystem::path &outdir_,
+                               const std::set<std::string> &recorders_, std::function<void()> flush_):
+    sink(std::move(sink_)), outdir(outdir_), recorders(recorders_), flush(std::move(flush_))
+{
+    {
+        std::lock_guard<std::mutex> lock(Mstreams);
+        streams.insert(this);
+        active++;
+    }
+    thread = std::thread(&feature_stream::run, this);
+}
+
+feature_stream::~feature_stream()
+{
+    stop();
+}
+
+void feature_stream::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(Mstreams);
+        if (streams.erase(this)) active--;
+    }
+    {
+        std::lock_guard<std::mutex> lock(M);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (thread.joinable()) thread.join();
+    sink->disconnect();
+    for (auto &it : files) {
+        if (it.second.fd >= 0) ::close(it.second.fd);
+        it.second.fd = -1;
+    }
+}
+
+void feature_stream::carved(const std::string &recorder, const std::string &fname)
+{
+    if (fname.empty()) return;
+    std::lock_guard<std::mutex> lock(Mstreams);
+    for (auto *it : streams) {
+        if (!it->follows(recorder)) continue;
+        std::lock_guard<std::mutex> lock2(it->M);
+        it->carves.push_back(carve_t{recorder, fname});
+    }
+}
+
+void feature_stream::split_lines(std::string &partial, const char *buf, size_t len, std::vector<std::string> &lines)
+{
+    partial.append(buf, len);
+    size_t start = 0;
+    for (size_t nl; (nl = partial.find('\n', start)) != std::string::npos; start = nl + 1) {
+        if (nl > start && partial[start] != '#') lines.push_back(partial.substr(start, nl + 1 - start));
+    }
+    partial.erase(0, start);
+}
+
+/* The files of the recorders named, or the feature files there are now; the histograms are not followed */
+void feature_stream::find_files()
+{
+    if (!recorders.empty()) {
+        for (const auto &it : recorders) files[it];
+        return;
+    }
+    std::error_code ec;
+    if (!std::filesystem::is_directory(outdir, ec)) return;
+    for (const auto &txt : output_text_files(outdir, true)) files[txt.stem().string()];
+}
+
+bool feature_stream::poll_file(followed &f, std::vector<std::string> &lines)
+{
+    char buf[65536];
+    size_t got = 0;
+    for (ssize_t n; got < MAX_BATCH && (n = ::pread(f.fd, buf, sizeof(buf), f.offset)) != 0; ) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        split_lines(f.partial, buf, n, lines);
+        f.offset += n;
+        got += n;
+    }
+    return !lines.empty();
+}
+
+bool feature_stream::retry(const std::function<bool()> &send)
+{
+    bool ok = send();
+    for (unsigned tries = 1; !ok && tries <= MAX_RETRIES; tries++) {
+        sink->disconnect();
+        std::unique_lock<std::mutex> lock(M);
+        /* When stopping, what is left gets one more try rather than the full wait */
+        if (!stopping) cv.wait_for(lock, RETRY_INTERVAL, [this]{ return stopping; });
+        else if (tries > 1) break;
+        lock.unlock();
+        ok = send();
+    }
+    return ok;
+}
+
+void feature_stream::run()
+{
+    /* A reader that goes away must not kill the run; the write fails with EPIPE instead */
+    sigset_t pipe;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+
+    for (bool last = false; !last; ) {
+        {
+            std::unique_lock<std::mutex> lock(M);
+            cv.wait_for(lock, POLL_INTERVAL, [this]{ return stopping; });
+            last = stopping;
+        }
+        if (flush) flush();
+        find_files();
+        for (auto &it : files) {
+            followed &f = it.second;
+            if (f.fd < 0) f.fd = ::open((outdir / (it.first + ".txt")).string().c_str(), O_RDONLY);
+            if (f.fd < 0) continue;     // not created yet
+            std::vector<std::string> lines;
+            while (poll_file(f, lines)) {
+                std::string batch;
+                for (const auto &line : lines) batch += line;
+                const bool ok = retry([&]{ return sink->write(it.first, batch); });
+                (ok ? lines_sent_ : lines_dropped_) += lines.size();
+                lines.clear();
+            }
+        }
+        for (;;) {
+            carve_t c;
+            {
+                std::lock_guard<std::mutex> lock(M);
+                if (carves.empty()) break;
+                c = carves.front();
+                carves.pop_front();
+            }
+            std::filesystem::path file(c.fname);
+            std::filesystem::path relpath(c.fname);
+            if (file.is_absolute()) relpath = file.lexically_relative(outdir);
+            else file = outdir / relpath;
+            const bool ok = retry([&]{ return sink->carve(c.recorder, file, relpath); });
+            (ok ? carves_sent_ : carves_dropped_)++;
+        }
+    }
+}
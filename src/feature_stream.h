@@ -0,0 +1,110 @@
+#ifndef FEATURE_STREAM_H
+#define FEATURE_STREAM_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "feature_sink.h"
+
+/**
+ * feature_stream:
+ * Sends the lines of the feature files, and the carved files, to a feature_sink as the recorders write
+ * them, so that they are in the central store when the run ends rather than copied there after it. It
+ * follows the files in the output directory, so they are still written there in full and then read back;
+ * the stream moves the copy into the run, it does not remove the local write (see TODO.md):
+ *
+ *   -S feature_sink=SINK - every feature file and every carve
+ *   -S alert_sink=SINK   - the alert file alone, so that a hit on the -r alert list is seen within seconds
+ *
+ * The scanners are never held up: the stream follows the files from its own thread, every POLL_INTERVAL,
+ * so a slow or absent sink only delays the stream and the files are its buffer. A line is seen only once
+ * its recorder has flushed it to the file, so a stream that must not wait for the recorder's buffer to
+ * fill (-S alert_sink) is given a flush, which it calls before each poll. The framework does the
+ * batching: the lines of a file written since the last poll go to the sink as one batch (of at most
+ * MAX_BATCH bytes), in order and whole, and comment lines are not sent. carve_index tells the streams of
+ * each file carved, which go to the sink after the lines before them.
+ *
+ * A batch or carve the sink cannot take is retried every RETRY_INTERVAL, reconnecting, and after
+ * MAX_RETRIES it is dropped and counted so that the stream catches up. The counts are in the report.
+ */
+
+class feature_stream {
+public:
+    static inline const std::chrono::milliseconds POLL_INTERVAL {250};
+    static inline const std::chrono::milliseconds RETRY_INTERVAL {1000};
+    static inline const unsigned MAX_RETRIES {5};
+    static inline const size_t MAX_BATCH {1024 * 1024}; // bytes of lines in a batch
+
+    /* Starts following the feature files of recorders in outdir, or all of them if recorders is empty;
+     * the files need not exist yet. flush, if given, is called from the stream's thread before each poll.
+     */
+    feature_stream(std::unique_ptr<feature_sink> sink, const std::filesystem::path &outdir,
+                   const std::set<std::string> &recorders = {}, std::function<void()> flush = {});
+    ~feature_stream();                  // stop()
+    feature_stream(const feature_stream &)=delete;
+    feature_stream &operator=(const feature_stream &)=delete;
+
+    void     stop();                    // sends what has been written, then stops following
+    uint64_t lines_sent() const { return lines_sent_; }
+    uint64_t lines_dropped() const { return lines_dropped_; }
+    uint64_t carves_sent() const { return carves_sent_; }
+    uint64_t carves_dropped() const { return carves_dropped_; }
+    const std::string &sink_name() const { return sink->name(); }
+
+    /* A file carved by recorder, fname as its feature file has it; queued for the streams that follow recorder */
+    static void carved(const std::string &recorder, const std::string &fname);
+    static bool enabled() { return active > 0; }
+
+    /* Appends buf to partial and moves its complete lines, but for comments, to lines */
+    static void split_lines(std::string &partial, const char *buf, size_t len, std::vector<std::string> &lines);
+
+private:
+    struct followed {
+        int      fd {-1};
+        uint64_t offset {0};
+        std::string partial {};         // a line that is not complete yet
+    };
+    struct carve_t {
+        std::string recorder {};
+        std::string fname {};
+    };
+    const std::unique_ptr<feature_sink> sink;
+    const std::filesystem::path outdir;
+    const std::set<std::string> recorders;
+    const std::function<void()> flush;
+    std::map<std::string, followed> files {}; // by recorder
+
+    std::thread thread {};
+    std::mutex M {};
+    std::condition_variable cv {};
+    bool     stopping {false};
+    std::deque<carve_t> carves {};
+    std::atomic<uint64_t> lines_sent_ {0};
+    std::atomic<uint64_t> lines_dropped_ {0};
+    std::atomic<uint64_t> carves_sent_ {0};
+    std::atomic<uint64_t> carves_dropped_ {0};
+
+    static inline std::mutex Mstreams {};
+    static inline std::set<feature_stream *> streams {};
+    static inline std::atomic<unsigned> active {0};
+
+    void     run();
+    bool     follows(const std::string &recorder) const { return recorders.empty() || recorders.count(recorder); }
+    void     find_files();
+    bool     poll_file(followed &f, std::vector<std::string> &lines); // false if there is nothing new
+    bool     retry(const std::function<bool()> &send); // send, trying again as above; false if dropped
+};
+
+#endif
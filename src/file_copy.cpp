@@ -0,0 +1,135 @@
+/**
+ * file_copy.cpp:
+ * Copies by reflink, copy_file_range() or pread() and pwrite(); see file_copy.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "file_copy.h"
+
+namespace {
+const size_t READ_WRITE_CHUNK {1024 * 1024};
+
+std::string error_at(const char *what, uint64_t offset)
+{
+    return std::string(what) + " at " + std::to_string(offset) + ": " + strerror(errno);
+}
+
+void read_write(int in, uint64_t in_offset, int out, uint64_t out_offset, uint64_t len)
+{
+    std::vector<char> buf(std::min<uint64_t>(len, READ_WRITE_CHUNK));
+    while (len > 0) {
+        const ssize_t n = ::pread(in, buf.data(), std::min<uint64_t>(len, buf.size()), in_offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw std::runtime_error(error_at("copy: cannot read", in_offset));
+        if (n == 0) throw std::runtime_error("copy: source ends at " + std::to_string(in_offset));
+        for (ssize_t done = 0; done < n; ) {
+            const ssize_t w = ::pwrite(out, buf.data() + done, n - done, out_offset + done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) throw std::runtime_error(error_at("copy: cannot write", out_offset + done));
+            done += w;
+        }
+        in_offset += n;
+        out_offset += n;
+        len -= n;
+    }
+}
+
+#ifdef __linux__
+/* True if the range was cloned; FICLONERANGE needs block-aligned offsets, and a length that is too, or ends the source */
+bool clone_range(int in, uint64_t in_offset, int out, uint64_t out_offset, uint64_t len)
+{
+    struct stat st;
+    if (fstat(in, &st) != 0 || st.st_blksize <= 0) return false;
+    const uint64_t block = st.st_blksize;
+    if (in_offset % block || out_offset % block || (len % block && in_offset + len != uint64_t(st.st_size))) {
+        return false;
+    }
+    file_clone_range r {};
+    r.src_fd = in;
+    r.src_offset = in_offset;
+    r.src_length = len;
+    r.dest_offset = out_offset;
+    return ioctl(out, FICLONERANGE, &r) == 0;
+}
+
+/* The bytes copied by copy_file_range() before it failed or there were none left */
+uint64_t range_copy(int in, uint64_t in_offset, int out, uint64_t out_offset, uint64_t len)
+{
+    uint64_t done = 0;
+    while (done < len) {
+        loff_t from = in_offset + done;
+        loff_t to = out_offset + done;
+        const ssize_t n = ::copy_file_range(in, &from, out, &to, len - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;              // EXDEV, ENOSYS, EOPNOTSUPP...; the rest is read and written
+        done += n;
+    }
+    return done;
+}
+#endif
+}
+
+copy_method clone_fd_range(int in, uint64_t in_offset, int out, uint64_t out_offset, uint64_t len)
+{
+    if (len == 0) return copy_method::clone;
+#ifdef __linux__
+    if (clone_range(in, in_offset, out, out_offset, len)) return copy_method::clone;
+    const uint64_t done = range_copy(in, in_offset, out, out_offset, len);
+    if (done == len) return copy_method::copy_range;
+    read_write(in, in_offset + done, out, out_offset + done, len - done);
+#else
+    read_write(in, in_offset, out, out_offset, len);
+#endif
+    return copy_method::read_write;
+}
+
+copy_method clone_file(const std::filesystem::path &from, const std::filesystem::path &to)
+{
+    const int in = ::open(from.string().c_str(), O_RDONLY | O_BINARY);
+    if (in < 0) throw std::runtime_error(from.string() + ": " + strerror(errno));
+    const int out = ::open(to.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (out < 0) {
+        const std::string err = to.string() + ": " + strerror(errno);
+        ::close(in);
+        throw std::runtime_error(err);
+    }
+    copy_method m {copy_method::clone};
+    try {
+        struct stat st;
+        if (fstat(in, &st) != 0) throw std::runtime_error(from.string() + ": " + strerror(errno));
+#ifdef __linux__
+        if (ioctl(out, FICLONE, in) != 0)
+#endif
+        {
+            m = clone_fd_range(in, 0, out, 0, st.st_size);
+        }
+    } catch (...) {
+        ::close(in);
+        ::close(out);
+        throw;
+    }
+    ::close(in);
+    if (::close(out) != 0) throw std::runtime_error(to.string() + ": " + strerror(errno));
+    return m;
+}
@@ -0,0 +1,28 @@
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * file_copy:
+ * Copies between files without bringing the bytes into user space when the kernel can do it.
+ * A copy first tries to share the extents (FICLONE and FICLONERANGE, a reflink on XFS, Btrfs and
+ * others), which costs neither I/O nor space; then copy_file_range(), which copies within the kernel
+ * (and on NFS 4.2 and SMB, on the server); and then pread() and pwrite(). Ranges that do not start on a
+ * block boundary, and files on different file systems, fall through to the later methods.
+ *
+ * The feature_sink dir: backend copies the carved files with clone_file(). The reflinks and
+ * copy_file_range() are Linux's; elsewhere only pread() and pwrite() are used. Both functions throw
+ * std::runtime_error if the copy cannot be made.
+ */
+
+enum class copy_method { clone, copy_range, read_write };
+
+/* Copies len bytes of in at in_offset to out at out_offset; returns the slowest method used */
+copy_method clone_fd_range(int in, uint64_t in_offset, int out, uint64_t out_offset, uint64_t len);
+
+/* Replaces to with a copy of from; returns the slowest method used */
+copy_method clone_file(const std::filesystem::path &from, const std::filesystem::path &to);
+
+#endif
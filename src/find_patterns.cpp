@@ -0,0 +1,172 @@
+/**
+ * find_patterns: one pass over a page for every find pattern.
+ * See find_patterns.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+#include "find_patterns.h"
+
+namespace {
+    const char *metacharacters = ".^$|()[]{}*+?\\";
+
+    inline uint8_t fold(uint8_t ch) {
+        return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+    }
+}
+
+bool find_patterns::is_literal(const std::string &pat)
+{
+    return !pat.empty() && pat.find_first_of(metacharacters) == std::string::npos;
+}
+
+void find_patterns::add(const std::string &pat)
+{
+    patterns.push_back(pat);
+}
+
+void find_patterns::compile()
+{
+    literal_ids.clear();
+    literal_lens.clear();
+    regex_ids.clear();
+    group_index.clear();
+    std::fill(std::begin(byte_class), std::end(byte_class), 0);
+    nclasses = 1;
+    max_literal = 0;
+
+    /* sort the patterns; a class for each folded byte that appears in a literal */
+    std::string alternation;
+    size_t      prev_marks = 0;
+    for (size_t id = 0; id < patterns.size(); id++) {
+        const std::string &pat = patterns[id];
+        if (is_literal(pat)) {
+            for (uint8_t ch : pat) {
+                uint8_t lc = fold(ch);
+                if (byte_class[lc] == 0) {
+                    byte_class[lc] = nclasses++;
+                    if (lc >= 'a' && lc <= 'z') byte_class[lc - ('a' - 'A')] = byte_class[lc];
+                }
+            }
+            literal_ids.push_back(id);
+            literal_lens.push_back(pat.size());
+            max_literal = std::max(max_literal, pat.size());
+        } else {
+            /* the outer group of each pattern comes after the groups of the patterns before it */
+            std::regex one(pat, std::regex::ECMAScript | std::regex::icase); // throws std::regex_error
+            group_index.push_back(regex_ids.empty() ? 1 : group_index.back() + 1 + prev_marks);
+            prev_marks = one.mark_count();
+            if (!alternation.empty()) alternation += "|";
+            alternation += "(" + pat + ")";
+            regex_ids.push_back(id);
+        }
+    }
+    if (!regex_ids.empty()) {
+        combined = std::regex(alternation, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+    }
+
+    /* the trie; state 0 is the root */
+    delta.assign(nclasses, 0);
+    output.assign(1, -1);
+    nstates = 1;
+    for (size_t lit = 0; lit < literal_ids.size(); lit++) {
+        uint32_t state = 0;
+        for (uint8_t ch : patterns[literal_ids[lit]]) {
+            uint16_t c = byte_class[ch];
+            if (delta[state * nclasses + c] == 0) {
+                delta[state * nclasses + c] = nstates++;
+                delta.resize(nstates * nclasses, 0);
+                output.push_back(-1);
+            }
+            state = delta[state * nclasses + c];
+        }
+        if (output[state] == -1) output[state] = lit; // a literal given twice is reported once
+    }
+
+    /* breadth first, turn the trie into the complete automaton and find the output links */
+    std::vector<uint32_t> failure(nstates, 0);
+    output_link.assign(nstates, -1);
+    std::deque<uint32_t> queue;
+    for (size_t c = 0; c < nclasses; c++) {
+        if (delta[c]) queue.push_back(delta[c]);
+    }
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        uint32_t f = failure[state];
+        output_link[state] = output[f] >= 0 ? static_cast<int32_t>(f) : output_link[f];
+        for (size_t c = 0; c < nclasses; c++) {
+            uint32_t next = delta[state * nclasses + c];
+            if (next) {
+                failure[next] = delta[f * nclasses + c];
+                queue.push_back(next);
+            } else {
+                delta[state * nclasses + c] = delta[f * nclasses + c];
+            }
+        }
+    }
+}
+
+void find_patterns::search_literals(const uint8_t *buf, size_t len, size_t limit, std::vector<match> &found) const
+{
+    if (literal_ids.empty() || limit == 0) return;
+    /* a match that ends at i starts before limit only if i < limit + max_literal - 1 */
+    size_t end = std::min(len, limit + max_literal - 1);
+    std::vector<size_t> next_start(literal_ids.size(), 0); // matches of one literal do not overlap
+    uint32_t state = 0;
+    for (size_t i = 0; i < end; i++) {
+        state = delta[state * nclasses + byte_class[buf[i]]];
+        for (int32_t s = output[state] >= 0 ? static_cast<int32_t>(state) : output_link[state]; s >= 0;
+             s = output_link[s]) {
+            size_t lit   = output[s];
+            size_t start = i + 1 - literal_lens[lit];
+            if (start < limit && start >= next_start[lit]) {
+                found.push_back(match{start, literal_lens[lit], literal_ids[lit]});
+                next_start[lit] = i + 1;
+            }
+        }
+    }
+}
+
+void find_patterns::search_regex(const uint8_t *buf, size_t len, size_t limit, std::vector<match> &found) const
+{
+    if (regex_ids.empty()) return;
+    const char *base = reinterpret_cast<const char *>(buf);
+    /* each run between NULs, as the matches of the old search never spanned one */
+    for (size_t seg = 0; seg < limit && seg < len;) {
+        const char *nul = static_cast<const char *>(memchr(base + seg, '\000', len - seg));
+        size_t seg_end = nul ? nul - base : len;
+        std::cmatch m;
+        auto flags = std::regex_constants::match_default;
+        for (const char *pos = base + seg; pos < base + seg_end && static_cast<size_t>(pos - base) < limit;) {
+            if (!std::regex_search(pos, base + seg_end, m, combined, flags)) break;
+            size_t start = m.position(0) + (pos - base);
+            if (start >= limit) break;
+            for (size_t r = 0; r < regex_ids.size(); r++) {
+                if (m[group_index[r]].matched) {
+                    if (m.length(0) > 0) found.push_back(match{start, static_cast<size_t>(m.length(0)), regex_ids[r]});
+                    break;
+                }
+            }
+            pos = base + start + std::max<size_t>(m.length(0), 1);
+            flags = std::regex_constants::match_prev_avail;
+        }
+        seg = seg_end + 1;
+    }
+}
+
+std::vector<find_patterns::match> find_patterns::search(const uint8_t *buf, size_t len, size_t limit) const
+{
+    std::vector<match> found;
+    limit = std::min(limit, len);
+    search_literals(buf, len, limit, found);
+    search_regex(buf, len, limit, found);
+    std::sort(found.begin(), found.end());
+    return found;
+}
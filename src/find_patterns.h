@@ -0,0 +1,70 @@
+#ifndef FIND_PATTERNS_H
+#define FIND_PATTERNS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+
+/**
+ * find_patterns:
+ * All of the -f and -F patterns of scan_find, compiled so that a page is searched once however
+ * many patterns there are.
+ *
+ * Patterns without regular expression metacharacters (most keyword lists) go into an Aho-Corasick
+ * automaton over the classes of the bytes that appear in them. The other patterns are joined into
+ * one std::regex alternation, which is searched between NULs, as the regex library stops at them.
+ * Both are case-insensitive (ASCII).
+ *
+ * search() reports every match that starts before the limit, in order of position. Matches of one
+ * literal do not overlap, and a literal given twice is reported once. The regular expressions are
+ * searched as one: where several match at a position, the first in the order given is reported.
+ */
+
+class find_patterns {
+public:
+    struct match {
+        size_t pos {0};
+        size_t len {0};
+        size_t id  {0};                 // the index of the pattern, in the order it was added
+        bool operator<(const match &that) const {
+            return pos < that.pos || (pos == that.pos && id < that.id);
+        }
+    };
+
+    static bool is_literal(const std::string &pat);
+
+    void   add(const std::string &pat);
+    void   compile();                   // after the last add()
+    size_t size() const { return patterns.size(); }
+    bool   empty() const { return patterns.empty(); }
+    size_t literal_count() const { return literal_ids.size(); }
+    size_t state_count() const { return nstates; }
+
+    /* matches that start in [0, limit) of buf[0, len); matches may extend past limit */
+    std::vector<match> search(const uint8_t *buf, size_t len, size_t limit) const;
+
+private:
+    std::vector<std::string> patterns {};
+
+    /* Aho-Corasick; delta is the complete transition table, nclasses entries per state */
+    std::vector<size_t>   literal_ids {};     // literal number -> pattern id
+    std::vector<size_t>   literal_lens {};
+    uint16_t              byte_class[256] {};
+    size_t                nclasses {1};        // class 0 is every byte not in a literal
+    size_t                nstates {0};
+    size_t                max_literal {0};
+    std::vector<uint32_t> delta {};
+    std::vector<int32_t>  output {};           // state -> literal ending here, or -1
+    std::vector<int32_t>  output_link {};      // state -> nearest suffix state with an output, or -1
+    void search_literals(const uint8_t *buf, size_t len, size_t limit, std::vector<match> &found) const;
+
+    /* the regular expressions, as one alternation */
+    std::vector<size_t>   regex_ids {};
+    std::vector<size_t>   group_index {};      // the sub_match index of each regex's outer group
+    std::regex            combined {};
+    void search_regex(const uint8_t *buf, size_t len, size_t limit, std::vector<match> &found) const;
+};
+
+#endif
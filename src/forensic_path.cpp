@@ -0,0 +1,20 @@
+#include "config.h"
+
+#include "forensic_path.h"
+
+forensic_path::ancestors forensic_path::ancestors_of(const std::string &path)
+{
+    ancestors ret;
+    const std::string_view p(path);
+    size_t end = p.size();
+    while (end > 0 && ret.count < MAX_ANCESTORS) {
+        size_t start = p.rfind('-', end-1);
+        start = (start==std::string_view::npos) ? 0 : start+1;
+        if (start < end && p.find_first_not_of("0123456789", start) < end) {
+            ret.names[ret.count++] = p.substr(start, end-start);
+        }
+        if (start==0) break;
+        end = start-1;
+    }
+    return ret;
+}
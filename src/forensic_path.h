@@ -0,0 +1,38 @@
+#ifndef FORENSIC_PATH_H
+#define FORENSIC_PATH_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * forensic_path:
+ * The recursion names in the forensic path of an sbuf, read from pos0.path without copying it.
+ *
+ * The path alternates offsets and the names of the recursions that made each buffer, as
+ * "1000-XOR(255)-0-ZIP"; ancestors_of() gives the names innermost first (ZIP, then XOR(255)) as
+ * string_views into the path, so that a scanner can ask whether its parent is a ZIP inside an XOR
+ * without formatting pos0.str() and splitting it into strings for every sbuf. The views are valid
+ * for as long as the pos0 they were read from.
+ */
+
+class forensic_path {
+public:
+    static inline const size_t MAX_ANCESTORS {8};       // the innermost names; the deeper ones are dropped
+
+    struct ancestors {
+        std::string_view names[MAX_ANCESTORS] {};
+        size_t count {0};
+        size_t size() const { return count; }
+        /* the i'th recursion out from the sbuf, or an empty view if there are not that many */
+        std::string_view operator[](size_t i) const { return i < count ? names[i] : std::string_view(); }
+    };
+
+    static ancestors ancestors_of(const std::string &path);
+    static ancestors ancestors_of(const pos0_t &pos0) { return ancestors_of(pos0.path); }
+    static ancestors ancestors_of(std::string &&path) = delete; // the views would outlive it
+};
+
+#endif
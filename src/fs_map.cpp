@@ -0,0 +1,293 @@
+/**
+ * fs_map.cpp:
+ * The allocation map of the NTFS and FAT volumes of an image; see fs_map.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "fs_map.h"
+#include "image_process.h"
+
+namespace {
+const uint64_t SECTOR {512};
+
+uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+uint32_t le32(const uint8_t *p) { return le16(p) | (uint32_t(le16(p + 2)) << 16); }
+uint64_t le64(const uint8_t *p) { return le32(p) | (uint64_t(le32(p + 4)) << 32); }
+
+bool read_all(const image_process &p, std::vector<uint8_t> &buf, uint64_t offset)
+{
+    return p.pread(buf.data(), buf.size(), offset) == static_cast<ssize_t>(buf.size());
+}
+
+bool power_of_two(uint64_t x) { return x && (x & (x - 1)) == 0; }
+
+/* NTFS multi-sector records end each sector with the update sequence number; the real bytes are in the array */
+bool apply_fixups(std::vector<uint8_t> &rec, uint64_t bytes_per_sector)
+{
+    const uint16_t usa = le16(&rec[4]);
+    const uint16_t count = le16(&rec[6]);
+    if (count == 0 || size_t(usa) + 2 * size_t(count) > rec.size() || (count - 1) * bytes_per_sector > rec.size()) return false;
+    for (uint16_t i = 1; i < count; i++) {
+        uint8_t *end = &rec[i * bytes_per_sector - 2];
+        if (memcmp(end, &rec[usa], 2) != 0) return false;
+        memcpy(end, &rec[usa + 2 * i], 2);
+    }
+    return true;
+}
+}
+
+const char *fs_map::class_name(class_t c)
+{
+    switch (c) {
+    case ALLOCATED:   return "allocated";
+    case UNALLOCATED: return "unallocated";
+    case OTHER:       return "other";
+    default:          return "";
+    }
+}
+
+std::vector<fs_map::class_t> fs_map::parse_priority(const std::string &classes)
+{
+    std::vector<class_t> priority;
+    std::stringstream ss(classes);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        bool found = false;
+        for (int c = 0; c < CLASSES; c++) {
+            if (name == class_name(class_t(c))) {
+                if (std::find(priority.begin(), priority.end(), class_t(c)) == priority.end()) priority.push_back(class_t(c));
+                found = true;
+            }
+        }
+        if (!found) throw std::invalid_argument("fs_priority: unknown class '" + name + "' (allocated, unallocated or other)");
+    }
+    return priority;
+}
+
+/* The $DATA attribute of $Bitmap (MFT record 6), resident or not, gives a bit for each cluster.
+ * The boot sector gives the cluster size and where the MFT starts; the MFT's own first records are
+ * where the boot sector says, whatever the MFT's run list.
+ */
+bool fs_map::map_ntfs(const image_process &p, uint64_t start, uint64_t length, volume &v)
+{
+    std::vector<uint8_t> boot(SECTOR);
+    if (!read_all(p, boot, start) || memcmp(&boot[3], "NTFS    ", 8) != 0) return false;
+    const uint64_t bps = le16(&boot[11]);
+    const uint8_t spc_code = boot[13];
+    const uint64_t spc = spc_code > 0x80 ? uint64_t(1) << (256 - spc_code) : spc_code;
+    const uint64_t total_sectors = le64(&boot[40]);
+    const uint64_t mft_lcn = le64(&boot[48]);
+    const int8_t mft_code = static_cast<int8_t>(boot[64]);
+    if (!power_of_two(bps) || bps < 256 || !power_of_two(spc) || total_sectors == 0) return false;
+    const uint64_t cluster = bps * spc;
+    const uint64_t record_size = mft_code < 0 ? uint64_t(1) << -mft_code : mft_code * cluster;
+    if (!power_of_two(record_size) || record_size > 64 * 1024) return false;
+    const uint64_t clusters = total_sectors * bps / cluster;
+
+    std::vector<uint8_t> rec(record_size);
+    if (!read_all(p, rec, start + mft_lcn * cluster + 6 * record_size)) return false;
+    if (memcmp(rec.data(), "FILE", 4) != 0 || !apply_fixups(rec, bps)) return false;
+
+    std::vector<uint8_t> bitmap;
+    for (size_t a = le16(&rec[20]); a + 16 <= rec.size(); ) {
+        const uint32_t type = le32(&rec[a]);
+        const uint32_t len = le32(&rec[a + 4]);
+        if (type == 0xffffffff || len < 16 || a + len > rec.size()) break;
+        if (type != 0x80 || rec[a + 9] != 0) { // not the unnamed $DATA
+            a += len;
+            continue;
+        }
+        const uint64_t bitmap_bytes = (clusters + 7) / 8;
+        if (rec[a + 8] == 0) {          // resident
+            const uint32_t size = le32(&rec[a + 16]);
+            const uint16_t offset = le16(&rec[a + 20]);
+            if (a + offset + size > rec.size()) return false;
+            bitmap.assign(&rec[a + offset], &rec[a + offset] + size);
+        } else {
+            int64_t lcn = 0;
+            for (size_t r = a + le16(&rec[a + 32]); r < a + len && rec[r] != 0 && bitmap.size() < bitmap_bytes; ) {
+                const unsigned len_bytes = rec[r] & 0x0f, off_bytes = rec[r] >> 4;
+                if (len_bytes == 0 || len_bytes > 8 || off_bytes > 8 || r + 1 + len_bytes + off_bytes > a + len) return false;
+                uint64_t run_clusters = 0;
+                for (unsigned i = 0; i < len_bytes; i++) run_clusters |= uint64_t(rec[r + 1 + i]) << (8 * i);
+                int64_t delta = 0;
+                for (unsigned i = 0; i < off_bytes; i++) delta |= int64_t(rec[r + 1 + len_bytes + i]) << (8 * i);
+                if (off_bytes && (rec[r + len_bytes + off_bytes] & 0x80)) delta -= int64_t(1) << (8 * off_bytes); // sign
+                r += 1 + len_bytes + off_bytes;
+                if (off_bytes == 0) return false; // a sparse $Bitmap
+                lcn += delta;
+                const uint64_t want = std::min(run_clusters * cluster, bitmap_bytes - bitmap.size());
+                std::vector<uint8_t> run(want);
+                if (lcn < 0 || !read_all(p, run, start + lcn * cluster)) return false;
+                bitmap.insert(bitmap.end(), run.begin(), run.end());
+            }
+        }
+        break;
+    }
+    if (bitmap.size() * 8 < clusters) return false;
+
+    v.type = "NTFS";
+    v.start = start;
+    v.length = std::min(length, total_sectors * bps);
+    v.clusters_start = start;
+    v.cluster_size = cluster;
+    v.allocated.resize(clusters);
+    for (uint64_t c = 0; c < clusters; c++) v.allocated[c] = bitmap[c / 8] & (1 << (c % 8));
+    return true;
+}
+
+/* The first FAT has an entry for each cluster of the data area, which is not free if it is not 0.
+ * What is before the data area (the reserved sectors, the FATs and the FAT12/16 root directory) is
+ * the file system's own, and is counted as allocated.
+ */
+bool fs_map::map_fat(const image_process &p, uint64_t start, uint64_t length, volume &v)
+{
+    std::vector<uint8_t> boot(SECTOR);
+    if (!read_all(p, boot, start) || boot[510] != 0x55 || boot[511] != 0xaa) return false;
+    const uint64_t bps = le16(&boot[11]);
+    const uint64_t spc = boot[13];
+    const uint64_t reserved = le16(&boot[14]);
+    const uint64_t nfats = boot[16];
+    const uint64_t root_entries = le16(&boot[17]);
+    const uint64_t total = le16(&boot[19]) ? le16(&boot[19]) : le32(&boot[32]);
+    const uint64_t fat_sectors = le16(&boot[22]) ? le16(&boot[22]) : le32(&boot[36]);
+    if (!power_of_two(bps) || bps < 512 || bps > 4096 || !power_of_two(spc) || reserved == 0
+        || nfats == 0 || nfats > 2 || fat_sectors == 0 || total == 0) return false;
+    const uint64_t root_sectors = (root_entries * 32 + bps - 1) / bps;
+    const uint64_t data_sector = reserved + nfats * fat_sectors + root_sectors;
+    if (data_sector >= total) return false;
+    const uint64_t clusters = (total - data_sector) / spc;
+    const unsigned bits = clusters < 4085 ? 12 : clusters < 65525 ? 16 : 32;
+    if (bits == 32 && root_entries != 0) return false;
+
+    std::vector<uint8_t> fat(fat_sectors * bps);
+    if (fat.size() * 8 < (clusters + 2) * bits || !read_all(p, fat, start + reserved * bps)) return false;
+    v.type = "FAT" + std::to_string(bits);
+    v.start = start;
+    v.length = std::min(length, total * bps);
+    v.clusters_start = start + data_sector * bps;
+    v.cluster_size = spc * bps;
+    v.allocated.resize(clusters);
+    for (uint64_t c = 0; c < clusters; c++) {
+        const uint64_t n = c + 2;       // the clusters of the data area are numbered from 2
+        uint32_t entry = 0;
+        switch (bits) {
+        case 12: entry = le16(&fat[n * 3 / 2]); entry = (n & 1) ? entry >> 4 : entry & 0xfff; break;
+        case 16: entry = le16(&fat[n * 2]); break;
+        default: entry = le32(&fat[n * 4]) & 0x0fffffff; break;
+        }
+        v.allocated[c] = entry != 0;
+    }
+    return true;
+}
+
+void fs_map::add_volume(const image_process &p, uint64_t start, uint64_t length)
+{
+    volume v;
+    if (map_ntfs(p, start, length, v) || map_fat(p, start, length, v)) volumes.push_back(std::move(v));
+}
+
+fs_map fs_map::read(const image_process &p)
+{
+    fs_map m;
+    const uint64_t size = p.image_size();
+    std::vector<uint8_t> mbr(SECTOR);
+    if (size < SECTOR || !read_all(p, mbr, 0)) return m;
+    m.add_volume(p, 0, size);           // a volume image
+    if (!m.volumes.empty() || mbr[510] != 0x55 || mbr[511] != 0xaa) return m;
+
+    for (int i = 0; i < 4; i++) {
+        const uint8_t *e = &mbr[446 + 16 * i];
+        const uint8_t type = e[4];
+        const uint64_t first = le32(e + 8) * SECTOR;
+        const uint64_t length = le32(e + 12) * SECTOR;
+        if (type == 0xee) {             // protective MBR: the partitions are in the GPT
+            std::vector<uint8_t> gpt(SECTOR);
+            if (!read_all(p, gpt, SECTOR) || memcmp(gpt.data(), "EFI PART", 8) != 0) break;
+            const uint64_t entries = le64(&gpt[72]) * SECTOR;
+            const uint32_t count = std::min<uint32_t>(le32(&gpt[80]), 1024);
+            const uint32_t entry_size = le32(&gpt[84]);
+            if (entry_size < 128 || entry_size > 4096) break;
+            std::vector<uint8_t> table(uint64_t(count) * entry_size);
+            if (!read_all(p, table, entries)) break;
+            for (uint32_t j = 0; j < count; j++) {
+                const uint8_t *g = &table[uint64_t(j) * entry_size];
+                const uint64_t first_lba = le64(g + 32), last_lba = le64(g + 40);
+                if (std::all_of(g, g + 16, [](uint8_t c){ return c == 0; }) || last_lba < first_lba) continue;
+                if (first_lba * SECTOR < size) m.add_volume(p, first_lba * SECTOR, (last_lba - first_lba + 1) * SECTOR);
+            }
+            break;
+        }
+        if (type == 0 || type == 0x05 || type == 0x0f || type == 0x85) continue; // empty, or extended
+        if (first < size && length) m.add_volume(p, first, length);
+    }
+    return m;
+}
+
+unsigned fs_map::classes(uint64_t offset, uint64_t len) const
+{
+    unsigned mask = 0;
+    uint64_t covered = 0;
+    const uint64_t end = offset + len;
+    for (const auto &v : volumes) {
+        const uint64_t a = std::max(offset, v.start), b = std::min(end, v.start + v.length);
+        if (a >= b) continue;
+        covered += b - a;
+        if (a < v.clusters_start) mask |= 1U << ALLOCATED; // the file system's own
+        const uint64_t clusters_end = v.clusters_start + v.allocated.size() * v.cluster_size;
+        if (b > clusters_end) mask |= 1U << OTHER; // volume slack
+        const uint64_t ca = std::max(a, v.clusters_start), cb = std::min(b, clusters_end);
+        for (uint64_t c = ca < cb ? (ca - v.clusters_start) / v.cluster_size : 0;
+             ca < cb && c <= (cb - 1 - v.clusters_start) / v.cluster_size; c++) {
+            mask |= 1U << (v.allocated[c] ? ALLOCATED : UNALLOCATED);
+            if ((mask & (1U << ALLOCATED)) && (mask & (1U << UNALLOCATED))) break;
+        }
+    }
+    if (covered < len) mask |= 1U << OTHER;
+    return mask;
+}
+
+std::vector<uint64_t> fs_map::page_order(uint64_t image_size, uint64_t pagesize, const std::vector<class_t> &priority) const
+{
+    const uint64_t pages = (image_size + pagesize - 1) / pagesize;
+    std::vector<std::vector<uint64_t>> by_rank(priority.size());
+    for (uint64_t page = 0; page < pages; page++) {
+        const uint64_t offset = page * pagesize;
+        const unsigned mask = classes(offset, std::min(pagesize, image_size - offset));
+        for (size_t rank = 0; rank < priority.size(); rank++) {
+            if (mask & (1U << priority[rank])) {
+                by_rank[rank].push_back(page);
+                break;
+            }
+        }
+    }
+    std::vector<uint64_t> order;
+    for (const auto &pages_of_rank : by_rank) order.insert(order.end(), pages_of_rank.begin(), pages_of_rank.end());
+    return order;
+}
+
+std::vector<uint64_t> fs_map::class_bytes(uint64_t image_size) const
+{
+    std::vector<uint64_t> bytes(CLASSES);
+    uint64_t in_volumes = 0;
+    for (const auto &v : volumes) {
+        if (v.start >= image_size) continue;
+        const uint64_t end = std::min(v.start + v.length, image_size);
+        const uint64_t clusters_start = std::min(v.clusters_start, end);
+        const uint64_t clusters_end = std::clamp(v.clusters_start + v.allocated.size() * v.cluster_size, clusters_start, end);
+        in_volumes += end - v.start;
+        bytes[ALLOCATED] += clusters_start - v.start;
+        for (uint64_t c = 0, offset = clusters_start; offset < clusters_end; c++, offset += v.cluster_size) {
+            bytes[v.allocated[c] ? ALLOCATED : UNALLOCATED] += std::min(v.cluster_size, clusters_end - offset);
+        }
+        bytes[OTHER] += end - clusters_end;
+    }
+    bytes[OTHER] += image_size - in_volumes;
+    return bytes;
+}
@@ -0,0 +1,65 @@
+#ifndef FS_MAP_H
+#define FS_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class image_process;
+
+/**
+ * fs_map:
+ * Which bytes of the image are in clusters that a file system has allocated, which are in clusters it
+ * has not, and which are in neither (unpartitioned space, volume slack, and whatever cannot be read as a
+ * file system), from a pre-pass over the file system metadata. With -S fs_priority=CLASSES, phase 1 scans
+ * the pages of each class in turn, in the order given, and skips the pages whose classes are not given;
+ * so with fs_priority=unallocated,other the pages that only hold files are never scanned, and with
+ * fs_priority=unallocated,other,allocated they are scanned last. Time-boxed triage gets what a file-based
+ * tool would miss first.
+ *
+ * The volumes are found at the start of the image and in the primary MBR partitions and GPT entries.
+ * NTFS volumes are mapped from $Bitmap (MFT record 6) and FAT12/16/32 volumes from their first FAT;
+ * the layouts are those of tsk3/fs/tsk_ntfs.h and tsk3/fs/tsk_fatfs.h, read directly, since only the
+ * headers of The Sleuth Kit are in the tree. Other file systems, extended partitions and the slack of
+ * individual files are not mapped; their bytes are "other".
+ *
+ * A page's class is that of its highest-priority bytes, so that a page with a few unallocated clusters
+ * among files is scanned with the unallocated pages.
+ */
+
+class fs_map {
+public:
+    enum class_t { ALLOCATED, UNALLOCATED, OTHER, CLASSES };
+    static const char *class_name(class_t c);
+    static std::vector<class_t> parse_priority(const std::string &classes); // throws std::invalid_argument
+
+    struct volume {
+        std::string type {};            // NTFS, FAT12, FAT16 or FAT32
+        uint64_t start {0};             // of the volume in the image
+        uint64_t length {0};
+        uint64_t clusters_start {0};    // of the first cluster in the image
+        uint64_t cluster_size {0};
+        std::vector<bool> allocated {}; // of each cluster
+    };
+
+    /* Finds and maps the volumes of the image. Volumes that cannot be mapped are left out. */
+    static fs_map read(const image_process &p);
+
+    std::vector<volume> volumes {};
+
+    /* The classes with bytes in [offset, offset+len), as a bit mask of 1<<class_t */
+    unsigned classes(uint64_t offset, uint64_t len) const;
+
+    /* The pages of the image in the order to scan them; pages of classes not in priority are left out */
+    std::vector<uint64_t> page_order(uint64_t image_size, uint64_t pagesize, const std::vector<class_t> &priority) const;
+
+    /* Bytes of each class in the image */
+    std::vector<uint64_t> class_bytes(uint64_t image_size) const;
+
+private:
+    static bool map_ntfs(const image_process &p, uint64_t start, uint64_t length, volume &v);
+    static bool map_fat(const image_process &p, uint64_t start, uint64_t length, volume &v);
+    void add_volume(const image_process &p, uint64_t start, uint64_t length);
+};
+
+#endif
@@ -0,0 +1,275 @@
+/**
+ * heavy_hitters.cpp:
+ * SpaceSaving counters and the approximate histograms; see heavy_hitters.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include "feature_shards.h"
+#include "heavy_hitters.h"
+#include "recorder_handle.h"
+
+heavy_hitters::heavy_hitters(size_t capacity): capacity_(std::max(capacity, size_t(1)))
+{
+    heap.reserve(capacity_);
+    where.reserve(capacity_);
+}
+
+void heavy_hitters::exchange(size_t i, size_t j)
+{
+    std::swap(heap[i], heap[j]);
+    where[heap[i].key] = i;
+    where[heap[j].key] = j;
+}
+
+void heavy_hitters::sift_up(size_t i)
+{
+    while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+        exchange(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void heavy_hitters::sift_down(size_t i)
+{
+    for (;;) {
+        size_t least = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap.size(); child++) {
+            if (heap[child].count < heap[least].count) least = child;
+        }
+        if (least == i) return;
+        exchange(i, least);
+        i = least;
+    }
+}
+
+void heavy_hitters::add(const std::string &key)
+{
+    total_++;
+    auto it = where.find(key);
+    if (it != where.end()) {
+        heap[it->second].count++;
+        sift_down(it->second);
+        return;
+    }
+    if (heap.size() < capacity_) {
+        heap.push_back(counter{key, 1, 0});
+        where[key] = heap.size() - 1;
+        sift_up(heap.size() - 1);
+        return;
+    }
+    /* the feature takes over the smallest counter */
+    counter &least = heap[0];
+    where.erase(least.key);
+    least.key = key;
+    least.error = least.count;
+    least.count++;
+    where[key] = 0;
+    sift_down(0);
+}
+
+std::vector<heavy_hitters::counter> heavy_hitters::top(size_t n) const
+{
+    std::vector<counter> ret(heap);
+    std::sort(ret.begin(), ret.end(), [](const counter &a, const counter &b) {
+        return a.count != b.count ? a.count > b.count : a.key < b.key;
+    });
+    if (ret.size() > n) ret.resize(n);
+    return ret;
+}
+
+void heavy_hitters::set_recorders(const std::string &names, size_t top_k_)
+{
+    recorders.clear();
+    deferred.clear();
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (!name.empty()) recorders.insert(name);
+    }
+    top_k = std::max(top_k_, size_t(1));
+}
+
+bool heavy_hitters::approximate(const std::string &recorder)
+{
+    return recorders.count(recorder) && !recorder_handle::histogram_only(recorder);
+}
+
+void heavy_hitters::add_def(const scanner_params &sp, const histogram_def &def)
+{
+    if (!approximate(def.feature)) {
+        sp.info->histogram_defs.push_back(def);
+        if (feature_shards::defined(def.feature)) {
+            for (unsigned i = 0; i < feature_shards::shards(); i++) {
+                histogram_def shard(def);
+                shard.feature = feature_shards::shard_name(def.feature, i);
+                sp.info->histogram_defs.push_back(shard);
+            }
+        }
+        return;
+    }
+    /* a scanner's PHASE_INIT runs again for each scanner set */
+    for (const auto &d : deferred) {
+        if (d.feature == def.feature && d.suffix == def.suffix) return;
+    }
+    deferred.push_back(def);
+}
+
+std::set<std::string> heavy_hitters::deferred_recorders()
+{
+    std::set<std::string> ret;
+    for (const auto &def : deferred) ret.insert(def.feature);
+    return ret;
+}
+
+heavy_hitters::compiled_defs::compiled_defs(const std::vector<histogram_def> &defs_): defs(defs_)
+{
+    for (const auto &def : defs) {
+        use_t use;
+        const form_t form{def.flags.lowercase, def.flags.numeric};
+        use.form = std::find(forms.begin(), forms.end(), form) - forms.begin();
+        if (use.form == forms.size()) forms.push_back(form);
+        if (!def.pattern.empty()) {
+            use.pattern = std::find_if(regexes.begin(), regexes.end(), [&](const pattern_t &p) {
+                return p.form == use.form && p.text == def.pattern;
+            }) - regexes.begin();
+            if (use.pattern == regexes.size()) {
+                regexes.push_back(pattern_t{def.pattern, use.form, std::regex(def.pattern, std::regex::optimize)});
+            }
+        }
+        uses.push_back(use);
+    }
+}
+
+void heavy_hitters::compiled_defs::keys(const std::string &feature, const std::string &context,
+                                        std::vector<std::string> &keys) const
+{
+    std::vector<std::string> formed(forms.size(), feature);
+    for (size_t i = 0; i < forms.size(); i++) {
+        std::string &f = formed[i];
+        if (forms[i].lowercase) {
+            std::transform(f.begin(), f.end(), f.begin(), [](unsigned char ch) { return std::tolower(ch); });
+        }
+        if (forms[i].numeric) {
+            f.erase(std::remove_if(f.begin(), f.end(), [](unsigned char ch) { return !std::isdigit(ch); }), f.end());
+        }
+    }
+    std::vector<std::string> matched(regexes.size());  // "" if the pattern is not found
+    for (size_t i = 0; i < regexes.size(); i++) {
+        std::smatch m;
+        if (std::regex_search(formed[regexes[i].form], m, regexes[i].re)) {
+            matched[i] = m.size() > 1 ? m[1].str() : m[0].str();
+        }
+    }
+    keys.resize(defs.size());
+    for (size_t i = 0; i < defs.size(); i++) {
+        const histogram_def &def = defs[i];
+        const std::string &f = formed[uses[i].form];
+        if (!def.require.empty() && (def.flags.require_context ? context : f).find(def.require) == std::string::npos) {
+            keys[i].clear();
+        } else {
+            keys[i] = uses[i].pattern == NO_PATTERN ? f : matched[uses[i].pattern];
+        }
+    }
+}
+
+heavy_hitters::file_histograms::file_histograms(const std::vector<histogram_def> &defs): compiled(defs)
+{
+    for (size_t i = 0; i < compiled.size(); i++) counters.emplace_back(top_k * 10);
+}
+
+void heavy_hitters::file_histograms::add_line(const std::string &line)
+{
+    if (line.empty() || line[0] == '#') return;
+    const size_t tab1 = line.find('\t');
+    if (tab1 == std::string::npos) return;
+    const size_t tab2 = line.find('\t', tab1 + 1);
+    const std::string f = line.substr(tab1 + 1, tab2 == std::string::npos ? std::string::npos : tab2 - tab1 - 1);
+    const std::string context = tab2 == std::string::npos ? "" : line.substr(tab2 + 1);
+    lines_++;
+    compiled.keys(f, context, keys);
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!keys[i].empty()) counters[i].add(keys[i]);
+    }
+}
+
+void heavy_hitters::file_histograms::write(const std::filesystem::path &outdir, std::vector<std::filesystem::path> &made) const
+{
+    for (size_t i = 0; i < compiled.size(); i++) {
+        const histogram_def &def = compiled.def(i);
+        const std::filesystem::path out_path = outdir / (def.feature + "_" + def.suffix + ".txt");
+        std::ofstream out(out_path, std::ios::binary);
+        if (!out.is_open()) throw std::runtime_error("cannot create " + out_path.string());
+        const auto entries = counters[i].top(top_k);
+        uint64_t max_error = 0;
+        for (const auto &e : entries) max_error = std::max(max_error, e.error);
+        /* with fewer than top_k, every counter is listed and none was taken over */
+        const uint64_t unlisted = entries.size() < top_k ? 0 : entries.back().count;
+        out << "# Approximate histogram: the top " << entries.size() << " of " << counters[i].total()
+            << " features, counted with " << counters[i].capacity() << " SpaceSaving counters\n"
+            << "# Each count is at most " << max_error << " more than the true count, and no feature that is not listed was seen more than "
+            << unlisted << " times\n";
+        for (const auto &e : entries) out << "n=" << e.count << "\t" << e.key << "\n";
+        out.close();
+        if (!out) throw std::runtime_error("cannot write " + out_path.string());
+        made.push_back(out_path);
+    }
+}
+
+heavy_hitters::stream_sink::stream_sink(): feature_sink("approximate_histograms")
+{
+    std::map<std::string, std::vector<histogram_def>> by_feature;
+    for (const auto &def : deferred) by_feature[def.feature].push_back(def);
+    for (const auto &[feature, defs] : by_feature) files.emplace(feature, file_histograms(defs));
+}
+
+bool heavy_hitters::stream_sink::write(const std::string &recorder, const std::string &lines)
+{
+    auto it = files.find(recorder);
+    if (it == files.end()) return true;
+    std::string line;
+    for (size_t start = 0, nl; (nl = lines.find('\n', start)) != std::string::npos; start = nl + 1) {
+        line.assign(lines, start, nl - start);
+        it->second.add_line(line);
+    }
+    return true;
+}
+
+const heavy_hitters::file_histograms *heavy_hitters::stream_sink::counts(const std::string &recorder) const
+{
+    auto it = files.find(recorder);
+    return it == files.end() ? nullptr : &it->second;
+}
+
+std::vector<std::filesystem::path> heavy_hitters::make_histograms(const std::filesystem::path &outdir,
+                                                                  const stream_sink *counted)
+{
+    std::map<std::string, std::vector<histogram_def>> by_feature;
+    for (const auto &def : deferred) by_feature[def.feature].push_back(def);
+
+    std::vector<std::filesystem::path> made;
+    for (const auto &[feature, defs] : by_feature) {
+        const std::filesystem::path txt = outdir / (feature + ".txt");
+        if (!std::filesystem::exists(txt)) continue;  // the recorder was disabled or found nothing
+        const file_histograms *counts = counted ? counted->counts(feature) : nullptr;
+        if (counts) {
+            counts->write(outdir, made);
+            continue;
+        }
+        std::ifstream in(txt, std::ios::binary);
+        if (!in.is_open()) continue;
+        file_histograms h(defs);
+        std::string line;
+        while (std::getline(in, line)) h.add_line(line);
+        h.write(outdir, made);
+    }
+    return made;
+}
@@ -0,0 +1,146 @@
+#ifndef HEAVY_HITTERS_H
+#define HEAVY_HITTERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <regex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "be13_api/scanner_params.h"
+
+#include "feature_sink.h"
+
+/**
+ * heavy_hitters:
+ * The most frequent features of a stream, counted in bounded memory with the SpaceSaving algorithm,
+ * and the approximate histograms made with it.
+ *
+ * SpaceSaving keeps capacity counters. A feature that has none takes the smallest, adding one to its
+ * count and remembering the count it took over as its error, so each count is at most its error more
+ * than the true count, and every feature seen more than total()/capacity times has a counter.
+ *
+ * With -S approximate_histograms=NAME,... the histograms of those feature recorders are not built
+ * in memory by the feature recorder set, which needs memory for every distinct feature; the scanners
+ * give their histogram definitions to add_def(), which keeps them here for those recorders, and at the
+ * end of phase 2 make_histograms() reads each of their feature files once and writes the top
+ * -S histogram_top_k features of each histogram, counted with ten counters for every one written.
+ * The header of such a histogram gives its bounds. The features are counted as the feature file has
+ * them (escaped, and without the utf16 counts of an exact histogram), and the recorders must have
+ * feature files, so -S histogram_only takes precedence.
+ *
+ * The histograms of a feature file are compiled together (compiled_defs): each distinct pattern once,
+ * however many histograms use it, and each form of the feature (lowercased, digits only) is made once
+ * for all of them. While the image is scanned, a feature_stream gives the lines of those files to a
+ * stream_sink as they are written, which counts them off the scanner threads, so that phase 2 writes
+ * the histograms without going over the feature files again; without one, make_histograms() reads them.
+ */
+
+class heavy_hitters {
+public:
+    struct counter {
+        std::string key {};
+        uint64_t count {0};
+        uint64_t error {0};                 // at most this more than the true count
+    };
+
+    explicit heavy_hitters(size_t capacity_);
+    void add(const std::string &key);
+    std::vector<counter> top(size_t n) const; // by count, then key
+    uint64_t total() const { return total_; }
+    size_t capacity() const { return capacity_; }
+
+    /* names is a list of recorder names separated by commas, or "" for none; before the scanners are loaded */
+    static void set_recorders(const std::string &names, size_t top_k);
+    static bool approximate(const std::string &recorder);
+    /* At PHASE_INIT, instead of sp.info->histogram_defs.push_back(def) */
+    static void add_def(const scanner_params &sp, const histogram_def &def);
+    /* The recorders whose histograms are approximate, from the definitions given to add_def() */
+    static std::set<std::string> deferred_recorders();
+
+    /* The histogram definitions of one feature file, compiled once for all of its features */
+    class compiled_defs {
+    public:
+        explicit compiled_defs(const std::vector<histogram_def> &defs);
+        size_t size() const { return defs.size(); }
+        size_t patterns() const { return regexes.size(); } // distinct
+        /* keys[i] is the string that the ith definition counts for the feature, or "" if it does not count it */
+        void keys(const std::string &feature, const std::string &context, std::vector<std::string> &keys) const;
+        const histogram_def &def(size_t i) const { return defs[i]; }
+
+    private:
+        static inline const size_t NO_PATTERN {SIZE_MAX};
+        struct form_t {
+            bool lowercase {false};
+            bool numeric {false};
+            bool operator==(const form_t &that) const { return lowercase == that.lowercase && numeric == that.numeric; }
+        };
+        struct pattern_t {
+            std::string text {};
+            size_t form {0};                // searched in this form of the feature
+            std::regex re {};
+        };
+        struct use_t {
+            size_t form {0};
+            size_t pattern {NO_PATTERN};
+        };
+        std::vector<histogram_def> defs;
+        std::vector<form_t> forms {};
+        std::vector<pattern_t> regexes {};
+        std::vector<use_t> uses {};         // of each definition
+    };
+
+    /* The approximate histograms of one feature file, counted a line at a time */
+    class file_histograms {
+    public:
+        explicit file_histograms(const std::vector<histogram_def> &defs);
+        void add_line(const std::string &line); // a line of the feature file without its newline
+        /* Writes a histogram file for each definition to outdir and adds their paths to made */
+        void write(const std::filesystem::path &outdir, std::vector<std::filesystem::path> &made) const;
+        uint64_t lines() const { return lines_; }
+
+    private:
+        compiled_defs compiled;
+        std::vector<heavy_hitters> counters {};
+        std::vector<std::string> keys {};   // reused from line to line
+        uint64_t lines_ {0};
+    };
+
+    /* Counts the histograms of deferred_recorders() as a feature_stream that follows them gives it the lines */
+    class stream_sink : public feature_sink {
+    public:
+        stream_sink();                      // after the scanners' PHASE_INIT, which gives the definitions
+        bool write(const std::string &recorder, const std::string &lines) override;
+        bool carve(const std::string &, const std::filesystem::path &, const std::filesystem::path &) override { return true; }
+        /* Once the stream is stopped: the counts of recorder, or nullptr if it is not counted here */
+        const file_histograms *counts(const std::string &recorder) const;
+
+    private:
+        std::map<std::string, file_histograms> files {};
+    };
+
+    /* Writes the approximate histograms to outdir from the counts of the stream sink that followed the
+     * feature files there, or from the feature files if there was none, and returns their paths */
+    static std::vector<std::filesystem::path> make_histograms(const std::filesystem::path &outdir,
+                                                             const stream_sink *counted = nullptr);
+
+private:
+    void sift_down(size_t i);
+    void sift_up(size_t i);
+    void exchange(size_t i, size_t j);
+
+    size_t capacity_;
+    uint64_t total_ {0};
+    std::vector<counter> heap {};       // smallest count first
+    std::unordered_map<std::string, size_t> where {}; // key -> index in heap
+
+    static inline std::set<std::string> recorders {};
+    static inline size_t top_k {1000};
+    static inline std::vector<histogram_def> deferred {};
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "config.h"
+
+#include "hex_runs.h"
+
+namespace {
+    inline bool hex_char(uint8_t ch) {
+        return (ch>='0' && ch<='9') || ((ch|0x20)>='a' && (ch|0x20)<='f');
+    }
+    inline uint8_t nibble(uint8_t ch) {
+        return ch<='9' ? ch-'0' : (ch|0x20)-'a'+10;
+    }
+    /* The length of the separator at p (space, LF or CRLF), or 0 */
+    inline size_t separator(const uint8_t *p, const uint8_t *end) {
+        if (*p==' ' || *p=='\n') return 1;
+        if (*p=='\r' && p+1<end && p[1]=='\n') return 2;
+        return 0;
+    }
+
+    /* The run at buf+i, or one of no pairs */
+    hex_runs::run follow(const uint8_t *buf, size_t bufsize, size_t i) {
+        hex_runs::run r {i, 0, 0};
+        const uint8_t *end = buf + bufsize;
+        const uint8_t *p = buf + i;
+        while (p+1 < end && hex_char(p[0]) && hex_char(p[1])) {
+            r.pairs++;
+            r.len = p + 2 - (buf + i);
+            p += 2;
+            for (int seps = 0; seps < 2 && p < end; seps++) {
+                const size_t n = separator(p, end);
+                if (n==0) break;
+                p += n;
+            }
+        }
+        return r;
+    }
+}
+
+/* Bits for the 16 bytes at p: those that are hex digits, and those that are hex digits or separators */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+static inline void classify16(const uint8_t *p, uint16_t &hex, uint16_t &in_run)
+{
+    // signed compares: bytes >= 0x80 are negative, and stay so with 0x20 or'ed in, so they fail both ranges
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i h = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('9'+1), c)),
+                                   _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('f'+1), lower)));
+    const __m128i s = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+                                   _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\r'))));
+    hex    = static_cast<uint16_t>(_mm_movemask_epi8(h));
+    in_run = static_cast<uint16_t>(_mm_movemask_epi8(_mm_or_si128(h, s)));
+}
+
+/* 32 hex digits at src to 16 bytes at out */
+static inline void decode32(const uint8_t *src, uint8_t *out)
+{
+    __m128i words[2];
+    for (int k = 0; k < 2; k++) {
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16*k));
+        const __m128i digit = _mm_cmpgt_epi8(_mm_set1_epi8('9'+1), c);
+        const __m128i n = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                                       _mm_andnot_si128(digit, _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                                                                            _mm_set1_epi8('a'-10))));
+        // each 16-bit lane has the high nibble in its low byte and the low nibble in its high byte
+        words[k] = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(n, 4), _mm_set1_epi16(0xf0)), _mm_srli_epi16(n, 8));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(words[0], words[1]));
+}
+#define HEX_RUNS_DECODE32
+#else
+static inline void classify16(const uint8_t *p, uint16_t &hex, uint16_t &in_run)
+{
+    hex = in_run = 0;
+    for (int k = 0; k < 16; k++) {
+        const bool h = hex_char(p[k]);
+        hex    |= h << k;
+        in_run |= (h || p[k]==' ' || p[k]=='\n' || p[k]=='\r') << k;
+    }
+}
+#endif
+
+/*
+ * A run of MIN_PAIRS is at least 2*MIN_PAIRS bytes that can be in a run, starting with a pair,
+ * so the block masks give the places where one may start; the 16 bytes after the block are looked
+ * at too, for the runs that start near its end.
+ */
+void hex_runs::find(const uint8_t *buf, size_t bufsize, size_t pagesize, std::vector<run> &runs)
+{
+    runs.clear();
+    const size_t span = 2 * MIN_PAIRS;
+    size_t i = 0;
+    while (i + 1 < bufsize && i < pagesize) {
+        if (i + 80 <= bufsize) {
+            uint64_t hex = 0, in_run = 0;
+            for (int k = 0; k < 4; k++) {
+                uint16_t h, r;
+                classify16(buf + i + 16*k, h, r);
+                hex    |= static_cast<uint64_t>(h) << (16*k);
+                in_run |= static_cast<uint64_t>(r) << (16*k);
+            }
+            uint16_t hex_next, in_run_next;  // the 16 bytes after the block
+            classify16(buf + i + 64, hex_next, in_run_next);
+            uint64_t starts = hex & ((hex >> 1) | (static_cast<uint64_t>(hex_next & 1) << 63));
+            for (size_t n = 1; n < span; n++) starts &= (in_run >> n) | (static_cast<uint64_t>(in_run_next) << (64 - n));
+            if (starts==0) {
+                i += 64;
+                continue;
+            }
+            i += __builtin_ctzll(starts);
+            if (i >= pagesize) break;
+        }
+        const run r = follow(buf, bufsize, i);
+        if (r.pairs >= MIN_PAIRS) {
+            runs.push_back(r);
+            i += r.len;
+        } else {
+            i++;
+        }
+    }
+}
+
+void hex_runs::decode(const uint8_t *src, const run &r, uint8_t *out)
+{
+    const uint8_t *p = src + r.offset;
+    const uint8_t *end = p + r.len;
+    uint8_t *o = out;
+    while (p < end) {
+#ifdef HEX_RUNS_DECODE32
+        if (p + 32 <= end) {
+            uint16_t h0, h1, in_run;
+            classify16(p, h0, in_run);
+            classify16(p + 16, h1, in_run);
+            if ((h0 & h1)==0xffff) {
+                decode32(p, o);
+                p += 32;
+                o += 16;
+                continue;
+            }
+        }
+#endif
+        const size_t n = separator(p, end);
+        if (n) {
+            p += n;
+            continue;
+        }
+        *o++ = (nibble(p[0]) << 4) | nibble(p[1]);
+        p += 2;
+    }
+}
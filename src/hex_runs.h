@@ -0,0 +1,37 @@
+#ifndef HEX_RUNS_H
+#define HEX_RUNS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * hex_runs:
+ * The runs of hexadecimal that scan_base16 decodes, found and decoded a block at a time.
+ *
+ * A run is MIN_PAIRS or more pairs of hex digits (in either case), each pair after the first
+ * preceded by at most two separators (space, LF or CRLF), as long as it goes; this is the language
+ * of the flex rule the scanner had. The bytes that can be in a run are classified 64 at a time with
+ * SSE2, and only where twelve of them in a row start with a hex pair is a run followed a byte at a
+ * time, so text with the odd hex word in it costs a few compares a byte. decode() turns 32 digits
+ * into 16 bytes at a step where there are no separators.
+ */
+
+class hex_runs {
+public:
+    static inline const size_t MIN_PAIRS {6};
+
+    struct run {
+        size_t offset {0};
+        size_t len {0};                 // bytes, separators included
+        size_t pairs {0};               // the bytes it decodes to
+    };
+
+    /* The runs that start before pagesize, in order; a run may continue into the margin */
+    static void find(const uint8_t *buf, size_t bufsize, size_t pagesize, std::vector<run> &runs);
+
+    /* Decodes the pairs of the run at src into out, which has room for r.pairs bytes */
+    static void decode(const uint8_t *src, const run &r, uint8_t *out);
+};
+
+#endif
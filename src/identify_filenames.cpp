@@ -0,0 +1,298 @@
+/**
+ * identify_filenames.cpp:
+ * The files in which the features were found; see identify_filenames.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "bulk_extractor_restarter.h"
+#include "feature_files.h"
+#include "identify_filenames.h"
+
+namespace {
+    bool parse_number(std::string_view s, uint64_t &value) {
+        if (s.empty() || s.size() > 20) return false;
+        value = 0;
+        for (char ch : s) {
+            if (ch < '0' || ch > '9') return false;
+            value = value * 10 + (ch - '0');
+        }
+        return true;
+    }
+
+    /* The name of the element in the body of a tag (what is between < and >) */
+    std::string_view element_name(std::string_view tag) {
+        const size_t end = tag.find_first_of(" \t\r\n/");
+        return tag.substr(0, end);
+    }
+
+    /* A fileobject being read */
+    struct fileobject {
+        identify_filenames::file_info info {};
+        bool allocated {true};
+        std::vector<std::pair<uint64_t, uint64_t>> runs {};
+    };
+}
+
+identify_filenames::counts &identify_filenames::counts::operator+=(const counts &that)
+{
+    features += that.features;
+    located += that.located;
+    unallocated += that.unallocated;
+    encoded += that.encoded;
+    return *this;
+}
+
+void identify_filenames::run_index::add(uint64_t start, uint64_t len, uint32_t file)
+{
+    if (len > 0) runs.push_back(run{start, start + len, file});
+}
+
+void identify_filenames::run_index::finish()
+{
+    std::sort(runs.begin(), runs.end(), [](const run &a, const run &b) {
+        return a.start != b.start ? a.start < b.start : a.file < b.file;
+    });
+    max_end.resize(runs.size());
+    uint64_t end = 0;
+    for (size_t i = 0; i < runs.size(); i++) max_end[i] = end = std::max(end, runs[i].end);
+}
+
+const identify_filenames::run_index::run *identify_filenames::run_index::find(uint64_t offset) const
+{
+    auto it = std::upper_bound(runs.begin(), runs.end(), offset,
+                               [](uint64_t o, const run &r) { return o < r.start; });
+    /* back from the last run that starts at or before offset, while one before may reach it */
+    for (size_t i = it - runs.begin(); i-- > 0 && max_end[i] > offset;) {
+        if (runs[i].end > offset) return &runs[i];
+    }
+    return nullptr;
+}
+
+identify_filenames identify_filenames::read_dfxml(const std::filesystem::path &dfxml)
+{
+    std::ifstream in(dfxml, std::ios::binary);
+    if (!in) throw std::runtime_error("identify_filenames: cannot open " + dfxml.string());
+    identify_filenames map;
+    map.read_dfxml(in);
+    if (in.bad()) throw std::runtime_error("identify_filenames: cannot read " + dfxml.string());
+    if (map.allocated.size() + map.unallocated.size() == 0) {
+        throw std::runtime_error("identify_filenames: no files with byte runs in " + dfxml.string());
+    }
+    return map;
+}
+
+void identify_filenames::read_dfxml(std::istream &in)
+{
+    /* Each piece up to a '>' is the text before a tag, then the tag. Only the elements of a
+     * fileobject that locate it are kept: its filename, MD5, whether it is allocated and its runs. */
+    std::string piece, value;
+    std::string open;                       // the element whose text is wanted
+    fileobject *file = nullptr;
+    fileobject current;
+    while (std::getline(in, piece, '>')) {
+        const size_t lt = piece.rfind('<');
+        if (lt == std::string::npos) continue;
+        const std::string_view text = std::string_view(piece).substr(0, lt);
+        const std::string_view tag = std::string_view(piece).substr(lt + 1);
+        if (tag.empty() || tag[0] == '?' || tag[0] == '!') continue;
+        if (tag[0] == '/') {
+            const std::string_view name = element_name(tag.substr(1));
+            if (file && !open.empty() && name == open) {
+                const std::string decoded = bulk_extractor_restarter::xml_decode(text);
+                uint64_t flag = 1;
+                if (open == "filename") file->info.filename = decoded;
+                else if (open == "md5" || open == "hashdigest") file->info.md5 = decoded;
+                else if (open == "unalloc") file->allocated = !(parse_number(decoded, flag) && flag);
+                else if (parse_number(decoded, flag) && flag == 0) file->allocated = false;  // alloc, alloc_inode, alloc_name
+            }
+            open.clear();
+            if (file && name == "fileobject") {
+                const uint32_t n = files.size();
+                if (!file->allocated) file->info.filename = "*" + file->info.filename;
+                files.push_back(std::move(file->info));
+                for (const auto &[start, len] : file->runs) (file->allocated ? allocated : unallocated).add(start, len, n);
+                file = nullptr;
+            }
+            continue;
+        }
+        const std::string_view name = element_name(tag);
+        if (name == "fileobject") {
+            current = fileobject();
+            file = &current;
+        } else if (file && name == "byte_run") {
+            uint64_t start = 0, len = 0;
+            if (bulk_extractor_restarter::attribute(tag, "img_offset", value) && parse_number(value, start) &&
+                bulk_extractor_restarter::attribute(tag, "len", value) && parse_number(value, len)) {
+                file->runs.emplace_back(start, len);
+            }
+        } else if (file && tag.back() != '/') {
+            if (name == "hashdigest") {
+                std::string type;
+                bulk_extractor_restarter::attribute(tag, "type", type);
+                std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+                if (type == "md5") open = "hashdigest";
+            } else if (name == "filename" || name == "md5" || name == "alloc" || name == "unalloc" ||
+                       name == "alloc_inode" || name == "alloc_name") {
+                open = std::string(name);
+            }
+        }
+    }
+    allocated.finish();
+    unallocated.finish();
+}
+
+bool identify_filenames::offset_of(std::string_view path, uint64_t &offset)
+{
+    size_t dash = path.find('-');
+    if (!parse_number(path.substr(0, dash), offset)) return false;
+    if (dash == std::string_view::npos) return true;
+    /* 1000-XOR-30 (or XOR(255)): the bytes of the buffer are where they were in the image */
+    const std::string_view after = path.substr(dash + 1);
+    if (after.compare(0, 3, "XOR") != 0) return true;
+    dash = after.find('-');
+    if (dash == std::string_view::npos) return true;
+    const std::string_view rest = after.substr(dash + 1);
+    uint64_t inner = 0;
+    if (parse_number(rest.substr(0, rest.find('-')), inner)) offset += inner;
+    return true;
+}
+
+const identify_filenames::file_info *identify_filenames::locate(uint64_t offset) const
+{
+    const run_index::run *r = allocated.find(offset);
+    if (r == nullptr) r = unallocated.find(offset);
+    return r ? &files[r->file] : nullptr;
+}
+
+identify_filenames::counts identify_filenames::annotate(const std::filesystem::path &txt, std::ostream &out,
+                                                        bool context, const std::string &command_line) const
+{
+    std::ifstream in(txt, std::ios::binary);
+    if (!in) throw std::runtime_error("identify_filenames: cannot open " + txt.string());
+    const auto t0 = std::chrono::steady_clock::now();
+    out << "# Position\tFeature" << (context ? "\tContext" : "") << "\tFilename\tMD5\n";
+    out << "# " << command_line << "\n";
+    counts c;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        if (line[0] == '#') {
+            out << line << "\n";
+            continue;
+        }
+        const std::string_view l(line);
+        const size_t tab1 = l.find('\t');
+        if (tab1 == std::string_view::npos) continue;
+        const size_t tab2 = l.find('\t', tab1 + 1);
+        const std::string_view path = l.substr(0, tab1);
+        c.features++;
+        if (path.find('-') != std::string_view::npos) c.encoded++;
+        out << (context || tab2 == std::string_view::npos ? l : l.substr(0, tab2));
+        uint64_t offset = 0;
+        const file_info *f = offset_of(path, offset) ? locate(offset) : nullptr;
+        if (f) {
+            c.located++;
+            out << "\t" << f->filename << "\t" << f->md5;
+        } else {
+            c.unallocated++;
+        }
+        out << "\n";
+    }
+    if (in.bad()) throw std::runtime_error("identify_filenames: cannot read " + txt.string());
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    out << "# Total features input: " << c.features << "\n"
+        << "# Total features located to files: " << c.located << "\n"
+        << "# Total features in unallocated space: " << c.unallocated << "\n"
+        << "# Total features in encoded regions: " << c.encoded << "\n"
+        << "# Total processing time: " << std::setprecision(2) << seconds << " seconds\n";
+    return c;
+}
+
+identify_filenames::counts identify_filenames::annotate_files(const std::filesystem::path &report_dir,
+                                                              const std::filesystem::path &outdir,
+                                                              const std::vector<std::string> &names, bool context,
+                                                              unsigned threads, const std::string &command_line) const
+{
+    std::vector<std::filesystem::path> txts;
+    if (names.empty()) {
+        for (const auto &txt : output_text_files(report_dir, true)) {
+            if (txt.filename() != "tcp.txt") txts.push_back(txt);   // not needed
+        }
+    } else {
+        for (const auto &name : names) txts.push_back(report_dir / name);
+    }
+    std::filesystem::create_directories(outdir);
+    for (const auto &txt : txts) {
+        if (std::filesystem::exists(outdir / ("annotated_" + txt.filename().string()))) {
+            throw std::runtime_error("identify_filenames: " + (outdir / ("annotated_" + txt.filename().string())).string() + " exists");
+        }
+    }
+    std::mutex M;
+    counts total;
+    for_each_file(txts, threads, [&](const std::filesystem::path &txt) {
+        const auto annotated = outdir / ("annotated_" + txt.filename().string());
+        std::ofstream out(annotated, std::ios::binary);
+        if (!out) throw std::runtime_error("identify_filenames: cannot create " + annotated.string());
+        const counts c = annotate(txt, out, context, command_line);
+        out.close();
+        if (!out) throw std::runtime_error("identify_filenames: cannot write " + annotated.string());
+        std::lock_guard<std::mutex> lock(M);
+        total += c;
+    });
+    return total;
+}
+
+int identify_filenames::main(int argc, char * const *argv, std::ostream &out, std::ostream &err)
+{
+    bool context = true;
+    std::vector<std::string> names, args;
+    std::string path;
+    std::string command_line = "bulk_extractor";
+    for (int i = 0; i < argc; i++) command_line += std::string(" ") + argv[i];
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0) context = false;
+        else if (strcmp(argv[i], "--featurefiles") == 0 && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            for (std::string name; std::getline(ss, name, ',');) {
+                if (!name.empty()) names.push_back(name);
+            }
+        }
+        else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) path = argv[++i];
+        else args.push_back(argv[i]);
+    }
+    if (path.empty() ? args.size() != 3 : args.size() != 1) {
+        err << "usage: bulk_extractor --identify-filenames [-t] [--featurefiles A,B] DFXML REPORT_DIR OUTDIR\n"
+            << "       bulk_extractor --identify-filenames --path PATH DFXML\n";
+        return 1;
+    }
+    try {
+        const identify_filenames map = read_dfxml(args[0]);
+        if (!path.empty()) {
+            uint64_t offset = 0;
+            const file_info *f = offset_of(path, offset) ? map.locate(offset) : nullptr;
+            if (f) out << "File Name: " << f->filename << "\nFile MD5:  " << f->md5 << "\n";
+            else out << "NOT FOUND\n";
+            return 0;
+        }
+        const counts c = map.annotate_files(args[1], args[2], names, context,
+                                            std::max(std::thread::hardware_concurrency(), 1U), command_line);
+        out << "Total Features: " << c.features << "\n"
+            << "Total Located:  " << c.located << "\n";
+    } catch (const std::exception &e) {
+        err << "bulk_extractor: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef IDENTIFY_FILENAMES_H
+#define IDENTIFY_FILENAMES_H
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * identify_filenames:
+ * The file that each feature was found in, from the byte runs of a DFXML file map (made by fiwalk),
+ * as python/identify_filenames.py does, but with the runs in sorted arrays searched in O(log n) and
+ * the feature files annotated in parallel:
+ *
+ *   bulk_extractor --identify-filenames [-t] [--featurefiles A,B] [--path PATH] DFXML REPORT_DIR OUTDIR
+ *
+ * writes OUTDIR/annotated_NAME.txt for each feature file of REPORT_DIR (or those named): its lines with
+ * the filename and MD5 of the file at the offset of each feature added, and the totals at the end.
+ * The files of unallocated fileobjects are prefixed with *, and searched only if no allocated one is
+ * found. The offset of a path is its leading image offset, plus the offset in the buffer if the next
+ * part is XOR (which does not move the bytes).
+ *
+ * With -S identify_filenames=DFXML, the file map is read while the image is scanned, and the
+ * annotated files are written to OUTDIR/annotated at the end of phase 2.
+ */
+
+class identify_filenames {
+public:
+    struct file_info {
+        std::string filename {};
+        std::string md5 {};
+    };
+
+    /* The runs of the files, sorted by start; the end of each that reach furthest, so that a
+     * search for an offset can step over the runs that end before it */
+    class run_index {
+    public:
+        struct run {
+            uint64_t start;
+            uint64_t end;                   // one after the last byte
+            uint32_t file;
+        };
+        void add(uint64_t start, uint64_t len, uint32_t file);
+        void finish();                      // after the last add(), before find()
+        /* The run with the latest start that holds offset, or nullptr */
+        const run *find(uint64_t offset) const;
+        size_t size() const { return runs.size(); }
+    private:
+        std::vector<run> runs {};
+        std::vector<uint64_t> max_end {};   // the largest end of runs[0..i]
+    };
+
+    struct counts {
+        uint64_t features {0};
+        uint64_t located {0};
+        uint64_t unallocated {0};           // not located to a file
+        uint64_t encoded {0};               // in a decoded buffer (the path has more than an offset)
+        counts &operator+=(const counts &that);
+    };
+
+    std::vector<file_info> files {};
+    run_index allocated {};
+    run_index unallocated {};
+
+    /* Throws std::runtime_error if the file cannot be read or has no byte runs */
+    static identify_filenames read_dfxml(const std::filesystem::path &dfxml);
+    void read_dfxml(std::istream &in);
+
+    /* The offset in the image of a forensic path; false if it does not start with one */
+    static bool offset_of(std::string_view path, uint64_t &offset);
+    /* The file at offset (allocated first), or nullptr */
+    const file_info *locate(uint64_t offset) const;
+
+    /* Writes the annotated lines of txt to out; without context, the context column is left out */
+    counts annotate(const std::filesystem::path &txt, std::ostream &out, bool context,
+                    const std::string &command_line) const;
+    /* Writes outdir/annotated_NAME.txt for each of the feature files (all those in report_dir but
+     * tcp.txt if names is empty) in up to threads threads. Throws std::runtime_error if one exists. */
+    counts annotate_files(const std::filesystem::path &report_dir, const std::filesystem::path &outdir,
+                          const std::vector<std::string> &names, bool context, unsigned threads,
+                          const std::string &command_line) const;
+
+    /* argv[0] is "--identify-filenames"; returns the exit status */
+    static int main(int argc, char * const *argv, std::ostream &out, std::ostream &err);
+};
+
+#endif
@@ -5,6 +5,7 @@
  *   - process_ewf (if libewf is installed)
  *   - process_raw (using std::iostream's 64-bit support.
  *   - process_dir (for scanning files in a directory
+ *   - process_vdisk (VMDK, VHDX and QCOW2, with virtual_disk)
  */
 
 #include "config.h"
@@ -25,15 +26,48 @@
 #include <sys/fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+/* The block device ioctls of linux/fs.h, whose BLOCK_SIZE macro would clash with process_http's */
+#if defined(__linux__) && defined(HAVE_SYS_IOCTL_H)
+#define BLKSSZGET     _IO(0x12,104)
+#define BLKGETSIZE64  _IOR(0x12,114,size_t)
+#define BLKPBSZGET    _IO(0x12,123)
+#define BLKROTATIONAL _IO(0x12,126)
+#endif
+
+#ifdef HAVE_SYS_DISK_H
+#include <sys/disk.h>
+#endif
+
+#include <fcntl.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 #ifndef PATH_MAX
 #define PATH_MAX 65536
 #endif
 
 #include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <stdexcept>
 #include <functional>
+#include <fstream>
+#include <sstream>
 #include <locale>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "be13_api/utf8.h"
@@ -41,6 +75,7 @@
 #include "be13_api/aftimer.h"
 #include "be13_api/formatter.h"
 #include "image_process.h"
+#include "page_allocator.h"
 
 /****************************************************************
  *** static functions
@@ -61,6 +96,46 @@ std::filesystem::path image_process::image_fname() const
     return image_fname_;
 }
 
+bool image_process::is_url(const std::string &fname)
+{
+    return fname.substr(0,7)=="http://" || fname.substr(0,8)=="https://" || fname.substr(0,5)=="s3://";
+}
+
+bool image_process::is_synthetic(const std::string &fname)
+{
+    return synthetic_image::is_synthetic(fname);
+}
+
+/**
+ * Sequential pages overlap by the margin, so reading each page in full reads (and for E01,
+ * decompresses) the margin twice. The margin of the last page read is kept, and a read that starts
+ * where it starts copies it instead. With several readers, a page is only helped if the
+ * page before it has finished.
+ */
+ssize_t image_process::read_page(uint8_t *buf, size_t count, size_t this_pagesize, uint64_t offset) const
+{
+    size_t reused = 0;
+    {
+        std::lock_guard<std::mutex> lock(Mmargin);
+        if (!margin_buf.empty() && margin_offset==offset) {
+            reused = std::min(margin_buf.size(), count);
+            memcpy(buf, margin_buf.data(), reused);
+        }
+    }
+    ssize_t count_read = reused;
+    if (reused < count) {
+        ssize_t bytes_read = this->pread(buf + reused, count - reused, offset + reused);
+        if (bytes_read<0) return bytes_read;
+        count_read += bytes_read;
+    }
+    if (static_cast<size_t>(count_read) > this_pagesize) {
+        std::lock_guard<std::mutex> lock(Mmargin);
+        margin_buf.assign(buf + this_pagesize, buf + count_read);
+        margin_offset = offset + this_pagesize;
+    }
+    return count_read;
+}
+
 
 
 bool image_process::fn_ends_with(std::filesystem::path path, std::string suffix)
@@ -166,10 +241,15 @@ void process_ewf::local_e01_glob(std::filesystem::path fname,char ***libewf_file
 process_ewf::~process_ewf()
 {
 #ifdef HAVE_LIBEWF_HANDLE_CLOSE
-    if (handle){
-	libewf_handle_close(handle,NULL);
-	libewf_handle_free(&handle,NULL);
+    /* handle is one of these */
+    for (auto &it : thread_handles) spare_handles.push_back(it.second);
+    thread_handles.clear();
+    for (auto h : spare_handles) {
+	libewf_handle_close(h,NULL);
+	libewf_handle_free(&h,NULL);
     }
+    spare_handles.clear();
+    handle = nullptr;
 #else
     if (handle){
 	libewf_close(handle);
@@ -196,6 +276,7 @@ int process_ewf::open()
     }
     for(int i=0;i<amount_of_filenames;i++){
         std::cout << "opening " << libewf_filenames[i] << std::endl;
+        segment_filenames.push_back(libewf_filenames[i]);
     }
 
     if (libewf_handle_initialize(&handle, nullptr) <0 ){
@@ -215,6 +296,9 @@ int process_ewf::open()
         throw image_process::NoSuchFile("libewf_glob_free");
     }
     libewf_handle_get_media_size(handle,static_cast<size64_t *>(&ewf_filesize), NULL);
+    size32_t cs = 0;
+    if (libewf_handle_get_chunk_size(handle, &cs, NULL) == 1) chunk_size = cs;
+    spare_handles.push_back(handle);
 #else
     amount_of_filenames = libewf_glob(fname,strlen(fname),LIBEWF_FORMAT_UNKNOWN,&libewf_filenames);
     if (amount_of_filenames<0){
@@ -268,15 +352,64 @@ std::vector<std::string> process_ewf::getewfdetails() const
 }
 
 
-ssize_t process_ewf::pread(void *buf,size_t bytes,uint64_t offset) const
+#ifdef HAVE_LIBEWF_HANDLE_CLOSE
+/* Open another handle on the same segment files, for a concurrent reader */
+libewf_handle_t *process_ewf::open_handle() const
+{
+    libewf_handle_t *h = nullptr;
+    libewf_error_t *error=0;
+    std::vector<char *> filenames;
+    for (const auto &fn : segment_filenames) {
+        filenames.push_back(const_cast<char *>(fn.c_str()));
+    }
+    if (libewf_handle_initialize(&h, nullptr) <0 ){
+	throw image_process::NoSuchFile("Cannot initialize EWF handle?");
+    }
+    if (libewf_handle_open(h, filenames.data(), filenames.size(), LIBEWF_OPEN_READ, &error) <0 ){
+	if (error) libewf_error_fprint(error, stderr);
+        libewf_error_free(&error);
+        libewf_handle_free(&h, NULL);
+	throw image_process::NoSuchFile( image_fname().string() );
+    }
+    return h;
+}
+#endif
+
+/* The calling thread's handle: a spare one, or a new one on the same segment files */
+libewf_handle_t *process_ewf::thread_handle() const
+{
+    const std::thread::id id = std::this_thread::get_id();
+    {
+        std::lock_guard<std::mutex> lock(Mhandles);
+        auto it = thread_handles.find(id);
+        if (it != thread_handles.end()) return it->second;
+        if (!spare_handles.empty()) {
+            libewf_handle_t *h = spare_handles.back();
+            spare_handles.pop_back();
+            thread_handles[id] = h;
+            return h;
+        }
+    }
+#ifdef HAVE_LIBEWF_HANDLE_CLOSE
+    libewf_handle_t *h = open_handle(); // outside the lock
+    std::lock_guard<std::mutex> lock(Mhandles);
+    thread_handles[id] = h;
+    return h;
+#else
+    throw std::runtime_error("process_ewf: concurrent reads require libewf_handle_close");
+#endif
+}
+
+ssize_t process_ewf::read_handle(void *buf, size_t bytes, uint64_t offset) const
 {
 #ifdef HAVE_LIBEWF_HANDLE_CLOSE
     libewf_error_t *error=0;
+    libewf_handle_t *h = thread_handle();
 #if defined(HAVE_LIBEWF_HANDLE_READ_RANDOM)
-    int ret = libewf_handle_read_random(handle,buf,bytes,offset,&error);
+    int ret = libewf_handle_read_random(h,buf,bytes,offset,&error);
 #endif
 #if defined(HAVE_LIBEWF_HANDLE_READ_BUFFER_AT_OFFSET) && !defined(HAVE_LIBEWF_HANDLE_READ_RANDOM)
-    int ret = libewf_handle_read_buffer_at_offset(handle,buf,bytes,offset,&error);
+    int ret = libewf_handle_read_buffer_at_offset(h,buf,bytes,offset,&error);
 #endif
     if (ret<0){
 	if (report_read_errors) libewf_error_fprint(error,stderr);
@@ -284,6 +417,7 @@ ssize_t process_ewf::pread(void *buf,size_t bytes,uint64_t offset) const
     }
     return ret;
 #else
+    std::lock_guard<std::mutex> lock(Mhandles); // the old API has a single handle
     if ((int64_t)bytes+offset > (int64_t)ewf_filesize) {
 	bytes = ewf_filesize - offset;
     }
@@ -291,6 +425,74 @@ ssize_t process_ewf::pread(void *buf,size_t bytes,uint64_t offset) const
 #endif
 }
 
+process_ewf::chunk_t process_ewf::cached_chunk(uint64_t chunk) const
+{
+    std::lock_guard<std::mutex> lock(Mchunks);
+    auto it = chunks.find(chunk);
+    if (it == chunks.end()) return nullptr;
+    chunk_lru.splice(chunk_lru.begin(), chunk_lru, it->second);
+    return it->second->second;
+}
+
+void process_ewf::cache_chunk(uint64_t chunk, chunk_t data) const
+{
+    std::lock_guard<std::mutex> lock(Mchunks);
+    if (chunks.count(chunk)) return;    // another thread read it too
+    chunk_lru.emplace_front(chunk, data);
+    chunks[chunk] = chunk_lru.begin();
+    chunks_bytes += data->size();
+    while (chunks_bytes > chunk_cache_bytes && !chunk_lru.empty()) {
+        chunks_bytes -= chunk_lru.back().second->size();
+        chunks.erase(chunk_lru.back().first);
+        chunk_lru.pop_back();
+    }
+}
+
+/**
+ * Read from the EWF file. The chunks that are in the chunk cache are copied from it; each run of
+ * chunks that is not is read whole with the thread's handle, copied out, and cached.
+ */
+ssize_t process_ewf::pread(void *buf,size_t bytes,uint64_t offset) const
+{
+    if (offset >= ewf_filesize) return 0;
+    bytes = std::min<uint64_t>(bytes, ewf_filesize - offset);
+    if (chunk_size == 0 || chunk_cache_bytes == 0) return read_handle(buf, bytes, offset);
+
+    uint8_t *out = static_cast<uint8_t *>(buf);
+    const uint64_t end = offset + bytes;
+    uint64_t chunk = offset / chunk_size;
+    while (chunk * chunk_size < end) {
+        if (chunk_t data = cached_chunk(chunk)) {
+            chunk_hits++;
+            const uint64_t start = std::max(offset, chunk * chunk_size);
+            const uint64_t stop  = std::min(end, chunk * chunk_size + data->size());
+            if (stop <= start) break;    // a short chunk at the end of the image
+            memcpy(out + (start - offset), data->data() + (start - chunk * chunk_size), stop - start);
+            chunk++;
+            continue;
+        }
+        uint64_t last = chunk + 1; // the run of chunks that are not cached
+        while (last * chunk_size < end && !cached_chunk(last)) last++;
+        const uint64_t run_start = chunk * chunk_size;
+        const uint64_t run_end   = std::min(last * chunk_size, uint64_t(ewf_filesize));
+        std::vector<uint8_t> run(run_end - run_start);
+        const ssize_t got = read_handle(run.data(), run.size(), run_start);
+        if (got < 0) return got;
+        chunk_misses += last - chunk;
+        const uint64_t copy_start = std::max(offset, run_start);
+        const uint64_t copy_end   = std::min(end, run_start + got);
+        if (copy_end > copy_start) memcpy(out + (copy_start - offset), run.data() + (copy_start - run_start), copy_end - copy_start);
+        for (uint64_t c = chunk; c < last && (c - chunk) * chunk_size < uint64_t(got); c++) {
+            const uint64_t c_start = (c - chunk) * chunk_size;
+            const uint64_t c_end   = std::min<uint64_t>(c_start + chunk_size, got);
+            cache_chunk(c, std::make_shared<const std::vector<uint8_t>>(run.begin() + c_start, run.begin() + c_end));
+        }
+        if (run_start + got < run_end) return copy_end > offset ? copy_end - offset : 0; // short read
+        chunk = last;
+    }
+    return bytes;
+}
+
 int64_t process_ewf::image_size() const
 {
     return ewf_filesize;
@@ -334,7 +536,8 @@ sbuf_t *process_ewf::sbuf_alloc(image_process::iterator &it) const
 
     auto sbuf = sbuf_t::sbuf_malloc(get_pos0(it), count, this_pagesize);
     unsigned char *buf = static_cast<unsigned char *>(sbuf->malloc_buf());
-    int count_read = this->pread(buf, count, it.raw_offset);
+    page_allocator::advise(buf, count);
+    int count_read = this->read_page(buf, count, this_pagesize, it.raw_offset);
     if (count_read<0){
         delete sbuf;
 	throw read_error();
@@ -383,326 +586,1689 @@ uint64_t process_ewf::seek_block(image_process::iterator &it,uint64_t block) con
 
 
 /****************************************************************
- *** RAW
+ *** HTTP
  ****************************************************************/
 
-process_raw::process_raw(std::filesystem::path fname, size_t pagesize_, size_t margin_)
-    :image_process(fname, pagesize_, margin_)
+#ifdef HAVE_LIBCURL
+/**
+ * The image is read in BLOCK_SIZE range requests. Several blocks are fetched at once: a page
+ * covers several blocks, the reader threads read several pages, and moving the iterator starts fetching
+ * the page after it. If a cache directory is set, blocks are also written there, so that a restart
+ * or a second run does not fetch them again.
+ *
+ * Objects in S3 need to be public, or named with a presigned https:// URL.
+ */
+process_http::process_http(std::filesystem::path fname, size_t pagesize_, size_t margin_):
+    image_process(fname, pagesize_, margin_), url(fname.string())
 {
+    if (url.substr(0,5)=="s3://") url = s3_to_https(url);
 }
 
-process_raw::~process_raw()
+process_http::~process_http()
 {
-    file_list.clear();
+    for (auto &it : blocks) {
+        if (it.second.valid()) it.second.wait(); // don't free handles out from under a fetch
+    }
+    for (auto h : spare_handles) curl_easy_cleanup(h);
 }
 
-/* If we are running on WIN32 and we've been asked to process a raw device, get its "Drive Geometry" to figure out how big it is.
- */
-#ifdef _WIN32
-BOOL GetDriveGeometry(const wchar_t *wszPath, DISK_GEOMETRY *pdg)
+std::string process_http::s3_to_https(const std::string &s3url)
 {
-    HANDLE hDevice = INVALID_HANDLE_VALUE;  // handle to the drive to be examined
-    BOOL bResult   = FALSE;                 // results flag
-    DWORD junk     = 0;                     // discard results
-
-    hDevice = CreateFileW(wszPath,          // drive to open
-                          0,                // no access to the drive
-                          FILE_SHARE_READ | // share mode
-                          FILE_SHARE_WRITE,
-                          NULL,             // default security attributes
-                          OPEN_EXISTING,    // disposition
-                          0,                // file attributes
-                          NULL);            // do not copy file attributes
+    std::string path = s3url.substr(5);
+    size_t slash = path.find('/');
+    if (slash==std::string::npos) throw NoSuchFile(s3url + ": no object key");
+    const char *endpoint = getenv("AWS_ENDPOINT_URL");
+    if (endpoint) {                     // path-style, for S3-compatible stores
+        return std::string(endpoint) + "/" + path;
+    }
+    return "https://" + path.substr(0, slash) + ".s3.amazonaws.com" + path.substr(slash);
+}
 
-    if (hDevice == INVALID_HANDLE_VALUE){    // cannot open the drive
-        throw image_process::NoSuchFile("GetDriveGeometry: Cannot open drive");
+CURL *process_http::acquire_handle() const
+{
+    {
+        std::lock_guard<std::mutex> lock(Mhandles);
+        if (!spare_handles.empty()) {
+            CURL *h = spare_handles.back();
+            spare_handles.pop_back();
+            return h;
+        }
     }
+    CURL *h = curl_easy_init();
+    if (h==nullptr) throw std::runtime_error("curl_easy_init failed");
+    return h;
+}
 
-    bResult = DeviceIoControl(hDevice,                       // device to be queried
-                              IOCTL_DISK_GET_DRIVE_GEOMETRY, // operation to perform
-                              NULL, 0,                       // no input buffer
-                              pdg, sizeof(*pdg),            // output buffer
-                              &junk,                         // # bytes returned
-                              (LPOVERLAPPED) NULL);          // synchronous I/O
+void process_http::release_handle(CURL *h) const
+{
+    std::lock_guard<std::mutex> lock(Mhandles);
+    spare_handles.push_back(h);
+}
 
-    CloseHandle(hDevice);
-    return (bResult);
+namespace {
+    /* The body of one range request. A server that ignores the range would send the whole image,
+     * so the transfer is stopped as soon as it is not a 206, or is longer than the range. */
+    struct http_range_body {
+        CURL     *h {nullptr};
+        uint64_t len {0};
+        long     code {0};              // the status, once the body has started
+        std::vector<uint8_t> buf {};
+    };
 }
-#endif
 
-/**
- * Add the file to the list, keeping track of the total size
- * https://docs.microsoft.com/en-us/windows/win32/devio/calling-deviceiocontrol
- */
-void process_raw::add_file(std::filesystem::path path)
+static size_t http_write_callback(char *ptr, size_t size, size_t nmemb, void *userdata)
 {
-    int64_t path_filesize = std::filesystem::file_size(path);
-
-#ifdef _WIN32
-    if (path_filesize==0){
-        /* On Windows, see if we can use this */
-        std::cout << path << " checking physical drive" << std::endl;
-        DISK_GEOMETRY pdg = { 0 }; // disk drive geometry structure
-        std::wstring wszDrive = safe_utf8to16(path.string());
-        GetDriveGeometry(wszDrive.c_str(), &pdg);
-        path_filesize = pdg.Cylinders.QuadPart
-            * (ULONG)pdg.TracksPerCylinder
-            * (ULONG)pdg.SectorsPerTrack
-            * (ULONG)pdg.BytesPerSector;
-    }
-#endif
-    file_list.push_back( std::shared_ptr<process_raw::file_info>(new file_info(path, raw_filesize, path_filesize)));
-    raw_filesize += path_filesize;
+    auto *body = static_cast<http_range_body *>(userdata);
+    const size_t n = size*nmemb;
+    if (body->code==0) curl_easy_getinfo(body->h, CURLINFO_RESPONSE_CODE, &body->code);
+    if (body->code!=206 || n > body->len - body->buf.size()) return 0; // aborts the transfer
+    body->buf.insert(body->buf.end(), ptr, ptr + n);
+    return n;
 }
 
-/*
- * This currently performs a linear search through the file list. It is not efficient, but it is reliable.
- * We could use a clever data structure, but then we would need to debug it.
- */
-const std::shared_ptr<process_raw::file_info> process_raw::find_offset(uint64_t pos) const
+/* GET [start, start+len). Servers that ignore the range header would send the whole image, so only 206 is accepted. */
+std::vector<uint8_t> process_http::get_range(uint64_t start, uint64_t len) const
 {
-    for (const auto &it:file_list) {
-	if (it->offset<=pos && pos<it->offset + it->length) {
-	    return it;
-	}
+    std::string range = std::to_string(start) + "-" + std::to_string(start + len - 1);
+    std::string last_error;
+    for (unsigned int retry=0; retry<MAX_RETRIES; retry++) {
+        http_range_body body;
+        body.len = len;
+        body.buf.reserve(len);
+        CURL *h = acquire_handle();
+        body.h = h;
+        curl_easy_reset(h);
+        curl_easy_setopt(h, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(h, CURLOPT_RANGE, range.c_str());
+        curl_easy_setopt(h, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(h, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, http_write_callback);
+        curl_easy_setopt(h, CURLOPT_WRITEDATA, &body);
+        CURLcode res = curl_easy_perform(h);
+        long code = 0;
+        curl_easy_getinfo(h, CURLINFO_RESPONSE_CODE, &code);
+        release_handle(h);
+        if (res==CURLE_OK && code==206 && body.buf.size()==len) return std::move(body.buf);
+        if (code==200) throw NoSupport(url + ": server does not support range requests");
+        last_error = (res==CURLE_WRITE_ERROR && code==206) ? "response longer than the range"
+            : (res!=CURLE_OK && res!=CURLE_WRITE_ERROR) ? curl_easy_strerror(res) : ("HTTP " + std::to_string(code));
+        std::cerr << "range " << range << " of " << url << ": " << last_error << "; retrying" << std::endl;
     }
-    return 0;
+    throw ReadError();
 }
 
-/**
- * Open the first image and, optionally, all of the others.
- */
-int process_raw::open()
+std::filesystem::path process_http::cache_path(uint64_t block) const
 {
-    add_file(image_fname());
+    std::stringstream ss;
+    ss << std::hex << std::hash<std::string>{}(url);
+    return cache_dir / ss.str() / std::to_string(block);
+}
 
-    /* Get the list of the files if this is a split-raw file */
-    if (is_multipart_file(image_fname())){
-	int num=0;
-        std::string templ = make_list_template(image_fname(),&num);
-	for(;;num++){
-	    char probename[PATH_MAX];
-	    snprintf(probename, sizeof(probename), templ.c_str(), num);
-            std::filesystem::path probe_path = probename;
-            // If the file exists, add it, otherwise break.
-            if (std::filesystem::exists( std::filesystem::path( probename ))) {
-                add_file(std::filesystem::path(probename));
-            } else {
-                break;
-            }
-	}
+process_http::block_t process_http::fetch_block(uint64_t block) const
+{
+    uint64_t start = block * BLOCK_SIZE;
+    uint64_t len = std::min(BLOCK_SIZE, http_filesize - start);
+    if (!cache_dir.empty()) {
+        std::filesystem::path fname = cache_path(block);
+        std::error_code ec;
+        if (std::filesystem::file_size(fname, ec)==len && !ec) {
+            auto buf = std::make_shared<std::vector<uint8_t>>(len);
+            std::ifstream in(fname, std::ios::binary);
+            if (in.read(reinterpret_cast<char *>(buf->data()), len)) return buf;
+        }
+        auto buf = std::make_shared<const std::vector<uint8_t>>(get_range(start, len));
+        std::filesystem::create_directories(fname.parent_path(), ec);
+        std::filesystem::path tmp = fname.string() + ".tmp";
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(buf->data()), buf->size());
+        out.close();
+        if (out.good()) std::filesystem::rename(tmp, fname, ec); // a failed cache write is not an error
+        return buf;
     }
-    return 0;
+    return std::make_shared<const std::vector<uint8_t>>(get_range(start, len));
 }
 
-/* Return the size of all the images */
-int64_t process_raw::image_size() const
+/* True if f has finished with an exception */
+static bool fetch_failed(const std::shared_future<std::shared_ptr<const std::vector<uint8_t>>> &f)
 {
-    return raw_filesize;
+    if (f.wait_for(std::chrono::seconds(0))!=std::future_status::ready) return false;
+    try {
+        f.get();
+    } catch (...) {
+        return true;
+    }
+    return false;
 }
 
-
-/**
- * Read randomly between a split file.
- * 1. Determine which file to read and how many bytes from that file can be read.
- * 2. Perform the read.
- * 3. If there are additional files to read in the next file, recurse.
- * NOTE: This code is single-threaded because we are seeking the fstreams.
+/* A block whose fetch failed is fetched again by the next reader that asks for it. Prefetches are not
+ * started while MAX_FETCHES are in flight, so the fetches (and their threads) are bounded by that and
+ * by the readers, each of which waits for one block at a time.
  */
-
-ssize_t process_raw::pread(void *buf, size_t bytes, uint64_t offset) const
+std::shared_future<process_http::block_t> process_http::get_block(uint64_t block, bool prefetching) const
 {
-    std::shared_ptr<file_info> fi = find_offset(offset);
-    if (fi==0) return 0;			// nothing to read.
-
-    // make sure that the offset falls within the selection.
-    assert(offset >= fi->offset);
-    assert(offset <  fi->offset + fi->length);
-
-    // Determine the offset and available bytes in the segment
-    uint64_t file_offset = offset - fi->offset;
-    uint64_t available_bytes = fi->length - file_offset;
+    std::lock_guard<std::mutex> lock(Mblocks);
+    auto it = blocks.find(block);
+    if (it!=blocks.end() && !fetch_failed(it->second)) return it->second;
+    if (prefetching && fetching >= MAX_FETCHES) return std::shared_future<block_t>();
+    fetching++;
+    std::shared_future<block_t> f = std::async(std::launch::async, [this, block]{
+        struct done { std::atomic<unsigned> &n; ~done() { n--; } } d {fetching};
+        return fetch_block(block);
+    }).share();
+    blocks[block] = f;
+    return f;
+}
 
-    size_t bytes_to_read = bytes;
-    if (bytes_to_read > available_bytes) {
-        bytes_to_read = available_bytes;
+void process_http::prefetch(uint64_t offset, uint64_t len) const
+{
+    if (offset >= http_filesize) return;
+    uint64_t last = (std::min(offset + len, http_filesize) - 1) / BLOCK_SIZE;
+    for (uint64_t b = offset / BLOCK_SIZE; b <= last; b++) {
+        get_block(b, true);
     }
-#ifdef _DEBUG_
-    std::cerr << fi->path
-              << " pread bytes=" << bytes
-              << " offset=" << offset
-              << " file_offset=" << file_offset
-              << " available_bytes=" << available_bytes
-              << " bytes_to_read=" << bytes_to_read << std::endl;
-#endif
-
+}
 
-    fi->stream.seekg( file_offset );
-    if (fi->stream.rdstate() & (std::ios::failbit|std::ios::badbit)){
-        throw SeekError();
+/* Blocks behind the oldest page still being read will not be read again; the reader threads and
+ * read-ahead keep pages in flight, so a few pages' worth are kept.
+ */
+void process_http::evict(uint64_t keep_from) const
+{
+    std::lock_guard<std::mutex> lock(Mblocks);
+    while (!blocks.empty() && blocks.begin()->first < keep_from) {
+        auto &f = blocks.begin()->second;
+        if (f.wait_for(std::chrono::seconds(0))!=std::future_status::ready) break;
+        blocks.erase(blocks.begin());
     }
+}
 
-    aftimer t;
-    t.start();
-    fi->stream.read(reinterpret_cast<char *>(buf), bytes_to_read);
-    t.stop();
-
-    if (fi->stream.rdstate() & std::ios::failbit){
-        std::cerr << "read error  failbit bytes=" << bytes << std::endl;
-        throw ReadError();
-    }
-    if (fi->stream.rdstate() & std::ios::badbit){
-        std::cerr << "read error  badbit bytes=" << bytes << std::endl;
-        throw ReadError();
-    }
-    if (fi->stream.rdstate() & (std::ios::eofbit)){
-        std::cerr << "read error  eof bytes=" << bytes << std::endl;
-        throw EndOfImage();
+int process_http::open()
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    CURL *h = acquire_handle();
+    curl_easy_setopt(h, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(h, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(h, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(h, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+    CURLcode res = curl_easy_perform(h);
+    curl_off_t length = -1;
+    curl_easy_getinfo(h, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    release_handle(h);
+    if (res!=CURLE_OK) {
+        std::cerr << url << ": " << curl_easy_strerror(res) << std::endl;
+        throw NoSuchFile(url);
     }
+    if (length<0) throw NoSupport(url + ": server did not report the image size");
+    http_filesize = length;
+    return 0;
+}
 
-    size_t bytes_read = bytes_to_read;  // guess we got the right amount
-
-    /* Need to recurse, which will cause the next segment to be loaded */
-    if (bytes_read==bytes) return bytes_read; // read precisely the correct amount!
-    if (bytes_read==0) return 0;              // This might happen at the end of the image; it prevents infinite recursion
-    ssize_t bytes_read2 = this->pread(static_cast<char *>(buf)+bytes_read, bytes-bytes_read, offset+bytes_read);
-    if (bytes_read2<0) return -1;	// error on second read
-    return bytes_read + bytes_read2;
+ssize_t process_http::pread(void *buf, size_t bytes, uint64_t offset) const
+{
+    if (offset >= http_filesize) return 0;
+    bytes = std::min<uint64_t>(bytes, http_filesize - offset);
+    prefetch(offset, bytes);            // start every block of the read at once
+    size_t done = 0;
+    while (done < bytes) {
+        uint64_t pos = offset + done;
+        block_t b = get_block(pos / BLOCK_SIZE).get();
+        uint64_t in_block = pos % BLOCK_SIZE;
+        size_t n = std::min<uint64_t>(bytes - done, b->size() - in_block);
+        memcpy(static_cast<uint8_t *>(buf) + done, b->data() + in_block, n);
+        done += n;
+    }
+    return done;
 }
 
+int64_t process_http::image_size() const
+{
+    return http_filesize;
+}
 
-image_process::iterator process_raw::begin() const
+image_process::iterator process_http::begin() const
 {
     image_process::iterator it(this);
     return it;
 }
 
-
-/* Returns an iterator at the end of the image */
-image_process::iterator process_raw::end() const
+image_process::iterator process_http::end() const
 {
     image_process::iterator it(this);
-    it.raw_offset = this->raw_filesize;
+    it.raw_offset = http_filesize;
     it.eof = true;
     return it;
 }
 
-/****************************************************************
- ** process_raw
- ****************************************************************/
-
-void process_raw::increment_iterator(image_process::iterator &it) const
+/* Moving the iterator starts fetching the page it moved to */
+void process_http::increment_iterator(image_process::iterator &it) const
 {
     it.raw_offset += pagesize;
-    if (it.raw_offset > this->raw_filesize) it.raw_offset = this->raw_filesize;
+    if (it.raw_offset > http_filesize) it.raw_offset = http_filesize;
+    evict(it.raw_offset > 4*pagesize ? (it.raw_offset - 4*pagesize) / BLOCK_SIZE : 0);
+    prefetch(it.raw_offset, pagesize + margin);
 }
 
-double process_raw::fraction_done(const image_process::iterator &it) const
+double process_http::fraction_done(const image_process::iterator &it) const
 {
-    return (double)it.raw_offset / (double)this->raw_filesize;
+    return (double)it.raw_offset / (double)http_filesize;
 }
 
-std::string process_raw::str(const image_process::iterator &it) const
+std::string process_http::str(const image_process::iterator &it) const
 {
     char buf[64];
     snprintf(buf,sizeof(buf),"Offset %" PRId64 "MB",it.raw_offset/1000000);
     return std::string(buf);
 }
 
-
-pos0_t process_raw::get_pos0(const image_process::iterator &it) const
+pos0_t process_http::get_pos0(const image_process::iterator &it) const
 {
     return pos0_t("",it.raw_offset);
 }
 
-/** Read from the iterator into a newly allocated sbuf.
- * uses pagesize. We don't memory map the file. Perhaps we should. But then we could only do 4K pages.
- */
-sbuf_t *process_raw::sbuf_alloc(image_process::iterator &it) const
+sbuf_t *process_http::sbuf_alloc(image_process::iterator &it) const
 {
     size_t count = pagesize + margin;
     size_t this_pagesize = pagesize;
 
-    if (this->raw_filesize < it.raw_offset + count){    /* See if that's more than I need */
-	count = this->raw_filesize - it.raw_offset;
+    if (http_filesize < it.raw_offset + count){
+	count = http_filesize - it.raw_offset;
     }
     if (this_pagesize > count ) {
         this_pagesize = count;
     }
-
-    sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), count, this_pagesize);
-    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
-    int count_read = this->pread(buf, count, it.raw_offset);       // do the read
-    if (count_read==0){
-        delete sbuf;
-	it.eof = true;
+    if (count==0) {
+        it.eof = true;
         throw EndOfImage();
     }
-    if (count_read<0){
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), count, this_pagesize);
+    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
+    page_allocator::advise(buf, count);
+    if (this->read_page(buf, count, this_pagesize, it.raw_offset) < static_cast<ssize_t>(count)) {
         delete sbuf;
-	throw read_error();
+        throw read_error();
     }
     return sbuf;
 }
 
-uint64_t process_raw::max_blocks(const image_process::iterator &it) const
+uint64_t process_http::max_blocks(const image_process::iterator &it) const
 {
-    return (this->raw_filesize+pagesize-1) / pagesize;
+    return (http_filesize+pagesize-1) / pagesize;
 }
 
-uint64_t process_raw::seek_block(image_process::iterator &it,uint64_t block) const
+/* Sampling seeks the iterator; fetch the page it will read next */
+uint64_t process_http::seek_block(image_process::iterator &it,uint64_t block) const
 {
-    if (block * pagesize > (uint64_t)raw_filesize){
-        block = raw_filesize / pagesize;
-    }
-
-    it.raw_offset = block * pagesize;
+    it.raw_offset = pagesize * block;
+    evict(it.raw_offset > 4*pagesize ? (it.raw_offset - 4*pagesize) / BLOCK_SIZE : 0);
+    prefetch(it.raw_offset, pagesize + margin);
     return block;
 }
+#endif
 
 
 /****************************************************************
- ** process_dir
- **/
+ *** SYNTHETIC
+ ****************************************************************/
 
-/**
- * directories don't get page sizes or margins; the page size is the entire
- * file and the margin is 0.
- */
-process_dir::process_dir(std::filesystem::path image_dir): image_process(image_dir,0,0)
+ssize_t process_synthetic::pread(void *buf, size_t bytes, uint64_t offset) const
 {
-    for (const auto& entry : std::filesystem::recursive_directory_iterator( image_dir )) {
-        if (entry.is_regular_file()) {
-            files.push_back( entry );
-        }
-    }
+    return image.read(static_cast<uint8_t *>(buf), bytes, offset);
 }
 
-process_dir::~process_dir()
+int64_t process_synthetic::image_size() const
 {
+    return image.size();
 }
 
-int process_dir::open()
+image_process::iterator process_synthetic::begin() const
 {
-    return 0;				// always successful
+    image_process::iterator it(this);
+    return it;
 }
 
-ssize_t process_dir::pread(void *buf,size_t bytes,uint64_t offset) const
+image_process::iterator process_synthetic::end() const
 {
-    if (bytes>0) {
-        throw std::runtime_error("process_dir does not support pread");
-    }
-    return 0;
+    image_process::iterator it(this);
+    it.raw_offset = image.size();
+    it.eof = true;
+    return it;
 }
 
-int64_t process_dir::image_size() const
+void process_synthetic::increment_iterator(image_process::iterator &it) const
 {
-    return files.size();		// the 'size' is in files
+    it.raw_offset += pagesize;
+    if (it.raw_offset > image.size()) it.raw_offset = image.size();
 }
 
-image_process::iterator process_dir::begin() const
+double process_synthetic::fraction_done(const image_process::iterator &it) const
 {
-    image_process::iterator it(this);
+    return (double)it.raw_offset / (double)image.size();
+}
+
+std::string process_synthetic::str(const image_process::iterator &it) const
+{
+    char buf[64];
+    snprintf(buf,sizeof(buf),"Offset %" PRId64 "MB",it.raw_offset/1000000);
+    return std::string(buf);
+}
+
+pos0_t process_synthetic::get_pos0(const image_process::iterator &it) const
+{
+    return pos0_t("",it.raw_offset);
+}
+
+sbuf_t *process_synthetic::sbuf_alloc(image_process::iterator &it) const
+{
+    size_t count = pagesize + margin;
+    size_t this_pagesize = pagesize;
+
+    if (image.size() < it.raw_offset + count){
+        count = image.size() - it.raw_offset;
+    }
+    if (this_pagesize > count ) {
+        this_pagesize = count;
+    }
+    if (count==0) {
+        it.eof = true;
+        throw EndOfImage();
+    }
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), count, this_pagesize);
+    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
+    page_allocator::advise(buf, count);
+    if (this->read_page(buf, count, this_pagesize, it.raw_offset) < static_cast<ssize_t>(count)) {
+        delete sbuf;
+        throw read_error();
+    }
+    return sbuf;
+}
+
+uint64_t process_synthetic::max_blocks(const image_process::iterator &it) const
+{
+    return (image.size()+pagesize-1) / pagesize;
+}
+
+uint64_t process_synthetic::seek_block(image_process::iterator &it,uint64_t block) const
+{
+    it.raw_offset = pagesize * block;
+    return block;
+}
+
+
+/****************************************************************
+ *** VIRTUAL DISK
+ ****************************************************************/
+
+process_vdisk::~process_vdisk()
+{
+    free(zero_buf);
+}
+
+int process_vdisk::open()
+{
+    disk = std::make_unique<virtual_disk>(image_fname());
+    zero_buf = static_cast<uint8_t *>(calloc(pagesize + margin, 1));
+    return zero_buf ? 0 : -1;
+}
+
+ssize_t process_vdisk::pread(void *buf, size_t bytes, uint64_t offset) const
+{
+    return disk->read(static_cast<uint8_t *>(buf), bytes, offset);
+}
+
+int64_t process_vdisk::image_size() const
+{
+    return disk->size();
+}
+
+image_process::iterator process_vdisk::begin() const
+{
+    image_process::iterator it(this);
+    return it;
+}
+
+image_process::iterator process_vdisk::end() const
+{
+    image_process::iterator it(this);
+    it.raw_offset = disk->size();
+    it.eof = true;
+    return it;
+}
+
+void process_vdisk::increment_iterator(image_process::iterator &it) const
+{
+    it.raw_offset += pagesize;
+    if (it.raw_offset > disk->size()) it.raw_offset = disk->size();
+}
+
+double process_vdisk::fraction_done(const image_process::iterator &it) const
+{
+    return (double)it.raw_offset / (double)disk->size();
+}
+
+std::string process_vdisk::str(const image_process::iterator &it) const
+{
+    char buf[64];
+    snprintf(buf,sizeof(buf),"Offset %" PRId64 "MB",it.raw_offset/1000000);
+    return std::string(buf);
+}
+
+pos0_t process_vdisk::get_pos0(const image_process::iterator &it) const
+{
+    return pos0_t("",it.raw_offset);
+}
+
+/* A page and margin with no stored block is a view of zero_buf; nothing is read */
+sbuf_t *process_vdisk::sbuf_alloc(image_process::iterator &it) const
+{
+    size_t count = pagesize + margin;
+    size_t this_pagesize = pagesize;
+
+    if (disk->size() < it.raw_offset + count){
+        count = disk->size() - it.raw_offset;
+    }
+    if (this_pagesize > count ) {
+        this_pagesize = count;
+    }
+    if (count==0) {
+        it.eof = true;
+        throw EndOfImage();
+    }
+    if (!disk->stored(it.raw_offset, count)) {
+        return sbuf_t::sbuf_new( get_pos0(it), zero_buf, count, this_pagesize);
+    }
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), count, this_pagesize);
+    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
+    page_allocator::advise(buf, count);
+    if (this->read_page(buf, count, this_pagesize, it.raw_offset) < static_cast<ssize_t>(count)) {
+        delete sbuf;
+        throw read_error();
+    }
+    return sbuf;
+}
+
+uint64_t process_vdisk::max_blocks(const image_process::iterator &it) const
+{
+    return (disk->size()+pagesize-1) / pagesize;
+}
+
+uint64_t process_vdisk::seek_block(image_process::iterator &it,uint64_t block) const
+{
+    if (block * pagesize > disk->size()){
+        block = disk->size() / pagesize;
+    }
+    it.raw_offset = block * pagesize;
+    return block;
+}
+
+
+/****************************************************************
+ *** MEMORY DUMP
+ ****************************************************************/
+
+process_memdump::~process_memdump()
+{
+    free(zero_buf);
+}
+
+int process_memdump::open()
+{
+    dump = std::make_unique<memory_dump>(image_fname());
+    zero_buf = static_cast<uint8_t *>(calloc(pagesize + margin, 1));
+    return zero_buf ? 0 : -1;
+}
+
+ssize_t process_memdump::pread(void *buf, size_t bytes, uint64_t offset) const
+{
+    return dump->read(static_cast<uint8_t *>(buf), bytes, offset);
+}
+
+int64_t process_memdump::image_size() const
+{
+    return dump->size();
+}
+
+uint64_t process_memdump::first_page(uint64_t addr) const
+{
+    const uint64_t next = dump->next_stored(addr);
+    return next >= dump->size() ? dump->size() : next / pagesize * pagesize;
+}
+
+image_process::iterator process_memdump::begin() const
+{
+    image_process::iterator it(this);
+    it.raw_offset = first_page(0);
+    return it;
+}
+
+image_process::iterator process_memdump::end() const
+{
+    image_process::iterator it(this);
+    it.raw_offset = dump->size();
+    it.eof = true;
+    return it;
+}
+
+void process_memdump::increment_iterator(image_process::iterator &it) const
+{
+    it.raw_offset = first_page(std::min(it.raw_offset + pagesize, dump->size()));
+}
+
+double process_memdump::fraction_done(const image_process::iterator &it) const
+{
+    const uint64_t stored = dump->stored_bytes();
+    return stored ? (double)dump->stored_below(it.raw_offset) / (double)stored : 1.0;
+}
+
+std::string process_memdump::str(const image_process::iterator &it) const
+{
+    char buf[64];
+    snprintf(buf,sizeof(buf),"Physical address %" PRIx64,it.raw_offset);
+    return std::string(buf);
+}
+
+pos0_t process_memdump::get_pos0(const image_process::iterator &it) const
+{
+    return pos0_t("",it.raw_offset);
+}
+
+/* The memory of the page and margin, with zeros where no run is; a page with none is a view of zero_buf */
+sbuf_t *process_memdump::sbuf_alloc(image_process::iterator &it) const
+{
+    size_t count = pagesize + margin;
+    size_t this_pagesize = pagesize;
+
+    if (dump->size() < it.raw_offset + count){
+        count = dump->size() - it.raw_offset;
+    }
+    if (this_pagesize > count ) {
+        this_pagesize = count;
+    }
+    if (count==0) {
+        it.eof = true;
+        throw EndOfImage();
+    }
+    if (dump->next_stored(it.raw_offset) >= it.raw_offset + count) {
+        return sbuf_t::sbuf_new( get_pos0(it), zero_buf, count, this_pagesize);
+    }
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), count, this_pagesize);
+    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
+    page_allocator::advise(buf, count);
+    if (this->read_page(buf, count, this_pagesize, it.raw_offset) < static_cast<ssize_t>(count)) {
+        delete sbuf;
+        throw read_error();
+    }
+    return sbuf;
+}
+
+uint64_t process_memdump::max_blocks(const image_process::iterator &it) const
+{
+    return (dump->size()+pagesize-1) / pagesize;
+}
+
+uint64_t process_memdump::seek_block(image_process::iterator &it,uint64_t block) const
+{
+    if (block * pagesize > dump->size()){
+        block = dump->size() / pagesize;
+    }
+    it.raw_offset = block * pagesize;
+    return block;
+}
+
+
+/****************************************************************
+ *** STREAM
+ ****************************************************************/
+
+bool process_stream::is_stream(const std::filesystem::path &fn)
+{
+    std::error_code ec;
+    return fn.string()=="-" || std::filesystem::is_fifo(fn, ec);
+}
+
+process_stream::~process_stream()
+{
+    if (fd > STDERR_FILENO) ::close(fd);
+}
+
+int process_stream::open()
+{
+    if (image_fname().string()=="-") {
+        fd = STDIN_FILENO;
+    } else {
+        fd = ::open(image_fname().c_str(), O_RDONLY);
+    }
+#ifdef _WIN32
+    if (fd == STDIN_FILENO) setmode(fd, O_BINARY);
+#endif
+    return fd < 0 ? -1 : 0;
+}
+
+bool process_stream::fill(uint64_t end) const
+{
+    while (!at_eof && window_start + window.size() < end) {
+        const size_t have = window.size();
+        window.resize(end - window_start);
+        ssize_t n = ::read(fd, window.data() + have, window.size() - have);
+        if (n < 0 && errno == EINTR) n = 0;
+        else if (n <= 0) at_eof = true;
+        window.resize(have + std::max<ssize_t>(n, 0));
+        if (n < 0 && errno != EINTR) throw ReadError();
+    }
+    return window_start + window.size() >= end;
+}
+
+void process_stream::discard(uint64_t offset) const
+{
+    while (window_start + window.size() < offset && !at_eof) {
+        window_start += window.size();
+        window.clear();
+        fill(std::min<uint64_t>(offset, window_start + pagesize));
+    }
+    if (offset <= window_start) return;
+    const size_t drop = std::min<uint64_t>(offset - window_start, window.size());
+    window.erase(window.begin(), window.begin() + drop);
+    window_start += drop;
+}
+
+ssize_t process_stream::pread(void *buf, size_t bytes, uint64_t offset) const
+{
+    std::lock_guard<std::mutex> lock(Mwindow);
+    if (offset < window_start) return -1; // already gone
+    fill(offset + bytes);
+    const uint64_t end = window_start + window.size();
+    if (offset >= end) return 0;
+    const size_t count = std::min<uint64_t>(bytes, end - offset);
+    memcpy(buf, window.data() + (offset - window_start), count);
+    return count;
+}
+
+int64_t process_stream::image_size() const
+{
+    std::lock_guard<std::mutex> lock(Mwindow);
+    return window_start + window.size();
+}
+
+image_process::iterator process_stream::begin() const
+{
+    image_process::iterator it(this);
+    std::lock_guard<std::mutex> lock(Mwindow);
+    if (!fill(1)) it.eof = true;        // an empty stream
+    return it;
+}
+
+image_process::iterator process_stream::end() const
+{
+    image_process::iterator it(this);
+    it.raw_offset = UINT64_MAX;         // not known until the stream ends
+    it.eof = true;
+    return it;
+}
+
+/* The next page starts at the end of this one; it exists if the stream has a byte there */
+void process_stream::increment_iterator(image_process::iterator &it) const
+{
+    it.raw_offset += pagesize;
+    it.page_number++;
+    std::lock_guard<std::mutex> lock(Mwindow);
+    discard(it.raw_offset);
+    if (!fill(it.raw_offset + 1)) it.eof = true;
+}
+
+double process_stream::fraction_done(const image_process::iterator &it) const
+{
+    std::lock_guard<std::mutex> lock(Mwindow);
+    const uint64_t size = window_start + window.size();
+    return at_eof && size ? std::min(1.0, double(it.raw_offset) / double(size)) : 0;
+}
+
+std::string process_stream::str(const image_process::iterator &it) const
+{
+    char buf[64];
+    snprintf(buf,sizeof(buf),"Offset %" PRId64 "MB",it.raw_offset/1000000);
+    return std::string(buf);
+}
+
+pos0_t process_stream::get_pos0(const image_process::iterator &it) const
+{
+    return pos0_t("",it.raw_offset);
+}
+
+sbuf_t *process_stream::sbuf_alloc(image_process::iterator &it) const
+{
+    std::lock_guard<std::mutex> lock(Mwindow);
+    discard(it.raw_offset);
+    fill(it.raw_offset + pagesize + margin);
+    if (window_start != it.raw_offset || window.empty()) {
+        it.eof = true;
+        throw EndOfImage();
+    }
+    const size_t count = std::min(window.size(), pagesize + margin);
+    const size_t this_pagesize = std::min(pagesize, count);
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), count, this_pagesize);
+    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
+    page_allocator::advise(buf, count);
+    memcpy(buf, window.data(), count);
+    return sbuf;
+}
+
+uint64_t process_stream::max_blocks(const image_process::iterator &it) const
+{
+    return 0;                           // not known
+}
+
+uint64_t process_stream::seek_block(image_process::iterator &it,uint64_t block) const
+{
+    return -1;
+}
+
+
+/****************************************************************
+ *** REMOTE
+ ****************************************************************/
+
+bool image_process::is_remote(const std::string &fname)
+{
+    return fname.compare(0, remote_workers::SCHEME.size(), remote_workers::SCHEME)==0;
+}
+
+int process_remote::open()
+{
+    try {
+        conn = remote_workers::connection::connect(image_fname().string().substr(remote_workers::SCHEME.size()));
+        conn->send(remote_workers::HELLO, remote_workers::hello());
+        remote_workers::frame_t type;
+        std::string payload;
+        if (!conn->recv(type, payload) || type != remote_workers::INFO || payload.size() < 8) return -1;
+        for (int i=0; i<8; i++) size = (size << 8) | uint8_t(payload[i]);
+    }
+    catch (const std::exception &e) {
+        std::cerr << image_fname().string() << ": " << e.what() << std::endl;
+        return -1;
+    }
+    remote_workers::set_worker(conn); // for the features sent back
+    return 0;
+}
+
+/* With Mpages held */
+bool process_remote::have(uint64_t page_number) const
+{
+    while (received <= page_number && !ended) {
+        std::string want;
+        for (int i=3; i>=0; i--) want.push_back(char((remote_workers::PAGES_PER_REQUEST >> (8*i)) & 0xff));
+        conn->send(remote_workers::NEXT, want);
+        remote_workers::frame_t type;
+        std::string payload;
+        if (!conn->recv(type, payload)) throw std::runtime_error("the producer closed the connection");
+        if (type == remote_workers::END) {
+            ended = true;
+        } else if (type == remote_workers::PAGES) {
+            for (auto &it : remote_workers::decode_pages(payload)) pages[received++] = std::move(it);
+        } else {
+            throw std::runtime_error("unexpected frame from the producer");
+        }
+    }
+    return received > page_number;
+}
+
+ssize_t process_remote::pread(void *buf, size_t bytes, uint64_t offset) const
+{
+    std::lock_guard<std::mutex> lock(Mpages);
+    for (const auto &it : pages) {
+        const auto &p = it.second;
+        if (offset >= p.offset && offset < p.offset + p.buf.size()) {
+            const size_t count = std::min<uint64_t>(bytes, p.offset + p.buf.size() - offset);
+            memcpy(buf, p.buf.data() + (offset - p.offset), count);
+            return count;
+        }
+    }
+    return -1;                          // not here
+}
+
+int64_t process_remote::image_size() const
+{
+    return size;
+}
+
+image_process::iterator process_remote::begin() const
+{
+    image_process::iterator it(this);
+    std::lock_guard<std::mutex> lock(Mpages);
+    if (have(0)) {
+        it.raw_offset = pages.at(0).offset;
+    } else {
+        it.eof = true;                  // nothing to scan
+    }
+    return it;
+}
+
+image_process::iterator process_remote::end() const
+{
+    image_process::iterator it(this);
+    it.raw_offset = UINT64_MAX;
+    it.eof = true;
+    return it;
+}
+
+void process_remote::increment_iterator(image_process::iterator &it) const
+{
+    it.page_number++;
+    std::lock_guard<std::mutex> lock(Mpages);
+    if (!have(it.page_number)) {
+        it.eof = true;
+        return;
+    }
+    it.raw_offset = pages.at(it.page_number).offset;
+}
+
+double process_remote::fraction_done(const image_process::iterator &it) const
+{
+    return size ? std::min(1.0, double(it.raw_offset) / double(size)) : 0; // the producer gives them out roughly in order
+}
+
+std::string process_remote::str(const image_process::iterator &it) const
+{
+    char buf[64];
+    snprintf(buf,sizeof(buf),"Remote page %" PRIu64 " (offset %" PRId64 "MB)",it.page_number,it.raw_offset/1000000);
+    return std::string(buf);
+}
+
+pos0_t process_remote::get_pos0(const image_process::iterator &it) const
+{
+    return pos0_t("",it.raw_offset);
+}
+
+sbuf_t *process_remote::sbuf_alloc(image_process::iterator &it) const
+{
+    remote_workers::page p;
+    {
+        std::lock_guard<std::mutex> lock(Mpages);
+        if (!have(it.page_number) || pages.count(it.page_number)==0) {
+            it.eof = true;
+            throw EndOfImage();
+        }
+        p = std::move(pages.at(it.page_number));
+        pages.erase(it.page_number);
+    }
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc( pos0_t("", p.offset), p.buf.size(), p.pagesize);
+    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
+    page_allocator::advise(buf, p.buf.size());
+    memcpy(buf, p.buf.data(), p.buf.size());
+    return sbuf;
+}
+
+uint64_t process_remote::max_blocks(const image_process::iterator &it) const
+{
+    return 0;                           // not known
+}
+
+uint64_t process_remote::seek_block(image_process::iterator &it,uint64_t block) const
+{
+    return -1;
+}
+
+
+/****************************************************************
+ *** RAW
+ ****************************************************************/
+
+process_raw::file_info::file_info(const std::filesystem::path path_, uint64_t offset_, uint64_t length_):
+    path(path_), offset(offset_), length(length_)
+{
+}
+
+process_raw::file_fds::~file_fds()
+{
+    if (fd >= 0) ::close(fd);
+    if (direct_fd >= 0) ::close(direct_fd);
+}
+
+size_t process_raw::max_open_files()
+{
+    size_t limit = 1024;
+#ifdef HAVE_SYS_RESOURCE_H
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl)==0 && rl.rlim_cur != RLIM_INFINITY) limit = rl.rlim_cur;
+#endif
+    return std::max<size_t>(limit / 4, 8);
+}
+
+std::shared_ptr<const process_raw::file_fds> process_raw::fds_of(const file_info &fi) const
+{
+    std::lock_guard<std::mutex> lock(Mfds);
+    if (fi.fds) {
+        open_files.splice(open_files.begin(), open_files, fi.lru);
+        return fi.fds;
+    }
+    while (open_files.size() >= max_open) {
+        open_files.back()->fds.reset(); // closed when the readers that hold it are done
+        open_files.pop_back();
+    }
+    auto fds = std::make_shared<file_fds>();
+    fds->fd = ::open(fi.path.string().c_str(), O_RDONLY|O_BINARY);
+    if (fds->fd < 0) {
+        const int err = errno;          // EMFILE, if the limit is lower than max_open_files() allows for
+        throw image_process::NoSuchFile( fi.path.string() + ": " + strerror(err) );
+    }
+#if defined(O_DIRECT) || defined(F_NOCACHE)
+    if (use_direct && !fi.direct_failed) {
+#ifdef O_DIRECT
+        fds->direct_fd = ::open(fi.path.string().c_str(), O_RDONLY|O_DIRECT);
+#else
+        fds->direct_fd = ::open(fi.path.string().c_str(), O_RDONLY);
+        if (fds->direct_fd >= 0 && fcntl(fds->direct_fd, F_NOCACHE, 1)<0) {
+            ::close(fds->direct_fd);
+            fds->direct_fd = -1;
+        }
+#endif
+        if (fds->direct_fd < 0) {
+            std::cerr << "cannot open " << fi.path << " for unbuffered reads: " << strerror(errno) << "; reading buffered" << std::endl;
+            fi.direct_failed = true;
+        }
+    }
+#endif
+    fi.fds = fds;
+    open_files.push_front(&fi);
+    fi.lru = open_files.begin();
+    return fds;
+}
+
+void process_raw::close_files()
+{
+    std::lock_guard<std::mutex> lock(Mfds);
+    for (const file_info *fi : open_files) fi->fds.reset();
+    open_files.clear();
+}
+
+process_raw::process_raw(std::filesystem::path fname, size_t pagesize_, size_t margin_)
+    :image_process(fname, pagesize_, margin_)
+{
+}
+
+process_raw::~process_raw()
+{
+    unmap_files();
+    close_direct();
+    close_files();
+    file_list.clear();
+    free(zero_buf);
+}
+
+/**
+ * Sparse files (and thinly-provisioned volumes copied with cp --sparse) have holes that read as zeros.
+ * SEEK_DATA finds the next allocated byte without reading anything, so pages in holes need not be read.
+ */
+bool process_raw::in_hole(const file_info &fi, uint64_t file_offset, size_t count) const
+{
+#ifdef SEEK_DATA
+    const auto fds = fds_of(fi);
+    off_t data = lseek(fds->fd, file_offset, SEEK_DATA);
+    if (data < 0) return errno==ENXIO;  // no data after file_offset
+    return static_cast<uint64_t>(data) >= file_offset + count;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Memory-map each of the files in the file list. When a page falls entirely within a mapped file,
+ * sbuf_alloc() returns an sbuf that points into the mapping rather than copying the data.
+ * Files that cannot be mapped (e.g. devices, or a 32-bit address space that is too small) are read as before.
+ */
+void process_raw::map_files()
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    for (auto &fi : file_list) {
+        if (fi->map || fi->length==0) continue;
+        int fd = ::open(fi->path.string().c_str(), O_RDONLY);
+        if (fd<0) continue;
+        void *addr = mmap(nullptr, fi->length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);                    // the mapping keeps its own reference to the file
+        if (addr==MAP_FAILED) {
+            std::cerr << "cannot mmap " << fi->path << ": " << strerror(errno) << "; reading instead" << std::endl;
+            continue;
+        }
+        madvise(addr, fi->length, MADV_SEQUENTIAL);
+        fi->map = static_cast<const uint8_t *>(addr);
+    }
+#endif
+}
+
+void process_raw::unmap_files()
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    for (auto &fi : file_list) {
+        if (fi->map) {
+            munmap(const_cast<uint8_t *>(fi->map), fi->length);
+            fi->map = nullptr;
+        }
+    }
+#endif
+}
+
+void process_raw::set_use_mmap(bool val)
+{
+    use_mmap = val;
+    if (use_mmap) {
+        map_files();
+    } else {
+        unmap_files();
+    }
+}
+
+/**
+ * Read the files unbuffered. On Linux this is O_DIRECT, which requires aligned offsets, lengths and
+ * buffers; on macOS it is F_NOCACHE. Images larger than RAM get no reuse from the page cache, and
+ * reading them through it evicts everyone else's data. The files are opened so by fds_of() when next
+ * read; files that cannot be opened this way (e.g. on file systems without O_DIRECT) are read as before.
+ */
+void process_raw::open_direct()
+{
+#if defined(O_DIRECT) || defined(F_NOCACHE)
+    if (direct_buf==nullptr) {
+        direct_capacity = ((pagesize + margin + DIRECT_ALIGN - 1) & ~(DIRECT_ALIGN-1)) + DIRECT_ALIGN;
+        void *buf = nullptr;
+        if (posix_memalign(&buf, DIRECT_ALIGN, direct_capacity)!=0) throw std::bad_alloc();
+        direct_buf = static_cast<uint8_t *>(buf);
+    }
+    close_files();
+#else
+    std::cerr << "unbuffered reads are not supported on this platform" << std::endl;
+#endif
+}
+
+void process_raw::close_direct()
+{
+    close_files();
+    free(direct_buf);
+    direct_buf = nullptr;
+    direct_file = nullptr;
+}
+
+void process_raw::set_use_direct(bool val)
+{
+    use_direct = val;
+    if (use_direct) {
+        set_use_mmap(false);            // mapped pages come through the page cache
+        open_direct();
+    } else {
+        close_direct();
+    }
+}
+
+/**
+ * Read [file_offset,file_offset+count) of fi through its unbuffered descriptor.
+ * Whatever part of the range is still in the window is copied from it; the rest is read into the
+ * window in aligned blocks and copied. Returns the number of bytes copied, which is short at end of file.
+ */
+size_t process_raw::direct_read(const file_info &fi, int direct_fd, uint8_t *buf, size_t count, uint64_t file_offset) const
+{
+    size_t done = 0;
+    while (done < count) {
+        uint64_t pos = file_offset + done;
+        if (direct_file==&fi && direct_start <= pos && pos < direct_start + direct_len) {
+            size_t n = std::min<uint64_t>(count - done, direct_start + direct_len - pos);
+            memcpy(buf + done, direct_buf + (pos - direct_start), n);
+            done += n;
+            continue;
+        }
+        uint64_t start = pos & ~(DIRECT_ALIGN-1);
+        uint64_t end   = (file_offset + count + DIRECT_ALIGN - 1) & ~(DIRECT_ALIGN-1);
+        if (end - start > direct_capacity) end = start + direct_capacity;
+        ssize_t got = ::pread(direct_fd, direct_buf, end - start, start);
+        if (got < 0) {
+            direct_file = nullptr;
+            throw ReadError();
+        }
+        direct_file  = &fi;
+        direct_start = start;
+        direct_len   = got;
+        if (start + got <= pos) break;  // end of file
+    }
+    return done;
+}
+
+/**
+ * Tell the kernel that the page after [file_offset,file_offset+count) will be needed soon,
+ * and that pages well behind the iterator are no longer needed. Pages behind the iterator are
+ * released with a lag because the workers may still be scanning them.
+ */
+void process_raw::advise_mapped(const file_info &fi, uint64_t file_offset, size_t count) const
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    static const uint64_t vm_pagesize = sysconf(_SC_PAGESIZE);
+    uint64_t ahead_start = (file_offset + count) & ~(vm_pagesize-1);
+    if (ahead_start < fi.length) {
+        size_t ahead_len = std::min<uint64_t>(pagesize, fi.length - ahead_start);
+        madvise(const_cast<uint8_t *>(fi.map + ahead_start), ahead_len, MADV_WILLNEED);
+    }
+
+    /* Aligned within this file's mapping: a split-raw segment need not start on a page of the image */
+    uint64_t lag = MMAP_RELEASE_LAG_PAGES * pagesize;
+    if (file_offset <= lag) return;
+    uint64_t release_end = (file_offset - lag) & ~(vm_pagesize-1);
+    uint64_t release_start = mmap_released.load() > fi.offset ? mmap_released.load() - fi.offset : 0;
+    release_start = (release_start + vm_pagesize - 1) & ~(vm_pagesize-1);
+    if (release_end > release_start) {
+        if (madvise(const_cast<uint8_t *>(fi.map + release_start), release_end - release_start, MADV_DONTNEED)!=0) {
+            static std::atomic<bool> warned {false};
+            if (!warned.exchange(true)) {
+                std::cerr << fi.path.string() << ": cannot release mapped pages: " << strerror(errno) << std::endl;
+            }
+        }
+        mmap_released = fi.offset + release_end; // not tried again if it failed
+    }
+#endif
+}
+
+/* If we are running on WIN32 and we've been asked to process a raw device, get its "Drive Geometry" to figure out how big it is.
+ */
+#ifdef _WIN32
+BOOL GetDriveGeometry(const wchar_t *wszPath, DISK_GEOMETRY *pdg)
+{
+    HANDLE hDevice = INVALID_HANDLE_VALUE;  // handle to the drive to be examined
+    BOOL bResult   = FALSE;                 // results flag
+    DWORD junk     = 0;                     // discard results
+
+    hDevice = CreateFileW(wszPath,          // drive to open
+                          0,                // no access to the drive
+                          FILE_SHARE_READ | // share mode
+                          FILE_SHARE_WRITE,
+                          NULL,             // default security attributes
+                          OPEN_EXISTING,    // disposition
+                          0,                // file attributes
+                          NULL);            // do not copy file attributes
+
+    if (hDevice == INVALID_HANDLE_VALUE){    // cannot open the drive
+        throw image_process::NoSuchFile("GetDriveGeometry: Cannot open drive");
+    }
+
+    bResult = DeviceIoControl(hDevice,                       // device to be queried
+                              IOCTL_DISK_GET_DRIVE_GEOMETRY, // operation to perform
+                              NULL, 0,                       // no input buffer
+                              pdg, sizeof(*pdg),            // output buffer
+                              &junk,                         // # bytes returned
+                              (LPOVERLAPPED) NULL);          // synchronous I/O
+
+    CloseHandle(hDevice);
+    return (bResult);
+}
+#endif
+
+/*
+ * If path is a disk device, get its size and sector sizes from its driver; false if it is not one.
+ * A device has no file size, and reads that are not whole physical sectors cost the drive a
+ * read-modify cycle (or, unbuffered, fail).
+ */
+static bool device_geometry(const std::filesystem::path &path, uint64_t &size, uint32_t &logical,
+                            uint32_t &physical, bool &rotational)
+{
+#if defined(HAVE_SYS_STAT_H) && defined(HAVE_IOCTL) && !defined(_WIN32)
+    const int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = false;
+    if (fstat(fd, &st)==0 && (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode))) {
+#if defined(BLKGETSIZE64)
+        ok = ioctl(fd, BLKGETSIZE64, &size)==0;
+        int lss = 0;
+        if (ok && ioctl(fd, BLKSSZGET, &lss)==0 && lss > 0) logical = lss;
+#ifdef BLKPBSZGET
+        unsigned int pss = 0;
+        if (ok && ioctl(fd, BLKPBSZGET, &pss)==0 && pss > 0) physical = pss;
+#endif
+#ifdef BLKROTATIONAL
+        unsigned short rot = 1;
+        if (ok && ioctl(fd, BLKROTATIONAL, &rot)==0) rotational = rot!=0;
+#endif
+#elif defined(DKIOCGETBLOCKCOUNT)
+        uint64_t blocks = 0;
+        uint32_t bs = 0;
+        ok = ioctl(fd, DKIOCGETBLOCKSIZE, &bs)==0 && ioctl(fd, DKIOCGETBLOCKCOUNT, &blocks)==0 && bs > 0;
+        if (ok) {
+            size = blocks * bs;
+            logical = bs;
+        }
+#ifdef DKIOCGETPHYSICALBLOCKSIZE
+        uint32_t pbs = 0;
+        if (ok && ioctl(fd, DKIOCGETPHYSICALBLOCKSIZE, &pbs)==0 && pbs > 0) physical = pbs;
+#endif
+#elif defined(DIOCGMEDIASIZE)
+        off_t media = 0;
+        u_int ss = 0;
+        ok = ioctl(fd, DIOCGMEDIASIZE, &media)==0;
+        if (ok) size = media;
+        if (ok && ioctl(fd, DIOCGSECTORSIZE, &ss)==0 && ss > 0) logical = ss;
+#ifdef DIOCGSTRIPESIZE
+        off_t stripe = 0;
+        if (ok && ioctl(fd, DIOCGSTRIPESIZE, &stripe)==0 && stripe > 0) physical = stripe;
+#endif
+#endif
+    }
+    ::close(fd);
+    if (physical < logical) physical = logical;
+    return ok;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Add the file to the list, keeping track of the total size
+ * https://docs.microsoft.com/en-us/windows/win32/devio/calling-deviceiocontrol
+ */
+void process_raw::add_file(std::filesystem::path path)
+{
+    uint64_t device_size = 0;
+    uint32_t logical = 512, physical = 512;
+    bool rotational = true;
+    bool device = device_geometry(path, device_size, logical, physical, rotational);
+    int64_t path_filesize = device ? device_size : std::filesystem::file_size(path);
+
+#ifdef _WIN32
+    if (path_filesize==0){
+        /* On Windows, see if we can use this */
+        std::cout << path << " checking physical drive" << std::endl;
+        DISK_GEOMETRY pdg = { 0 }; // disk drive geometry structure
+        std::wstring wszDrive = safe_utf8to16(path.string());
+        GetDriveGeometry(wszDrive.c_str(), &pdg);
+        path_filesize = pdg.Cylinders.QuadPart
+            * (ULONG)pdg.TracksPerCylinder
+            * (ULONG)pdg.SectorsPerTrack
+            * (ULONG)pdg.BytesPerSector;
+        device = true;
+        logical = physical = pdg.BytesPerSector;
+    }
+#endif
+    std::shared_ptr<process_raw::file_info> fi(new file_info(path, raw_filesize, path_filesize));
+    fds_of(*fi);                        // throws now if it cannot be read; closed later if there are many
+    fi->device = device;
+    fi->logical_sector = logical;
+    fi->physical_sector = physical;
+    fi->rotational = rotational;
+    file_list.push_back( fi );
+    raw_filesize += path_filesize;
+}
+
+/*
+ * The files are in image order, so the file with pos is the last one that starts at or before it.
+ * Empty files start where the next one does and are passed over.
+ */
+size_t process_raw::segment_of(uint64_t pos) const
+{
+    auto it = std::upper_bound(file_list.begin(), file_list.end(), pos,
+                               [](uint64_t p, const std::shared_ptr<file_info> &fi){ return p < fi->offset; });
+    if (it == file_list.begin()) return file_list.size();
+    const size_t seg = (it - file_list.begin()) - 1;
+    return pos < file_list[seg]->offset + file_list[seg]->length ? seg : file_list.size();
+}
+
+const std::shared_ptr<process_raw::file_info> process_raw::find_offset(uint64_t pos) const
+{
+    const size_t seg = segment_of(pos);
+    return seg < file_list.size() ? file_list[seg] : nullptr;
+}
+
+/**
+ * Open the first image and, optionally, all of the others.
+ */
+int process_raw::open()
+{
+    max_open = max_open_files();
+    add_file(image_fname());
+
+    /* Get the list of the files if this is a split-raw file */
+    if (is_multipart_file(image_fname())){
+	int num=0;
+        std::string templ = make_list_template(image_fname(),&num);
+	for(;;num++){
+	    char probename[PATH_MAX];
+	    snprintf(probename, sizeof(probename), templ.c_str(), num);
+            std::filesystem::path probe_path = probename;
+            // If the file exists, add it, otherwise break.
+            if (std::filesystem::exists( std::filesystem::path( probename ))) {
+                add_file(std::filesystem::path(probename));
+            } else {
+                break;
+            }
+	}
+    }
+    zero_buf = static_cast<uint8_t *>(calloc(pagesize + margin, 1)); // pages of a large calloc are not touched until read
+    return 0;
+}
+
+/* Return the size of all the images */
+int64_t process_raw::image_size() const
+{
+    return raw_filesize;
+}
+
+/* Read count bytes at file_offset of fd, retrying short reads; returns fewer only at end of file */
+static size_t pread_fully(int fd, uint8_t *buf, size_t count, uint64_t file_offset)
+{
+    size_t done = 0;
+    while (done < count) {
+        ssize_t got = ::pread(fd, buf + done, count - done, file_offset + done);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            throw image_process::ReadError();
+        }
+        if (got == 0) break;
+        done += got;
+    }
+    return done;
+}
+
+/**
+ * Read randomly between a split file.
+ * The span is cut at the file boundaries from the segment table, and each piece is read from its
+ * file's mapping, its unbuffered window, or with a positional read of its descriptor. Nothing is
+ * seeked, so any number of threads may read at once (but for the unbuffered window; see concurrent_reads()).
+ * Returns the bytes read, which is short only at the end of the image or of a file that shrank.
+ */
+
+/**
+ * Read [file_offset,file_offset+count) of a device, which may have bad sectors. A read that fails is
+ * read again as two halves split at a physical sector (or, below that, logical sector) boundary, and
+ * so on, so that only the sectors that cannot be read are lost; they are zeros in buf, and their runs
+ * are kept for the report. Each bad run costs about log2(count / sector) failed reads more.
+ */
+size_t process_raw::device_read(const file_info &fi, const file_fds &fds, uint8_t *buf, size_t count, uint64_t file_offset) const
+{
+    std::vector<std::pair<uint64_t, size_t>> todo {{file_offset, count}}; // the last is read next
+    while (!todo.empty()) {
+        const auto [pos, len] = todo.back();
+        todo.pop_back();
+        uint8_t *out = buf + (pos - file_offset);
+        try {
+            const size_t got = fds.direct_fd >= 0 && pos==file_offset && len==count ?
+                direct_read(fi, fds.direct_fd, out, len, pos) : pread_fully(fds.fd, out, len, pos);
+            if (got==len) continue;
+        }
+        catch (const ReadError &) {
+        }
+        const uint64_t sector = len > fi.physical_sector ? fi.physical_sector : fi.logical_sector;
+        if (len <= fi.logical_sector) {
+            memset(out, 0, len);
+            add_bad_sectors(fi.offset + pos, len);
+            continue;
+        }
+        if (pos==file_offset && len==count) recovered_reads++;
+        uint64_t mid = (pos + len / 2) / sector * sector;
+        if (mid <= pos) mid = std::min<uint64_t>(pos + fi.logical_sector, pos + len - 1);
+        todo.emplace_back(mid, pos + len - mid);
+        todo.emplace_back(pos, mid - pos);
+    }
+    return count;
+}
+
+void process_raw::add_bad_sectors(uint64_t offset, uint64_t len)
+{
+    bad_sector_bytes += len;
+    std::lock_guard<std::mutex> lock(Mbad);
+    if (!bad_runs_.empty() && bad_runs_.back().offset + bad_runs_.back().length == offset) {
+        bad_runs_.back().length += len;
+        return;
+    }
+    if (bad_runs_.size() < MAX_BAD_RUNS) bad_runs_.push_back({offset, len});
+}
+
+std::vector<process_raw::bad_run> process_raw::bad_runs()
+{
+    std::lock_guard<std::mutex> lock(Mbad);
+    std::vector<bad_run> ret(bad_runs_);
+    std::sort(ret.begin(), ret.end(), [](const bad_run &a, const bad_run &b){ return a.offset < b.offset; });
+    return ret;
+}
+
+/*
+ * A drive that seeks reads fastest with one read at a time; a solid-state one wants several in
+ * flight, which -S read_threads readers keep there (the unbuffered window takes one reader).
+ */
+u_int process_raw::read_queue_depth() const
+{
+    for (const auto &fi : file_list) {
+        if (fi->device && !fi->rotational) return SOLID_STATE_READS;
+    }
+    return 1;
+}
+
+ssize_t process_raw::pread(void *buf, size_t bytes, uint64_t offset) const
+{
+    uint8_t *out = static_cast<uint8_t *>(buf);
+    size_t done = 0;
+    for (size_t seg = segment_of(offset); done < bytes && seg < file_list.size(); seg++) {
+        const file_info &fi = *file_list[seg];
+        const uint64_t file_offset = offset + done - fi.offset;
+        if (file_offset >= fi.length) continue; // empty
+        const size_t want = std::min<uint64_t>(bytes - done, fi.length - file_offset);
+        size_t got = want;
+        if (fi.map) {
+            memcpy(out + done, fi.map + file_offset, want);
+        } else {
+            const auto fds = fds_of(fi);
+            if (fi.device) {
+                got = device_read(fi, *fds, out + done, want, file_offset);
+            } else if (fds->direct_fd >= 0) {
+                got = direct_read(fi, fds->direct_fd, out + done, want, file_offset);
+            } else {
+                got = pread_fully(fds->fd, out + done, want, file_offset);
+            }
+        }
+        done += got;
+        if (got < want) break;
+    }
+    return done;
+}
+
+
+image_process::iterator process_raw::begin() const
+{
+    image_process::iterator it(this);
+    return it;
+}
+
+
+/* Returns an iterator at the end of the image */
+image_process::iterator process_raw::end() const
+{
+    image_process::iterator it(this);
+    it.raw_offset = this->raw_filesize;
+    it.eof = true;
+    return it;
+}
+
+/****************************************************************
+ ** process_raw
+ ****************************************************************/
+
+void process_raw::increment_iterator(image_process::iterator &it) const
+{
+    it.raw_offset += pagesize;
+    if (it.raw_offset > this->raw_filesize) it.raw_offset = this->raw_filesize;
+}
+
+double process_raw::fraction_done(const image_process::iterator &it) const
+{
+    return (double)it.raw_offset / (double)this->raw_filesize;
+}
+
+std::string process_raw::str(const image_process::iterator &it) const
+{
+    char buf[64];
+    snprintf(buf,sizeof(buf),"Offset %" PRId64 "MB",it.raw_offset/1000000);
+    return std::string(buf);
+}
+
+
+pos0_t process_raw::get_pos0(const image_process::iterator &it) const
+{
+    return pos0_t("",it.raw_offset);
+}
+
+/** Read from the iterator into a newly allocated sbuf.
+ * uses pagesize. If the file is memory-mapped and the page and margin fall within a single file,
+ * the sbuf is a view into the mapping and no data is copied. If the page and margin are in a hole
+ * of a sparse file, the sbuf is a view of zero_buf. Otherwise the data is read into a new buffer.
+ */
+sbuf_t *process_raw::sbuf_alloc(image_process::iterator &it) const
+{
+    size_t count = pagesize + margin;
+    size_t this_pagesize = pagesize;
+
+    if (this->raw_filesize < it.raw_offset + count){    /* See if that's more than I need */
+	count = this->raw_filesize - it.raw_offset;
+    }
+    if (this_pagesize > count ) {
+        this_pagesize = count;
+    }
+
+    if (count>0) {
+        std::shared_ptr<file_info> fi = find_offset(it.raw_offset);
+        if (fi && it.raw_offset + count <= fi->offset + fi->length) {
+            uint64_t file_offset = it.raw_offset - fi->offset;
+            if (zero_buf && in_hole(*fi, file_offset, count)) {
+                return sbuf_t::sbuf_new( get_pos0(it), zero_buf, count, this_pagesize);
+            }
+            if (use_mmap && fi->map) {
+                advise_mapped(*fi, file_offset, count);
+                return sbuf_t::sbuf_new( get_pos0(it), fi->map + file_offset, count, this_pagesize);
+            }
+        }
+    }
+
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), count, this_pagesize);
+    unsigned char *buf = reinterpret_cast<unsigned char *>(sbuf->malloc_buf());
+    page_allocator::advise(buf, count);
+    // the direct window already keeps the margin
+    int count_read = use_direct ? this->pread(buf, count, it.raw_offset) : this->read_page(buf, count, this_pagesize, it.raw_offset);
+    if (count_read==0){
+        delete sbuf;
+	it.eof = true;
+        throw EndOfImage();
+    }
+    if (count_read<0){
+        delete sbuf;
+	throw read_error();
+    }
+    return sbuf;
+}
+
+uint64_t process_raw::max_blocks(const image_process::iterator &it) const
+{
+    return (this->raw_filesize+pagesize-1) / pagesize;
+}
+
+uint64_t process_raw::seek_block(image_process::iterator &it,uint64_t block) const
+{
+    if (block * pagesize > (uint64_t)raw_filesize){
+        block = raw_filesize / pagesize;
+    }
+
+    it.raw_offset = block * pagesize;
+    return block;
+}
+
+
+/****************************************************************
+ ** process_dir
+ **/
+
+/**
+ * directories don't get page sizes or margins; the page size is the entire
+ * file and the margin is 0.
+ */
+process_dir::process_dir(std::filesystem::path image_dir): image_process(image_dir,0,0)
+{
+    files = walk(image_dir, std::max(std::thread::hardware_concurrency(), 1U));
+}
+
+/**
+ * Walk the tree with a shared queue of directories. Each thread takes a directory, lists it,
+ * and queues its subdirectories, so that the stat() latency of a network share is overlapped.
+ * As with recursive_directory_iterator, symbolic links to directories are not followed.
+ * The first error stops the walk and is rethrown.
+ */
+std::vector<std::filesystem::path> process_dir::walk(const std::filesystem::path &root, unsigned int nthreads)
+{
+    std::mutex M;
+    std::condition_variable cv;
+    std::deque<std::filesystem::path> dirs {root};
+    std::vector<std::filesystem::path> found;
+    std::exception_ptr walk_exception {nullptr};
+    unsigned int busy = 0;              // threads listing a directory
+
+    auto worker = [&]{
+        std::vector<std::filesystem::path> my_files;
+        for (;;) {
+            std::filesystem::path dir;
+            {
+                std::unique_lock<std::mutex> lock(M);
+                cv.wait(lock, [&]{ return !dirs.empty() || busy==0 || walk_exception; });
+                if (dirs.empty() || walk_exception) break;
+                dir = dirs.front();
+                dirs.pop_front();
+                busy++;
+            }
+            std::vector<std::filesystem::path> subdirs;
+            try {
+                for (const auto &entry : std::filesystem::directory_iterator( dir )) {
+                    if (entry.is_directory() && !entry.is_symlink()) {
+                        subdirs.push_back( entry.path() );
+                    } else if (entry.is_regular_file()) {
+                        my_files.push_back( entry.path() );
+                    }
+                }
+            }
+            catch (...) {
+                std::unique_lock<std::mutex> lock(M);
+                if (!walk_exception) walk_exception = std::current_exception();
+            }
+            std::unique_lock<std::mutex> lock(M);
+            for (auto &d : subdirs) dirs.push_back( std::move(d) );
+            busy--;
+            cv.notify_all();
+        }
+        std::unique_lock<std::mutex> lock(M);
+        found.insert( found.end(), my_files.begin(), my_files.end() );
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i=1; i<nthreads; i++) {
+        threads.emplace_back( worker );
+    }
+    worker();
+    for (auto &t : threads) t.join();
+    if (walk_exception) std::rethrow_exception(walk_exception);
+    std::sort( found.begin(), found.end() );
+    return found;
+}
+
+process_dir::~process_dir()
+{
+}
+
+int process_dir::open()
+{
+    return 0;				// always successful
+}
+
+ssize_t process_dir::pread(void *buf,size_t bytes,uint64_t offset) const
+{
+    if (bytes>0) {
+        throw std::runtime_error("process_dir does not support pread");
+    }
+    return 0;
+}
+
+int64_t process_dir::image_size() const
+{
+    return files.size();		// the 'size' is in files
+}
+
+image_process::iterator process_dir::begin() const
+{
+    image_process::iterator it(this);
     return it;
 }
 
@@ -731,12 +2297,28 @@ pos0_t process_dir::get_pos0(const image_process::iterator &it) const
 //#pragma GCC diagnostic warning "-Wsuggest-attribute=noreturn"
 //#endif
 
-/** Read from the iterator into a newly allocated sbuf
- * with mapped memory.
+/** Read from the iterator into a newly allocated sbuf.
+ * Small files are read with a single read(), which is much cheaper than mapping and unmapping them.
+ * Larger files are memory mapped.
  */
 sbuf_t *process_dir::sbuf_alloc(image_process::iterator &it) const
 {
     std::filesystem::path fname = files[it.file_number];
+#if defined(HAVE_UNISTD_H) && defined(HAVE_SYS_STAT_H)
+    int fd = ::open(fname.string().c_str(), O_RDONLY|O_BINARY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st)==0 && st.st_size > 0 && static_cast<uint64_t>(st.st_size) < SMALL_FILE_SIZE) {
+            sbuf_t *sbuf = sbuf_t::sbuf_malloc( get_pos0(it), st.st_size, st.st_size );
+            ssize_t bytes_read = ::read(fd, sbuf->malloc_buf(), st.st_size);
+            ::close(fd);
+            if (bytes_read == st.st_size) return sbuf;
+            delete sbuf;                // the file changed while we were reading it; map it instead
+        } else {
+            ::close(fd);
+        }
+    }
+#endif
     sbuf_t *sbuf = sbuf_t::map_file(fname);     // returns a new sbuf
     return sbuf;
 }
@@ -775,6 +2357,40 @@ image_process *image_process::open(std::filesystem::path fn, bool opt_recurse, s
     image_process *ip = 0;
     std::string fname_string = fn.string();
 
+    if (is_url(fname_string)) {
+#ifdef HAVE_LIBCURL
+        ip = new process_http(fname_string, pagesize_, margin_);
+        if (ip->open()){
+            throw NoSuchFile(fname_string);
+        }
+        return ip;
+#else
+        throw NoSupport("This program was compiled without HTTP support");
+#endif
+    }
+
+    if (is_synthetic(fname_string)) {
+        return new process_synthetic(fname_string, pagesize_, margin_);
+    }
+
+    if (is_remote(fname_string)) {
+        ip = new process_remote(fn, pagesize_, margin_);
+        if (ip->open()){
+            delete ip;
+            throw NoSuchFile(fname_string);
+        }
+        return ip;
+    }
+
+    if (process_stream::is_stream(fn)) {
+        ip = new process_stream(fn, pagesize_, margin_);
+        if (ip->open()){
+            delete ip;
+            throw NoSuchFile(fname_string);
+        }
+        return ip;
+    }
+
     if ( std::filesystem::exists(fn) == false ){
 	throw NoSuchFile(fname_string);
     }
@@ -820,6 +2436,12 @@ image_process *image_process::open(std::filesystem::path fn, bool opt_recurse, s
 	    throw NoSupport("This program was compiled without E01 support");
 #endif
 	}
+	if (ip==nullptr && process_vdisk::is_vdisk(fn)) {
+            ip = new process_vdisk(fn,pagesize_,margin_);
+        }
+	if (ip==nullptr && process_memdump::is_memdump(fn)) {
+            ip = new process_memdump(fn,pagesize_,margin_);
+        }
 	if (ip==nullptr) {
             ip = new process_raw(fn,pagesize_,margin_);
         }
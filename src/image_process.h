@@ -11,8 +11,12 @@
  *
  * Subclasses of this class are used to process:
  * process_ewf - process an EWF file
- * process_raw - process a RAW or splitraw file.
+ * process_raw - process a RAW or splitraw file, or a disk device.
  * process_dir - recursively process a directory of files (but not E01  files)
+ * process_synthetic - generate a deterministic benchmark image (see synthetic_image.h)
+ * process_stream - read an image from stdin or a FIFO, once and in order
+ * process_vdisk - read a VMDK, VHDX or QCOW2 virtual disk in place (see virtual_disk.h)
+ * process_remote - read the pages that a producer gives out, as a remote worker (see remote_workers.h)
  *
  * Conditional compilation assures that this compiles no matter which class libraries are installed.
  *
@@ -44,8 +48,12 @@
 #include "be13_api/sbuf.h"
 #include "be13_api/abstract_image_reader.h"
 
+#include <atomic>
 #include <filesystem>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #if defined(_WIN32)
 #  include <winsock2.h>
@@ -63,6 +71,11 @@ class image_process : public abstract_image_reader {
     /****************************************************************/
     const std::filesystem::path image_fname_;			/* image filename */
 
+    /* The margin of the last page read, which is the start of the next page */
+    mutable std::mutex Mmargin {};
+    mutable std::vector<uint8_t> margin_buf {};
+    mutable uint64_t margin_offset {0};
+
 public:
     /* These two functions are only used in WIN32 but are defined here so that they can be tested on all platforms */
     static std::string filename_extension(std::filesystem::path fn); // returns extension
@@ -70,6 +83,9 @@ public:
     static bool fn_ends_with(std::filesystem::path str,std::string suffix);
     static bool is_multipart_file(std::filesystem::path fn);
     static std::string make_list_template(std::filesystem::path fn,int *start);
+    static bool is_url(const std::string &fname); // http://, https:// or s3:// images are read with process_http
+    static bool is_synthetic(const std::string &fname); // synthetic: images are generated by process_synthetic
+    static bool is_remote(const std::string &fname);    // remote:HOST:PORT images are read with process_remote
 
     struct EndOfImage : public std::exception {
         EndOfImage(){};
@@ -103,6 +119,11 @@ public:
     const size_t margin;                      // margin size we are using
     bool  report_read_errors;
 
+    /* Read count bytes of the page at offset into buf, copying the start of the page from the previous
+     * page's margin when the pages are consecutive. Returns the bytes read, or -1 on error.
+     */
+    ssize_t read_page(uint8_t *buf, size_t count, size_t this_pagesize, uint64_t offset) const;
+
     class read_error: public std::exception {
 	virtual const char *what() const throw() {
 	    return "read error";
@@ -164,6 +185,13 @@ public:
     // seek_block modifies the iterator, but not the image!
     virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const = 0; // returns -1 if failure
     virtual void set_report_read_errors(bool val){report_read_errors=val;}
+    virtual void set_use_mmap(bool val){} // only meaningful for readers that can map their image
+    virtual void set_use_direct(bool val){} // only meaningful for readers that can bypass the page cache
+    virtual void set_block_cache(const std::filesystem::path &dir){} // only meaningful for network readers
+    virtual void set_chunk_cache(uint64_t bytes){} // only meaningful for compressed readers
+    virtual bool concurrent_reads() const { return false; } // true if sbuf_alloc() may be called from several threads at once
+    virtual u_int read_queue_depth() const { return 1; } // the reads the image's device takes at once, for -S read_threads
+    virtual bool seekable() const { return true; } // false if the image can only be read once, in order
 };
 
 inline image_process::iterator & operator++(image_process::iterator &it){
@@ -183,6 +211,9 @@ inline image_process::iterator & operator++(image_process::iterator &it){
 
 #ifdef HAVE_LIBEWF
 #include "libewf.h"
+#include <list>
+#include <map>
+#include <thread>
 
 class process_ewf : public image_process {
  private:
@@ -197,7 +228,36 @@ class process_ewf : public image_process {
     std::vector<std::string> details {};
     mutable libewf_handle_t *handle { nullptr };
 
+    /* Each thread reads with its own libewf handle, opened on its first read, so that the chunk cache
+     * inside a handle serves the reads of one thread and is not thrashed by the others.
+     */
+    std::vector<std::string> segment_filenames {};
+    mutable std::mutex Mhandles {};
+    mutable std::vector<libewf_handle_t *> spare_handles {}; // opened but not given to a thread yet
+    mutable std::map<std::thread::id, libewf_handle_t *> thread_handles {};
+    libewf_handle_t *open_handle() const;
+    libewf_handle_t *thread_handle() const;
+    ssize_t read_handle(void *buf, size_t bytes, uint64_t offset) const; // with the thread's handle
+
+    /* Decompressed chunks, shared by all of the handles and least recently used first out, so that a
+     * chunk one thread has read (the margin of the page before, or a block another sampling pass read)
+     * is not decompressed again by another.
+     */
+    typedef std::shared_ptr<const std::vector<uint8_t>> chunk_t;
+    uint64_t    chunk_size {0};         // 0 if the chunks are not cached
+    uint64_t    chunk_cache_bytes {DEFAULT_CHUNK_CACHE_BYTES};
+    mutable std::mutex Mchunks {};
+    mutable std::list<std::pair<uint64_t, chunk_t>> chunk_lru {}; // most recently used first
+    mutable std::map<uint64_t, std::list<std::pair<uint64_t, chunk_t>>::iterator> chunks {};
+    mutable uint64_t chunks_bytes {0};
+    chunk_t     cached_chunk(uint64_t chunk) const;
+    void        cache_chunk(uint64_t chunk, chunk_t data) const;
+
  public:
+    static inline const uint64_t DEFAULT_CHUNK_CACHE_BYTES {64 * 1024 * 1024};
+    static inline std::atomic<uint64_t> chunk_hits {0};
+    static inline std::atomic<uint64_t> chunk_misses {0};
+
     static void local_e01_glob(std::filesystem::path fname,char ***libewf_filenames,int *amount_of_filenames);
 
     process_ewf(std::filesystem::path fname, size_t pagesize_, size_t margin_) : image_process(fname, pagesize_, margin_) {}
@@ -217,35 +277,349 @@ class process_ewf : public image_process {
     virtual int64_t  image_size() const override;
     virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
     virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override; // returns -1 if failue
+    virtual bool     concurrent_reads() const override { return true; }
+    virtual void     set_chunk_cache(uint64_t bytes) override { chunk_cache_bytes = bytes; }
 };
 #endif
 
+/****************************************************************
+ *** HTTP
+ *** Read an image from a web server or object store with HTTP range requests.
+ ****************************************************************/
+
+/* Undefine HAVE_LIBCURL if we don't have include files */
+#if defined(HAVE_LIBCURL) && !defined(HAVE_CURL_CURL_H)
+#undef HAVE_LIBCURL
+#endif
+
+#ifdef HAVE_LIBCURL
+#include <curl/curl.h>
+#include <future>
+#include <map>
+
+class process_http : public image_process {
+    process_http(const process_http &)=delete;
+    process_http &operator=(const process_http &)=delete;
+
+    typedef std::shared_ptr<const std::vector<uint8_t>> block_t;
+    std::string url {};                 // what we GET; s3:// names are translated to https://
+    uint64_t    http_filesize {0};
+    std::filesystem::path cache_dir {}; // if set, blocks are kept here between runs
+
+    /* Blocks that have been fetched or are being fetched, so that readers and the prefetcher
+     * share downloads. Each easy handle keeps its connection open, so handles are pooled.
+     */
+    mutable std::mutex Mblocks {};
+    mutable std::map<uint64_t, std::shared_future<block_t>> blocks {};
+    mutable std::mutex Mhandles {};
+    mutable std::vector<CURL *> spare_handles {};
+    CURL        *acquire_handle() const;
+    void        release_handle(CURL *h) const;
+    block_t     fetch_block(uint64_t block) const;          // from the cache directory or the server
+    std::vector<uint8_t> get_range(uint64_t start, uint64_t len) const; // one range request, with retries
+    mutable std::atomic<unsigned> fetching {0};                // blocks being fetched
+    /* start fetching, if not fetched already; a prefetch is not started while MAX_FETCHES are in flight,
+     * and then returns an invalid future */
+    std::shared_future<block_t> get_block(uint64_t block, bool prefetching = false) const;
+    void        prefetch(uint64_t offset, uint64_t len) const;
+    void        evict(uint64_t keep_from) const;          // drop blocks before this one
+    std::filesystem::path cache_path(uint64_t block) const;
+
+public:
+    static inline const uint64_t BLOCK_SIZE {4 * 1024 * 1024}; // bytes per range request
+    static inline const unsigned int MAX_RETRIES {3};
+    static inline const unsigned int MAX_FETCHES {16};       // range requests in flight for prefetching
+    static std::string s3_to_https(const std::string &s3url); // s3://bucket/key -> https://bucket.s3.amazonaws.com/key
+
+    process_http(std::filesystem::path fname, size_t pagesize_, size_t margin_);
+    virtual ~process_http();
+    int open() override;
+    virtual ssize_t pread(void *,size_t bytes,uint64_t offset) const override;
+
+    /* iterator support */
+    virtual image_process::iterator begin() const override;
+    virtual image_process::iterator end() const override;
+    virtual void    increment_iterator(class image_process::iterator &it) const override;
+    virtual pos0_t  get_pos0(const class image_process::iterator &it) const override;
+    virtual sbuf_t  *sbuf_alloc(class image_process::iterator &it) const override;
+    virtual double  fraction_done(const class image_process::iterator &it) const override;
+    virtual std::string str(const class image_process::iterator &it) const override;
+    virtual int64_t  image_size() const override;
+    virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
+    virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override;
+    virtual bool     concurrent_reads() const override { return true; }
+    virtual void     set_block_cache(const std::filesystem::path &dir) override { cache_dir = dir; }
+};
+#endif
+
+/****************************************************************
+ *** SYNTHETIC
+ *** Generate a deterministic image as it is read; nothing is stored.
+ *** The image name is a synthetic_image specification, synthetic:SIZE[,...].
+ ****************************************************************/
+
+#include "synthetic_image.h"
+
+class process_synthetic : public image_process {
+    process_synthetic(const process_synthetic &)=delete;
+    process_synthetic &operator=(const process_synthetic &)=delete;
+    const synthetic_image image;
+
+public:
+    process_synthetic(std::filesystem::path fname, size_t pagesize_, size_t margin_):
+        image_process(fname, pagesize_, margin_), image(fname.string()) {}
+    virtual ~process_synthetic() {}
+    int open() override { return 0; }
+    virtual ssize_t pread(void *,size_t bytes,uint64_t offset) const override;
+
+    /* iterator support */
+    virtual image_process::iterator begin() const override;
+    virtual image_process::iterator end() const override;
+    virtual void    increment_iterator(class image_process::iterator &it) const override;
+    virtual pos0_t  get_pos0(const class image_process::iterator &it) const override;
+    virtual sbuf_t  *sbuf_alloc(class image_process::iterator &it) const override;
+    virtual double  fraction_done(const class image_process::iterator &it) const override;
+    virtual std::string str(const class image_process::iterator &it) const override;
+    virtual int64_t  image_size() const override;
+    virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
+    virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override;
+    virtual bool     concurrent_reads() const override { return true; }
+};
+
+/****************************************************************
+ *** VIRTUAL DISK
+ *** Read a VMDK, VHDX or QCOW2 disk in place (see virtual_disk.h). Only the blocks that are stored
+ *** are read; a page and margin with none of them is a view of zero_buf, which phase 1 counts as a
+ *** constant page and does not scan.
+ ****************************************************************/
+
+#include "virtual_disk.h"
+
+class process_vdisk : public image_process {
+    process_vdisk(const process_vdisk &)=delete;
+    process_vdisk &operator=(const process_vdisk &)=delete;
+    std::unique_ptr<virtual_disk> disk {};
+    uint8_t *zero_buf {nullptr};        // pagesize+margin of zeros, shared by the sbufs of unstored pages
+
+public:
+    static bool is_vdisk(const std::filesystem::path &fn) { return virtual_disk::detect(fn) != virtual_disk::NONE; }
+    process_vdisk(std::filesystem::path fname, size_t pagesize_, size_t margin_):
+        image_process(fname, pagesize_, margin_) {}
+    virtual ~process_vdisk();
+    int open() override;                // throws std::runtime_error if the disk is not supported
+    virtual ssize_t pread(void *,size_t bytes,uint64_t offset) const override;
+
+    /* iterator support */
+    virtual image_process::iterator begin() const override;
+    virtual image_process::iterator end() const override;
+    virtual void    increment_iterator(class image_process::iterator &it) const override;
+    virtual pos0_t  get_pos0(const class image_process::iterator &it) const override;
+    virtual sbuf_t  *sbuf_alloc(class image_process::iterator &it) const override;
+    virtual double  fraction_done(const class image_process::iterator &it) const override;
+    virtual std::string str(const class image_process::iterator &it) const override;
+    virtual int64_t  image_size() const override;
+    virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
+    virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override;
+    virtual bool     concurrent_reads() const override { return true; }
+};
+
+/****************************************************************
+ *** MEMORY DUMP
+ *** Read a LiME image or a Windows crash dump as the physical address space (see memory_dump.h).
+ *** The offset of a page is its physical address; the pages with no memory in any run are skipped.
+ ****************************************************************/
+
+#include "memory_dump.h"
+
+class process_memdump : public image_process {
+    process_memdump(const process_memdump &)=delete;
+    process_memdump &operator=(const process_memdump &)=delete;
+    std::unique_ptr<memory_dump> dump {};
+    uint8_t *zero_buf {nullptr};        // pagesize+margin of zeros, for sampled pages with no memory
+    uint64_t first_page(uint64_t addr) const; // of the first page at or after addr with memory in it
+
+public:
+    static bool is_memdump(const std::filesystem::path &fn) { return memory_dump::detect(fn) != memory_dump::NONE; }
+    process_memdump(std::filesystem::path fname, size_t pagesize_, size_t margin_):
+        image_process(fname, pagesize_, margin_) {}
+    virtual ~process_memdump();
+    int open() override;
+    virtual ssize_t pread(void *,size_t bytes,uint64_t offset) const override;
+
+    /* iterator support */
+    virtual image_process::iterator begin() const override;
+    virtual image_process::iterator end() const override;
+    virtual void    increment_iterator(class image_process::iterator &it) const override;
+    virtual pos0_t  get_pos0(const class image_process::iterator &it) const override;
+    virtual sbuf_t  *sbuf_alloc(class image_process::iterator &it) const override;
+    virtual double  fraction_done(const class image_process::iterator &it) const override;
+    virtual std::string str(const class image_process::iterator &it) const override;
+    virtual int64_t  image_size() const override;
+    virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
+    virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override;
+    virtual bool     concurrent_reads() const override { return true; }
+};
+
+/****************************************************************
+ *** STREAM
+ *** Read an image from stdin ("-") or a FIFO, once and in order, so that it can be piped from dd,
+ *** ewfexport or a network tool and scanned as it arrives. The image cannot be sampled, sharded or
+ *** started at an offset, and its size is the bytes read so far. Pages are hashed as they are read,
+ *** as they always are, and phase 1's read-ahead pages overlap the reads with the scanning.
+ *** The window holds the next page and its margin, and no more.
+ ****************************************************************/
+
+class process_stream : public image_process {
+    process_stream(const process_stream &)=delete;
+    process_stream &operator=(const process_stream &)=delete;
+
+    int  fd {-1};
+    mutable std::mutex Mwindow {};
+    mutable std::vector<uint8_t> window {}; // bytes [window_start, window_start+window.size()) of the stream
+    mutable uint64_t window_start {0};
+    mutable bool at_eof {false};
+    bool fill(uint64_t end) const;      // read until the window reaches end; false if the stream ends first
+    void discard(uint64_t offset) const; // drop what is before offset, reading up to it if need be
+
+public:
+    static bool is_stream(const std::filesystem::path &fn); // "-", or a FIFO
+
+    process_stream(std::filesystem::path fname, size_t pagesize_, size_t margin_):
+        image_process(fname, pagesize_, margin_) {}
+    virtual ~process_stream();
+    int open() override;
+    virtual ssize_t pread(void *,size_t bytes,uint64_t offset) const override; // only in the window
+
+    /* iterator support */
+    virtual image_process::iterator begin() const override;
+    virtual image_process::iterator end() const override;
+    virtual void    increment_iterator(class image_process::iterator &it) const override;
+    virtual pos0_t  get_pos0(const class image_process::iterator &it) const override;
+    virtual sbuf_t  *sbuf_alloc(class image_process::iterator &it) const override;
+    virtual double  fraction_done(const class image_process::iterator &it) const override;
+    virtual std::string str(const class image_process::iterator &it) const override;
+    virtual int64_t  image_size() const override;
+    virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
+    virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override; // returns -1
+    virtual bool     seekable() const override { return false; }
+};
+
+/****************************************************************
+ *** REMOTE
+ *** Read the pages that a producer run gives out, remote:HOST:PORT, on demand and in the order given.
+ *** The producer chooses the pages, so they need not be consecutive; each is keyed by the iterator's
+ *** page number until it is read.
+ ****************************************************************/
+
+#include "remote_workers.h"
+
+class process_remote : public image_process {
+    process_remote(const process_remote &)=delete;
+    process_remote &operator=(const process_remote &)=delete;
+
+    std::shared_ptr<remote_workers::connection> conn {};
+    uint64_t size {0};                  // of the producer's image
+    mutable std::mutex Mpages {};
+    mutable std::map<uint64_t, remote_workers::page> pages {}; // by page number, until they are read
+    mutable uint64_t received {0};      // the page number of the next page received
+    mutable bool ended {false};
+    bool have(uint64_t page_number) const; // asks for more pages until it has this one; false at the end
+
+public:
+    process_remote(std::filesystem::path fname, size_t pagesize_, size_t margin_):
+        image_process(fname, pagesize_, margin_) {}
+    virtual ~process_remote() {}
+    int open() override;                // connects and says HELLO
+    virtual ssize_t pread(void *,size_t bytes,uint64_t offset) const override; // only of pages not read yet
+
+    /* iterator support */
+    virtual image_process::iterator begin() const override;
+    virtual image_process::iterator end() const override;
+    virtual void    increment_iterator(class image_process::iterator &it) const override;
+    virtual pos0_t  get_pos0(const class image_process::iterator &it) const override;
+    virtual sbuf_t  *sbuf_alloc(class image_process::iterator &it) const override;
+    virtual double  fraction_done(const class image_process::iterator &it) const override;
+    virtual std::string str(const class image_process::iterator &it) const override;
+    virtual int64_t  image_size() const override;
+    virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
+    virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override; // returns -1
+    virtual bool     seekable() const override { return false; }
+};
+
 /****************************************************************
  *** RAW
  *** Read one or more raw files (to handle multipart disk images.
  ****************************************************************/
 
 class process_raw : public image_process {
+    /* The descriptors of an open file, closed when the last reader that holds them lets go */
+    struct file_fds {
+        file_fds()=default;
+        ~file_fds();
+        file_fds(const file_fds &)=delete;
+        file_fds &operator=(const file_fds &)=delete;
+        int fd {-1};                    // read with positional reads, which any number of threads may share
+        int direct_fd {-1};             // opened with O_DIRECT (or F_NOCACHE) when reading unbuffered
+    };
     class file_info {
     public:;
-        file_info(const std::filesystem::path path_,uint64_t offset_,uint64_t length_):
-            path(path_),offset(offset_),length(length_){
-            stream.open(path, std::ios::binary);
-            if (stream.is_open()==false){
-                throw image_process::NoSuchFile( path_.string() );
-            }
-        };
-        ~file_info() {
-            stream.close();
-        }
+        file_info(const std::filesystem::path path_,uint64_t offset_,uint64_t length_);
+        file_info(const file_info &)=delete;
+        file_info &operator=(const file_info &)=delete;
         std::filesystem::path path {};  // the file name
 	uint64_t offset   {};           // where each file starts
 	uint64_t length   {};           // how long it is
-        std::ifstream     stream {};       // where we are reading
+        const uint8_t     *map {nullptr};  // if the file is memory-mapped, where it is mapped
+        bool              device {false};  // a disk, whose size and sectors come from the driver
+        uint32_t          logical_sector {512};  // the least the device reads, which a bad sector costs
+        uint32_t          physical_sector {512}; // what it reads without a read-modify cycle
+        bool              rotational {true};
+        mutable std::shared_ptr<const file_fds> fds {};     // while it is open; see fds_of()
+        mutable std::list<const file_info *>::iterator lru {};
+        mutable bool      direct_failed {false};   // could not be opened unbuffered, which was said once
     };
     typedef std::vector<std::shared_ptr<file_info>> file_list_t;
-    file_list_t file_list {};
+    file_list_t file_list {};           // in image order, so sorted by offset
+    size_t      segment_of(uint64_t offset) const; // index in file_list of the file with offset, or file_list.size()
+
+    /* The files are opened when they are read, and no more than max_open stay open (the least
+     * recently read are closed), since a split raw image can have thousands of segments and
+     * RLIMIT_NOFILE is often 1024. Throws NoSuchFile, with the errno, if fi cannot be opened.
+     */
+    std::shared_ptr<const file_fds> fds_of(const file_info &fi) const;
+    void        close_files();          // they are opened again, unbuffered or not, when next read
+    static size_t max_open_files();     // a quarter of RLIMIT_NOFILE (at least 8), leaving the rest for the feature files
+    mutable std::mutex Mfds {};
+    mutable std::list<const file_info *> open_files {};        // most recently read first
+    size_t      max_open {8};           // max_open_files() when the image was opened
     void        add_file(std::filesystem::path fname);
+    void        map_files();            // mmap every file in file_list; files that cannot be mapped are read
+    void        unmap_files();
+    void        advise_mapped(const file_info &fi, uint64_t file_offset, size_t count) const;
+    bool        use_mmap {false};
+    mutable std::atomic<uint64_t> mmap_released {0}; // everything below this image offset has been MADV_DONTNEED'ed
+    static inline const uint64_t MMAP_RELEASE_LAG_PAGES {16}; // keep this many pages resident behind the iterator
+    bool        in_hole(const file_info &fi, uint64_t file_offset, size_t count) const; // true if the range is unallocated
+
+    /* Unbuffered reads. Data is read into direct_buf, an aligned window over one file, and copied out.
+     * The window keeps the last blocks read, so the margin of one page is not read again for the next.
+     */
+    void        open_direct();
+    void        close_direct();
+    size_t      direct_read(const file_info &fi, int direct_fd, uint8_t *buf, size_t count, uint64_t file_offset) const;
+    static inline const uint64_t DIRECT_ALIGN {4096}; // offset, length and buffer alignment for O_DIRECT
+    bool        use_direct {false};
+    uint8_t     *direct_buf {nullptr};
+    size_t      direct_capacity {0};
+    mutable const file_info *direct_file {nullptr}; // the window's file, offset and length
+    mutable uint64_t direct_start {0};
+    mutable size_t   direct_len {0};
+    uint8_t     *zero_buf {nullptr};    // pagesize+margin of zeros, shared by the sbufs of pages in holes
+
+    /* A read of a device that fails is read again in halves, down to single sectors, and the sectors
+     * that cannot be read are zeros; see device_read() */
+    size_t      device_read(const file_info &fi, const file_fds &fds, uint8_t *buf, size_t count, uint64_t file_offset) const;
+    static void add_bad_sectors(uint64_t offset, uint64_t len);
     const class std::shared_ptr<process_raw::file_info> find_offset(uint64_t offset) const; /* finds which file this offset would map to */
     uint64_t    raw_filesize {};			/* sume of all the lengths */
 public:
@@ -266,6 +640,23 @@ public:
     virtual int64_t  image_size() const override;
     virtual uint64_t max_blocks(const class image_process::iterator &it) const override;
     virtual uint64_t seek_block(class image_process::iterator &it,uint64_t block) const override; // returns -1 if failue
+    virtual void     set_use_mmap(bool val) override;
+    virtual void     set_use_direct(bool val) override;
+    virtual bool     concurrent_reads() const override { return !use_direct; } // the unbuffered window is shared
+    virtual u_int    read_queue_depth() const override;
+
+    static inline const u_int SOLID_STATE_READS {4}; // reader threads for a device that does not seek
+    static inline const size_t MAX_BAD_RUNS {1000};   // runs of bad sectors kept for the report
+    struct bad_run {
+        uint64_t offset {0};            // in the image
+        uint64_t length {0};
+    };
+    static inline std::atomic<uint64_t> bad_sector_bytes {0}; // read as zeros
+    static inline std::atomic<uint64_t> recovered_reads {0};  // device reads that failed and were split
+    static std::vector<bad_run> bad_runs(); // merged, in image order
+private:
+    static inline std::mutex Mbad {};
+    static inline std::vector<bad_run> bad_runs_ {};
 };
 
 /****************************************************************
@@ -278,8 +669,12 @@ class process_dir : public image_process {
     std::vector<std::filesystem::path> files {};		/* all of the files */
 
  public:
+    static inline const size_t SMALL_FILE_SIZE {64 * 1024}; // files smaller than this are read rather than mapped
+    /* Find the regular files under root, walking the directories with nthreads threads. Sorted. */
+    static std::vector<std::filesystem::path> walk(const std::filesystem::path &root, unsigned int nthreads);
     process_dir(std::filesystem::path image_dir);
     virtual ~process_dir();
+    virtual bool     concurrent_reads() const override { return true; } // every sbuf_alloc() opens its own file
 
     virtual int open() override;
     virtual ssize_t pread(void *,size_t bytes,uint64_t offset) const override ;
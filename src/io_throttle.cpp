@@ -0,0 +1,211 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/stat.h>
+
+#include "io_throttle.h"
+
+namespace {
+    using clock = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
+
+    const clock::duration BURST = std::chrono::seconds(1);  // each bucket holds this much of its rate
+    const auto CHECK_INTERVAL = std::chrono::seconds(1);    // of the control file's modification time
+    const auto MAX_SLEEP = std::chrono::milliseconds(100);  // so that a new limit is seen soon
+
+    struct bucket {
+        uint64_t rate {0};              // a second; 0 for no limit
+        clock::time_point tat {};       // when the bucket would be full again
+        void take(double cost, clock::time_point now) {
+            if (rate) tat = std::max(tat, now) + std::chrono::duration_cast<clock::duration>(seconds(cost / rate));
+        }
+        bool has_room(clock::time_point now) const { return rate == 0 || tat - BURST <= now; }
+    };
+
+    struct state {
+        std::mutex M {};
+        bucket bytes {};
+        bucket reads {};
+        std::string path {};
+        struct timespec mtime {};
+        clock::time_point checked {};
+        std::atomic<bool> active {false};
+    };
+    state &the_state() {
+        static state s;
+        return s;
+    }
+
+    std::atomic<bool> reload_requested {false};
+    extern "C" void on_sigusr1(int) { reload_requested = true; }
+
+    uint64_t parse_scaled(const std::string &value) {
+        size_t end = 0;
+        unsigned long long n = 0;
+        try {
+            n = std::stoull(value, &end);
+        } catch (const std::exception &) {
+            throw std::invalid_argument("io_throttle: bad number " + value);
+        }
+        const std::string suffix = value.substr(end);
+        if (suffix == "K" || suffix == "k") n <<= 10;
+        else if (suffix == "M" || suffix == "m") n <<= 20;
+        else if (suffix == "G" || suffix == "g") n <<= 30;
+        else if (!suffix.empty()) throw std::invalid_argument("io_throttle: bad number " + value);
+        return n;
+    }
+
+    bool modified(const std::string &path, struct timespec &mtime) {
+        struct stat st {};
+        if (stat(path.c_str(), &st) != 0) return false;
+#if defined(__APPLE__)
+        const struct timespec t = st.st_mtimespec;
+#else
+        const struct timespec t = st.st_mtim;
+#endif
+        if (t.tv_sec == mtime.tv_sec && t.tv_nsec == mtime.tv_nsec) return false;
+        mtime = t;
+        return true;
+    }
+
+    /* With s.M held */
+    void apply(state &s, uint64_t bytes_per_second, uint64_t reads_per_second) {
+        const auto now = clock::now();
+        s.bytes.rate = bytes_per_second;
+        s.reads.rate = reads_per_second;
+        s.bytes.tat = s.reads.tat = now;               // the buckets start full at the new rates
+        s.active = s.bytes.rate || s.reads.rate || !s.path.empty();
+    }
+
+    /* With s.M held; throws if the file cannot be read or parsed */
+    void load(state &s) {
+        std::ifstream in(s.path);
+        if (!in) throw std::runtime_error("io_throttle: cannot open " + s.path);
+        std::stringstream text;
+        text << in.rdbuf();
+        uint64_t bandwidth = s.bytes.rate, iops = s.reads.rate;
+        io_throttle::parse_control(text.str(), bandwidth, iops);
+        apply(s, bandwidth, iops);
+        io_throttle::reloads++;
+    }
+
+    /* With s.M held: reload the control file if it changed or SIGUSR1 asked; keep the limits if it is bad */
+    void check_control_file(state &s, clock::time_point now) {
+        if (s.path.empty()) return;
+        const bool asked = reload_requested.exchange(false);
+        if (!asked && now - s.checked < CHECK_INTERVAL) return;
+        s.checked = now;
+        if (!modified(s.path, s.mtime) && !asked) return;
+        try {
+            load(s);
+        } catch (const std::exception &) {
+            // an editor may have left it half written; the next change is read
+        }
+    }
+}
+
+void io_throttle::parse_control(const std::string &text, uint64_t &bytes_per_second, uint64_t &reads_per_second)
+{
+    std::stringstream ss(text);
+    for (std::string line; std::getline(ss, line);) {
+        line.erase(std::remove_if(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); }), line.end());
+        if (line.empty() || line[0] == '#') continue;
+        const size_t eq = line.find('=');
+        if (eq == std::string::npos) throw std::invalid_argument("io_throttle: no '=' in " + line);
+        const std::string key = line.substr(0, eq);
+        const uint64_t value = parse_scaled(line.substr(eq + 1));
+        if (key == "bandwidth") bytes_per_second = value;
+        else if (key == "iops") reads_per_second = value;
+        else throw std::invalid_argument("io_throttle: unknown limit " + key);
+    }
+}
+
+void io_throttle::set_limits(uint64_t bytes_per_second, uint64_t reads_per_second)
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    apply(s, bytes_per_second, reads_per_second);
+}
+
+uint64_t io_throttle::bandwidth()
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    return s.bytes.rate;
+}
+
+uint64_t io_throttle::iops()
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    return s.reads.rate;
+}
+
+void io_throttle::set_control_file(const std::string &path)
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    s.path = path;
+    s.mtime = {};
+    if (path.empty()) {
+        apply(s, s.bytes.rate, s.reads.rate);
+        return;
+    }
+    modified(path, s.mtime);
+    s.checked = clock::now();
+    try {
+        load(s);
+    } catch (const std::exception &) {
+        s.path.clear();
+        throw;
+    }
+    std::signal(SIGUSR1, on_sigusr1);
+}
+
+bool io_throttle::enabled()
+{
+    return the_state().active;
+}
+
+void io_throttle::charge(uint64_t bytes)
+{
+    state &s = the_state();
+    if (!s.active) return;
+    std::unique_lock<std::mutex> lock(s.M);
+    auto now = clock::now();
+    check_control_file(s, now);
+    s.bytes.take(bytes, now);
+    s.reads.take(1, now);
+    if (s.bytes.has_room(now) && s.reads.has_room(now)) return;
+
+    waits++;
+    const auto start = now;
+    while (!(s.bytes.has_room(now) && s.reads.has_room(now))) {
+        const auto until = std::max(s.bytes.rate ? s.bytes.tat - BURST : now, s.reads.rate ? s.reads.tat - BURST : now);
+        lock.unlock();
+        std::this_thread::sleep_for(std::min<clock::duration>(until - now, MAX_SLEEP));
+        lock.lock();
+        now = clock::now();
+        check_control_file(s, now);
+    }
+    wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+}
+
+std::string io_throttle::xml_attributes()
+{
+    state &s = the_state();
+    std::lock_guard<std::mutex> lock(s.M);
+    std::stringstream ss;
+    ss << "bandwidth='" << s.bytes.rate << "' iops='" << s.reads.rate << "' waits='" << waits
+       << "' wait_seconds='" << wait_ns / 1e9 << "' reloads='" << reloads << "'";
+    return ss.str();
+}
@@ -0,0 +1,49 @@
+#ifndef IO_THROTTLE_H
+#define IO_THROTTLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * io_throttle:
+ * A limit on the image reads of phase 1, in bytes a second (-S io_bandwidth) and reads a second
+ * (-S io_iops), for images on storage that others share: a scan that reads at 70% of the array all
+ * day is better than one that reads at 100% until it is killed.
+ *
+ * Each limit is a token bucket that holds a second of its rate, so a burst of reads after an idle
+ * spell goes at full speed and the average stays at the rate. Phase 1 charges every read after it
+ * is made, with the bytes it got (get_sbuf() and the runs of -s), and the reader thread waits until
+ * both buckets have room again; with several reader threads they share the buckets. Depth-0 pages
+ * of a memory-mapped image (-S raw_mmap) are charged as they are handed out, as their pages fault in
+ * when the scanners touch them.
+ *
+ * The limits can be changed while the job runs with a control file (-S io_control_file) of lines
+ * bandwidth=N and iops=N (N may end in K, M or G; 0 for no limit). It is read when it is set, again
+ * when its modification time changes (checked at most once a second), and at once on SIGUSR1.
+ * A file that cannot be read leaves the limits as they were.
+ */
+
+class io_throttle {
+public:
+    static void set_limits(uint64_t bytes_per_second, uint64_t reads_per_second);
+    static uint64_t bandwidth();
+    static uint64_t iops();
+
+    /* Reads the file now, and watches it; throws std::runtime_error if it cannot be read or parsed */
+    static void set_control_file(const std::string &path);
+    static bool enabled();              // a limit or a control file is set
+
+    /* A read of bytes was made: waits until the buckets have room for the next */
+    static void charge(uint64_t bytes);
+
+    static inline std::atomic<uint64_t> waits {0};        // reads that were held back
+    static inline std::atomic<uint64_t> wait_ns {0};
+    static inline std::atomic<uint64_t> reloads {0};      // of the control file
+    static std::string xml_attributes();                  // for the <io_throttle> report element
+
+    /* bandwidth=N and iops=N lines; throws std::invalid_argument on others */
+    static void parse_control(const std::string &text, uint64_t &bytes_per_second, uint64_t &reads_per_second);
+};
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * jpeg_candidates.cpp:
+ * The JPEG validations and TIFF offsets shared by the JPEG-aware scanners; see jpeg_candidates.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include "exif_reader.h"
+#include "jpeg_candidates.h"
+
+namespace {
+    const size_t CACHE_DEPTHS = 8;      // deeper sbufs share the last cache entry
+
+    struct candidate {
+        size_t start {0};
+        signed char headers {-1};       // validate_jpeg(headers_only) accepted it; -1 if not asked
+        bool validated {false};
+        jpeg_validator::results_t res {};
+        bool tiff_checked {false};
+        size_t tiff_offset {0};
+    };
+
+    struct cache_entry {
+        const sbuf_t  *sbuf {nullptr};
+        const uint8_t *buf {nullptr};
+        size_t         bufsize {0};
+        size_t         pagesize {0};
+        uint64_t       offset {0};      // the pos0, compared without formatting it
+        std::string    path {};
+        std::vector<candidate> candidates {};   // by start
+    };
+
+    candidate &lookup(const sbuf_t &sbuf, size_t start)
+    {
+        static thread_local std::array<cache_entry, CACHE_DEPTHS> cache;
+        cache_entry &entry = cache[std::min<size_t>(std::max(sbuf.depth(), 0), CACHE_DEPTHS - 1)];
+        if (entry.sbuf != &sbuf || entry.buf != sbuf.get_buf() ||
+            entry.bufsize != sbuf.bufsize || entry.pagesize != sbuf.pagesize ||
+            entry.offset != sbuf.pos0.offset || entry.path != sbuf.pos0.path) {
+            entry.sbuf     = &sbuf;
+            entry.buf      = sbuf.get_buf();
+            entry.bufsize  = sbuf.bufsize;
+            entry.pagesize = sbuf.pagesize;
+            entry.offset   = sbuf.pos0.offset;
+            entry.path     = sbuf.pos0.path;
+            entry.candidates.clear();
+        }
+        auto it = std::lower_bound(entry.candidates.begin(), entry.candidates.end(), start,
+                                   [](const candidate &c, size_t s) { return c.start < s; });
+        if (it == entry.candidates.end() || it->start != start) {
+            it = entry.candidates.insert(it, candidate());
+            it->start = start;
+        }
+        return *it;
+    }
+}
+
+bool jpeg_candidates::headers_valid(const sbuf_t &sbuf, size_t start)
+{
+    candidate &c = lookup(sbuf, start);
+    if (c.validated) return c.res.len > 0;
+    if (c.headers < 0) c.headers = jpeg_validator::validate_jpeg(sbuf.slice(start), true).len > 0;
+    return c.headers > 0;
+}
+
+jpeg_validator::results_t jpeg_candidates::validate(const sbuf_t &sbuf, size_t start)
+{
+    candidate &c = lookup(sbuf, start);
+    if (!c.validated) {
+        if (c.headers == 0) {
+            c.res.how = jpeg_validator::CORRUPT;        // the full validation would stop where the headers did
+            c.res.len = 0;
+        } else {
+            c.res = jpeg_validator::validate_jpeg(sbuf.slice(start));
+        }
+        c.validated = true;
+    }
+    return c.res;
+}
+
+size_t jpeg_candidates::tiff_offset(const sbuf_t &sbuf, size_t start)
+{
+    candidate &c = lookup(sbuf, start);
+    if (!c.tiff_checked) {
+        const size_t offset = exif_reader::get_tiff_offset_from_exif(sbuf.slice(start));
+        if (offset != 0 && tiff_reader::is_maybe_valid_tiff(sbuf.slice(start + offset))) c.tiff_offset = offset;
+        c.tiff_checked = true;
+    }
+    return c.tiff_offset;
+}
@@ -0,0 +1,38 @@
+#ifndef JPEG_CANDIDATES_H
+#define JPEG_CANDIDATES_H
+
+#include <cstddef>
+
+#include "be13_api/sbuf.h"
+#include "jpeg_validator.h"
+
+/**
+ * jpeg_candidates:
+ * What the JPEG-aware scanners (scan_exif, scan_exiv2) learn about the JPEGs in an sbuf, worked out
+ * once for all of them. With both enabled each found the same FFD8FF starts and ran
+ * jpeg_validator over them, and scan_exif validated a JPEG's headers and then the whole JPEG again
+ * to carve it.
+ *
+ * A candidate is a start in the sbuf; each of its answers is worked out the first time a scanner
+ * asks for it and kept with the sbuf: whether validate_jpeg() accepts its headers, the full
+ * validation (the length that is carved), and the offset of the TIFF in its Exif APP1. The
+ * answers are cached per thread and recursion depth, as signature_prefilter::candidates() is,
+ * and are valid until the next call for another sbuf at the same depth; the starts are of the
+ * sbuf given, not of a slice of it.
+ *
+ * A JPEG whose headers are rejected is rejected by the full validation too, so the one is not run
+ * after the other; and a JPEG that was validated in full has its headers answered from that.
+ */
+
+class jpeg_candidates {
+public:
+    /* validate_jpeg(sbuf.slice(start), true).len > 0 */
+    static bool headers_valid(const sbuf_t &sbuf, size_t start);
+    /* validate_jpeg(sbuf.slice(start)) */
+    static jpeg_validator::results_t validate(const sbuf_t &sbuf, size_t start);
+    /* The offset from start of the TIFF in the JPEG's Exif APP1, if tiff_reader::is_maybe_valid_tiff()
+     * accepts it, else 0 */
+    static size_t tiff_offset(const sbuf_t &sbuf, size_t start);
+};
+
+#endif
@@ -7,6 +7,8 @@
 #ifndef JPEG_VALIDTOR_H
 #define JPEG_VALIDTOR_H
 
+#include <cstring>
+
 #include "be13_api/sbuf.h"
 
 extern bool exif_debug;
@@ -34,7 +36,10 @@ struct jpeg_validator {
         uint16_t height;
         uint16_t width;
     };
-    static struct results_t validate_jpeg(const sbuf_t &sbuf) {
+    /* With headers_only, stop at the start of scan: a JPEG that gets that far is never rejected,
+     * so len > 0 tells whether validate_jpeg() would accept it without scanning the image data.
+     */
+    static struct results_t validate_jpeg(const sbuf_t &sbuf, bool headers_only = false) {
         if (exif_debug) std::cerr << "validate_jpeg " << sbuf << "\n";
         results_t res;
         res.how = UNKNOWN;
@@ -76,6 +81,11 @@ struct jpeg_validator {
                 {
                     if (i+8 >= sbuf.bufsize){i+=8;break;} // whoops - not enough
                     uint16_t block_length = sbuf.get16uBE(i+2);
+                    if (block_length < 2) {     // the length includes itself
+                        EDEBUG("CORRUPT block length");
+                        res.how = CORRUPT;
+                        break;
+                    }
                     if (sbuf[i+1]==0xc4) res.seen_ff_c4 = true;
                     if (sbuf[i+1]==0xcc) res.seen_ff_cc = true;
                     if (sbuf[i+1]==0xdb) res.seen_ff_db = true;
@@ -111,6 +121,10 @@ struct jpeg_validator {
                     res.len = 0;
                     return res;
                 }
+                if (headers_only) {
+                    res.len = i;            // past the SOI, so never 0
+                    return res;
+                }
 
                 // http://webtweakers.com/swag/GRAPHICS/0143.PAS.html
                 //printf("start of scan. i=%zd header=%d\n",i,sbuf.get16uBE(i+2));
@@ -118,11 +132,14 @@ struct jpeg_validator {
                 i += 2 + sbuf.get16uBE(i+2);   // skip ff da and minor header info
 
                 // Image data follows
-                // Scan for EOI or an unescaped invalid FF
-                for(;i+1 < sbuf.bufsize;i++){
-                    if (sbuf[i]!=0xff){  // Non-FF can be skipped
-                        continue;
+                // Scan for EOI or an unescaped invalid FF; the bytes in between are skipped with memchr
+                for(const uint8_t *buf = sbuf.get_buf(); i+1 < sbuf.bufsize; i++){
+                    const uint8_t *ff = static_cast<const uint8_t *>(memchr(buf + i, 0xff, sbuf.bufsize - 1 - i));
+                    if (ff == nullptr) {
+                        i = sbuf.bufsize - 1;
+                        break;
                     }
+                    i = ff - buf;
                     if (sbuf[i+1]==0x00){ // escaped FF
                         continue;
                     }
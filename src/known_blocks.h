@@ -0,0 +1,65 @@
+#ifndef KNOWN_BLOCKS_H
+#define KNOWN_BLOCKS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+/**
+ * known_blocks:
+ * A database of the hashes of BLOCK_SIZE blocks of known files (stock operating system and application
+ * files), so that phase 1 does not scan them on every case (-S known_blocks=DB). The blocks of a page are
+ * hashed where the page is scheduled; a page whose blocks are all known is not scanned, and a run of at
+ * least MIN_SKIP_BLOCKS known blocks is cut out of the page, whose other parts are scheduled as pieces
+ * with their margins, as -G auto splits the last pages. The pages and bytes skipped are in the report.
+ *
+ * The database is built by bulk_extractor --build-known-blocks DB PATH..., from every whole block of the
+ * files under each PATH (blocks that are all one byte value are left out). It is the hashes, sorted, after
+ * a 16-byte header, and it is memory-mapped; a lookup is a binary search of the hashes with the same top
+ * INDEX_BITS bits, which an index built when the database is opened finds.
+ *
+ * The hash is 64 bits of eight independent multiply-rotate lanes (after xxHash64), about 9 GB/s on one
+ * core; a block is wrongly taken as known about once in 2^64 / (hashes in the database) blocks.
+ */
+
+class known_blocks {
+public:
+    static inline const size_t BLOCK_SIZE {4096};
+    static inline const size_t MIN_SKIP_BLOCKS {16}; // shorter runs are scanned; a piece costs a call of every scanner
+    static inline const unsigned INDEX_BITS {16};
+    static inline const char MAGIC[8] {'B','E','K','N','O','W','N','1'};
+
+    static uint64_t hash(const uint8_t *block); // of BLOCK_SIZE bytes
+    /* Writes the database of the blocks of the files under paths; returns the number of hashes */
+    static uint64_t build(const std::vector<std::filesystem::path> &paths, const std::filesystem::path &db, std::ostream &cerr);
+
+    explicit known_blocks(const std::filesystem::path &db); // throws std::runtime_error if it cannot be read
+    ~known_blocks();
+    known_blocks(const known_blocks &)=delete;
+    known_blocks &operator=(const known_blocks &)=delete;
+
+    uint64_t size() const { return count; }
+    bool     contains(uint64_t h) const;
+
+    /* The runs of at least MIN_SKIP_BLOCKS known blocks in buf, [start, end) from buf, where buf is at
+     * offset in the image; the blocks are those aligned to BLOCK_SIZE in the image.
+     */
+    std::vector<std::pair<size_t, size_t>> known_runs(const uint8_t *buf, size_t len, uint64_t offset) const;
+
+    static inline std::atomic<uint64_t> skipped_pages {0}; // not scanned
+    static inline std::atomic<uint64_t> skipped_bytes {0}; // including those of skipped pages
+
+private:
+    const uint64_t *hashes {nullptr};
+    uint64_t count {0};
+    void     *map {nullptr};
+    size_t   map_len {0};
+    std::vector<uint64_t> loaded {};    // where there is no mmap
+    std::vector<uint64_t> index {};     // of the first hash with each value of the top INDEX_BITS; 2^INDEX_BITS+1 entries
+};
+
+#endif
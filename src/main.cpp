@@ -6,11 +6,50 @@
  */
 
 #include "config.h"
+#include "bulk_diff.h"
 #include "bulk_extractor.h"
+#include "bulk_extractor_batch.h"
+#include "bulk_extractor_scaling.h"
+#include "bulk_extractor_server.h"
+#include "identify_filenames.h"
+#include "known_blocks.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <ostream>
 
 int main(int argc,char * const *argv)
 {
+    /* bulk_extractor --batch FILE [THREADS] */
+    if (argc>=3 && strcmp(argv[1],"--batch")==0) {
+        return bulk_extractor_batch::run(argv[2], argc>3 ? atoi(argv[3]) : 0, std::cout, std::cerr)==0 ? 0 : 1;
+    }
+    /* bulk_extractor --benchmark-scaling [OPTIONS] -o OUTDIR [IMAGE] [-- OPTIONS] */
+    if (argc>=2 && strcmp(argv[1],"--benchmark-scaling")==0) {
+        return bulk_extractor_scaling::main(argc-1, argv+1, std::cout, std::cerr);
+    }
+    /* bulk_extractor --build-known-blocks DB PATH... */
+    if (argc>=4 && strcmp(argv[1],"--build-known-blocks")==0) {
+        try {
+            const uint64_t count = known_blocks::build(std::vector<std::filesystem::path>(argv + 3, argv + argc), argv[2], std::cerr);
+            std::cout << argv[2] << ": " << count << " known blocks" << std::endl;
+            return 0;
+        } catch (const std::exception &e) {
+            std::cerr << "bulk_extractor: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    /* bulk_extractor --diff [OPTIONS] PRE POST */
+    if (argc>=2 && strcmp(argv[1],"--diff")==0) {
+        return bulk_diff::main(argc-1, argv+1, std::cout, std::cerr);
+    }
+    /* bulk_extractor --identify-filenames [OPTIONS] DFXML REPORT_DIR OUTDIR */
+    if (argc>=2 && strcmp(argv[1],"--identify-filenames")==0) {
+        return identify_filenames::main(argc-1, argv+1, std::cout, std::cerr);
+    }
+    /* bulk_extractor --serve SOCKET [JOBS] */
+    if (argc>=3 && strcmp(argv[1],"--serve")==0) {
+        return bulk_extractor_server::serve(argv[2], argc>3 ? atoi(argv[3]) : 1, std::cerr);
+    }
     return bulk_extractor_main(std::cout, std::cerr, argc, argv);
 }
@@ -0,0 +1,268 @@
+/**
+ * memory_dump.cpp:
+ * The runs of LiME images and Windows crash dumps; see memory_dump.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "memory_dump.h"
+
+namespace {
+const uint32_t LIME_MAGIC {0x4C694D45};   // "EMiL"
+const uint64_t LIME_HEADER_SIZE {32};
+const uint64_t BITMAP_CHUNK {1024 * 1024}; // bytes of a bitmap read at a time
+
+uint32_t le32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+uint64_t le64(const uint8_t *p) { return le32(p) | (uint64_t(le32(p + 4)) << 32); }
+
+/* The header of a full crash dump: where its run list and dump type are, and how long it is */
+struct crashdump_layout {
+    uint64_t header_size;
+    uint64_t runs;                      // the PHYSICAL_MEMORY_DESCRIPTOR
+    uint64_t dump_type;
+    unsigned field;                     // bytes of each field of the descriptor
+};
+const crashdump_layout DUMP32 {0x1000, 0x64, 0xF88, 4};
+const crashdump_layout DUMP64 {0x2000, 0x88, 0xF98, 8};
+const uint32_t FULL_DUMP {1};
+}
+
+const char *memory_dump::format_name(format_t f)
+{
+    switch (f) {
+    case LIME:      return "LiME";
+    case CRASHDUMP: return "crash dump";
+    default:        return "none";
+    }
+}
+
+memory_dump::format_t memory_dump::detect(const std::filesystem::path &fn)
+{
+    int f = ::open(fn.string().c_str(), O_RDONLY|O_BINARY);
+    if (f < 0) return NONE;
+    uint8_t magic[8] {};
+    const ssize_t n = ::pread(f, magic, sizeof(magic), 0);
+    ::close(f);
+    if (n != sizeof(magic)) return NONE;
+    if (le32(magic)==LIME_MAGIC && le32(magic + 4)==1) return LIME;
+    if (memcmp(magic, "PAGEDUMP", 8)==0 || memcmp(magic, "PAGEDU64", 8)==0) return CRASHDUMP;
+    return NONE;
+}
+
+memory_dump::memory_dump(const std::filesystem::path &fn): fname(fn)
+{
+    format_ = detect(fn);
+    fd = ::open(fn.string().c_str(), O_RDONLY|O_BINARY);
+    if (fd < 0 || format_ == NONE) {
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error(fn.string() + ": not a LiME image or a crash dump");
+    }
+    try {
+        file_size = std::filesystem::file_size(fn);
+        switch (format_) {
+        case LIME:      open_lime(); break;
+        case CRASHDUMP: open_crashdump(); break;
+        default: break;
+        }
+        std::sort(runs_.begin(), runs_.end(), [](const run &a, const run &b){ return a.start < b.start; });
+        for (size_t i = 1; i < runs_.size(); i++) {
+            if (runs_[i].start < runs_[i-1].start + runs_[i-1].length) {
+                throw std::runtime_error(fname.string() + ": memory ranges overlap at " + std::to_string(runs_[i].start));
+            }
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+memory_dump::~memory_dump()
+{
+    ::close(fd);
+}
+
+void memory_dump::read_file(void *buf, size_t len, uint64_t offset) const
+{
+    for (size_t done = 0; done < len; ) {
+        const ssize_t n = ::pread(fd, static_cast<uint8_t *>(buf) + done, len - done, offset + done);
+        if (n <= 0) {
+            throw std::runtime_error(fname.string() + ": cannot read " + std::to_string(len)
+                                     + " bytes at " + std::to_string(offset));
+        }
+        done += n;
+    }
+}
+
+/* A run that goes past the end of the file (an acquisition that was cut short) is cut there; one that wraps
+ * the address space, or starts before the end of the run before it, is refused
+ */
+void memory_dump::add_run(uint64_t start, uint64_t length, uint64_t file_offset)
+{
+    if (length > UINT64_MAX - start) {
+        throw std::runtime_error(fname.string() + ": a run at " + std::to_string(start) + " wraps the address space");
+    }
+    if (!runs_.empty() && start < size()) {
+        throw std::runtime_error(fname.string() + ": the run at " + std::to_string(start) + " overlaps the one before it");
+    }
+    if (file_offset >= file_size) return;
+    length = std::min(length, file_size - file_offset);
+    if (length == 0) return;
+    if (!runs_.empty() && runs_.back().start + runs_.back().length == start
+        && runs_.back().file_offset + runs_.back().length == file_offset) {
+        runs_.back().length += length;
+        return;
+    }
+    runs_.push_back(run{start, length, file_offset});
+}
+
+void memory_dump::open_lime()
+{
+    for (uint64_t pos = 0; pos + LIME_HEADER_SIZE <= file_size; ) {
+        uint8_t h[LIME_HEADER_SIZE];
+        read_file(h, sizeof(h), pos);
+        if (le32(h) != LIME_MAGIC || le32(h + 4) != 1) {
+            throw std::runtime_error(fname.string() + ": no LiME header at " + std::to_string(pos));
+        }
+        const uint64_t start = le64(h + 8);
+        const uint64_t end   = le64(h + 16); // inclusive
+        if (end < start || end - start == UINT64_MAX) {
+            throw std::runtime_error(fname.string() + ": bad LiME range at " + std::to_string(pos));
+        }
+        const uint64_t length = end - start + 1;
+        add_run(start, length, pos + LIME_HEADER_SIZE);
+        if (length > file_size) break;  // cut short
+        pos += LIME_HEADER_SIZE + length;
+    }
+}
+
+void memory_dump::open_crashdump()
+{
+    uint8_t magic[8];
+    read_file(magic, sizeof(magic), 0);
+    const crashdump_layout &l = memcmp(magic, "PAGEDU64", 8)==0 ? DUMP64 : DUMP32;
+    if (file_size < l.header_size) throw std::runtime_error(fname.string() + ": crash dump header is cut short");
+    std::vector<uint8_t> h(l.header_size);
+    read_file(h.data(), h.size(), 0);
+
+    if (le32(&h[l.dump_type]) == FULL_DUMP) {
+        /* NumberOfRuns, NumberOfPages, then (BasePage, PageCount) for each run; NumberOfRuns is 32 bits */
+        auto field = [&](uint64_t off){ return l.field == 8 ? le64(&h[off]) : le32(&h[off]); };
+        const uint64_t nruns = le32(&h[l.runs]);
+        const uint64_t first = l.runs + 2 * l.field;
+        if (first + nruns * 2 * l.field > l.dump_type) {
+            throw std::runtime_error(fname.string() + ": crash dump has " + std::to_string(nruns) + " runs");
+        }
+        uint64_t file_offset = l.header_size;
+        for (uint64_t i = 0; i < nruns && file_offset < file_size; i++) { // the later runs are not in the file
+            const uint64_t base  = field(first + i * 2 * l.field);
+            const uint64_t pages = field(first + i * 2 * l.field + l.field);
+            if (base > UINT64_MAX / PAGE_SIZE || pages > UINT64_MAX / PAGE_SIZE) {
+                throw std::runtime_error(fname.string() + ": crash dump run " + std::to_string(i) + " is out of range");
+            }
+            add_run(base * PAGE_SIZE, pages * PAGE_SIZE, file_offset);
+            file_offset += std::min(pages * PAGE_SIZE, file_size - file_offset);
+        }
+        return;
+    }
+    uint8_t sig[8] {};
+    if (&l == &DUMP64 && file_size >= l.header_size + 0x38) read_file(sig, sizeof(sig), l.header_size);
+    if ((memcmp(sig, "SDMP", 4)==0 || memcmp(sig, "FDMP", 4)==0) && memcmp(sig + 4, "DUMP", 4)==0) {
+        read_bitmap(l.header_size);
+        return;
+    }
+    throw std::runtime_error(fname.string() + ": crash dump type " + std::to_string(le32(&h[l.dump_type]))
+                             + " is not supported; only full and bitmap dumps are");
+}
+
+/* The bitmap header: HeaderSize (where the pages start) at 0x20, BitmapSize (in pages) at 0x28, the bitmap at 0x38 */
+void memory_dump::read_bitmap(uint64_t header_offset)
+{
+    uint8_t h[0x38];
+    read_file(h, sizeof(h), header_offset);
+    uint64_t file_offset = le64(h + 0x20);
+    const uint64_t bits  = le64(h + 0x28);
+    const uint64_t bitmap = header_offset + sizeof(h);
+    if (bits > file_size * 8 || bitmap + (bits + 7) / 8 > file_size || file_offset < bitmap + (bits + 7) / 8) {
+        throw std::runtime_error(fname.string() + ": crash dump bitmap of " + std::to_string(bits) + " pages does not fit");
+    }
+    std::vector<uint8_t> buf;
+    for (uint64_t byte = 0; byte < (bits + 7) / 8 && file_offset < file_size; byte += buf.size()) {
+        buf.resize(std::min(BITMAP_CHUNK, (bits + 7) / 8 - byte));
+        read_file(buf.data(), buf.size(), bitmap + byte);
+        for (size_t i = 0; i < buf.size(); i++) {
+            if (buf[i] == 0) continue;
+            for (unsigned b = 0; b < 8; b++) {
+                const uint64_t page = (byte + i) * 8 + b;
+                if (page >= bits || ((buf[i] >> b) & 1) == 0) continue;
+                if (file_offset >= file_size) return;   // the later pages are not in the file
+                add_run(page * PAGE_SIZE, PAGE_SIZE, file_offset);
+                file_offset += PAGE_SIZE;
+            }
+        }
+    }
+}
+
+uint64_t memory_dump::stored_bytes() const
+{
+    uint64_t n = 0;
+    for (const auto &r : runs_) n += r.length;
+    return n;
+}
+
+/* The index of the run with addr, or of the first run after it */
+static size_t run_at(const std::vector<memory_dump::run> &runs, uint64_t addr)
+{
+    auto it = std::upper_bound(runs.begin(), runs.end(), addr,
+                               [](uint64_t a, const memory_dump::run &r){ return a < r.start; });
+    if (it != runs.begin() && addr < (it - 1)->start + (it - 1)->length) --it;
+    return it - runs.begin();
+}
+
+uint64_t memory_dump::next_stored(uint64_t addr) const
+{
+    const size_t i = run_at(runs_, addr);
+    if (i == runs_.size()) return size();
+    return std::max(addr, runs_[i].start);
+}
+
+uint64_t memory_dump::stored_below(uint64_t addr) const
+{
+    uint64_t n = 0;
+    for (const auto &r : runs_) {
+        if (r.start >= addr) break;
+        n += std::min(r.length, addr - r.start);
+    }
+    return n;
+}
+
+ssize_t memory_dump::read(uint8_t *buf, size_t len, uint64_t addr) const
+{
+    if (addr >= size()) return 0;
+    len = std::min<uint64_t>(len, size() - addr);
+    memset(buf, 0, len);
+    for (size_t i = run_at(runs_, addr); i < runs_.size() && runs_[i].start < addr + len; i++) {
+        const run &r = runs_[i];
+        const uint64_t from = std::max(addr, r.start);
+        const uint64_t to   = std::min(addr + len, r.start + r.length);
+        for (uint64_t done = 0; done < to - from; ) {
+            const ssize_t n = ::pread(fd, buf + (from - addr) + done, to - from - done, r.file_offset + (from - r.start) + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            done += n;
+        }
+    }
+    return len;
+}
@@ -0,0 +1,79 @@
+#ifndef MEMORY_DUMP_H
+#define MEMORY_DUMP_H
+
+/**
+ * memory_dump: the layouts of memory images whose files are not the physical memory byte for byte,
+ * read in physical address order (see process_memdump in image_process.h):
+ *
+ *   LIME      - Linux Memory Extractor; each range of memory follows a 32-byte header with its start
+ *               and (inclusive) end address
+ *   CRASHDUMP - a Windows full memory dump (PAGEDUMP or PAGEDU64), whose header lists the runs of
+ *               physical pages stored after it, or a bitmap dump (a full, kernel or automatic dump of
+ *               Windows 8 and later), whose header is followed by a bitmap of the physical pages stored
+ *
+ * The constructor reads the layout into runs, each a range of physical addresses and where it is in
+ * the file. The image is the physical address space, up to the end of the last run; the addresses in no
+ * run (the holes under 4 GiB, and what a kernel dump leaves out) read as zeros and are not scanned, and
+ * the offsets of the features found are physical addresses.
+ *
+ * Hibernation files are not supported; their pages are Xpress-compressed, and decompressing them is
+ * the work of a converter (e.g. Volatility's imagecopy). A malformed header throws std::runtime_error.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <sys/types.h>
+
+class memory_dump {
+public:
+    enum format_t { NONE, LIME, CRASHDUMP };
+    static const char *format_name(format_t f);
+    static inline const uint64_t PAGE_SIZE {4096}; // of the crash dump runs and bitmaps
+
+    struct run {
+        uint64_t start {0};             // physical address
+        uint64_t length {0};
+        uint64_t file_offset {0};
+    };
+
+    /* The format of a file, from its magic number; NONE if it is neither */
+    static format_t detect(const std::filesystem::path &fn);
+
+    /* Opens fn and reads its runs; throws std::runtime_error if it is malformed or not supported */
+    explicit memory_dump(const std::filesystem::path &fn);
+    ~memory_dump();
+    memory_dump(const memory_dump &)=delete;
+    memory_dump &operator=(const memory_dump &)=delete;
+
+    format_t format() const { return format_; }
+    uint64_t size() const { return runs_.empty() ? 0 : runs_.back().start + runs_.back().length; }
+    uint64_t stored_bytes() const;
+    const std::vector<run> &runs() const { return runs_; }
+
+    /* The first address at or after addr that is in a run; size() if there is none */
+    uint64_t next_stored(uint64_t addr) const;
+    /* Bytes of the runs below addr */
+    uint64_t stored_below(uint64_t addr) const;
+
+    /* Copies physical addresses [addr, addr+len) into buf; returns the bytes copied (short at the end),
+     * or -1 if the file cannot be read. May be called from several threads at once.
+     */
+    ssize_t  read(uint8_t *buf, size_t len, uint64_t addr) const;
+
+private:
+    void     open_lime();
+    void     open_crashdump();
+    void     read_bitmap(uint64_t header_offset);
+    void     add_run(uint64_t start, uint64_t length, uint64_t file_offset);
+    void     read_file(void *buf, size_t len, uint64_t offset) const; // all of it, or throws
+
+    const std::filesystem::path fname;
+    int      fd {-1};
+    uint64_t file_size {0};
+    format_t format_ {NONE};
+    std::vector<run> runs_ {};          // by start, not overlapping
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "config.h"
+
+#include <cmath>
+#include <fstream>
+#include <thread>
+
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#include "memory_governor.h"
+
+uint64_t memory_governor::resident_bytes()
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (statm >> size >> resident) {
+        static const uint64_t vm_pagesize = sysconf(_SC_PAGESIZE);
+        return resident * vm_pagesize;
+    }
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count)==KERN_SUCCESS) {
+        return info.resident_size;
+    }
+#endif
+    return 0;
+}
+
+uint64_t memory_governor::allocated_bytes()
+{
+#ifdef HAVE_MALLINFO2
+    const struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;     // chunks in use in the arenas, and chunks of their own mapping
+#else
+    return 0;
+#endif
+}
+
+uint64_t memory_governor::used_bytes()
+{
+    const uint64_t allocated = allocated_bytes();
+    return allocated ? allocated : resident_bytes();
+}
+
+uint64_t memory_governor::budget_at(unsigned depth)
+{
+    const double reserve = depth_reserve;
+    if (reserve <= 0 || reserve >= 1) return budget;
+    return budget * (1 - std::pow(reserve, depth + 1));
+}
+
+bool memory_governor::over_budget(uint64_t bytes, unsigned depth)
+{
+    const uint64_t b = budget_at(depth);
+    if (b==0 || bytes < MIN_GOVERNED) return false;
+    const uint64_t used = used_bytes();
+    return used!=0 && used + bytes > b;
+}
+
+bool memory_governor::wait_for_budget(uint64_t bytes, unsigned depth, std::chrono::milliseconds max_wait)
+{
+    if (!over_budget(bytes, depth)) return true;
+    waits++;
+    const auto deadline = std::chrono::steady_clock::now() + max_wait;
+    while (over_budget(bytes, depth)) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            timeouts++;
+            return false;
+        }
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * memory_governor:
+ * Keeps the memory that the process has allocated under a byte budget (-S memory_budget).
+ *
+ * Recursive sbufs are freed by whichever worker finishes with them, and sbuf_t has no hook to say
+ * so, so the governor counts what the allocator counts: the bytes of the malloc heap that are in
+ * use (mallinfo2), which go up with each sbuf_malloc() and down as soon as its sbuf is deleted.
+ * Heap that malloc keeps after a free, and file pages mapped by -S raw_mmap, are not counted; they
+ * are resident but can be reused or dropped. Where the allocator cannot say, the governor falls back
+ * to the resident size of the process. Code that is about to make a large allocation calls
+ * wait_for_budget(), which waits (polling) until there is room.
+ *
+ * Phase 1 waits at most READER_WAIT before reading another page, and not at all once the scanner
+ * queue is empty, since then nothing it waits for will be freed. Scanners wait at most SCANNER_WAIT
+ * before allocating anyway: every worker may be waiting for memory that only a worker can free, and
+ * dropping the recursion would lose evidence.
+ *
+ * The budget can be shared out by recursion depth (-S memory_depth_reserve), so that when memory is
+ * short the shallow work stops before the deep: each depth may use all but depth_reserve of what the
+ * depth above it may not, so with a reserve of 0.25 phase 1 stops reading new pages at 75% of the
+ * budget, the children of depth 0 wait at 94% and those of depth 1 at 98%. The decompressed children
+ * of zip, gzip and base64 chains then run to the end and free their parents' buffers, instead of more
+ * parents being read and decoded behind them.
+ */
+
+class memory_governor {
+    static inline std::atomic<uint64_t> budget {0};    // 0 for no budget
+    static inline std::atomic<double>   depth_reserve {0}; // of each depth's budget, left for the depths below
+public:
+    static inline std::atomic<uint64_t> waits {0};     // allocations that had to wait
+    static inline std::atomic<uint64_t> timeouts {0};  // allocations that went ahead over budget
+    static inline std::atomic<uint64_t> reader_timeouts {0}; // pages that phase 1 read over budget
+    static inline const uint64_t MIN_GOVERNED {1024*1024}; // smaller allocations are not governed
+    static inline const auto POLL_INTERVAL = std::chrono::milliseconds(5);
+    static inline const auto SCANNER_WAIT  = std::chrono::seconds(10);
+    static inline const auto READER_WAIT   = std::chrono::seconds(30);
+
+    static void     set_budget(uint64_t bytes) { budget = bytes; }
+    static uint64_t get_budget() { return budget; }
+    static void     set_depth_reserve(double reserve) { depth_reserve = reserve; }
+    static double   get_depth_reserve() { return depth_reserve; }
+    static uint64_t budget_at(unsigned depth); // the share of the budget for the sbufs made at depth
+    static uint64_t resident_bytes();   // resident size of the process; 0 if it cannot be determined
+    static uint64_t allocated_bytes();  // bytes of the malloc heap in use; 0 if it cannot be determined
+    static uint64_t used_bytes();       // what is held against the budget: allocated_bytes(), else resident_bytes()
+    /* true if allocating bytes for an sbuf at depth would exceed its budget */
+    static bool     over_budget(uint64_t bytes, unsigned depth = 0);
+
+    /* Wait until bytes can be allocated for an sbuf at depth within its budget.
+     * Returns false if max_wait passed first. */
+    static bool     wait_for_budget(uint64_t bytes, unsigned depth, std::chrono::milliseconds max_wait = SCANNER_WAIT);
+};
+
+#endif
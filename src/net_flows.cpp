@@ -0,0 +1,58 @@
+#include "config.h"
+
+#include <sstream>
+
+#include "net_flows.h"
+
+bool net_flows::add(const uint8_t *datagram, size_t len, const pos0_t &where, const key_t *key)
+{
+    const bool copy = seen.check_for_presence_and_insert(content_cache::hash(datagram, len, 0));
+    if (copy) {
+        copies++;
+    } else {
+        packets++;
+    }
+    if (key == nullptr) return !copy;
+
+    std::lock_guard<std::mutex> lock(M);
+    auto it = table.find(*key);
+    if (it == table.end()) {
+        if (table.size() >= MAX_FLOWS) {
+            unrecorded++;
+            return !copy;
+        }
+        it = table.emplace(*key, flow_t()).first;
+        it->second.first = where;
+        it->second.last = where;
+    } else {
+        if (where < it->second.first) it->second.first = where;
+        if (it->second.last < where) it->second.last = where;
+    }
+    flow_t &f = it->second;
+    if (copy) {
+        f.copies++;
+    } else {
+        f.packets++;
+        f.bytes += len;
+    }
+    return !copy;
+}
+
+std::vector<std::pair<net_flows::key_t, net_flows::flow_t>> net_flows::take()
+{
+    std::vector<std::pair<key_t, flow_t>> ret;
+    std::lock_guard<std::mutex> lock(M);
+    ret.reserve(table.size());
+    for (auto &it : table) ret.emplace_back(it.first, std::move(it.second));
+    table.clear();
+    flows += ret.size();
+    return ret;
+}
+
+std::string net_flows::xml_attributes()
+{
+    std::stringstream ss;
+    ss << "packets='" << packets << "' copies='" << copies << "' flows='" << flows
+       << "' unrecorded='" << unrecorded << "'";
+    return ss.str();
+}
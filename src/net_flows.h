@@ -0,0 +1,74 @@
+#ifndef NET_FLOWS_H
+#define NET_FLOWS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "be13_api/sbuf.h"
+#include "content_cache.h"
+#include "seen_set.h"
+
+/**
+ * net_flows:
+ * The packets that scan_net carves, kept as flows (-S net_flows=YES) instead of one per hit. A memory
+ * image holds each packet many times over (socket buffers, the driver's rings, the pages they were
+ * copied through); the flow mode writes each distinct IP datagram to packets.pcap once, and counts
+ * every sighting in the flow of its 5-tuple (addresses, protocol and, for TCP and UDP, ports).
+ *
+ * A datagram is the same as another if its bytes hash the same; the Ethernet header in front of it,
+ * real or made up, is not hashed. At the end of the scan, scan_net writes one line per flow to
+ * net_flows.txt, at the first place that one of its packets was found, with the last place and its
+ * counts. Flows past MAX_FLOWS are not kept (their packets are still written) and are counted in
+ * unrecorded. With -S net_pcap=NO, packets.pcap is not written at all.
+ */
+
+class net_flows {
+public:
+    static inline const size_t MAX_FLOWS {1024 * 1024};
+    static inline const size_t MAX_PACKETS {16 * 1024 * 1024};  // hashes kept to find the copies
+
+    struct key_t {
+        uint8_t family {0};             // AF_INET or AF_INET6
+        uint8_t proto {0};              // the IP next header
+        uint16_t sport {0};             // TCP and UDP only; 0 for the others
+        uint16_t dport {0};
+        uint8_t src[16] {};             // IPv4 addresses in the last 4 bytes
+        uint8_t dst[16] {};
+        bool operator<(const key_t &that) const { return memcmp(this, &that, sizeof(key_t)) < 0; }
+    };
+    struct flow_t {
+        pos0_t first {};
+        pos0_t last {};
+        uint64_t packets {0};           // distinct datagrams
+        uint64_t copies {0};            // sightings of datagrams already seen
+        uint64_t bytes {0};             // of the distinct datagrams
+    };
+
+    /* Counts the datagram of len bytes found at where in the flow of key (nullptr if it is not IP);
+     * returns true if it has not been seen before and should be written */
+    static bool add(const uint8_t *datagram, size_t len, const pos0_t &where, const key_t *key);
+    /* The flows, in key order; they are cleared */
+    static std::vector<std::pair<key_t, flow_t>> take();
+
+    static inline std::atomic<uint64_t> packets {0};     // distinct datagrams
+    static inline std::atomic<uint64_t> copies {0};      // that were not written again
+    static inline std::atomic<uint64_t> flows {0};       // written to net_flows.txt
+    static inline std::atomic<uint64_t> unrecorded {0};  // flows past MAX_FLOWS
+    static std::string xml_attributes();                 // for the <net_flows> report element
+
+private:
+    struct hash128_hasher {
+        size_t operator()(const content_cache::hash128 &h) const { return h.lo; }
+    };
+    static inline seen_set<content_cache::hash128, hash128_hasher> seen {MAX_PACKETS};
+    static inline std::mutex M {};
+    static inline std::map<key_t, flow_t> table {};
+};
+
+#endif
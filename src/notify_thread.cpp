@@ -1,4 +1,14 @@
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
 #include "notify_thread.h"
+#include "feature_census.h"
+#include "memory_governor.h"
+#include "queue_stats.h"
+#include "scanner_watchdog.h"
+#include "trace_writer.h"
+#include "worker_tuner.h"
 
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
@@ -28,6 +38,103 @@ int notify_thread::terminal_width( int default_width )
 
 
 
+/* true if the whole string is a number, such as "1234" or "12.5"; "50.0 %" is not */
+static bool is_number(const std::string &s)
+{
+    if (s.empty()) return false;
+    char *end = nullptr;
+    strtod(s.c_str(), &end);
+    return end && *end=='\0';
+}
+
+/* Prometheus metric names are [a-zA-Z_:][a-zA-Z0-9_:]* */
+static std::string metric_name(const std::string &s)
+{
+    std::string ret("bulk_extractor_");
+    for (char ch : s) ret += isalnum(static_cast<unsigned char>(ch)) ? ch : '_';
+    return ret;
+}
+
+void notify_thread::write_json(std::ostream &os, const std::map<std::string,std::string> &stats,
+                               const std::map<std::string,scanner_watchdog::scanner_totals> &totals,
+                               const std::vector<uint64_t> &depths)
+{
+    os << "{\"stats\": {";
+    const char *sep = "";
+    for (const auto &it : stats) {
+        os << sep << trace_writer::json_string(it.first) << ": " << (is_number(it.second) ? it.second : trace_writer::json_string(it.second));
+        sep = ", ";
+    }
+    os << "},\n \"scanners\": {";
+    sep = "";
+    for (const auto &it : totals) {
+        os << sep << trace_writer::json_string(it.first) << ": {\"calls\": " << it.second.calls
+           << ", \"bytes\": " << it.second.bytes
+           << ", \"cpu_seconds\": " << it.second.cpu_seconds
+           << ", \"wall_seconds\": " << it.second.wall_seconds << "}";
+        sep = ",\n  ";
+    }
+    os << "},\n \"calls_by_depth\": [";
+    for (size_t i=0; i<depths.size(); i++) os << (i ? ", " : "") << depths[i];
+    os << "]}\n";
+}
+
+void notify_thread::write_prometheus(std::ostream &os, const std::map<std::string,std::string> &stats,
+                                     const std::map<std::string,scanner_watchdog::scanner_totals> &totals,
+                                     const std::vector<uint64_t> &depths)
+{
+    for (const auto &it : stats) {
+        const std::string &v = it.second;
+        if (is_number(v)) {
+            os << metric_name(it.first) << " " << v << "\n";
+        } else if (v.size()>2 && v.substr(v.size()-2)==" %" && is_number(v.substr(0, v.size()-2))) {
+            os << metric_name(it.first) << " " << strtod(v.c_str(), nullptr) / 100 << "\n"; // as a fraction
+        }
+    }
+    os << "# TYPE bulk_extractor_scanner_calls_total counter\n";
+    for (const auto &it : totals) {
+        os << "bulk_extractor_scanner_calls_total{scanner=\"" << it.first << "\"} " << it.second.calls << "\n";
+    }
+    os << "# TYPE bulk_extractor_scanner_bytes_total counter\n";
+    for (const auto &it : totals) {
+        os << "bulk_extractor_scanner_bytes_total{scanner=\"" << it.first << "\"} " << it.second.bytes << "\n";
+    }
+    os << "# TYPE bulk_extractor_scanner_cpu_seconds_total counter\n";
+    for (const auto &it : totals) {
+        os << "bulk_extractor_scanner_cpu_seconds_total{scanner=\"" << it.first << "\"} " << it.second.cpu_seconds << "\n";
+    }
+    os << "# TYPE bulk_extractor_scanner_wall_seconds_total counter\n";
+    for (const auto &it : totals) {
+        os << "bulk_extractor_scanner_wall_seconds_total{scanner=\"" << it.first << "\"} " << it.second.wall_seconds << "\n";
+    }
+    os << "# TYPE bulk_extractor_scanner_calls_by_depth_total counter\n";
+    for (size_t i=0; i<depths.size(); i++) {
+        os << "bulk_extractor_scanner_calls_by_depth_total{depth=\"" << i << "\"} " << depths[i] << "\n";
+    }
+}
+
+/* Each file is written to a temporary name and renamed, so readers never see a partial file */
+void notify_thread::write_stats_files(const std::filesystem::path &outdir, const std::map<std::string,std::string> &stats)
+{
+    const auto totals = scanner_watchdog::totals();
+    const auto depths = scanner_watchdog::depth_histogram();
+    for (const auto &fname : {STATS_JSON, STATS_PROMETHEUS}) {
+        std::filesystem::path path = outdir / fname;
+        std::filesystem::path tmp  = outdir / (fname + ".tmp");
+        {
+            std::ofstream os(tmp);
+            if (!os.is_open()) continue;
+            if (fname==STATS_JSON) {
+                write_json(os, stats, totals, depths);
+            } else {
+                write_prometheus(os, stats, totals, depths);
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+    }
+}
+
 void notify_thread::notifier( struct notify_thread::notify_opts *o)
 {
     assert( o->ssp != nullptr);
@@ -79,6 +186,13 @@ void notify_thread::notifier( struct notify_thread::notify_opts *o)
         time_t rawtime = time ( 0 );
         struct tm timeinfo = *( localtime( &rawtime ));
         std::map<std::string,std::string> stats = o->ssp->get_realtime_stats();
+        scanner_watchdog::add_realtime_stats( stats );
+        queue_stats::add_realtime_stats( stats );
+        feature_census::add_realtime_stats( stats );
+        worker_tuner::add_realtime_stats( stats );
+        if ( memory_governor::resident_bytes() ) {
+            stats[RESIDENT_MEMORY] = std::to_string( memory_governor::resident_bytes() );
+        }
 
         stats["elapsed_time"] = o->master_timer->elapsed_text();
         if ( o->fraction_done ) {
@@ -98,6 +212,9 @@ void notify_thread::notifier( struct notify_thread::notify_opts *o)
                           << " at " << stats[ESTIMATED_DATE_COMPLETION] << std::endl;
             }
         }
+        if ( o->cfg.opt_live_stats ) {
+            write_stats_files( o->ssp->sc.outdir, stats );
+        }
         if ( !o->cfg.opt_legacy) {
             std::cout << ho << "bulk_extractor      " << asctime( &timeinfo) << "  " << std::endl;
             for( const auto &it : stats ){
@@ -3,6 +3,8 @@
 
 #include "config.h"
 
+#include <map>
+#include <ostream>
 #include <string>
 #include <thread>
 #include <mutex>
@@ -10,6 +12,7 @@
 #include "be13_api/aftimer.h"
 #include "be13_api/scanner_set.h"
 #include "phase1.h"
+#include "scanner_watchdog.h"
 
 struct notify_thread {
     struct notify_opts {
@@ -25,6 +28,18 @@ struct notify_thread {
     static inline const std::string FRACTION_READ {"fraction_read"};
     static inline const std::string ESTIMATED_TIME_REMAINING {"estimated_time_remaining"};
     static inline const std::string ESTIMATED_DATE_COMPLETION {"estimated_date_completion"};
+    static inline const std::string RESIDENT_MEMORY {"resident_memory"};
+    static inline const std::string STATS_JSON {"stats.json"};
+    static inline const std::string STATS_PROMETHEUS {"stats.prom"};
+
+    /* Live statistics: the realtime stats, with the totals of each scanner and the calls at each depth */
+    static void write_json(std::ostream &os, const std::map<std::string,std::string> &stats,
+                           const std::map<std::string,scanner_watchdog::scanner_totals> &totals,
+                           const std::vector<uint64_t> &depths);
+    static void write_prometheus(std::ostream &os, const std::map<std::string,std::string> &stats,
+                                 const std::map<std::string,scanner_watchdog::scanner_totals> &totals,
+                                 const std::vector<uint64_t> &depths);
+    static void write_stats_files(const std::filesystem::path &outdir, const std::map<std::string,std::string> &stats);
 
     static int terminal_width( int default_width );
 
@@ -0,0 +1,140 @@
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "output_checkpoint.h"
+
+/* Gets the file's data to the disk; a file that cannot be opened is left as it is */
+static void sync_file(const std::filesystem::path &path)
+{
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+#endif
+}
+
+uint64_t output_checkpoint::whole_lines_length(const std::filesystem::path &path)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) return 0;
+    const size_t BLOCK_SIZE {64 * 1024};
+    uint64_t end = in.tellg();
+    std::vector<char> buf(BLOCK_SIZE);
+    while (end > 0) {
+        const uint64_t start = end > BLOCK_SIZE ? end - BLOCK_SIZE : 0;
+        in.seekg(start);
+        in.read(buf.data(), end - start);
+        if (in.gcount() != static_cast<std::streamsize>(end - start)) return 0;
+        for (uint64_t i = end; i > start; i--) {
+            if (buf[i - start - 1] == '\n') return i;
+        }
+        end = start;
+    }
+    return 0;
+}
+
+void output_checkpoint::write(std::ostream &os, const std::vector<file_length> &files, const page_ranges &pages)
+{
+    for (const auto &f : files) {
+        os << "file " << f.length << " " << f.name << "\n";
+    }
+    os << "pages\n";
+    pages.write(os);
+}
+
+void output_checkpoint::read(std::istream &is, std::vector<file_length> &files, page_ranges &pages)
+{
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line == "pages") {
+            pages.read(is);
+            return;
+        }
+        std::istringstream ls(line);
+        std::string word;
+        file_length f;
+        if (!(ls >> word >> f.length) || word != "file" || ls.get() != ' ' || !std::getline(ls, f.name) ||
+            f.name.empty() || std::filesystem::path(f.name).has_parent_path()) {
+            throw std::runtime_error("invalid line in output checkpoint: " + line);
+        }
+        files.push_back(f);
+    }
+    throw std::runtime_error("output checkpoint has no pages");
+}
+
+void output_checkpoint::save(const std::filesystem::path &outdir, const std::vector<std::string> &recorders,
+                             const page_ranges &pages)
+{
+    std::vector<file_length> files;
+    for (const auto &name : recorders) {
+        file_length f;
+        f.name = name + ".txt";
+        sync_file(outdir / f.name);
+        f.length = whole_lines_length(outdir / f.name);
+        files.push_back(f);
+    }
+
+    const std::filesystem::path fname = outdir / FILENAME;
+    const std::filesystem::path tmp = fname.string() + ".tmp";
+    {
+        std::ofstream os(tmp);
+        if (!os.is_open()) {
+            throw std::runtime_error("cannot create " + tmp.string());
+        }
+        write(os, files, pages);
+        os.close();
+        if (!os) {
+            throw std::runtime_error("cannot write " + tmp.string());
+        }
+    }
+    sync_file(tmp);
+    std::filesystem::rename(tmp, fname);
+    checkpoints++;
+}
+
+void output_checkpoint::restore(const std::filesystem::path &outdir, page_ranges &pages)
+{
+    std::vector<file_length> files;
+    {
+        std::ifstream in(outdir / FILENAME);
+        if (!in.is_open()) {
+            throw std::runtime_error("cannot open " + (outdir / FILENAME).string());
+        }
+        read(in, files, pages);
+    }
+    /* check them all before cutting any */
+    for (const auto &f : files) {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(outdir / f.name, ec);
+        if (f.length > 0 && (ec || size < f.length)) {
+            throw std::runtime_error(f.name + " is shorter than its output checkpoint");
+        }
+    }
+    for (const auto &f : files) {
+        const std::filesystem::path path = outdir / f.name;
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec) continue;
+        truncated_bytes += size - f.length;
+        if (f.length == 0) {
+            std::filesystem::remove(path);
+        } else if (size > f.length) {
+            std::filesystem::resize_file(path, f.length);
+        }
+    }
+}
+
+std::string output_checkpoint::xml_attributes()
+{
+    std::stringstream ss;
+    ss << "checkpoints='" << checkpoints << "' skipped='" << skipped << "' wait_seconds='" << wait_seconds
+       << "' truncated_bytes='" << truncated_bytes << "'";
+    return ss.str();
+}
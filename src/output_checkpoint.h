@@ -0,0 +1,64 @@
+#ifndef OUTPUT_CHECKPOINT_H
+#define OUTPUT_CHECKPOINT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "page_ranges.h"
+
+/**
+ * output_checkpoint:
+ * A restart point for the feature files (-S checkpoint_outputs=YES), so that a run that stops can be
+ * restarted without rescanning what it scanned and without the lines it was writing when it stopped.
+ *
+ * Every -S checkpoint_seconds, phase 1 stops reading and waits for the scanners to finish everything
+ * it has given them, which is when no sbuf is left (sbuf_t::sbuf_count is 0) and nothing is stashed
+ * or spilled. It then flushes the feature recorders, syncs their files to disk, and writes the length
+ * of each feature file with the pages scheduled so far to FILENAME (to a temporary, synced and renamed
+ * into place). If the scanners are not done within MAX_WAIT, that checkpoint is skipped.
+ *
+ * On restart, restore() cuts each feature file back to its checkpointed length (removing the files
+ * made since) and the pages of the checkpoint are the ones not scanned again: the features of the
+ * pages scanned after it are dropped with the pages, which are scanned again. What the recorders keep
+ * in memory until the end of the run, such as the exact histograms, has only the features found after
+ * the restart; the approximate histograms (-S approximate_histograms) are made from the feature files,
+ * and so are whole.
+ */
+
+class output_checkpoint {
+public:
+    static inline const std::string FILENAME {"restart_outputs.txt"};
+    static inline const auto MAX_WAIT = std::chrono::seconds(60);   // for the scanners to finish
+
+    struct file_length {
+        std::string name {};            // in the output directory
+        uint64_t length {0};
+    };
+
+    /* The length of the file up to the end of its last whole line; 0 if it does not exist */
+    static uint64_t whole_lines_length(const std::filesystem::path &path);
+
+    /* Syncs the files of the recorders (name.txt in outdir) and saves their lengths with pages */
+    static void save(const std::filesystem::path &outdir, const std::vector<std::string> &recorders,
+                     const page_ranges &pages);
+    static void write(std::ostream &os, const std::vector<file_length> &files, const page_ranges &pages);
+    static void read(std::istream &is, std::vector<file_length> &files, page_ranges &pages);
+
+    /* Cuts the files in outdir back to the checkpoint there and adds its pages to pages. Throws
+     * std::runtime_error if a file is shorter than its checkpoint (it was not on the disk).
+     */
+    static void restore(const std::filesystem::path &outdir, page_ranges &pages);
+
+    static inline std::atomic<uint64_t> checkpoints {0};     // saved
+    static inline std::atomic<uint64_t> skipped {0};         // the scanners did not finish in MAX_WAIT
+    static inline std::atomic<double>   wait_seconds {0};    // for the scanners to finish
+    static inline std::atomic<uint64_t> truncated_bytes {0}; // cut off by restore()
+    static std::string xml_attributes();                     // for the <output_checkpoint> report element
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "config.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "page_allocator.h"
+
+bool page_allocator::configure(size_t buffer_bytes, unsigned in_flight, bool use_huge_pages, bool budgeted)
+{
+    huge_pages = use_huge_pages;
+#if defined(__GLIBC__) && defined(M_MMAP_THRESHOLD) && defined(M_TRIM_THRESHOLD)
+    /* glibc caps the mmap threshold at 32MiB on 64-bit systems; larger buffers are still mapped. */
+    const uint64_t max_threshold = INT_MAX;
+    mmap_threshold = std::min<uint64_t>(uint64_t(buffer_bytes) + 4096, max_threshold);
+    trim_threshold = budgeted ? 0 : std::min<uint64_t>(uint64_t(buffer_bytes) * (uint64_t(in_flight) + 1), max_threshold);
+    if (mallopt(M_MMAP_THRESHOLD, static_cast<int>(mmap_threshold))==1 &&
+        (budgeted || mallopt(M_TRIM_THRESHOLD, static_cast<int>(trim_threshold))==1)) {
+        recycling = true;
+    }
+#else
+    (void)buffer_bytes;
+    (void)in_flight;
+    (void)budgeted;
+#endif
+    return recycling;
+}
+
+void page_allocator::advise(void *buf, size_t len)
+{
+    if (!huge_pages || buf==nullptr) return;
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_HUGEPAGE)
+    /* Only whole huge pages can be backed by a huge page */
+    uintptr_t start = (reinterpret_cast<uintptr_t>(buf) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    uintptr_t end   = (reinterpret_cast<uintptr_t>(buf) + len) & ~(HUGE_PAGE_SIZE - 1);
+    if (end <= start) return;
+    if (madvise(reinterpret_cast<void *>(start), end - start, MADV_HUGEPAGE)==0) {
+        advised_buffers++;
+        advised_bytes += end - start;
+    }
+#else
+    (void)len;
+#endif
+}
+
+std::string page_allocator::xml_attributes()
+{
+    return "recycling='" + std::to_string(recycling) +
+        "' mmap_threshold='" + std::to_string(mmap_threshold) +
+        "' trim_threshold='" + std::to_string(trim_threshold) +
+        "' huge_pages='" + std::to_string(huge_pages) +
+        "' advised_buffers='" + std::to_string(advised_buffers) +
+        "' advised_bytes='" + std::to_string(advised_bytes) + "'";
+}
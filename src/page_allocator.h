@@ -0,0 +1,45 @@
+#ifndef PAGE_ALLOCATOR_H
+#define PAGE_ALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * page_allocator:
+ * Keeps the buffers of sbufs recycled, and optionally backed by huge pages (-S huge_pages).
+ *
+ * sbuf_t owns its buffer and frees it with free(), so bulk_extractor cannot hand pages out of a
+ * pool of its own. Instead the page buffers are kept in the malloc heap: by default glibc serves
+ * a 20MiB sbuf_malloc() with mmap() and returns it to the kernel with munmap(), so each page
+ * pays for page faults on memory that was just given back. configure() raises the mmap threshold
+ * above the page size and the trim threshold above the pages that can be in flight, so a freed
+ * page buffer (or a child buffer of a common size) is reused by the next allocation. mallopt()
+ * takes an int, so both are capped at INT_MAX. Under -S memory_budget the trim threshold is left
+ * alone: the heap above it goes back to the kernel, so what the process holds follows the budget.
+ *
+ * advise() asks for transparent huge pages on a buffer that is about to be filled, which cuts the
+ * TLB misses of scanning it. It is only effective where the kernel supports MADV_HUGEPAGE.
+ */
+
+class page_allocator {
+public:
+    static inline std::atomic<uint64_t> advised_buffers {0}; // buffers given to advise()
+    static inline std::atomic<uint64_t> advised_bytes {0};   // bytes of those buffers in huge-page ranges
+    static inline bool     huge_pages {false};               // advise() asks for huge pages
+    static inline bool     recycling {false};                // configure() changed the malloc thresholds
+    static inline size_t   mmap_threshold {0};
+    static inline size_t   trim_threshold {0};                // 0 if left at malloc's default
+    static inline const size_t HUGE_PAGE_SIZE {2*1024*1024};
+
+    /* Tune malloc to recycle buffers of buffer_bytes, with up to in_flight of them allocated at once.
+     * If budgeted, freed heap is still returned to the kernel.
+     * Returns false if the platform's malloc cannot be tuned.
+     */
+    static bool configure(size_t buffer_bytes, unsigned in_flight, bool use_huge_pages, bool budgeted = false);
+    static void advise(void *buf, size_t len); // the caller is about to fill buf
+    static std::string xml_attributes();       // for the <page_allocator> report element
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "config.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "page_classifier.h"
+
+namespace {
+    /* n*log2(n) for the counts of one block, so that a block's entropy is 256 lookups */
+    const std::array<float, page_classifier::BLOCK_SIZE+1> &nlogn_table() {
+        static const auto table = []{
+            std::array<float, page_classifier::BLOCK_SIZE+1> t {};
+            for (size_t n=1; n<t.size(); n++) t[n] = n * std::log2(double(n));
+            return t;
+        }();
+        return table;
+    }
+
+    constexpr bool printable(int ch) {
+        return (ch>=0x20 && ch<0x7f) || ch=='\t' || ch=='\n' || ch=='\r';
+    }
+
+    /* 1 for printable ASCII; and for the UTF-16 test, 1 for the characters without tab, CR and LF */
+    constexpr std::array<uint8_t, 256> make_printable_table(bool controls) {
+        std::array<uint8_t, 256> t {};
+        for (int ch=0; ch<256; ch++) t[ch] = controls ? printable(ch) : (ch>=0x20 && ch<0x7f);
+        return t;
+    }
+    constexpr auto printable_table = make_printable_table(true);
+    constexpr auto utf16_table     = make_printable_table(false);
+}
+
+page_classifier::page_class page_classifier::classify(const uint8_t *buf, size_t len)
+{
+    page_class pc;
+    if (len==0) return pc;
+    const auto &nlogn = nlogn_table();
+    uint64_t ascii = 0, utf16 = 0;
+    size_t text_run = 0, utf16_run = 0;
+    pc.min_entropy = 8;
+    for (size_t start=0; start<len; start+=BLOCK_SIZE) {
+        const size_t n = std::min(BLOCK_SIZE, len-start);
+        const uint8_t *b = buf + start;
+
+        /* four histograms, so that runs of one byte do not wait on each other's increments */
+        uint16_t counts[4][256];
+        memset(counts, 0, sizeof(counts));
+        size_t i = 0;
+        for (; i+4<=n; i+=4) {
+            counts[0][b[i]]++;
+            counts[1][b[i+1]]++;
+            counts[2][b[i+2]]++;
+            counts[3][b[i+3]]++;
+        }
+        for (; i<n; i++) counts[0][b[i]]++;
+
+        double sum = 0;
+        for (int ch=0; ch<256; ch++) {
+            const size_t c = counts[0][ch] + counts[1][ch] + counts[2][ch] + counts[3][ch];
+            sum += nlogn[c];
+            if (printable(ch)) ascii += c;
+        }
+        const double entropy = std::log2(double(n)) - sum / n;
+        if (n==BLOCK_SIZE || start==0) pc.min_entropy = std::min(pc.min_entropy, entropy); // a short last block says little
+
+        /* without branches, since in compressed data they are unpredictable */
+        size_t longest = pc.longest_text_run;
+        for (size_t j=0; j<n; j++) {
+            text_run = (text_run + 1) * printable_table[b[j]];
+            longest = std::max(longest, text_run);
+        }
+        pc.longest_text_run = longest;
+        longest = pc.longest_utf16_run;
+        for (size_t j=0; j+1<n; j+=2) {
+            const size_t is_char = utf16_table[b[j]] & (b[j+1]==0);
+            utf16 += 2 * is_char;
+            utf16_run = (utf16_run + 1) * is_char;
+            longest = std::max(longest, utf16_run);
+        }
+        pc.longest_utf16_run = longest;
+    }
+    pc.ascii_fraction = double(ascii) / len;
+    pc.utf16_fraction = double(utf16) / len;
+    return pc;
+}
+
+const page_classifier::page_class &page_classifier::of(const sbuf_t &sbuf)
+{
+    /* the sbuf is identified by its address and place, since a freed sbuf's address is reused */
+    thread_local const uint8_t *last_buf {nullptr};
+    thread_local size_t last_size {0};
+    thread_local uint64_t last_offset {0};
+    thread_local page_class last {};
+    if (sbuf.get_buf()!=last_buf || sbuf.bufsize!=last_size || sbuf.pos0.offset!=last_offset) {
+        last = classify(sbuf.get_buf(), sbuf.bufsize);
+        last_buf = sbuf.get_buf();
+        last_size = sbuf.bufsize;
+        last_offset = sbuf.pos0.offset;
+        classified++;
+        if (last.high_entropy()) high_entropy_sbufs++;
+    }
+    return last;
+}
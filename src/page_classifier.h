@@ -0,0 +1,51 @@
+#ifndef PAGE_CLASSIFIER_H
+#define PAGE_CLASSIFIER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * page_classifier:
+ * A cheap pass over an sbuf that says what it looks like: the entropy of each BLOCK_SIZE block (from
+ * its byte histogram), and the fractions of bytes that are printable ASCII and that are UTF-16LE text.
+ *
+ * A page whose every block has at least ENTROPY_THRESHOLD bits per byte, and which has no run of text as
+ * long as an email address, is compressed or encrypted: the text scanners cannot match in it. A block of
+ * random data has about 7.95 bits per byte and a block of text under 6, but a few hundred bytes of text
+ * in a block of compressed data do not bring it below the threshold, so the runs are what keep them.
+ * Random data has a run of MIN_TEXT_RUN printable bytes about once in 500 MB.
+ *
+ * content_affinity asks for the class of an sbuf before each text scanner's call (with
+ * -S skip_high_entropy=YES); the class of the sbuf the thread is scanning is kept, so the page is
+ * classified once however many scanners ask.
+ */
+
+class page_classifier {
+public:
+    static inline const size_t BLOCK_SIZE {4096};
+    static inline const double ENTROPY_THRESHOLD {7.8};
+    static inline const size_t MIN_TEXT_RUN {20};       // printable ASCII bytes
+    static inline const size_t MIN_UTF16_RUN {8};       // UTF-16LE characters
+
+    struct page_class {
+        double min_entropy {0};         // bits per byte of the block with the least
+        double ascii_fraction {0};      // printable ASCII, tab, CR and LF
+        double utf16_fraction {0};      // in pairs of a printable ASCII byte and a 0
+        size_t longest_text_run {0};    // in bytes
+        size_t longest_utf16_run {0};   // in characters
+        bool   high_entropy() const {
+            return min_entropy >= ENTROPY_THRESHOLD && longest_text_run < MIN_TEXT_RUN && longest_utf16_run < MIN_UTF16_RUN;
+        }
+    };
+
+    static inline std::atomic<uint64_t> classified {0}; // sbufs classified
+    static inline std::atomic<uint64_t> high_entropy_sbufs {0};
+
+    static page_class classify(const uint8_t *buf, size_t len);
+    static const page_class &of(const sbuf_t &sbuf); // classified once for each sbuf a thread scans
+};
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * page_dedup.cpp:
+ * Collapsing the features found again in the same page; see page_dedup.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include "feature_shards.h"
+#include "page_dedup.h"
+
+namespace {
+const uint64_t FNV_OFFSET {0xcbf29ce484222325ULL};
+const uint64_t FNV_PRIME {0x100000001b3ULL};
+const size_t   MIN_SLOTS {64};          // a power of two
+
+uint64_t fnv(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * FNV_PRIME;
+    return h;
+}
+}
+
+void page_dedup::set_recorders(const std::string &names, size_t context_window_)
+{
+    recorders.clear();
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (!name.empty()) recorders.insert(name);
+    }
+    context_window = context_window_;
+}
+
+bool page_dedup::enabled(const feature_recorder &fr)
+{
+    if (recorders.count("all") || recorders.count(fr.name)) return true;
+    return feature_shards::shards() > 1 && recorders.count(feature_shards::recorder_of(fr.name));  // a shard of one
+}
+
+page_dedup::page_dedup(const sbuf_t &sbuf_): sbuf(sbuf_)
+{
+}
+
+page_dedup::~page_dedup()
+{
+    flush();
+}
+
+void page_dedup::write_buf(feature_recorder &fr, size_t pos, size_t len)
+{
+    /* A feature that starts in the margin is dropped by the recorder, and found again in the next page */
+    if (!enabled(fr) || len == 0 || pos >= sbuf.pagesize || pos + len > sbuf.bufsize) {
+        fr.write_buf(sbuf, pos, len);
+        return;
+    }
+    entry e;
+    e.fr = &fr;
+    e.pos = pos;
+    e.len = len;
+    e.start = pos > context_window ? pos - context_window : 0;
+    e.end = std::min(sbuf.bufsize, pos + len + context_window);
+    const uint64_t where[2] {pos - e.start, len};
+    e.hash = fnv(fnv(fnv(FNV_OFFSET, &e.fr, sizeof(e.fr)), where, sizeof(where)),
+                 sbuf.get_buf() + e.start, e.end - e.start);
+    add(std::move(e));
+}
+
+void page_dedup::write(feature_recorder &fr, const pos0_t &pos0, const std::string &feature, const std::string &context)
+{
+    if (!enabled(fr)) {
+        fr.write(pos0, feature, context);
+        return;
+    }
+    entry e;
+    e.fr = &fr;
+    e.given = true;
+    e.pos0 = pos0;
+    e.feature = feature;
+    e.context = context;
+    const uint64_t len = feature.size();
+    e.hash = fnv(fnv(fnv(fnv(FNV_OFFSET, &e.fr, sizeof(e.fr)), &len, sizeof(len)), feature.data(), feature.size()),
+                 context.data(), context.size());
+    add(std::move(e));
+}
+
+bool page_dedup::same(const entry &a, const entry &b) const
+{
+    if (a.hash != b.hash || a.fr != b.fr || a.given != b.given) return false;
+    if (a.given) return a.feature == b.feature && a.context == b.context;
+    return a.len == b.len && a.pos - a.start == b.pos - b.start && a.end - a.start == b.end - b.start
+        && memcmp(sbuf.get_buf() + a.start, sbuf.get_buf() + b.start, a.end - a.start) == 0;
+}
+
+void page_dedup::add(entry &&e)
+{
+    if (slots.size() < (entries.size() + 1) * 2) grow(); // at most half full
+    const size_t mask = slots.size() - 1;
+    for (size_t i = e.hash & mask; ; i = (i + 1) & mask) {
+        if (slots[i] == 0) {
+            e.count = 1;
+            entries.push_back(std::move(e));
+            slots[i] = entries.size();
+            return;
+        }
+        entry &found = entries[slots[i] - 1];
+        if (same(found, e)) {
+            found.count++;
+            return;
+        }
+    }
+}
+
+void page_dedup::grow()
+{
+    slots.assign(std::max(MIN_SLOTS, slots.size() * 2), 0);
+    const size_t mask = slots.size() - 1;
+    for (size_t n = 0; n < entries.size(); n++) {
+        size_t i = entries[n].hash & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = n + 1;
+    }
+}
+
+void page_dedup::flush()
+{
+    for (const auto &e : entries) {
+        if (e.count == 1) {
+            if (e.given) e.fr->write(e.pos0, e.feature, e.context);
+            else e.fr->write_buf(sbuf, e.pos, e.len);
+            continue;
+        }
+        collapsed += e.count - 1;
+        const std::string count = "<page_duplicates count='" + std::to_string(e.count) + "'/>";
+        if (e.given) {
+            e.fr->write(e.pos0, e.feature, e.context + count);
+        } else {
+            e.fr->write(sbuf.pos0 + e.pos, sbuf.substr(e.pos, e.len), sbuf.substr(e.start, e.end - e.start) + count);
+        }
+    }
+    entries.clear();
+    std::fill(slots.begin(), slots.end(), 0);
+}
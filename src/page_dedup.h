@@ -0,0 +1,82 @@
+#ifndef PAGE_DEDUP_H
+#define PAGE_DEDUP_H
+
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "be13_api/feature_recorder.h"
+#include "be13_api/sbuf.h"
+
+/**
+ * page_dedup:
+ * Collapses the features a scanner finds more than once in the same page, with the same context, into
+ * one line. A page of a mail spool, a log or an HTML file can hold the same address or URL in the same
+ * surroundings hundreds of times, and each copy costs a line in the feature file and the time to write it.
+ *
+ * Enabled per recorder with -S page_dedup=email,url,domain,... (or "all"). A scanner makes a page_dedup
+ * for each buffer it scans and writes its features through it; the features of recorders that are not
+ * enabled go to the recorder at once. The others are held in a small open-addressed table, keyed by
+ * the recorder, the feature and the context window around it, and written when the buffer is done (or
+ * at flush()), in the order they were first found. A feature found once is written as it would have
+ * been; one found N times is written once, at its first position, with <page_duplicates count='N'/>
+ * after its context.
+ *
+ * The histograms are made from the feature files, so a collapsed feature counts once per page; that is
+ * why the mode is per recorder and off by default.
+ */
+
+class page_dedup {
+public:
+    static inline std::atomic<uint64_t> collapsed {0}; // lines that were not written
+
+    /* names is a list of recorder names separated by commas, "all", or "" to disable;
+     * context_window is the bytes either side of a feature that it is compared with (-C)
+     */
+    static void set_recorders(const std::string &names, size_t context_window);
+    static bool enabled() { return !recorders.empty(); }
+    static bool enabled(const feature_recorder &fr);
+
+    explicit page_dedup(const sbuf_t &sbuf);
+    ~page_dedup();                      // flush()
+    page_dedup(const page_dedup &)=delete;
+    page_dedup &operator=(const page_dedup &)=delete;
+
+    /* fr.write_buf(sbuf, pos, len) */
+    void write_buf(feature_recorder &fr, size_t pos, size_t len);
+    /* fr.write(pos0, feature, context), for the scanners that make their own context */
+    void write(feature_recorder &fr, const pos0_t &pos0, const std::string &feature, const std::string &context);
+    /* Writes the features held so far */
+    void flush();
+
+private:
+    struct entry {
+        feature_recorder *fr {nullptr};
+        uint64_t hash {0};
+        size_t   count {0};
+        /* write_buf(): the feature at pos, compared with the bytes of [start, end) */
+        size_t   pos {0};
+        size_t   len {0};
+        size_t   start {0};
+        size_t   end {0};
+        /* write(): the feature and context given */
+        bool     given {false};
+        pos0_t   pos0 {};
+        std::string feature {};
+        std::string context {};
+    };
+    static inline std::set<std::string> recorders {};
+    static inline size_t context_window {16};
+
+    const sbuf_t &sbuf;
+    std::vector<entry> entries {};      // in the order they were found
+    std::vector<uint32_t> slots {};     // index into entries + 1; 0 is free
+
+    bool     same(const entry &a, const entry &b) const;
+    void     add(entry &&e);
+    void     grow();
+};
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * page_ranges.cpp:
+ * a run-length-encoded set of processed pages. See page_ranges.h.
+ */
+
+#include "config.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "page_ranges.h"
+
+bool page_ranges::is_offset(const std::string &pos0)
+{
+    if (pos0.empty()) return false;
+    for (const auto ch : pos0) {
+        if (ch<'0' || ch>'9') return false;
+    }
+    return true;
+}
+
+/*
+ * Add [start,start+len), merging it with any ranges that it overlaps or touches.
+ */
+void page_ranges::add(uint64_t start, uint64_t len)
+{
+    if (len==0) len = 1;
+    uint64_t end = start + len;
+
+    auto it = ranges.upper_bound(start);
+    if (it != ranges.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= start) { // overlaps or touches the previous range
+            start = prev->first;
+            end   = std::max(end, prev->second);
+            it    = ranges.erase(prev);
+        }
+    }
+    while (it != ranges.end() && it->first <= end) {
+        end = std::max(end, it->second);
+        it  = ranges.erase(it);
+    }
+    ranges[start] = end;
+}
+
+void page_ranges::add(const std::string &pos0, uint64_t len)
+{
+    if (is_offset(pos0)) {
+        add(std::stoull(pos0), len);
+    } else {
+        others.insert(pos0);
+    }
+}
+
+void page_ranges::add(const pos0_t &pos0, uint64_t len)
+{
+    if (pos0.path.empty()) {
+        add(pos0.offset, len);
+    } else {
+        others.insert(pos0.str());
+    }
+}
+
+bool page_ranges::contains(uint64_t offset) const
+{
+    auto it = ranges.upper_bound(offset);
+    if (it == ranges.begin()) return false;
+    --it;
+    return offset < it->second;
+}
+
+bool page_ranges::contains(const pos0_t &pos0) const
+{
+    if (pos0.path.empty()) return contains(pos0.offset);
+    return others.find(pos0.str()) != others.end();
+}
+
+bool page_ranges::contains(const std::string &pos0) const
+{
+    if (is_offset(pos0)) return contains(std::stoull(pos0));
+    return others.find(pos0) != others.end();
+}
+
+void page_ranges::merge(const page_ranges &that)
+{
+    for (const auto &it : that.ranges) {
+        add(it.first, it.second - it.first);
+    }
+    others.insert(that.others.begin(), that.others.end());
+}
+
+void page_ranges::write_page(std::ostream &os, const pos0_t &pos0, uint64_t len)
+{
+    if (pos0.path.empty()) {
+        os << pos0.offset << " " << pos0.offset + std::max<uint64_t>(len, 1) << "\n";
+    } else {
+        os << "path " << pos0.str() << "\n";
+    }
+}
+
+void page_ranges::write(std::ostream &os) const
+{
+    for (const auto &it : ranges) {
+        os << it.first << " " << it.second << "\n";
+    }
+    for (const auto &it : others) {
+        os << "path " << it << "\n";
+    }
+}
+
+void page_ranges::read(std::istream &is)
+{
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line.empty()) continue;
+        if (line.compare(0, 5, "path ")==0) {
+            others.insert(line.substr(5));
+            continue;
+        }
+        std::istringstream ls(line);
+        uint64_t start=0, end=0;
+        if (!(ls >> start >> end) || end < start) {
+            throw std::runtime_error("invalid line in restart checkpoint: " + line);
+        }
+        add(start, end - start);
+    }
+}
+
+void page_ranges::save(const std::filesystem::path &fname) const
+{
+    std::filesystem::path tmp = fname.string() + ".tmp";
+    {
+        std::ofstream os(tmp);
+        if (!os.is_open()) {
+            throw std::runtime_error("cannot create " + tmp.string());
+        }
+        write(os);
+    }
+    std::filesystem::rename(tmp, fname);
+}
+
+void page_ranges::load(const std::filesystem::path &fname)
+{
+    std::ifstream is(fname);
+    if (!is.is_open()) {
+        throw std::runtime_error("cannot open " + fname.string());
+    }
+    read(is);
+}
@@ -0,0 +1,57 @@
+#ifndef PAGE_RANGES_H
+#define PAGE_RANGES_H
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_set>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * page_ranges:
+ * A compact set of the depth-0 pages that have been processed, used for restarting.
+ *
+ * Pages of disk images are identified by their byte offsets, which are kept as a
+ * run-length-encoded list of [start,end) ranges: a contiguous run of pages is one entry,
+ * no matter how many pages it covers. Pages whose forensic path is not a plain offset
+ * (for example, the files of a -R directory scan) are kept as strings.
+ *
+ * The set can be saved to and loaded from a checkpoint file with one line per range:
+ *     <start> <end>
+ * and one line per other page:
+ *     path <forensic path>
+ */
+
+class page_ranges {
+    std::map<uint64_t,uint64_t> ranges {};     // start -> end (exclusive)
+    std::unordered_set<std::string> others {}; // pages that are not plain offsets
+
+public:
+    static inline const std::string CHECKPOINT_FILENAME {"restart_pages.txt"};
+
+    void add(uint64_t start, uint64_t len);    // add the range [start, start+len)
+    void add(const std::string &pos0, uint64_t len); // add a page by its forensic path
+    void add(const pos0_t &pos0, uint64_t len);
+    bool contains(uint64_t offset) const;
+    bool contains(const pos0_t &pos0) const;
+    bool contains(const std::string &pos0) const;
+    bool empty() const { return ranges.empty() && others.empty(); }
+    size_t range_count() const { return ranges.size(); }
+    size_t other_count() const { return others.size(); }
+    const std::map<uint64_t,uint64_t> &get_ranges() const { return ranges; }
+    const std::unordered_set<std::string> &get_others() const { return others; }
+    void merge(const page_ranges &that);
+
+    static bool is_offset(const std::string &pos0); // true if pos0 is a plain depth-0 offset
+
+    static void write_page(std::ostream &os, const pos0_t &pos0, uint64_t len); // one checkpoint line
+    void write(std::ostream &os) const;
+    void read(std::istream &is);
+    void save(const std::filesystem::path &fname) const; // written to a temporary and renamed into place
+    void load(const std::filesystem::path &fname);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "config.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "page_stash.h"
+
+size_t page_stash::size()
+{
+    std::lock_guard<std::mutex> lock(M);
+    return pages.size();
+}
+
+bool page_stash::put(sbuf_t *sbuf)
+{
+    if (!has_room() || sbuf->bufsize == 0) return false;
+
+    thread_local std::vector<uint8_t> buf;
+    uLongf len = compressBound(sbuf->bufsize);
+    if (buf.size() < len) buf.resize(len);
+    if (compress2(buf.data(), &len, sbuf->get_buf(), sbuf->bufsize, Z_BEST_SPEED) != Z_OK ||
+        len > sbuf->bufsize * MAX_RATIO) {
+        incompressible++;
+        return false;
+    }
+
+    page_t page;
+    page.pos0 = sbuf->pos0;
+    page.bufsize = sbuf->bufsize;
+    page.pagesize = sbuf->pagesize;
+    page.data.assign(buf.data(), buf.data() + len);
+    {
+        std::lock_guard<std::mutex> lock(M);
+        pages.push_back(std::move(page));
+        compressed_bytes += len;
+        if (compressed_bytes > max_held) max_held = compressed_bytes.load();
+    }
+    stashed++;
+    stashed_bytes += sbuf->bufsize;
+    delete sbuf;
+    return true;
+}
+
+sbuf_t *page_stash::take()
+{
+    page_t page;
+    {
+        std::lock_guard<std::mutex> lock(M);
+        if (pages.empty()) return nullptr;
+        page = std::move(pages.front());
+        pages.pop_front();
+        compressed_bytes -= page.data.size();
+    }
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc(page.pos0, page.bufsize, page.pagesize);
+    uLongf len = page.bufsize;
+    if (uncompress(static_cast<Bytef *>(sbuf->malloc_buf()), &len, page.data.data(), page.data.size()) != Z_OK ||
+        len != page.bufsize) {
+        delete sbuf;
+        throw std::runtime_error("page_stash: cannot decompress the page at " + page.pos0.str());
+    }
+    return sbuf;
+}
+
+std::string page_stash::xml_attributes()
+{
+    std::stringstream ss;
+    ss << "pages='" << stashed << "' bytes='" << stashed_bytes << "' incompressible='" << incompressible
+       << "' max_held='" << max_held << "'";
+    return ss.str();
+}
@@ -0,0 +1,62 @@
+#ifndef PAGE_STASH_H
+#define PAGE_STASH_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * page_stash:
+ * Depth-0 pages that phase 1 has read while the scanner queue is full, kept compressed until there
+ * is room for them (-S queue_stash_bytes), so that the reader runs ahead of slow scanners without
+ * the pages it has read growing the resident size.
+ *
+ * Once the scanner queue is over queue_high_water, a page is compressed (zlib at its fastest level)
+ * into the stash instead of being queued, and phase 1 reads the next one. Before each read, and
+ * when reading is done, the stashed pages are decompressed into new sbufs and queued, oldest first,
+ * while the queue has room. The reader waits for the queue as before only once the stash holds
+ * queue_stash_bytes of compressed pages. A page that does not compress (to at most MAX_RATIO of its
+ * size) is queued at once: keeping it would save nothing.
+ *
+ * The sbufs that the scanners recurse into are queued by the scanner set, and are not stashed.
+ */
+
+class page_stash {
+public:
+    static inline const double MAX_RATIO {0.75};   // of its size, that a stashed page may take compressed
+
+    static void set_max_bytes(uint64_t bytes) { max_bytes = bytes; }   // 0 disables
+    static bool enabled() { return max_bytes != 0; }
+    static bool has_room() { return compressed_bytes < max_bytes; }
+    static size_t size();
+
+    /* Takes the sbuf (and deletes it) if it compresses and the stash has room; else leaves it */
+    static bool put(sbuf_t *sbuf);
+    /* The oldest stashed page, decompressed; nullptr if there is none */
+    static sbuf_t *take();
+
+    static inline std::atomic<uint64_t> stashed {0};          // pages put in the stash
+    static inline std::atomic<uint64_t> stashed_bytes {0};    // their sizes
+    static inline std::atomic<uint64_t> incompressible {0};   // pages that were queued instead
+    static inline std::atomic<uint64_t> max_held {0};         // the most compressed bytes held at once
+    static std::string xml_attributes();                      // for the <page_stash> report element
+
+private:
+    struct page_t {
+        pos0_t pos0 {};
+        size_t bufsize {0};
+        size_t pagesize {0};
+        std::vector<uint8_t> data {};   // compressed
+    };
+    static inline std::atomic<uint64_t> max_bytes {0};
+    static inline std::atomic<uint64_t> compressed_bytes {0}; // held now
+    static inline std::mutex M {};
+    static inline std::deque<page_t> pages {};
+};
+
+#endif
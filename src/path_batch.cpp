@@ -0,0 +1,75 @@
+/**
+ * path_batch.cpp:
+ * Many -p paths with one image open; see path_batch.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
+
+#include "feature_file_sort.h"
+#include "path_batch.h"
+
+std::string_view path_batch::path_of(std::string_view request)
+{
+    while (request.size() > 2 && request[request.size() - 2] == '/' &&
+           (request.back() == 'h' || request.back() == 'r')) {
+        request.remove_suffix(2);
+    }
+    const size_t colon = request.rfind(':');
+    if (colon != std::string_view::npos && colon + 1 < request.size() &&
+        std::all_of(request.begin() + colon + 1, request.end(), [](char ch) { return ch >= '0' && ch <= '9'; })) {
+        request = request.substr(0, colon);
+    }
+    return request;
+}
+
+std::vector<size_t> path_batch::order(const std::vector<std::string> &requests)
+{
+    std::unordered_map<std::string_view, size_t> first;
+    std::vector<size_t> ret;
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (first.emplace(requests[i], i).second) ret.push_back(i);
+    }
+    std::stable_sort(ret.begin(), ret.end(), [&requests](size_t a, size_t b) {
+        return compare_forensic_paths(path_of(requests[a]), path_of(requests[b])) < 0;
+    });
+    return ret;
+}
+
+size_t path_batch::run(std::istream &in, std::ostream &out,
+                       const std::function<void(const std::string &, std::ostream &)> &print)
+{
+    std::vector<std::string> requests;
+    for (std::string line; std::getline(in, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty() && line[0] != '#') requests.push_back(std::move(line));
+    }
+
+    /* each request prints as its first copy did; a printed one is kept until its last copy is written */
+    std::unordered_map<std::string_view, size_t> first;
+    std::vector<size_t> copy_of(requests.size()), uses(requests.size(), 0);
+    for (size_t i = 0; i < requests.size(); i++) {
+        copy_of[i] = first.emplace(requests[i], i).first->second;
+        uses[copy_of[i]]++;
+    }
+    std::vector<std::string> printed(requests.size());
+    std::vector<bool> done(requests.size(), false);
+    size_t next = 0;                        // the next request to write
+    for (size_t i : order(requests)) {
+        std::stringstream ss;
+        print(requests[i], ss);
+        printed[i] = ss.str();
+        done[i] = true;
+        for (; next < requests.size() && done[copy_of[next]]; next++) {
+            const size_t c = copy_of[next];
+            out << printed[c];
+            if (--uses[c] == 0) std::string().swap(printed[c]);
+        }
+    }
+    out.flush();
+    return requests.size();
+}
@@ -0,0 +1,38 @@
+#ifndef PATH_BATCH_H
+#define PATH_BATCH_H
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * path_batch:
+ * bulk_extractor -p @FILE prints the forensic paths listed in FILE (one per line, each with the
+ * optional [:length][/h][/r] of -p), as if bulk_extractor -p were run for each of them, with one
+ * process and one open image.
+ *
+ * The paths are printed in the order of feature_file_sort, so the image is read forward and the
+ * paths inside one decoded buffer (1000-GZIP-0, 1000-GZIP-512, ...) follow one another, where a cache
+ * of decoded prefixes in the path printer would find them. A path listed more than once is printed
+ * once. The output is written in the order of FILE, each path's as soon as those before it are done.
+ */
+
+class path_batch {
+public:
+    /* The forensic path of a request, without its :length, /h or /r */
+    static std::string_view path_of(std::string_view request);
+    /* The order in which to print the requests: indexes into requests, in path order, the
+     * repeated requests left out */
+    static std::vector<size_t> order(const std::vector<std::string> &requests);
+
+    /* Calls print(request, out) for each line of in that is not empty or a comment, and writes
+     * what it printed to out in the order of in; returns the requests */
+    static size_t run(std::istream &in, std::ostream &out,
+                      const std::function<void(const std::string &, std::ostream &)> &print);
+};
+
+#endif
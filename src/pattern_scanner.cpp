@@ -3,26 +3,56 @@
 // if liblightgrep isn't present, compiles to nothing
 #ifdef HAVE_LIBLIGHTGREP
 
-#include "beregex.h"
-#include "histogram.h"
 #include "pattern_scanner.h"
 
 #include <lightgrep/api.h>
 
 #include <iostream>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <limits>
 #include <fstream>
+#include <sstream>
 
-#include <iostream>
+#include <unistd.h>
+
+#include "be13_api/scanner_params.h"
 
 #ifdef LGBENCHMARK
 #include <chrono>
 #endif
 
+// The version that configure found; without it, a cached program could be of another library, so none is
+#ifdef LIGHTGREP_VERSION
+#define LIGHTGREP_CACHE_VERSION LIGHTGREP_VERSION
+#else
+#define LIGHTGREP_CACHE_VERSION ""
+#endif
+
 namespace {
   const char* DefaultEncodingsCStrings[] = {"UTF-8", "UTF-16LE"};
   const unsigned int NumDefaultEncodings = 2;
+
+  // Compiled programs are cached in files that start with this, then the pattern key
+  const char CacheMagic[8] = {'B', 'E', 'L', 'G', 'P', 'R', 'G', '1'};
+
+  // One search context per thread, reused for every sbuf the thread searches
+  struct ThreadContext {
+    LG_HCONTEXT Ctx = 0;
+    ~ThreadContext() { if (Ctx) lg_destroy_context(Ctx); }
+  };
+  thread_local ThreadContext TheThreadContext;
+
+  // FNV-1a; stable across builds and platforms, unlike std::hash
+  uint64_t fnv1a(uint64_t h, const string& s) {
+    for (unsigned char ch : s) {
+      h = (h ^ ch) * 0x100000001b3ULL;
+    }
+    return (h ^ 0xff) * 0x100000001b3ULL; // separates "ab","c" from "a","bc"
+  }
 }
 
 bool PatternScanner::handleParseError(const Handler& h, LG_Error* err) const {
@@ -43,6 +73,10 @@ LightgrepController::LightgrepController()
   Fsm(lg_create_fsm(1 << 20)),              // Reserve space for 1M states in the automaton--will grow if needed
   PatternInfo(lg_create_pattern_map(1000)), // Reserve space for 1000 patterns in the pattern map
   Prog(0),
+  Compiled(),
+  PatternKey(fnv1a(0xcbf29ce484222325ULL, LIGHTGREP_CACHE_VERSION)), // a program is loaded only by the library that wrote it
+  CacheDir(),
+  ProgFromCache(false),
   Scanners()
 {
 }
@@ -69,7 +103,13 @@ bool LightgrepController::addScanner(PatternScanner& scanner) {
   int idx = -1;
 
   // iterate all the scanner's handlers
+  PatternKey = fnv1a(PatternKey, scanner.name());
   for (vector<const Handler*>::const_iterator h(scanner.handlers().begin()); h != scanner.handlers().end(); ++h) {
+    PatternKey = fnv1a(PatternKey, (*h)->RE);
+    PatternKey = fnv1a(PatternKey, string(1, (*h)->Options.FixedString) + string(1, (*h)->Options.CaseInsensitive));
+    for (const auto& enc : (*h)->Encodings) {
+      PatternKey = fnv1a(PatternKey, enc);
+    }
     bool good = false;
     if (lg_parse_pattern(ParsedPattern, (*h)->RE.c_str(), &(*h)->Options, &lgErr)) { // parse the pattern
       for (vector<string>::const_iterator enc((*h)->Encodings.begin()); enc != (*h)->Encodings.end(); ++enc) {
@@ -121,6 +161,7 @@ bool LightgrepController::addUserPatterns(PatternScanner& scanner, CallbackFnTyp
       return false;
     }
     string contents = string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    PatternKey = fnv1a(PatternKey, contents);
 
     const char* contentsCStr = contents.c_str();
     // Add all the patterns from the files in one fell swoop
@@ -144,6 +185,7 @@ bool LightgrepController::addUserPatterns(PatternScanner& scanner, CallbackFnTyp
   }
   // add patterns from single command-line arguments
   for (vector<string>::const_iterator itr(user.Patterns.begin()); itr != user.Patterns.end(); ++itr) {
+    PatternKey = fnv1a(PatternKey, *itr);
     bool good = false;
     if (lg_parse_pattern(ParsedPattern, itr->c_str(), &opts, &err)) {
       for (unsigned int i = 0; i < NumDefaultEncodings; ++i) {
@@ -158,6 +200,7 @@ bool LightgrepController::addUserPatterns(PatternScanner& scanner, CallbackFnTyp
       return false;
     }
   }
+  PatternKey = fnv1a(PatternKey, scanner.name());
   patEnd = lg_pattern_map_size(PatternInfo);
   for (unsigned int i = patBegin; i < patEnd; ++i) {
     lg_pattern_info(PatternInfo, i)->UserData = const_cast<void*>(static_cast<const void*>(callbackPtr));
@@ -168,13 +211,30 @@ bool LightgrepController::addUserPatterns(PatternScanner& scanner, CallbackFnTyp
 }
 
 void LightgrepController::regcomp() {
-  LG_ProgramOptions progOpts;
-  progOpts.Determinize = 1;
-  // Create an optimized, immutable form of the accumulated automaton
-  Prog = lg_create_program(Fsm, &progOpts);
+  if (Scanners.empty()) {
+    return;
+  }
+  // The same patterns, added in the same order, give the same program and keyword indexes,
+  // so a program compiled by an earlier run can be used instead of compiling it again.
+  const string cache = cacheFile();
+  if (!cache.empty()) {
+    Prog = readProgram(cache);
+    ProgFromCache = (Prog != 0);
+  }
+  if (!Prog) {
+    LG_ProgramOptions progOpts;
+    progOpts.Determinize = 1;
+    // Create an optimized, immutable form of the accumulated automaton
+    Prog = lg_create_program(Fsm, &progOpts);
+    if (!cache.empty() && Prog) {
+      writeProgram(cache);
+    }
+  }
   lg_destroy_fsm(Fsm);
+  Fsm = 0;
 
-  cerr << lg_pattern_map_size(PatternInfo) << " lightgrep patterns, logic size is " << lg_program_size(Prog) << " bytes, " << Scanners.size() << " active scanners" << std::endl;
+  cerr << lg_pattern_map_size(PatternInfo) << " lightgrep patterns, logic size is " << lg_program_size(Prog) << " bytes, " << Scanners.size() << " active scanners"
+       << (ProgFromCache ? " (cached)" : "") << std::endl;
   #ifdef LGBENCHMARK
   cerr << "timer second ratio " << chrono::high_resolution_clock::period::num << "/" <<
     chrono::high_resolution_clock::period::den << endl;
@@ -186,7 +246,6 @@ struct HitData {
   LightgrepController* lgc;
   const vector<PatternScanner*>* scannerTable;
   const scanner_params* sp;
-    //const recursion_control_block* rcb;
 };
 
 void gotHit(void* userData, const LG_SearchHit* hit) {
@@ -196,12 +255,18 @@ void gotHit(void* userData, const LG_SearchHit* hit) {
   #else
   // trampoline back into LightgrepController::processHit() from the void* userData
   HitData* hd(static_cast<HitData*>(userData));
-  hd->lgc->processHit(*hd->scannerTable, *hit, *hd->sp, *hd->rcb);
+  hd->lgc->processHit(*hd->scannerTable, *hit, *hd->sp);
   #endif
 }
 
-void LightgrepController::scan(const scanner_params& sp, const recursion_control_block &rcb) {
-  // Scan the sbuf for pattern hits, invoking various scanners' handlers as hits are encountered
+void LightgrepController::scan(const PatternScanner& caller, const scanner_params& sp) {
+  // Scan the sbuf for pattern hits, invoking various scanners' handlers as hits are encountered.
+  // Every PatternScanner is called for the sbuf, but it is searched only once, for all of them.
+  if (Scanners.empty() || &caller != Scanners.front()) {
+    return;
+  }
+  // All the scanners have been added in PHASE_INIT2, so the program can be built now
+  std::call_once(Compiled, [this]() { regcomp(); });
   if (!Prog) {
     // we had no valid patterns, do nothing
     return;
@@ -217,15 +282,23 @@ void LightgrepController::scan(const scanner_params& sp, const recursion_control
     }
     s->initScan(sp); // let the scanner know we're about to scan an sbuf
   }
-  LG_ContextOptions ctxOpts;
-  ctxOpts.TraceBegin = 0xffffffffffffffff;
-  ctxOpts.TraceEnd   = 0;
-
-  LG_HCONTEXT ctx = lg_create_context(Prog, &ctxOpts); // create a search context; cannot be shared, so local to scan
+  // A search context cannot be shared between threads, so each thread has its own, which is
+  // reset instead of being created for each sbuf
+  LG_HCONTEXT& ctx = TheThreadContext.Ctx;
+  if (ctx) {
+    lg_reset_context(ctx);
+  }
+  else {
+    LG_ContextOptions ctxOpts;
+    ctxOpts.TraceBegin = 0xffffffffffffffff;
+    ctxOpts.TraceEnd   = 0;
+    ctx = lg_create_context(Prog, &ctxOpts);
+  }
 
-  const sbuf_t &sbuf = sp.sbuf;
+  const sbuf_t &sbuf = *sp.sbuf;
+  const char *buf = reinterpret_cast<const char*>(sbuf.get_buf());
 
-  HitData callbackInfo = { this, &scannerTable, &sp, &rcb };
+  HitData callbackInfo = { this, &scannerTable, &sp };
   void*   userData = &callbackInfo;
 
   #ifdef LGBENCHMARK // perform timings of lightgrep search functions only -- no callbacks
@@ -238,9 +311,9 @@ void LightgrepController::scan(const scanner_params& sp, const recursion_control
 
   // search the sbuf in one go
   // the gotHit() function will be invoked for each pattern hit
-  if (lg_search(ctx, (const char*)sbuf.buf, (const char*)sbuf.buf + sbuf.pagesize, 0, userData, gotHit) < numeric_limits<uint64_t>::max()) {
+  if (lg_search(ctx, buf, buf + sbuf.pagesize, 0, userData, gotHit) < numeric_limits<uint64_t>::max()) {
     // resolve potential hits that want data into the sbuf margin, without beginning any new hits
-    lg_search_resolve(ctx, (const char*)sbuf.buf + sbuf.pagesize, (const char*)sbuf.buf + sbuf.bufsize, sbuf.pagesize, userData, gotHit);
+    lg_search_resolve(ctx, buf + sbuf.pagesize, buf + sbuf.bufsize, sbuf.pagesize, userData, gotHit);
   }
   // flush any remaining hits; there's no more data
   lg_closeout_search(ctx, userData, gotHit);
@@ -256,8 +329,6 @@ void LightgrepController::scan(const scanner_params& sp, const recursion_control
 //  std::cout.flush();
   #endif
 
-  lg_destroy_context(ctx);
-
   // don't call PatternScanner::shutdown() on these! that only happens on prototypes
   for (vector<PatternScanner*>::const_iterator itr(scannerList.begin()); itr != scannerList.end(); ++itr) {
     (*itr)->finishScan(sp); // let the scanner know we're done with the sbuf
@@ -265,25 +336,99 @@ void LightgrepController::scan(const scanner_params& sp, const recursion_control
   }
 }
 
-void LightgrepController::processHit(const vector<PatternScanner*>& sTbl, const LG_SearchHit& hit, const scanner_params& sp, const recursion_control_block& rcb) {
+void LightgrepController::processHit(const vector<PatternScanner*>& sTbl, const LG_SearchHit& hit, const scanner_params& sp) {
   // lookup the handler's callback functor in the pattern map, then invoke it
   CallbackFnType* cbPtr(static_cast<CallbackFnType*>(lg_pattern_info(PatternInfo, hit.KeywordIndex)->UserData));
-  ((*sTbl[hit.KeywordIndex]).*(*cbPtr))(hit, sp, rcb); // ...yep...
+  ((*sTbl[hit.KeywordIndex]).*(*cbPtr))(hit, sp); // ...yep...
 }
 
 unsigned int LightgrepController::numPatterns() const {
   return lg_pattern_map_size(PatternInfo);
 }
 
+void LightgrepController::setCacheDir(const string& dir) {
+  CacheDir = dir;
+}
+
+string LightgrepController::cacheFile() const {
+  // -S lightgrep_cache=- disables the cache, as does a build that does not know its liblightgrep version;
+  // the default is $XDG_CACHE_HOME/bulk_extractor or ~/.cache/bulk_extractor
+  filesystem::path dir(CacheDir);
+  if (CacheDir == "-" || string(LIGHTGREP_CACHE_VERSION).empty()) {
+    return "";
+  }
+  if (dir.empty()) {
+    if (const char* xdg = getenv("XDG_CACHE_HOME")) {
+      dir = filesystem::path(xdg) / "bulk_extractor";
+    }
+    else if (const char* home = getenv("HOME")) {
+      dir = filesystem::path(home) / ".cache" / "bulk_extractor";
+    }
+    else {
+      return "";
+    }
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "lightgrep-%016llx.lgp", static_cast<unsigned long long>(PatternKey));
+  return (dir / name).string();
+}
+
+LG_HPROGRAM LightgrepController::readProgram(const string& fname) const {
+  // the file is the magic, the pattern key, and the program; anything else is ignored
+  ifstream in(fname, ios::binary);
+  if (!in.is_open()) {
+    return 0;
+  }
+  string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  const size_t header = sizeof(CacheMagic) + sizeof(PatternKey);
+  uint64_t key = 0;
+  if (data.size() <= header || data.compare(0, sizeof(CacheMagic), CacheMagic, sizeof(CacheMagic)) != 0) {
+    return 0;
+  }
+  memcpy(&key, data.data() + sizeof(CacheMagic), sizeof(key));
+  if (key != PatternKey || data.size() - header > numeric_limits<unsigned int>::max()) {
+    return 0;
+  }
+  return lg_read_program(&data[header], static_cast<unsigned int>(data.size() - header));
+}
+
+void LightgrepController::writeProgram(const string& fname) const {
+  // written to a temporary file and renamed, so that concurrent runs never read a partial program
+  vector<char> prog(lg_program_size(Prog));
+  lg_write_program(Prog, prog.data());
+  error_code ec;
+  filesystem::create_directories(filesystem::path(fname).parent_path(), ec);
+  const string tmp = fname + "." + to_string(getpid()) + ".tmp";
+  {
+    ofstream out(tmp, ios::binary | ios::trunc);
+    if (!out.is_open()) {
+      return;                   // the cache is an optimization; not being able to write it is not an error
+    }
+    out.write(CacheMagic, sizeof(CacheMagic));
+    out.write(reinterpret_cast<const char*>(&PatternKey), sizeof(PatternKey));
+    out.write(prog.data(), prog.size());
+    if (!out.good()) {
+      out.close();
+      filesystem::remove(tmp, ec);
+      return;
+    }
+  }
+  filesystem::rename(tmp, fname, ec);
+  if (ec) {
+    filesystem::remove(tmp, ec);
+  }
+}
+
 /*********************************************************/
 
-void scan_lg(PatternScanner& scanner, class scanner_params &sp) {
+void scan_lg(PatternScanner& scanner, struct scanner_params &sp) {
   // utility implementation of the normal scan function for a PatternScanner instance
+  sp.check_version();
   switch (sp.phase) {
-  case scanner_params::PHASE_STARTUP:
+  case scanner_params::PHASE_INIT:
     scanner.startup(sp);
     break;
-  case scanner_params::PHASE_INIT:
+  case scanner_params::PHASE_INIT2:
     scanner.init(sp);
     if (!LightgrepController::Get().addScanner(scanner)) {
       // It's fine for user patterns not to parse, but there's no excuse for a scanner so exit.
@@ -291,6 +436,9 @@ void scan_lg(PatternScanner& scanner, class scanner_params &sp) {
       exit(EXIT_FAILURE);
     }
     break;
+  case scanner_params::PHASE_SCAN:
+    LightgrepController::Get().scan(scanner, sp);
+    break;
   case scanner_params::PHASE_SHUTDOWN:
     scanner.shutdown(sp);
     break;
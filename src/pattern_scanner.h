@@ -4,14 +4,15 @@
 // if liblightgrep isn't present, compiles to nothing
 #ifdef HAVE_LIBLIGHTGREP
 
+#include <mutex>
 #include <vector>
 #include <string>
 #include <utility>
 
 #include <lightgrep/api.h>
 
+#include "be13_api/scanner_params.h"
 #include "findopts.h"
-#include "be13/plugin.h"
 
 using namespace std;
 
@@ -20,13 +21,11 @@ class PatternScanner;
 /**
  * the function prototype for a handler callback
  * LG_SearchHit            - LightGrep Search Hit.
- * scanner_params          - the parameters available to the scanner.
- * recursion_control_clock - information about where we are in the recursive analysis.
+ * scanner_params          - the parameters available to the scanner; sp.sbuf is the sbuf searched.
  */
 
 typedef void (PatternScanner::*CallbackFnType)(const LG_SearchHit&,
-                                               const scanner_params& sp,
-                                               const recursion_control_block& rcb);
+                                               const scanner_params& sp);
 
 /*********************************************************/
 
@@ -43,9 +42,9 @@ public:
 
   const string& name() const { return Name; }
 
-  virtual void startup(const scanner_params& sp) = 0;
+  virtual void startup(const scanner_params& sp) = 0; // PHASE_INIT: describe the scanner
 
-  virtual void init(const scanner_params& sp) = 0; // register handlers
+  virtual void init(const scanner_params& sp) = 0; // PHASE_INIT2: register handlers
 
   virtual void initScan(const scanner_params& sp) = 0; // get feature_recorders
   virtual void finishScan(const scanner_params& sp) {} // done searching a region
@@ -106,7 +105,14 @@ struct Handler {
 
 /*********************************************************/
 
-class LightgrepController { // Centralized search facility amongst PatternScanners
+/*
+ * Centralized search facility amongst PatternScanners. The patterns of every enabled
+ * PatternScanner are compiled into one program, so each sbuf is searched once, and each
+ * hit is dispatched to the handler of the scanner that registered the pattern.
+ * scanner_set calls every enabled scanner on every sbuf; only the first scanner added
+ * to the controller runs the search, the others return at once.
+ */
+class LightgrepController {
 public:
 
   static LightgrepController& Get(); // singleton instance
@@ -115,11 +121,14 @@ public:
   bool addUserPatterns(PatternScanner& scanner, CallbackFnType* callbackPtr, const FindOpts& userPatterns);
 
   void regcomp();
-  void scan(const scanner_params& sp, const recursion_control_block& rcb);
-  void processHit(const vector<PatternScanner*>& sTbl, const LG_SearchHit& hit, const scanner_params& sp, const recursion_control_block& rcb);
+  void scan(const PatternScanner& caller, const scanner_params& sp);
+  void processHit(const vector<PatternScanner*>& sTbl, const LG_SearchHit& hit, const scanner_params& sp);
 
   unsigned int numPatterns() const;
 
+  // where compiled programs are cached; "" is the default, "-" disables the cache
+  void setCacheDir(const string& dir);
+
 private:
   LightgrepController();
   LightgrepController(const LightgrepController&);
@@ -131,6 +140,15 @@ private:
   LG_HFSM         Fsm;
   LG_HPATTERNMAP  PatternInfo;
   LG_HPROGRAM     Prog;
+  std::once_flag  Compiled;         // regcomp() runs once, before the first search
+
+  string cacheFile() const;
+  LG_HPROGRAM readProgram(const string& fname) const;
+  void writeProgram(const string& fname) const;
+
+  uint64_t PatternKey;              // hash of the liblightgrep version and every pattern, its options and encodings, in order
+  string   CacheDir;
+  bool     ProgFromCache;
 
   vector<PatternScanner*> Scanners;
 };
@@ -138,7 +156,7 @@ private:
 /*********************************************************/
 
 // Utility function. Makes your scan function a one-liner, given a PatternScanner instance
-void scan_lg(PatternScanner& scanner, struct scanner_params &sp;
+void scan_lg(PatternScanner& scanner, struct scanner_params &sp);
 
 #endif
 #endif /* PATTERN_SCANNER_H */
@@ -1,5 +1,8 @@
 #include "config.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <set>
 #include <mutex>
 #include <ctype.h>
@@ -16,46 +19,83 @@
  **/
 
 pcap_writer::pcap_writer(const scanner_params &sp):
-    outpath(sp.sc.outdir / OUTPUT_FILENAME)
+    outpath(sp.sc.outdir / OUTPUT_FILENAME), id(next_id++)
 {
 }
 
 pcap_writer::~pcap_writer()
 {
+    const std::lock_guard<std::mutex> lock(Mfcap);
+    try {
+        for (auto &it : buffers) {
+            if (!it->empty()) pcap_write_block(*it);
+        }
+    } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+    }
     if (fcap){
-        const std::lock_guard<std::mutex> lock(Mfcap);
         fcap->close();
         delete fcap;
         fcap = nullptr;
     }
 }
 
-void pcap_writer::pcap_write_bytes(const uint8_t * const val, size_t num_bytes)
+pcap_writer::buffer_t &pcap_writer::thread_buffer()
 {
-    fcap->write(reinterpret_cast<const char *>(val),num_bytes);
-    if (fcap->rdstate() & (std::ios::failbit|std::ios::badbit)){
-        throw std::runtime_error(Formatter() << "scanner pcap_writer is unable to write to file " << outpath);
+    struct cache_t {
+        uint64_t id {~0ULL};
+        buffer_t *buf {nullptr};
+    };
+    static thread_local cache_t cache;
+    if (cache.id != id || cache.buf == nullptr) {
+        const std::lock_guard<std::mutex> lock(Mfcap);
+        buffers.push_back(std::make_unique<buffer_t>());
+        cache.id  = id;
+        cache.buf = buffers.back().get();
     }
+    return *cache.buf;
+}
+
+void pcap_writer::pcap_write_bytes(buffer_t &buf, const uint8_t * const val, size_t num_bytes)
+{
+    buf.insert(buf.end(), val, val + num_bytes);
 }
 
 /* Write a 16-bit value, little end first */
-void pcap_writer::pcap_write2(const uint16_t val)
+void pcap_writer::pcap_write2(buffer_t &buf, const uint16_t val)
 {
-    char ch = val & 0xff;
-    *fcap << ch;
-    ch = val >> 8;
-    *fcap << ch;
-    if (fcap->rdstate() & (std::ios::failbit|std::ios::badbit)){
-        throw std::runtime_error(Formatter() << "scanner scan_net is unable to write to file " << outpath);
-    }
+    buf.push_back(val & 0xff);
+    buf.push_back(val >> 8);
+}
+
+void pcap_writer::pcap_write4(buffer_t &buf, const uint32_t val)
+{
+    pcap_write_bytes(buf, reinterpret_cast<const uint8_t *>(&val), 4);
 }
 
-void pcap_writer::pcap_write4(const uint32_t val)
+void pcap_writer::pcap_write_block(buffer_t &buf)
 {
-    fcap->write(reinterpret_cast<const char *>(&val), 4);
+    if (fcap==0){
+        fcap = new std::ofstream(outpath, std::ios::binary); // write the output
+        if (fcap->is_open()==false){
+            throw std::runtime_error(Formatter() << "pcap_writer.cpp: cannot open " << outpath << " for  writing");
+        }
+        buffer_t header;
+        pcap_write4(header, 0xa1b2c3d4);
+        pcap_write2(header, 2);			// major version number
+        pcap_write2(header, 4);			// minor version number
+        pcap_write4(header, 0);			// time zone offset; always 0
+        pcap_write4(header, 0);			// accuracy of time stamps in the file; always 0
+        pcap_write4(header, PCAP_MAX_PKT_LEN);	// snapshot length
+        pcap_write4(header, DLT_EN10MB);	// link layer encapsulation
+        assert( header.size() == TCPDUMP_HEADER_SIZE );
+        fcap->write(reinterpret_cast<const char *>(header.data()), header.size());
+    }
+    fcap->write(reinterpret_cast<const char *>(buf.data()), buf.size());
     if (fcap->rdstate() & (std::ios::failbit|std::ios::badbit)){
-        throw std::runtime_error(Formatter() << "scanner scan_net is unable to write to file " << outpath);
+        throw std::runtime_error(Formatter() << "scanner pcap_writer is unable to write to file " << outpath);
     }
+    buf.clear();
 }
 
 
@@ -69,22 +109,7 @@ void pcap_writer::pcap_writepkt(const struct pcap_writer::pcap_hdr &h, // packet
                                 const bool add_frame,     // whether or not to create a synthetic ethernet frame
                                 const uint16_t frame_type)  // if we add a frame, the frame type
 {
-    // Make sure that neither this packet nor an encapsulated version of this packet has been written
-    const std::lock_guard<std::mutex> lock(Mfcap);  // lock the mutex
-    if (fcap==0){
-        fcap = new std::ofstream(outpath, std::ios::binary); // write the output
-        if (fcap->is_open()==false){
-            throw std::runtime_error(Formatter() << "pcap_writer.cpp: cannot open " << outpath << " for  writing");
-        }
-        pcap_write4(0xa1b2c3d4);
-        pcap_write2(2);			// major version number
-        pcap_write2(4);			// minor version number
-        pcap_write4(0);			// time zone offset; always 0
-        pcap_write4(0);			// accuracy of time stamps in the file; always 0
-        pcap_write4(PCAP_MAX_PKT_LEN);	// snapshot length
-        pcap_write4(DLT_EN10MB);	// link layer encapsulation
-        assert( fcap->tellp() == TCPDUMP_HEADER_SIZE );
-    }
+    buffer_t &buf = thread_buffer();
 
     size_t forged_header_len = 0;
     uint8_t forged_header[ETHER_HEAD_LEN];
@@ -106,20 +131,29 @@ void pcap_writer::pcap_writepkt(const struct pcap_writer::pcap_hdr &h, // packet
     }
 
     /* Write a packet */
-    pcap_write4(h.seconds);		// time stamp, seconds avalue
-    pcap_write4(h.useconds);		// time stamp, microseconds
-    pcap_write4(h.cap_len + forged_header_len);
-    pcap_write4(h.pkt_len + forged_header_len);
+    pcap_write4(buf, h.seconds);		// time stamp, seconds avalue
+    pcap_write4(buf, h.useconds);		// time stamp, microseconds
+    pcap_write4(buf, h.cap_len + forged_header_len);
+    pcap_write4(buf, h.pkt_len + forged_header_len);
     if (add_frame_and_safe) {
-        pcap_write_bytes(forged_header, sizeof(forged_header));
+        pcap_write_bytes(buf, forged_header, sizeof(forged_header));
+    }
+    if (pos < sbuf.bufsize) {           // the packet, as much of it as there is
+        pcap_write_bytes(buf, sbuf.get_buf() + pos, std::min<size_t>(h.cap_len, sbuf.bufsize - pos));
+    }
+
+    if (buf.size() >= BLOCK_SIZE) {
+        const std::lock_guard<std::mutex> lock(Mfcap);
+        pcap_write_block(buf);
     }
-    sbuf.write(*fcap, pos, h.cap_len );	// the packet
 }
 
 void pcap_writer::flush()
 {
+    buffer_t &buf = thread_buffer();
+    const std::lock_guard<std::mutex> lock(Mfcap);
+    if (!buf.empty()) pcap_write_block(buf);
     if (fcap){
-        const std::lock_guard<std::mutex> lock(Mfcap);
         fcap->flush();
     }
 }
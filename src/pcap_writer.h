@@ -1,9 +1,13 @@
 #ifndef PCAP_WRITER_H
 #define PCAP_WRITER_H
 
+#include <atomic>
 #include <mutex>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include "be13_api/scanner_params.h"
 
@@ -12,6 +16,7 @@
  *
  * Currently this will not write out a truncated packet.
  * multi-threaded, supporting a single object for multiple threads that's used for the entire bulk_extractor run.
+ * The threads' packets are interleaved in blocks, not in time order; pcap readers do not require it.
  *
  */
 
@@ -41,24 +46,37 @@
 
 class pcap_writer {
     static const inline std::string OUTPUT_FILENAME {"packets.pcap"};
+    const static inline size_t BLOCK_SIZE = 1024 * 1024; // a thread's packets are written this much at a time
     pcap_writer(const pcap_writer &pc) = delete;
     pcap_writer &operator=(const pcap_writer &that) = delete;
-    std::mutex Mfcap {};              // mutex for fcap
+    std::mutex Mfcap {};              // mutex for fcap and buffers
     std::ofstream *fcap = nullptr;		      // capture file, protected by M
     std::filesystem::path outpath;            // where it gets written
 
+    /* Each thread formats its packets into its own buffer, which is appended to fcap
+     * when it reaches BLOCK_SIZE, when the thread calls flush(), and when the writer is destroyed.
+     * The buffers belong to the writer; each thread caches a pointer to its own.
+     */
+    typedef std::vector<uint8_t> buffer_t;
+    std::vector<std::unique_ptr<buffer_t>> buffers {}; // protected by Mfcap
+    const uint64_t id;                                 // tells the threads' caches apart
+    static inline std::atomic<uint64_t> next_id {0};
+    buffer_t &thread_buffer();
+
     /*
      * According to 'man pcap-savefile', you need to implement this file format,
      * but there are no functions to do so.
      *
-     * pcap_write_bytes writes bytes; pcap accomidates.
-     * pcap_write2 writes a 2-byte value in native byte order; pcap accomidates.
-     * pcap_write4 writes a 4-byte value in native byte order; pcap accomidates.
+     * pcap_write_bytes appends bytes; pcap accomidates.
+     * pcap_write2 appends a 2-byte value, little end first; pcap accomidates.
+     * pcap_write4 appends a 4-byte value in native byte order; pcap accomidates.
+     * pcap_write_block writes a buffer to fcap, opening it and writing the file header first.
      * pcap_writepkt writes a packet
      */
-    void pcap_write_bytes(const uint8_t * const val, size_t num_bytes);
-    void pcap_write2(const uint16_t val);
-    void pcap_write4(const uint32_t val);
+    static void pcap_write_bytes(buffer_t &buf, const uint8_t * const val, size_t num_bytes);
+    static void pcap_write2(buffer_t &buf, const uint16_t val);
+    static void pcap_write4(buffer_t &buf, const uint32_t val);
+    void pcap_write_block(buffer_t &buf); // requires Mfcap
 
 public:
     const static inline size_t PCAP_MAX_PKT_LEN  = 65535;	// The longest a packet may be; longer values make wireshark refuse to load
@@ -81,7 +99,7 @@ public:
     pcap_writer(const scanner_params &sp);
     ~pcap_writer();
 
-    void flush();
+    void flush();                       // write the calling thread's packets and flush the file
 
     /* write an IP packet to the output stream, optionally writing a pcap header.
      * Length of packet is determined from IP header.
@@ -0,0 +1,78 @@
+#include "config.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+#include "perf_counters.h"
+
+const char *perf_counters::name(counter_t c)
+{
+    static const char *names[COUNTERS] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+    return c < COUNTERS ? names[c] : "";
+}
+
+#ifdef __linux__
+namespace {
+    /* The group of one thread: the cycle counter leads, and one read() returns all four */
+    class counter_group {
+        int fds[perf_counters::COUNTERS];
+        bool ok {false};
+        static int open_counter(uint64_t config, int group_fd) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size           = sizeof(attr);
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.config         = config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0); // this thread, any CPU
+        }
+    public:
+        counter_group() {
+            static const uint64_t configs[perf_counters::COUNTERS] =
+                {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+            for (int i=0; i<perf_counters::COUNTERS; i++) fds[i] = -1;
+            for (int i=0; i<perf_counters::COUNTERS; i++) {
+                fds[i] = open_counter(configs[i], i==0 ? -1 : fds[0]);
+                if (fds[i] < 0) return;
+            }
+            ok = true;
+            perf_counters::opened = true;
+        }
+        ~counter_group() {
+            for (int fd : fds) if (fd >= 0) close(fd);
+        }
+        counter_group(const counter_group &) = delete;
+        counter_group &operator=(const counter_group &) = delete;
+
+        bool read(perf_counters::values &out) {
+            if (!ok) return false;
+            uint64_t buf[3 + perf_counters::COUNTERS];  // nr, time enabled, time running, the values
+            if (::read(fds[0], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) ||
+                buf[0] != perf_counters::COUNTERS) {
+                return false;
+            }
+            const double scale = buf[2] ? double(buf[1]) / double(buf[2]) : 0;
+            for (int i=0; i<perf_counters::COUNTERS; i++) out.v[i] = uint64_t(buf[3+i] * scale);
+            return true;
+        }
+    };
+}
+
+bool perf_counters::read(values &out)
+{
+    thread_local counter_group group;
+    return group.read(out);
+}
+#else
+bool perf_counters::read(values &)
+{
+    return false;
+}
+#endif
@@ -0,0 +1,37 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * perf_counters:
+ * Hardware performance counters for the calling thread, read through perf_event_open() on Linux,
+ * so that scanner_watchdog can charge cycles, instructions, cache misses and branch misses to each
+ * scanner (-S perf_counters=YES). Each thread opens one group of counters, in user mode only, the
+ * first time it reads them. Counts are scaled for the time the kernel multiplexed the group off the PMU.
+ *
+ * Where the counters cannot be opened (not Linux, no PMU in a VM, or kernel.perf_event_paranoid too high),
+ * read() returns false and nothing is reported.
+ */
+
+class perf_counters {
+public:
+    enum counter_t { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, COUNTERS };
+    struct values {
+        uint64_t v[COUNTERS] {};
+        values &operator+=(const values &o) { for (int i=0; i<COUNTERS; i++) v[i] += o.v[i]; return *this; }
+        values operator-(const values &o) const {
+            values r;
+            for (int i=0; i<COUNTERS; i++) r.v[i] = v[i] > o.v[i] ? v[i] - o.v[i] : 0;
+            return r;
+        }
+    };
+
+    static inline std::atomic<bool> enabled {false};
+    static inline std::atomic<bool> opened {false};     // at least one thread opened its counters
+    static const char *name(counter_t c);               // for the DFXML attributes: cycles, instructions, ...
+    static bool read(values &out);                      // this thread's counts so far
+};
+
+#endif
@@ -1,10 +1,42 @@
-#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
 #include <chrono>
 #include <thread>
 #include <chrono>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include "config.h"
 #include "phase1.h"
+#include "alloc_profiler.h"
+#include "candidate_offload.h"
+#include "content_affinity.h"
+#include "content_cache.h"
+#include "cpu_dispatch.h"
+#include "fs_map.h"
+#include "io_throttle.h"
+#include "memory_governor.h"
+#include "output_checkpoint.h"
+#include "page_allocator.h"
+#include "page_classifier.h"
+#include "page_stash.h"
+#include "perf_counters.h"
+#include "queue_stats.h"
+#include "recursion_spill.h"
+#include "remote_workers.h"
+#include "scanner_priority.h"
+#include "scanner_tiles.h"
+#include "scanner_watchdog.h"
+#include "scratch_arena.h"
+#include "trace_writer.h"
+#include "triage_planner.h"
+#include "worker_tuner.h"
 #include "be13_api/utils.h"             // needs config.h
 #include "be13_api/aftimer.h"             // needs config.h
 #include "be13_api/dfxml_cpp/src/dfxml_writer.h"
@@ -31,6 +63,9 @@ using namespace std::chrono_literals;
 Phase1::Phase1(Config &config_, image_process &p_, scanner_set &ss_):
     config(config_), p(p_), ss(ss_), xreport(*ss_.get_dfxml_writer())
 {
+    if (!config.known_blocks_db.empty()) {
+        known = std::make_unique<known_blocks>(config.known_blocks_db);
+    }
 }
 
 /**
@@ -50,8 +85,8 @@ std::string Phase1::minsec(time_t tsec)
 void Phase1::Config::set_sampling_parameters(std::string param)
 {
     std::vector<std::string> params = split(param,':');
-    if (params.size()!=1 && params.size()!=2){
-        throw std::runtime_error("sampling parameters must be fraction[:passes]");
+    if (params.size()<1 || params.size()>3){
+        throw std::runtime_error("sampling parameters must be fraction[:passes[:strata]]");
     }
     sampling_fraction = atof(params.at(0).c_str());
     if (sampling_fraction<=0 || sampling_fraction>=1){
@@ -59,15 +94,194 @@ void Phase1::Config::set_sampling_parameters(std::string param)
         std::cerr << "sampling_fraction: " << sampling_fraction << std::endl;
         throw std::runtime_error("error: sampling fraction f must be 0<f<=1");
     }
-    if (params.size()==2){
+    if (params.size()>=2){
         sampling_passes = atoi(params.at(1).c_str());
         if (sampling_passes==0){
             throw std::runtime_error("error: sampling passes must be >=1");
         }
+        if (sampling_fraction * sampling_passes > 1.0){
+            throw std::runtime_error("error: sampling fraction * passes must be <=1");
+        }
+    }
+    if (params.size()==3){
+        const int strata = atoi(params.at(2).c_str());
+        if (strata<=0){
+            throw std::runtime_error("error: sampling strata must be >=1");
+        }
+        sampling_strata = strata;
+    }
+}
+
+
+
+void Phase1::Config::set_shard_parameters(std::string param)
+{
+    std::vector<std::string> params = split(param,'/');
+    if (params.size()!=2){
+        throw std::runtime_error("shard must be index/count");
+    }
+    shard_index = atoi(params.at(0).c_str());
+    shard_count = atoi(params.at(1).c_str());
+    if (shard_count==0 || shard_index>=shard_count){
+        throw std::runtime_error("error: shard index must be 0<=index<count");
+    }
+}
+
+/*
+ * Shards are whole pages, so every shard reads the same pages (with the same margins) as
+ * a single run; a feature that crosses a shard boundary is found by the page in which it starts,
+ * exactly once. The last shard runs to the end of the image.
+ */
+void Phase1::Config::set_shard_range(uint64_t image_size)
+{
+    if (shard_count==0) return;
+    const uint64_t pages = (image_size + opt_pagesize - 1) / opt_pagesize;
+    opt_scan_start = (pages * shard_index / shard_count) * opt_pagesize;
+    opt_scan_end   = (shard_index+1==shard_count) ? 0 : (pages * (shard_index+1) / shard_count) * opt_pagesize;
+}
+
+/*
+ * -G auto. Small pages balance the load across the threads; large pages amortize the cost of each
+ * sbuf (allocating, reading the margin again, and starting every scanner on it). The page size is
+ * the largest power of two giving each thread at least PAGES_PER_THREAD pages, between a minimum and
+ * the default page size, so auto never uses more memory than the default. When few scanners are enabled,
+ * each page is scanned quickly and the per-sbuf cost dominates, so the minimum is larger.
+ * A page is never smaller than its margin.
+ */
+size_t Phase1::Config::auto_pagesize(uint64_t image_size, u_int threads, size_t scanners, size_t margin)
+{
+    static const uint64_t PAGES_PER_THREAD = 16;
+    const size_t max_pagesize = Config().opt_pagesize;
+    size_t min_pagesize = std::max(scanners < 8 ? 4 * MIN_AUTO_PAGESIZE : MIN_AUTO_PAGESIZE, margin);
+    min_pagesize = std::min(min_pagesize, max_pagesize);
+    const uint64_t target = image_size / (std::max(threads, 1U) * PAGES_PER_THREAD);
+    size_t pagesize = max_pagesize;
+    while (pagesize > min_pagesize && pagesize > target) pagesize /= 2;
+    return std::max(pagesize, min_pagesize);
+}
+
+/*
+ * An image of a page or two takes less time to scan than the worker pool, the readers and the
+ * notifier take to start and stop, and its one page goes to one worker anyway.
+ */
+bool Phase1::Config::small_input(uint64_t image_size) const
+{
+    return small_input_pages > 0 && image_size > 0 && image_size <= uint64_t(small_input_pages) * opt_pagesize;
+}
+
+void Phase1::Config::use_main_thread()
+{
+    num_threads = 0;
+    read_ahead_pages = 0;
+    read_threads = 1;
+    opt_notification = false;
+    opt_auto_threads = false;
+}
+
+/*
+ * The quota allows this many threads, and the pages that are queued, read and scanned at once (as
+ * page_allocator counts them) take up no more than part of the memory limit, with the budget a little
+ * under the limit for the rest of the heap.
+ */
+void Phase1::Config::apply_container_limits(const container_limits &l)
+{
+    container = l;
+    if (num_threads) num_threads = l.threads(num_threads);
+    if (l.memory_bytes == 0) return;
+    memory_budget = l.memory_bytes * CONTAINER_BUDGET_FRACTION;
+    const uint64_t pages = num_threads + read_ahead_pages + read_threads + 1;
+    const size_t min_pagesize = std::max(MIN_AUTO_PAGESIZE, opt_marginsize);
+    while (opt_pagesize / 2 >= min_pagesize &&
+           pages * (opt_pagesize + opt_marginsize) > l.memory_bytes * CONTAINER_PAGES_FRACTION) {
+        opt_pagesize /= 2;
+    }
+}
+
+/*
+ * With -G auto, the last pages of the image are split so that the threads finish together instead of
+ * waiting for the last few full pages. Each piece keeps a whole margin, so pieces are no smaller
+ * than the margin (or MIN_AUTO_PAGESIZE).
+ */
+u_int Phase1::Config::split_pieces(uint64_t offset, size_t pagesize, uint64_t image_size) const
+{
+    const u_int threads = std::max(num_threads, 1U);
+    if (!opt_auto_pagesize || threads==1 || image_size==0) return 1;
+    if (offset + static_cast<uint64_t>(threads) * pagesize < image_size) return 1; // not one of the last pages
+    const size_t min_piece = std::max(opt_marginsize, MIN_AUTO_PAGESIZE);
+    return static_cast<u_int>(std::clamp<size_t>(pagesize / min_piece, 1, threads));
+}
+
+/*
+ * With -g auto, the margin is only as large as the enabled scanners need. A scanner's lookahead is how
+ * far past the start of a feature, structure or carved object it reads: the margin lets it see the whole
+ * of one that starts in the page. The fixed-size records of the structure scanners and the short features
+ * of the text scanners need little. The scanners that decompress, decode or carve objects of any size (zip,
+ * gzip, pdf, base64, exif, sqlite...), the find and lightgrep scanners, and plug-ins are not in the
+ * table; if any of them is enabled, the margin is the default.
+ */
+size_t Phase1::Config::scanner_lookahead(const std::string &scanner)
+{
+    static const size_t KiB = 1024;
+    static const std::map<std::string,size_t> table {
+        {"aes", 4*KiB},                 // a 240-byte AES-256 key schedule
+        {"ntfsmft", 4*KiB}, {"ntfsindx", 4*KiB}, {"ntfslogfile", 4*KiB}, // one record
+        {"ntfsusn", 64*KiB}, {"utmp", 4*KiB}, {"windirs", 4*KiB},
+        {"net", 128*KiB},               // a packet of up to 64 KiB and its headers
+        {"wordlist", 4*KiB},
+        {"accts", 64*KiB}, {"email", 64*KiB}, {"gps", 64*KiB}, {"httplogs", 64*KiB}, // features of one line
+    };
+    auto it = table.find(scanner);
+    return it==table.end() ? 0 : it->second;
+}
+
+size_t Phase1::Config::auto_marginsize(const std::vector<std::string> &scanners, size_t default_margin)
+{
+    size_t margin = MIN_AUTO_MARGINSIZE;
+    for (const auto &scanner : scanners) {
+        const size_t lookahead = scanner_lookahead(scanner);
+        if (lookahead==0) return default_margin;
+        margin = std::max(margin, lookahead);
     }
+    return std::min(margin, default_margin);
 }
 
+std::vector<int> Phase1::parse_cpulist(const std::string &cpulist)
+{
+    std::vector<int> cpus;
+    for (const auto &range : split(cpulist, ',')) {
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last  = (dash==std::string::npos) ? first : atoi(range.c_str() + dash + 1);
+        for (int cpu=first; cpu<=last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
 
+std::vector<std::vector<int>> Phase1::numa_node_cpus()
+{
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    for (int node=0; ; node++) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string line;
+        if (!std::getline(in, line)) break;
+        std::vector<int> cpus = parse_cpulist(line);
+        if (!cpus.empty()) nodes.push_back(cpus);
+    }
+#endif
+    return nodes;
+}
+
+void Phase1::pin_thread(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
 
 /**
  * attempt to get an sbuf. If we can't get it, we may be in a
@@ -81,7 +295,14 @@ sbuf_t *Phase1::get_sbuf(image_process::iterator &it)
     assert(config.max_bad_alloc_errors>0);
     for(u_int retry_count=0;retry_count<config.max_bad_alloc_errors;retry_count++){
         try {
-            return p.sbuf_alloc(it); // may throw exception
+            trace_writer::span span("read", "sbuf_alloc");
+            if (trace_writer::enabled) span.set_args("\"pos0\": " + trace_writer::json_string(it.get_pos0().str()));
+            sbuf_t *sbufp = p.sbuf_alloc(it); // may throw exception
+            if (io_throttle::enabled()) {
+                trace_writer::span wait("wait", "io_throttle");
+                io_throttle::charge(sbufp->bufsize); // the mapped pages of -S raw_mmap are charged here too
+            }
+            return sbufp;
         }
         catch (const std::bad_alloc &e) {
             // Low memory could come from a bad sbuf alloc or another low memory condition.
@@ -106,126 +327,899 @@ sbuf_t *Phase1::get_sbuf(image_process::iterator &it)
 }
 
 
+Phase1::block_sampler::block_sampler(uint64_t max_blocks_, double frac_, uint64_t seed_, u_int pass_, uint64_t strata_):
+    max_blocks(max_blocks_), frac(frac_), seed(seed_), pass(pass_), strata(std::min(strata_, max_blocks_))
+{
+}
+
+uint64_t Phase1::block_sampler::mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* A pseudo-random permutation of [0,len), keyed: a balanced Feistel network on the smallest even number of
+ * bits that holds len, cycle-walked until it lands in [0,len). The domain is less than 4*len, so that takes
+ * a few rounds of the network at most, on average.
+ */
+uint64_t Phase1::block_sampler::permute(uint64_t x, uint64_t len, uint64_t key) const
+{
+    unsigned bits = 0;
+    while (bits < 64 && (1ULL << bits) < len) bits++;
+    const unsigned half = (bits + 1) / 2;
+    const uint64_t mask = (1ULL << half) - 1;
+    do {
+        uint64_t l = x >> half, r = x & mask;
+        for (uint64_t round=0; round<4; round++){
+            const uint64_t f = mix(seed ^ mix(key ^ (round << 56) ^ r)) & mask;
+            const uint64_t t = l ^ f;
+            l = r;
+            r = t;
+        }
+        x = (l << half) | r;
+    } while (x >= len);
+    return x;
+}
+
+/* Select this pass's blocks from the next stratum: rank the stratum's blocks by a permutation keyed by the
+ * seed and the stratum, and take ranks [pass*n, (pass+1)*n), where n is the stratum's share. Only those n
+ * blocks are generated, so a large stratum costs no more than a small one.
+ */
+void Phase1::block_sampler::load_stratum()
+{
+    stratum_blocks.clear();
+    stratum_pos = 0;
+    const uint64_t stratum_size = (max_blocks + strata - 1) / strata;
+    const uint64_t start = stratum * stratum_size;
+    const uint64_t end   = std::min(start + stratum_size, max_blocks);
+    const uint64_t key   = mix(stratum);
+    stratum++;
+    if (start >= end) return;
+
+    const uint64_t len   = end - start;
+    const uint64_t n     = std::max<uint64_t>(1, llround(len * frac));
+    const uint64_t first = pass * n;
+    if (first >= len) return;
+    const uint64_t last  = std::min(first + n, len);
+
+    stratum_blocks.reserve(last - first);
+    for (uint64_t i=first; i<last; i++){
+        stratum_blocks.push_back(start + permute(i, len, key));
+    }
+    std::sort(stratum_blocks.begin(), stratum_blocks.end());
+}
+
+bool Phase1::block_sampler::next(uint64_t &block)
+{
+    if (strata==0){
+        const double lo = pass * frac;
+        const double hi = (pass + 1) * frac; // computed the same way as the next pass's lo, so passes tile [0,1)
+        while (next_block < max_blocks){
+            uint64_t b = next_block++;
+            double ub = u(b);
+            if (lo <= ub && ub < hi){
+                block = b;
+                return true;
+            }
+        }
+        return false;
+    }
+    while (stratum_pos >= stratum_blocks.size()){
+        if (stratum >= strata) return false;
+        load_stratum();
+    }
+    block = stratum_blocks[stratum_pos++];
+    return true;
+}
+
+/*
+ * The children that recursion_spill put off are scanned at their own depth, as sp.recurse() would have
+ * scheduled them.
+ */
+void Phase1::resume_spilled(bool wait)
+{
+    if (!recursion_spill::enabled()) return;
+    while (sbuf_t *child = recursion_spill::resume(wait)) {
+        ss.schedule_sbuf(child);        // processes the child, then deletes it
+    }
+}
+
 /**
- * Create a list sorted list of random blocks.
+ * Admission control for the scanner queue.
+ * Once more than queue_high_water bytes of depth0 sbufs are queued, stop reading until the queue
+ * has drained to queue_low_water. The queue depth is an atomic in the scanner_set, which does
+ * not signal when work completes, so it is checked every QUEUE_POLL_INTERVAL. This lets the
+ * reader resume within a millisecond of the workers freeing up capacity.
  */
-void Phase1::make_sorted_random_blocklist(blocklist_t *blocklist,uint64_t max_blocks,float frac)
+uint64_t Phase1::high_water() const
 {
-    if (frac>0.2){
-        std::cerr << "A better random sampler is needed for this many random blocks. \n"
-                  << "We should have an iterator that decides if to include or not to include based on frac.\n";
-        throw std::runtime_error("Specify frac<0.2");
+    if (config.queue_high_water) return config.queue_high_water;
+    return std::max<uint64_t>(ss.get_thread_count(), 1) * (config.opt_pagesize + config.opt_marginsize);
+}
+
+void Phase1::wait_for_queue_capacity()
+{
+    checkpoint_outputs();
+    resume_spilled(false);              // the deep work that waited for memory goes before another page
+    const uint64_t high = high_water();
+    const uint64_t page_bytes = config.opt_pagesize + config.opt_marginsize;
+    if (memory_governor::over_budget(page_bytes)) {
+        trace_writer::span span("wait", "memory_budget");
+        queue_stats::wait_timer timer(queue_stats::MEMORY_BUDGET);
+        const auto deadline = std::chrono::steady_clock::now() + memory_governor::READER_WAIT;
+        while (memory_governor::over_budget(page_bytes) && ss.disk_write_errors==0) {
+            /* with nothing queued, nothing will be freed; read the page over budget */
+            if (ss.depth0_bytes_in_queue==0 || std::chrono::steady_clock::now() >= deadline) {
+                memory_governor::reader_timeouts++;
+                break;
+            }
+            std::this_thread::sleep_for(memory_governor::POLL_INTERVAL); // the workers will free memory
+        }
     }
+    unstash();
+    if (ss.depth0_bytes_in_queue <= high) return;
+    if (page_stash::enabled() && page_stash::has_room()) return; // the next page is stashed
 
-    std::default_random_engine generator;
-    std::uniform_int_distribution<uint64_t> distribution(0,max_blocks);
-    while(blocklist->size() < max_blocks * frac){
-        blocklist->insert( distribution(generator) ); // will be added even if already present
+    trace_writer::span span("wait", "queue_capacity");
+    queue_stats::wait_timer timer(queue_stats::QUEUE_CAPACITY);
+    uint64_t low = config.queue_low_water ? std::min(config.queue_low_water, high) : high / 2;
+    while (ss.depth0_bytes_in_queue > low && ss.disk_write_errors==0) {
+        std::this_thread::sleep_for(QUEUE_POLL_INTERVAL);
     }
+    unstash();
 }
 
-void Phase1::read_process_sbufs()
+Phase1::image_hasher *Phase1::image_hasher::make(const std::string &alg)
+{
+    if (alg=="sha1")   return new image_hasher_t<dfxml::sha1_generator>("SHA1");
+    if (alg=="sha256") return new image_hasher_t<dfxml::sha256_generator>("SHA256");
+    throw std::runtime_error("image_hash_alg must be sha1 or sha256");
+}
+
+/**
+ * Add the page to the image hash.
+ * sbufs must be delivered in image order for the hash to be computed.
+ */
+void Phase1::hash_sbuf(const sbuf_t &sbuf)
+{
+    if (hasher){
+        if (sbuf.pos0.offset==hash_next){
+            // next byte follows logically, so continue to compute hash
+            hasher->update(sbuf.get_buf(), sbuf.pagesize);
+            hash_next += sbuf.pagesize;
+
+        } else {
+            delete hasher; // we had a logical gap; stop hashing
+            hasher = nullptr;
+        }
+    }
+}
+
+std::filesystem::path Phase1::checkpoint_path() const
+{
+    if (ss.sc.outdir.empty()) return std::filesystem::path();
+    return ss.sc.outdir / page_ranges::CHECKPOINT_FILENAME;
+}
+
+/*
+ * Rewrite the checkpoint as the ranges of the pages seen in previous runs and this one,
+ * then reopen it so that new pages are appended.
+ */
+void Phase1::checkpoint_compact()
+{
+    std::filesystem::path fname = checkpoint_path();
+    if (fname.empty()) return;
+    if (checkpoint_log.is_open()) checkpoint_log.close();
+    page_ranges all(config.seen_pages);
+    all.merge(scheduled_pages);
+    all.save(fname);
+    checkpoint_log.open(fname, std::ios::app);
+    checkpoint_compacted = time(nullptr);
+}
+
+/*
+ * With -S checkpoint_outputs, wait (before reading another page) until the scanners have finished every
+ * page given to them and the sbufs they made, then record the feature files' lengths with those pages.
+ * In read-ahead mode the pages already read are scheduled and scanned while this waits, since no sbuf
+ * may be left. The scanner set does not signal when it is idle, so the count of sbufs is polled.
+ */
+void Phase1::checkpoint_outputs()
+{
+    if (!config.checkpoint_outputs || checkpoint_path().empty()) return;
+    if (time(nullptr) - outputs_checkpointed < config.checkpoint_seconds) return;
+    outputs_checkpointed = time(nullptr);
+
+    trace_writer::span span("wait", "output_checkpoint");
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        unstash();
+        resume_spilled(false);
+        if (sbuf_t::sbuf_count==0 && page_stash::size()==0 && recursion_spill::pending()==0) break;
+        if (std::chrono::steady_clock::now() - start > output_checkpoint::MAX_WAIT || ss.disk_write_errors) {
+            output_checkpoint::skipped++;
+            return;
+        }
+        std::this_thread::sleep_for(QUEUE_POLL_INTERVAL);
+    }
+    output_checkpoint::wait_seconds = output_checkpoint::wait_seconds +
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const std::vector<std::string> recorders = ss.feature_file_list();
+    for (const auto &name : recorders) {
+        ss.fs.named_feature_recorder(name).flush();
+    }
+    page_ranges done(config.seen_pages);
+    done.merge(scheduled_pages);
+    output_checkpoint::save(ss.sc.outdir, recorders, done);
+}
+
+/*
+ * Zero-filled and erased (0xFF) pages are common in large images and none of the scanners find
+ * anything in them. Other constant values are still scanned, since a run of printable characters
+ * can be a feature. The margin is checked too, because features that start in the page end there.
+ * The overlapping memcmp() compares each byte with the next one using the library's vectorized code.
+ */
+bool Phase1::constant_page(const sbuf_t &sbuf)
+{
+    const uint8_t *buf = sbuf.get_buf();
+    const size_t len = sbuf.bufsize;
+    if (len==0) return false;
+    if (buf[0]!=0x00 && buf[0]!=0xff) return false;
+    return len==1 || memcmp(buf, buf+1, len-1)==0;
+}
+
+void Phase1::schedule(sbuf_t *sbufp)
+{
+    total_bytes += sbufp->pagesize;
+    if (sbufp->depth()==0) {
+        depth0_scheduled++;
+        scheduled_pages.add(sbufp->pos0, sbufp->pagesize);
+        if (checkpoint_log.is_open()) {
+            page_ranges::write_page(checkpoint_log, sbufp->pos0, sbufp->pagesize);
+            checkpoint_log.flush();
+            if (time(nullptr) - checkpoint_compacted >= config.checkpoint_seconds) {
+                checkpoint_compact();
+            }
+        }
+    }
+    if (config.opt_skip_constant_pages && sbufp->depth()==0 && constant_page(*sbufp)) {
+        constant_pages++;
+        delete sbufp;                   // already hashed and recorded; nothing to scan
+        return;
+    }
+    if (known && sbufp->depth()==0) {
+        const auto runs = known->known_runs(sbufp->get_buf(), sbufp->pagesize, sbufp->pos0.offset);
+        if (!runs.empty()) {
+            schedule_unknown(sbufp, runs);
+            return;
+        }
+    }
+    if (sbufp->depth()==0 && sbufp->pos0.path.empty()) {
+        const u_int pieces = config.split_pieces(sbufp->pos0.offset, sbufp->pagesize, p.image_size());
+        if (pieces>1) {
+            schedule_pieces(sbufp, pieces);
+            return;
+        }
+    }
+    enqueue(sbufp);
+}
+
+/* Queue the sbuf for the scanners, which process it and then delete it; or stash it while the queue is full,
+ * or give it to the remote workers (-S remote_workers) */
+void Phase1::enqueue(sbuf_t *sbufp)
+{
+    if (remote_workers::enabled() && sbufp->depth()==0) {
+        remote_workers::put(sbufp);     // a remote worker scans it
+        return;
+    }
+    if (page_stash::enabled() && sbufp->depth()==0 && ss.depth0_bytes_in_queue > high_water()) {
+        if (page_stash::put(sbufp)) return;
+    }
+    queue_stats::enqueued(sbufp, sbufp->depth());
+    ss.schedule_sbuf(sbufp);
+}
+
+/* Queue the stashed pages, oldest first, while the queue has room */
+void Phase1::unstash()
+{
+    if (!page_stash::enabled()) return;
+    const uint64_t high = high_water();
+    while (ss.depth0_bytes_in_queue <= high) {
+        sbuf_t *sbufp = page_stash::take();
+        if (sbufp==nullptr) break;
+        queue_stats::enqueued(sbufp, 0);
+        ss.schedule_sbuf(sbufp);
+    }
+}
+
+/*
+ * Each piece is a depth-0 sbuf with its own page and as much of the margin as the page has,
+ * so features are found (and reported at the same offsets) as if the page were scanned whole.
+ */
+void Phase1::schedule_piece(const sbuf_t &sbuf, size_t start, size_t this_pagesize)
+{
+    const size_t len = std::min(sbuf.bufsize - start, this_pagesize + config.opt_marginsize);
+    sbuf_t *child = sbuf_t::sbuf_malloc(sbuf.pos0 + start, len, this_pagesize);
+    memcpy(child->malloc_buf(), sbuf.get_buf() + start, len);
+    enqueue(child);
+}
+
+void Phase1::schedule_pieces(sbuf_t *sbufp, u_int pieces)
+{
+    const size_t piece = (sbufp->pagesize + pieces - 1) / pieces;
+    for (size_t start=0; start < sbufp->pagesize; start += piece) {
+        schedule_piece(*sbufp, start, std::min(piece, sbufp->pagesize - start));
+        split_pages++;
+    }
+    delete sbufp;
+}
+
+/*
+ * The parts of the page between the runs of known blocks are scanned as pieces. Each keeps a margin,
+ * which may run into the known blocks after it, so what starts in an unknown part is found whole.
+ */
+void Phase1::schedule_unknown(sbuf_t *sbufp, const std::vector<std::pair<size_t, size_t>> &known_runs)
+{
+    size_t start = 0;
+    for (const auto &run : known_runs) {
+        if (run.first > start) schedule_piece(*sbufp, start, run.first - start);
+        known_blocks::skipped_bytes += run.second - run.first;
+        start = run.second;
+    }
+    if (start < sbufp->pagesize) {
+        schedule_piece(*sbufp, start, sbufp->pagesize - start);
+    } else if (known_runs.size()==1 && known_runs.front().first==0) {
+        known_blocks::skipped_pages++;
+    }
+    delete sbufp;
+}
+
+/**
+ * Hash the sbuf (if we are hashing) and hand it to the scanner set, which processes it and then deletes it.
+ */
+void Phase1::process_sbuf(sbuf_t *sbufp)
+{
+    if (sbufp==nullptr) return;         // nothing was read
+    hash_sbuf(*sbufp);
+    schedule(sbufp);
+}
+
+void Phase1::report_read_exception(const std::exception &e, const pos0_t &pos0)
+{
+    // report uncaught exceptions to both user and XML file
+    std::stringstream sstr;
+    sstr << "phase=1 name='" << e.what() << "' " << "pos0='" << pos0 << "' ";
+
+    if (config.opt_report_read_errors) {
+        std::cerr << "Phase 1 Exception " << e.what() << " skipping " << pos0 << "\n";
+    }
+    xreport.xmlout("debug:exception", e.what(), sstr.str(), true);
+}
+
+/**
+ * Run the image iterator and deliver the location of every page that should be read.
+ */
+void Phase1::exit_on_disk_write_error() const
+{
+    if (ss.disk_write_errors == 0) return;
+    for(int i=0;i<5;i++){
+        std::cerr << std::endl;
+    }
+    std::cerr << "*** DISK WRITE ERROR ***" << std::endl;
+    std::cerr << "Disk is likely full. Clear space and restart (press up arrow) " << std::endl;
+    exit(1);
+}
+
+void Phase1::read_sbufs(const std::function<void(const image_process::iterator &)> &deliver,
+                        const run_deliverer &deliver_run)
 {
-    /* A single loop with two iterators.
+    if (config.triage_minutes) {
+        read_triage(deliver);
+        return;
+    }
+
+    /* For each pass, a single loop with two iterators.
      *
      * it -- the regular image_iterator; it knows how to read blocks.
      *
-     * si -- the sampling iterator. It is a iterator for an STL set.
+     * sampler -- the sampling iterator. It produces the block numbers of this pass in order.
      *
-     * If sampling, si is used to ask for a specific page from it.
+     * If sampling, the sampler is used to ask for a specific page from it.
      */
-    blocklist_t blocks_to_sample;
-    blocklist_t::const_iterator si = blocks_to_sample.begin(); // sampling iterator
-    image_process::iterator     it = p.begin(); // sequential iterator
+    const u_int passes = sampling() ? config.sampling_passes : 1;
+    for (u_int pass=0; pass<passes; pass++){
+        image_process::iterator it = p.begin(); // sequential iterator
 
-    if (config.opt_scan_start){
-        std::cout << "offset set to " << config.opt_scan_start << "\n";
-        it.set_raw_offset(config.opt_scan_start);
-    }
+        if (config.opt_scan_start){
+            std::cout << "offset set to " << config.opt_scan_start << "\n";
+            it.set_raw_offset(config.opt_scan_start);
+        }
 
-    if (sampling()){
-        /* Create a list of blocks to sample */
-        std::cerr << "sampling\n";
-        make_sorted_random_blocklist(&blocks_to_sample,it.max_blocks(),config.sampling_fraction);
-        si = blocks_to_sample.begin();    // get the new beginning
-    } else {
-        /* Not sampling */
-        sha1g = new dfxml::sha1_generator();
-    }
-    /* Loop over the blocks to sample */
-    while(it != p.end()) {
-        /* If there is a disk write error, shut down */
-        if (ss.disk_write_errors > 0 ){
-            for(int i=0;i<5;i++){
-                std::cerr << std::endl;
+        block_sampler sampler(it.max_blocks(), config.sampling_fraction, config.sampling_seed, pass, config.sampling_strata);
+        size_t order_pos = 0;
+        if (sampling()){
+            if (!config.opt_recurse) {  // the files of a directory are not read at offsets
+                std::cerr << "sampling " << passes << (passes==1 ? " pass" : " passes, merged into one read") << "\n";
+                read_sampled(passes, deliver_run);
+                break;
+            }
+            std::cerr << "sampling pass " << pass+1 << " of " << passes << "\n";
+        }
+
+        /* Loop over the blocks to sample */
+        while(it != p.end()) {
+            exit_on_disk_write_error(); // if there is a disk write error, shut down
+
+            if (sampling()){                // if sampling, seek the iterator
+                uint64_t block = 0;
+                if (!sampler.next(block)) break;
+                it.seek_block(block);
+            } else if (fs_ordered) {
+                if (order_pos >= page_order.size()) break;
+                it.seek_block(page_order[order_pos++]);
+            }
+            /* If we have gone to far, break */
+            if (config.opt_scan_end!=0 && config.opt_scan_end <= it.raw_offset ){
+                break;                      // passed the offset
+            }
+
+            /* If there are too many bytes in the queue, wait... */
+            wait_for_queue_capacity();
+
+            if (config.opt_page_start<=it.page_number && config.opt_scan_start<=it.raw_offset){
+                // Only process pages we haven't seen before
+                if (!config.seen_pages.contains(it.get_pos0())){
+                    try {
+                        deliver( it );
+                    }
+                    catch (const std::exception &e) {
+                        report_read_exception(e, it.get_pos0());
+                    }
+                }
+            }
+
+            /* Report back the fraction done if requested */
+            if (config.fraction_done) {
+                const double done = fs_ordered ? double(order_pos) / page_order.size() : p.fraction_done(it);
+                *config.fraction_done = (pass + done) / passes;
             }
-            std::cerr << "*** DISK WRITE ERROR ***" << std::endl;
-            std::cerr << "Disk is likely full. Clear space and restart (press up arrow) " << std::endl;
-            exit(1);
+            ++it;
         }
+    }
+}
+
+/**
+ * The sampling passes, read as one schedule in runs. Each pass's sampler selects units of sample_unit()
+ * bytes in increasing order; the passes are merged by offset (a unit that two passes select is read
+ * once, for the first), so the device sees one pass over the image rather than one per -s pass. A unit
+ * that starts within sampling_coalesce bytes of the end of the one before is read with it, while the
+ * run's units span at most SAMPLE_RUN_PAGES pages, so nearby units are a few sequential reads rather
+ * than a seek for each. The runs go to the reader threads in order, read_ahead_pages ahead. Each unit
+ * keeps its pass, for the per-pass counts in the DFXML.
+ */
+void Phase1::read_sampled(u_int passes, const run_deliverer &deliver_run)
+{
+    const uint64_t unit       = sample_unit();
+    const uint64_t image_size = p.image_size();
+    const uint64_t units      = (image_size + unit - 1) / unit;
+    const uint64_t scan_start = std::max<uint64_t>(config.opt_scan_start, config.opt_page_start * p.pagesize);
+    const uint64_t scan_end   = config.opt_scan_end ? std::min(config.opt_scan_end, image_size) : image_size;
 
-        if (sampling()){                // if sampling, seek the iterator
-            if (si==blocks_to_sample.end()) break;
-            it.seek_block(*si);
+    /* the next unit of each pass, in a min-heap of (unit, pass) */
+    std::vector<block_sampler> samplers;
+    std::vector<std::pair<uint64_t, u_int>> heads;
+    for (u_int pass=0; pass<passes; pass++) {
+        samplers.emplace_back(units, config.sampling_fraction, config.sampling_seed, pass, config.sampling_strata);
+        uint64_t u = 0;
+        if (samplers.back().next(u)) heads.push_back(std::make_pair(u, pass));
+    }
+    const auto later = std::greater<std::pair<uint64_t, u_int>>();
+    std::make_heap(heads.begin(), heads.end(), later);
+
+    sample_run run;
+    auto flush = [&]{
+        if (run.units.empty()) return;
+        run.len = std::min(run.units.back() + unit + config.opt_marginsize, image_size) - run.start;
+        wait_for_queue_capacity();
+        try {
+            deliver_run(run);
         }
-        /* If we have gone to far, break */
-        if (config.opt_scan_end!=0 && config.opt_scan_end <= it.raw_offset ){
-            break;                      // passed the offset
+        catch (const std::exception &e) {
+            report_read_exception(e, pos0_t("", run.start));
         }
+        run.units.clear();
+        run.passes.clear();
+    };
+    bool have_last = false;
+    uint64_t last = 0;
+    while (!heads.empty()) {
+        std::pop_heap(heads.begin(), heads.end(), later);
+        const auto [u, pass] = heads.back();
+        uint64_t next = 0;
+        if (samplers[pass].next(next)) {
+            heads.back().first = next;
+            std::push_heap(heads.begin(), heads.end(), later);
+        } else {
+            heads.pop_back();
+        }
+        if (have_last && u == last) continue; // selected by an earlier pass too
+        have_last = true;
+        last = u;
 
-        /* If there are too many in the queue, wait... */
-        if (ss.depth0_sbufs_in_queue > ss.get_thread_count()) {
-            using namespace std::chrono_literals;
-            std::this_thread::sleep_for(2000ms);
-            continue;
+        exit_on_disk_write_error();
+        const uint64_t offset = u * unit;
+        if (offset < scan_start) continue;
+        if (offset >= scan_end) break;
+        if (config.seen_pages.contains(pos0_t("", offset))) continue;
+        if (!run.units.empty() && (offset > run.units.back() + unit + config.sampling_coalesce ||
+                                   offset + unit > run.start + SAMPLE_RUN_PAGES * p.pagesize)) {
+            flush();
         }
+        if (run.units.empty()) run.start = offset;
+        run.units.push_back(offset);
+        run.passes.push_back(pass);
+        if (config.fraction_done) *config.fraction_done = double(u) / units;
+    }
+    flush();
+}
 
-        if (config.opt_page_start<=it.page_number && config.opt_scan_start<=it.raw_offset){
-            // Only process pages we haven't seen before
-            if (config.seen_page_ids.find(it.get_pos0().str()) == config.seen_page_ids.end()){
-                try {
-                    sbuf_t *sbufp = get_sbuf(it);
-
-                    /* compute the sha1 hash */
-                    if (sha1g){
-                        if (sbufp->pos0.offset==hash_next){
-                            // next byte follows logically, so continue to compute hash
-                            sha1g->update(sbufp->get_buf(), sbufp->pagesize);
-                            hash_next += sbufp->pagesize;
-
-                        } else {
-                            delete sha1g; // we had a logical gap; stop hashing
-                            sha1g = 0;
+/* Read a run and cut each of its units out as a depth-0 sbuf with its margin */
+std::vector<sbuf_t *> Phase1::read_run(const sample_run &run)
+{
+    trace_writer::span span("read", "sample_run");
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[run.len]);
+    const ssize_t got = p.pread(buf.get(), run.len, run.start);
+    if (got < 0) throw image_process::ReadError();
+    io_throttle::charge(got);
+    sampling_reads++;
+    sampling_bytes += got;
+
+    const uint64_t unit       = sample_unit();
+    const uint64_t image_size = p.image_size();
+    const uint64_t end        = run.start + got;
+    std::vector<sbuf_t *> sbufs;
+    for (size_t i = 0; i < run.units.size(); i++) {
+        const uint64_t offset = run.units[i];
+        if (offset >= end) break;       // a short read
+        const size_t this_pagesize = std::min(unit, image_size - offset);
+        const size_t len = std::min<uint64_t>(this_pagesize + config.opt_marginsize, end - offset);
+        sbuf_t *sbufp = sbuf_t::sbuf_malloc(pos0_t("", offset), len, std::min(this_pagesize, len));
+        memcpy(sbufp->malloc_buf(), buf.get() + (offset - run.start), len);
+        sbufs.push_back(sbufp);
+        sampling_units++;
+        if (i < run.passes.size() && run.passes[i] < pass_units.size()) {
+            pass_units[run.passes[i]]++;
+            pass_bytes[run.passes[i]] += sbufp->pagesize;
+        }
+    }
+    return sbufs;
+}
+
+/**
+ * -S triage_minutes: scan a stratified sample, wait for the scanners to finish it, rank the regions by
+ * the features they found (see triage_planner.h), and read the regions whole, best first, until the
+ * budget is spent. The sample may take at most half of the budget, waiting included.
+ */
+void Phase1::read_triage(const std::function<void(const image_process::iterator &)> &deliver)
+{
+    typedef std::chrono::steady_clock clock;
+    const auto start    = clock::now();
+    const auto budget   = std::chrono::duration_cast<clock::duration>(std::chrono::minutes(config.triage_minutes));
+    const auto deadline = start + budget;
+    image_process::iterator it = p.begin();
+    const uint64_t max_blocks = it.max_blocks();
+    triage_planner plan(max_blocks, config.triage_regions);
+    triage_region_blocks = plan.region_blocks();
+    std::vector<bool> read(max_blocks);
+    uint64_t delivered = 0;
+    auto read_block = [&](uint64_t block) {
+        it.seek_block(block);
+        wait_for_queue_capacity();
+        read[block] = true;
+        if (config.seen_pages.contains(it.get_pos0())) return;
+        try {
+            deliver(it);
+            delivered++;
+        }
+        catch (const std::exception &e) {
+            report_read_exception(e, it.get_pos0());
+        }
+        if (config.fraction_done) *config.fraction_done = double(triage_sample_pages + triage_pages) / max_blocks;
+    };
+
+    /* the sample, with a stratum for each region */
+    const auto sample_deadline = start + budget / 2;
+    block_sampler sampler(max_blocks, config.triage_sample, config.sampling_seed, 0, config.triage_regions);
+    for (uint64_t block = 0; ss.disk_write_errors==0 && clock::now() < sample_deadline && sampler.next(block); ) {
+        read_block(block);
+        plan.add_sampled(block, p.pagesize);
+        triage_sample_pages++;
+    }
+    while ((depth0_scheduled < delivered || ss.depth0_bytes_in_queue > 0) && clock::now() < sample_deadline) {
+        std::this_thread::sleep_for(QUEUE_POLL_INTERVAL);
+    }
+    /* the scanners may still be writing if the wait ran out; the lines they have not finished are not counted */
+    for (const auto &name : ss.feature_file_list()) {
+        ss.fs.named_feature_recorder(name).flush();
+    }
+    triage_sample_features = plan.count_features(ss.sc.outdir, p.pagesize);
+    if (!config.opt_quiet) {
+        std::cout << "triage: " << triage_sample_features << " features in a sample of " << triage_sample_pages
+                  << " pages; scanning the densest of " << plan.regions() << " regions" << std::endl;
+    }
+
+    for (uint64_t region : plan.ranked_regions()) {
+        bool whole = true;
+        for (uint64_t block = plan.region_start(region); block < plan.region_end(region); block++) {
+            if (ss.disk_write_errors > 0 || clock::now() >= deadline) {
+                triage_out_of_time = true;
+                whole = false;
+                break;
+            }
+            if (read[block]) continue;
+            read_block(block);
+            triage_pages++;
+        }
+        triage_scanned.push_back(triage_region{region, plan.score(region), whole});
+        if (triage_out_of_time) break;
+    }
+}
+
+/**
+ * Read the sbufs and hand them to the scanner set.
+ *
+ * If read_ahead_pages>0, a dispatcher thread runs the image iterator and keeps up to
+ * read_ahead_pages pages in flight, so that the disk stays busy while this thread schedules.
+ * If the image supports concurrent reads, read_threads reader threads read (and for
+ * E01 files, decompress) those pages in parallel. A hashing thread hashes each page after it
+ * is read and before it is scheduled, since the scanner set deletes the sbuf when it is done.
+ * Pages are always hashed and scheduled in image order.
+ * With -R, each reader task reads dir_batch_files files, so that millions of small files
+ * do not each pay for a task and two queue handoffs.
+ */
+/*
+ * With -S fs_priority, the pages are read in the order of their fs_map classes. The image is not
+ * hashed, as when sampling, since its pages are not read in order.
+ */
+void Phase1::order_by_fs()
+{
+    fs_map m = fs_map::read(p);
+    for (const auto &v : m.volumes) {
+        xreport.xmlout("fs_volume", "",
+                       "type='" + v.type + "' start='" + std::to_string(v.start) + "' length='" + std::to_string(v.length) +
+                       "' cluster_size='" + std::to_string(v.cluster_size) + "'", false);
+    }
+    const std::vector<uint64_t> bytes = m.class_bytes(p.image_size());
+    std::string attrs;
+    for (int c = 0; c < fs_map::CLASSES; c++) {
+        attrs += std::string(c ? " " : "") + fs_map::class_name(fs_map::class_t(c)) + "='" + std::to_string(bytes[c]) + "'";
+    }
+    xreport.xmlout("fs_classes", "", attrs, false);
+    if (m.volumes.empty()) {
+        if (!config.opt_quiet) std::cout << "fs_priority: no NTFS or FAT volumes; reading the image in order" << std::endl;
+        return;
+    }
+    page_order = m.page_order(p.image_size(), p.pagesize, fs_map::parse_priority(config.fs_priority));
+    fs_ordered = true;
+    xreport.xmlout("fs_order", "", "priority='" + config.fs_priority + "' pages='" + std::to_string(page_order.size()) + "'", false);
+    if (!config.opt_quiet) {
+        std::cout << "fs_priority: " << m.volumes.size() << " volumes; " << page_order.size() << " of "
+                  << p.max_blocks(p.begin()) << " pages to read, " << config.fs_priority << " first" << std::endl;
+    }
+}
+
+void Phase1::dfxml_write_triage()
+{
+    const uint64_t region_bytes = triage_region_blocks * p.pagesize;
+    xreport.push("triage", "budget_minutes='" + std::to_string(config.triage_minutes) +
+                 "' region_bytes='" + std::to_string(region_bytes) + "'");
+    xreport.xmlout("sample", "", "pages='" + std::to_string(triage_sample_pages) +
+                   "' features='" + std::to_string(triage_sample_features) + "'", false);
+    for (const auto &r : triage_scanned) {
+        std::stringstream attrs;
+        attrs << "start='" << r.region * region_bytes << "' end='" << std::min<uint64_t>((r.region + 1) * region_bytes, p.image_size())
+              << "' score='" << r.score << "' whole='" << (r.whole ? 1 : 0) << "'";
+        xreport.xmlout("region", "", attrs.str(), false);
+    }
+    const uint64_t pages = triage_sample_pages + triage_pages;
+    const uint64_t max_blocks = p.max_blocks(p.begin());
+    std::stringstream attrs;
+    attrs << "pages='" << pages << "' of='" << max_blocks << "' fraction='" << (max_blocks ? double(pages) / max_blocks : 0)
+          << "' out_of_time='" << (triage_out_of_time ? 1 : 0) << "'";
+    xreport.xmlout("coverage", "", attrs.str(), false);
+    xreport.pop("triage");
+    if (!config.opt_quiet) {
+        std::cout << "triage: read " << pages << " of " << max_blocks << " pages"
+                  << (triage_out_of_time ? " before the budget ran out" : "") << std::endl;
+    }
+}
+
+void Phase1::read_process_sbufs()
+{
+    if (!config.fs_priority.empty()) order_by_fs();
+    if (!sampling() && !fs_ordered && !config.triage_minutes){
+        hasher = image_hasher::make(config.image_hash_alg);
+    }
+    checkpoint_compact();               // start the checkpoint with the pages seen previously
+
+    if (config.read_ahead_pages==0){
+        read_sbufs([this](const image_process::iterator &it){
+            image_process::iterator itc(it);
+            process_sbuf( get_sbuf(itc) );
+        }, [this](const sample_run &run){
+            for (sbuf_t *sbufp : read_run(run)) process_sbuf(sbufp);
+        });
+    } else {
+        /* With -S numa_readers, there is at least one reader per node, and reader i runs on node i % nodes.
+         * Each reader fills (and so, by first touch, places) the pages it reads in its node's memory.
+         */
+        const std::vector<std::vector<int>> nodes = config.opt_numa_readers ? numa_node_cpus() : std::vector<std::vector<int>>();
+        u_int nreaders = p.concurrent_reads() ? std::max(config.read_threads, 1U) : 1;
+        if (nodes.size()>1 && p.concurrent_reads()) nreaders = std::max<u_int>(nreaders, nodes.size());
+        bounded_queue<pending_sbuf> pending(config.read_ahead_pages);
+        bounded_queue<std::packaged_task<std::vector<sbuf_t *>()>> tasks(config.read_ahead_pages);
+        std::vector<std::thread> readers;
+        if (nreaders>1) {
+            for (u_int i=0; i<nreaders; i++){
+                readers.emplace_back([&tasks, &nodes, i]{
+                    if (nodes.size()>1) pin_thread(nodes[i % nodes.size()]);
+                    std::packaged_task<std::vector<sbuf_t *>()> task;
+                    while (tasks.pop(task)) task();
+                });
+            }
+        }
+
+        /* A batch of one page is read as before, and a read error is reported by the hashing thread.
+         * In a batch of files, each file's error is reported as it happens so the rest of the batch survives.
+         */
+        const size_t batch_size = config.opt_recurse ? std::max(config.dir_batch_files, 1U) : 1;
+        std::exception_ptr dispatcher_exception {nullptr};
+        std::thread dispatcher([this, nreaders, batch_size, &pending, &tasks, &dispatcher_exception]{
+            std::vector<image_process::iterator> batch;
+            auto dispatch = [this, nreaders, &batch, &pending, &tasks]{
+                if (batch.empty()) return;
+                pos0_t pos0 = batch.front().get_pos0();
+                std::packaged_task<std::vector<sbuf_t *>()> task([this, batch]() mutable {
+                    std::vector<sbuf_t *> sbufs;
+                    if (batch.size()==1) {
+                        sbufs.push_back( get_sbuf(batch.front()) );
+                        return sbufs;
+                    }
+                    for (auto &itc : batch) {
+                        try {
+                            sbufs.push_back( get_sbuf(itc) );
+                        }
+                        catch (const std::exception &e) {
+                            report_read_exception(e, itc.get_pos0());
                         }
                     }
-                    total_bytes += sbufp->pagesize;
-                    ss.schedule_sbuf(sbufp); // processes the sbuf, then deletes it
+                    return sbufs;
+                });
+                batch.clear();
+                pending.push(pending_sbuf{pos0, task.get_future()});
+                if (nreaders>1) {
+                    tasks.push(std::move(task));
+                } else {
+                    task();
                 }
-                catch (const std::exception &e) {
-                    // report uncaught exceptions to both user and XML file
-                    std::stringstream sstr;
-                    sstr << "phase=1 name='" << e.what() << "' " << "pos0='" << it.get_pos0() << "' ";
+            };
+            auto dispatch_run = [this, nreaders, &pending, &tasks](const sample_run &run){
+                std::packaged_task<std::vector<sbuf_t *>()> task([this, run]{ return read_run(run); });
+                pending.push(pending_sbuf{pos0_t("", run.start), task.get_future()});
+                if (nreaders>1) {
+                    tasks.push(std::move(task));
+                } else {
+                    task();
+                }
+            };
+            try {
+                read_sbufs([batch_size, &batch, &dispatch](const image_process::iterator &it){
+                    batch.push_back(it);
+                    if (batch.size() >= batch_size) dispatch();
+                }, dispatch_run);
+                dispatch();
+            }
+            catch (...) {
+                dispatcher_exception = std::current_exception();
+            }
+            tasks.close();
+            pending.close();
+        });
 
-                    if (config.opt_report_read_errors) {
-                        std::cerr << "Phase 1 Exception " << e.what() << " skipping " << it.get_pos0() << "\n";
+        bounded_queue<sbuf_t *> hashed(config.read_ahead_pages * batch_size);
+        std::thread hashing([this, &pending, &hashed]{
+            pending_sbuf ps;
+            while (pending.pop(ps)) {
+                try {
+                    for (sbuf_t *sbufp : ps.sbufs.get()) {
+                        if (sbufp==nullptr) continue;
+                        hash_sbuf(*sbufp);
+                        hashed.push(std::move(sbufp));
                     }
-                    xreport.xmlout("debug:exception", e.what(), sstr.str(), true);
+                }
+                catch (const std::exception &e) {
+                    report_read_exception(e, ps.pos0);
                 }
             }
-        }
-
+            hashed.close();
+        });
 
-        /* If we are random sampling, move to the next random sample. */
-        if (sampling()){
-            ++si;
+        sbuf_t *sbufp = nullptr;
+        auto next_sbuf = [&hashed, &sbufp]{
+            queue_stats::wait_timer timer(queue_stats::READ);
+            return hashed.pop(sbufp);
+        };
+        while (next_sbuf()) {
+            pos0_t pos0 = sbufp->pos0;  // the scanner set may delete the sbuf before throwing
+            try {
+                schedule(sbufp);
+            }
+            catch (const std::exception &e) {
+                report_read_exception(e, pos0);
+            }
         }
-
-        /* Report back the fraction done if requested */
-        if (config.fraction_done) *config.fraction_done = p.fraction_done(it);
-        ++it;
+        hashing.join();
+        dispatcher.join();
+        for (auto &t : readers) t.join();
+        if (dispatcher_exception) std::rethrow_exception(dispatcher_exception);
     }
 
+    checkpoint_compact();
+    if (config.triage_minutes) dfxml_write_triage();
+    if (sampling_reads) {
+        xreport.xmlout("sampling_reads", "",
+                       "reads='" + std::to_string(sampling_reads) +
+                       "' units='" + std::to_string(sampling_units) +
+                       "' unit_bytes='" + std::to_string(sample_unit()) +
+                       "' bytes_read='" + std::to_string(sampling_bytes) + "'", false);
+        for (u_int pass=0; pass<pass_units.size(); pass++) {
+            xreport.xmlout("sampling_pass", "",
+                           "pass='" + std::to_string(pass + 1) +
+                           "' units='" + std::to_string(pass_units[pass]) +
+                           "' bytes='" + std::to_string(pass_bytes[pass]) + "'", false);
+        }
+    }
+    xreport.xmlout("constant_pages", constant_pages);
+    if (config.opt_auto_pagesize) xreport.xmlout("split_pages", split_pages);
+    if (known) {
+        xreport.xmlout("known_blocks", "",
+                       "db='" + dfxml_writer::xmlescape(config.known_blocks_db) +
+                       "' hashes='" + std::to_string(known->size()) +
+                       "' skipped_pages='" + std::to_string(known_blocks::skipped_pages) +
+                       "' skipped_bytes='" + std::to_string(known_blocks::skipped_bytes) + "'", false);
+    }
+    if (content_cache::enabled) {
+        xreport.xmlout("dedup_recursion", "",
+                       "sbufs='" + std::to_string(content_cache::dup_sbufs) +
+                       "' bytes='" + std::to_string(content_cache::dup_bytes) +
+                       "' unrecorded='" + std::to_string(content_cache::unrecorded()) + "'", false);
+    }
+    xreport.xmlout("page_allocator", "", page_allocator::xml_attributes(), false);
+    xreport.xmlout("scratch_arena", "", scratch_arena::xml_attributes(), false);
+    if (memory_governor::get_budget()) {
+        xreport.xmlout("memory_governor", "",
+                       "budget='" + std::to_string(memory_governor::get_budget()) +
+                       "' waits='" + std::to_string(memory_governor::waits) +
+                       "' depth_reserve='" + std::to_string(memory_governor::get_depth_reserve()) +
+                       "' timeouts='" + std::to_string(memory_governor::timeouts) +
+                       "' reader_timeouts='" + std::to_string(memory_governor::reader_timeouts) + "'", false);
+    }
+    if (page_stash::enabled()) {
+        xreport.xmlout("page_stash", "", page_stash::xml_attributes(), false);
+    }
+    if (recursion_spill::enabled()) {
+        xreport.xmlout("recursion_spill", "", recursion_spill::xml_attributes(), false);
+    }
+    if (io_throttle::enabled()) {
+        xreport.xmlout("io_throttle", "", io_throttle::xml_attributes(), false);
+    }
     if (config.fraction_done) *config.fraction_done = 1.0;
+    if (!config.opt_quiet && constant_pages) std::cout << constant_pages << " constant pages were not scanned" << std::endl;
+    if (!config.opt_quiet && known_blocks::skipped_bytes) {
+        std::cout << known_blocks::skipped_bytes << " bytes of known blocks were not scanned" << std::endl;
+    }
     if (!config.opt_quiet) std::cout << "All data read; waiting for threads to finish..." << std::endl;
 }
 
@@ -245,6 +1239,21 @@ void Phase1::dfxml_write_create(int argc, char * const *argv)
     xreport.xmlout("threads",config.num_threads);
     xreport.xmlout("pagesize",config.opt_pagesize);
     xreport.xmlout("marginsize",config.opt_marginsize);
+    if (config.container.limited()) {
+        std::stringstream attrs;
+        attrs << "source='" << config.container.source << "' cpus='" << config.container.cpus
+              << "' affinity_cpus='" << config.container.affinity_cpus << "' memory_bytes='" << config.container.memory_bytes
+              << "' threads='" << config.num_threads << "' pagesize='" << config.opt_pagesize
+              << "' memory_budget='" << config.memory_budget << "'";
+        xreport.xmlout("container_limits", "", attrs.str(), false);
+    }
+    xreport.xmlout("cpu_dispatch", "", cpu_dispatch::xml_attributes(), false);
+    if (config.shard_count){
+        xreport.xmlout("shard", "",
+                       "index='" + std::to_string(config.shard_index) + "' count='" + std::to_string(config.shard_count) +
+                       "' start='" + std::to_string(config.opt_scan_start) + "' end='" + std::to_string(config.opt_scan_end) + "'",
+                       false);
+    }
     ss.dump_enabled_scanner_config();
     xreport.pop("configuration");	// configuration
     xreport.flush();                    // get it to the disk
@@ -256,18 +1265,20 @@ void Phase1::dfxml_write_source()
     xreport.push("source");
     xreport.xmlout("image_filename",p.image_fname());
     xreport.xmlout("image_size",p.image_size());
-    if (sha1g){
-        dfxml::sha1_t sha1 = sha1g->digest();
-        xreport.xmlout("hashdigest",sha1.hexdigest(),"type='SHA1'",false);
-        delete sha1g;
+    if (hasher){
+        image_hash = hasher->hexdigest();
+        xreport.xmlout("hashdigest",image_hash,"type='" + hasher->name() + "'",false);
+        delete hasher;
+        hasher = nullptr;
     }
     xreport.pop("source");			// source
     xreport.flush();
 
-    //if (config.opt_quiet==0) std::cout << "Producer time spent waiting: " << tp->waiting.elapsed_seconds() << " sec.\n";
-
-    //xreport.xmlout("thread_wait",dtos(tp->waiting.elapsed_seconds()),"thread='0'",false);
-    double worker_wait_average = 0;
+    if (!config.opt_quiet) {
+        double producer_wait = 0;
+        for (int w=0; w<queue_stats::WAITS; w++) producer_wait += queue_stats::wait_seconds(queue_stats::wait_t(w));
+        std::cout << "Producer time spent waiting: " << producer_wait << " sec." << std::endl;
+    }
     if (!config.opt_quiet && worker_wait_average>0) {
         std::cout << "Average consumer time spent waiting: " << worker_wait_average << " sec." << std::endl;
     }
@@ -275,16 +1286,123 @@ void Phase1::dfxml_write_source()
 }
 
 
+/*
+ * Where phase 1 waited: the producer, each worker (thread_wait is its idle time), and the sbufs in the queue.
+ */
+void Phase1::dfxml_write_waits()
+{
+    std::stringstream pw;
+    for (int w=0; w<queue_stats::WAITS; w++) {
+        pw << (w ? " " : "") << queue_stats::wait_name(queue_stats::wait_t(w)) << "_seconds='"
+           << queue_stats::wait_seconds(queue_stats::wait_t(w)) << "'";
+    }
+    xreport.xmlout("producer_wait", "", pw.str(), false);
+
+    const std::vector<double> idle = queue_stats::worker_idle_seconds();
+    const std::vector<double> busy = scanner_watchdog::thread_busy_seconds();
+    double total_idle = 0;
+    for (size_t i=0; i<idle.size(); i++) {
+        const double b = i < busy.size() ? busy[i] : 0;
+        xreport.xmlout("thread_wait", std::to_string(idle[i]),
+                       "thread='" + std::to_string(i) + "' busy_seconds='" + std::to_string(b) + "'", false);
+        total_idle += idle[i];
+    }
+    worker_wait_average = idle.empty() ? 0 : total_idle / idle.size();
+    xreport.xmlout("worker_wait", "",
+                   "threads='" + std::to_string(idle.size()) + "' average_seconds='" + std::to_string(worker_wait_average) +
+                   "' elapsed_seconds='" + std::to_string(queue_stats::elapsed_seconds()) + "'", false);
+
+    const std::vector<queue_stats::residence> residences = queue_stats::residence_by_depth();
+    for (size_t depth=0; depth<residences.size(); depth++) {
+        const queue_stats::residence &r = residences[depth];
+        if (r.sbufs==0) continue;
+        std::stringstream attrs;
+        attrs << "depth='" << depth << "' sbufs='" << r.sbufs << "' mean_seconds='" << r.mean_seconds()
+              << "' max_seconds='" << r.max_seconds << "'";
+        xreport.xmlout("queue_residence", "", attrs.str(), false);
+    }
+}
+
 void Phase1::phase1_run()
 {
     assert(ss.get_current_phase() == scanner_params::PHASE_SCAN);
-    // save all of the pages we have seen in the DFXML file
-    for (const auto &it : config.seen_page_ids) {
+    // save all of the pages we have seen in the DFXML file, one element per range
+    for (const auto &it : config.seen_pages.get_ranges()) {
+        xreport.xmlout("debug:restart_range", "",
+                       "start='" + std::to_string(it.first) + "' end='" + std::to_string(it.second) + "'", false);
+    }
+    for (const auto &it : config.seen_pages.get_others()) {
         ss.record_work_start( it, 0, 0 );
     }
     xreport.push("runtime","xmlns:debug=\"http://www.github.com/simsong/bulk_extractor/issues\"");
+    queue_stats::start(ss.get_thread_count());
+    if (config.opt_auto_threads) worker_tuner::start(ss.get_thread_count());
     read_process_sbufs();
+    while (page_stash::size() && ss.disk_write_errors==0) { // the pages read ahead
+        unstash();
+        std::this_thread::sleep_for(QUEUE_POLL_INTERVAL);
+    }
     ss.join();
+    while (recursion_spill::pending()) { // the children may have spilled children of their own
+        resume_spilled(true);
+        ss.join();
+    }
+    if (config.opt_auto_threads) {
+        worker_tuner::stop();
+        xreport.xmlout("worker_tuner", "", worker_tuner::xml_attributes(), false);
+    }
+    dfxml_write_waits();
+    if (content_affinity::enabled || content_affinity::skip_high_entropy) {
+        xreport.xmlout("affinity_skipped_calls", uint64_t(content_affinity::skipped));
+    }
+    if (content_affinity::skip_high_entropy) {
+        xreport.xmlout("page_classes", "",
+                       "classified='" + std::to_string(page_classifier::classified) +
+                       "' high_entropy='" + std::to_string(page_classifier::high_entropy_sbufs) + "'", false);
+    }
+    for (int c=0; c<scanner_priority::CLASSES; c++) {
+        const auto cls = scanner_priority::class_t(c);
+        if (scanner_priority::threads(cls)==0) continue;
+        std::stringstream attrs;
+        attrs << "name='" << scanner_priority::name(cls) << "' threads='" << scanner_priority::threads(cls)
+              << "' waits='" << scanner_priority::waits(cls) << "' wait_seconds='" << scanner_priority::wait_seconds(cls) << "'";
+        xreport.xmlout("scanner_class", "", attrs.str(), false);
+    }
+    if (std::string(candidate_offload::backend_name()) != "cpu") {
+        xreport.xmlout("candidate_offload", "", candidate_offload::xml_attributes(), false);
+    }
+    if (!scanner_tiles::scanners().empty()) {
+        xreport.xmlout("scanner_tiles", "",
+                       "scanners='" + scanner_tiles::scanners() +
+                       "' tile_bytes='" + std::to_string(scanner_tiles::tile_bytes) +
+                       "' tiled_sbufs='" + std::to_string(scanner_tiles::tiled_sbufs) + "'", false);
+    }
+    for (const auto &it : scanner_watchdog::finished_stragglers()) {
+        std::stringstream attrs;
+        attrs << "scanner='" << it.scanner << "' pos0='" << dfxml_writer::xmlescape(it.pos0)
+              << "' bytes='" << it.bytes << "' seconds='" << it.seconds << "'";
+        xreport.xmlout("straggler", "", attrs.str(), false);
+    }
+    for (const auto &it : scanner_watchdog::totals()) {
+        std::stringstream attrs;
+        attrs << "name='" << it.first << "' calls='" << it.second.calls << "' bytes='" << it.second.bytes
+              << "' cpu_seconds='" << it.second.cpu_seconds << "' wall_seconds='" << it.second.wall_seconds << "'";
+        if (alloc_profiler::enabled) {
+            attrs << " allocations='" << it.second.allocations << "' allocated_bytes='" << it.second.allocated_bytes
+                  << "' peak_outstanding_bytes='" << it.second.peak_outstanding << "'";
+        }
+        if (perf_counters::opened) {
+            for (int c=0; c<perf_counters::COUNTERS; c++) {
+                attrs << " " << perf_counters::name(perf_counters::counter_t(c)) << "='" << it.second.perf.v[c] << "'";
+            }
+        }
+        xreport.xmlout("scanner_time", "", attrs.str(), false);
+    }
+    if (trace_writer::enabled && !ss.sc.outdir.empty()) {
+        trace_writer::enabled = false;  // the workers are done; nothing more is recorded
+        trace_writer::save(ss.sc.outdir / trace_writer::TRACE_FILENAME);
+        xreport.xmlout("trace", trace_writer::TRACE_FILENAME, "dropped_events='" + std::to_string(trace_writer::dropped()) + "'", true);
+    }
     xreport.pop("runtime");
     dfxml_write_source();               // written here so it may also include hash
 }
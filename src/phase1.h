@@ -3,12 +3,21 @@
 
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
 
 #include "be13_api/scanner_set.h"
 #include "be13_api/dfxml_cpp/src/dfxml_writer.h"
 #include "be13_api/dfxml_cpp/src/hash_t.h"
 
+#include "container_limits.h"
 #include "image_process.h"
+#include "known_blocks.h"
+#include "page_ranges.h"
 
 /**
  * bulk_extractor:
@@ -37,8 +46,6 @@ class Phase1 {
     }
 
 public:
-    // because seen_page_ids are added in order, we want to use an unordered set.
-    typedef std::unordered_set<std::string> seen_page_ids_t;
     static inline std::string REPORT_FILENAME {"report.xml"};
     /* Configuration Control */
     struct Config {
@@ -50,30 +57,231 @@ public:
         uint64_t  debug {false};                 // debug
         size_t    opt_pagesize {16 * MiB};
         size_t    opt_marginsize { 4 * MiB};
+        bool      opt_auto_pagesize {false};     // -G auto: choose the page size for the image, and split the last pages
+        bool      opt_auto_marginsize {false};   // -g auto: the margin is the largest lookahead of the enabled scanners
         uint32_t  max_bad_alloc_errors {3}; // by default, 3 retries
         bool      opt_info {false};
         uint32_t  opt_notify_rate {1};		// by default, notify every second
+        bool      opt_trace {false};            // write a Chrome trace of the scanner calls, reads and waits to trace.json
+        bool      opt_profile_allocations {false}; // count each scanner's operator new calls, bytes and peak outstanding bytes
+        bool      opt_perf_counters {false};    // count each scanner's cycles, instructions, cache and branch misses
+        bool      opt_live_stats {false};       // write stats.json and stats.prom to the outdir every opt_notify_rate seconds
+        bool      opt_gzip_feature_files {false}; // at the end of phase 2, replace the *.txt files with framed *.txt.gz
+        uint64_t  gzip_frame_size {1 * MiB};    // bytes of lines in each gzip frame
+        bool      opt_sort_feature_files {false}; // at the end of phase 2, sort each feature file by forensic path
+        uint64_t  sort_memory {256 * MiB};      // bytes of lines held by the sort at once
+        std::string identify_filenames_dfxml {}; // at the end of phase 2, annotate the feature files with the files of this DFXML map
+        bool      opt_index_feature_files {false}; // at the end of phase 2, write a *.txt.index of offsets beside each feature file
+        uint64_t  index_block_size {64 * 1024}; // bytes of lines in each block of the index
+        bool      opt_columnar_feature_files {false}; // at the end of phase 2, write a binary *.col beside each feature file
+        uint64_t  columnar_dictionary_bytes {64 * MiB}; // bytes of distinct values looked up in each column's dictionary
         uint64_t  opt_page_start {0};
         uint64_t  opt_scan_start {0};   // byte where we should start scanning, if not 0
         uint64_t  opt_scan_end {0}; // byte where we should end scanning, if not 0
         time_t    max_wait_time {3600};  // after an hour, terminate a scanner
+        u_int     straggler_seconds {60};  // scanner calls that take longer are reported as stragglers
         int       opt_quiet {false};                  // -1 = no output
         int       retry_seconds {60};
         u_int     num_threads  { std::thread::hardware_concurrency() }; // default to # of cores; 0 for no threads
         double    sampling_fraction {1.0};       // for random sampling
         u_int     sampling_passes {1};
+        uint64_t  sampling_strata {0};           // if >0, sample evenly from this many regions of the image
+        uint64_t  sampling_seed {0};             // seed for the sampler; the same seed samples the same blocks
+        uint64_t  sampling_block {0};            // bytes in each sampled unit; 0 for a page
+        uint64_t  sampling_coalesce {1 * MiB};   // sampled units this close are read together
+        u_int     read_ahead_pages {2};  // pages read ahead of the scheduler by the reader thread; 0 to read inline
+        u_int     read_threads {1};      // threads reading pages, if the image supports concurrent reads (e.g. E01)
+        u_int     small_input_pages {1}; // images of no more pages are scanned in the main thread; 0 for never
+        bool      small_input(uint64_t image_size) const; // and so gets no workers, readers or notifier
+        void      use_main_thread();     // as -J, with the page read inline and no notifier
+        u_int     dir_batch_files {64};  // with -R, files read by each reader task
+        bool      opt_numa_readers {false}; // run reader threads on every NUMA node, pinned to the node
+        bool      opt_recycle_pages {true}; // keep freed page buffers in the malloc heap for reuse
+        bool      opt_huge_pages {false};   // back page buffers with transparent huge pages
+        uint64_t  queue_high_water {0};  // stop reading when this many depth0 bytes are queued; 0 for threads*(page+margin)
+        uint64_t  queue_low_water {0};   // resume reading when the queue drains to this; 0 for half of queue_high_water
+        uint64_t  queue_stash_bytes {0}; // above queue_high_water, keep reading into this many bytes of compressed pages; 0 to wait
+        uint64_t  memory_budget {0};     // keep the memory allocated under this many bytes; 0 for no limit
+        double    memory_depth_reserve {0}; // of each depth's share of memory_budget, kept for the depths below
+        std::string recursion_spill_dir {}; // with memory_budget, where the children wait for memory; "" to scan them over it
+        bool      opt_dedup_recursion {false}; // do not recurse into decoded content that has been seen at the same depth
+        uint64_t  dedup_recursion_memory {0};  // with opt_dedup_recursion, bytes of fingerprints to keep; 0 for an exact set
+        bool      opt_scanner_affinity {true}; // do not run scanners on recursed-into content they cannot match in
+        bool      opt_skip_high_entropy {false}; // do not run the text scanners on compressed or encrypted pages
+        bool      opt_auto_threads {false};      // let worker_tuner choose how many of the -j workers scan at once
+        std::string histogram_only {};         // recorders that write only their histograms (see recorder_handle.h)
+        std::string approximate_histograms {}; // recorders whose histograms are made in bounded memory (see heavy_hitters.h)
+        u_int     histogram_top_k {1000};      // the features written to each approximate histogram
+        std::string feature_shards {};         // recorders written to a feature file for each thread (see feature_shards.h)
+        bool      feature_shards_merge {true}; // merge the shards into the recorders' files at the end of the run
+        std::string feature_quotas {};         // NAME:N,... features a recorder may write (see feature_quotas.h)
+        std::string feature_quota_bytes {};    // NAME:BYTES,...
+        std::string feature_page_quotas {};    // NAME:N,... features on a page
+        std::string remote_workers {};         // [HOST:]PORT on which to give the pages to remote workers (see remote_workers.h)
+        std::string remote_token {};           // shared by the producer and its remote workers
+        u_int     remote_queue_pages {16};     // pages read and waiting for a remote worker
+        std::string page_dedup {};             // recorders that collapse a page's repeated features ("all" for every one)
+        std::string carve_dedup {};            // recorders that record duplicate carves as references ("all" for every one)
+        u_int     carve_writer_threads {0};    // threads that write carved files; 0 to carve in the scanner
+        uint64_t  carve_queue_bytes {256 * MiB}; // bytes of copies queued for the carve writers
         bool      opt_report_read_errors {true};
         bool      opt_recurse {false};  // -r flag
+        bool      opt_raw_mmap {false}; // memory-map raw images rather than reading them
+        bool      opt_raw_direct {false}; // read raw images without the page cache (O_DIRECT)
+        std::string opt_http_cache_dir {};   // where blocks of http:// and s3:// images are cached
+        uint64_t  opt_ewf_cache_mb {64};    // decompressed E01 chunks shared by the reader threads
+        bool      opt_skip_constant_pages {true}; // hash, but do not scan, pages that are all 0x00 or all 0xFF
+        std::string known_blocks_db {};     // do not scan the blocks of the files in this database (see known_blocks.h)
+        std::string alert_sink {};          // where alert-list hits are sent as they are found (see feature_stream.h)
+        std::string feature_sink {};        // where the features and carves are sent as they are written
+        bool      opt_feature_census {false}; // count the features and distinct features of each recorder as they are written
+        std::string scanner_classes {};     // NAME:CLASS,... for scanner_priority
+        std::string scanner_class_threads {}; // CLASS:N,... the most threads in each class's scanners
+        std::string tiled_scanners {};      // NAME,... scanned together a tile at a time (see scanner_tiles.h)
+        uint64_t  tile_bytes {256 * 1024};
+        uint64_t  io_bandwidth {0};         // image bytes read a second, at most (see io_throttle.h); 0 for no limit
+        uint64_t  io_iops {0};              // image reads a second, at most
+        std::string io_control_file {};     // bandwidth=N and iops=N, read again when it changes or on SIGUSR1
+        std::string offload {"cpu"};        // the backend that searches the depth-0 pages for candidates (see candidate_offload.h)
+        std::string cpu_isa {"native"};     // the SIMD kernels may use only this level's features (see cpu_dispatch.h)
+        std::string fs_priority {};         // scan the pages of these fs_map classes in this order, and no others
+        u_int     triage_minutes {0};          // scan the densest regions of a sample until this budget is spent; 0 to scan all
+        double    triage_sample {0.02};          // the fraction of each region sampled first
+        uint64_t  triage_regions {256};          // regions ranked by the sample (see triage_planner.h)
+        bool      opt_sector_aligned {false}; // the image is a disk; structures at depth 0 start at sector boundaries
+        std::string image_hash_alg {"sha1"}; // sha1 or sha256
         void      set_sampling_parameters(std::string p);
+        u_int     shard_index {0};               // --shard index/count; count 0 if not sharding
+        u_int     shard_count {0};
+        void      set_shard_parameters(std::string p);
+        void      set_shard_range(uint64_t image_size); // sets opt_scan_start and opt_scan_end for this shard
+
+        /* The defaults of -j, -G and -S memory_budget in a container; before the options are read */
+        static inline const double CONTAINER_BUDGET_FRACTION {0.80}; // of the memory limit, for memory_budget
+        static inline const double CONTAINER_PAGES_FRACTION {0.50};  // of the limit, for the pages in flight
+        container_limits container {};
+        void      apply_container_limits(const container_limits &l);
+
+        /* -G auto */
+        static inline const size_t MIN_AUTO_PAGESIZE {1 * MiB};
+        static size_t auto_pagesize(uint64_t image_size, u_int threads, size_t scanners, size_t margin);
+        u_int     split_pieces(uint64_t offset, size_t pagesize, uint64_t image_size) const; // pieces to split this page into
+
+        /* -g auto */
+        static inline const size_t MIN_AUTO_MARGINSIZE {64 * 1024};
+        static size_t scanner_lookahead(const std::string &scanner); // 0 if not known
+        static size_t auto_marginsize(const std::vector<std::string> &scanners, size_t default_margin);
         std::atomic<double>    *fraction_done {nullptr};
         bool      opt_legacy {false};
         bool      opt_notification {true}; // run notification thread
-        seen_page_ids_t seen_page_ids {};               // pages that were already seen
+        page_ranges seen_pages {};               // pages that were already seen
+        u_int     checkpoint_seconds {60};       // how often the restart checkpoint is compacted
+        bool      checkpoint_outputs {false};    // and the feature files checkpointed (see output_checkpoint.h)
+        bool      state_dump {true};             // a snapshot on SIGUSR1 or outdir/dump_state (see state_dump.h)
+    };
+
+    /* A bounded queue used between the reader threads and read_process_sbufs().
+     * push() blocks while the queue is full; pop() blocks while it is empty and returns false
+     * once the queue has been closed and drained.
+     */
+    template <typename T> class bounded_queue {
+        std::mutex M {};
+        std::condition_variable not_full {};
+        std::condition_variable not_empty {};
+        std::deque<T> q {};
+        const size_t capacity;
+        bool closed {false};
+    public:
+        bounded_queue(size_t capacity_):capacity(capacity_ ? capacity_ : 1) {}
+        void push(T &&val) {
+            std::unique_lock<std::mutex> lock(M);
+            not_full.wait(lock, [this]{ return q.size() < capacity; });
+            q.push_back(std::move(val));
+            not_empty.notify_one();
+        }
+        bool pop(T &val) {
+            std::unique_lock<std::mutex> lock(M);
+            not_empty.wait(lock, [this]{ return !q.empty() || closed; });
+            if (q.empty()) return false;
+            val = std::move(q.front());
+            q.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+        void close() {
+            std::unique_lock<std::mutex> lock(M);
+            closed = true;
+            not_empty.notify_all();
+        }
+    };
+
+    /* The hash of the image, computed as the pages are read. */
+    struct image_hasher {
+        virtual ~image_hasher() {}
+        virtual void update(const uint8_t *buf, size_t bufsize) = 0;
+        virtual std::string hexdigest() = 0;
+        virtual std::string name() const = 0; // as used in the DFXML type attribute
+        static image_hasher *make(const std::string &alg);
+    };
+    template <typename GENERATOR> struct image_hasher_t : public image_hasher {
+        GENERATOR g {};
+        const std::string name_;
+        image_hasher_t(std::string name__): name_(name__) {}
+        void update(const uint8_t *buf, size_t bufsize) override { g.update(buf, bufsize); }
+        std::string hexdigest() override { return g.digest().hexdigest(); }
+        std::string name() const override { return name_; }
     };
 
-    typedef std::set<uint64_t> blocklist_t; // a list of blocks (for random sampling)
+    /* Pages that have been dispatched to a reader but may not have been read yet.
+     * Disk images are read a page at a time; with -R, small files are read in batches.
+     */
+    struct pending_sbuf {
+        pos0_t pos0 {};                 // of the first page, for error reports
+        std::future<std::vector<sbuf_t *>> sbufs {};
+    };
+
+    /* With sampling, sampled units close to each other are read together, and cut apart as they are read */
+    struct sample_run {
+        uint64_t start {0};             // of the read in the image
+        uint64_t len {0};
+        std::vector<uint64_t> units {}; // where the sampled units in it start
+        std::vector<u_int> passes {};   // the pass that selected each unit
+    };
+    typedef std::function<void(const sample_run &)> run_deliverer;
+    static inline const uint64_t SAMPLE_RUN_PAGES {4}; // the most a run's units span, in pages
+
+    /* Streaming random sampler over the block numbers 0..max_blocks-1, in increasing order.
+     * Each block gets a pseudo-random value u in [0,1) from a hash of (seed, block).
+     * Pass p selects the blocks with p*frac <= u < (p+1)*frac, so passes never repeat a block
+     * and no list of blocks is kept in memory.
+     * If strata>0, the image is divided into that many regions and each region contributes
+     * the same share of its blocks (at least one), chosen by rank in a keyed permutation of the region,
+     * so that only the blocks chosen are kept.
+     */
+    class block_sampler {
+        const uint64_t max_blocks;
+        const double   frac;
+        const uint64_t seed;
+        const u_int    pass;
+        const uint64_t strata;
+        uint64_t next_block {0};        // next block to consider (unstratified)
+        uint64_t stratum {0};           // next stratum to load (stratified)
+        std::vector<uint64_t> stratum_blocks {}; // blocks selected from the current stratum
+        size_t   stratum_pos {0};
+        void     load_stratum();
+        uint64_t permute(uint64_t x, uint64_t len, uint64_t key) const; // a bijection of [0,len)
+    public:
+        block_sampler(uint64_t max_blocks_, double frac_, uint64_t seed_, u_int pass_, uint64_t strata_);
+        static uint64_t mix(uint64_t x); // splitmix64 finalizer
+        double   u(uint64_t block) const { return (mix(seed ^ mix(block)) >> 11) * 0x1.0p-53; }
+        bool     next(uint64_t &block); // sets the next block in this pass; false when the pass is done
+    };
     static std::string minsec(time_t tsec);    // return "5 min 10 sec" string
-    static void make_sorted_random_blocklist(blocklist_t *blocklist,uint64_t max_blocks,float frac);
+
+    /* NUMA support (Linux). A node's CPUs are listed in /sys/devices/system/node/node<N>/cpulist */
+    static std::vector<int> parse_cpulist(const std::string &cpulist); // "0-3,8" -> 0,1,2,3,8
+    static std::vector<std::vector<int>> numa_node_cpus();          // empty if there is no NUMA information
+    static void pin_thread(const std::vector<int> &cpus);            // run this thread only on these CPUs
 
     /* These instance variables reference variables in main.cpp */
     Config        &config;              // phase1 config passed in. Writable so seen can be updated.
@@ -82,19 +290,76 @@ public:
 
     u_int         notify_ctr  {0};      // for random sampling
     uint64_t      total_bytes {0};      // processed
-    dfxml::sha1_generator *sha1g {nullptr};        // the SHA1 of the image. Set to 0 if a gap is encountered
+    uint64_t      constant_pages {0};   // pages that were not scanned because they were constant
+    std::unique_ptr<known_blocks> known {}; // with -S known_blocks
+    std::vector<uint64_t> page_order {}; // with -S fs_priority, the pages to read; empty to read them in order
+    bool          fs_ordered {false};
+    void          order_by_fs();        // map the file systems and set page_order
+
+    /* -S triage_minutes; written by the reader and reported when phase 1 is done */
+    std::atomic<uint64_t> depth0_scheduled {0}; // pages given to the scanner set
+    uint64_t      triage_sample_pages {0};
+    uint64_t      triage_sample_features {0};
+    uint64_t      triage_pages {0};     // after the sample
+    uint64_t      triage_region_blocks {0};
+    bool          triage_out_of_time {false};
+    struct triage_region { uint64_t region; double score; bool whole; };
+    std::vector<triage_region> triage_scanned {};
+    void          read_triage(const std::function<void(const image_process::iterator &)> &deliver);
+    void          dfxml_write_triage();
+    double        worker_wait_average {0}; // seconds each worker sat idle in phase 1, on average
+    uint64_t      split_pages {0};      // pieces scheduled for the last pages of the image (-G auto)
+    image_hasher  *hasher {nullptr};    // the hash of the image. Set to 0 if a gap is encountered
     uint64_t      hash_next {0};        // next byte to hash, to detect gaps
 
     std::string image_hash {};          // when hashed, the image hash
+
+    /* Restart checkpoint. Every page given to the scanner set is appended to the checkpoint file,
+     * which is periodically rewritten as ranges.
+     */
+    page_ranges   scheduled_pages {};   // pages given to the scanner set in this run
+    std::ofstream checkpoint_log {};
+    time_t        checkpoint_compacted {0};
+    std::filesystem::path checkpoint_path() const;
+    void          checkpoint_compact();
+    time_t        outputs_checkpointed {0};
+    void          checkpoint_outputs(); // when it is time, once the scanners have finished what they were given
     dfxml_writer &xreport;              // we always write out the DFXML. Allows restart to be handled in phase1
 
     /* Get the sbuf from current image iterator location, with retries */
     sbuf_t *get_sbuf(image_process::iterator &it);
+    void read_sbufs(const std::function<void(const image_process::iterator &)> &deliver, // deliver each page to read
+                    const run_deliverer &deliver_run); // or, when sampling, each run of sampled units
+    uint64_t sample_unit() const { return config.sampling_block ? config.sampling_block : p.pagesize; }
+    void read_sampled(u_int passes, const run_deliverer &deliver_run); // all of the passes, merged
+    std::vector<sbuf_t *> read_run(const sample_run &run);
+    std::atomic<uint64_t> sampling_reads {0};
+    std::atomic<uint64_t> sampling_units {0};
+    std::atomic<uint64_t> sampling_bytes {0};
+    typedef std::vector<std::atomic<uint64_t>> pass_counts;
+    pass_counts pass_units = pass_counts(config.sampling_passes); // units read for each pass
+    pass_counts pass_bytes = pass_counts(config.sampling_passes);
+    void exit_on_disk_write_error() const;
+    void report_read_exception(const std::exception &e, const pos0_t &pos0);
+    void process_sbuf(sbuf_t *sbufp);   // hash and schedule an sbuf that has been read
+    void hash_sbuf(const sbuf_t &sbuf); // add the page to the image hash
+    void schedule(sbuf_t *sbufp);       // count the sbuf and give it to the scanner set
+    void schedule_pieces(sbuf_t *sbufp, u_int pieces); // schedule the page as pieces, then delete it
+    void schedule_piece(const sbuf_t &sbuf, size_t start, size_t this_pagesize); // part of the page, with its margin
+    void schedule_unknown(sbuf_t *sbufp, const std::vector<std::pair<size_t, size_t>> &known_runs); // the rest, then delete it
+    static bool constant_page(const sbuf_t &sbuf); // true if the page and margin are all 0x00 or all 0xFF
+    void enqueue(sbuf_t *sbufp);        // give the sbuf to the scanner set, or to the page_stash while the queue is full
+    void unstash();                     // queue the stashed pages while there is room
+    uint64_t high_water() const;        // queue_high_water, or its default
+    void wait_for_queue_capacity();     // block while the scanner queue is above the high watermark
+    void resume_spilled(bool wait);     // schedule the spilled children that fit (all, if wait)
+    static inline const auto QUEUE_POLL_INTERVAL = std::chrono::milliseconds(1);
 
 
     Phase1(Config &config_, image_process &p_, scanner_set &ss_);
     void dfxml_write_create(int argc, char * const *argv); // create the DFXML header
     void dfxml_write_source();                             // create the DFXML <source> block
+    void dfxml_write_waits();                              // the producer's waits, worker idle time, queue residence
     void read_process_sbufs(); // read and process the sbufs
     void phase1_run();         // run phase1
 };
@@ -0,0 +1,165 @@
+#include "config.h"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include "queue_stats.h"
+#include "scanner_watchdog.h"
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    struct stamp {
+        clock_type::time_point when {};
+        unsigned depth {0};
+    };
+
+    /* The stamped sbufs are sharded by address, so that the workers seldom contend for a lock */
+    struct shard {
+        std::mutex M {};
+        std::unordered_map<const void *,stamp> pending {};
+    };
+    const size_t SHARDS {16};
+    const size_t MAX_PENDING {4096};    // per shard; more means sbufs are being deleted unscanned
+    shard shards[SHARDS];
+
+    std::mutex Mresidence;
+    std::vector<queue_stats::residence> residences;
+
+    std::atomic<int64_t> start_ns {0};
+    std::atomic<unsigned> worker_count {0};
+
+    shard &shard_of(const void *sbuf) {
+        return shards[(reinterpret_cast<uintptr_t>(sbuf) >> 6) % SHARDS];
+    }
+    int64_t ns_since_epoch(clock_type::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+}
+
+queue_stats::wait_timer::~wait_timer()
+{
+    wait_ns[w] += std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+}
+
+const char *queue_stats::wait_name(wait_t w)
+{
+    switch (w) {
+    case QUEUE_CAPACITY: return "queue_capacity";
+    case MEMORY_BUDGET:  return "memory_budget";
+    case READ:           return "read";
+    default:             return "unknown";
+    }
+}
+
+double queue_stats::wait_seconds(wait_t w)
+{
+    return wait_ns[w] / 1e9;
+}
+
+void queue_stats::start(unsigned workers)
+{
+    start_ns = ns_since_epoch(clock_type::now());
+    worker_count = workers;
+}
+
+double queue_stats::elapsed_seconds()
+{
+    if (start_ns==0) return 0;
+    return (ns_since_epoch(clock_type::now()) - start_ns) / 1e9;
+}
+
+unsigned queue_stats::workers()
+{
+    return worker_count;
+}
+
+void queue_stats::enqueued(const void *sbuf, unsigned depth)
+{
+    shard &s = shard_of(sbuf);
+    std::lock_guard<std::mutex> lock(s.M);
+    if (s.pending.size() >= MAX_PENDING) s.pending.clear();
+    s.pending[sbuf] = stamp{clock_type::now(), depth};
+}
+
+void queue_stats::started(const void *sbuf)
+{
+    const auto now = clock_type::now();
+    stamp st;
+    {
+        shard &s = shard_of(sbuf);
+        std::lock_guard<std::mutex> lock(s.M);
+        auto it = s.pending.find(sbuf);
+        if (it==s.pending.end()) return; // not stamped, or another scanner already started on it
+        st = it->second;
+        s.pending.erase(it);
+    }
+    const double seconds = std::chrono::duration<double>(now - st.when).count();
+    std::lock_guard<std::mutex> lock(Mresidence);
+    if (residences.size() <= st.depth) residences.resize(st.depth+1);
+    residence &r = residences[st.depth];
+    r.sbufs++;
+    r.total_seconds += seconds;
+    r.max_seconds = std::max(r.max_seconds, seconds);
+}
+
+std::vector<queue_stats::residence> queue_stats::residence_by_depth()
+{
+    std::lock_guard<std::mutex> lock(Mresidence);
+    return residences;
+}
+
+std::vector<queue_stats::residence> queue_stats::queued_by_depth()
+{
+    const auto now = clock_type::now();
+    std::vector<residence> ret;
+    for (auto &s : shards) {
+        std::lock_guard<std::mutex> lock(s.M);
+        for (const auto &it : s.pending) {
+            if (ret.size() <= it.second.depth) ret.resize(it.second.depth+1);
+            const double seconds = std::chrono::duration<double>(now - it.second.when).count();
+            residence &r = ret[it.second.depth];
+            r.sbufs++;
+            r.total_seconds += seconds;
+            r.max_seconds = std::max(r.max_seconds, seconds);
+        }
+    }
+    return ret;
+}
+
+std::vector<double> queue_stats::worker_idle_seconds()
+{
+    const double elapsed = elapsed_seconds();
+    std::vector<double> busy = scanner_watchdog::thread_busy_seconds();
+    if (busy.size() < workers()) busy.resize(workers());
+    std::vector<double> ret;
+    for (double b : busy) ret.push_back(std::max(elapsed - b, 0.0));
+    return ret;
+}
+
+/* The producer's waits, the mean residence at depth 0, and how idle the workers are, for the notify thread */
+void queue_stats::add_realtime_stats(std::map<std::string,std::string> &stats)
+{
+    std::stringstream ws;
+    for (int w=0; w<WAITS; w++) {
+        ws << (w ? ", " : "") << wait_name(wait_t(w)) << " " << int(wait_seconds(wait_t(w))) << "s";
+    }
+    stats["producer_wait"] = ws.str();
+
+    auto r = residence_by_depth();
+    if (!r.empty() && r[0].sbufs) {
+        std::stringstream rs;
+        rs << int(r[0].mean_seconds() * 1000) << " ms mean, " << int(r[0].max_seconds * 1000) << " ms max";
+        stats["queue_residence"] = rs.str();
+    }
+
+    const double elapsed = elapsed_seconds();
+    auto idle = worker_idle_seconds();
+    if (elapsed>0 && !idle.empty()) {
+        double total = 0;
+        for (double i : idle) total += i;
+        stats["worker_idle"] = std::to_string(int(100 * total / (elapsed * idle.size()))) + " %";
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef QUEUE_STATS_H
+#define QUEUE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * queue_stats:
+ * Where phase 1 waits, for sizing -j and the read threads:
+ *   - the producer's waits: for the scanner queue to drain (queue_capacity), for the memory budget
+ *     (memory_budget), and for the readers to hand it the next page (read);
+ *   - each worker's idle time: the phase-1 wall time less the time it spent in scanner calls
+ *     (scanner_watchdog counts the busy time);
+ *   - the queue residence of each sbuf: from when phase 1 scheduled it to when a worker began to scan it.
+ *
+ * Phase 1 stamps each depth-0 sbuf with enqueued() just before it schedules it, and scanner_watchdog
+ * calls started() when the first scanner call on an sbuf begins. The sbufs that the scanners recurse
+ * into are queued by the scanner set, which does not stamp them, so only depth 0 has residence times.
+ *
+ * A producer that waits for queue capacity while the workers are busy wants more workers; workers
+ * that sit idle while the producer waits for reads want more read threads.
+ */
+
+class queue_stats {
+public:
+    enum wait_t { QUEUE_CAPACITY, MEMORY_BUDGET, READ, WAITS };
+    struct residence {
+        uint64_t sbufs {0};
+        double   total_seconds {0};
+        double   max_seconds {0};
+        double   mean_seconds() const { return sbufs ? total_seconds / sbufs : 0; }
+    };
+
+    /* RAII: time spent waiting */
+    class wait_timer {
+        wait_t w;
+        std::chrono::steady_clock::time_point start;
+    public:
+        explicit wait_timer(wait_t w_) : w(w_), start(std::chrono::steady_clock::now()) {}
+        ~wait_timer();
+    };
+
+    static const char *wait_name(wait_t w);
+    static double wait_seconds(wait_t w);
+
+    static void start(unsigned workers);        // when phase 1 starts; workers is -j
+    static double elapsed_seconds();            // since start()
+    static unsigned workers();
+
+    static void enqueued(const void *sbuf, unsigned depth); // the sbuf is about to be scheduled
+    static void started(const void *sbuf);      // a worker is about to scan it; does nothing if it was not stamped
+    static std::vector<residence> residence_by_depth();
+    static std::vector<residence> queued_by_depth(); // the stamped sbufs not started yet, and their waits so far
+
+    /* The idle seconds of each worker, from scanner_watchdog's busy time; at least workers() entries */
+    static std::vector<double> worker_idle_seconds();
+    static void add_realtime_stats(std::map<std::string,std::string> &stats);
+
+private:
+    static inline std::atomic<uint64_t> wait_ns[WAITS] {};
+};
+
+#endif
@@ -14,6 +14,18 @@ CmdExtract::CmdExtract() :
   Unp->Init(NULL);
 }
 
+CmdExtract::CmdExtract(byte *Window) :
+    StartTime(), DataIO(), Unp(), TotalFileCount(), FileCount(), MatchedArgs(),
+    FirstFile(), AllMatchesExact(), ReconstructDone(),
+    AnySolidDataUnpackedWell(), PasswordAll(), PrevExtracted(),
+    PasswordCancelled(), SignatureFound()
+{
+  TotalFileCount=0;
+  *Password=0;
+  Unp=new Unpack(&DataIO);
+  Unp->Init(Window);
+}
+
 CmdExtract::CmdExtract(const CmdExtract &copy) :
     StartTime(), DataIO(), Unp(), TotalFileCount(), FileCount(), MatchedArgs(),
     FirstFile(), AllMatchesExact(), ReconstructDone(),
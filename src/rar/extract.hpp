@@ -36,6 +36,7 @@ class CmdExtract
     bool PasswordCancelled;
   public:
     CmdExtract();
+    CmdExtract(byte *Window); // unpack in a zeroed MAXWINSIZE window that the caller owns
     CmdExtract(const CmdExtract &copy);
     const CmdExtract& operator=(const CmdExtract &src);
     ~CmdExtract();
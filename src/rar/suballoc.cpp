@@ -9,6 +9,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+
 #include "raros.hpp"
 #include "os.hpp"
 #include "errhnd.hpp"
@@ -16,14 +18,14 @@
 #include "model.hpp"
 
 SubAllocator::SubAllocator() :
-    SubAllocatorSize(), GlueCount(), HeapStart(), LoUnit(), HiUnit(), pText(),
+    SubAllocatorSize(), HeapSize(), GlueCount(), HeapStart(), LoUnit(), HiUnit(), pText(),
     UnitsStart(), HeapEnd(), FakeUnitsStart()
 {
   Clean();
 }
 
 SubAllocator::SubAllocator(const SubAllocator &copy) :
-    SubAllocatorSize(), GlueCount(), HeapStart(), LoUnit(), HiUnit(), pText(),
+    SubAllocatorSize(), HeapSize(), GlueCount(), HeapStart(), LoUnit(), HiUnit(), pText(),
     UnitsStart(), HeapEnd(), FakeUnitsStart()
 {
     *this = copy;
@@ -32,6 +34,7 @@ SubAllocator::SubAllocator(const SubAllocator &copy) :
 const SubAllocator& SubAllocator::operator=(const SubAllocator &src)
 {
     SubAllocatorSize = src.SubAllocatorSize;
+    HeapSize = src.HeapSize;
     memcpy(Indx2Units, src.Indx2Units, sizeof(Indx2Units));
     memcpy(Units2Indx, src.Units2Indx, sizeof(Units2Indx));
     GlueCount = src.GlueCount;
@@ -102,12 +105,64 @@ void SubAllocator::SplitBlock(void* pv,int OldIndx,int NewIndx)
 
 
 
+// bulk_extractor: a PPM block of a corrupt component can ask for up to 256 MB, and the
+// unpacker of every component used to malloc and free its own. A stopped heap is kept as this
+// thread's spare and reused by the next model that fits in it. The spare is freed when a larger
+// heap replaces it and when the thread exits.
+static std::atomic<size_t> MemoryInUse(0);
+static size_t MemoryLimit=1024<<20;
+
+namespace {
+  struct SpareHeap
+  {
+    byte *Heap=NULL;
+    uint Size=0;
+    void Free()
+    {
+      if (Heap!=NULL)
+      {
+        free(Heap);
+        MemoryInUse-=Size;
+        Heap=NULL;
+        Size=0;
+      }
+    }
+    ~SpareHeap() {Free();}
+  };
+  thread_local SpareHeap Spare;
+}
+
+
+void SubAllocator::SetMemoryLimit(size_t Bytes)
+{
+  MemoryLimit=Bytes;
+}
+
+
+size_t SubAllocator::GetMemoryInUse()
+{
+  return MemoryInUse;
+}
+
+
 void SubAllocator::StopSubAllocator()
 {
   if ( SubAllocatorSize ) 
   {
     SubAllocatorSize=0;
-    free(HeapStart);
+    if (HeapSize>=Spare.Size)
+    {
+      Spare.Free();
+      Spare.Heap=HeapStart;
+      Spare.Size=HeapSize;
+    }
+    else
+    {
+      free(HeapStart);
+      MemoryInUse-=HeapSize;
+    }
+    HeapStart=NULL;
+    HeapSize=0;
   }
 }
 
@@ -124,14 +179,35 @@ bool SubAllocator::StartSubAllocator(int SASize)
   // units: one as reserve for HeapEnd overflow checks and another
   // to provide the space to correctly align UnitsStart.
   uint AllocSize=t/FIXED_UNIT_SIZE*UNIT_SIZE+2*UNIT_SIZE;
-  if ((HeapStart=(byte *)malloc(AllocSize)) == NULL)
+  if (Spare.Heap!=NULL && Spare.Size>=AllocSize)
+  {
+    HeapStart=Spare.Heap;
+    HeapSize=Spare.Size;
+    Spare.Heap=NULL;
+    Spare.Size=0;
+  }
+  else
   {
-    ErrHandler.MemoryError();
-    return FALSE;
+    Spare.Free();
+    if ((MemoryInUse+=AllocSize)>MemoryLimit)
+    {
+      MemoryInUse-=AllocSize;
+      ErrHandler.MemoryError();
+      return FALSE;
+    }
+    if ((HeapStart=(byte *)malloc(AllocSize)) == NULL)
+    {
+      MemoryInUse-=AllocSize;
+      ErrHandler.MemoryError();
+      return FALSE;
+    }
+    HeapSize=AllocSize;
   }
 
   // HeapEnd did not present in original algorithm. We added it to control
   // invalid memory access attempts when processing corrupt archived data.
+  // It is at the end of the requested size, not of a larger reused block,
+  // so that the model behaves as it would in a heap of its own.
   HeapEnd=HeapStart+AllocSize-UNIT_SIZE;
 
   SubAllocatorSize=t;
@@ -65,6 +65,7 @@ class SubAllocator
     inline RAR_MEM_BLK* MBPtr(RAR_MEM_BLK *BasePtr,int Items);
 
     long SubAllocatorSize;
+    uint HeapSize; // the size of the block at HeapStart, which may be a larger one reused
     byte Indx2Units[N_INDEXES], Units2Indx[128], GlueCount;
     byte *HeapStart,*LoUnit, *HiUnit;
     struct RAR_NODE FreeList[N_INDEXES];
@@ -84,6 +85,12 @@ class SubAllocator
     void  FreeUnits(void* ptr,int OldNU);
     long GetAllocatedMemory() {return(SubAllocatorSize);};
 
+    // bulk_extractor: the heaps of all threads' models together, including the one each thread
+    // keeps for its next model, are limited to this many bytes; StartSubAllocator() throws
+    // MEMORY_ERROR past it.
+    static void SetMemoryLimit(size_t Bytes);
+    static size_t GetMemoryInUse();
+
     byte *pText, *UnitsStart,*HeapEnd,*FakeUnitsStart;
 };
 
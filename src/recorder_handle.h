@@ -0,0 +1,110 @@
+#ifndef RECORDER_HANDLE_H
+#define RECORDER_HANDLE_H
+
+#include <cassert>
+#include <cstddef>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "be13_api/scanner_params.h"
+#include "feature_shards.h"
+
+/**
+ * recorder_handle:
+ * A scanner's feature recorder, looked up by name once, at PHASE_INIT2 (which runs only for the
+ * enabled scanners), instead of with sp.named_feature_recorder() on every call, which finds the name
+ * in the feature_recorder_set's map for every sbuf and every recursed-into child.
+ *
+ * A scanner declares a static handle for each of its feature files, and the handle gives both the
+ * definition and the lookup, so that the name is written once:
+ *
+ *     static recorder_handle sqlite_recorder {"sqlite"};
+ *
+ *     PHASE_INIT:  sp.info->feature_defs.push_back(sqlite_recorder.def(carve_flag));
+ *     PHASE_INIT2: sqlite_recorder.resolve(sp);
+ *     PHASE_SCAN:  sqlite_recorder->write(...);  or  feature_recorder &fr = *sqlite_recorder;
+ *
+ * The name must be a string literal (or a macro that is one), so it is fixed when the scanner is
+ * compiled; a handle used before it is resolved asserts. Each scanner set resolves the handles again at
+ * its PHASE_INIT2, as the pointers that scan_aes and scan_winprefetch cached always were.
+ *
+ * def() is also where -S histogram_only=NAME,... applies: those recorders are defined with no_features,
+ * so their features are counted in their in-memory histograms but neither escaped nor written to a
+ * feature file, which is most of the output of recorders such as domain and url that are read only
+ * for their histograms. The scanners that define recorders without a handle use make_def() for the same.
+ * The histograms of such a recorder cannot fall back to rereading its feature file, so they are lost if
+ * the histogram runs out of memory; and nothing that reads the feature files (the feature streams,
+ * -S triage_minutes, the indexes) sees its features.
+ *
+ * define(sp, flags) pushes def(flags) and, for the recorders of -S feature_shards, the definitions of
+ * their shards; a resolved handle then gives each thread its shard (see feature_shards.h).
+ */
+
+class recorder_handle {
+public:
+    template <size_t N>
+    constexpr explicit recorder_handle(const char (&name_)[N]) : name(name_) {
+        static_assert(N > 1, "a feature recorder needs a name");
+    }
+    recorder_handle(const recorder_handle &) = delete;
+    recorder_handle &operator=(const recorder_handle &) = delete;
+
+    const char *const name;
+
+    feature_recorder_def def() const { return make_def(name); }
+    feature_recorder_def def(const feature_recorder_def::flags_t &flags) const { return make_def(name, flags); }
+
+    /* names is a list of recorder names separated by commas, or "" for none */
+    static void set_histogram_only(const std::string &names) {
+        histogram_only_.clear();
+        std::stringstream ss(names);
+        std::string n;
+        while (std::getline(ss, n, ',')) {
+            if (!n.empty()) histogram_only_.insert(n);
+        }
+    }
+    static bool histogram_only(const std::string &n) { return histogram_only_.count(n) > 0; }
+    static feature_recorder_def make_def(const std::string &n, feature_recorder_def::flags_t flags = {}) {
+        if (histogram_only(n)) flags.no_features = true;
+        return feature_recorder_def(n, flags);
+    }
+
+    /* at PHASE_INIT, for sp.info->feature_defs.push_back(def(flags)) */
+    void define(const scanner_params &sp, const feature_recorder_def::flags_t &flags = {}) const { define(sp, name, flags); }
+    static void define(const scanner_params &sp, const std::string &n, const feature_recorder_def::flags_t &flags = {}) {
+        sp.info->feature_defs.push_back(make_def(n, flags));
+        if (!feature_shards::sharded(n) || flags.carve) return;
+        for (unsigned i = 0; i < feature_shards::shards(); i++) {
+            sp.info->feature_defs.push_back(make_def(feature_shards::shard_name(n, i), flags));
+        }
+        feature_shards::add_defined(n);
+    }
+
+    /* at PHASE_INIT2 */
+    void resolve(const scanner_params &sp) {
+        fr = &sp.named_feature_recorder(name);
+        shards.clear();
+        if (feature_shards::defined(name)) {
+            for (unsigned i = 0; i < feature_shards::shards(); i++) {
+                shards.push_back(&sp.named_feature_recorder(feature_shards::shard_name(name, i)));
+            }
+        }
+    }
+    bool resolved() const { return fr != nullptr; }
+
+    feature_recorder &operator*() const { return *get(); }
+    feature_recorder *operator->() const { return get(); }
+
+private:
+    feature_recorder *get() const {
+        assert(fr);
+        return shards.empty() ? fr : shards[feature_shards::thread_shard() % shards.size()];
+    }
+    feature_recorder *fr {nullptr};
+    std::vector<feature_recorder *> shards {};         // when sharded
+    static inline std::set<std::string> histogram_only_ {};
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "config.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "memory_governor.h"
+#include "recursion_spill.h"
+
+void recursion_spill::set_directory(const std::filesystem::path &dir_)
+{
+    std::lock_guard<std::mutex> lock(M);
+    dir = dir_;
+    active = false;
+    if (dir.empty()) return;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (!std::filesystem::is_directory(dir)) {
+        throw std::runtime_error("recursion_spill: cannot make " + dir.string());
+    }
+    active = true;
+}
+
+bool recursion_spill::spill(const sbuf_t &child)
+{
+    if (!active || !memory_governor::over_budget(child.bufsize, child.depth())) return false;
+
+    spilled_t s;
+    s.path = child.pos0.path;
+    s.offset = child.pos0.offset;
+    s.bufsize = child.bufsize;
+    s.pagesize = child.pagesize;
+    {
+        std::lock_guard<std::mutex> lock(M);
+        s.file = dir / ("child-" + std::to_string(next_file++) + ".bin");
+    }
+    std::ofstream out(s.file, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(child.get_buf()), child.bufsize);
+    out.close();
+    if (!out) {                         // the disk is full: scan it now
+        std::error_code ec;
+        std::filesystem::remove(s.file, ec);
+        return false;
+    }
+    spilled++;
+    spilled_bytes += child.bufsize;
+    const unsigned depth = child.depth();
+    std::lock_guard<std::mutex> lock(M);
+    by_depth[depth].push_back(std::move(s));
+    return true;
+}
+
+sbuf_t *recursion_spill::resume(bool wait)
+{
+    for (;;) {
+        spilled_t s;
+        unsigned depth = 0;
+        {
+            std::lock_guard<std::mutex> lock(M);
+            if (by_depth.empty()) return nullptr;
+            auto deepest = std::prev(by_depth.end());
+            depth = deepest->first;
+            if (!wait && memory_governor::over_budget(deepest->second.front().bufsize, depth)) return nullptr;
+            s = std::move(deepest->second.front());
+            deepest->second.pop_front();
+            if (deepest->second.empty()) by_depth.erase(deepest);
+        }
+        if (wait) memory_governor::wait_for_budget(s.bufsize, depth);
+
+        sbuf_t *child = sbuf_t::sbuf_malloc(pos0_t(s.path, s.offset), s.bufsize, s.pagesize);
+        std::ifstream in(s.file, std::ios::binary);
+        in.read(static_cast<char *>(child->malloc_buf()), s.bufsize);
+        const bool whole = in.gcount() == static_cast<std::streamsize>(s.bufsize);
+        in.close();
+        std::error_code ec;
+        std::filesystem::remove(s.file, ec);
+        if (whole) {
+            resumed++;
+            return child;
+        }
+        delete child;                   // the file was removed or cut short under us
+        lost++;
+    }
+}
+
+size_t recursion_spill::pending()
+{
+    std::lock_guard<std::mutex> lock(M);
+    size_t n = 0;
+    for (const auto &it : by_depth) n += it.second.size();
+    return n;
+}
+
+std::string recursion_spill::xml_attributes()
+{
+    std::stringstream ss;
+    ss << "spilled='" << spilled << "' bytes='" << spilled_bytes << "' resumed='" << resumed << "' lost='" << lost << "'";
+    return ss.str();
+}
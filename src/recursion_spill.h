@@ -0,0 +1,65 @@
+#ifndef RECURSION_SPILL_H
+#define RECURSION_SPILL_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * recursion_spill:
+ * Puts off the scan of a recursive sbuf when memory is short (-S recursion_spill_dir), instead of
+ * scanning it over the budget. content_cache::recurse() writes a child that would not leave room
+ * under its depth's share of -S memory_budget for another of its size to a file in the directory,
+ * deletes it, and returns to the parent scanner, which goes on with the rest of its buffer; the
+ * memory of the child (and of what its scanners would have decoded from it) is freed at once.
+ *
+ * Phase 1 reads the children back when memory frees up: before it reads another page, it schedules
+ * the spilled children that fit (the deepest first, so that archive chains run to the end), and at
+ * the end of phase 1 it schedules all that are left, waiting for the budget as the scanners do. A
+ * child is scanned as it would have been, at its own forensic path, only later. Children smaller
+ * than memory_governor::MIN_GOVERNED are never spilled; a child that cannot be written is scanned
+ * at once.
+ */
+
+class recursion_spill {
+public:
+    /* Spill into dir, which is made if it does not exist; "" for none. Throws std::runtime_error. */
+    static void set_directory(const std::filesystem::path &dir);
+    static bool enabled() { return active; }
+
+    /* Writes the child to a file if it should wait for memory; the caller then deletes it */
+    static bool spill(const sbuf_t &child);
+
+    /* The spilled child that is deepest, read back, if it fits under the budget (or if wait, once the
+     * budget allows or memory_governor::SCANNER_WAIT has passed); nullptr if there is none */
+    static sbuf_t *resume(bool wait);
+    static size_t pending();
+
+    static inline std::atomic<uint64_t> spilled {0};        // children written to files
+    static inline std::atomic<uint64_t> spilled_bytes {0};
+    static inline std::atomic<uint64_t> resumed {0};        // read back and scheduled
+    static inline std::atomic<uint64_t> lost {0};           // whose file could not be read back
+    static std::string xml_attributes();                    // for the <recursion_spill> report element
+
+private:
+    struct spilled_t {
+        std::filesystem::path file {};
+        std::string path {};            // of the child's pos0
+        uint64_t offset {0};
+        size_t bufsize {0};
+        size_t pagesize {0};
+    };
+    static inline std::atomic<bool> active {false};
+    static inline std::mutex M {};
+    static inline std::filesystem::path dir {};
+    static inline uint64_t next_file {0};
+    static inline std::map<unsigned, std::deque<spilled_t>> by_depth {};   // of the children
+};
+
+#endif
@@ -0,0 +1,663 @@
+/**
+ * remote_workers.cpp:
+ * Giving the pages of the image to workers on other machines and keeping what they send back;
+ * see remote_workers.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "feature_files.h"
+#include "feature_shards.h"
+#include "image_process.h"
+#include "remote_workers.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+    void put_be(std::string &s, uint64_t v, int bytes) {
+        for (int i = bytes - 1; i >= 0; i--) s.push_back(char((v >> (8 * i)) & 0xff));
+    }
+    uint64_t get_be(const std::string &s, size_t pos, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) v = (v << 8) | uint8_t(s[pos + i]);
+        return v;
+    }
+
+    /* Reads len bytes; returns the bytes read, which are fewer only at the end of the stream.
+     * Throws if deadline (if it is not max()) passes first. */
+    size_t read_full(int fd, char *buf, size_t len, std::chrono::steady_clock::time_point deadline) {
+        size_t got = 0;
+        while (got < len) {
+            if (deadline != std::chrono::steady_clock::time_point::max()) {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                pollfd pfd {fd, POLLIN, 0};
+                const int r = left.count() > 0 ? ::poll(&pfd, 1, int(std::min<int64_t>(left.count(), INT_MAX))) : 0;
+                if (r < 0 && errno == EINTR) continue;
+                if (r < 0) throw std::runtime_error(std::string("remote_workers: receive: ") + strerror(errno));
+                if (r == 0) throw std::runtime_error("remote_workers: receive: timed out");
+            }
+            const ssize_t n = ::recv(fd, buf + got, len - got, 0);
+            if (n == 0) break;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) throw std::runtime_error("remote_workers: receive: timed out");
+                throw std::runtime_error(std::string("remote_workers: receive: ") + strerror(errno));
+            }
+            got += n;
+        }
+        return got;
+    }
+
+    void set_nodelay(int fd) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // the requests are small and waited for
+    }
+
+    /* A connection can be quiet for as long as a worker takes to scan its pages, so a peer that is gone
+     * (a host that lost power, a network that split) is found by the kernel's probes, not by a deadline:
+     * recv() and send() then fail, within about KEEPALIVE_IDLE + KEEPALIVE_INTERVAL * KEEPALIVE_COUNT seconds. */
+    void set_keepalive(int fd) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+#ifdef TCP_KEEPIDLE
+        int idle = remote_workers::KEEPALIVE_IDLE;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#elif defined(TCP_KEEPALIVE)
+        int idle = remote_workers::KEEPALIVE_IDLE;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(idle)); // macOS
+#endif
+#ifdef TCP_KEEPINTVL
+        int interval = remote_workers::KEEPALIVE_INTERVAL;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+#endif
+#ifdef TCP_KEEPCNT
+        int count = remote_workers::KEEPALIVE_COUNT;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+#ifdef TCP_USER_TIMEOUT
+        /* data sent that is not acknowledged, which keepalive does not probe */
+        unsigned int user_timeout = (remote_workers::KEEPALIVE_IDLE +
+                                     remote_workers::KEEPALIVE_INTERVAL * remote_workers::KEEPALIVE_COUNT) * 1000;
+        setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout));
+#endif
+    }
+
+    /* splits "NAME\nDATA" */
+    void split_named(const std::string &payload, std::string &name, std::string &data) {
+        const size_t nl = payload.find('\n');
+        if (nl == std::string::npos || nl == 0) throw std::runtime_error("remote_workers: frame without a name");
+        name = payload.substr(0, nl);
+        data = payload.substr(nl + 1);
+    }
+
+    void write_file(const std::filesystem::path &path, const std::string &data) {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream os(path, std::ios::binary | std::ios::trunc);
+        os.write(data.data(), data.size());
+        os.close();
+        if (!os) throw std::runtime_error("remote_workers: cannot write " + path.string());
+    }
+
+    std::string read_file(const std::filesystem::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) throw std::runtime_error("remote_workers: cannot open " + path.string());
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+}
+
+/****************************************************************
+ *** the wire
+ ****************************************************************/
+
+remote_workers::connection::~connection()
+{
+    ::close(fd);
+}
+
+std::shared_ptr<remote_workers::connection> remote_workers::connection::connect(const std::string &hostport)
+{
+    std::string host, port;
+    split_hostport(hostport, host, port);
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    const int err = getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0) throw std::runtime_error(hostport + ": " + gai_strerror(err));
+    int fd = -1;
+    for (addrinfo *ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) throw std::runtime_error("cannot connect to " + hostport + ": " + strerror(errno));
+    set_nodelay(fd);
+    set_keepalive(fd);                  // the worker finds a lost producer as the producer finds a lost worker
+    return std::make_shared<connection>(fd);
+}
+
+void remote_workers::connection::send(frame_t type, const std::string &payload)
+{
+    if (payload.size() > MAX_FRAME) throw std::runtime_error("remote_workers: frame too large");
+    std::string header(1, char(type));
+    put_be(header, payload.size(), 4);
+    std::lock_guard<std::mutex> lock(Msend);
+    for (const std::string *s : std::initializer_list<const std::string *>{&header, &payload}) {
+        for (size_t done = 0; done < s->size(); ) {
+            const ssize_t n = ::send(fd, s->data() + done, s->size() - done, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error(std::string("remote_workers: send: ") + strerror(errno));
+            done += n;
+        }
+    }
+}
+
+bool remote_workers::connection::recv(frame_t &type, std::string &payload, uint32_t max_len)
+{
+    char header[5];
+    const size_t got = read_full(fd, header, sizeof(header), deadline);
+    if (got == 0) return false;
+    if (got < sizeof(header)) throw std::runtime_error("remote_workers: connection closed within a frame");
+    type = frame_t(header[0]);
+    const uint64_t len = get_be(std::string(header, sizeof(header)), 1, 4);
+    if (len > max_len) throw std::runtime_error("remote_workers: frame too large");
+    payload.resize(len);
+    if (read_full(fd, payload.data(), len, deadline) < len) throw std::runtime_error("remote_workers: connection closed within a frame");
+    return true;
+}
+
+void remote_workers::connection::shutdown()
+{
+    ::shutdown(fd, SHUT_RDWR);
+}
+
+void remote_workers::connection::set_deadline(unsigned seconds)
+{
+    deadline = seconds ? std::chrono::steady_clock::now() + std::chrono::seconds(seconds)
+                       : std::chrono::steady_clock::time_point::max();
+}
+
+void remote_workers::connection::keep_alive()
+{
+    set_keepalive(fd);
+}
+
+std::string remote_workers::encode_page(uint64_t offset, size_t pagesize, const uint8_t *buf, size_t bufsize)
+{
+    std::string ret;
+    put_be(ret, offset, 8);
+    put_be(ret, pagesize, 4);
+    put_be(ret, bufsize, 4);
+    uLongf zlen = compressBound(bufsize);
+    ret.resize(16 + zlen);
+    if (compress2(reinterpret_cast<Bytef *>(ret.data() + 16), &zlen, buf, bufsize, Z_BEST_SPEED) != Z_OK) {
+        throw std::runtime_error("remote_workers: cannot compress a page");
+    }
+    ret.resize(16 + zlen);
+    return ret;
+}
+
+void remote_workers::decode_page(const std::string &payload, page &p)
+{
+    if (payload.size() < 16) throw std::runtime_error("remote_workers: short page");
+    p.offset   = get_be(payload, 0, 8);
+    p.pagesize = get_be(payload, 8, 4);
+    const size_t bufsize = get_be(payload, 12, 4);
+    if (p.pagesize > bufsize) throw std::runtime_error("remote_workers: page larger than its buffer");
+    p.buf.resize(bufsize);
+    uLongf len = bufsize;
+    if (uncompress(p.buf.data(), &len, reinterpret_cast<const Bytef *>(payload.data() + 16), payload.size() - 16) != Z_OK ||
+        len != bufsize) {
+        throw std::runtime_error("remote_workers: corrupt page");
+    }
+}
+
+std::string remote_workers::encode_pages(const std::vector<std::string> &encoded)
+{
+    std::string ret;
+    put_be(ret, encoded.size(), 4);
+    for (const auto &it : encoded) {
+        put_be(ret, it.size(), 4);
+        ret += it;
+    }
+    return ret;
+}
+
+std::vector<remote_workers::page> remote_workers::decode_pages(const std::string &payload)
+{
+    if (payload.size() < 4) throw std::runtime_error("remote_workers: short PAGES");
+    std::vector<page> ret(get_be(payload, 0, 4));
+    size_t pos = 4;
+    for (auto &p : ret) {
+        if (pos + 4 > payload.size()) throw std::runtime_error("remote_workers: short PAGES");
+        const size_t len = get_be(payload, pos, 4);
+        pos += 4;
+        if (len > payload.size() - pos) throw std::runtime_error("remote_workers: short PAGES");
+        decode_page(payload.substr(pos, len), p);
+        pos += len;
+    }
+    return ret;
+}
+
+void remote_workers::split_hostport(const std::string &hostport, std::string &host, std::string &port)
+{
+    const bool bracketed = !hostport.empty() && hostport[0] == '[';
+    size_t colon = std::string::npos;
+    if (bracketed) {
+        const size_t close = hostport.find(']');
+        if (close == std::string::npos) throw std::invalid_argument(hostport + ": no closing ]");
+        host = hostport.substr(1, close - 1);
+        if (close + 1 < hostport.size() && hostport[close + 1] == ':') colon = close + 1;
+    } else {
+        colon = hostport.rfind(':');
+        host = colon == std::string::npos ? "" : hostport.substr(0, colon);
+    }
+    port = colon != std::string::npos ? hostport.substr(colon + 1) : bracketed ? "" : hostport;
+    if (port.empty() || port.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::invalid_argument(hostport + ": must be HOST:PORT or PORT");
+    }
+}
+
+bool remote_workers::safe_relpath(const std::filesystem::path &relpath)
+{
+    if (relpath.empty() || relpath.is_absolute() || relpath.has_root_path()) return false;
+    for (const auto &part : relpath) {
+        if (part == "..") return false;
+    }
+    return true;
+}
+
+/****************************************************************
+ *** the producer
+ ****************************************************************/
+
+bool remote_workers::hello_valid(const std::string &payload)
+{
+    const std::string want = hello();
+    unsigned char diff = payload.size() != want.size();
+    for (size_t i = 0; i < payload.size() && i < want.size(); i++) diff |= payload[i] ^ want[i];
+    return diff == 0;
+}
+
+void remote_workers::start(const std::string &listen, const image_process &image_, const std::filesystem::path &outdir_,
+                           size_t max_queued_)
+{
+    if (token.empty()) throw std::runtime_error("-S remote_workers needs -S remote_token, which the workers must also be given");
+    if (token.size() > MAX_TOKEN) throw std::runtime_error("-S remote_token is longer than " + std::to_string(MAX_TOKEN) + " bytes");
+    std::string host, port;
+    split_hostport(listen, host, port);
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    /* without AI_PASSIVE, no HOST is the loopback interface */
+    const int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0) throw std::runtime_error(listen + ": " + gai_strerror(err));
+    int fd = -1;
+    for (addrinfo *ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || ::listen(fd, 64) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) throw std::runtime_error("-S remote_workers: cannot listen on " + listen + ": " + strerror(errno));
+
+    image = &image_;
+    outdir = outdir_;
+    max_queued = std::max<size_t>(max_queued_, 1);
+    listen_fd = fd;
+    last_put = false;
+    stopping = false;
+    running = true;
+    acceptor = std::thread(accept_loop);
+}
+
+void remote_workers::accept_loop()
+{
+    uint64_t next_id = 0;
+    while (true) {
+        pollfd pfd {listen_fd, POLLIN, 0};
+        const bool ready = ::poll(&pfd, 1, 500) > 0 && (pfd.revents & POLLIN);
+        std::lock_guard<std::mutex> lock(M);
+        if (stopping) return;
+        /* a connection that never said HELLO has nothing to keep; its thread has only to return */
+        for (auto it = sessions.begin(); it != sessions.end(); ) {
+            if (!it->second->done || it->second->greeted) {
+                ++it;
+                continue;
+            }
+            it->second->thread.join();
+            it = sessions.erase(it);
+        }
+        if (!ready) continue;
+        const int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        /* a connection costs a thread before it has shown the token, so there are few of them, and briefly */
+        const auto greeting = std::count_if(sessions.begin(), sessions.end(),
+                                            [](const auto &it) { return !it.second->greeted; });
+        if (greeting >= MAX_GREETING) {
+            ::close(fd);
+            continue;
+        }
+        set_nodelay(fd);
+        auto s = std::make_unique<session>();
+        s->conn = std::make_shared<connection>(fd);
+        s->conn->set_deadline(HELLO_SECONDS);  // for the whole greeting, however it is sent
+        session *sp = s.get();
+        const uint64_t id = ++next_id;
+        sessions[id] = std::move(s);
+        sp->thread = std::thread(serve, id, sp);
+    }
+}
+
+void remote_workers::put(sbuf_t *sbuf)
+{
+    std::unique_lock<std::mutex> lock(M);
+    if (queue.size() >= max_queued) {
+        waits++;
+        changed.wait(lock, [] { return queue.size() < max_queued; });
+    }
+    queue.push_back(item{sbuf, sbuf->pos0.offset, sbuf->pagesize, sbuf->bufsize});
+    changed.notify_all();
+}
+
+/* Takes the next page for s, waiting for one if wait; "" if there are none (and, if wait, will be none) */
+std::string remote_workers::next_page(session *s, bool wait)
+{
+    item it;
+    std::string payload;
+    while (payload.empty()) {
+        {
+            std::unique_lock<std::mutex> lock(M);
+            if (wait) changed.wait(lock, [] { return !queue.empty() || last_put; });
+            if (queue.empty()) return "";
+            it = queue.front();
+            queue.pop_front();
+            s->given.push_back(item{nullptr, it.offset, it.pagesize, it.bufsize, it.reads});
+            outstanding++;
+            changed.notify_all();       // room for put()
+        }
+        std::unique_ptr<sbuf_t> sbuf(it.sbuf);
+        if (sbuf) {
+            payload = encode_page(it.offset, it.pagesize, sbuf->get_buf(), sbuf->bufsize);
+            break;
+        }
+        /* the page of a lost worker */
+        std::vector<uint8_t> buf(it.bufsize);
+        ssize_t n = -1;
+        try {
+            n = image->pread(buf.data(), buf.size(), it.offset);
+        } catch (const std::exception &) {
+        }
+        if (n >= 0) {
+            payload = encode_page(it.offset, std::min<size_t>(it.pagesize, n), buf.data(), n);
+            pages_resent++;
+            break;
+        }
+        /* not given after all: tried again, or after READ_TRIES a read error */
+        std::lock_guard<std::mutex> lock(M);
+        s->given.pop_back();
+        outstanding--;
+        if (++it.reads < READ_TRIES) {
+            queue.push_back(it);
+        } else {
+            pages_unreadable++;
+            std::cerr << "remote workers: cannot read the image again at offset " << it.offset
+                      << "; the page is not scanned" << std::endl;
+        }
+        changed.notify_all();
+    }
+    pages_sent++;
+    page_bytes += it.bufsize;
+    wire_bytes += payload.size();
+    return payload;
+}
+
+void remote_workers::serve(uint64_t id, session *s)
+{
+    const std::filesystem::path dir = outdir / (DIR_PREFIX + std::to_string(id));
+    std::map<std::string, std::ofstream> files;
+    bool greeted = false, bye = false;
+    try {
+        frame_t type;
+        std::string payload, name, data;
+        while (!bye && s->conn->recv(type, payload, greeted ? MAX_FRAME : MAX_HELLO)) {
+            if (!greeted && type != HELLO) throw std::runtime_error("no HELLO");
+            switch (type) {
+            case HELLO:
+                if (!hello_valid(payload)) throw std::runtime_error("not " + PROTOCOL + " with this run's token");
+                greeted = true;
+                s->conn->set_deadline(0);       // a worker asks again when it has scanned its pages,
+                s->conn->keep_alive();          // so a worker that is gone is found by keepalive instead
+                {
+                    std::lock_guard<std::mutex> lock(M);
+                    s->greeted = true;
+                }
+                workers++;
+                std::filesystem::create_directories(dir);
+                data.clear();
+                put_be(data, image->image_size(), 8);
+                s->conn->send(INFO, data + image->image_fname().string());
+                break;
+            case NEXT: {
+                if (payload.size() != 4) throw std::runtime_error("bad NEXT");
+                const uint64_t wanted = std::clamp<uint64_t>(get_be(payload, 0, 4), 1, MAX_PAGES_PER_REQUEST);
+                std::vector<std::string> encoded;
+                for (std::string p; encoded.size() < wanted && !(p = next_page(s, encoded.empty())).empty(); ) {
+                    encoded.push_back(std::move(p));
+                }
+                if (encoded.empty()) s->conn->send(END, "");
+                else s->conn->send(PAGES, encode_pages(encoded));
+                break;
+            }
+            case FEATURES: {
+                split_named(payload, name, data);
+                if (name.find('/') != std::string::npos || name == "..") throw std::runtime_error("bad recorder " + name);
+                auto &os = files[name];
+                if (!os.is_open()) os.open(dir / (name + ".txt"), std::ios::binary | std::ios::app);
+                os.write(data.data(), data.size());
+                if (!os) throw std::runtime_error("cannot write " + (dir / (name + ".txt")).string());
+                lines_received += std::count(data.begin(), data.end(), '\n');
+                break;
+            }
+            case CARVE:
+            case OUTPUT:
+                split_named(payload, name, data);
+                if (!safe_relpath(name) || (type == OUTPUT && std::filesystem::path(name).has_parent_path())) {
+                    throw std::runtime_error("bad file name " + name);
+                }
+                write_file(dir / name, data);
+                break;
+            case BYE:
+                for (auto &it : files) {
+                    it.second.close();
+                    if (!it.second) throw std::runtime_error("cannot write the feature file " + it.first);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(M);
+                    outstanding -= s->given.size();
+                    s->given.clear();
+                    s->done = true;
+                    finished.push_back(id);
+                    changed.notify_all();
+                }
+                bye = true;
+                s->conn->send(ACK, "");
+                break;
+            default:
+                throw std::runtime_error("unknown frame type");
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "remote worker " << id << ": " << e.what() << std::endl;
+    }
+    if (bye) return;
+
+    /* lost: its pages are given to the others, and nothing it sent is kept */
+    files.clear();
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    std::lock_guard<std::mutex> lock(M);
+    if (!s->given.empty()) {
+        std::cerr << "remote worker " << id << " was lost; its " << s->given.size() << " pages are scanned again" << std::endl;
+        workers_lost++;
+        for (auto it = s->given.rbegin(); it != s->given.rend(); ++it) queue.push_front(*it);
+        outstanding -= s->given.size();
+        s->given.clear();
+    }
+    s->done = true;
+    changed.notify_all();
+}
+
+void remote_workers::finish()
+{
+    if (!running) return;
+    {
+        std::unique_lock<std::mutex> lock(M);
+        last_put = true;
+        changed.notify_all();
+        bool told = false;
+        while (!queue.empty() || outstanding > 0) {
+            const bool connected = std::any_of(sessions.begin(), sessions.end(), [](const auto &it) { return !it.second->done; });
+            if (!connected && !told) {
+                std::cerr << "The image has been read; " << queue.size() + outstanding
+                          << " pages are waiting for a remote worker to connect" << std::endl;
+                told = true;
+            }
+            changed.wait_for(lock, std::chrono::seconds(1));
+        }
+        stopping = true;
+        /* the workers still connected have no pages; they are told so when they ask */
+        for (auto &it : sessions) {
+            if (!it.second->done) it.second->conn->shutdown();
+        }
+    }
+    acceptor.join();
+    ::close(listen_fd);
+    listen_fd = -1;
+    for (auto &it : sessions) it.second->thread.join();
+    running = false;
+}
+
+void remote_workers::merge(const std::filesystem::path &outdir_)
+{
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(M);
+        ids = finished;
+    }
+    std::sort(ids.begin(), ids.end());
+    for (const uint64_t id : ids) {
+        const std::filesystem::path dir = outdir_ / (DIR_PREFIX + std::to_string(id));
+        std::vector<std::filesystem::path> rels;
+        std::error_code ec;
+        for (auto it = std::filesystem::recursive_directory_iterator(dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); ++it) {
+            if (it->is_regular_file()) rels.push_back(std::filesystem::relative(it->path(), dir));
+        }
+        for (const auto &rel : rels) {
+            const std::filesystem::path from = dir / rel;
+            const std::filesystem::path to = outdir_ / rel;
+            if (!rel.has_parent_path() && rel.extension() == ".txt") {
+                if (is_histogram_file(from)) {
+                    std::vector<std::filesystem::path> parts;
+                    if (std::filesystem::exists(to)) parts.push_back(to);
+                    parts.push_back(from);
+                    feature_shards::add_histograms(parts, to);
+                } else {
+                    feature_shards::append_features(from, to);
+                }
+            } else if (!std::filesystem::exists(to)) {
+                std::filesystem::create_directories(to.parent_path());
+                std::filesystem::rename(from, to);
+            }
+        }
+        std::filesystem::remove_all(dir);
+    }
+}
+
+std::string remote_workers::xml_attributes()
+{
+    std::stringstream ss;
+    ss << "workers='" << workers << "' lost='" << workers_lost << "' pages='" << pages_sent
+       << "' resent='" << pages_resent << "' unreadable='" << pages_unreadable << "' page_bytes='" << page_bytes << "' wire_bytes='" << wire_bytes
+       << "' lines='" << lines_received << "' waits='" << waits << "'";
+    return ss.str();
+}
+
+/****************************************************************
+ *** the worker
+ ****************************************************************/
+
+namespace {
+    class remote_sink : public feature_sink {
+    public:
+        explicit remote_sink(std::shared_ptr<remote_workers::connection> conn_):
+            feature_sink("remote"), conn(std::move(conn_)) {}
+        bool write(const std::string &recorder, const std::string &lines) override {
+            try {
+                conn->send(remote_workers::FEATURES, recorder + "\n" + lines);
+            } catch (const std::runtime_error &) {
+                return false;
+            }
+            return true;
+        }
+        bool carve(const std::string &, const std::filesystem::path &file, const std::filesystem::path &relpath) override {
+            try {
+                conn->send(remote_workers::CARVE, relpath.string() + "\n" + read_file(file));
+            } catch (const std::runtime_error &) {
+                return false;
+            }
+            return true;
+        }
+    private:
+        const std::shared_ptr<remote_workers::connection> conn;
+    };
+}
+
+std::unique_ptr<feature_sink> remote_workers::make_sink()
+{
+    return std::make_unique<remote_sink>(worker_);
+}
+
+void remote_workers::finish_worker(const std::filesystem::path &outdir_)
+{
+    if (!worker_) return;
+    for (const auto &txt : output_text_files(outdir_, false)) {
+        if (is_histogram_file(txt)) worker_->send(OUTPUT, txt.filename().string() + "\n" + read_file(txt));
+    }
+    worker_->send(BYE, "");
+    frame_t type;
+    std::string payload;
+    if (!worker_->recv(type, payload) || type != ACK) {
+        throw std::runtime_error("the producer did not take the output");
+    }
+}
@@ -0,0 +1,198 @@
+#ifndef REMOTE_WORKERS_H
+#define REMOTE_WORKERS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "be13_api/sbuf.h"
+#include "feature_sink.h"
+
+class image_process;
+
+/**
+ * remote_workers:
+ * Scanning an image on other machines, for an image on a node with few cores next to a pool of machines
+ * with many. The run on the node with the image (the producer) reads the pages as it always does, but
+ * instead of scanning them it gives them out to the workers that connect to it, each of which is a run of
+ * bulk_extractor whose image is the producer:
+ *
+ *     bulk_extractor -S remote_workers=[HOST:]PORT -S remote_token=SECRET -o OUTDIR IMAGE   (the producer)
+ *     bulk_extractor -S remote_token=SECRET -o SCRATCH remote:HOST:PORT     (each worker, with its own -j and -e/-x)
+ *
+ * The work is given out by demand, as the local work queue gives it to the threads: a worker asks for
+ * PAGES_PER_REQUEST more pages when its reader wants them, which is when its own queue has room, so a
+ * fast worker takes more of the image than a slow one. The producer's reader waits while
+ * -S remote_queue_pages pages are waiting for a worker. Pages are compressed (zlib, fastest) for the wire.
+ *
+ * A worker streams its features and carves back on the same connection as it writes them (a feature_stream
+ * with make_sink()), and at the end of its run sends its histograms and says BYE. The producer keeps what
+ * each worker sends in OUTDIR/remote-N/, and merge() adds them to OUTDIR at the end of the run: the feature
+ * files appended, the histograms added up and the carves moved, so that OUTDIR is as if the producer had
+ * scanned the image itself.
+ *
+ * A worker that goes away before its BYE is lost with everything it sent, and so is one whose host stops
+ * answering the connection's keepalive probes (KEEPALIVE_IDLE, KEEPALIVE_INTERVAL, KEEPALIVE_COUNT): its directory is removed and the
+ * pages it was given are read again and given to the other workers, so that no page is lost or counted
+ * twice. The producer waits, at the end, until every page has been scanned by a worker that finished; if
+ * the last worker is lost, it waits for another to connect. The producer and the workers should enable the
+ * same scanners, so that OUTDIR has the headers of the feature files the workers send.
+ *
+ * A page that cannot be read again for a worker is tried READ_TRIES times, and then counted as a read
+ * error (unreadable= in the report) instead of being given out forever.
+ *
+ * The wire is TCP, one connection per worker, of frames: a type byte, a 4-byte big-endian length, and the
+ * payload. A worker's NEXT is answered by one PAGES or END. A page is its offset, page size and buffer size
+ * (each big-endian) and the compressed buffer.
+ *
+ * The wire has no encryption, and what it carries is evidence: a producer given only a PORT listens on the
+ * loopback interface, and the producer and its workers must be given the same -S remote_token, which the
+ * worker sends in its HELLO and without which it is given nothing and its output is not taken. Between
+ * machines, the connection should be tunneled (ssh -L, or a VPN), with the producer on its loopback port.
+ * Until its HELLO, a connection may send frames no longer than MAX_HELLO, has HELLO_SECONDS to send it,
+ * and is one of at most MAX_GREETING; the connections past that are closed when they are accepted.
+ */
+
+class remote_workers {
+public:
+    enum frame_t : char {
+        HELLO    = 'H',                 // worker: PROTOCOL, '\n', and the token
+        NEXT     = 'N',                 // worker: 4 bytes, the pages it wants
+        FEATURES = 'F',                 // worker: the recorder, '\n', and whole lines of its feature file
+        CARVE    = 'C',                 // worker: the path under the output directory, '\n', and the file
+        OUTPUT   = 'O',                 // worker: a histogram file's name, '\n', and the file
+        BYE      = 'B',                 // worker: finished
+        INFO     = 'I',                 // producer: 8 bytes of image size, then the image's name
+        PAGES    = 'P',                 // producer: 4 bytes of count, then each page's 4-byte length and the page
+        END      = 'E',                 // producer: no more pages
+        ACK      = 'A',                 // producer: the BYE's output is kept
+    };
+    static inline const std::string PROTOCOL {"bulk_extractor remote 2"};
+    static inline const std::string SCHEME {"remote:"};         // remote:HOST:PORT images
+    static inline const std::string DIR_PREFIX {"remote-"};     // OUTDIR/remote-N/
+    static inline const unsigned PAGES_PER_REQUEST {4};
+    static inline const unsigned MAX_PAGES_PER_REQUEST {16};        // that a producer gives at once
+    static inline const uint32_t MAX_FRAME {1024 * 1024 * 1024};
+    static inline const size_t   MAX_TOKEN {4096};
+    static inline const uint32_t MAX_HELLO = PROTOCOL.size() + 1 + MAX_TOKEN;      // the frames before HELLO
+    static inline const unsigned MAX_GREETING {16};             // connections that have not said HELLO yet
+    static inline const unsigned HELLO_SECONDS {10};            // that a connection has to say it
+    static inline const int      KEEPALIVE_IDLE {60};           // seconds of quiet before a connection is probed
+    static inline const int      KEEPALIVE_INTERVAL {10};       // seconds between probes
+    static inline const int      KEEPALIVE_COUNT {6};           // probes unanswered before the peer is lost
+    static inline const unsigned READ_TRIES {3};                 // of a page that cannot be read again
+
+    /* One end of a connection; send() may be called from several threads, recv() from one */
+    class connection {
+    public:
+        explicit connection(int fd_): fd(fd_) {}
+        ~connection();
+        connection(const connection &)=delete;
+        connection &operator=(const connection &)=delete;
+        /* Throws std::runtime_error if HOST:PORT cannot be reached */
+        static std::shared_ptr<connection> connect(const std::string &hostport);
+        void send(frame_t type, const std::string &payload);   // throws std::runtime_error
+        /* false at the end of the stream; throws on a bad frame, or one longer than max_len */
+        bool recv(frame_t &type, std::string &payload, uint32_t max_len = MAX_FRAME);
+        void shutdown();                                        // wakes a thread blocked in recv()
+        /* recv() throws once seconds from now have passed, however the frames arrive; 0 for none */
+        void set_deadline(unsigned seconds);
+        void keep_alive();                                      // probe the peer while the connection is quiet
+    private:
+        const int fd;
+        std::mutex Msend {};
+        std::chrono::steady_clock::time_point deadline {std::chrono::steady_clock::time_point::max()};
+    };
+
+    struct page {
+        uint64_t offset {0};
+        size_t   pagesize {0};
+        std::vector<uint8_t> buf {};    // the page and its margin
+    };
+    static std::string encode_page(uint64_t offset, size_t pagesize, const uint8_t *buf, size_t bufsize);
+    static void decode_page(const std::string &payload, page &p);    // throws std::runtime_error
+    static std::string encode_pages(const std::vector<std::string> &encoded); // the payload of PAGES
+    static std::vector<page> decode_pages(const std::string &payload);        // throws std::runtime_error
+    /* "HOST:PORT", "[V6]:PORT" or "PORT"; throws std::invalid_argument */
+    static void split_hostport(const std::string &hostport, std::string &host, std::string &port);
+    /* -S remote_token, of the producer and of a worker; before start() or the remote: image is opened */
+    static void set_token(const std::string &token_) { token = token_; }
+    static std::string hello() { return PROTOCOL + "\n" + token; }    // the payload of HELLO
+    /* True if the HELLO is of this protocol and token; the tokens are compared in constant time */
+    static bool hello_valid(const std::string &payload);
+    /* True if a worker's relpath stays under the directory it is written to */
+    static bool safe_relpath(const std::filesystem::path &relpath);
+
+    /* The producer: listens on listen (loopback if it has no HOST) for workers, which read image's pages;
+     * throws std::runtime_error, and if there is no token or it is longer than MAX_TOKEN */
+    static void start(const std::string &listen, const image_process &image, const std::filesystem::path &outdir,
+                      size_t max_queued);
+    static bool enabled() { return running; }
+    static void put(sbuf_t *sbuf);     // takes the depth-0 sbuf for a worker; waits while the queue is full
+    static void finish();              // after the last put(): waits for the workers to scan every page, then stops
+    static void merge(const std::filesystem::path &outdir); // adds the finished workers' output to outdir
+
+    static inline std::atomic<uint64_t> workers {0};        // that said HELLO
+    static inline std::atomic<uint64_t> workers_lost {0};
+    static inline std::atomic<uint64_t> pages_sent {0};
+    static inline std::atomic<uint64_t> pages_resent {0};   // of lost workers, read again
+    static inline std::atomic<uint64_t> pages_unreadable {0}; // that could not be read again
+    static inline std::atomic<uint64_t> page_bytes {0};     // as read
+    static inline std::atomic<uint64_t> wire_bytes {0};     // as sent
+    static inline std::atomic<uint64_t> lines_received {0};
+    static inline std::atomic<uint64_t> waits {0};          // times the reader waited for a worker
+    static std::string xml_attributes();                    // for the <remote_workers> report element
+
+    /* The worker: the connection of the remote: image that is being scanned, or nullptr */
+    static void set_worker(std::shared_ptr<connection> c) { worker_ = std::move(c); }
+    static const std::shared_ptr<connection> &worker() { return worker_; }
+    static std::unique_ptr<feature_sink> make_sink();       // sends the feature lines and carves to the producer
+    /* After the feature stream has stopped: sends the histograms in outdir and BYE, and waits for the ACK */
+    static void finish_worker(const std::filesystem::path &outdir);
+
+private:
+    struct item {                       // a page waiting for a worker
+        sbuf_t  *sbuf {nullptr};        // as read, or nullptr to read it again
+        uint64_t offset {0};
+        size_t   pagesize {0};
+        size_t   bufsize {0};
+        unsigned reads {0};             // times it could not be read again
+    };
+    struct session {
+        std::shared_ptr<connection> conn {};
+        std::thread thread {};
+        std::vector<item> given {};     // the pages given to it, without their sbufs
+        bool greeted {false};
+        bool done {false};
+    };
+    static inline std::atomic<bool> running {false};
+    static inline std::string token {};
+    static inline const image_process *image {nullptr};
+    static inline std::filesystem::path outdir {};
+    static inline size_t max_queued {0};
+    static inline int listen_fd {-1};
+    static inline std::thread acceptor {};
+    static inline std::mutex M {};
+    static inline std::condition_variable changed {};
+    static inline std::deque<item> queue {};
+    static inline std::map<uint64_t, std::unique_ptr<session>> sessions {};
+    static inline std::vector<uint64_t> finished {};        // the sessions whose output is kept
+    static inline uint64_t outstanding {0};                  // pages given to sessions that have not finished
+    static inline bool last_put {false};
+    static inline bool stopping {false};
+    static inline std::shared_ptr<connection> worker_ {};
+    static void accept_loop();
+    static void serve(uint64_t id, session *s);
+    static std::string next_page(session *s, bool wait);    // "" if there are no more
+};
+
+#endif
@@ -10,6 +10,15 @@
  */
 
 #include "config.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "memory_governor.h"
+#include "page_allocator.h"
 #include "sbuf_decompress.h"
 
 #define ZLIB_CONST
@@ -21,6 +30,11 @@
 #endif
 #include <zlib.h>
 
+#if defined(HAVE_LIBDEFLATE) && defined(HAVE_LIBDEFLATE_H)
+#include <libdeflate.h>
+#define USE_LIBDEFLATE
+#endif
+
 std::ostream & operator<<(std::ostream &os, const z_stream &zs)
 {
     os << " zs.next_in=" << static_cast<const void *>(zs.next_in)
@@ -31,60 +45,284 @@ std::ostream & operator<<(std::ostream &os, const z_stream &zs)
 }
 
 
+/*
+ * Most candidates from scan_gzip and scan_zip are not compressed data, and inflate fails within a
+ * few bytes. So each thread keeps one z_stream, which is reset rather than set up and torn down,
+ * and the first PROBE_SIZE bytes are inflated into a scratch buffer of the thread's: the output
+ * sbuf is only allocated (and max_uncompr_size only charged to the memory governor) for a
+ * stream that produces data, and at its final size when that fits in the probe.
+ *
+ * Streams longer than the probe are inflated with libdeflate when it is available (it needs the
+ * whole output buffer, so it is only tried then), falling back to zlib for the truncated streams
+ * that carving finds, where zlib still returns what it could inflate.
+ */
+namespace {
+    const size_t PROBE_SIZE = 64*1024;
 
+    struct inflate_context {
+        z_stream zs {};
+        bool     initialized {false};
+        std::vector<uint8_t> probe = std::vector<uint8_t>(PROBE_SIZE);
+#ifdef USE_LIBDEFLATE
+        struct libdeflate_decompressor *ld {nullptr};
+#endif
+        inflate_context() {}
+        inflate_context(const inflate_context &) = delete;
+        inflate_context &operator=(const inflate_context &) = delete;
+        ~inflate_context() {
+            if (initialized) inflateEnd(&zs);
+#ifdef USE_LIBDEFLATE
+            if (ld) libdeflate_free_decompressor(ld);
+#endif
+        }
+        /* Generic zlib decompresser. Works with all the versions we've seen zlib be used.
+         * If there is a gzip header, "Add 32 to windowBits to enable zlib and gzip decoding with automatic header detection"
+         */
+        void reset(sbuf_decompress::mode_t mode, int &flush) {
+            int window_bits = 0;
+            flush = Z_SYNC_FLUSH;
+            switch (mode) {
+            case sbuf_decompress::mode_t::GZIP: window_bits = 32+MAX_WBITS; break;
+            case sbuf_decompress::mode_t::PDF:  window_bits = MAX_WBITS; flush = Z_FINISH; break;
+            case sbuf_decompress::mode_t::ZIP:  window_bits = -15; break;
+            default:
+                throw std::runtime_error("sbuf_decompress.cpp: invalid mode");
+            }
+            int r = initialized ? inflateReset2(&zs, window_bits) : inflateInit2(&zs, window_bits);
+            if (r != Z_OK) {
+                throw std::runtime_error("sbuf_decompress: inflateInit2 failed");
+            }
+            initialized = true;
+        }
+    };
+    thread_local inflate_context context;
 
-sbuf_t *sbuf_decompress::sbuf_new_decompress(const sbuf_t &sbuf, uint32_t max_uncompr_size, const std::string name,
-                                             sbuf_decompress::mode_t mode, ssize_t header_size)
-{
-    sbuf_t *ret = sbuf_t::sbuf_malloc((sbuf.pos0 - header_size) + name, max_uncompr_size, max_uncompr_size);
-    /* Generic zlib decompresser. Works with all the versions we've seen zlib be used. */
-
-    z_stream zs;
-    memset(&zs,0,sizeof(zs));
-
-    zs.next_in  = static_cast<const Bytef *>(sbuf.get_buf());
-    zs.avail_in = sbuf.bufsize;
-    zs.next_out = static_cast<Bytef *>(ret->malloc_buf());
-    zs.avail_out = max_uncompr_size;
-
-    /* If there is a gzip header, "Add 32 to windowBits to enable zlib and gzip decoding with automatic header detection" */
-    int r = 0;
-    switch (mode) {
-    case mode_t::GZIP:
-        // attempt gzip decoding
-        r = inflateInit2(&zs, 32+MAX_WBITS);
-        if (r!=0){                  // something go wrong. get out of here.
-            throw std::runtime_error("GZIP inflateInit2 failed");
+    /* Reject what cannot be the start of a stream before inflating anything */
+    bool deflate_block_plausible(const uint8_t *p, size_t len) {
+        if (len < 1) return false;
+        const int btype = (p[0] >> 1) & 3;
+        if (btype == 3) return false;                    // reserved block type
+        if (btype == 0) {                                // stored: LEN and NLEN must be complements
+            return len >= 5 && (p[1] ^ p[3]) == 0xff && (p[2] ^ p[4]) == 0xff;
         }
-        r = inflate(&zs,Z_SYNC_FLUSH);
-        inflateEnd(&zs);
-        break;
-    case mode_t::PDF:
-        r = inflateInit(&zs);
-        if (r!=0){                  // something went wrong.
-            throw std::runtime_error("PDF inflateInit failed");
+        if (btype == 2) {                                // dynamic: at most 286 literal and 30 distance codes
+            if (len < 2) return false;
+            const unsigned hlit  = p[0] >> 3;
+            const unsigned hdist = p[1] & 0x1f;
+            return hlit <= 29 && hdist <= 29;
         }
-        r = inflate(&zs, Z_FINISH);
-        inflateEnd(&zs);
-        break;
-    case mode_t::ZIP:
-        r = inflateInit2(&zs,-15);
-        if (r!=0){                  // something went wrong.
-            throw std::runtime_error("ZIP inflateInit failed");
+        return true;
+    }
+
+    bool plausible(const uint8_t *p, size_t len, sbuf_decompress::mode_t mode) {
+        switch (mode) {
+        case sbuf_decompress::mode_t::GZIP:
+            return sbuf_decompress::gzip_plausible(p, len);
+        case sbuf_decompress::mode_t::PDF:              // zlib header: deflate, and the FCHECK bits
+            return len >= 3 && (p[0] & 0x0f) == 8 && (p[0] >> 4) <= 7 && ((p[0] << 8) | p[1]) % 31 == 0
+                && (p[1] & 0x20) == 0 && deflate_block_plausible(p + 2, len - 2);
+        case sbuf_decompress::mode_t::ZIP:
+            return deflate_block_plausible(p, len);
         }
-        r = inflate(&zs,Z_SYNC_FLUSH);
-        inflateEnd(&zs);
-        break;
-    default:
-        throw std::runtime_error("sbuf_decompress.cpp: invalid mode");
+        return false;
+    }
+
+#ifdef USE_LIBDEFLATE
+    /* Inflate all of in into out; returns the bytes written, or 0 if libdeflate could not */
+    size_t libdeflate_inflate(inflate_context &c, sbuf_decompress::mode_t mode,
+                              const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len) {
+        if (c.ld == nullptr) {
+            c.ld = libdeflate_alloc_decompressor();
+            if (c.ld == nullptr) return 0;
+        }
+        size_t in_used = 0, out_used = 0;
+        enum libdeflate_result r = LIBDEFLATE_BAD_DATA;
+        switch (mode) {
+        case sbuf_decompress::mode_t::GZIP:
+            r = libdeflate_gzip_decompress_ex(c.ld, in, in_len, out, out_len, &in_used, &out_used);
+            break;
+        case sbuf_decompress::mode_t::PDF:
+            r = libdeflate_zlib_decompress_ex(c.ld, in, in_len, out, out_len, &in_used, &out_used);
+            break;
+        case sbuf_decompress::mode_t::ZIP:
+            r = libdeflate_deflate_decompress_ex(c.ld, in, in_len, out, out_len, &in_used, &out_used);
+            break;
+        }
+        return r == LIBDEFLATE_SUCCESS ? out_used : 0;
+    }
+#endif
+}
+
+/* RFC 1952: ID1 ID2 CM FLG MTIME(4) XFL OS, then FEXTRA, FNAME, FCOMMENT and FHCRC as FLG has them */
+bool sbuf_decompress::gzip_plausible(const uint8_t *p, size_t len)
+{
+    static const uint32_t latest = static_cast<uint32_t>(time(nullptr)) + GZIP_MTIME_SLACK;
+    const uint8_t FHCRC = 0x02, FEXTRA = 0x04, FNAME = 0x08, FCOMMENT = 0x10, RESERVED = 0xe0;
+
+    if (len < 18) return false;         // the header, a block and the trailer
+    if (p[0]!=0x1f || p[1]!=0x8b || p[2]!=0x08) return false;
+    const uint8_t flg = p[3];
+    if (flg & RESERVED) return false;
+    const uint32_t mtime = p[4] | (p[5] << 8) | (p[6] << 16) | (uint32_t(p[7]) << 24);
+    if (mtime > latest) return false;
+    const uint8_t xfl = p[8];           // 2 for the best compression, 4 for the fastest
+    if (xfl != 0 && xfl != 2 && xfl != 4) return false;
+    const uint8_t os = p[9];
+    if (os > 13 && os != 255) return false;
+
+    size_t pos = 10;
+    if (flg & FEXTRA) {
+        if (pos + 2 > len) return false;
+        pos += 2 + (p[pos] | (p[pos+1] << 8));
+    }
+    for (const uint8_t f : {FNAME, FCOMMENT}) {
+        if ((flg & f) == 0) continue;
+        if (pos >= len) return false;
+        const void *nul = memchr(p + pos, 0, std::min(len - pos, GZIP_MAX_STRING));
+        if (nul == nullptr) return false;
+        pos = static_cast<const uint8_t *>(nul) - p + 1;
     }
+    if (flg & FHCRC) pos += 2;
+    return pos < len && deflate_block_plausible(p + pos, len - pos);
+}
+
+const char *sbuf_decompress::backend_name()
+{
+#ifdef USE_LIBDEFLATE
+    return "libdeflate+zlib";
+#else
+    return "zlib";
+#endif
+}
+
+sbuf_t *sbuf_decompress::sbuf_new_decompress(const sbuf_t &sbuf, uint32_t max_uncompr_size, const std::string name,
+                                             sbuf_decompress::mode_t mode, ssize_t header_size)
+{
+    const uint8_t *in = sbuf.get_buf();
+    const size_t in_len = std::min<size_t>(sbuf.bufsize, UINT_MAX);
+    if (max_uncompr_size == 0 || !plausible(in, in_len, mode)) return nullptr;
+
+    int flush = 0;
+    inflate_context &c = context;
+    c.reset(mode, flush);
+    z_stream &zs = c.zs;
+    zs.next_in   = static_cast<const Bytef *>(in);
+    zs.avail_in  = in_len;
+    zs.next_out  = static_cast<Bytef *>(c.probe.data());
+    zs.avail_out = std::min<size_t>(PROBE_SIZE, max_uncompr_size);
+
     /* Ignore the error code; process data if we got any */
-    deflateEnd(&zs);
-    if (zs.total_out > 0){
-        /* Shrink the allocated region */
-        ret = ret->realloc(zs.total_out);
+    int r = inflate(&zs, flush);
+    const size_t probed = zs.total_out;
+    if (probed == 0) {
+        return nullptr;                      // couldn't decompress
+    }
+    const pos0_t pos0 = (sbuf.pos0 - header_size) + name;
+    if (zs.avail_out > 0 || (r != Z_OK && r != Z_BUF_ERROR) || probed >= max_uncompr_size) {
+        /* the stream ended (or failed) within the probe */
+        memory_governor::wait_for_budget(probed, sbuf.depth() + 1);
+        sbuf_t *ret = sbuf_t::sbuf_malloc(pos0, probed, probed);
+        memcpy(ret->malloc_buf(), c.probe.data(), probed);
         return ret;
     }
-    delete ret;
-    return nullptr;                     // couldn't decompress
+
+    memory_governor::wait_for_budget(max_uncompr_size, sbuf.depth() + 1);
+    sbuf_t *ret = sbuf_t::sbuf_malloc(pos0, max_uncompr_size, max_uncompr_size);
+    uint8_t *out = static_cast<uint8_t *>(ret->malloc_buf());
+    page_allocator::advise(out, max_uncompr_size);
+#ifdef USE_LIBDEFLATE
+    size_t inflated = libdeflate_inflate(c, mode, in, in_len, out, max_uncompr_size);
+    if (inflated > 0) {
+        return ret->realloc(inflated);      // Shrink the allocated region
+    }
+#endif
+    memcpy(out, c.probe.data(), probed);
+    zs.next_out  = static_cast<Bytef *>(out + probed);
+    zs.avail_out = max_uncompr_size - probed;
+    inflate(&zs, flush);
+    /* Shrink the allocated region */
+    return ret->realloc(zs.total_out);
+}
+
+/*
+ * Streaming: the output is cut into children of pagesize bytes plus a margin, each allocated
+ * when the one before it fills. The margin of a child is copied to the start of the next, whose
+ * page it is, so only margin bytes are copied per child and at most two children are held here.
+ */
+uint64_t sbuf_decompress::stream_decompress(const sbuf_t &sbuf, const std::string name, mode_t mode,
+                                            ssize_t header_size, size_t pagesize, size_t margin,
+                                            uint64_t max_uncompr_size, const std::function<void(sbuf_t *)> &emit)
+{
+    const uint8_t *in = sbuf.get_buf();
+    const size_t in_len = std::min<size_t>(sbuf.bufsize, UINT_MAX);
+    if (pagesize == 0 || !plausible(in, in_len, mode)) return 0;
+    if (max_uncompr_size == 0) max_uncompr_size = UINT64_MAX;
+
+    int flush = 0;
+    inflate_context &c = context;
+    c.reset(mode, flush);
+    z_stream &zs = c.zs;
+    zs.next_in   = static_cast<const Bytef *>(in);
+    zs.avail_in  = in_len;
+    zs.next_out  = static_cast<Bytef *>(c.probe.data());
+    zs.avail_out = std::min<uint64_t>(PROBE_SIZE, max_uncompr_size);
+
+    int r = inflate(&zs, flush);
+    const size_t probed = zs.total_out;
+    if (probed == 0) return 0;
+    const pos0_t pos0 = (sbuf.pos0 - header_size) + name;
+    bool more = zs.avail_out == 0 && (r == Z_OK || r == Z_BUF_ERROR) && probed < max_uncompr_size;
+    if (!more) {
+        memory_governor::wait_for_budget(probed, sbuf.depth() + 1);
+        sbuf_t *child = sbuf_t::sbuf_malloc(pos0, probed, probed);
+        memcpy(child->malloc_buf(), c.probe.data(), probed);
+        emit(child);
+        return probed;
+    }
+
+    const size_t window = pagesize + margin;
+    uint64_t start = 0;                 // offset of the current child in the output
+    memory_governor::wait_for_budget(window, sbuf.depth() + 1);
+    sbuf_t *child = sbuf_t::sbuf_malloc(pos0, window, pagesize);
+    uint8_t *out  = static_cast<uint8_t *>(child->malloc_buf());
+    size_t filled = std::min(probed, window);
+    memcpy(out, c.probe.data(), filled);
+    if (filled < probed) {              // a page smaller than the probe: inflate the rest again
+        c.reset(mode, flush);
+        zs.next_in  = static_cast<const Bytef *>(in);
+        zs.avail_in = in_len;
+        filled = 0;
+    }
+    while (more) {
+        zs.next_out  = static_cast<Bytef *>(out + filled);
+        zs.avail_out = std::min<uint64_t>(window - filled, max_uncompr_size - (start + filled));
+        r = inflate(&zs, flush);
+        filled = zs.next_out - out;
+        more = zs.avail_out == 0 && (r == Z_OK || r == Z_BUF_ERROR) && start + filled < max_uncompr_size;
+        if (more) {
+            /* this child is full: start the next at its margin, and hand it over */
+            memory_governor::wait_for_budget(window, sbuf.depth() + 1);
+            sbuf_t *next = sbuf_t::sbuf_malloc(pos0 + (start + pagesize), window, pagesize);
+            uint8_t *next_out = static_cast<uint8_t *>(next->malloc_buf());
+            memcpy(next_out, out + pagesize, margin);
+            emit(child);
+            child  = next;
+            out    = next_out;
+            start += pagesize;
+            filled = margin;
+        }
+    }
+    /* the output ended in this child; what is past its page goes in one more, as its page */
+    uint64_t total = start + filled;
+    if (filled > pagesize) {
+        const size_t tail = filled - pagesize;
+        memory_governor::wait_for_budget(tail, sbuf.depth() + 1);
+        sbuf_t *last = sbuf_t::sbuf_malloc(pos0 + (start + pagesize), tail, tail);
+        memcpy(last->malloc_buf(), out + pagesize, tail);
+        emit(child->realloc(filled));
+        emit(last);
+    } else {
+        emit(child->realloc(filled));
+    }
+    return total;
 }
@@ -8,6 +8,8 @@
 #ifndef SBUF_DECOMPRESS_H
 #define SBUF_DECOMPRESS_H
 
+#include <functional>
+
 #include "be13_api/sbuf.h"
 
 struct sbuf_decompress {
@@ -19,6 +21,15 @@ struct sbuf_decompress {
         return sbuf[offset+0]==0x1f && sbuf[offset+1]==0x8b && sbuf[offset+2]==0x08;
     }
 
+    /* returns true if the gzip member at p, of at most len bytes, has a plausible header: no reserved
+     * flags, a modification time that is not in the future (or none), an XFL and OS that gzip writes,
+     * optional fields that end within len, and a first deflate block that could be decoded.
+     * Most 1f 8b 08 sequences in compressed and random data fail it within the first dozen bytes.
+     */
+    static bool gzip_plausible(const uint8_t *p, size_t len);
+    static inline const uint32_t GZIP_MTIME_SLACK {366*24*3600}; // clocks that are ahead
+    static inline const size_t GZIP_MAX_STRING {4096};           // FNAME and FCOMMENT
+
     enum mode_t {
         GZIP,                           // seen in GZIP files
         PDF,                            // seen in PDF files
@@ -36,6 +47,17 @@ struct sbuf_decompress {
      */
 
     static sbuf_t *sbuf_new_decompress(const sbuf_t &sbuf, uint32_t max_uncompr_size, const std::string name, mode_t mode, ssize_t header_size);
+    /* Decompress as a stream of children, each pagesize bytes plus a margin of the bytes after it,
+     * so that the scanners can start on the output before decompression finishes. The children
+     * are given to emit in order, with the forensic path of their offset in the output, and
+     * belong to it. At most max_uncompr_size bytes are decompressed (0 for no limit).
+     *
+     * @return - the number of bytes decompressed
+     */
+    static uint64_t stream_decompress(const sbuf_t &sbuf, const std::string name, mode_t mode, ssize_t header_size,
+                                      size_t pagesize, size_t margin, uint64_t max_uncompr_size,
+                                      const std::function<void(sbuf_t *)> &emit);
+    static const char *backend_name();  // "zlib", or "libdeflate+zlib"
 };
 
 #endif
@@ -20,6 +20,10 @@
 #define YY_NO_INPUT
 
 #include "config.h"
+
+#include <algorithm>
+#include <cstring>
+
 #include "be13_api/sbuf.h"
 #include "be13_api/scanner_params.h"
 #include "be13_api/scanner_set.h"
@@ -58,10 +62,14 @@ public:
             first = false;
         }
 
-        while ((max_size > 0) && (point < sbuf.bufsize) ){
-            *buf++ = sbuf[point++];
-            max_size--;
-            count++;
+        /* Copy as much of the page as fits in one go, rather than a bounds-checked byte at a time */
+        if (max_size > 0 && point < sbuf.bufsize) {
+            const size_t n = std::min(max_size, sbuf.bufsize - point);
+            memcpy(buf, sbuf.get_buf() + point, n);
+            buf      += n;
+            point    += n;
+            max_size -= n;
+            count    += n;
         }
         /* Provide an extra space at the end, so that regular expressions that specify "/<text>" always find an end */
         if (point==sbuf.bufsize && max_size>0){
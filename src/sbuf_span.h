@@ -0,0 +1,95 @@
+#ifndef SBUF_SPAN_H
+#define SBUF_SPAN_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * sbuf_span:
+ * A range of an sbuf that is bounds-checked once, for the structure parsers. sbuf_t's get16u() and
+ * friends check every access and throw when it is out of range, so a parser that reads a dozen fields
+ * of a header at every candidate offset pays for a dozen checks and an exception path. A span checks
+ * when it is made: if the range does not fit in the sbuf the span is empty and tests false; otherwise
+ * its accessors are plain loads, which the compiler can keep in registers and combine.
+ *
+ * The accessors are named as sbuf_t's and read the byte order of the span's type: sbuf_span_le for the
+ * little-endian structures of disks and Windows, sbuf_span_be for network order. Offsets are relative
+ * to the start of the span and are checked only by assert(); use fits() for the ones a parser computes.
+ */
+
+enum class byte_order { little, big };
+
+template <byte_order ORDER>
+class sbuf_span_t {
+public:
+    sbuf_span_t() {}
+    /* [offset, offset+len) of sbuf, or an empty span if that is not all in the sbuf */
+    sbuf_span_t(const sbuf_t &sbuf, size_t offset, size_t len) {
+        if (offset <= sbuf.bufsize && len <= sbuf.bufsize - offset) {
+            buf_ = sbuf.get_buf() + offset;
+            len_ = len;
+        }
+    }
+
+    explicit operator bool() const { return buf_ != nullptr; }
+    size_t size() const { return len_; }
+    const uint8_t *data() const { return buf_; }
+    bool fits(size_t offset, size_t len) const { return offset <= len_ && len <= len_ - offset; }
+
+    /* [offset, offset+len) of this span, or an empty span */
+    sbuf_span_t sub(size_t offset, size_t len) const {
+        sbuf_span_t s;
+        if (buf_ && fits(offset, len)) {
+            s.buf_ = buf_ + offset;
+            s.len_ = len;
+        }
+        return s;
+    }
+
+    uint8_t  operator[](size_t i) const { return get8u(i); }
+    uint8_t  get8u(size_t i)  const { assert(i < len_); return buf_[i]; }
+    int8_t   get8i(size_t i)  const { return static_cast<int8_t>(get8u(i)); }
+    uint16_t get16u(size_t i) const { return load<uint16_t>(i); }
+    int16_t  get16i(size_t i) const { return static_cast<int16_t>(load<uint16_t>(i)); }
+    uint32_t get32u(size_t i) const { return load<uint32_t>(i); }
+    int32_t  get32i(size_t i) const { return static_cast<int32_t>(load<uint32_t>(i)); }
+    uint64_t get64u(size_t i) const { return load<uint64_t>(i); }
+    int64_t  get64i(size_t i) const { return static_cast<int64_t>(load<uint64_t>(i)); }
+
+    /* true if the len bytes at offset are those of s */
+    bool equals(size_t offset, const void *s, size_t len) const {
+        assert(fits(offset, len));
+        return memcmp(buf_ + offset, s, len) == 0;
+    }
+
+private:
+    const uint8_t *buf_ {nullptr};
+    size_t len_ {0};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    static constexpr byte_order HOST {byte_order::big};
+#else
+    static constexpr byte_order HOST {byte_order::little};
+#endif
+
+    static uint16_t swap(uint16_t v) { return __builtin_bswap16(v); }
+    static uint32_t swap(uint32_t v) { return __builtin_bswap32(v); }
+    static uint64_t swap(uint64_t v) { return __builtin_bswap64(v); }
+
+    template <typename T> T load(size_t i) const {
+        assert(fits(i, sizeof(T)));
+        T v;
+        memcpy(&v, buf_ + i, sizeof(T));  // an unaligned load
+        if constexpr (ORDER != HOST) v = swap(v);
+        return v;
+    }
+};
+
+typedef sbuf_span_t<byte_order::little> sbuf_span_le;
+typedef sbuf_span_t<byte_order::big>    sbuf_span_be;
+
+#endif
@@ -4,13 +4,18 @@
 #ifdef HAVE_LIBLIGHTGREP
 
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <string>
 
 #include "be13_api/scanner_params.h"
-#include "histogram.h"
+#include "be13_api/scanner_set.h"
+
 #include "scan_ccns2.h"
+#include "heavy_hitters.h"
 #include "pattern_scanner.h"
 #include "pattern_scanner_utils.h"
+#include "recorder_handle.h"
 
 namespace accts {
   const char* const DefaultEncodingsCStrings[] = {"UTF-8", "UTF-16LE"};
@@ -34,8 +39,9 @@ namespace accts {
   bool is_pdf_box(const sbuf_t& sbuf, size_t pos) {
     const char box[] = "Box";
     const size_t c0 = pos >= 10 ? pos - 10 : 10 - pos - 1;
-    const uint8_t* i = search(sbuf.buf + c0, sbuf.buf + pos, box, box + strlen(box));
-    return i != sbuf.buf + pos;
+    const uint8_t* buf = sbuf.get_buf();
+    const uint8_t* i = search(buf + c0, buf + pos, box, box + strlen(box));
+    return i != buf + pos;
 /*
     return i != sbuf.buf + pos && (
       (i + 2 < sbuf.buf + pos && *(i+1) == ' ' && *(i+2) == '[')
@@ -212,28 +218,26 @@ namespace accts {
   };
 
   void Scanner::startup(const scanner_params& sp) {
-      sp.check_version();
-
-    sp.info->name            = "accts_lg";
+    sp.info->set_name("accts_lg");
     sp.info->author          = "Simson L. Garfinkel, modified by Tim Walsh";
-    sp.info->description     = "scans for CCNs, track 2, PII (including SSN and Canadian SIN), and phone #s";
-    sp.info->scanner_version = "1.0";
+    sp.info->description     = "scans for CCNs, track 2, PII (including SSN and Canadian SIN), and phone #s (lightgrep)";
+    sp.info->scanner_version = "1.1";
+    sp.info->scanner_flags.default_enabled = false; // duplicates accts
 
     // define the feature files this scanner creates
-    sp.info->feature_names.insert("ccn");
-    sp.info->feature_names.insert("pii");  // personally identifiable information
-    sp.info->feature_names.insert("sin");  // canadian social insurance number
-    sp.info->feature_names.insert("ccn_track2");
-    sp.info->feature_names.insert("telephone");
-    sp.info->histogram_defs.insert(histogram_def("ccn", "", "histogram"));
-    sp.info->histogram_defs.insert(histogram_def("ccn_track2", "", "histogram"));
+    sp.info->feature_defs.push_back( recorder_handle::make_def("ccn"));
+    sp.info->feature_defs.push_back( recorder_handle::make_def("pii"));  // personally identifiable information
+    sp.info->feature_defs.push_back( recorder_handle::make_def("sin"));  // canadian social insurance number
+    sp.info->feature_defs.push_back( recorder_handle::make_def("ccn_track2"));
+    sp.info->feature_defs.push_back( recorder_handle::make_def("telephone"));
 
     // define the histograms to make
-    sp.info->histogram_defs.insert(
-      histogram_def("telephone", "", "histogram", HistogramMaker::FLAG_NUMERIC)
-    );
-
-    scan_ccns2_debug = sp.info->config->debug;           // get debug value
+    histogram_def::flags_t flag_numeric;
+    flag_numeric.numeric = true;
+    histogram_def::flags_t nf;
+    heavy_hitters::add_def(sp, histogram_def("ccn",        "ccn",        "", "", "histogram", flag_numeric));
+    heavy_hitters::add_def(sp, histogram_def("ccn_track2", "ccn_track2", "", "", "histogram", nf));
+    heavy_hitters::add_def(sp, histogram_def("telephone",  "telephone",  "", "", "histogram", flag_numeric));
   }
 
   void Scanner::init(const scanner_params& sp) {
@@ -591,29 +595,29 @@ namespace accts {
   }
 
   void Scanner::initScan(const scanner_params& sp) {
-    CCN_Recorder = sp.fs.named_feature_recorder("ccn");
-    CCN_Track2_Recorder = sp.fs.named_feature_recorder("ccn_track2");
-    Telephone_Recorder = sp.fs.named_feature_recorder("telephone");
-    Alert_Recorder = sp.fs.get_alert_recorder();
-    PII_Recorder = sp.fs.named_feature_recorder("pii");
-    SIN_Recorder = sp.fs.named_feature_recorder("sin");
+    CCN_Recorder = &sp.named_feature_recorder("ccn");
+    CCN_Track2_Recorder = &sp.named_feature_recorder("ccn_track2");
+    Telephone_Recorder = &sp.named_feature_recorder("telephone");
+    Alert_Recorder = &sp.named_feature_recorder(feature_recorder_set::ALERT_RECORDER_NAME);
+    PII_Recorder = &sp.named_feature_recorder("pii");
+    SIN_Recorder = &sp.named_feature_recorder("sin");
   }
 
   void Scanner::ccnHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     const size_t pos = hit.Start + 1;
-    const size_t len = hit.End - (*(sp.sbuf.buf+hit.End-2) == '.' ? 2 : 1) - pos;
+    const size_t len = hit.End - (*(sp.sbuf->get_buf()+hit.End-2) == '.' ? 2 : 1) - pos;
 
-    if (valid_ccn(reinterpret_cast<const char*>(sp.sbuf.buf)+pos, len)) {
-      CCN_Recorder->write_buf(sp.sbuf, pos, len);
+    if (valid_ccn(reinterpret_cast<const char*>(sp.sbuf->get_buf())+pos, len)) {
+      CCN_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
   void Scanner::ccnUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    const size_t pos = hit.Start + (*(sp.sbuf.buf+hit.Start+1) == '\0' ? 2 : 1);    const size_t len = hit.End - pos;
+    const size_t pos = hit.Start + (*(sp.sbuf->get_buf()+hit.Start+1) == '\0' ? 2 : 1);    const size_t len = hit.End - pos;
 
-    const string ascii(low_utf16le_to_ascii(sp.sbuf.buf+pos, len));
+    const string ascii(low_utf16le_to_ascii(sp.sbuf->get_buf()+pos, len));
     if (valid_ccn(ascii.c_str(), ascii.size())) {
-      CCN_Recorder->write_buf(sp.sbuf, pos, len);
+      CCN_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
@@ -621,121 +625,121 @@ namespace accts {
     const size_t pos = hit.Start + 1;
     const size_t len = hit.End - pos;
 
-    if (valid_ccn(reinterpret_cast<const char*>(sp.sbuf.buf)+pos, len)) {
-      CCN_Recorder->write_buf(sp.sbuf, pos, len);
+    if (valid_ccn(reinterpret_cast<const char*>(sp.sbuf->get_buf())+pos, len)) {
+      CCN_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
   void Scanner::ccnTrack2UTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    const size_t pos = hit.Start + (*(sp.sbuf.buf+hit.Start+1) == '\0' ? 2 : 1);
+    const size_t pos = hit.Start + (*(sp.sbuf->get_buf()+hit.Start+1) == '\0' ? 2 : 1);
     const size_t len = hit.End - pos;
 
-    const string ascii(low_utf16le_to_ascii(sp.sbuf.buf+pos, len));
+    const string ascii(low_utf16le_to_ascii(sp.sbuf->get_buf()+pos, len));
     if (valid_ccn(ascii.c_str(), ascii.size())) {
-      CCN_Recorder->write_buf(sp.sbuf, pos, len);
+      CCN_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
   void Scanner::telephoneHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    Telephone_Recorder->write_buf(sp.sbuf, hit.Start+1, hit.End-hit.Start-1);
+    Telephone_Recorder->write_buf(*sp.sbuf, hit.Start+1, hit.End-hit.Start-1);
   }
 
   void Scanner::telephoneUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    const size_t start = hit.Start + (*(sp.sbuf.buf + hit.Start + 1) == '\0' ? 2 : 1);
+    const size_t start = hit.Start + (*(sp.sbuf->get_buf() + hit.Start + 1) == '\0' ? 2 : 1);
     const size_t len = hit.End - start;
 
-    Telephone_Recorder->write_buf(sp.sbuf, start, len);
+    Telephone_Recorder->write_buf(*sp.sbuf, start, len);
   }
 
   void Scanner::telephoneTrailingCtxHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     Telephone_Recorder->write_buf(
-      sp.sbuf,
+      *sp.sbuf,
       hit.Start+1,
-      hit.End - (*(sp.sbuf.buf+hit.End-2) == '.' ? 2 : 1) - (hit.Start+1)
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-2) == '.' ? 2 : 1) - (hit.Start+1)
     );
   }
 
   void Scanner::telephoneTrailingCtxUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     Telephone_Recorder->write_buf(
-      sp.sbuf,
+      *sp.sbuf,
       hit.Start+1,
-      hit.End - (*(sp.sbuf.buf+hit.End-3) == '.' ? 3 : 1) -(hit.Start+1)
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-3) == '.' ? 3 : 1) -(hit.Start+1)
     );
   }
 
   void Scanner::validatedTelephoneHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     const size_t pos = hit.Start + 1;
-    const size_t len = hit.End - (*(sp.sbuf.buf+hit.End-2) == '.' ? 2 : 1) - pos;
-    if (valid_phone(sp.sbuf, pos, len)){
-      if (!is_pdf_box(sp.sbuf, pos)) {
-        Telephone_Recorder->write_buf(sp.sbuf, pos, len);
+    const size_t len = hit.End - (*(sp.sbuf->get_buf()+hit.End-2) == '.' ? 2 : 1) - pos;
+    if (valid_phone(*sp.sbuf, pos, len)){
+      if (!is_pdf_box(*sp.sbuf, pos)) {
+        Telephone_Recorder->write_buf(*sp.sbuf, pos, len);
       }
     }
   }
 
   void Scanner::validatedTelephoneUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     const size_t pos = hit.Start + 1;
-    const size_t len = hit.End - (*(sp.sbuf.buf+hit.End-2) == '.' ? 2 : 1) - pos;
-    if (valid_phone_utf16le(sp.sbuf, pos, len)){
-      Telephone_Recorder->write_buf(sp.sbuf, pos, len);
+    const size_t len = hit.End - (*(sp.sbuf->get_buf()+hit.End-2) == '.' ? 2 : 1) - pos;
+    if (valid_phone_utf16le(*sp.sbuf, pos, len)){
+      Telephone_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
   void Scanner::bitlockerHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    Alert_Recorder->write(sp.sbuf.pos0 + hit.Start + 1, reinterpret_cast<const char*>(sp.sbuf.buf) + 1, "Possible BitLocker Recovery Key (ASCII).");
+    Alert_Recorder->write(sp.sbuf->pos0 + hit.Start + 1, reinterpret_cast<const char*>(sp.sbuf->get_buf()) + 1, "Possible BitLocker Recovery Key (ASCII).");
   }
 
   void Scanner::bitlockerUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    const size_t pos = hit.Start + (*(sp.sbuf.buf + hit.Start + 1) == '\0' ? 2 : 1);
+    const size_t pos = hit.Start + (*(sp.sbuf->get_buf() + hit.Start + 1) == '\0' ? 2 : 1);
     const size_t len = (hit.End - 1) - pos;
 
-    Alert_Recorder->write(sp.sbuf.pos0 + pos, low_utf16le_to_ascii(sp.sbuf.buf + pos, len), "Possible BitLocker Recovery Key (UTF-16).");
+    Alert_Recorder->write(sp.sbuf->pos0 + pos, low_utf16le_to_ascii(sp.sbuf->get_buf() + pos, len), "Possible BitLocker Recovery Key (UTF-16).");
   }
 
   void Scanner::piiHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     PII_Recorder->write_buf(
-      sp.sbuf, hit.Start,
-      hit.End - (*(sp.sbuf.buf+hit.End-2) == '.' ? 2 : 1) - hit.Start
+      *sp.sbuf, hit.Start,
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-2) == '.' ? 2 : 1) - hit.Start
     );
   }
 
   void Scanner::piiUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     PII_Recorder->write_buf(
-      sp.sbuf, hit.Start,
-      hit.End - (*(sp.sbuf.buf+hit.End-3) == '.' ? 3 : 1) - hit.Start
+      *sp.sbuf, hit.Start,
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-3) == '.' ? 3 : 1) - hit.Start
     );
   }
 
   void Scanner::sinHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     SIN_Recorder->write_buf(
-      sp.sbuf, hit.Start,
-      hit.End - (*(sp.sbuf.buf+hit.End-2) == '.' ? 2 : 1) - hit.Start
+      *sp.sbuf, hit.Start,
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-2) == '.' ? 2 : 1) - hit.Start
     );
   }
 
   void Scanner::sinUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     SIN_Recorder->write_buf(
-      sp.sbuf, hit.Start,
-      hit.End - (*(sp.sbuf.buf+hit.End-3) == '.' ? 3 : 1) - hit.Start
+      *sp.sbuf, hit.Start,
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-3) == '.' ? 3 : 1) - hit.Start
     );
   }
 
   void Scanner::sinHitHandler2(const LG_SearchHit& hit, const scanner_params& sp) {
     SIN_Recorder->write_buf(
-      sp.sbuf, hit.Start+1,
-      hit.End - (*(sp.sbuf.buf+hit.End-2) == '.' ? 2 : 1) - hit.Start
+      *sp.sbuf, hit.Start+1,
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-2) == '.' ? 2 : 1) - hit.Start
     );
   }
 
   void Scanner::sinUTF16LEHitHandler2(const LG_SearchHit& hit, const scanner_params& sp) {
     SIN_Recorder->write_buf(
-      sp.sbuf, hit.Start+1,
-      hit.End - (*(sp.sbuf.buf+hit.End-3) == '.' ? 3 : 1) - hit.Start
+      *sp.sbuf, hit.Start+1,
+      hit.End - (*(sp.sbuf->get_buf()+hit.End-3) == '.' ? 3 : 1) - hit.Start
     );
   }
 
   void Scanner::dateHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    PII_Recorder->write_buf(sp.sbuf, hit.Start, hit.End - hit.Start);
+    PII_Recorder->write_buf(*sp.sbuf, hit.Start, hit.End - hit.Start);
   }
 
   Scanner TheScanner;
@@ -743,7 +747,7 @@ namespace accts {
 
 extern "C"
 void scan_accts_lg(struct scanner_params &sp) {
-  scan_lg(accts::TheScanner, sp, rcb);
+  scan_lg(accts::TheScanner, sp);
 }
 
 #endif // HAVE_LIBLIGHTGREP
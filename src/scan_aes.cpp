@@ -32,6 +32,14 @@
 #include <string.h>
 #include <inttypes.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define AES_PREFILTER_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AES_PREFILTER_NEON
+#endif
+
 #include "be13_api/scanner_params.h"
 #include "be13_api/scanner_set.h"
 
@@ -56,150 +64,16 @@ static const size_t AES256_KEY_SCHEDULE_SIZE =      240; // Size of a 128-bit AE
 //
 // Returns TRUE if 'in' is a valid 128-bit AES key schedule, otherwise false
 
+#include "candidate_offload.h"
+#include "cpu_dispatch.h"
+#include "recorder_handle.h"
 #include "scan_aes.h"
+#include "scanner_tables.h"
+#include "scanner_tiles.h"
 
-/* 8 bit x 8 bit group multiplication.
- */
-inline uint8_t gmul(uint8_t a, uint8_t b)
-{
-    uint8_t p = 0;
-
-    for(uint8_t counter = 0; counter < 8; counter++) {
-	if((b & 1) == 1) p ^= a;
-	uint8_t hi_bit_set = (a & 0x80);
-	a <<= 1;
-	if(hi_bit_set == 0x80) a ^= 0x1b;
-	b >>= 1;
-    }
-    return p;
-}
-
-/* The rcon function.
- * This function is now solely used to create the rcon table
- */
-uint8_t rcon_function(uint8_t in)
-{
-    uint8_t c=1;
-
-    if(in == 0) return 0;
-    while(in != 1) {
-	c = gmul(c,2);
-	in--;
-    }
-    return c;
-}
-
-uint8_t rcon[256];
-void rcon_setup()
-{
-    for(int i=0;i<256;i++){
-	rcon[i] = rcon_function(i);
-    }
-}
-
-
-// Log table using 0xe5 (229) as the generator
-static constexpr uint8_t ltable[256] = {
-    0x00, 0xff, 0xc8, 0x08, 0x91, 0x10, 0xd0, 0x36,
-    0x5a, 0x3e, 0xd8, 0x43, 0x99, 0x77, 0xfe, 0x18,
-    0x23, 0x20, 0x07, 0x70, 0xa1, 0x6c, 0x0c, 0x7f,
-    0x62, 0x8b, 0x40, 0x46, 0xc7, 0x4b, 0xe0, 0x0e,
-    0xeb, 0x16, 0xe8, 0xad, 0xcf, 0xcd, 0x39, 0x53,
-    0x6a, 0x27, 0x35, 0x93, 0xd4, 0x4e, 0x48, 0xc3,
-    0x2b, 0x79, 0x54, 0x28, 0x09, 0x78, 0x0f, 0x21,
-    0x90, 0x87, 0x14, 0x2a, 0xa9, 0x9c, 0xd6, 0x74,
-    0xb4, 0x7c, 0xde, 0xed, 0xb1, 0x86, 0x76, 0xa4,
-    0x98, 0xe2, 0x96, 0x8f, 0x02, 0x32, 0x1c, 0xc1,
-    0x33, 0xee, 0xef, 0x81, 0xfd, 0x30, 0x5c, 0x13,
-    0x9d, 0x29, 0x17, 0xc4, 0x11, 0x44, 0x8c, 0x80,
-    0xf3, 0x73, 0x42, 0x1e, 0x1d, 0xb5, 0xf0, 0x12,
-    0xd1, 0x5b, 0x41, 0xa2, 0xd7, 0x2c, 0xe9, 0xd5,
-    0x59, 0xcb, 0x50, 0xa8, 0xdc, 0xfc, 0xf2, 0x56,
-    0x72, 0xa6, 0x65, 0x2f, 0x9f, 0x9b, 0x3d, 0xba,
-    0x7d, 0xc2, 0x45, 0x82, 0xa7, 0x57, 0xb6, 0xa3,
-    0x7a, 0x75, 0x4f, 0xae, 0x3f, 0x37, 0x6d, 0x47,
-    0x61, 0xbe, 0xab, 0xd3, 0x5f, 0xb0, 0x58, 0xaf,
-    0xca, 0x5e, 0xfa, 0x85, 0xe4, 0x4d, 0x8a, 0x05,
-    0xfb, 0x60, 0xb7, 0x7b, 0xb8, 0x26, 0x4a, 0x67,
-    0xc6, 0x1a, 0xf8, 0x69, 0x25, 0xb3, 0xdb, 0xbd,
-    0x66, 0xdd, 0xf1, 0xd2, 0xdf, 0x03, 0x8d, 0x34,
-    0xd9, 0x92, 0x0d, 0x63, 0x55, 0xaa, 0x49, 0xec,
-    0xbc, 0x95, 0x3c, 0x84, 0x0b, 0xf5, 0xe6, 0xe7,
-    0xe5, 0xac, 0x7e, 0x6e, 0xb9, 0xf9, 0xda, 0x8e,
-    0x9a, 0xc9, 0x24, 0xe1, 0x0a, 0x15, 0x6b, 0x3a,
-    0xa0, 0x51, 0xf4, 0xea, 0xb2, 0x97, 0x9e, 0x5d,
-    0x22, 0x88, 0x94, 0xce, 0x19, 0x01, 0x71, 0x4c,
-    0xa5, 0xe3, 0xc5, 0x31, 0xbb, 0xcc, 0x1f, 0x2d,
-    0x3b, 0x52, 0x6f, 0xf6, 0x2e, 0x89, 0xf7, 0xc0,
-    0x68, 0x1b, 0x64, 0x04, 0x06, 0xbf, 0x83, 0x38 };
-
-// Anti-log table:
-static constexpr uint8_t atable[256] = {
-    0x01, 0xe5, 0x4c, 0xb5, 0xfb, 0x9f, 0xfc, 0x12,
-    0x03, 0x34, 0xd4, 0xc4, 0x16, 0xba, 0x1f, 0x36,
-    0x05, 0x5c, 0x67, 0x57, 0x3a, 0xd5, 0x21, 0x5a,
-    0x0f, 0xe4, 0xa9, 0xf9, 0x4e, 0x64, 0x63, 0xee,
-    0x11, 0x37, 0xe0, 0x10, 0xd2, 0xac, 0xa5, 0x29,
-    0x33, 0x59, 0x3b, 0x30, 0x6d, 0xef, 0xf4, 0x7b,
-    0x55, 0xeb, 0x4d, 0x50, 0xb7, 0x2a, 0x07, 0x8d,
-    0xff, 0x26, 0xd7, 0xf0, 0xc2, 0x7e, 0x09, 0x8c,
-    0x1a, 0x6a, 0x62, 0x0b, 0x5d, 0x82, 0x1b, 0x8f,
-    0x2e, 0xbe, 0xa6, 0x1d, 0xe7, 0x9d, 0x2d, 0x8a,
-    0x72, 0xd9, 0xf1, 0x27, 0x32, 0xbc, 0x77, 0x85,
-    0x96, 0x70, 0x08, 0x69, 0x56, 0xdf, 0x99, 0x94,
-    0xa1, 0x90, 0x18, 0xbb, 0xfa, 0x7a, 0xb0, 0xa7,
-    0xf8, 0xab, 0x28, 0xd6, 0x15, 0x8e, 0xcb, 0xf2,
-    0x13, 0xe6, 0x78, 0x61, 0x3f, 0x89, 0x46, 0x0d,
-    0x35, 0x31, 0x88, 0xa3, 0x41, 0x80, 0xca, 0x17,
-    0x5f, 0x53, 0x83, 0xfe, 0xc3, 0x9b, 0x45, 0x39,
-    0xe1, 0xf5, 0x9e, 0x19, 0x5e, 0xb6, 0xcf, 0x4b,
-    0x38, 0x04, 0xb9, 0x2b, 0xe2, 0xc1, 0x4a, 0xdd,
-    0x48, 0x0c, 0xd0, 0x7d, 0x3d, 0x58, 0xde, 0x7c,
-    0xd8, 0x14, 0x6b, 0x87, 0x47, 0xe8, 0x79, 0x84,
-    0x73, 0x3c, 0xbd, 0x92, 0xc9, 0x23, 0x8b, 0x97,
-    0x95, 0x44, 0xdc, 0xad, 0x40, 0x65, 0x86, 0xa2,
-    0xa4, 0xcc, 0x7f, 0xec, 0xc0, 0xaf, 0x91, 0xfd,
-    0xf7, 0x4f, 0x81, 0x2f, 0x5b, 0xea, 0xa8, 0x1c,
-    0x02, 0xd1, 0x98, 0x71, 0xed, 0x25, 0xe3, 0x24,
-    0x06, 0x68, 0xb3, 0x93, 0x2c, 0x6f, 0x3e, 0x6c,
-    0x0a, 0xb8, 0xce, 0xae, 0x74, 0xb1, 0x42, 0xb4,
-    0x1e, 0xd3, 0x49, 0xe9, 0x9c, 0xc8, 0xc6, 0xc7,
-    0x22, 0x6e, 0xdb, 0x20, 0xbf, 0x43, 0x51, 0x52,
-    0x66, 0xb2, 0x76, 0x60, 0xda, 0xc5, 0xf3, 0xf6,
-    0xaa, 0xcd, 0x9a, 0xa0, 0x75, 0x54, 0x0e, 0x01 };
-
-
-inline uint8_t gmul_inverse(uint8_t in)
-{
-    if(in == 0)     return 0;    // 0 is self inverting
-    return atable[(255 - ltable[in])];
-}
-
-
-// sbox function is now used only to create the sbox table
-// Previously this was inlined, but now we just use the precomputed sbox function sbox[i]
-uint8_t sbox_function(uint8_t in)
-{
-    uint8_t c, s, x;
-    s = x = gmul_inverse(in);
-    for(c = 0; c < 4; c++)   {
-        // One bit circular rotate to the left
-        s = (s << 1) | (s >> 7);
-        // xor with x
-        x ^= s;
-    }
-    x ^= 99; // 0x63
-    return x;
-}
-
-/* Precompute the sbox function */
-uint8_t sbox[256];
-void sbox_setup()
-{
-    for(int i=0;i<256;i++){
-	sbox[i] = sbox_function(i);
-    }
-}
+/* The S-box and rcon tables are generated at compile time (scanner_tables.h) */
+static constexpr const auto &sbox = scanner_tables::aes_sbox;
+static constexpr const auto &rcon = scanner_tables::aes_rcon;
 
 
 // This is the core key expansion, which, given a 4-byte value,
@@ -344,6 +218,272 @@ bool valid_aes256_schedule(const uint8_t * in)
     return true;
 }
 
+/*
+ * Prefilter.
+ * Every key schedule has words that are the XOR of two earlier words, with no S-box:
+ *   AES-128: w5 = w1 ^ w4     AES-192: w7 = w1 ^ w6     AES-256: w9 = w1 ^ w8
+ * so for a schedule at p, in[4..7] ^ in[b..b+3] ^ in[c..c+3] is zero, with (b,c) (16,20), (24,28) or (32,36).
+ * Almost no other offsets pass, so the kernels compute this XOR for many offsets at once (one offset per
+ * byte lane), find the lanes that are zero, and keep the offsets whose four consecutive lanes are zero.
+ * Only those are given to the validators.
+ */
+static const int AES_RELATION[3][2] = {{16, 20}, {24, 28}, {32, 36}};
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Given a mask with bit i set if lane i is zero, the offsets whose lanes i..i+3 are zero */
+static inline uint64_t four_zero_lanes(uint64_t m)
+{
+    return m & (m >> 1) & (m >> 2) & (m >> 3);
+}
+
+uint32_t aes_prefilter_scalar(const uint8_t *p, unsigned sizes)
+{
+    uint32_t ret = 0;
+    for (size_t i = 0; i < AES_PREFILTER_OFFSETS; i++) {
+        const uint32_t w1 = load32(p + i + 4);
+        for (int r = 0; r < 3; r++) {
+            if ((sizes & (1U << r)) && (w1 ^ load32(p + i + AES_RELATION[r][0])) == load32(p + i + AES_RELATION[r][1])) {
+                ret |= 1U << i;
+                break;
+            }
+        }
+    }
+    return ret;
+}
+
+#ifdef AES_PREFILTER_X86
+static inline uint64_t zero_lanes_sse2(const uint8_t *q, int b, int c)
+{
+    const __m128i v = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(q + 4)),
+                                                  _mm_loadu_si128(reinterpret_cast<const __m128i *>(q + b))),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(q + c)));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())));
+}
+
+static uint32_t aes_prefilter_sse2(const uint8_t *p, unsigned sizes)
+{
+    uint32_t ret = 0;
+    for (int r = 0; r < 3; r++) {
+        if ((sizes & (1U << r)) == 0) continue;
+        const int b = AES_RELATION[r][0], c = AES_RELATION[r][1];
+        const uint64_t m = zero_lanes_sse2(p, b, c) | (zero_lanes_sse2(p + 16, b, c) << 16)
+            | (zero_lanes_sse2(p + 32, b, c) << 32);
+        ret |= static_cast<uint32_t>(four_zero_lanes(m));
+    }
+    return ret;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t zero_lanes_avx2(const uint8_t *q, int b, int c)
+{
+    const __m256i v = _mm256_xor_si256(_mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(q + 4)),
+                                                        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q + b))),
+                                       _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q + c)));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+}
+
+__attribute__((target("avx2")))
+static uint32_t aes_prefilter_avx2(const uint8_t *p, unsigned sizes)
+{
+    uint32_t ret = 0;
+    for (int r = 0; r < 3; r++) {
+        if ((sizes & (1U << r)) == 0) continue;
+        const int b = AES_RELATION[r][0], c = AES_RELATION[r][1];
+        const uint64_t m = zero_lanes_avx2(p, b, c) | (zero_lanes_avx2(p + 32, b, c) << 32);
+        ret |= static_cast<uint32_t>(four_zero_lanes(m));
+    }
+    return ret;
+}
+#endif
+
+#ifdef AES_PREFILTER_NEON
+static inline uint64_t zero_lanes_neon(const uint8_t *q, int b, int c)
+{
+    static const uint8_t lane_bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t v  = veorq_u8(veorq_u8(vld1q_u8(q + 4), vld1q_u8(q + b)), vld1q_u8(q + c));
+    const uint8x16_t eq = vandq_u8(vceqq_u8(v, vdupq_n_u8(0)), vld1q_u8(lane_bits));
+    return vaddv_u8(vget_low_u8(eq)) | (static_cast<uint64_t>(vaddv_u8(vget_high_u8(eq))) << 8);
+}
+
+static uint32_t aes_prefilter_neon(const uint8_t *p, unsigned sizes)
+{
+    uint32_t ret = 0;
+    for (int r = 0; r < 3; r++) {
+        if ((sizes & (1U << r)) == 0) continue;
+        const int b = AES_RELATION[r][0], c = AES_RELATION[r][1];
+        const uint64_t m = zero_lanes_neon(p, b, c) | (zero_lanes_neon(p + 16, b, c) << 16)
+            | (zero_lanes_neon(p + 32, b, c) << 32);
+        ret |= static_cast<uint32_t>(four_zero_lanes(m));
+    }
+    return ret;
+}
+#endif
+
+/* AVX-512 is not used: 32 offsets per call are already cheap next to the validators, and the wider
+ * registers lower the clock of the other scanners' cores on many CPUs.
+ */
+static cpu_dispatch::table<uint32_t (*)(const uint8_t *p, unsigned sizes)> prefilter_kernels("aes_prefilter", {
+#ifdef AES_PREFILTER_X86
+    {"avx2", cpu_dispatch::AVX2, aes_prefilter_avx2},
+    {"sse2", cpu_dispatch::SSE2, aes_prefilter_sse2},
+#elif defined(AES_PREFILTER_NEON)
+    {"neon", cpu_dispatch::NEON, aes_prefilter_neon},
+#endif
+    {"scalar", 0, aes_prefilter_scalar},
+});
+
+uint32_t aes_prefilter(const uint8_t *p, unsigned sizes)
+{
+    return prefilter_kernels.fn()(p, sizes);
+}
+
+const char *aes_prefilter_name()
+{
+    return prefilter_kernels.chosen_name();
+}
+
+/*
+ * Hardware key expansion.
+ * The candidates that pass the prefilter are verified by expanding their first key with the CPU's AES
+ * instructions and comparing each round key with the buffer, 16 bytes at a time:
+ *  - x86: AESKEYGENASSIST, when the CPU has AES-NI (checked at startup)
+ *  - ARMv8: AESE with a zero round key is SubBytes(ShiftRows()), which is SubWord() when all four
+ *    columns hold the same word. Used when built with the crypto extensions (__ARM_FEATURE_CRYPTO).
+ * AES-192 round keys do not fall on 16-byte boundaries, so it is always verified in software.
+ */
+#ifdef AES_PREFILTER_X86
+__attribute__((target("aes")))
+static inline bool round_key_matches(__m128i key, const uint8_t *in)
+{
+    const __m128i mem = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(key, mem)) == 0xffff;
+}
+
+/* Each word of the result is the XOR of the words of k up to it */
+__attribute__((target("aes")))
+static inline __m128i prefix_xor(__m128i k)
+{
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    return _mm_xor_si128(k, _mm_slli_si128(k, 4));
+}
+
+template<int RCON> __attribute__((target("aes")))
+static inline __m128i next_key128(__m128i k)
+{
+    return _mm_xor_si128(prefix_xor(k), _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k, RCON), 0xff));
+}
+
+__attribute__((target("aes")))
+static bool valid_aes128_schedule_aesni(const uint8_t *in)
+{
+    __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    k = next_key128<0x01>(k); if (!round_key_matches(k, in +  16)) return false;
+    k = next_key128<0x02>(k); if (!round_key_matches(k, in +  32)) return false;
+    k = next_key128<0x04>(k); if (!round_key_matches(k, in +  48)) return false;
+    k = next_key128<0x08>(k); if (!round_key_matches(k, in +  64)) return false;
+    k = next_key128<0x10>(k); if (!round_key_matches(k, in +  80)) return false;
+    k = next_key128<0x20>(k); if (!round_key_matches(k, in +  96)) return false;
+    k = next_key128<0x40>(k); if (!round_key_matches(k, in + 112)) return false;
+    k = next_key128<0x80>(k); if (!round_key_matches(k, in + 128)) return false;
+    k = next_key128<0x1b>(k); if (!round_key_matches(k, in + 144)) return false;
+    k = next_key128<0x36>(k); return round_key_matches(k, in + 160);
+}
+
+/* AES-256: the even round keys use RotWord, SubWord and rcon of the previous odd key; the odd ones only SubWord */
+template<int RCON> __attribute__((target("aes")))
+static inline bool next_keys256(__m128i &even, __m128i &odd, const uint8_t *in, bool last)
+{
+    even = _mm_xor_si128(prefix_xor(even), _mm_shuffle_epi32(_mm_aeskeygenassist_si128(odd, RCON), 0xff));
+    if (!round_key_matches(even, in)) return false;
+    if (last) return true;
+    odd = _mm_xor_si128(prefix_xor(odd), _mm_shuffle_epi32(_mm_aeskeygenassist_si128(even, 0), 0xaa));
+    return round_key_matches(odd, in + 16);
+}
+
+__attribute__((target("aes")))
+static bool valid_aes256_schedule_aesni(const uint8_t *in)
+{
+    __m128i even = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    __m128i odd  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16));
+    return next_keys256<0x01>(even, odd, in +  32, false)
+        && next_keys256<0x02>(even, odd, in +  64, false)
+        && next_keys256<0x04>(even, odd, in +  96, false)
+        && next_keys256<0x08>(even, odd, in + 128, false)
+        && next_keys256<0x10>(even, odd, in + 160, false)
+        && next_keys256<0x20>(even, odd, in + 192, false)
+        && next_keys256<0x40>(even, odd, in + 224, true);
+}
+#endif
+
+#if defined(AES_PREFILTER_NEON) && defined(__ARM_FEATURE_CRYPTO)
+#define AES_EXPANSION_ARM
+static inline uint32_t sub_word_arm(uint32_t w)
+{
+    const uint8x16_t v = vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(w)), vdupq_n_u8(0));
+    return vgetq_lane_u32(vreinterpretq_u32_u8(v), 0);
+}
+
+/* nk is the number of 32-bit words in the key: 4 for AES-128, 8 for AES-256 */
+static bool valid_schedule_arm(const uint8_t *in, size_t nk, size_t schedule_size)
+{
+    uint32_t w[AES256_KEY_SCHEDULE_SIZE / 4];
+    memcpy(w, in, nk * 4);
+    uint32_t rc = 1;
+    for (size_t i = nk; i < schedule_size / 4; i++) {
+        uint32_t t = w[i-1];
+        if (i % nk == 0) {
+            t = sub_word_arm((t >> 8) | (t << 24)) ^ rc; // little-endian: RotWord is a right rotate
+            rc = ((rc << 1) ^ ((rc & 0x80) ? 0x1b : 0)) & 0xff;
+        } else if (nk == 8 && i % nk == 4) {
+            t = sub_word_arm(t);
+        }
+        w[i] = w[i-nk] ^ t;
+        if (w[i] != load32(in + i * 4)) return false;
+    }
+    return true;
+}
+
+static bool valid_aes128_schedule_arm(const uint8_t *in) { return valid_schedule_arm(in, 4, AES128_KEY_SCHEDULE_SIZE); }
+static bool valid_aes256_schedule_arm(const uint8_t *in) { return valid_schedule_arm(in, 8, AES256_KEY_SCHEDULE_SIZE); }
+#endif
+
+struct aes_expansion_kernel {
+    bool (*valid128)(const uint8_t *in);
+    bool (*valid256)(const uint8_t *in);
+};
+
+static cpu_dispatch::table<aes_expansion_kernel> expansion_kernels("aes_key_expansion", {
+#ifdef AES_PREFILTER_X86
+    {"aesni", cpu_dispatch::AESNI, {valid_aes128_schedule_aesni, valid_aes256_schedule_aesni}},
+#endif
+#ifdef AES_EXPANSION_ARM
+    {"armv8-crypto", cpu_dispatch::ARM_AES, {valid_aes128_schedule_arm, valid_aes256_schedule_arm}},
+#endif
+    {"software", 0, {valid_aes128_schedule, valid_aes256_schedule}},
+});
+
+bool valid_aes128_schedule_fast(const uint8_t *in)
+{
+    return expansion_kernels.fn().valid128(in);
+}
+
+bool valid_aes256_schedule_fast(const uint8_t *in)
+{
+    return expansion_kernels.fn().valid256(in);
+}
+
+const char *aes_key_expansion_name()
+{
+    return expansion_kernels.chosen_name();
+}
+
 // FindAES version 1.0 by Jesse Kornblum
 // http://jessekornblum.com/tools/findaes/
 // This code is public domain.
@@ -367,7 +507,56 @@ int scan_aes_128 = 1;
 int scan_aes_192 = 0;
 int scan_aes_256 = 1;
 
-class feature_recorder *aes_recorderp = nullptr;
+static recorder_handle aes_keys_file {"aes_keys"};
+
+/* The key schedules that start in [begin, end) of the sbuf; begin is a multiple of AES_PREFILTER_OFFSETS */
+static void scan_aes_range(const scanner_params &sp, size_t begin, size_t range_end)
+{
+    if (scan_aes_128==0 && scan_aes_192==0 && scan_aes_256==0) return;
+    auto &aes_recorder = *aes_keys_file;
+
+    /* Note: We tried keeping a rolling window of entropy and the
+     * number of distinct characters and this increased
+     * runtimes.
+     */
+
+    assert(sp.sbuf->bufsize >= AES128_KEY_SCHEDULE_SIZE);
+    assert(begin % AES_PREFILTER_OFFSETS == 0);
+    const uint8_t *buf = sp.sbuf->get_buf();
+    const size_t end = std::min(sp.sbuf->bufsize - AES128_KEY_SCHEDULE_SIZE, range_end);
+    const unsigned sizes = (scan_aes_128 ? AES_PREFILTER_128 : 0) | (scan_aes_192 ? AES_PREFILTER_192 : 0)
+        | (scan_aes_256 ? AES_PREFILTER_256 : 0);
+
+    /* The prefilter rejects almost every offset, 32 at a time, over the whole range first (on a device
+     * with -S offload; see candidate_offload.h); the last offsets are checked one by one. Every offset
+     * that can be a schedule remains, since each schedule satisfies the prefilter's relation.
+     */
+    thread_local std::vector<size_t> candidates;
+    candidates.clear();
+    candidate_offload::aes_candidates(buf, sp.sbuf->bufsize, begin, end, sizes, sp.sbuf->depth(), candidates);
+    for (const size_t pos : candidates) {
+        const uint8_t *p2 = buf + pos;
+
+        if (scan_aes_128
+            && (sp.sbuf->bufsize-pos >= AES128_KEY_SCHEDULE_SIZE)
+            && valid_aes128_schedule_fast(p2)) {
+            std::string key = key_to_string(p2, AES128_KEY_SIZE);
+            aes_recorder.write(sp.sbuf->pos0+pos,key,std::string("AES128"));
+        }
+        if (scan_aes_192
+            && (sp.sbuf->bufsize-pos >= AES192_KEY_SCHEDULE_SIZE)
+            && valid_aes192_schedule(p2)) {
+            std::string key = key_to_string(p2, AES192_KEY_SIZE);
+            aes_recorder.write(sp.sbuf->pos0+pos,key,std::string("AES192"));
+        }
+        if (scan_aes_256
+            && (sp.sbuf->bufsize-pos >= AES256_KEY_SCHEDULE_SIZE)
+            && valid_aes256_schedule_fast(p2)) {
+            std::string key = key_to_string(p2, AES256_KEY_SIZE);
+            aes_recorder.write(sp.sbuf->pos0+pos,key,std::string("AES256"));
+        }
+    }
+}
 
 extern "C"
 void scan_aes(struct scanner_params &sp)
@@ -378,53 +567,20 @@ void scan_aes(struct scanner_params &sp)
 	sp.info->description    = "Search for AES key schedules";
         sp.info->scanner_version = "1.2";
         sp.info->scanner_flags.scanner_wants_memory = true;
-        sp.info->feature_defs.push_back( feature_recorder_def("aes_keys"));
+        sp.info->feature_defs.push_back( aes_keys_file.def());
         sp.info->min_sbuf_size  =  AES128_KEY_SCHEDULE_SIZE;
         sp.get_scanner_config("scan_aes_128", &scan_aes_128, "Scan for 128-bit AES keys; 0=No, 1=Yes");
         sp.get_scanner_config("scan_aes_192", &scan_aes_192, "Scan for 192-bit AES keys; 0=No, 1=Yes");
         sp.get_scanner_config("scan_aes_256", &scan_aes_256, "Scan for 256-bit AES keys; 0=No, 1=Yes");
-	rcon_setup();
-	sbox_setup();
 	return;
     }
 
     if(sp.phase==scanner_params::PHASE_INIT2){
-        // look up once
-        aes_recorderp = &sp.named_feature_recorder("aes_keys");
+        aes_keys_file.resolve(sp);
+        scanner_tiles::enable("aes", scan_aes_range);
     }
 
     if(sp.phase==scanner_params::PHASE_SCAN){
-        if (scan_aes_128==0 && scan_aes_192==0 && scan_aes_256==0) return;
-	auto &aes_recorder = *aes_recorderp;
-
-	/* Note: We tried keeping a rolling window of entropy and the
-         * number of distinct characters and this increased
-         * runtimes.
-         */
-
-        assert(sp.sbuf->bufsize >= AES128_KEY_SCHEDULE_SIZE);
-        const uint8_t *buf = sp.sbuf->get_buf();
-	for (size_t pos = 0 ; pos < sp.sbuf->bufsize && pos < sp.sbuf->bufsize - AES128_KEY_SCHEDULE_SIZE; pos++){
-            const uint8_t *p2 = buf + pos;
-
-	    if (scan_aes_128
-                && (sp.sbuf->bufsize-pos >= AES128_KEY_SCHEDULE_SIZE)
-                && valid_aes128_schedule(p2)) {
-                std::string key = key_to_string(p2, AES128_KEY_SIZE);
-                aes_recorder.write(sp.sbuf->pos0+pos,key,std::string("AES128"));
-            }
-            if (scan_aes_192
-                && (sp.sbuf->bufsize-pos >= AES192_KEY_SCHEDULE_SIZE)
-                && valid_aes192_schedule(p2)) {
-                std::string key = key_to_string(p2, AES192_KEY_SIZE);
-                aes_recorder.write(sp.sbuf->pos0+pos,key,std::string("AES192"));
-            }
-            if (scan_aes_256
-                && (sp.sbuf->bufsize-pos >= AES256_KEY_SCHEDULE_SIZE)
-                && valid_aes256_schedule(p2)) {
-                std::string key = key_to_string(p2, AES256_KEY_SIZE);
-                aes_recorder.write(sp.sbuf->pos0+pos,key,std::string("AES256"));
-            }
-	}
+        scan_aes_range(sp, 0, sp.sbuf->bufsize);
     }
 }
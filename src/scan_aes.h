@@ -4,6 +4,25 @@ bool valid_aes128_schedule(const uint8_t * in);
 bool valid_aes192_schedule(const uint8_t * in);
 bool valid_aes256_schedule(const uint8_t * in);
 
+/* Prefilter: bit i of the result is set if offset i of the 32 offsets starting at p may start
+ * a key schedule of one of the sizes. p must have AES_PREFILTER_READ_SIZE readable bytes.
+ */
+static const unsigned AES_PREFILTER_128 = 1;
+static const unsigned AES_PREFILTER_192 = 2;
+static const unsigned AES_PREFILTER_256 = 4;
+static const size_t   AES_PREFILTER_OFFSETS   = 32;
+static const size_t   AES_PREFILTER_READ_SIZE = 64 + 40;
+uint32_t aes_prefilter(const uint8_t *p, unsigned sizes);        // the fastest kernel this CPU supports
+uint32_t aes_prefilter_scalar(const uint8_t *p, unsigned sizes);
+const char *aes_prefilter_name();                                // the kernel aes_prefilter() uses
+
+/* The validators, using the CPU's AES instructions for the key expansion when it has them.
+ * The software validators need the tables that scan_aes sets up at PHASE_INIT.
+ */
+bool valid_aes128_schedule_fast(const uint8_t *in);
+bool valid_aes256_schedule_fast(const uint8_t *in);
+const char *aes_key_expansion_name();                            // "aesni", "armv8-crypto" or "software"
+
 // https://tinyurl.com/u9p944uu
 // Try this one day...
 #if 0
@@ -0,0 +1,72 @@
+/* -*- mode: C++; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*
+ * scan_base16:
+ * Finds runs of hex and recurses into what they decode to. The runs are found and decoded by
+ * hex_runs a block at a time, rather than by a flex scanner a byte at a time.
+ */
+
+#define SCANNER "scan_base16"
+
+#include <vector>
+
+#include "config.h"
+#include "be13_api/scanner_params.h"
+
+#include "content_cache.h"
+#include "hex_runs.h"
+#include "recorder_handle.h"
+
+unsigned int opt_min_hex_buf = 64;           /* Don't re-analyze hex bufs smaller than this */
+
+static recorder_handle hex_file {"hex"};
+
+static void decode(const scanner_params &sp, feature_recorder &hex_recorder, const hex_runs::run &r)
+{
+    const sbuf_t &sbuf = *sp.sbuf;
+
+    /* Alert on byte sequences of 48, 128 or 256 bits*/
+    if (r.pairs==48/8 || r.pairs==128/8 || r.pairs==256/8){
+        const sbuf_t run(sbuf, r.offset, r.len);
+        hex_recorder.write_buf(run, 0, run.bufsize);  /* it validates; write original with context */
+        return;                                       /* Small keys don't get recursively analyzed */
+    }
+    if (r.pairs>opt_min_hex_buf){
+        auto *dbuf = sbuf_t::sbuf_malloc(sbuf.pos0 + r.offset + "BASE16", r.pairs, r.pairs);
+        hex_runs::decode(sbuf.get_buf(), r, static_cast<uint8_t *>(dbuf->malloc_buf()));
+        content_cache::recurse(sp, dbuf);    // recurse; will delete
+    }
+}
+
+/* Linkage */
+#define MINIMUM_SIZE_TO_SCAN 24
+
+extern "C"
+void scan_base16(struct scanner_params &sp)
+{
+    sp.check_version();
+    if (sp.phase==scanner_params::PHASE_INIT){
+        sp.info->set_name("base16");
+        sp.info->scanner_flags.recurse = true;
+        sp.info->scanner_flags.default_enabled = false;
+        sp.info->author          = "Simson L. Garfinkel";
+        sp.info->description     = "Base16 (hex) scanner";
+        sp.info->scanner_version = "1.2";
+        sp.info->pathPrefix      = "BASE16";
+        feature_recorder_def frd = hex_file.def();
+        frd.flags.disabled=true; /* disabled by default */
+        sp.info->feature_defs.push_back( frd );
+        return; /* No feature files created */
+    }
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        hex_file.resolve(sp);
+    }
+    if (sp.phase==scanner_params::PHASE_SCAN){
+        if (sp.sbuf->pagesize < MINIMUM_SIZE_TO_SCAN) return;
+        std::vector<hex_runs::run> runs; // not reused: the decoded runs are scanned on this thread, before the loop ends
+        hex_runs::find(sp.sbuf->get_buf(), sp.sbuf->bufsize, sp.sbuf->pagesize, runs);
+        for (const auto &r : runs) {
+            decode(sp, *hex_file, r);
+        }
+    }
+}
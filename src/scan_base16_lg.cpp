@@ -6,8 +6,10 @@
 #include <string>
 
 #include "be13_api/scanner_params.h"
-#include "histogram.h"
+
+#include "content_cache.h"
 #include "pattern_scanner.h"
+#include "recorder_handle.h"
 
 namespace base16 {
 //  const char* const DefaultEncodingsCStrings[] = {"UTF-8", "UTF-16LE"};
@@ -36,10 +38,10 @@ namespace base16 {
     virtual void init(const scanner_params& sp);
     virtual void initScan(const scanner_params&);
 
-    feature_recorder &Recorder;
+    feature_recorder* Recorder;
 
     void hitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-      decode(sp.sbuf, hit.Start, hit.End - hit.Start, sp, rcb);
+      decode(*sp.sbuf, hit.Start, hit.End - hit.Start, sp);
     }
 
   private:
@@ -124,15 +126,14 @@ namespace base16 {
   };
 
   void Scanner::startup(const scanner_params& sp) {
-      sp.check_version();
-
-      sp.info.set_name("base16_lg");
-      sp.info->name             = "base16_lg";
+      sp.info->set_name("base16_lg");
       sp.info->author           = "Simson L. Garfinkel";
-      sp.info->description      = "Base16 (hex) scanner";
-      sp.info->scanner_version  = "1.0";
-      sp.info->flags            = scanner_info::SCANNER_RECURSE;
-      sp.info->feature_names.insert("hex"); // notable hex values
+      sp.info->description      = "Base16 (hex) scanner (lightgrep)";
+      sp.info->scanner_version  = "1.1";
+      sp.info->pathPrefix       = "BASE16";
+      sp.info->scanner_flags.recurse = true;
+      sp.info->scanner_flags.default_enabled = false; // duplicates base16
+      sp.info->feature_defs.push_back( recorder_handle::make_def("hex")); // notable hex values
   }
 
   void Scanner::init(const scanner_params& sp) {
@@ -153,7 +154,7 @@ namespace base16 {
   }
 
   void Scanner::initScan(const scanner_params& sp) {
-    Recorder = sp.fs.named_feature_recorder("hex");
+    Recorder = &sp.named_feature_recorder("hex");
   }
 
   // Don't re-analyze hex bufs smaller than this
@@ -164,7 +165,7 @@ namespace base16 {
     uint16_t byte;
     uint8_t msn, lsn;
 
-    while (src < src_end) {
+    while (src + 1 < src_end) {
       msn = *src++;
       lsn = *src++;
       byte = BASE16_MSN[msn] | BASE16_LSN[lsn];
@@ -184,28 +185,25 @@ namespace base16 {
   }
 
   void Scanner::decode(const sbuf_t& osbuf, size_t pos, size_t len, const scanner_params& sp) {
-    sbuf_t sbuf(osbuf, pos, len);  // the substring we are working with
+    // the hit is decoded into a child sbuf, which is recursed into or deleted
+    sbuf_t* dbuf = sbuf_t::sbuf_malloc(osbuf.pos0 + pos + "BASE16", len/2 + 1, len/2 + 1);
+    uint8_t* dst = static_cast<uint8_t*>(dbuf->malloc_buf());
+    const uint8_t* src = osbuf.get_buf() + pos;
 
-  TODO: Replace managed_malloc with a sbuf_t::sbuf_malloc
-    managed_malloc<uint8_t> b(sbuf.pagesize/2);
-    if (b.buf == 0) return;
-
-    const size_t p = base16_decode_skipping_invalid(
-      b.buf, sbuf.buf, sbuf.buf+sbuf.pagesize
-    );
+    const size_t p = base16_decode_skipping_invalid(dst, src, src + len);
 
     // Alert on byte sequences of 48, 128 or 256 bits
     if (p == 48/8 || p == 128/8 || p == 256/8) {
       // it validates; write original with context
       Recorder->write_buf(osbuf, pos, len);
+      delete dbuf;
       return; // Small keys don't get recursively analyzed
     }
 
     if (p > opt_min_hex_buf) {
-      // NB: we manually add BASE16 here when recursing, because
-      // rcb.partName is LIGHTGREP here, which is not useful.
-      sbuf_t nsbuf(osbuf.pos0 + pos + "BASE16", b.buf, p, p, false);
-      (*rcb.callback)(scanner_params(sp, nsbuf)); // recurse
+      content_cache::recurse(sp, dbuf->realloc(p)); // recurse; will delete
+    } else {
+      delete dbuf;
     }
   }
 
@@ -214,7 +212,7 @@ namespace base16 {
 
 extern "C"
 void scan_base16_lg(struct scanner_params &sp) {
-  scan_lg(base16::TheScanner, sp, rcb);
+  scan_lg(base16::TheScanner, sp);
 }
 
 #endif // HAVE_LIBLIGHTGREP
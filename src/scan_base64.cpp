@@ -2,6 +2,7 @@
  * Does not create any feature files.
  */
 
+#include <algorithm>
 #include <cassert>
 //#include <cstdint>
 #include <cstring>
@@ -10,48 +11,94 @@
 #include "be13_api/scanner_params.h"
 
 #include "base64_forensic.h"
+#include "content_cache.h"
 #include "scan_base64.h"
+#include "scanner_tables.h"
 
-/* These create bitfields so we can quickly assess the character classes in a potential base64 block */
-static const uint32_t B64_LOWERCASE=1;
-static const uint32_t B64_UPPERCASE=2;
-static const uint32_t B64_NUMBER=4;
-static const uint32_t B64_SYMBOL=8;
-static int   base64array[256];           // array of valid base64 characters,
-static bool  base64array_initialized = false;
+/* These create bitfields so we can quickly assess the character classes in a potential base64 block.
+ * The table of valid base64 characters and their classes is generated at compile time.
+ */
+using scanner_tables::B64_LOWERCASE;
+using scanner_tables::B64_UPPERCASE;
+static constexpr const auto &base64array = scanner_tables::base64_classes;
 static size_t minlinewidth = 60;
 static size_t maxlinewidth_needed_for_character_classes = 160;
 
 
 inline bool isbase64(unsigned char ch)
 {
-    assert(base64array_initialized==true);
     return base64array[ch];
 }
 
-void base64array_initialize()
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define B64_CLASSIFY16
+/* If all 16 characters at p are base64 characters, add their classes to classes, clear only_A
+ * unless they are all 'A', and return true. Otherwise the caller classifies them one at a time.
+ */
+static inline bool classify16(const uint8_t *p, int &classes, bool &only_A)
 {
-    /* Create the base64 array */
-    std::memset(base64array,0,sizeof(base64array));
-    base64array[ static_cast<int>('+') ] = B64_SYMBOL;
-    base64array[ static_cast<int>('/') ] = B64_SYMBOL;
-    base64array[ static_cast<int>('-') ] = B64_SYMBOL; // RFC 4648
-    base64array[ static_cast<int>('_') ] = B64_SYMBOL; // RFC 4648
-    for (int ch='a';ch<='z';ch++){ base64array[ch] = B64_LOWERCASE; }
-    for (int ch='A';ch<='Z';ch++){ base64array[ch] = B64_UPPERCASE; }
-    for (int ch='0';ch<='9';ch++){ base64array[ch] = B64_NUMBER; }
-    base64array_initialized=true;
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    auto in_range = [&c](char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), c));
+    };
+    const int lower  = _mm_movemask_epi8(in_range('a', 'z'));
+    const int upper  = _mm_movemask_epi8(in_range('A', 'Z'));
+    const int number = _mm_movemask_epi8(in_range('0', '9'));
+    const int symbol = _mm_movemask_epi8(_mm_or_si128(
+                           _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')), _mm_cmpeq_epi8(c, _mm_set1_epi8('/'))),
+                           _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('-')), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')))));
+    if ((lower | upper | number | symbol) != 0xffff) return false;
+    if (lower)  classes |= scanner_tables::B64_LOWERCASE;
+    if (upper)  classes |= scanner_tables::B64_UPPERCASE;
+    if (number) classes |= scanner_tables::B64_NUMBER;
+    if (symbol) classes |= scanner_tables::B64_SYMBOL;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('A'))) != 0xffff) only_A = false;
+    return true;
 }
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define B64_CLASSIFY16
+static inline bool classify16(const uint8_t *p, int &classes, bool &only_A)
+{
+    const uint8x16_t c = vld1q_u8(p);
+    auto in_range = [&c](uint8_t lo, uint8_t hi) {
+        return vandq_u8(vcgeq_u8(c, vdupq_n_u8(lo)), vcleq_u8(c, vdupq_n_u8(hi)));
+    };
+    const uint8x16_t lower  = in_range('a', 'z');
+    const uint8x16_t upper  = in_range('A', 'Z');
+    const uint8x16_t number = in_range('0', '9');
+    const uint8x16_t symbol = vorrq_u8(vorrq_u8(vceqq_u8(c, vdupq_n_u8('+')), vceqq_u8(c, vdupq_n_u8('/'))),
+                                       vorrq_u8(vceqq_u8(c, vdupq_n_u8('-')), vceqq_u8(c, vdupq_n_u8('_'))));
+    if (vminvq_u8(vorrq_u8(vorrq_u8(lower, upper), vorrq_u8(number, symbol))) == 0) return false;
+    if (vmaxvq_u8(lower))  classes |= scanner_tables::B64_LOWERCASE;
+    if (vmaxvq_u8(upper))  classes |= scanner_tables::B64_UPPERCASE;
+    if (vmaxvq_u8(number)) classes |= scanner_tables::B64_NUMBER;
+    if (vmaxvq_u8(symbol)) classes |= scanner_tables::B64_SYMBOL;
+    if (vminvq_u8(vceqq_u8(c, vdupq_n_u8('A'))) == 0) only_A = false;
+    return true;
+}
+#endif
 
 /* Return true if the line only has base64 characters, space characters, or equal signs at the end */
 bool sbuf_line_is_base64(const sbuf_t &sbuf, size_t start, size_t len, bool &found_equal)
 {
-    assert(base64array_initialized==true);
     int  b64_classes = 0;
     bool only_A = true;
     if (start>sbuf.pagesize) return false;
     bool inequal = false;
+#ifdef B64_CLASSIFY16
+    const uint8_t *buf = sbuf.get_buf();
+    const size_t   end = std::min(start+len, sbuf.bufsize);
+#endif
     for (size_t i=start;i<start+len;i++){
+#ifdef B64_CLASSIFY16
+        /* Most lines are all base64 characters: take them 16 at a time */
+        while (!inequal && i+16 <= end && classify16(buf+i, b64_classes, only_A)){
+            i += 16;
+        }
+        if (i>=start+len) break;
+#endif
         if (sbuf[i]==' ' || sbuf[i]=='\t' || sbuf[i]=='\r') continue;
         if (sbuf[i]=='='){
             inequal=true;
@@ -113,7 +160,7 @@ void process_base64(const scanner_params &sp, size_t start, size_t src_len)
 {
     auto sbuf2 = decode_base64(*sp.sbuf, start, src_len);
     if (sbuf2) {
-        sp.recurse(sbuf2);              // deletes sbuf2
+        content_cache::recurse(sp, sbuf2);              // deletes sbuf2
     }
 }
 
@@ -130,7 +177,6 @@ void scan_base64(scanner_params &sp)
         sp.info->description    = "scans for Base64-encoded data";
         sp.info->scanner_version= "1.1";
         sp.info->scanner_flags.recurse = true;
-        base64array_initialize();
 	return;
     }
     if ( sp.phase==scanner_params::PHASE_SCAN){
@@ -145,7 +191,6 @@ void scan_base64(scanner_params &sp)
 	 * Note that this doesn't scan base64-encoded blobs smaller than two lines.
 	 * Perhaps we should do that.
 	 */
-        assert(base64array_initialized==true);
 
         bool   inblock    = false;      // are we in a base64 block?
         size_t blockstart = 0;          // where the base64 started
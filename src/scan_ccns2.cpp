@@ -4,14 +4,24 @@
  * used by the scan_accts.flex system.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 
 #include "config.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "scan_ccns2.h"
+#include "scanner_tables.h"
+#include "sha256.h"
 
 #include "be13_api/utils.h"
-#include "dfxml_cpp/src/hash_t.h"
 
 #include "be13_api/scanner_params.h"
 
@@ -21,60 +31,106 @@ int scan_ccns2_debug=0;
 /* credit2.cpp:
  * A filter to scan stdin to stdout, pass through only the lines
  * that have valid credit-card numbers by our feature detector.
+ *
+ * The candidates are tested in batches (valid_ccns()). Each test is run on the candidates that
+ * passed the one before, and the cheapest come first: the characters of each candidate are
+ * classified 32 at a time, which settles the digit and hex-window tests with bit operations,
+ * then the prefix, Luhn (ccv1), pattern and histogram tests are run on what is left.
  */
 
-inline int digit_val(char cc)
+static const size_t CHUNK = 64;        // candidates tested together by check_ccns()
+
+/* The characters of a candidate, as bitmasks: bit i is set if text[i] is a decimal digit,
+ * a hex digit, or NUL.
+ */
+struct char_masks {
+    uint32_t dec {0};
+    uint32_t hex {0};
+    uint32_t nul {0};
+};
+
+#if defined(__SSE2__)
+/* the bytes of v in [first, first+count) */
+static inline __m128i in_range(__m128i v, char first, char count)
 {
-    return cc - '0';
+    const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(first));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(count - 1)), d);
 }
 
+static inline uint32_t movemask32(__m128i lo, __m128i hi)
+{
+    return static_cast<uint32_t>(_mm_movemask_epi8(lo)) | (static_cast<uint32_t>(_mm_movemask_epi8(hi)) << 16);
+}
 
-/** extract the digits from a buffer of a given length
- * into a null-termianted array (which must be at least len+1).
- * Return 0 if extract is successful and if the count of non-digit
- * numbers is either 0, 3 (for credit card numbers beginning with a 4 or 5)
- * or 2 (for credit card numbers beginning with a 3).
- */
-static int extract_digits_and_test(const char *buf,int len,char *digits)
+static char_masks classify(const char *text)
 {
-    int nondigit_count = 0;
-    while(*buf && len){
-	if(isdigit(*buf)) *digits++ = *buf;
-	else nondigit_count++;
-	buf++;
-	len--;
-    }
-    *digits = 0;			// null-terminate
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + 16));
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i dec_lo = in_range(lo, '0', 10);
+    const __m128i dec_hi = in_range(hi, '0', 10);
+    char_masks m;
+    m.dec = movemask32(dec_lo, dec_hi);
+    m.hex = movemask32(_mm_or_si128(dec_lo, in_range(_mm_or_si128(lo, lower), 'a', 6)),
+                       _mm_or_si128(dec_hi, in_range(_mm_or_si128(hi, lower), 'a', 6)));
+    m.nul = movemask32(_mm_cmpeq_epi8(lo, _mm_setzero_si128()), _mm_cmpeq_epi8(hi, _mm_setzero_si128()));
+    return m;
+}
+#elif defined(__aarch64__)
+static inline uint8x16_t in_range(uint8x16_t v, uint8_t first, uint8_t count)
+{
+    return vcltq_u8(vsubq_u8(v, vdupq_n_u8(first)), vdupq_n_u8(count));
+}
+
+static inline uint32_t movemask16(uint8x16_t eq)
+{
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t b = vandq_u8(eq, vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(b)) | (static_cast<uint32_t>(vaddv_u8(vget_high_u8(b))) << 8);
+}
 
-    if(nondigit_count==0) return 0;
-    if((digits[0]=='4' || digits[0]=='5') && nondigit_count==3){
-	return 0;			// visa or mastercard
+static char_masks classify(const char *text)
+{
+    char_masks m;
+    for (int half = 0; half < 2; half++) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(text) + 16 * half);
+        const uint8x16_t dec = in_range(v, '0', 10);
+        m.dec |= movemask16(dec) << (16 * half);
+        m.hex |= movemask16(vorrq_u8(dec, in_range(vorrq_u8(v, vdupq_n_u8(0x20)), 'a', 6))) << (16 * half);
+        m.nul |= movemask16(vceqq_u8(v, vdupq_n_u8(0))) << (16 * half);
     }
-    if((digits[0]=='3') && (nondigit_count==2)){
-	return 0;			// american express
+    return m;
+}
+#else
+static char_masks classify(const char *text)
+{
+    char_masks m;
+    for (int i = 0; i < ccn_candidate::TEXT_SIZE; i++) {
+        const uint8_t ch = text[i];
+        const bool dec = ch >= '0' && ch <= '9';
+        if (dec) m.dec |= 1U << i;
+        if (dec || ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f')) m.hex |= 1U << i;
+        if (ch == 0) m.nul |= 1U << i;
     }
-    return -1;
+    return m;
 }
+#endif
 
-/* Return true if the string only has hex digits */
-static int only_hex_digits(const char *buf,int len)
+/* the characters of w up to the first NUL, which is where only_hex_digits() stopped */
+static inline uint32_t before_nul(const char_masks &m, uint32_t w)
 {
-    while(*buf && len){
-	if(ishexnumber(*buf)==0) return 0;
-	buf++;
-	len--;
-    }
-    return 1;
+    const uint32_t nul = m.nul & w;
+    return nul ? w & ((nul & (0U - nul)) - 1) : w;
 }
 
-static int only_dec_digits(const char *buf,int len)
+/* If the 4 characters before or after are hex digits but not decimal digits,
+ * then this is probably not a credit card number.
+ * We're probably instead in a sea of hex.
+ */
+static inline bool hex_window(const char_masks &m, uint32_t w)
 {
-    while(*buf && len){
-	if(isdigit(*buf)==0) return 0;
-	buf++;
-	len--;
-    }
-    return 1;
+    w = before_nul(m, w);
+    return (m.hex & w) == w && (m.dec & w) != w;
 }
 
 
@@ -88,18 +144,57 @@ static int only_dec_digits(const char *buf,int len)
  * Return 0 if a number follows the
  * Credit Card Number Validation Algorithm Version #1, -1 if it fails
  * (Version 2 is a pure database lookup based on the 3 digits on the back panel.)
+ * text is a candidate's text, with the len digits at text[WINDOW].
+ * Every other digit from the right is doubled, which is d + (d - 9*(d>4)).
  */
 
-static int ccv1_test(const char *digits)
+static int ccv1_test(const char *text, int len)
 {
     int chk=0;
+#if defined(__SSE2__) || defined(__aarch64__)
+    /* lane i of a table at 32-start is 0xff if i < start */
+    static const uint8_t below[64] = {
+        0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+        0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff};
+    static const uint8_t even[16] = {0xff,0,0xff,0,0xff,0,0xff,0,0xff,0,0xff,0,0xff,0,0xff,0};
+    const uint8_t *end = below + 32 - (ccn_candidate::WINDOW + len);
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(text);
+#endif
+#if defined(__SSE2__)
+    /* the digits are in lanes [WINDOW, WINDOW+len); the lane (WINDOW+len-2) is the first doubled */
+    const __m128i window = _mm_setr_epi8(0, 0, 0, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i even_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(even));
+    const __m128i doubled = (len % 2 == 0) ? even_lanes : _mm_andnot_si128(even_lanes, _mm_set1_epi8(-1));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (int half = 0; half < 2; half++) {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end + 16 * half));
+        if (half == 0) lanes = _mm_and_si128(lanes, window);
+        const __m128i d = _mm_and_si128(_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * half)),
+                                                     _mm_set1_epi8('0')), lanes);
+        const __m128i nines = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(4)), _mm_set1_epi8(9));
+        const __m128i v = _mm_add_epi8(d, _mm_and_si128(doubled, _mm_sub_epi8(d, nines)));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+    }
+    chk = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+#elif defined(__aarch64__)
+    static const uint8_t window[16] = {0,0,0,0,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff};
+    const uint8x16_t even_lanes = vld1q_u8(even);
+    const uint8x16_t doubled = (len % 2 == 0) ? even_lanes : vmvnq_u8(even_lanes);
+    for (int half = 0; half < 2; half++) {
+        uint8x16_t lanes = vld1q_u8(end + 16 * half);
+        if (half == 0) lanes = vandq_u8(lanes, vld1q_u8(window));
+        const uint8x16_t d = vandq_u8(vsubq_u8(vld1q_u8(p + 16 * half), vdupq_n_u8('0')), lanes);
+        const uint8x16_t nines = vandq_u8(vcgtq_u8(d, vdupq_n_u8(4)), vdupq_n_u8(9));
+        chk += vaddlvq_u8(vaddq_u8(d, vandq_u8(doubled, vsubq_u8(d, nines))));
+    }
+#else
     int double_flag=0;			// is number doubled?
-    int len = strlen(digits);
-    int i;
     int doubled[] = { 0,2,4,6,8,1,3,5,7,9 };	/* what are number when "doubled" */
+    const char *digits = text + ccn_candidate::WINDOW;
 
-    for(i=len-1;i>=0;i--){
-	int val = digit_val(digits[i]);
+    for(int i=len-1;i>=0;i--){
+	int val = digits[i] - '0';
 	if(double_flag==0){
 	    chk += val;
 	    double_flag = 1;
@@ -108,6 +203,7 @@ static int ccv1_test(const char *digits)
 	    double_flag = 0;
 	}
     }
+#endif
 
     if ( (chk%10) == 0 ) {
 	return 0;			// passed alg
@@ -120,15 +216,14 @@ static int ccv1_test(const char *digits)
  * If one digit is repeated more than 7 times, it is not valid.
  * If two sets of digits are repeated more than 5 times, it is not valid.
  */
-static int histogram_test(const char *digits)
+static int histogram_test(const char *digits,int len)
 {
     int cntscore = 0;
     int digit_counts[10];			// count of each character
 
     memset((void*)digit_counts,0,sizeof(digit_counts));
-    while(*digits){
-	digit_counts[digit_val(*digits)]++;
-	digits++;
+    for(int i=0;i<len;i++){
+	digit_counts[digits[i]-'0']++;
     }
 
     /* If we have more than 7 of one digit,
@@ -148,34 +243,22 @@ static int histogram_test(const char *digits)
  * Called to display strings. The first character is not part of the number.
  */
 
-/** Return the value of the first 4 digites of a buffer, as an integer */
-static int int4(const char *cc)
+/** Return the value of the first count (at most 6) digits of a buffer, as an integer */
+static int int_n(const char *cc,int count)
 {
-    char buf[5];
-    for(int i=0;i<4 && cc[i];i++){
-	buf[i] = cc[i];
+    int val = 0;
+    for(int i=0;i<count;i++){
+	val = val*10 + (cc[i]-'0');
     }
-    buf[4] = 0;
-    return atoi(buf);
+    return val;
 }
 
-/** Return the value of the first 6 digites of a buffer, as an integer */
-static int int6(const char *cc)
+static int pattern_test(const char *digits,int len)
 {
-    char buf[7];
-    for(int i=0;i<6 && cc[i];i++){
-	buf[i] = cc[i];
-    }
-    buf[6] = 0;
-    return atoi(buf);
-}
-
-static int pattern_test(const char *digits)
-{
-    int a = int4(digits);
-    int b = int4(digits+4);
-    int c = int4(digits+8);
-    int d = int4(digits+12);
+    int a = int_n(digits,4);
+    int b = int_n(digits+4,4);
+    int c = int_n(digits+8,4);
+    int d = int_n(digits+12,std::min(4,len-12));
 
     if(b-a == c-d) return -1;		/* something fishy going on... */
     return 0;
@@ -188,11 +271,11 @@ static int pattern_test(const char *digits)
  * http://en.wikipedia.org/wiki/Bank_card_number
  */
 
-static int prefix_test(const char *digits)
+static int prefix_test(const char *digits,int len)
 {
-    int len = strlen(digits);
-    int a = int4(digits);
-    int b = int6(digits);
+    if(len<13 || len>19) return -1;
+    int a = int_n(digits,4);
+    int b = int_n(digits,6);
 
     switch(len){
     case 13:
@@ -263,6 +346,80 @@ static int prefix_test(const char *digits)
     return -1;
 }
 
+void ccn_candidate::set(const char *buf, int buflen)
+{
+    memset(text, 0, sizeof(text));
+    if (buflen < 0 || buflen > MAX_LEN) {
+        len = -1;
+        return;
+    }
+    len = buflen;
+    /* the windows are read up to a NUL, which may be the end of the buffer */
+    for (int i = 0; i < WINDOW && buf[i - WINDOW]; i++) text[i] = buf[i - WINDOW];
+    memcpy(text + WINDOW, buf, buflen);
+    for (int i = 0; i < WINDOW && buf[buflen + i]; i++) text[WINDOW + buflen + i] = buf[buflen + i];
+}
+
+/**
+ * Test count (at most CHUNK) candidates; failed[i] is set to nullptr if candidate i is a
+ * credit card number, and to the test it failed if it is not.
+ */
+static void check_ccns(const ccn_candidate *candidates, size_t count, const char **failed)
+{
+    const int W = ccn_candidate::WINDOW;
+    char_masks masks[CHUNK];
+    int ndigits[CHUNK];
+
+    /* The characters up to the first NUL must all be digits. (extract_digits_and_test() also
+     * allowed the separators of "#### #### #### ####", but tested the digit after the end of
+     * the number to do so, so those numbers have never passed; see TODO.md.)
+     */
+    for (size_t i = 0; i < count; i++) {
+        const ccn_candidate &c = candidates[i];
+        failed[i] = nullptr;
+        if (c.len < 0) {
+            failed[i] = "Too long";
+            continue;
+        }
+        masks[i] = classify(c.text);
+        const uint32_t number = before_nul(masks[i], ((1U << c.len) - 1) << W);
+        if ((masks[i].dec & number) != number) {
+            failed[i] = "failed nondigit count";
+            continue;
+        }
+        ndigits[i] = __builtin_popcount(number);
+        if (hex_window(masks[i], 0xfU)) {
+            failed[i] = "failed before hex test";
+        } else if (hex_window(masks[i], 0xfU << (W + c.len))) {
+            failed[i] = "failed after hex test";
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!failed[i] && prefix_test(candidates[i].text + W, ndigits[i])) failed[i] = "failed prefix test";
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!failed[i] && ccv1_test(candidates[i].text, ndigits[i])) failed[i] = "failed ccv1 test";
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (failed[i]) continue;
+        if (pattern_test(candidates[i].text + W, ndigits[i])) {
+            failed[i] = "failed pattern test";
+        } else if (histogram_test(candidates[i].text + W, ndigits[i])) {
+            failed[i] = "failed histogram test";
+        }
+    }
+}
+
+void valid_ccns(const ccn_candidate *candidates, size_t count, bool *valid)
+{
+    const char *failed[CHUNK];
+    for (size_t base = 0; base < count; base += CHUNK) {
+        const size_t n = std::min(CHUNK, count - base);
+        check_ccns(candidates + base, n, failed);
+        for (size_t i = 0; i < n; i++) valid[base + i] = failed[i] == nullptr;
+    }
+}
+
 #define RETURN(code,reason) {if(scan_ccns2_debug){std::cerr << reason << "\n";} return code;}
 /**
  * Determine if this is or is not a credit card number.
@@ -272,36 +429,14 @@ static int prefix_test(const char *digits)
  */
 bool valid_ccn(const char *buf,int buflen)
 {
-    /* Make the digits array */
-    if(buflen>19) RETURN(0,"Too long");
-
-    char digits[20];			// just the digits
-
-    memset(digits,0,sizeof(digits));
-    if(extract_digits_and_test(buf,buflen,digits)) RETURN(0,"failed nondigit count");
-    if(prefix_test(digits))    RETURN(0,"failed prefix test");
-    if(ccv1_test(digits))      RETURN(0,"failed ccv1 test");
-    if(pattern_test(digits))   RETURN(0,"failed pattern test");
-    if(histogram_test(digits)) RETURN(0,"failed histogram test");
-
-    int before_window = 4;		// what we care about before
-    int after_window = 4;		// what we care about before
-
-    /* If the 4 characters before or after are hex digits but not decimal digits,
-     * then this is probably not a credit card number.
-     * We're probably instead in a sea of hex. So abort.
-     */
-    if(only_hex_digits(buf-before_window,before_window) && !only_dec_digits(buf-before_window,before_window)){
-	RETURN(0,"failed before hex test");
-    }
-    if(only_hex_digits(buf+buflen,after_window) && !only_dec_digits(buf+buflen,after_window)){
-	RETURN(0,"failed after hex test");
-    }
-
+    ccn_candidate c;
+    c.set(buf, buflen);
+    const char *failed = nullptr;
+    check_ccns(&c, 1, &failed);
+    if(failed) RETURN(0,failed);
     return 1;
 }
 
-
 /**
  * Throw out phone numbers that are preceeded or followed with only
  * numbers and spaces or brackets. These are commonly seen in PDF files
@@ -353,69 +488,50 @@ bool  valid_phone(const sbuf_t &sbuf,size_t pos,size_t len)
 }
 
 // http://rosettacode.org/wiki/Bitcoin/address_validation#C
-static const char *base58_chars =
-    "123456789"
-    "ABCDEFGHJKLMNPQRSTUVWXYZ"
-    "abcdefghijkmnopqrstuvwxyz";
-static int base58_vals[256];
-static bool unbase58_built = false;
-void build_unbase58()
-{
-    memset(base58_vals,-1,sizeof(base58_vals));
-    for(size_t i=0;base58_chars[i];i++){
-        base58_vals[(u_char)(base58_chars[i])] = i;
-    }
-    unbase58_built = true;
-}
-
+// The table of base58 values is generated at compile time (scanner_tables.h)
+// The number is accumulated in four 64-bit limbs, ten characters at a time (58^10 < 2^64),
+// and is too long if it does not fit in the 25 bytes of out.
 bool unbase58(const char *s,uint8_t *out,size_t len)
 {
-    assert(unbase58_built==true);
-    memset(out,0,25);
-    for(size_t i=0;s[i] && i<len;i++){
-        int c = base58_vals[(u_char)(s[i])];
-        if (c==-1) return false; // invalid character
-        for (int j = 25; j--; ) {
-            c += 58 * out[j];
-            out[j] = c % 256;
-            c /= 256;
+    uint64_t limbs[4] = {0, 0, 0, 0};   // least significant first
+    size_t i = 0;
+    while (i < len && s[i]) {
+        uint64_t chunk = 0;
+        uint64_t scale = 1;
+        for (int k = 0; k < 10 && i < len && s[i]; k++, i++) {
+            const int c = scanner_tables::base58_values[(u_char)(s[i])];
+            if (c==-1) return false; // invalid character
+            chunk = chunk * 58 + c;
+            scale *= 58;
+        }
+        unsigned __int128 carry = chunk;
+        for (auto &limb : limbs) {
+            carry += static_cast<unsigned __int128>(limb) * scale;
+            limb = static_cast<uint64_t>(carry);
+            carry >>= 64;
         }
-        if (c!=0) return false; // address too long
+        if (carry != 0 || (limbs[3] >> 8) != 0) return false; // address too long
+    }
+    out[0] = static_cast<uint8_t>(limbs[3]);
+    for (int j = 1; j < 25; j++) {
+        out[j] = static_cast<uint8_t>(limbs[(24 - j) / 8] >> (8 * ((24 - j) % 8)));
     }
     return true;
 }
 
 // A bitcoin address uses a base58 encoding, which uses an alphabet of the characters 0 .. 9, A ..Z, a .. z,
 // but without the four characters 0, O, I and l.
+// It is 26 to 35 characters long; the decoder rejects the other characters.
 bool valid_bitcoin_address(const char *s,size_t len){
+    if (len < 26 || len > 35) return false;
     uint8_t dec[32];
     if (unbase58(s,dec,len)==false) return false;
-    dfxml::sha256_t d1 = dfxml::sha256_generator::hash_buf(dec,21);
-    dfxml::sha256_t d2 = dfxml::sha256_generator::hash_buf(d1.digest,d1.size());
-    if (memcmp(dec+21, d2.digest, 4)!=0){
+    uint8_t d1[32];
+    uint8_t d2[32];
+    sha256_short(dec, 21, d1);
+    sha256_short(d1, sizeof(d1), d2);
+    if (memcmp(dec+21, d2, 4)!=0){
         return false;
     }
     return true;  /* validates */
 };
-
-
-
-
-
-
-#ifdef DEBUG
-static int validate_ccn_debug(const char *buf,int buflen)
-{
-    char digits[64];
-
-    printf("running tests. 0 means passed, -1 means failed.\n\n");
-    printf("nondigit_test(%s) = %d\n",buf,extract_digits_and_test(buf,buflen,digits));
-    printf("prefix_test(%s) = %d \n",digits,prefix_test(digits));
-    printf("ccv1_test(%s) = %d \n",digits,ccv1_test(digits));
-    printf("histogram_test(%s) = %d \n",digits,histogram_test(digits));
-    printf("pattern_test(%s) = %d \n",digits,pattern_test(digits));
-    printf("only_hex_digits(%s) = %d\n",buf,only_hex_digits(buf,strlen(buf)));
-    printf("only_dec_digits(%s) = %d\n",buf,only_dec_digits(buf,strlen(buf)));
-    return validate_ccn(buf,buflen);
-}
-#endif
@@ -1,14 +1,33 @@
 #ifndef SCAN_CCNS2_H
 #define SCAN_CCNS2_H
 
+#include <cstddef>
+#include <cstdint>
+
 #include "be13_api/sbuf.h"
 
 /* scan_ccns2.cpp --- here because it's used in both scan_accts.flex and scan_ccns2.cpp
  */
 bool  valid_ccn(const char *buf,int buflen);
+
+/* A credit card number for valid_ccns(): the number, with the WINDOW characters before and
+ * after it that valid_ccn() checks for hex. set() copies them, so the candidate can be tested
+ * after buf is gone (flex's yytext).
+ */
+struct ccn_candidate {
+    static constexpr int WINDOW = 4;
+    static constexpr int MAX_LEN = 19;
+    static constexpr int TEXT_SIZE = 32;
+    alignas(16) char text[TEXT_SIZE] {};    // [0,WINDOW) before, then the number, then WINDOW after
+    int len {-1};                           // of the number; -1 if it is too long
+    void set(const char *buf, int buflen);  // buf[-WINDOW] and buf[buflen+WINDOW-1] as for valid_ccn()
+};
+static_assert(ccn_candidate::WINDOW * 2 + ccn_candidate::MAX_LEN <= ccn_candidate::TEXT_SIZE);
+
+/* valid[i] = valid_ccn() of candidate i; each test is run on the candidates that passed the ones before */
+void  valid_ccns(const ccn_candidate *candidates, size_t count, bool *valid);
 bool  valid_phone(const sbuf_t &sbuf,size_t pos,size_t len);
 bool  valid_bitcoin_address(const char *buf,size_t buflen);
-void  build_unbase58();
 bool  unbase58(const char *s,uint8_t *out,size_t len);
 extern int scan_ccns2_debug;
 #endif
@@ -7,7 +7,11 @@
 
 #include "config.h"
 
+#include <cstring>
+#include <sstream>
+
 #include "be13_api/scanner_params.h"
+#include "recorder_handle.h"
 
 /* tunable constants */
 size_t sht_null_counter_max = 10;
@@ -472,6 +476,25 @@ static std::string match_switch_case (const struct flagnames_t flagnames[],
     return std::string("");
 }
 
+static bool known_value (const struct flagnames_t flagnames[], const uint32_t needle)
+{
+    for (int i = 0; flagnames[i].name; i++) {
+        if (needle == flagnames[i].flag) return true;
+    }
+    return false;
+}
+
+/* the size of the string that getAsciiString() would return */
+static size_t ascii_string_length (const sbuf_t & sbuf, size_t offset)
+{
+    size_t len = 0;
+    while (sbuf[offset + len] != '\0') {
+        if (sbuf[offset + len] & 0x80) return 0;
+        len++;
+    }
+    return len;
+}
+
 std::string getAsciiString (const sbuf_t & sbuf, size_t offset)
 {
     std::string str;
@@ -601,11 +624,56 @@ std::string scan_elf64_dynamic_needed (const sbuf_t & data, const Elf64_Shdr * s
 }
 
 
+/* All the excuses scan_elf_verify() has to throw out the ELF, tested before any XML is built */
+template <typename Ehdr, typename Shdr>
+static bool elf_header_ok (const sbuf_t & data)
+{
+    const Ehdr * ehdr = data.get_struct_ptr<Ehdr>(0);
+
+    if (ehdr == 0) return false;
+    if (ehdr->e_phentsize & 1) return false;
+    if (ehdr->e_shentsize & 1) return false;
+    if (ehdr->e_shstrndx > ehdr->e_shnum) return false;
+    if (!known_value(elf_e_type, ehdr->e_type)) return false;
+    if (!known_value(elf_e_machine, ehdr->e_machine)) return false;
+    if (ehdr->e_ehsize < sizeof(*ehdr)) return false;
+
+    size_t shstr_offset = ehdr->e_shoff + (ehdr->e_shentsize * ehdr->e_shstrndx);
+    const Shdr * shstr = data.get_struct_ptr<Shdr>(shstr_offset);
+    size_t sht_null_count = 0;
+
+    for (int si = 0; si < ehdr->e_shnum; si++) {
+        size_t shdr_offset = ehdr->e_shoff + (ehdr->e_shentsize * si);
+        const Shdr * shdr = data.get_struct_ptr<Shdr>(shdr_offset);
+        if (shdr == 0) break;
+        if (shdr->sh_type == SHT_NULL && ++sht_null_count > sht_null_counter_max) return false;
+        if (shdr->sh_type == SHT_DYNAMIC && (shdr->sh_size == 0 || shdr->sh_entsize == 0)) return false;
+        if (shstr != 0 && ascii_string_length(data, shstr->sh_offset + shdr->sh_name) > slt_max_name_size) return false;
+    }
+    return true;
+}
+
+/* The XML is built in one stream per thread, which keeps its buffer from one ELF to the next */
+static std::stringstream & xml_buffer ()
+{
+    static thread_local std::stringstream xml;
+    static const std::ios_base::fmtflags default_flags = xml.flags();
+    xml.str(std::string());
+    xml.clear();
+    xml.flags(default_flags);
+    return xml;
+}
+
 // function begins with 32 bits of confidence
 // So look for excuses to throw out the ELF
 std::string scan_elf_verify (const sbuf_t & data)
 {
-    std::stringstream xml;
+    if      (data[EI_CLASS] == ELFCLASS32) { if (!elf_header_ok<Elf32_Ehdr, Elf32_Shdr>(data)) return ""; }
+    else if (data[EI_CLASS] == ELFCLASS64) { if (!elf_header_ok<Elf64_Ehdr, Elf64_Shdr>(data)) return ""; }
+    else return "";
+    if (data[EI_DATA] != ELFDATA2LSB && data[EI_DATA] != ELFDATA2MSB) return "";
+
+    std::stringstream &xml = xml_buffer();
     std::stringstream so_xml;		// collect shared object names
     size_t sht_null_count=0;
 
@@ -790,6 +858,8 @@ std::string scan_elf_verify (const sbuf_t & data)
     return xml.str();
 }
 
+static recorder_handle elf_file {"elf"};
+
 extern "C"
 void scan_elf (scanner_params &sp)
 {
@@ -799,19 +869,25 @@ void scan_elf (scanner_params &sp)
         sp.info->set_name("elf");
 	sp.info->author          = "Alex Eubanks";
         sp.info->scanner_version = "1.1";
-        sp.info->feature_defs.push_back( feature_recorder_def("elf") );
+        sp.info->feature_defs.push_back( elf_file.def() );
         return;
     }
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        elf_file.resolve(sp);
+    }
     if ( sp.phase == scanner_params::PHASE_SCAN){
 
-	auto &f = sp.named_feature_recorder("elf");
+	auto &f = *elf_file;
         auto &sbuf = *(sp.sbuf);
 
+	const uint8_t *buf = sbuf.get_buf();
 	for (size_t pos = 0; pos < sbuf.bufsize; pos++) {
 	    // Look for the magic number
 	    // If we find it, make an sbuf and analyze...
-	    if ( (sbuf[pos+0] == 0x7f)
-		 && (sbuf[pos+1] == 'E')
+	    const void *hit = memchr(buf + pos, 0x7f, sbuf.bufsize - pos);
+	    if (hit == nullptr) break;
+	    pos = static_cast<const uint8_t *>(hit) - buf;
+	    if ( (sbuf[pos+1] == 'E')
 		 && (sbuf[pos+2] == 'L')
 		 && (sbuf[pos+3] == 'F')) {
 
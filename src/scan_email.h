@@ -3,4 +3,5 @@
 bool extra_validate_email(const char *email);
 ssize_t find_host_in_email(const sbuf_t &sbuf);
 ssize_t find_host_in_url(const sbuf_t &sbuf, size_t *domain_len);
+size_t email_length(const char *text, size_t len, size_t stride, size_t min_domain);
 #endif
@@ -4,15 +4,19 @@
 #ifdef HAVE_LIBLIGHTGREP
 
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <functional>
+#include <set>
 #include <string>
 
 #include "be13_api/scanner_params.h"
+#include "be13_api/utils.h"             // needs config.h
 
-#include "histogram.h"
+#include "heavy_hitters.h"
 #include "pattern_scanner.h"
 #include "pattern_scanner_utils.h"
-#include "utils.h"                      // needs config.h
+#include "recorder_handle.h"
 
 using namespace std;
 
@@ -214,29 +218,32 @@ namespace email {
   };
 
   void Scanner::startup(const scanner_params& sp) {
-      sp.check_version();
-
-    sp.info->name            = "email_lg";
+    sp.info->set_name("email_lg");
     sp.info->author          = "Simson L. Garfinkel";
-    sp.info->description     = "Scans for email addresses, domains, URLs, RFC822 headers, etc.";
-    sp.info->scanner_version = "1.0";
+    sp.info->description     = "Scans for email addresses, domains, URLs, RFC822 headers, etc. (lightgrep)";
+    sp.info->scanner_version = "1.1";
+    sp.info->scanner_flags.default_enabled = false; // duplicates email
 
     // define the feature files this scanner creates
-    sp.info->feature_names.insert("email");
-    sp.info->feature_names.insert("domain");
-    sp.info->feature_names.insert("url");
-    sp.info->feature_names.insert("rfc822");
-    sp.info->feature_names.insert("ether");
+    sp.info->feature_defs.push_back( recorder_handle::make_def("email"));
+    sp.info->feature_defs.push_back( recorder_handle::make_def("domain"));
+    sp.info->feature_defs.push_back( recorder_handle::make_def("url"));
+    sp.info->feature_defs.push_back( recorder_handle::make_def("rfc822"));
+    sp.info->feature_defs.push_back( recorder_handle::make_def("ether"));
 
     // define the histograms to make
-    sp.info->histogram_defs.insert(histogram_def("email", "", "histogram", HistogramMaker::FLAG_LOWERCASE));
-    sp.info->histogram_defs.insert(histogram_def("domain", "", "histogram"));
-    sp.info->histogram_defs.insert(histogram_def("url", "", "histogram"));
-    sp.info->histogram_defs.insert(histogram_def("url", "://([^/]+)", "services"));
-    sp.info->histogram_defs.insert(histogram_def("url", "://((cid-[0-9a-f])+[a-z.].live.com/)", "microsoft-live"));
-    sp.info->histogram_defs.insert(histogram_def("url", "://[-_a-z0-9.]+facebook.com/.*[&?]{1}id=([0-9]+)", "facebook-id"));
-    sp.info->histogram_defs.insert(histogram_def("url", "://[-_a-z0-9.]+facebook.com/([a-zA-Z0-9.]*[^/?&]$)", "facebook-address",  HistogramMaker::FLAG_LOWERCASE));
-    sp.info->histogram_defs.insert(histogram_def("url", "search.*[?&/;fF][pq]=([^&/]+)", "searches"));
+    auto no_flags  = histogram_def::flags_t();
+    auto lowercase = histogram_def::flags_t(); lowercase.lowercase = true;
+
+    heavy_hitters::add_def(sp, histogram_def("email1", "email",  "",                                     "", "histogram", lowercase));
+    heavy_hitters::add_def(sp, histogram_def("email2", "email",  "(@.*)",                                "", "domain_histogram", lowercase));
+    heavy_hitters::add_def(sp, histogram_def("email3", "domain", "",                                     "", "histogram", no_flags));
+    heavy_hitters::add_def(sp, histogram_def("url1",   "url",    "",                                     "", "histogram", no_flags));
+    heavy_hitters::add_def(sp, histogram_def("url2",   "url",    "://([^/]+)",                           "", "services", no_flags));
+    heavy_hitters::add_def(sp, histogram_def("url3",   "url",    "://((cid-[0-9a-f])+[a-z.].live.com/)", "", "microsoft-live", no_flags));
+    heavy_hitters::add_def(sp, histogram_def("url4",   "url",    "://[-_a-z0-9.]+facebook.com/.*[&?]{1}id=([0-9]+)", "", "facebook-id", no_flags));
+    heavy_hitters::add_def(sp, histogram_def("url5",   "url",    "://[-_a-z0-9.]+facebook.com/([a-zA-Z0-9.]*[^/?&]$)", "", "facebook-address", lowercase));
+    heavy_hitters::add_def(sp, histogram_def("url6",   "url",    "search.*[?&/;fF][pq]=([^&/]+)",       "", "searches", no_flags));
   }
 
   void Scanner::init(const scanner_params& sp) {
@@ -380,71 +387,71 @@ namespace email {
   }
 
   void Scanner::initScan(const scanner_params& sp) {
-    RFC822_Recorder = sp.named_feature_recorder("rfc822");
-    Email_Recorder = sp.named_feature_recorder("email");
-    Domain_Recorder = sp.named_feature_recorder("domain");
-    Ether_Recorder = sp.named_feature_recorder("ether");
-    URL_Recorder = sp.named_feature_recorder("url");
+    RFC822_Recorder = &sp.named_feature_recorder("rfc822");
+    Email_Recorder = &sp.named_feature_recorder("email");
+    Domain_Recorder = &sp.named_feature_recorder("domain");
+    Ether_Recorder = &sp.named_feature_recorder("ether");
+    URL_Recorder = &sp.named_feature_recorder("url");
   }
 
   void Scanner::rfc822HitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    RFC822_Recorder->write_buf(sp.sbuf, hit.Start, hit.End - hit.Start);
+    RFC822_Recorder->write_buf(*sp.sbuf, hit.Start, hit.End - hit.Start);
   }
 
   void Scanner::emailHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     const size_t len = (hit.End - 1) - hit.Start;
-    const uint8_t* matchStart = sp.sbuf.buf + hit.Start;
+    const uint8_t* matchStart = sp.sbuf->get_buf() + hit.Start;
 
-    Email_Recorder->write_buf(sp.sbuf, hit.Start, len);
+    Email_Recorder->write_buf(*sp.sbuf, hit.Start, len);
     const size_t domain_off = find_domain_in_email(matchStart, len);
     if (domain_off < len) {
-      Domain_Recorder->write_buf(sp.sbuf, hit.Start + domain_off, len - domain_off);
+      Domain_Recorder->write_buf(*sp.sbuf, hit.Start + domain_off, len - domain_off);
     }
   }
 
   void Scanner::emailUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     const size_t len = (hit.End - 1) - hit.Start;
-    const uint8_t* matchStart = sp.sbuf.buf + hit.Start;
+    const uint8_t* matchStart = sp.sbuf->get_buf() + hit.Start;
 
-    Email_Recorder->write_buf(sp.sbuf, hit.Start, len);
+    Email_Recorder->write_buf(*sp.sbuf, hit.Start, len);
     const size_t domain_off = find_domain_in_email(matchStart, len) + 1;
     if (domain_off < len) {
-      Domain_Recorder->write_buf(sp.sbuf, hit.Start + domain_off, len - domain_off);
+      Domain_Recorder->write_buf(*sp.sbuf, hit.Start + domain_off, len - domain_off);
     }
   }
 
   void Scanner::ipaddrHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    if (valid_ipaddr(sp.sbuf.buf, sp.sbuf.buf + hit.Start + 1)) {
-      Domain_Recorder->write_buf(sp.sbuf, hit.Start+1, hit.End - hit.Start - 2);
+    if (valid_ipaddr(sp.sbuf->get_buf(), sp.sbuf->get_buf() + hit.Start + 1)) {
+      Domain_Recorder->write_buf(*sp.sbuf, hit.Start+1, hit.End - hit.Start - 2);
     }
   }
 
   void Scanner::ipaddrUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    const size_t pos = hit.Start + (*(sp.sbuf.buf+hit.Start+1) == '\0' ? 2 : 1);
+    const size_t pos = hit.Start + (*(sp.sbuf->get_buf()+hit.Start+1) == '\0' ? 2 : 1);
     const size_t len = (hit.End - 1) - pos;
     // this assumes sp.sbuf.pos will never be an odd memory address...
     // if pos is odd, add 1 to sbuf.buf and use it as a leftmost guard
-    const uint16_t* leftguard(reinterpret_cast<const uint16_t*>(sp.sbuf.buf + ((pos & 0x01) == 1 ? 1: 0)));
-    if (valid_ipaddr(leftguard, reinterpret_cast<const uint16_t*>(sp.sbuf.buf + pos))) {
-      Domain_Recorder->write_buf(sp.sbuf, pos, len);
+    const uint16_t* leftguard(reinterpret_cast<const uint16_t*>(sp.sbuf->get_buf() + ((pos & 0x01) == 1 ? 1: 0)));
+    if (valid_ipaddr(leftguard, reinterpret_cast<const uint16_t*>(sp.sbuf->get_buf() + pos))) {
+      Domain_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
   void Scanner::etherHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     const size_t pos = hit.Start + 1;
     const size_t len = (hit.End - 1) - pos;
-    if (valid_ether_addr(sp.sbuf.buf+pos)){
-      Ether_Recorder->write_buf(sp.sbuf, pos, len);
+    if (valid_ether_addr(sp.sbuf->get_buf()+pos)){
+      Ether_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
   void Scanner::etherUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    const size_t pos = hit.Start + (*(sp.sbuf.buf+hit.Start+1) == '\0' ? 2 : 1);
+    const size_t pos = hit.Start + (*(sp.sbuf->get_buf()+hit.Start+1) == '\0' ? 2 : 1);
     const size_t len = (hit.End -1) - pos;
 
-    const string ascii(low_utf16le_to_ascii(sp.sbuf.buf+pos, len));
+    const string ascii(low_utf16le_to_ascii(sp.sbuf->get_buf()+pos, len));
     if (valid_ether_addr(reinterpret_cast<const uint8_t*>(ascii.c_str()))){
-      Ether_Recorder->write_buf(sp.sbuf, pos, len);
+      Ether_Recorder->write_buf(*sp.sbuf, pos, len);
     }
   }
 
@@ -454,49 +461,49 @@ namespace email {
     // number of slashes and if it is only 2 the size is pruned until the
     // last character is a letter
     const int slash_count = count(
-      sp.sbuf.buf + hit.Start,
-      sp.sbuf.buf + hit.End, '/'
+      sp.sbuf->get_buf() + hit.Start,
+      sp.sbuf->get_buf() + hit.End, '/'
     );
 
     size_t len = hit.End - hit.Start;
 
     if (slash_count == 2) {
-      while (len > 0 && !isalpha(sp.sbuf[hit.Start+len-1])) {
+      while (len > 0 && !isalpha((*sp.sbuf)[hit.Start+len-1])) {
         --len;
       }
     }
 
-    URL_Recorder->write_buf(sp.sbuf, hit.Start, len);
+    URL_Recorder->write_buf(*sp.sbuf, hit.Start, len);
 
     size_t domain_len = 0;
-    size_t domain_off = find_domain_in_url(sp.sbuf.buf + hit.Start, len, domain_len);  // find the start of domain?
+    size_t domain_off = find_domain_in_url(sp.sbuf->get_buf() + hit.Start, len, domain_len);  // find the start of domain?
     if (domain_off < len && domain_len > 0) {
-      Domain_Recorder->write_buf(sp.sbuf, hit.Start + domain_off, domain_len);
+      Domain_Recorder->write_buf(*sp.sbuf, hit.Start + domain_off, domain_len);
     }
   }
 
   void Scanner::protoUTF16LEHitHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     const int slash_count = count(
-      sp.sbuf.buf + hit.Start,
-      sp.sbuf.buf + hit.End, '/'
+      sp.sbuf->get_buf() + hit.Start,
+      sp.sbuf->get_buf() + hit.End, '/'
     );
 
     size_t len = hit.End - hit.Start;
 
     if (slash_count == 2) {
-      while (len > 1 && !isalpha(sp.sbuf[hit.Start+len-2])) {
+      while (len > 1 && !isalpha((*sp.sbuf)[hit.Start+len-2])) {
         len -= 2;
       }
     }
 
-    URL_Recorder->write_buf(sp.sbuf, hit.Start, len);
+    URL_Recorder->write_buf(*sp.sbuf, hit.Start, len);
 
     size_t domain_len = 0;
-    size_t domain_off = find_domain_in_url(reinterpret_cast<const uint16_t*>(sp.sbuf.buf + hit.Start), len/2, domain_len);  // find the start of domain?
+    size_t domain_off = find_domain_in_url(reinterpret_cast<const uint16_t*>(sp.sbuf->get_buf() + hit.Start), len/2, domain_len);  // find the start of domain?
     domain_off *= 2;
     domain_len *= 2;
     if (domain_off < len && domain_len > 0) {
-      Domain_Recorder->write_buf(sp.sbuf, hit.Start + domain_off, domain_len);
+      Domain_Recorder->write_buf(*sp.sbuf, hit.Start + domain_off, domain_len);
     }
   }
 
@@ -505,7 +512,7 @@ namespace email {
 
 extern "C"
 void scan_email_lg(struct scanner_params &sp) {
-  scan_lg(email::TheScanner, sp, rcb);
+  scan_lg(email::TheScanner, sp);
 }
 
 #endif // HAVE_LIBLIGHTGREP
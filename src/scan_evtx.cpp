@@ -13,18 +13,24 @@
 #include <strings.h>
 #include <sstream>
 #include <vector>
+#include <algorithm>
 
 
+#include "recorder_handle.h"
 #include "utf8.h"
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 #include "be13_api/scanner_set.h"
+#include "crc32.h"
+#include "signature_prefilter.h"
 
 #define SECTOR_SIZE 512
 #define CLUSTER_SIZE 4096
 #define ELFFILE_SIZE 4096
 #define ELFCHNK_SIZE 65536
 
-const std::string FEATURE_FILE_NAME {"evtx_carved"};
+static recorder_handle evtx_file {"evtx_carved"};
+static size_t record_signature = 0;     // "**\0\0", in the signature_prefilter
 
 struct elffile {
     struct elffilepart {
@@ -44,38 +50,6 @@ struct elffile {
     char unknown2[3968];
 };
 
-// TODO: This is pretty gross. Make it a proper class?
-// https://gist.github.com/timepp/1f678e200d9e0f2a043a9ec6b3690635
-// usage: the following code generates crc for 2 pieces of data
-// uint32_t table[256];
-// crc32::generate_table(table);
-// uint32_t crc = crc32::update(table, 0, data_piece1, len1);
-// crc = crc32::update(table, crc, data_piece2, len2);
-// output(crc);
-struct crc32 {
-    static void generate_table(uint32_t(&table)[256]) {
-        uint32_t polynomial = 0xEDB88320;
-		for (size_t i = 0; i < 256; i++) {
-			uint32_t c = i;
-			for (size_t j = 0; j < 8; j++) {
-				if (c & 1)
-					c = polynomial ^ (c >> 1);
-				else
-					c >>= 1;
-			}
-			table[i] = c;
-		}
-    }
-    static uint32_t update(uint32_t (&table)[256], uint32_t initial, const void* buf, size_t len) {
-        uint32_t c = initial ^ 0xFFFFFFFF;
-        const uint8_t* u = static_cast<const uint8_t*>(buf);
-        for (size_t i = 0; i < len; ++i) {
-            c = table[(c ^ u[i]) & 0xFF] ^ (c >> 8);
-        }
-        return c ^ 0xFFFFFFFF;
-	}
-};
-
 // check EVTX Header Signature
 // return: > 0 - valid header and number of chunks, 0 - not header, -1 - valid header but invalid num of chunk
 int64_t check_evtxheader_signature(size_t offset, const sbuf_t &sbuf) {
@@ -146,6 +120,8 @@ void scan_evtx(const sbuf_t &sbuf, feature_recorder &evtx_recorder)
     // search for EVTX chunk in the sbuf
     size_t offset = 0;
     size_t total_size=0;
+    const std::vector<size_t> &records = signature_prefilter::shared().candidates(sbuf, record_signature);
+    auto next_record = records.begin();
 
     while (offset < sbuf.pagesize) {
         int64_t result_num_of_chunks = check_evtxheader_signature(offset, sbuf);
@@ -169,7 +145,7 @@ void scan_evtx(const sbuf_t &sbuf, feature_recorder &evtx_recorder)
                     std::to_string(result_num_of_chunks) + "chunks_" +
                     std::to_string(actual_num_of_chunk) + "actual.evtx";
                 sbuf_t data(sbuf, offset, total_size);
-                evtx_recorder.carve(data, filename);
+                carve_index::carve(evtx_recorder, data, filename);
             } else if (result_last_record_id == -1) {
                 // If valid ElfChnk and invalid record then skip
                 total_size += ELFCHNK_SIZE;
@@ -194,8 +170,7 @@ void scan_evtx(const sbuf_t &sbuf, feature_recorder &evtx_recorder)
                 total_size += ELFCHNK_SIZE;
                 result_last_record_id = check_evtxchunk_signature(offset+total_size, sbuf);
             }
-            uint8_t *header_buf = static_cast<uint8_t *>(malloc(sizeof(struct elffile))); // allocate memory for header
-            struct elffile &header = *(reinterpret_cast<struct elffile *>(header_buf)); // make header. a reference to the buffer
+            struct elffile header; // the synthetic header, carved in front of the chunks without copying them to it
             // set header values for found ElfChnk records
             strcpy(header.part.magic, "ElfFile");
             header.part.first_chunk = 0;
@@ -209,36 +184,34 @@ void scan_evtx(const sbuf_t &sbuf, feature_recorder &evtx_recorder)
             memset(header.part.unknown1,'\0', sizeof(header.part.unknown1));
             header.flags = 0;
 
-            // todo: This CRC32 implementation is horrible.
-            // Replace it with one that uses proper encapsulation.
-            uint32_t table[256];
-            crc32::generate_table(table);
-
             // CRC32 of the first 120 bytes == header.part struct
-            header.crc32 = crc32::update(table, 0, &header.part, 120);
+            header.crc32 = crc32_update(0, &header.part, 120);
             memset(header.unknown2,'\0', sizeof(header.unknown2));
             std::string filename = (sbuf.pos0+offset).str() + "_" +
                 std::to_string(header.part.number_of_chunks) + "chunks_" +
                 std::to_string(num_of_records) + "records.evtx";
             // generate evtx header based on elfchnk information
-            // make an sbuf for the header that will free it automatically when we are finished
-            sbuf_t *sbuf_header = sbuf_t::sbuf_new(pos0_t(), header_buf, sizeof(header), sizeof(header));
+            // the header sbuf only points to it; carve_index copies it if the carve is written later
+            sbuf_t *sbuf_header = sbuf_t::sbuf_new(pos0_t(), reinterpret_cast<const uint8_t *>(&header),
+                                                   sizeof(header), sizeof(header));
             sbuf_t sbuf_records(sbuf, offset, total_size);
-            evtx_recorder.carve(*sbuf_header, sbuf_records, filename);
+            carve_index::carve(evtx_recorder, *sbuf_header, sbuf_records, filename);
             delete sbuf_header;
             offset += total_size;
         } else { // scans orphan record
+            // at every 8 bytes from the last record in the cluster; only where the prefilter found one
             size_t i=0;
-            while (i < CLUSTER_SIZE) {
+            next_record = std::lower_bound(next_record, records.end(), offset);
+            for (; next_record != records.end() && *next_record < offset+CLUSTER_SIZE; ++next_record) {
+                if (*next_record < offset+i || (*next_record-offset-i) % 8 != 0)
+                    continue;
+                i = *next_record - offset;
                 int64_t result_record_size = check_evtxrecord_signature(offset+i, sbuf);
                 if (result_record_size > 0) {
                     sbuf_t data(sbuf,offset+i, result_record_size);
-                    evtx_recorder.carve(data, ".evtx_orphan_record");
+                    carve_index::carve(evtx_recorder, data, ".evtx_orphan_record");
                     i += result_record_size;
-                } else {
-                    i += 8;
                 }
-
             }
             offset += CLUSTER_SIZE;
         }
@@ -259,14 +232,19 @@ void scan_evtx(scanner_params &sp)
 
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-        sp.info->feature_defs.push_back( feature_recorder_def(FEATURE_FILE_NAME, carve_flag));
+        sp.info->feature_defs.push_back( evtx_file.def(carve_flag));
+        return;
+    }
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        evtx_file.resolve(sp);
+        record_signature = signature_prefilter::shared().add(std::string("**\0\0", 4));
         return;
     }
     if(sp.phase==scanner_params::PHASE_SCAN){
         /* Note: the original programmer's scanner runs off the end of the sbuf, so we have to catch the exception */
 
         try {
-            scan_evtx( *(sp.sbuf), sp.named_feature_recorder(FEATURE_FILE_NAME));
+            scan_evtx( *(sp.sbuf), *evtx_file);
         } catch (const sbuf_t::range_exception_t &e) {
         }
     } // end PHASE_SCAN
@@ -16,19 +16,39 @@
 #include <iomanip>
 #include <cassert>
 #include <algorithm>
+#include <charconv>
+#include <string>
+#include <string_view>
 
 
 #include "scan_exif.h"
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 #include "be13_api/utils.h"// needs config.h
 
 #include "dfxml_cpp/src/dfxml_writer.h"
 
 #include "exif_reader.h"
+#include "jpeg_candidates.h"
+#include "recorder_handle.h"
+#include "scratch_arena.h"
+#include "signature_prefilter.h"
 #include "unicode_escape.h"
+#include "utf8_text.h"
 
 // these are tunable
 static size_t min_jpeg_size = 1000; // don't carve smaller than this
+static bool   exif_sector_aligned = false; // at depth 0, JPEGs start at sector boundaries
+
+/* the starts of JPEG, Photoshop and TIFF files, in the signature_prefilter */
+static size_t jpeg_signature = 0;
+static size_t psd_signature = 0;
+static size_t tiff_ii_signature = 0;
+static size_t tiff_mm_signature = 0;
+
+static recorder_handle exif_file {"exif"};
+static recorder_handle gps_file {"gps"};
+static recorder_handle jpeg_carved_file {"jpeg_carved"};
 
 /****************************************************************
  *** formatting code
@@ -39,31 +59,73 @@ static size_t min_jpeg_size = 1000; // don't carve smaller than this
  */
 bool exif_debug = false;
 
-static double be_stod(std::string s)
+static double be_stod(std::string_view s)
 {
+    /* exif_entry writes the parts of a rational as integers; from_chars reads them without a copy or the locale */
+    int64_t n = 0;
+    const std::from_chars_result res = std::from_chars(s.data(), s.data() + s.size(), n);
+    if (res.ec == std::errc() && res.ptr == s.data() + s.size()) return static_cast<double>(n);
+
+    // sscanf needs a terminated string; the numbers of a GPS rational are short
+    char digits[64];
+    const size_t len = std::min(s.size(), sizeof(digits) - 1);
+    memcpy(digits, s.data(), len);
+    digits[len] = '\0';
     double d=0;
-    sscanf(s.c_str(),"%lf",&d);
+    sscanf(digits,"%lf",&d);
     return d;
 }
 
-static double rational(std::string s)
+/* splits s at delim as split() does, into at most max parts; returns the number of parts, or max+1 */
+static size_t split_view(std::string_view s, char delim, std::string_view *parts, size_t max)
+{
+    size_t n = 0;
+    while (!s.empty()) {
+        if (n == max) return max + 1;
+        const size_t end = s.find(delim);
+        parts[n++] = s.substr(0, end);
+        if (end == std::string_view::npos) break;
+        s.remove_prefix(end + 1);
+    }
+    return n;
+}
+
+static double rational(std::string_view s)
 {
-    std::vector<std::string> parts = split(s,'/');
-    if (parts.size()!=2) return be_stod(s);	// no slash, so return without
+    std::string_view parts[2];
+    if (split_view(s,'/',parts,2)!=2) return be_stod(s);	// no slash, so return without
     double top = be_stod(parts[0]);
     double bot = be_stod(parts[1]);
     return bot>0 ? top / bot : top;
 }
 
-static std::string fix_gps(std::string s)
+/* appends d as std::to_string() formats it ("%f"), but without the locale or a temporary string */
+static void append_fixed(std::string &out, double d)
 {
-    std::vector<std::string> parts = split(s,' ');
-    if (parts.size()!=3) return s;	// return the original
-    double res = rational(parts[0]) + rational(parts[1])/60.0 + rational(parts[2])/3600.0;
-    return std::to_string(res);
+    char digits[64];
+#if defined(__cpp_lib_to_chars)
+    const std::to_chars_result res = std::to_chars(digits, digits + sizeof(digits), d, std::chars_format::fixed, 6);
+    if (res.ec == std::errc()) {
+        out.append(digits, res.ptr);
+        return;
+    }
+#endif
+    const int n = snprintf(digits, sizeof(digits), "%f", d);
+    if (n > 0) out.append(digits, std::min<size_t>(n, sizeof(digits) - 1));
 }
 
-static std::string fix_gps_ref(std::string s)
+/* appends the degrees, minutes and seconds of s as decimal degrees, or s if it is not three rationals */
+static void append_gps(std::string &out, std::string_view s)
+{
+    std::string_view parts[3];
+    if (split_view(s,' ',parts,3)!=3) {
+        out.append(s);	// the original
+        return;
+    }
+    append_fixed(out, rational(parts[0]) + rational(parts[1])/60.0 + rational(parts[2])/3600.0);
+}
+
+static std::string_view fix_gps_ref(std::string_view s)
 {
     if (s=="W" || s=="S") return "-";
     return "";
@@ -171,6 +233,14 @@ namespace psd_reader {
 
 
 
+exif_scanner::exif_scanner(const scanner_params &sp):
+    ss(sp.ss),
+    exif_recorder(*exif_file),
+    gps_recorder(*gps_file),
+    jpeg_recorder(*jpeg_carved_file)
+{
+}
+
 /**
  * record exif data in well-formatted XML.
  */
@@ -184,14 +254,14 @@ void exif_scanner::record_exif_data(const pos0_t &pos0, std::string hash_hex)
     // compose xml from all entries
     if (exif_debug) std::cerr << pos0 << " scan_exif recording data for entry" << std::endl;
 
-    std::stringstream sts;
-    sts << "<exif>";
+    std::string xml {"<exif>"};
+    std::string escape_buf;
     for (const auto &it: entries) {
 
         // prepare by escaping XML codes.
         if (exif_debug) std::cerr << pos0 << " scan_exif fed before xmlescape: "
-                                  << it->name << ":" << it->value << std::endl;
-        std::string prepared_value = dfxml_writer::xmlescape( it->value );
+                                  << it.name << ":" << it.value << std::endl;
+        const std::string_view prepared_value = utf8_text::xml_escaped( it.value, escape_buf );
         if (exif_debug)  std::cerr << pos0 << " scan_exif fed after xmlescape: " << prepared_value << std::endl;
 
         // do not report entries that have empty values
@@ -209,13 +279,19 @@ void exif_scanner::record_exif_data(const pos0_t &pos0, std::string hash_hex)
 
 
         if (exif_debug)  std::cerr << pos0 << "  point3" << std::endl;
-        sts << "<" << it->get_full_name() << ">" << prepared_value << "</" << it->get_full_name() << ">";
+        xml += '<';
+        it.append_full_name(xml);
+        xml += '>';
+        xml += prepared_value;
+        xml += "</";
+        it.append_full_name(xml);
+        xml += '>';
         if (exif_debug)  std::cerr << pos0 << "  point4" << std::endl;
     }
-    sts << "</exif>";
+    xml += "</exif>";
 
     // record the formatted exif entries
-    exif_recorder.write(pos0, hash_hex, sts.str());
+    exif_recorder.write(pos0, hash_hex, xml);
 }
 
 /**
@@ -223,11 +299,12 @@ void exif_scanner::record_exif_data(const pos0_t &pos0, std::string hash_hex)
  * Note that GPS data is considered to be present when a GPS IFD entry is present
  * that is not just a time or date entry.
  */
-void exif_scanner::record_gps_data(const pos0_t &pos0, std::string hash_hex)
+void exif_scanner::record_gps_data(const pos0_t &pos0, const std::string &hash_hex)
 {
-    // desired GPS strings
-    std::string gps_time, gps_date, gps_lon_ref, gps_lon, gps_lat_ref;
-    std::string gps_lat, gps_ele, gps_speed, gps_course;
+    // desired GPS strings; the numbers are formatted straight into the line
+    std::string gps_time, gps_date;
+    std::string_view gps_lon_ref, gps_lon, gps_lat_ref, gps_lat, gps_ele, gps_speed, gps_course;
+    bool has_gps_ele = false, has_gps_speed = false;
 
     // date if GPS date is not available
     std::string exif_time, exif_date;
@@ -239,8 +316,8 @@ void exif_scanner::record_gps_data(const pos0_t &pos0, std::string hash_hex)
     for ( const auto &it: entries ) {
 
         // get timestamp from EXIF IFD just in case it is not available from GPS IFD
-        if (it->name.compare("DateTimeOriginal") == 0) {
-            exif_time = it->value;
+        if (it.name == "DateTimeOriginal") {
+            exif_time.assign(it.value);
 
             if (exif_debug) std::cerr << "scan_exif.format_gps_data exif_time: " << exif_time << "\n";
 
@@ -273,12 +350,12 @@ void exif_scanner::record_gps_data(const pos0_t &pos0, std::string hash_hex)
             }
         }
 
-        if (it->ifd_type == IFD0_GPS) {
+        if (it.ifd_type == IFD0_GPS) {
 
             // get GPS values from IFD0's GPS IFD
-            if (it->name.compare("GPSTimeStamp") == 0) {
+            if (it.name == "GPSTimeStamp") {
                 has_gps_date = true;
-                gps_time = it->value;
+                gps_time.assign(it.value);
                 // reformat timestamp to standard ISO8601
                 // change "12 20 11" to "12:20:11"
                 if (gps_time.length() == 8) {
@@ -289,9 +366,9 @@ void exif_scanner::record_gps_data(const pos0_t &pos0, std::string hash_hex)
                         gps_time[7] = ':';
                     }
                 }
-            } else if (it->name.compare("GPSDateStamp") == 0) {
+            } else if (it.name == "GPSDateStamp") {
                 has_gps_date = true;
-                gps_date = it->value;
+                gps_date.assign(it.value);
                 // reformat timestamp to standard ISO8601
                 // change "2011:06:25" to "2011-06-25"
                 if (gps_date.length() == 10) {
@@ -302,27 +379,29 @@ void exif_scanner::record_gps_data(const pos0_t &pos0, std::string hash_hex)
                         gps_date[7] = '-';
                     }
                 }
-            } else if (it->name.compare("GPSLongitudeRef") == 0) {
+            } else if (it.name == "GPSLongitudeRef") {
                 has_gps = true;
-                gps_lon_ref = fix_gps_ref(it->value);
-            } else if (it->name.compare("GPSLongitude") == 0) {
+                gps_lon_ref = fix_gps_ref(it.value);
+            } else if (it.name == "GPSLongitude") {
                 has_gps = true;
-                gps_lon = fix_gps(it->value);
-            } else if (it->name.compare("GPSLatitudeRef") == 0) {
+                gps_lon = it.value;
+            } else if (it.name == "GPSLatitudeRef") {
                 has_gps = true;
-                gps_lat_ref = fix_gps_ref(it->value);
-            } else if (it->name.compare("GPSLatitude") == 0) {
+                gps_lat_ref = fix_gps_ref(it.value);
+            } else if (it.name == "GPSLatitude") {
                 has_gps = true;
-                gps_lat = fix_gps(it->value);
-            } else if (it->name.compare("GPSAltitude") == 0) {
+                gps_lat = it.value;
+            } else if (it.name == "GPSAltitude") {
                 has_gps = true;
-                gps_ele = std::to_string(rational(it->value));
-            } else if (it->name.compare("GPSSpeed") == 0) {
+                has_gps_ele = true;
+                gps_ele = it.value;
+            } else if (it.name == "GPSSpeed") {
                 has_gps = true;
-                gps_speed = std::to_string(rational(it->value));
-            } else if (it->name.compare("GPSTrack") == 0) {
+                has_gps_speed = true;
+                gps_speed = it.value;
+            } else if (it.name == "GPSTrack") {
                 has_gps = true;
-                gps_course = it->value;
+                gps_course = it.value;
             }
         }
     }
@@ -331,42 +410,48 @@ void exif_scanner::record_gps_data(const pos0_t &pos0, std::string hash_hex)
     // NOTE: desired date format is "2011-06-25T12:20:11" made from "2011:06:25" and "12 20 11"
     if (has_gps) {
         // report GPS
-        std::stringstream sts;
+        gps_line.clear();
         if (has_gps_date) {
             // use GPS data with GPS date
-            sts << gps_date << "T" << gps_time << ",";
+            gps_line.append(gps_date).append("T").append(gps_time).append(",");
         } else {
             // use GPS data with date from EXIF
-            sts << exif_time << ",";
+            gps_line.append(exif_time).append(",");
         }
-        sts << gps_lat_ref << gps_lat << "," << gps_lon_ref << gps_lon << ",";
-        sts << gps_ele << "," << gps_speed << "," << gps_course;
+        gps_line.append(gps_lat_ref);
+        append_gps(gps_line, gps_lat);
+        gps_line.append(",").append(gps_lon_ref);
+        append_gps(gps_line, gps_lon);
+        gps_line.append(",");
+        if (has_gps_ele) append_fixed(gps_line, rational(gps_ele));
+        gps_line.append(",");
+        if (has_gps_speed) append_fixed(gps_line, rational(gps_speed));
+        gps_line.append(",").append(gps_course);
 
         // record the formatted GPS entries
-        gps_recorder.write(pos0, hash_hex, sts.str());
+        gps_recorder.write(pos0, hash_hex, gps_line);
 
     } else {
         // no GPS to report
     }
 }
 
-size_t exif_scanner::process_possible_jpeg(const sbuf_t &sbuf, bool found_start)
+size_t exif_scanner::process_possible_jpeg(const sbuf_t &sbuf, const jpeg_validator::results_t *res)
 {
     // get hash for this exif
     size_t ret = 0;
     std::string hex_hash {"00000000000000000000000000000000"};
-    if (found_start){
-        jpeg_validator::results_t res = jpeg_validator::validate_jpeg(sbuf);
-        if (exif_scanner_debug) std::cerr << "res.len=" << res.len << " res.how=" << (int)(res.how) << "\n";
+    if (res){
+        if (exif_scanner_debug) std::cerr << "res.len=" << res->len << " res.how=" << (int)(res->how) << "\n";
 
         // Is it valid?
-        if (res.len <= 0) return 0;
+        if (res->len <= 0) return 0;
 
         // Should we carve?
-        if (res.how==jpeg_validator::COMPLETE || res.len > static_cast<ssize_t>(min_jpeg_size)) {
+        if (res->how==jpeg_validator::COMPLETE || res->len > static_cast<ssize_t>(min_jpeg_size)) {
             if (exif_scanner_debug) fprintf(stderr,"CARVING1\n");
-            jpeg_recorder.carve(sbuf.slice(0, res.len), ".jpg", 0);
-            ret = res.len;
+            carve_index::carve(jpeg_recorder, sbuf.slice(0, res->len), ".jpg", 0);
+            ret = res->len;
         }
 
         // Record the hash of the first 4K
@@ -395,22 +480,41 @@ void exif_scanner::scan(const sbuf_t &sbuf)
         limit = sbuf.bufsize - jpeg_validator::MIN_JPEG_SIZE;
     }
 
-    for (size_t start=0; start < limit; start++) {
+    // only the offsets at which one of the signatures is present are checked
+    signature_prefilter &prefilter = signature_prefilter::shared();
+    scratch_vector<size_t> candidates;
+    for (size_t id : {jpeg_signature, psd_signature, tiff_ii_signature, tiff_mm_signature}) {
+        const std::vector<size_t> &found = prefilter.candidates(sbuf, id);
+        candidates.insert(candidates.end(), found.begin(), found.end());
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    size_t next = 0;                    // the first offset not in a JPEG already processed
+    for (size_t start : candidates) {
+        if (start >= limit) break;
+        if (start < next) continue;
+        next = start + 1;
         // check for start of a JPEG.
         if (sbuf[start + 0] == 0xff && sbuf[start + 1] == 0xd8 &&
             sbuf[start + 2] == 0xff && (sbuf[start + 3] & 0xf0) == 0xe0) {
 
-            // Does this JPEG have an EXIF?
-            size_t possible_tiff_offset_from_exif = exif_reader::get_tiff_offset_from_exif (sbuf.slice(start));
+            // Would the JPEG be accepted? If not, do not parse its EXIF.
+            // The validation is the one it is carved by, and is shared with scan_exiv2.
+            const jpeg_validator::results_t res = jpeg_candidates::validate(sbuf, start);
+            if (res.len <= 0) {
+                continue;
+            }
+
+            // Does this JPEG have an EXIF with a valid TIFF?
+            size_t tiff_offset_from_exif = jpeg_candidates::tiff_offset(sbuf, start);
             if (exif_scanner_debug){
-                std::cerr << "scan_exif.possible_tiff_offset_from_exif "
-                          << possible_tiff_offset_from_exif << "\n";
+                std::cerr << "scan_exif.tiff_offset_from_exif "
+                          << tiff_offset_from_exif << "\n";
             }
-            if ((possible_tiff_offset_from_exif != 0)
-                && tiff_reader::is_maybe_valid_tiff(sbuf.slice(start + possible_tiff_offset_from_exif))) {
+            if (tiff_offset_from_exif != 0) {
 
                 // TIFF in Exif is valid, so process TIFF
-                size_t tiff_offset = start + possible_tiff_offset_from_exif;
+                size_t tiff_offset = start + tiff_offset_from_exif;
 
                 if (exif_scanner_debug){
                     std::cerr << "scan_exif Start processing validated Exif ffd8ff at start "
@@ -426,8 +530,8 @@ void exif_scanner::scan(const sbuf_t &sbuf)
             }
             // Try to process if it is exif or not
 
-            size_t skip_bytes = process_possible_jpeg( sbuf.slice(start), true);
-            if (skip_bytes>1) start += skip_bytes - 1; // (because the for loop will add 1)
+            size_t skip_bytes = process_possible_jpeg( sbuf.slice(start), &res);
+            if (skip_bytes>1) next = start + skip_bytes;
             if (exif_scanner_debug){
                 std::cerr << "scan_exif Done processing JPEG/Exif ffd8ff at " << start << " len=" << skip_bytes << "\n";
             }
@@ -459,9 +563,10 @@ void exif_scanner::scan(const sbuf_t &sbuf)
                     std::cerr << "scan_exif Start processing validated Photoshop 8BPS at start "
                               << start << " tiff_offset " << tiff_offset << "\n";
                 }
-                size_t skip = process_possible_jpeg(sbuf.slice(start), true);
+                const jpeg_validator::results_t res = jpeg_candidates::validate(sbuf, start);
+                size_t skip = process_possible_jpeg(sbuf.slice(start), &res);
                 // std::cerr << "2 skip=" << skip << "\n";
-                if (skip>1) start += skip-1;
+                if (skip>1) next = start + skip;
                 if (exif_scanner_debug){
                     std::cerr << "scan_exif Done processing validated Photoshop 8BPS at start "
                               << start << "\n";
@@ -490,7 +595,7 @@ void exif_scanner::scan(const sbuf_t &sbuf)
                 }
 
                 // there is no MD5 because there is no associated file for this TIFF marker
-                process_possible_jpeg(sbuf.slice(start), false);
+                process_possible_jpeg(sbuf.slice(start), nullptr);
                 if (exif_scanner_debug){
                     std::cerr << "scan_exif Done processing validated TIFF II42 or MM42 at start "
                               << start << "\n";
@@ -500,8 +605,6 @@ void exif_scanner::scan(const sbuf_t &sbuf)
     }
 }
 
-exif_scanner *escan = nullptr;
-
 extern "C"
 void scan_exif (scanner_params &sp)
 {
@@ -516,17 +619,26 @@ void scan_exif (scanner_params &sp)
         xml_flag.xml = true;
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-	sp.info->feature_defs.push_back( feature_recorder_def("exif", xml_flag));
-	sp.info->feature_defs.push_back( feature_recorder_def("gps"));
-	sp.info->feature_defs.push_back( feature_recorder_def("jpeg_carved", carve_flag));
+	sp.info->feature_defs.push_back( exif_file.def(xml_flag));
+	sp.info->feature_defs.push_back( gps_file.def());
+	sp.info->feature_defs.push_back( jpeg_carved_file.def(carve_flag));
         sp.get_scanner_config("exif_debug",&exif_debug,"debug exif decoder");
+        sp.get_scanner_config("exif_sector_aligned",&exif_sector_aligned,
+                              "At depth 0, look for JPEGs only at sector boundaries (misses JPEGs embedded in other files)");
 	return;
     }
     if (sp.phase==scanner_params::PHASE_INIT2) {
-        /* Nothing to do here */
+        exif_file.resolve(sp);
+        gps_file.resolve(sp);
+        jpeg_carved_file.resolve(sp);
+        signature_prefilter &prefilter = signature_prefilter::shared();
+        jpeg_signature    = prefilter.add(std::string("\xff\xd8\xff", 3), 0, 1, exif_sector_aligned ? 512 : 1);
+        psd_signature     = prefilter.add(std::string("8BPS\x00\x01", 6));
+        tiff_ii_signature = prefilter.add(std::string("II\x2a\x00", 4));
+        tiff_mm_signature = prefilter.add(std::string("MM\x00\x2a", 4));
     }
     if (sp.phase==scanner_params::PHASE_SCAN){
-        escan = new exif_scanner(sp);
-        escan->scan(*sp.sbuf);
+        exif_scanner escan(sp);         // its entries are reused for each JPEG in the sbuf
+        escan.scan(*sp.sbuf);
     }
 }
@@ -12,12 +12,7 @@ struct exif_scanner {
     exif_scanner(const exif_scanner&) = delete;
     exif_scanner & operator=(const exif_scanner &) = delete;
 
-    exif_scanner(const scanner_params &sp):
-        ss(sp.ss),
-        exif_recorder(sp.named_feature_recorder("exif")),
-        gps_recorder(sp.named_feature_recorder("gps")),
-        jpeg_recorder(sp.named_feature_recorder("jpeg_carved")) {
-    }
+    exif_scanner(const scanner_params &sp);     // after scan_exif's PHASE_INIT2, which finds its recorders
 
     entry_list_t entries {};
     scanner_set *ss;            //  for the hashing function
@@ -31,13 +26,16 @@ struct exif_scanner {
 
     void record_exif_data(const pos0_t &pos0, std::string hash_hex);
 
-    void record_gps_data(const pos0_t &pos0, std::string hash_hex);
+    void record_gps_data(const pos0_t &pos0, const std::string &hash_hex);
+    std::string gps_line {};    // the gps feature, reused from one JPEG to the next
 
     /**
      * Process the JPEG, including - calculate its hash, carve it, record exif and gps data
+     * res is the validation of the JPEG at the start of sbuf (jpeg_candidates::validate()), or nullptr
+     * if there is no JPEG start to process.
      * Return the size of the object carved, or 0 if unknown
      */
-    size_t process_possible_jpeg(const sbuf_t &sbuf,bool found_start);
+    size_t process_possible_jpeg(const sbuf_t &sbuf, const jpeg_validator::results_t *res);
     void   scan(const sbuf_t &sbuf);    // scan and possibly carve
 };
 
@@ -19,6 +19,8 @@
 #include "be13_api/utils.h"// needs config.h
 
 #include "dfxml_cpp/src/dfxml_writer.h"
+#include "jpeg_candidates.h"
+#include "recorder_handle.h"
 
 
 //#include "md5.h"
@@ -33,9 +35,13 @@
 #pragma GCC diagnostic ignored "-Weffc++"
 #endif
 
+#include <exiv2/basicio.hpp>
 #include <exiv2/image.hpp>
 #include <exiv2/exif.hpp>
 #include <exiv2/error.hpp>
+#include <exiv2/version.hpp>
+
+using std::string;
 
 const size_t min_exif_size = 4096;
 const size_t exif_gulp_size = 1024*1024;	// how many bytes of EXIF to read
@@ -50,6 +56,51 @@ inline bool jpeg_start(const sbuf_t &sbuf){
 	    && sbuf[2]==(unsigned char)'\xff');
 }
 
+/*
+ * sbuf_io:
+ * A candidate's bytes for exiv2, read where they are in the sbuf. exiv2's MemIo refers to a const
+ * buffer until it is written to, which reading the metadata never does, so this is a MemIo over
+ * the sbuf that exiv2 reports by the candidate's forensic path.
+ */
+class sbuf_io : public Exiv2::MemIo {
+public:
+    sbuf_io(const sbuf_t &sbuf, size_t pos, size_t count):
+        Exiv2::MemIo(sbuf.get_buf() + pos, count), where((sbuf.pos0 + pos).str()) {}
+#if EXIV2_TEST_VERSION(0,28,0)
+    const std::string &path() const noexcept override { return where; }
+#else
+    std::string path() const override { return where; }
+#endif
+private:
+    const std::string where;
+};
+
+#if EXIV2_TEST_VERSION(0,28,0)
+typedef Exiv2::Image::UniquePtr image_ptr;
+#else
+typedef Exiv2::Image::AutoPtr image_ptr;
+#endif
+
+/*
+ * The image at pos, or nullptr. exiv2 is only given the candidates that look like images: JPEGs
+ * whose headers jpeg_validator accepts, and blocks that start with the signature of a type exiv2
+ * reads, so that the garbage at most places is turned away without exiv2 throwing. The JPEG
+ * validation is shared with scan_exif, which has usually validated the JPEG already.
+ */
+static image_ptr open_image(const sbuf_t &sbuf, size_t pos, size_t count)
+{
+    if (jpeg_start(sbuf.slice(pos))) {
+        if (!jpeg_candidates::headers_valid(sbuf, pos)) return nullptr;
+    } else if (pos%512!=0 || Exiv2::ImageFactory::getType(sbuf.get_buf() + pos, count) == Exiv2::ImageType::none) {
+        return nullptr;
+    }
+#if EXIV2_TEST_VERSION(0,28,0)
+    return Exiv2::ImageFactory::open(std::make_unique<sbuf_io>(sbuf, pos, count));
+#else
+    return Exiv2::ImageFactory::open(Exiv2::BasicIo::AutoPtr(new sbuf_io(sbuf, pos, count)));
+#endif
+}
+
 static size_t min(size_t a,size_t b)
 {
     return a<b ? a : b;
@@ -101,26 +152,33 @@ static string fix_gps_ref(string s)
 }
 
 int exif_show_all=1;
+static recorder_handle exif_file {"exif"};
+static recorder_handle gps_file {"gps"};
+
 extern "C"
 void scan_exiv2(struct scanner_params &sp)
 {
     sp.check_version();
     if(sp.phase==scanner_params::PHASE_INIT){
-        sp.info.set_name("exiv2" );
+        sp.info->set_name("exiv2" );
         sp.info->author         = "Simson L. Garfinkel";
         sp.info->description    = "Searches for EXIF information using exiv2. Use exif scanner if this is not available or if this crashes.";
         sp.info->scanner_flags.default_enabled = false;
         sp.info->scanner_version= "1.1";
-	sp.info->feature_defs.push_back( feature_recorder_def("exif"));
-	sp.info->feature_defs.push_back( feature_recorder_def("gps"));
+	sp.info->feature_defs.push_back( exif_file.def());
+	sp.info->feature_defs.push_back( gps_file.def());
 	return;
     }
     if(sp.phase==scanner_params::PHASE_SHUTDOWN) return;
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        exif_file.resolve(sp);
+        gps_file.resolve(sp);
+    }
     if(sp.phase==scanner_params::PHASE_SCAN){
 
-	const sbuf_t &sbuf = sp.sbuf;
-	feature_recorder &exif_recorder = sp.named_feature_recorder("exif");
-	feature_recorder &gps_recorder  = sp.named_feature_recorder("gps");
+	const sbuf_t &sbuf = *sp.sbuf;
+	feature_recorder &exif_recorder = *exif_file;
+	feature_recorder &gps_recorder  = *gps_file;
 
 #ifdef HAVE_EXIV2__LOGMSG__SETLEVEL
 	/* New form to suppress error messages on exiv2 */
@@ -142,10 +200,10 @@ void scan_exiv2(struct scanner_params &sp)
 	     * of any JPEG on any boundary. This will cause processing of any multimedia file
 	     * that Exiv2 recognizes (for which I do not know all the headers.
 	     */
-	    if(pos%512==0 || jpeg_start(sbuf+pos)){
+	    if(pos%512==0 || jpeg_start(sbuf.slice(pos))){
 		try {
-		    Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(sbuf.buf+pos,count);
-		    if(image->good()){
+		    image_ptr image = open_image(sbuf,pos,count);
+		    if(image && image->good()){
 			image->readMetadata();
 
 			Exiv2::ExifData &exifData = image->exifData();
@@ -154,8 +212,7 @@ void scan_exiv2(struct scanner_params &sp)
 			/*
 			 * Create the MD5 of the first 4K to use as a unique identifier.
 			 */
-			sbuf_t tohash(sbuf,0,4096);
-			string md5_hex = exif_recorder->fs.hasher.func(tohash.buf,tohash.bufsize);
+			string md5_hex = sp.ss->hash(sbuf_t(sbuf,0,4096));
 
 			char xmlbuf[1024];
 			snprintf(xmlbuf,sizeof(xmlbuf),
@@ -263,20 +320,20 @@ void scan_exiv2(struct scanner_params &sp)
 			xml.append("</exiv2>");
 
                         // record EXIF
-			exif_recorder->write(sp.sbuf.pos0+pos,md5_hex,xml);
+			exif_recorder.write(sbuf.pos0+pos,md5_hex,xml);
 
                         // record GPS
                         if (has_gps) {
                             if (has_gps_date) {
                                 // record the GPS entry using the GPS date
-                                gps_recorder->write(sp.sbuf.pos0+pos,md5_hex,
+                                gps_recorder.write(sbuf.pos0+pos,md5_hex,
 					    gps_date+"T"+gps_time+","+gps_lat_ref+gps_lat+","
 					    +gps_lon_ref+gps_lon+","
 					    +gps_ele+","+gps_speed+","+gps_course);
 
                             } else {
                                 // record the GPS entry using the date obtained from Photo
-                                gps_recorder->write(sp.sbuf.pos0+pos,md5_hex,
+                                gps_recorder.write(sbuf.pos0+pos,md5_hex,
 					    photo_time+","+gps_lat_ref+gps_lat+","
 					    +gps_lon_ref+gps_lon+","
 					    +gps_ele+","+gps_speed+","+gps_course);
@@ -284,8 +341,7 @@ void scan_exiv2(struct scanner_params &sp)
 			}
 		    }
 		}
-		catch (Exiv2::AnyError &e) { }
-		catch (std::exception &e) { }
+		catch (std::exception &e) { }	// exiv2's errors too
 	    }
 	}
     }
@@ -10,6 +10,8 @@
 
 #include "be13_api/scanner_params.h"
 #include "be13_api/scanner_set.h"
+#include "recorder_handle.h"
+#include "signature_prefilter.h"
 
 
 struct used_offsets_t {
@@ -46,6 +48,9 @@ static const char *facebook_searches[] = {"hovercard/page",
                                           "facebook.com/profile.php",
                                           "timelineUnitContainer",
                                           0};
+static std::vector<size_t> facebook_signatures; // of facebook_searches, in the signature_prefilter
+
+static recorder_handle facebook_file {"facebook"};
 
 extern "C"
 void scan_facebook(scanner_params &sp)
@@ -56,17 +61,25 @@ void scan_facebook(scanner_params &sp)
         sp.info->author = "";
         sp.info->description = "Searches for facebook html and json tags";
         sp.info->scanner_version = "2.0";
-        sp.info->feature_defs.push_back( feature_recorder_def("facebook"));
+        sp.info->feature_defs.push_back( facebook_file.def());
+        return;
+    }
+    if (sp.phase==scanner_params::PHASE_INIT2) {
+        facebook_file.resolve(sp);
+        facebook_signatures.clear();
+        for (int j = 0; facebook_searches[j]; j++) {
+            facebook_signatures.push_back(signature_prefilter::shared().add(facebook_searches[j], 0, 1, 1, true));
+        }
         return;
     }
     if (sp.phase==scanner_params::PHASE_SCAN) {
-        feature_recorder &facebook_recorder = sp.named_feature_recorder("facebook");
+        feature_recorder &facebook_recorder = *facebook_file;
         used_offsets_t used_offsets;
 
-        for (int j = 0; facebook_searches[j]; j++) {
-            const char *text_search = facebook_searches[j];
+        for (size_t j = 0; j < facebook_signatures.size(); j++) {
+            const std::vector<size_t> &found = signature_prefilter::shared().candidates(*sp.sbuf, facebook_signatures[j]);
             for (size_t i = 0;  i+50 < sp.sbuf->bufsize; i++) {
-                ssize_t location = sp.sbuf->find(text_search, i);
+                ssize_t location = signature_prefilter::next(found, i);
                 if (location < 1) break;
                 if (used_offsets.value_used(location)) {
                     i = location + used_offsets_t::window;
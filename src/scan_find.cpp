@@ -6,16 +6,18 @@
 
 #include "be13_api/scanner_params.h"
 #include "be13_api/scanner_set.h"
-#include "be13_api/regex_vector.h"
 #include "be13_api/utils.h" // needs config.h
 #include "findopts.h"
+#include "find_patterns.h"
+#include "heavy_hitters.h"
+#include "recorder_handle.h"
 
 // anonymous namespace hides symbols from other cpp files (like "static" applied to functions)
 // TODO: make this not a global variable
 namespace {
-    regex_vector find_list;
+    find_patterns find_list;
     void add_find_pattern(const std::string &pat) {
-        find_list.push_back("(" + pat + ")"); // make a group
+        find_list.add(pat);
     }
 
     void process_find_file(const char *findfile) {
@@ -38,6 +40,8 @@ namespace {
     }
 }
 
+static recorder_handle find_file {"find"};
+
 extern "C"
 void scan_find(scanner_params &sp)
 {
@@ -49,20 +53,22 @@ void scan_find(scanner_params &sp)
         sp.info->description    = "Simple search for patterns";
         sp.info->scanner_version= "1.1";
         sp.info->scanner_flags.find_scanner = true; // this is a find scanner
-        sp.info->feature_defs.push_back( feature_recorder_def("find"));
+        sp.info->feature_defs.push_back( find_file.def());
         auto lowercase = histogram_def::flags_t(); lowercase.lowercase = true;
-      	sp.info->histogram_defs.push_back( histogram_def("find", "find", "", "","histogram", lowercase));
+      	heavy_hitters::add_def(sp, histogram_def("find", "find", "", "","histogram", lowercase));
         return;
     }
     if(sp.phase==scanner_params::PHASE_SHUTDOWN) return;
 
-    if (scanner_params::PHASE_INIT == sp.phase) {
+    if (scanner_params::PHASE_INIT2 == sp.phase) {
+        find_file.resolve(sp);
         for (const auto &it : FindOpts::get().Patterns) {
             add_find_pattern(it);
         }
         for (const auto &it : FindOpts::get().Files) {
             process_find_file(it.c_str());
         }
+        find_list.compile();
     }
 
     if(sp.phase==scanner_params::PHASE_SCAN) {
@@ -72,36 +78,10 @@ void scan_find(scanner_params &sp)
             return;
         }
 
-        /* The current regex library treats \0 as the end of a string.
-         * So we make a copy of the current buffer to search that's one bigger, and the copy has a \0 at the end.
-         * This is super-wasteful. Does Lightgrep have this problem?
-         */
-        feature_recorder &f = sp.named_feature_recorder("find");
-
-        auto *tbuf = sbuf_t::sbuf_malloc(sp.sbuf->pos0, sp.sbuf->bufsize+1, sp.sbuf->bufsize+1);
-        memcpy(tbuf->malloc_buf(), sp.sbuf->get_buf(), sp.sbuf->bufsize);
-        const char *base = static_cast<const char *>(tbuf->malloc_buf());
-        tbuf->wbuf(sp.sbuf->bufsize, 0); // null terminate
-
-        /* Now see if we can find a string */
-        for (size_t pos = 0; pos < sp.sbuf->pagesize && pos < sp.sbuf->bufsize;) {
-            std::string found;
-            size_t offset=0;
-            size_t len = 0;
-            if ( find_list.search_all( base+pos, &found, &offset, &len)) {
-                if(len == 0) {
-                    len+=1;
-                    continue;
-                }
-                f.write_buf( *sp.sbuf, pos+offset, len);
-                pos += offset+len;
-            } else {
-                /* nothing was found; skip past the first \0 and repeat. */
-                const char *eos = static_cast<const char *>(memchr( base+pos, '\000', sp.sbuf->bufsize-pos));
-                if (eos) pos=(eos-base)+1;		// skip 1 past the \0
-                else     pos=sp.sbuf->bufsize;	// skip to the end of the buffer
-            }
+        /* Every pattern in one pass over the page; matches may run into the margin */
+        feature_recorder &f = *find_file;
+        for (const auto &m : find_list.search(sp.sbuf->get_buf(), sp.sbuf->bufsize, sp.sbuf->pagesize)) {
+            f.write_buf( *sp.sbuf, m.pos, m.len);
         }
-        delete tbuf;
     }
 }
@@ -8,6 +8,7 @@
 #include "be13_api/scanner_params.h"
 
 #include "pattern_scanner.h"
+#include "recorder_handle.h"
 
 namespace gps {
   const char* const DefaultEncodingsCStrings[] = {"UTF-8", "UTF-16LE"};
@@ -70,7 +71,7 @@ namespace gps {
     virtual void init(const scanner_params& sp);
     virtual void initScan(const scanner_params&);
 
-      feature_recorder* Recorder {};
+    feature_recorder* Recorder;
 
     void trkptHandler(const LG_SearchHit& hit, const scanner_params& sp);
 
@@ -92,13 +93,12 @@ namespace gps {
   };
 
   void Scanner::startup(const scanner_params& sp) {
-      sp.check_version();
-
-    sp.info->name            = "gps_lg";
+    sp.info->set_name("gps_lg");
     sp.info->author          = "Simson L. Garfinkel";
-    sp.info->description     = "Garmin Trackpt XML info";
-    sp.info->scanner_version = "1.0";
-    sp.info->feature_defs.push_back( feature_recorder_def("gps"));
+    sp.info->description     = "Garmin Trackpt XML info (lightgrep)";
+    sp.info->scanner_version = "1.1";
+    sp.info->scanner_flags.default_enabled = false; // duplicates gps
+    sp.info->feature_defs.push_back( recorder_handle::make_def("gps"));
   }
 
   void Scanner::init(const scanner_params& sp) {
@@ -168,7 +168,7 @@ namespace gps {
       const string what = Time + "," + Lat + "," + Lon + "," +
                           Ele + "," + Speed + "," + Course;
       // NB: the pos is the *end* of the "hit"
-      Recorder->write(sp.sbuf.pos0 + pos, what, "");
+      Recorder->write(sp.sbuf->pos0 + pos, what, "");
 
       Time.clear();
       Lat.clear();
@@ -179,26 +179,32 @@ namespace gps {
     }
   }
 
+  // the text of a hit
+  inline string hit_text(const LG_SearchHit& hit, const scanner_params& sp) {
+    return sp.sbuf->substr(hit.Start, hit.End - hit.Start);
+  }
+
   void Scanner::trkptHandler(const LG_SearchHit& hit, const scanner_params& sp) {
     clear(sp, hit.Start);
-    Lat = get_quoted_attrib(reinterpret_cast<const char*>(sp.sbuf.buf), "lat");
-    Lon = get_quoted_attrib(reinterpret_cast<const char*>(sp.sbuf.buf), "lon");
+    const string text = hit_text(hit, sp);
+    Lat = get_quoted_attrib(text, "lat");
+    Lon = get_quoted_attrib(text, "lon");
   }
 
   void Scanner::eleHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    Ele = get_cdata(reinterpret_cast<const char*>(sp.sbuf.buf));
+    Ele = get_cdata(hit_text(hit, sp));
   }
 
   void Scanner::timeHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    Time = get_cdata(reinterpret_cast<const char*>(sp.sbuf.buf));
+    Time = get_cdata(hit_text(hit, sp));
   }
 
   void Scanner::speedHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    Speed = get_cdata(reinterpret_cast<const char*>(sp.sbuf.buf));
+    Speed = get_cdata(hit_text(hit, sp));
   }
 
   void Scanner::courseHandler(const LG_SearchHit& hit, const scanner_params& sp) {
-    Course = get_cdata(reinterpret_cast<const char*>(sp.sbuf.buf));
+    Course = get_cdata(hit_text(hit, sp));
   }
 
   Scanner TheScanner;
@@ -206,7 +212,7 @@ namespace gps {
 
 extern "C"
 void scan_gps_lg(scanner_params &sp) {
-  scan_lg(gps::TheScanner, sp, rcb);
+  scan_lg(gps::TheScanner, sp);
 }
 
 #endif // HAVE_LIBLIGHTGREP
@@ -6,10 +6,15 @@
 
 #include "config.h"
 
+#include "content_cache.h"
 #include "sbuf_decompress.h"
 #include "be13_api/scanner_params.h"
 
 uint32_t   gzip_max_uncompr_size = 256*1024*1024; // don't decompress objects larger than this
+bool       gzip_stream = false;                   // decompress as a stream of page-sized children
+uint64_t   gzip_stream_max_size = 0;              // limit of a stream; 0 for none
+uint32_t   gzip_stream_pagesize = 16*1024*1024;
+uint32_t   gzip_stream_margin   = 4*1024*1024;
 
 extern "C"
 void scan_gzip(scanner_params &sp)
@@ -22,6 +27,10 @@ void scan_gzip(scanner_params &sp)
         sp.info->scanner_version= "1.1";
         sp.info->scanner_flags.recurse = true;
         sp.get_scanner_config("gzip_max_uncompr_size",&gzip_max_uncompr_size,"maximum size for decompressing GZIP objects");
+        sp.get_scanner_config("gzip_stream",&gzip_stream,"decompress GZIP objects as a stream of page-sized children, without gzip_max_uncompr_size");
+        sp.get_scanner_config("gzip_stream_max_size",&gzip_stream_max_size,"maximum size of a streamed GZIP object (0 for no limit)");
+        sp.get_scanner_config("gzip_stream_pagesize",&gzip_stream_pagesize,"page size of the children of a streamed GZIP object");
+        sp.get_scanner_config("gzip_stream_margin",&gzip_stream_margin,"margin of the children of a streamed GZIP object");
 	return ;		/* no features */
     }
     if (sp.phase==scanner_params::PHASE_SCAN){
@@ -34,12 +43,21 @@ void scan_gzip(scanner_params &sp)
 	     * http://www.15seconds.com/Issue/020314.htm
 	     *
 	     */
-            if( sbuf_decompress::is_gzip_header( sbuf, i)){
+            if( sbuf_decompress::is_gzip_header( sbuf, i) &&
+                sbuf_decompress::gzip_plausible( sbuf.get_buf() + i, sbuf.bufsize - i)){
+                if (gzip_stream) {
+                    sbuf_decompress::stream_decompress( sbuf.slice(i), "GZIP", sbuf_decompress::mode_t::GZIP, 0,
+                                                        gzip_stream_pagesize, gzip_stream_margin, gzip_stream_max_size,
+                                                        [&sp](sbuf_t *child) {
+                                                            content_cache::recurse(sp, child); // recurse will free the sbuf
+                                                        });
+                    continue;
+                }
                 auto *decomp = sbuf_decompress::sbuf_new_decompress( sbuf.slice(i),
                                                                      gzip_max_uncompr_size, "GZIP" ,sbuf_decompress::mode_t::GZIP, 0);
                 if (decomp==nullptr) continue;
                 assert(sbuf.depth() +1 == decomp->depth());
-                sp.recurse(decomp);      // recurse will free the sbuf
+                content_cache::recurse(sp, decomp);      // recurse will free the sbuf
             }
 	}
     }
@@ -6,6 +6,7 @@
 #include "be13_api/scanner_params.h"
 
 #include "image_process.h"
+#include "memory_governor.h"
 #include "pyxpress.h"
 
 #define SCANNER_NAME "HIBERFILE"
@@ -20,9 +21,13 @@
 #endif
 #include <zlib.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <iomanip>
 #include <cassert>
+#include <thread>
+#include <vector>
 
 //const uint32_t windows_page_size = 4096;
 const uint32_t min_uncompr_size = 4096; // allow at least this much when uncompressing
@@ -35,6 +40,32 @@ const uint32_t MIN_COMPRESSED_SIZE = 512; // don't decompress something smaller
 
 const uint8_t PYEXPRESS_HEADER[] = {0x81, 0x81, 0x78, 0x70, 0x72, 0x65, 0x73, 0x73 };
 
+/* -S hiberfile_parallel: find every block first, decompress them on several threads into an arena,
+ * and recurse into children of up to hiberfile_pagesize bytes of coalesced output.
+ */
+static bool     hiberfile_parallel = false;
+static uint32_t hiberfile_threads  = 0;                // 0 for the number of cores
+static uint32_t hiberfile_pagesize = 16*1024*1024;
+static uint64_t hiberfile_arena    = 256*1024*1024;    // decompression space for one batch of blocks
+
+struct xpress_block {
+    size_t pos;                         // of the header in the sbuf
+    size_t compr_size;
+    size_t max_uncompr_size;
+    size_t arena_offset {0};
+    size_t uncompr_size {0};            // 0 if the block did not decompress
+};
+
+/* The length of the block whose header is at pos, rounded as Hibr2bin does */
+static u_int xpress_compressed_length(const sbuf_t &sbuf, size_t pos)
+{
+    u_int compressed_length = (   (sbuf[pos+8]
+                                   + (sbuf[pos+9]<<8)
+                                   + (sbuf[pos+10] << 16)
+                                   + (sbuf[pos+11]<<24)) >> 10) + 1; // ref: Hibr2bin/MemoryBlocks.cpp
+    return (compressed_length + 7) & ~7; // ref: Hibr2bin/MemoryBlocks.cpp
+}
+
 
 void scan_hiberfile_scan(scanner_params &sp)
 {
@@ -54,12 +85,7 @@ void scan_hiberfile_scan(scanner_params &sp)
         if (npos==-1) break;             // header not found
 
         pos = npos;
-        u_int compressed_length = (   (sbuf[pos+8]
-                                       + (sbuf[pos+9]<<8)
-                                       + (sbuf[pos+10] << 16)
-                                       + (sbuf[pos+11]<<24)) >> 10) + 1; // ref: Hibr2bin/MemoryBlocks.cpp
-
-        compressed_length = (compressed_length + 7) & ~7; // ref: Hibr2bin/MemoryBlocks.cpp
+        u_int compressed_length = xpress_compressed_length(sbuf, pos);
         const u_char *compressed_buf = sbuf.get_buf() + pos + 32;		 // "the header contains 32 bytes"
         u_int  remaining_size = sbuf.bufsize - (pos+32); // up to the end of the buffer
         size_t compr_size = compressed_length < remaining_size ? compressed_length : remaining_size;
@@ -68,6 +94,7 @@ void scan_hiberfile_scan(scanner_params &sp)
             max_uncompr_size = min_uncompr_size; // it should at least be this large!
         }
 
+        memory_governor::wait_for_budget(max_uncompr_size, sbuf.depth() + 1);
         auto *decomp_sbuf = sbuf_t::sbuf_malloc(sbuf.pos0 + pos + "HIBERFILE", max_uncompr_size, max_uncompr_size);
         u_char *decomp_buf = reinterpret_cast<u_char *>(decomp_sbuf->malloc_buf());
 
@@ -94,6 +121,91 @@ void scan_hiberfile_scan(scanner_params &sp)
     }
 }
 
+/* Decompress the blocks [first, last) in parallel, each into its own slot of the arena */
+static void decompress_blocks(const sbuf_t &sbuf, std::vector<xpress_block> &blocks, size_t first, size_t last,
+                              std::vector<u_char> &arena)
+{
+    size_t arena_size = 0;
+    for (size_t i = first; i < last; i++) {
+        blocks[i].arena_offset = arena_size;
+        arena_size += blocks[i].max_uncompr_size;
+    }
+    if (arena.size() < arena_size) arena.resize(arena_size);
+
+    std::atomic<size_t> next {first};
+    auto worker = [&sbuf, &blocks, &arena, &next, last]() {
+        for (size_t i; (i = next++) < last; ) {
+            xpress_block &b = blocks[i];
+            const u_char *compressed_buf = sbuf.get_buf() + b.pos + 32;   // "the header contains 32 bytes"
+            long decompress_size = Xpress_Decompress(compressed_buf, b.compr_size,
+                                                     arena.data() + b.arena_offset, b.max_uncompr_size);
+            b.uncompr_size = decompress_size > 0 ? decompress_size : 0;
+        }
+    };
+    const size_t cores    = hiberfile_threads ? hiberfile_threads : std::max(std::thread::hardware_concurrency(), 1U);
+    const size_t nthreads = std::min(cores, last - first);
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nthreads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+void scan_hiberfile_scan_parallel(scanner_params &sp)
+{
+    const sbuf_t &sbuf = *(sp.sbuf);
+
+    /* Locate the blocks, stepping over each as the serial scan does */
+    std::vector<xpress_block> blocks;
+    for (size_t pos = 0; pos + MIN_COMPRESSED_SIZE < sbuf.bufsize; ) {
+        ssize_t npos = sbuf.findbin(PYEXPRESS_HEADER, sizeof(PYEXPRESS_HEADER), pos);
+        if (npos==-1) break;             // header not found
+        pos = npos;
+        if (pos + 32 >= sbuf.bufsize) break;
+        u_int compressed_length = xpress_compressed_length(sbuf, pos);
+        size_t compr_size = std::min<size_t>(compressed_length, sbuf.bufsize - (pos+32));
+        blocks.push_back(xpress_block{pos, compr_size, std::max<size_t>(compr_size * 10, min_uncompr_size)});
+        pos += compressed_length;
+    }
+
+    /* The arena is the thread's, and kept: hibernation files are scanned one page after another */
+    thread_local std::vector<u_char> arena;
+    for (size_t first = 0; first < blocks.size(); ) {
+        size_t last = first;
+        uint64_t batch = 0;
+        while (last < blocks.size() && (last == first || batch + blocks[last].max_uncompr_size <= hiberfile_arena)) {
+            batch += blocks[last++].max_uncompr_size;
+        }
+        memory_governor::wait_for_budget(batch, sbuf.depth() + 1);
+        decompress_blocks(sbuf, blocks, first, last, arena);
+
+        /* Coalesce the output, in block order, into children of at most hiberfile_pagesize bytes.
+         * A child's forensic path is that of its first block; like the serial scan, this treats
+         * the blocks as swap space, in which logically unrelated pages are adjacent.
+         */
+        for (size_t i = first; i < last; ) {
+            if (blocks[i].uncompr_size == 0) { i++; continue; }
+            size_t j = i, child_size = 0;
+            while (j < last && (j == i || child_size + blocks[j].uncompr_size <= hiberfile_pagesize)) {
+                child_size += blocks[j++].uncompr_size;
+            }
+            memory_governor::wait_for_budget(child_size, sbuf.depth() + 1);
+            auto *child = sbuf_t::sbuf_malloc(sbuf.pos0 + blocks[i].pos + "HIBERFILE", child_size, child_size);
+            u_char *out = reinterpret_cast<u_char *>(child->malloc_buf());
+            for (size_t k = i; k < j; k++) {
+                memcpy(out, arena.data() + blocks[k].arena_offset, blocks[k].uncompr_size);
+                out += blocks[k].uncompr_size;
+            }
+            sp.recurse( child );            // will delete the child
+            i = j;
+        }
+        first = last;
+    }
+}
+
 extern "C"
 void scan_hiberfile(scanner_params &sp)
 {
@@ -108,6 +220,10 @@ void scan_hiberfile(scanner_params &sp)
         sp.info->scanner_flags.scanner_produces_memory = true;
         sp.info->scanner_flags.recurse = true;
         sp.info->min_sbuf_size         = MIN_COMPRESSED_SIZE;
+        sp.get_scanner_config("hiberfile_parallel",&hiberfile_parallel,"Decompress all of the Xpress blocks in a buffer in parallel and coalesce the output");
+        sp.get_scanner_config("hiberfile_threads",&hiberfile_threads,"Threads for hiberfile_parallel (0 for the number of cores)");
+        sp.get_scanner_config("hiberfile_pagesize",&hiberfile_pagesize,"Largest child of coalesced output for hiberfile_parallel");
+        sp.get_scanner_config("hiberfile_arena",&hiberfile_arena,"Decompression space for one batch of blocks for hiberfile_parallel");
 	return; /* no features */
     }
     if (sp.phase==scanner_params::PHASE_SHUTDOWN) return;
@@ -125,7 +241,11 @@ void scan_hiberfile(scanner_params &sp)
 	}
 
         try {
-            scan_hiberfile_scan(sp);
+            if (hiberfile_parallel) {
+                scan_hiberfile_scan_parallel(sp);
+            } else {
+                scan_hiberfile_scan(sp);
+            }
         }
         catch (const sbuf_t::range_exception_t &e) {
             // oh well.
@@ -9,7 +9,17 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "be13_api/scanner_params.h"
+#include "recorder_handle.h"
+#include "scratch_arena.h"
+#include "signature_prefilter.h"
 
 /* We accept printable ASCII characters and \n, \r only */
 bool isok(const char chr)
@@ -25,26 +35,21 @@ bool isdigit(const char chr)
     return false;
 }
 
-/* Check if the string starts (!) with a valid dotted quad (IP address) */
-bool validDottedQuad(std::string str)
+/* Check if buf[0, len) starts (!) with a valid dotted quad (IP address) */
+bool validDottedQuad(const uint8_t *buf, size_t len)
 {
     unsigned long val = 0;
     unsigned int dots = 0;
     bool partpresent = false;
-    char c;
-
-    std::string::iterator i = str.begin();
-    while(i != str.end()) {
-        c = *i;
-        for(;;) {
-            if(isdigit(c) && (i != str.end())) {
-                partpresent = true;
-                val = val * 10 + (c - '0');
-                i++;
-                c = *i;
-            } else break;
+    size_t i = 0;
+
+    while(i < len) {
+        while((i < len) && isdigit(buf[i])) {
+            partpresent = true;
+            val = val * 10 + (buf[i] - '0');
+            i++;
         }
-        if((c == '.') && partpresent && (i != str.end())) {
+        if((i < len) && (buf[i] == '.') && partpresent) {
             if((val > 255) || (dots > 3)) return false;
             val = 0;
             dots++;
@@ -55,7 +60,85 @@ bool validDottedQuad(std::string str)
     return ((dots == 3) && partpresent && (val <= 255));
 }
 
+bool validDottedQuad(std::string str)
+{
+    return validDottedQuad(reinterpret_cast<const uint8_t *>(str.data()), str.size());
+}
+
+namespace {
+    /* The request methods, in the signature_prefilter. We support the following methods:
+     * GET, HEAD, POST, PUT, DELETE, TRACE, OPTIONS, CONNECT;
+     * and the following protocol versions: HTTP/1.1, HTTP/1.0, HTTP/0.9.
+     *
+     * Request lines are similar to these:
+     *  - HTTP/1.1: GET / HTTP/1.1
+     *  - HTTP/1.0: GET / HTTP/1.0
+     *  - HTTP/0.9: GET /
+     *
+     * The plugin should output access log entries even for incorrect requests (like POST in HTTP/0.9).
+     */
+    const char *methods[] = {"GET ", "HEAD ", "POST ", "PUT ", "DELETE ", "TRACE ", "OPTIONS ", "CONNECT ", 0};
+    std::vector<size_t> method_signatures;
+
+    const size_t LINE_SEARCH = 1024;    // how far a request line's ends are looked for
+
+    /* The bytes that end a line: \n and the ones that are not isok(), one bit per byte of buf */
+    class line_breaks {
+        scratch_vector<uint64_t> bits {};
+        size_t len {0};
+    public:
+        line_breaks(const uint8_t *buf, size_t len_) : bits((len_ + 63) / 64), len(len_) {
+            size_t i = 0;
+#if defined(__SSE2__)
+            const __m128i below = _mm_set1_epi8(' ' - 1);
+            const __m128i above = _mm_set1_epi8(0x7f);
+            const __m128i cr    = _mm_set1_epi8('\r');
+            for (; i + 16 <= len; i += 16) {
+                /* the printable bytes are the ones that are signed between 0x1f and 0x7f */
+                const __m128i b  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i));
+                const __m128i ok = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(b, below), _mm_cmplt_epi8(b, above)),
+                                                _mm_cmpeq_epi8(b, cr));
+                const uint64_t mask = ~_mm_movemask_epi8(ok) & 0xffff;
+                bits[i / 64] |= mask << (i % 64);
+            }
+#endif
+            for (; i < len; i++) {
+                if (buf[i] == '\n' || !isok(buf[i])) bits[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+
+        /* the first break in [from, to), or to if there is none */
+        size_t next(size_t from, size_t to) const {
+            to = std::min(to, len);
+            for (size_t w = from / 64; from < to; w++, from = w * 64) {
+                const uint64_t word = bits[w] & (~uint64_t(0) << (from % 64));
+                if (word) return std::min(to, w * 64 + __builtin_ctzll(word));
+            }
+            return to;
+        }
+
+        /* the last break in [from, to), or to if there is none */
+        size_t prev(size_t from, size_t to) const {
+            const size_t none = to;
+            to = std::min(to, len);
+            while (from < to) {
+                const size_t w = (to - 1) / 64;
+                uint64_t word = bits[w];
+                if ((to % 64) != 0) word &= (uint64_t(1) << (to % 64)) - 1;
+                if (word) {
+                    const size_t found = w * 64 + 63 - __builtin_clzll(word);
+                    return found >= from ? found : none;
+                }
+                to = w * 64;
+            }
+            return none;
+        }
+    };
+}
+
 /* Main function */
+static recorder_handle httplogs_file {"httplogs"};
+
 extern "C"
 void scan_httplogs(scanner_params &sp)
 {
@@ -64,103 +147,72 @@ void scan_httplogs(scanner_params &sp)
         sp.info->set_name("httplogs");
         sp.info->author		= "Maxim Suhanov";
         sp.info->description	= "Extract various web server access logs";
-        sp.info->feature_defs.push_back( feature_recorder_def("httplogs"));
+        sp.info->feature_defs.push_back( httplogs_file.def());
+        return;
+    }
+
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        httplogs_file.resolve(sp);
+        method_signatures.clear();
+        for (int i = 0; methods[i]; i++) {
+            method_signatures.push_back(signature_prefilter::shared().add(methods[i]));
+        }
         return;
     }
 
     if(sp.phase==scanner_params::PHASE_SHUTDOWN) return;
 
     if(sp.phase==scanner_params::PHASE_SCAN){
-	feature_recorder &httplogs_recorder = sp.named_feature_recorder("httplogs");
+	feature_recorder &httplogs_recorder = *httplogs_file;
         const sbuf_t &sbuf = *(sp.sbuf);
+        const uint8_t *buf = sbuf.get_buf();
 
-        for (size_t p = 0; p < sbuf.pagesize; p++) {
-            /* We support the following methods: GET, HEAD, POST, PUT, DELETE, TRACE, OPTIONS, CONNECT;
-             * and the following protocol versions: HTTP/1.1, HTTP/1.0, HTTP/0.9.
-             *
-             * Request lines are similar to these:
-             *  - HTTP/1.1: GET / HTTP/1.1
-             *  - HTTP/1.0: GET / HTTP/1.0
-             *  - HTTP/0.9: GET /
-             *
-             * The plugin should output access log entries even for incorrect requests (like POST in HTTP/0.9).
+        /* the request methods of the page, found in one pass by the signature_prefilter */
+        scratch_vector<size_t> starts;
+        for (size_t id : method_signatures) {
+            const std::vector<size_t> &found = signature_prefilter::shared().candidates(sbuf, id);
+            starts.insert(starts.end(), found.begin(), found.end());
+        }
+        if (starts.empty()) return;
+        std::sort(starts.begin(), starts.end());
+        const line_breaks breaks(buf, sbuf.bufsize);
+
+        size_t p = 0;
+        for (size_t start : starts) {
+            if (start < p) continue;    // in the last request line
+            p = start;
+
+            /* Got something, now we should find the next \n (in the nearest kilobyte) */
+            const size_t end = std::min(sbuf.bufsize, p + 5 + LINE_SEARCH + 1);
+            const size_t lineend = breaks.next(p + 5, end);
+            if (lineend == end || buf[lineend] != '\n') continue; /* Bad character found, or none */
+
+            /* Now we should find the previous \n or any non-printable character (in the nearest kilobyte);
+             * a line within a kilobyte of the start of the buffer can start there.
              */
-            ssize_t bytes_left = sbuf.bufsize - p;
-            if(((bytes_left > 3)
-             && (sbuf[p+0] == 'G') && (sbuf[p+1] == 'E') && (sbuf[p+2] == 'T')
-             && (sbuf[p+3] == ' ')) ||
-
-             ((bytes_left > 4)
-             && (sbuf[p+0] == 'H') && (sbuf[p+1] == 'E') && (sbuf[p+2] == 'A')
-             && (sbuf[p+3] == 'D') && (sbuf[p+4] == ' ')) ||
-
-             ((bytes_left > 4)
-             && (sbuf[p+0] == 'P') && (sbuf[p+1] == 'O') && (sbuf[p+2] == 'S')
-             && (sbuf[p+3] == 'T') && (sbuf[p+4] == ' ')) ||
-
-             ((bytes_left > 3)
-             && (sbuf[p+0] == 'P') && (sbuf[p+1] == 'U') && (sbuf[p+2] == 'T')
-             && (sbuf[p+3] == ' ')) ||
-
-             ((bytes_left > 6)
-             && (sbuf[p+0] == 'D') && (sbuf[p+1] == 'E') && (sbuf[p+2] == 'L')
-             && (sbuf[p+3] == 'E') && (sbuf[p+4] == 'T') && (sbuf[p+5] == 'E')
-             && (sbuf[p+6] == ' ')) ||
-
-             ((bytes_left > 5)
-             && (sbuf[p+0] == 'T') && (sbuf[p+1] == 'R') && (sbuf[p+2] == 'A')
-             && (sbuf[p+3] == 'C') && (sbuf[p+4] == 'E')
-             && (sbuf[p+5] == ' ')) ||
-
-             ((bytes_left > 7)
-             && (sbuf[p+0] == 'O') && (sbuf[p+1] == 'P') && (sbuf[p+2] == 'T')
-             && (sbuf[p+3] == 'I') && (sbuf[p+4] == 'O') && (sbuf[p+5] == 'N')
-             && (sbuf[p+6] == 'S') && (sbuf[p+7] == ' ')) ||
-
-             ((bytes_left > 7)
-             && (sbuf[p+0] == 'C') && (sbuf[p+1] == 'O') && (sbuf[p+2] == 'N')
-             && (sbuf[p+3] == 'N') && (sbuf[p+4] == 'E') && (sbuf[p+5] == 'C')
-             && (sbuf[p+6] == 'T') && (sbuf[p+7] == ' '))) {
-                /* Got something, now we should find the next \n (in the nearest kilobyte) */
-                size_t lineend = 0;
-                for (size_t np = p + 5; ((np < sbuf.bufsize) && (np <= p + 5 + 1024)); np++) {
-                if(!isok(sbuf[np])) break; /* Bad character found */
-                    if(sbuf[np] == '\n') {
-                        lineend = np;
-                        break;
-                    }
-                }
+            const size_t from = (p > LINE_SEARCH + 1) ? p - LINE_SEARCH : 1;
+            const size_t before = breaks.prev(from, p);
+            size_t linestart = 0;
+            if (before != p) {
+                linestart = before + 1;
+            } else if (p > LINE_SEARCH + 1) {
+                continue;
+            }
 
-                if(lineend > 0) {
-                    /* Now we should find the previous \n or any non-printable character (in the nearest kilobyte) */
-                    size_t np;
-                    size_t linestart = 0;
-                    bool foundlinestart = false;
-                    for (np = p-1; ((np > 0) && (p - np <= 1024)); np--) {
-                        if((!isok(sbuf[np])) || (sbuf[np] == '\n')) {
-                            linestart = np + 1;
-                            foundlinestart = true;
-                            break;
-                        }
-                    }
-                    if(np == 0) foundlinestart = true;
-
-                    if(foundlinestart) {
-                        /* Check for a valid IP address (dotted quad) */
-                        bool ipaddrfound = false;
-                        size_t length = lineend - linestart;
-                        sbuf_t n(sbuf, linestart, length);
-                        for (size_t cp = 0; (cp < length) && !ipaddrfound; cp++) {
-                            ipaddrfound = validDottedQuad(std::string(n.asString(), cp, length-cp));
-                            if((cp > 0) && (n[cp-1] == '/')) ipaddrfound = false; /* False positive */
-                        }
-
-                        /* Output the entry found */
-                        if(ipaddrfound) httplogs_recorder.write_buf(n, 0, length);
-                        p = lineend;
-                    }
-                }
+            /* Check for a valid IP address (dotted quad) */
+            bool ipaddrfound = false;
+            const size_t length = lineend - linestart;
+            for (size_t cp = 0; (cp < length) && !ipaddrfound; cp++) {
+                if ((cp > 0) && (buf[linestart + cp - 1] == '/')) continue; /* False positive */
+                ipaddrfound = validDottedQuad(buf + linestart + cp, length - cp);
+            }
+
+            /* Output the entry found */
+            if(ipaddrfound) {
+                sbuf_t n(sbuf, linestart, length);
+                httplogs_recorder.write_buf(n, 0, length);
             }
+            p = lineend + 1;
         }
     }
 }
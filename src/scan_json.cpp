@@ -30,9 +30,19 @@ SOFTWARE.
 
 #include "config.h"
 
+#include <array>
 #include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "be13_api/scanner_params.h"
 #include "be13_api/scanner_set.h"
+#include "recorder_handle.h"
+#include "scanner_tables.h"
 
 
 class json_checker {
@@ -51,6 +61,8 @@ public:
     int check_char(int next_char);
     int done();
     bool check_if_done();
+    bool in_string() const;             // the next characters up to a quote, backslash or control are in a string
+    bool between_tokens() const;        // the next whitespace does not change the state
 };
 
 
@@ -209,6 +221,22 @@ static int state_transition_table[NR_STATES][NR_CLASSES] = {
 };
 
 
+/*
+    The transition for each state and byte, so that a character costs one lookup.
+    Non-whitespace control characters are errors; the bytes above 127 are C_ETC.
+*/
+static const auto byte_transition_table = [] {
+    std::array<std::array<int8_t, 256>, NR_STATES> table {};
+    for (int state = 0; state < NR_STATES; state++) {
+        for (int ch = 0; ch < 256; ch++) {
+            const int char_class = ch < 128 ? ascii_class[ch] : C_ETC;
+            table[state][ch] = char_class <= __ ? __ : state_transition_table[state][char_class];
+        }
+    }
+    return table;
+}();
+
+
 /*
     These modes can be pushed on the stack.
 */
@@ -238,6 +266,16 @@ bool json_checker::check_if_done()
     return state==OK && top==0;
 }
 
+inline bool json_checker::in_string() const
+{
+    return state==ST;
+}
+
+inline bool json_checker::between_tokens() const
+{
+    return state<=AR;                   // GO, OK, OB, KE, CO, VA and AR keep their state on space and white
+}
+
 int json_checker::done()
 {
 /*
@@ -292,9 +330,9 @@ int json_checker::pop(uint8_t mode)
  */
 int json_checker::check_char(int next_char)
 {
-    int next_class, next_state;
+    int next_state;
     /*
-     * Determine the character's class.
+     * Determine the character's class and the next state.
      */
     if(reject) return -1;		// in rejecting mode
 
@@ -302,19 +340,11 @@ int json_checker::check_char(int next_char)
 	reject = true;
 	return -1;
     }
-    if (next_char >= 128) {
-        next_class = C_ETC;
+    if (next_char >= 256) {
+        next_state = state_transition_table[state][C_ETC];
     } else {
-        next_class = ascii_class[next_char];
-        if (next_class <= __) {
-	    reject = true;
-	    return -1;
-        }
+        next_state = byte_transition_table[state][next_char];
     }
-/*
-    Get the next state from the state transition table.
-*/
-    next_state = state_transition_table[state][next_class];
     if (next_state >= 0) {
 /*
     Change the state.
@@ -426,11 +456,81 @@ int json_checker::check_char(int next_char)
 
 
 /****************************************************************
- ** Make the JSON validator work with bulk_extractor
+ ** Runs of characters that the checker can skip, found 16 at a time.
+ ** Inside a string every character but a quote, a backslash and the controls leaves the state
+ ** at ST; between tokens whitespace leaves it where it is. A JSON text starts with { or [.
  */
 
-static const char *json_second_chars = "0123456789.-{[ \t\n\r\""; // valid second chars in a JSON block
-static bool is_json_second_char[256];   // fast lookup to determine if a second char is in JSON or not.
+enum class json_run { STRING, SPACE, START };
+
+template <json_run R> static inline bool json_run_stops(uint8_t ch)
+{
+    switch (R) {
+    case json_run::STRING: return ch < 0x20 || ch == '"' || ch == '\\';
+    case json_run::SPACE:  return ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r';
+    case json_run::START:  return ch == '{' || ch == '[';
+    }
+    return true;
+}
+
+#if defined(__SSE2__)
+template <json_run R> static inline uint32_t json_run_stop_mask(__m128i v)
+{
+    switch (R) {
+    case json_run::STRING:
+        return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v),
+                                              _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')))));
+    case json_run::SPACE:
+        return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                              _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))))) ^ 0xffff;
+    case json_run::START:
+        return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')),
+                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('['))));
+    }
+    return 0xffff;
+}
+#elif defined(__aarch64__)
+template <json_run R> static inline bool json_run_stops16(uint8x16_t v)
+{
+    uint8x16_t m;
+    switch (R) {
+    case json_run::STRING:
+        m = vorrq_u8(vcltq_u8(v, vdupq_n_u8(0x20)), vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\'))));
+        break;
+    case json_run::SPACE:
+        m = vmvnq_u8(vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t'))),
+                              vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r')))));
+        break;
+    case json_run::START:
+        m = vorrq_u8(vceqq_u8(v, vdupq_n_u8('{')), vceqq_u8(v, vdupq_n_u8('[')));
+        break;
+    }
+    return vmaxvq_u8(m) != 0;
+}
+#endif
+
+/* the first j in [i,end) at which the run stops, or end */
+template <json_run R> static size_t json_skip(const uint8_t *buf, size_t i, size_t end)
+{
+#if defined(__SSE2__)
+    for (; i + 16 <= end; i += 16) {
+        const uint32_t mask = json_run_stop_mask<R>(_mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif defined(__aarch64__)
+    for (; i + 16 <= end; i += 16) {
+        if (json_run_stops16<R>(vld1q_u8(buf + i))) break; // located below
+    }
+#endif
+    while (i < end && !json_run_stops<R>(buf[i])) i++;
+    return i;
+}
+
+static recorder_handle json_file {"json"};
+
 extern "C"
 void scan_json(struct scanner_params &sp)
 {
@@ -440,33 +540,31 @@ void scan_json(struct scanner_params &sp)
         sp.info->author          = "Simson Garfinkel";
         sp.info->description     = "Scans for JSON-encoded data";
         sp.info->scanner_version = "1.1";
-        feature_recorder_def frd("json");
+        feature_recorder_def frd = json_file.def();
         frd.flags.xml = true;
         sp.info->feature_defs.push_back( frd );
-
-	/* Create a fast map of the valid json characters.*/
-	memset(is_json_second_char,0,sizeof(is_json_second_char));
-	for(int i=0;json_second_chars[i];i++){
-	    is_json_second_char[(uint8_t)json_second_chars[i]] = true;
-	}
         return;
     }
 
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        json_file.resolve(sp);
+    }
     if(sp.phase==scanner_params::PHASE_SCAN){
-        // do we want to look up the feature_recorder every time through?
-        // Perhaps the scanners should be C++ classes with C linkage
         auto &sbuf = *(sp.sbuf);
-        feature_recorder &fr = sp.named_feature_recorder("json");
+        feature_recorder &fr = *json_file;
+        const uint8_t *buf = sbuf.get_buf();
 	for(size_t pos = 0;pos+1<sbuf.pagesize;pos++){
-	    /* Find the beginning of a json object. This will improve later... */
-	    if((sbuf[pos]=='{' || sbuf[pos]=='[') && is_json_second_char[sbuf[pos+1]]){
+	    /* Find the beginning of a json object. */
+	    pos = json_skip<json_run::START>(buf, pos, sbuf.pagesize-1);
+	    if(pos+1>=sbuf.pagesize) break;
+	    if(scanner_tables::json_second_chars[buf[pos+1]]){
 		json_checker jc;
 		for(size_t i=pos;i<sbuf.bufsize;i++){
-		    if(jc.check_char(sbuf[i])){ // is character invalid?
+		    if(jc.check_char(buf[i])){ // is character invalid?
 			pos = i;		    // yes
 			break;
 		    }
-		    if((sbuf[i]==']' || sbuf[i]=='}') && jc.check_if_done()){
+		    if((buf[i]==']' || buf[i]=='}') && jc.check_if_done()){
 			// Only write JSON objects with more than 2 commas
 			if(jc.comma_count >= 2 ){
 			    sbuf_t json_sbuf(sbuf, pos, (i-pos)+1);
@@ -476,6 +574,14 @@ void scan_json(struct scanner_params &sp)
 			pos = i;		// skip to the end
 			break;
 		    }
+		    /* skip the characters that would not change the state */
+		    if(i+1<sbuf.bufsize){
+			if(jc.in_string() && !json_run_stops<json_run::STRING>(buf[i+1])){
+			    i = json_skip<json_run::STRING>(buf, i+1, sbuf.bufsize) - 1;
+			} else if(jc.between_tokens() && !json_run_stops<json_run::SPACE>(buf[i+1])){
+			    i = json_skip<json_run::SPACE>(buf, i+1, sbuf.bufsize) - 1;
+			}
+		    }
 		}
 	    }
 	}
@@ -10,6 +10,9 @@
 
 #include "config.h"
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
+#include "recorder_handle.h"
+#include "signature_prefilter.h"
 
 #include <iostream>
 #include <fstream>
@@ -20,7 +23,14 @@
 #include <sstream>
 
 
-#include "utf8.h"
+#include "utf8_text.h"
+
+/* "<?xml ", "<kml " and "</kml>", in the signature_prefilter */
+static size_t xml_signature = 0;
+static size_t kml_signature = 0;
+static size_t ekml_signature = 0;
+
+static recorder_handle kml_file {"kml"};
 
 extern "C"
 void scan_kml(scanner_params &sp)
@@ -34,29 +44,41 @@ void scan_kml(scanner_params &sp)
         sp.info->scanner_version= "1.0";
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-        sp.info->feature_defs.push_back( feature_recorder_def("kml", carve_flag));
+        sp.info->feature_defs.push_back( kml_file.def(carve_flag));
+	return;
+    }
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        kml_file.resolve(sp);
+	signature_prefilter &prefilter = signature_prefilter::shared();
+	xml_signature  = prefilter.add("<?xml ", 0, 1, 1, true);
+	kml_signature  = prefilter.add("<kml ", 0, 1, 1, true);
+	ekml_signature = prefilter.add("</kml>", 0, 1, 1, true);
 	return;
     }
     if(sp.phase==scanner_params::PHASE_SCAN){
 	const sbuf_t &sbuf = *(sp.sbuf);
-	feature_recorder &kml_recorder = sp.named_feature_recorder("kml");
+	feature_recorder &kml_recorder = *kml_file;
+	const signature_prefilter &prefilter = signature_prefilter::shared();
+	const std::vector<size_t> &xmls  = prefilter.candidates(sbuf, xml_signature);
+	const std::vector<size_t> &kmls  = prefilter.candidates(sbuf, kml_signature);
+	const std::vector<size_t> &ekmls = prefilter.candidates(sbuf, ekml_signature);
 
-	// Search for <xml BEGIN:VCARD\r in the sbuf
-	// we could do this with a loop, or with
+	// Search for <?xml in the sbuf; the prefilter found all three tags in one pass
 	for(size_t i = 0;  i < sbuf.bufsize;)	{
-	    ssize_t xml_loc = sbuf.find("<?xml ",i);
+	    ssize_t xml_loc = signature_prefilter::next(xmls, i);
 	    if(xml_loc==-1) return;		// no more
-	    ssize_t kml_loc = sbuf.find("<kml ",xml_loc);
+	    ssize_t kml_loc = signature_prefilter::next(kmls, xml_loc);
 	    if(kml_loc==-1) return;
-	    ssize_t ekml_loc = sbuf.find("</kml>",kml_loc);
+	    ssize_t ekml_loc = signature_prefilter::next(ekmls, kml_loc);
 	    if(ekml_loc==-1) return;
 	    ssize_t kml_len = (ekml_loc-xml_loc)+6;
 
-	    /* verify the utf-8 */
-	    std::string possible_kml = sbuf.substr(xml_loc, kml_len);
-	    if(utf8::find_invalid(possible_kml.begin(),possible_kml.end()) == possible_kml.end()){
+	    /* verify the utf-8, in place */
+	    const std::string_view possible_kml(reinterpret_cast<const char *>(sbuf.get_buf()) + xml_loc,
+	                                        std::min<size_t>(kml_len, sbuf.bufsize - xml_loc));
+	    if(utf8_text::valid(possible_kml)){
 		/* No invalid UTF-8 */
-		kml_recorder.carve(sbuf.slice(xml_loc, kml_len), ".kml", 0);
+		carve_index::carve(kml_recorder, sbuf.slice(xml_loc, kml_len), ".kml", 0);
 		i = ekml_loc + 6;	// skip past end of </kml>
 	    }
 	    else {
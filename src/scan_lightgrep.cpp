@@ -10,9 +10,10 @@
 
 #include "be13_api/scanner_params.h"
 
-//#include "be13_api/beregex.h"
-#include "histogram.h"
+#include "findopts.h"
+#include "heavy_hitters.h"
 #include "pattern_scanner.h"
+#include "recorder_handle.h"
 
 #include <lightgrep/api.h>
 
@@ -29,13 +30,15 @@ namespace { // local namespace hides these from other translation units
     };
 
     virtual void startup(const scanner_params& sp) {
-        sp.info.set_name("scan_lightgrep");
+        sp.info->set_name("lightgrep");
         sp.info->author          = "Jon Stewart";
         sp.info->description     = "Advanced search for patterns";
-        sp.info->scanner_version = "0.2";
-        sp.info->flags           = scanner_info::SCANNER_FIND_SCANNER | scanner_info::SCANNER_FAST_FIND;
-        sp.info->feature_names.insert(name());
-        sp.info->histogram_defs.insert(histogram_def( name(), "", "histogram", HistogramMaker::FLAG_LOWERCASE));
+        sp.info->scanner_version = "0.3";
+        sp.info->scanner_flags.find_scanner = true; // this is a find scanner
+        sp.info->scanner_flags.default_enabled = false;
+        sp.info->feature_defs.push_back( recorder_handle::make_def(name()));
+        auto lowercase = histogram_def::flags_t(); lowercase.lowercase = true;
+        heavy_hitters::add_def(sp, histogram_def(name(), name(), "", "", "histogram", lowercase));
     }
 
     virtual void init(const scanner_params& sp) {
@@ -48,7 +51,7 @@ namespace { // local namespace hides these from other translation units
     feature_recorder* LgRec;
 
     void processHit(const LG_SearchHit& hit, const scanner_params& sp) {
-      LgRec->write_buf(sp.sbuf, hit.Start, hit.End - hit.Start);
+      LgRec->write_buf(*sp.sbuf, hit.Start, hit.End - hit.Start);
     }
 
   private:
@@ -64,21 +67,26 @@ namespace { // local namespace hides these from other translation units
 
 extern "C"
 void scan_lightgrep(struct scanner_params &sp) {
+  sp.check_version();
   switch (sp.phase) {
   case scanner_params::PHASE_INIT:
     Scanner.startup(sp);
     ProcessHit = static_cast<CallbackFnType>(&FindScanner::processHit);
-    break;
-  case scanner_params::PHASE_INIT:
     {
-      Scanner.init(sp);
-      LightgrepController& lg(LightgrepController::Get());
-      lg.addUserPatterns(Scanner, &ProcessHit, FindOpts::get());
-      lg.regcomp();
-      break;
+      // PHASE_INIT runs for all scanners, so this applies to the other lightgrep scanners too
+      std::string cache_dir;
+      sp.get_scanner_config("lightgrep_cache", &cache_dir,
+                            "Directory for compiled lightgrep programs (default ~/.cache/bulk_extractor; - for none)");
+      LightgrepController::Get().setCacheDir(cache_dir);
     }
+    break;
+  case scanner_params::PHASE_INIT2:
+    // the user's -f and -F patterns are searched with the other lightgrep scanners' patterns
+    Scanner.init(sp);
+    LightgrepController::Get().addUserPatterns(Scanner, &ProcessHit, FindOpts::get());
+    break;
   case scanner_params::PHASE_SCAN:
-    LightgrepController::Get().scan(sp);
+    LightgrepController::Get().scan(Scanner, sp);
     break;
   case scanner_params::PHASE_SHUTDOWN:
     Scanner.shutdown(sp);
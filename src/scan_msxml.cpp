@@ -4,6 +4,7 @@
  *
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -13,6 +14,7 @@
 #include "config.h"
 #include "be13_api/scanner_params.h"
 
+#include "content_cache.h"
 #include "image_process.h"
 #include "scan_msxml.h"
 
@@ -26,29 +28,76 @@
 #endif
 #include <zlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define SCANNER_NAME "msxml"
 
-std::string msxml_extract_text(const sbuf_t &sbuf)
+namespace {
+    /* The first '<' or '>' in buf[i, len), or len */
+    size_t next_tag_char(const uint8_t *buf, size_t i, size_t len)
+    {
+#if defined(__SSE2__)
+        const __m128i lt = _mm_set1_epi8('<');
+        const __m128i gt = _mm_set1_epi8('>');
+        for (; i + 16 <= len; i += 16) {
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i));
+            const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(b, lt), _mm_cmpeq_epi8(b, gt)));
+            if (mask) return i + __builtin_ctz(mask);
+        }
+#endif
+        for (; i < len; i++) {
+            if (buf[i] == '<' || buf[i] == '>') return i;
+        }
+        return len;
+    }
+}
+
+size_t msxml_extract_text(const sbuf_t &sbuf, uint8_t *out)
 {
     /* copy out the data to a new buffer. The < character turns off copying the > character turns it on */
-    std::stringstream ss;
+    const uint8_t *buf = sbuf.get_buf();
+    const size_t len = sbuf.bufsize;
+    size_t n = 0;
     bool instring = false;
-    for(size_t i=0;i<sbuf.bufsize;i++){
-        switch(sbuf[i]){
-        case '<':
-            instring=false;
-            if (sbuf.substr(i,6)=="</w:p>"){
-                ss << "\n";
+    for (size_t i = 0; i < len; ) {
+        const size_t tag = next_tag_char(buf, i, len);
+        if (instring) {
+            memcpy(out + n, buf + i, tag - i);
+            n += tag - i;
+        }
+        if (tag == len) break;
+        if (buf[tag] == '<') {
+            instring = false;
+            if (tag + 6 <= len && memcmp(buf + tag, "</w:p>", 6) == 0) {
+                out[n++] = '\n';
             }
-            break;
-        case '>':
-            instring=true;
-            break;
-        default:
-            if (instring) ss << sbuf[i];
+        } else {
+            instring = true;
         }
+        i = tag + 1;
     }
-    return ss.str();
+    return n;
+}
+
+std::string msxml_extract_text(const sbuf_t &sbuf)
+{
+    std::string ret(sbuf.bufsize, '\0');
+    ret.resize(msxml_extract_text(sbuf, reinterpret_cast<uint8_t *>(ret.data())));
+    return ret;
+}
+
+bool msxml_is_binary(const sbuf_t &sbuf)
+{
+    /* XML allows no control characters but tab, newline and return; NULs may be slack after the part */
+    const size_t len = std::min(sbuf.bufsize, MSXML_BINARY_PROBE);
+    size_t controls = 0;
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t ch = sbuf[i];
+        if (ch != 0 && ch < ' ' && ch != '\t' && ch != '\n' && ch != '\r') controls++;
+    }
+    return controls >= MSXML_BINARY_CONTROLS;
 }
 
 extern "C"
@@ -64,11 +113,16 @@ void scan_msxml(scanner_params &sp)
     }
     if (sp.phase==scanner_params::PHASE_SCAN){
 	const sbuf_t &sbuf = *(sp.sbuf);
-        if (sbuf.substr(0,6)=="<?xml "){
-            std::string bufstr = msxml_extract_text(sbuf);
-            auto *dbuf = sbuf_t::sbuf_malloc(sbuf.pos0+"MSXML", bufstr.size(), bufstr.size());
-            memcpy(dbuf->malloc_buf(), bufstr.c_str(), bufstr.size());
-            sp.recurse(dbuf);           // will delete dbuf
+        if (sbuf.bufsize >= 6 && memcmp(sbuf.get_buf(), "<?xml ", 6) == 0 && !msxml_is_binary(sbuf)) {
+            /* the text is no longer than the XML, so it is extracted into the child and the child shrunk */
+            auto *dbuf = sbuf_t::sbuf_malloc(sbuf.pos0+"MSXML", sbuf.bufsize, sbuf.bufsize);
+            const size_t len = msxml_extract_text(sbuf, reinterpret_cast<uint8_t *>(dbuf->malloc_buf()));
+            if (len == 0) {
+                delete dbuf;
+                return;
+            }
+            dbuf = dbuf->realloc(len);
+            content_cache::recurse(sp, dbuf);           // will delete dbuf
         }
     }
 }
@@ -2,5 +2,14 @@
 #define SCAN_MSXML_H
 #include "be13_api/sbuf.h"
 
+/* The text of an XML part: the characters outside its tags, with a newline for each </w:p>.
+ * The first form writes it into out, which must hold sbuf.bufsize bytes, and returns its length.
+ */
+size_t msxml_extract_text(const sbuf_t &sbuf, uint8_t *out);
 std::string msxml_extract_text(const sbuf_t &sbuf);
+
+/* A part with MSXML_BINARY_CONTROLS control characters in its first MSXML_BINARY_PROBE bytes is not XML */
+inline constexpr size_t MSXML_BINARY_PROBE {4096};
+inline constexpr size_t MSXML_BINARY_CONTROLS {8};
+bool msxml_is_binary(const sbuf_t &sbuf);
 #endif
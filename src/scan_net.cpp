@@ -27,18 +27,30 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <set>
 #include <mutex>
 #include <ctype.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "be13_api/formatter.h"
 #include "be13_api/utils.h"
 
+#include "heavy_hitters.h"
 #include "pcap_writer.h"
+#include "recorder_handle.h"
+#include "sbuf_span.h"
 #include "scan_net.h"
 
 /* singleton option */
 bool opt_carve_net_memory = false;
+bool opt_net_flows = false;
+bool opt_net_pcap = true;
 
 #ifdef HAVE_PCAP_PCAP_H
 #ifdef HAVE_DIAGNOSTIC_REDUNDANT_DECLS
@@ -159,31 +171,115 @@ scan_net_t::scan_net_t(const scanner_params &sp):
 {
 }
 
-
-/* compute an Internet-style checksum, from Stevens.
- * The ipchecksum is stored 10 bytes in, so do not include it.
- */
-uint16_t scan_net_t::ip4_cksum(const sbuf_t &sbuf, size_t pos, size_t len)
+bool scan_net_t::flow_key(const sbuf_t &sbuf, size_t ip_pos, const generic_iphdr_t &h, net_flows::key_t &k)
 {
-    uint32_t  sum = 0;  /* assume 32 bit long, 16 bit short */
-
-    for (size_t offset = 0; offset+pos < sbuf.bufsize && offset<len; offset+=2){
-        if (offset != 10) {   // do not include the checksum field
-            sum += sbuf.get16u( pos+offset );
-            if (sum & 0x80000000){   /* if high order bit set, fold */
-                sum = (sum & 0xFFFF) + (sum >> 16);
-	    }
+    if (h.family != AF_INET && h.family != AF_INET6) return false;
+    k.family = h.family;
+    k.proto = h.nxthdr;
+    memcpy(k.src, h.src, sizeof(k.src));
+    memcpy(k.dst, h.dst, sizeof(k.dst));
+    if (h.nxthdr == IPPROTO_TCP || h.nxthdr == IPPROTO_UDP) {
+        /* both headers start with the source and destination ports */
+        const sbuf_span_be ports(sbuf, ip_pos + h.nxthdr_offs, 4);
+        if (ports) {
+            k.sport = ports.get16u(0);
+            k.dport = ports.get16u(2);
         }
     }
+    return true;
+}
 
-    if (len % 2 != 0){
-        sum += sbuf[ pos+len-1];     /* take care of left over byte */
+void scan_net_t::write_packet(const struct pcap_writer::pcap_hdr &h, const sbuf_t &sbuf, size_t pos, bool add_frame,
+                              uint16_t frame_type, size_t ip_pos, const generic_iphdr_t *ip, const pos0_t &where) const
+{
+    if (flows_recorder) {
+        const size_t end = std::min(pos + h.cap_len, sbuf.bufsize);
+        if (ip_pos > end) ip_pos = pos;
+        net_flows::key_t k;
+        const bool is_ip = ip && flow_key(sbuf, ip_pos, *ip, k);
+        if (!net_flows::add(sbuf.get_buf() + ip_pos, end - ip_pos, where, is_ip ? &k : nullptr)) return;
+    }
+    if (write_pcap) {
+        pwriter.pcap_writepkt(h, sbuf, pos, add_frame, frame_type);
     }
+}
 
-    /* Now add all of the 1st complements */
-    while (sum>>16) {
+void scan_net_t::write_flows() const
+{
+    if (flows_recorder == nullptr) return;
+    for (const auto &it : net_flows::take()) {
+        const net_flows::key_t &k = it.first;
+        const net_flows::flow_t &f = it.second;
+        std::string feature;
+        if (k.proto == IPPROTO_TCP || k.proto == IPPROTO_UDP) {
+            feature = ip2string(k.src, k.family) + ":" + i2str(k.sport) + " -> " +
+                ip2string(k.dst, k.family) + ":" + i2str(k.dport) + (k.proto == IPPROTO_TCP ? " (TCP)" : " (UDP)");
+        } else {
+            feature = ip2string(k.src, k.family) + " -> " + ip2string(k.dst, k.family) +
+                (k.proto == IPPROTO_ICMPV6 ? " (ICMPv6)" : " (" + i2str(k.proto) + ")");
+        }
+        flows_recorder->write(f.first, feature,
+                              "packets=" + std::to_string(f.packets) + " copies=" + std::to_string(f.copies) +
+                              " bytes=" + std::to_string(f.bytes) + " last=" + f.last.str());
+    }
+}
+
+
+uint32_t scan_net_t::ones_complement_sum(const uint8_t *buf, size_t len, uint64_t sum)
+{
+    /* Each 32-bit lane takes two words per 16 bytes; fold them into sum before a lane can overflow */
+    const size_t MAX_BLOCKS = 0x8000;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    while (len >= 16) {
+        const size_t blocks = std::min(len / 16, MAX_BLOCKS);
+        __m128i acc = zero;
+        for (size_t i = 0; i < blocks; i++, buf += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+        sum += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        len -= blocks * 16;
+    }
+#elif defined(__aarch64__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 16) {
+        const size_t blocks = std::min(len / 16, MAX_BLOCKS);
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (size_t i = 0; i < blocks; i++, buf += 16) {
+            acc = vpadalq_u16(acc, vreinterpretq_u16_u8(vld1q_u8(buf)));
+        }
+        sum += vaddlvq_u32(acc);
+        len -= blocks * 16;
+    }
+#endif
+    for (; len >= 2; buf += 2, len -= 2) {
+        sum += static_cast<uint32_t>(buf[0]) | (static_cast<uint32_t>(buf[1]) << 8);
+    }
+    if (len > 0) {
+        sum += buf[0];                  /* take care of left over byte */
+    }
+    while (sum >> 16) {
         sum = (sum & 0xFFFF) + (sum >> 16);
     }
+    return static_cast<uint32_t>(sum);
+}
+
+/* compute an Internet-style checksum, from Stevens.
+ * The ipchecksum is stored 10 bytes in, so do not include it.
+ */
+uint16_t scan_net_t::ip4_cksum(const sbuf_t &sbuf, size_t pos, size_t len)
+{
+    if (pos >= sbuf.bufsize) return 0xFFFF;
+    len = std::min(len, sbuf.bufsize - pos);
+
+    const uint8_t *header = sbuf.get_buf() + pos;
+    uint32_t sum = ones_complement_sum(header, std::min<size_t>(len, 10), 0);
+    if (len > 12) {
+        sum = ones_complement_sum(header + 12, len - 12, sum); // do not include the checksum field
+    }
     return ~sum;
 }
 
@@ -212,46 +308,20 @@ uint16_t scan_net_t::IPv6L3Chksum(const sbuf_t &sbuf, size_t pos, u_int chksum_b
     const struct ip6_hdr *ip6 = sbuf.get_struct_ptr<struct ip6_hdr>(pos);
     if (ip6==0) return 0;           // cannot compute; not enough data
 
-    int len      = ntohs(ip6->ip6_plen) + 40;/* payload len + size of pseudo hdr */
-    uint32_t sum = 0;			//
-    u_int octets_processed = 0;
-
-    /** We start counting at offset 8, which is the source address
-     *  which is followed by the ipv6 dst addr field and then the tcp
-     * payload
+    /* The pseudo header: the addresses, which are 8 bytes in, then the length and next header.
+     * The words are summed as they are in memory, so the length is too, and the next header
+     * is the second byte of its word.
      */
-    for(size_t i=pos+8 ; pos+i+1 < sbuf.bufsize && len > 0 ; i+=2 ){
-	if (i==40){			// reached the end of ipv6 header
-	    sum += ip6->ip6_plen;
-	    if (sum & 0x80000000){   /* if high order bit set, fold */
-		sum = (sum & 0xFFFF) + (sum >> 16);
-	    }
-
-	    /* putting the nxt pseudo header field in network-byte order via SHL(8) */
-	    sum += (uint16_t)(ip6->ip6_nxt << 8);
-	    if (sum & 0x80000000){   /* if high order bit set, fold */
-		sum = (sum & 0xFFFF) + (sum >> 16);
-	    }
-	    len -= 8; 	    /* we've processed 8 octets in the pseudo header */
-	    octets_processed += 8;
-	} else {
-	    /* check if we are at the offset of the L3 chksum field*/
-	    if ((octets_processed != chksum_byteoffset)) {
-		sum += sbuf.get16u(i);
-		if (sum & 0x80000000){   /* if high order bit set, fold */
-		    sum = (sum & 0xFFFF) + (sum >> 16);
-		}
-	    }
-
-	    /* update len and octets_processed */
-	    len -= 2;
-	    octets_processed += 2;
-	}
-    }
-    while( (sum & 0xFFFF0000) > 0 ){
-	sum = (sum & 0xFFFF) + (sum >> 16);
+    const uint8_t *header = sbuf.get_buf() + pos;
+    uint32_t sum = ones_complement_sum(header + 8, 32, ip6->ip6_plen + (static_cast<uint32_t>(ip6->ip6_nxt) << 8));
+
+    /* The L3 datagram follows the 40-byte IPv6 header; do not include its checksum field */
+    const size_t l3_len = std::min<size_t>(ntohs(ip6->ip6_plen), sbuf.bufsize - pos - 40);
+    const size_t chksum = chksum_byteoffset - 40;
+    sum = ones_complement_sum(header + 40, std::min(l3_len, chksum), sum);
+    if (l3_len > chksum + 2) {
+        sum = ones_complement_sum(header + 40 + chksum + 2, l3_len - chksum - 2, sum);
     }
-
     return ~sum;			// return the complement of the checksum
 }
 
@@ -401,20 +471,25 @@ std::string scan_net_t::i2str(const int i)
  */
 bool scan_net_t::sanityCheckIP46Header(const sbuf_t &sbuf, size_t pos, scan_net_t::generic_iphdr_t *h)
 {
-    const struct be13::ip4 *ip = sbuf.get_struct_ptr<struct be13::ip4>( pos );
+    /* The fields are read from network order; the checksums are computed as the words are in memory */
+    const sbuf_span_be ip(sbuf, pos, sizeof(struct be13::ip4));
     if (!ip) return false;		// not enough space
-    if (ip->ip_v == 4){
-	if (ip->ip_hl != 5) return false;	// IPv4 header length is 20 bytes (5 quads) (ignores options)
-	if ( (ip->ip_off != 0x0) && (ip->ip_off != ntohs(IP_DF)) ) return false;
+    const uint8_t version  = ip[0] >> 4;
+    if (version == 4){
+        const uint8_t header_len = ip[0] & 0x0f;
+	if (header_len != 5) return false;	// IPv4 header length is 20 bytes (5 quads) (ignores options)
+	if ( (ip.get16u(6) != 0x0) && (ip.get16u(6) != IP_DF) ) return false;
 
 	// only do TCP and UDP
-	if ( (ip->ip_p != IPPROTO_TCP) && (ip->ip_p != IPPROTO_UDP) ) return false;
+        const uint8_t protocol = ip[9];
+	if ( (protocol != IPPROTO_TCP) && (protocol != IPPROTO_UDP) ) return false;
 
 	/* reject anything larger than a jumbo gram or smaller than min-size IP */
-	if ( (ntohs(ip->ip_len) > 8192) || (ntohs(ip->ip_len) < 28) ) return false;
+        const uint16_t total_len = ip.get16u(2);
+	if ( (total_len > 8192) || (total_len < 28) ) return false;
 
         /* Validate the checksum */
-    	h->checksum_valid = (ip->ip_sum == ip4_cksum(sbuf, pos, ip->ip_hl * 4 ));
+    	h->checksum_valid = (ip.get16u(10) == ntohs(ip4_cksum(sbuf, pos, header_len * 4 )));
 
 	/* create a generic_iphdr_t, similar to tcpip.c from tcpflow code */
 	h->family = AF_INET;
@@ -422,76 +497,77 @@ bool scan_net_t::sanityCheckIP46Header(const sbuf_t &sbuf, size_t pos, scan_net_
 	/* similar to tcpip.c from tcpflow code */
 	uint32_t src[4] = {0, 0, 0, 0};
 	uint32_t dst[4] = {0, 0, 0, 0};
-	memcpy(&src[3],&ip->ip_src.addr,4); // avoids the need to be quadbyte aligned.
-	memcpy(&dst[3],&ip->ip_dst.addr,4);
+	memcpy(&src[3], ip.data()+12, 4); // avoids the need to be quadbyte aligned.
+	memcpy(&dst[3], ip.data()+16, 4);
 	memcpy(h->src, src, sizeof(src));
 	memcpy(h->dst, dst, sizeof(dst));
-	h->ttl = ip->ip_ttl;
-	h->nxthdr = ip->ip_p;
-	h->nxthdr_offs = (ip->ip_hl * 4);
-	h->payload_len = (ntohs(ip->ip_len) - (ip->ip_hl * 4));
+	h->ttl = ip[8];
+	h->nxthdr = protocol;
+	h->nxthdr_offs = (header_len * 4);
+	h->payload_len = (total_len - (header_len * 4));
 	return true;
     }
 
     /* ipv6 attempt */
-    const struct be13::ip6_hdr *ip6 = sbuf.get_struct_ptr<struct be13::ip6_hdr>( pos );
+    const sbuf_span_be ip6(sbuf, pos, sizeof(struct be13::ip6_hdr));
     if (!ip6) return false;
-    if ((ip6->ip6_vfc & 0xF0) == 0x60){
+    if ((ip6[0] & 0xF0) == 0x60){
 
 	//only do TCP, UDP and ICMPv6
-	if ( (ip6->ip6_nxt != IPPROTO_TCP) &&
-	     (ip6->ip6_nxt != IPPROTO_UDP) &&
-	     (ip6->ip6_nxt != IPPROTO_ICMPV6) ) return false;
+        const uint8_t next_header = ip6[6];
+	if ( (next_header != IPPROTO_TCP) &&
+	     (next_header != IPPROTO_UDP) &&
+	     (next_header != IPPROTO_ICMPV6) ) return false;
 
-	uint16_t ip_payload_len = ntohs(ip6->ip6_plen);
+	uint16_t ip_payload_len = ip6.get16u(4);
 
 	/* Reject anything larger than a jumbo gram or smaller than the
 	 * minimum size TCP, UDP or ICMPv6 packet (i.e. just header, no payload
 	 */
 	if ( (ip_payload_len > 8192) ||
-	     ((ip6->ip6_nxt == IPPROTO_TCP) && (ip_payload_len < 20)) ||
-	     ((ip6->ip6_nxt == IPPROTO_UDP) && (ip_payload_len < 8)) ||
-	     ((ip6->ip6_nxt == IPPROTO_ICMPV6) && (ip_payload_len < 4)) )
+	     ((next_header == IPPROTO_TCP) && (ip_payload_len < 20)) ||
+	     ((next_header == IPPROTO_UDP) && (ip_payload_len < 8)) ||
+	     ((next_header == IPPROTO_ICMPV6) && (ip_payload_len < 4)) )
 	    return false;
 
-	switch (ip6->ip6_nxt) {
+	switch (next_header) {
 	default:
 	case IPPROTO_TCP:
         {
-            const struct be_tcphdr *tcp = sbuf.get_struct_ptr<struct be_tcphdr>( pos+40 );
+            const sbuf_span_be tcp(sbuf, pos+40, sizeof(struct be_tcphdr));
             if (!tcp) return false;	// not sufficient room
 
             /* tcp chksum is at byte offset 16 from tcp hdr + 40 w/ pseudo hdr */
-            h->checksum_valid = (tcp->th_sum == scan_net_t::IPv6L3Chksum(sbuf, pos, 56));
+            h->checksum_valid = (tcp.get16u(16) == ntohs(scan_net_t::IPv6L3Chksum(sbuf, pos, 56)));
             break;
         }
 	case IPPROTO_UDP:
         {
-            const struct be_udphdr *udp = sbuf.get_struct_ptr<struct be_udphdr>( pos+40 );
+            const sbuf_span_be udp(sbuf, pos+40, sizeof(struct be_udphdr));
             if (!udp) return false;	// not sufficient room
 
             /* udp chksum is at byte offset 6 from udp hdr + 40 w/ pseudo hdr */
-            h->checksum_valid = (udp->uh_sum == scan_net_t::IPv6L3Chksum(sbuf, pos, 46));
+            h->checksum_valid = (udp.get16u(6) == ntohs(scan_net_t::IPv6L3Chksum(sbuf, pos, 46)));
             break;
         }
 	case IPPROTO_ICMPV6:
         {
-            const struct icmp6_hdr *icmp6 = sbuf.get_struct_ptr<struct icmp6_hdr>( pos+40 );
+            const sbuf_span_be icmp6(sbuf, pos+40, sizeof(struct icmp6_hdr));
             if (!icmp6) return false;	// not sufficient room
 
             /* icmpv6 chksum is at byte offset 2 from icmpv6 hdr + 40 w/ pseudo hdr */
-            h->checksum_valid = (icmp6->icmp6_cksum == scan_net_t::IPv6L3Chksum(sbuf, pos, 42));
+            h->checksum_valid = (icmp6.get16u(2) == ntohs(scan_net_t::IPv6L3Chksum(sbuf, pos, 42)));
             break;
         }
 	}
 	/* create a generic_iphdr_t, similar to tcpip.c from tcpflow code */
 	h->family = AF_INET6;
-	memcpy(h->src, ip6->ip6_src.addr.addr8, sizeof(ip6->ip6_src.addr.addr8));
-	memcpy(h->dst, ip6->ip6_dst.addr.addr8, sizeof(ip6->ip6_dst.addr.addr8));
-	h->ttl = ip6->ip6_hlim;
-	h->nxthdr = ip6->ip6_nxt;
+	memcpy(h->src, ip6.data()+8, 16);
+	memcpy(h->dst, ip6.data()+24, 16);
+	h->ttl = ip6[7];
+	h->nxthdr = next_header;
 	h->nxthdr_offs = 40; 	/* ipv6 headers are a fixed length of 40 bytes */
-	h->payload_len = ntohs(ip6->ip6_plen);
+	h->payload_len = ip_payload_len;
 	return true;
     }
     return false;			// right now we only do IPv4 and IPv6
@@ -598,14 +674,14 @@ size_t scan_net_t::carveIPFrame(const sbuf_t &sbuf, size_t pos) const
     case AF_INET6: buf[12] = 0xdd; buf[13] = 0x86; break;
     default:       buf[12] = 0xff; buf[13] = 0xff; break; // shouldn't happen
     }
-    memcpy(buf+14,sbuf.get_buf(),packet_len-14);       // copy the packet data
+    memcpy(buf+14,sbuf.get_buf()+pos,packet_len-14);   // copy the packet data
 
     /* make an sbuf to write */
     sbuf_t sb3(pos0_t(), buf, packet_len);
     struct pcap_writer::pcap_hdr ph(0, 0, packet_len, packet_len);  // make a fake header
     bool shouldWriteIP = documentIPFields(sb3, 0, h);
     if (shouldWriteIP) {
-        pwriter.pcap_writepkt(ph, sb3, 0, false, 0x0000);	   // write the packet
+        write_packet(ph, sb3, 0, false, 0x0000, 14, &h, sbuf.pos0 + pos); // write the packet
     }
     return ip_len;                                     // return that we processed this much
 }
@@ -616,7 +692,7 @@ size_t scan_net_t::carveIPFrame(const sbuf_t &sbuf, size_t pos) const
 
 size_t scan_net_t::carveEther(const sbuf_t &sbuf, size_t pos) const
 {
-    const struct macip *er = sbuf.get_struct_ptr<struct macip>(0);
+    const struct macip *er = sbuf.get_struct_ptr<struct macip>(pos);
     if (er){
         if ( (er->ether_type != htons(ETHERTYPE_IP)) &&   // 0x0800
              (er->ether_type != htons(ETHERTYPE_IPV6)) ){ // 0x86dd
@@ -658,7 +734,7 @@ size_t scan_net_t::carveEther(const sbuf_t &sbuf, size_t pos) const
             if (packet_len + pos > sbuf.bufsize) packet_len = sbuf.bufsize - pos;
             if (packet_len > 0 ){
                 struct pcap_writer::pcap_hdr hz(0, 0, packet_len, packet_len);
-                pwriter.pcap_writepkt(hz, sbuf, pos, false, 0x0000);
+                write_packet(hz, sbuf, pos, false, 0x0000, pos+14, &h, sbuf.pos0 + pos);
                 return packet_len;
             }
         }
@@ -753,18 +829,21 @@ size_t scan_net_t::carvePCAPPacket(const sbuf_t &sbuf, size_t pos) const
 
         generic_iphdr_t header_info;
         bool is_raw_ip = sanityCheckIP46Header(sbuf, pos+PCAP_RECORD_HEADER_SIZE, &header_info);
+        bool is_ip = is_raw_ip;
 
         uint16_t pseudo_frame_ethertype = 0;
         if (is_raw_ip) {
             pseudo_frame_ethertype = (header_info.family == AF_INET6) ? ETHERTYPE_IPV6 : ETHERTYPE_IP;
         } else {
-            sanityCheckIP46Header(sbuf, pos+PCAP_RECORD_HEADER_SIZE+ETHER_HEAD_LEN, &header_info);
+            is_ip = sanityCheckIP46Header(sbuf, pos+PCAP_RECORD_HEADER_SIZE+ETHER_HEAD_LEN, &header_info);
         }
 
         /* We are at the end of the file, or the next slot is also a packet */
         bool shouldWriteIP = documentIPFields(sbuf, pos+PCAP_RECORD_HEADER_SIZE, header_info);
         if (shouldWriteIP) {
-            pwriter.pcap_writepkt(h, sbuf, pos+PCAP_RECORD_HEADER_SIZE, is_raw_ip,pseudo_frame_ethertype);
+            write_packet(h, sbuf, pos+PCAP_RECORD_HEADER_SIZE, is_raw_ip, pseudo_frame_ethertype,
+                         pos+PCAP_RECORD_HEADER_SIZE+(is_raw_ip ? 0 : ETHER_HEAD_LEN), is_ip ? &header_info : nullptr,
+                         sbuf.pos0 + pos);
         }
         return PCAP_RECORD_HEADER_SIZE + h.cap_len;    // what is hard-coded 16?
     }
@@ -804,41 +883,140 @@ size_t scan_net_t::carvePCAPFile(const sbuf_t &sbuf, size_t pos) const
     return bytes;
 }
 
+/* the IPv4 (with a 20-byte header) and IPv6 version bytes that sanityCheckIP46Header() accepts */
+static inline bool ip_version_byte(uint8_t b)
+{
+    return b == 0x45 || (b & 0xF0) == 0x60;
+}
+
+/*
+ * Which carvers could match at p, from the bytes that each one requires:
+ * carvePCAPFile the magic number, carveIPFrame the version at p[0] and carveEther the one at
+ * p[14], carvePCAPPacket a time within [TIME_MIN, TIME_MAX] and microseconds and lengths under
+ * 2^24, carveSockAddrIn AF_INET in sin_len or sin_family and carveTCPTOBJ the pool size.
+ */
+unsigned scan_net_t::carvers_at(const uint8_t *p) const
+{
+    unsigned carvers = 0;
+    if (p[0] == PCAP_HEADER[0]) carvers |= CARVE_PCAP_FILE;
+    if (p[3] >= (TIME_MIN >> 24) && p[3] <= (TIME_MAX >> 24) && p[7] == 0 && p[11] == 0 && p[15] == 0) {
+        carvers |= CARVE_PCAP_PACKET;
+    }
+    if (ip_version_byte(p[14])) carvers |= CARVE_ETHER;
+    if (ip_version_byte(p[0])) carvers |= CARVE_IP;
+    if (p[0] == AF_INET || p[1] == AF_INET) carvers |= CARVE_SOCKADDR;
+    if (p[2] == 0x33 && p[4] == 'T') carvers |= CARVE_TCPT;
+    return carvers;
+}
+
+/*
+ * Returns the first offset in [pos, end) at which carvers_at() could be non-zero, or end;
+ * 16 offsets at a time. buf[pos, end + CARVERS_BYTES - 1) must be readable.
+ */
+size_t scan_net_t::skip_to_candidate(const uint8_t *buf, size_t pos, size_t end) const
+{
+#if defined(__SSE2__)
+    const __m128i zero     = _mm_setzero_si128();
+    const __m128i v45      = _mm_set1_epi8(0x45);
+    const __m128i v60      = _mm_set1_epi8(0x60);
+    const __m128i vF0      = _mm_set1_epi8(static_cast<char>(0xF0));
+    const __m128i pcap     = _mm_set1_epi8(static_cast<char>(PCAP_HEADER[0]));
+    const __m128i af_inet  = _mm_set1_epi8(AF_INET);
+    const __m128i pool     = _mm_set1_epi8(0x33);
+    const __m128i time_lo  = _mm_set1_epi8(static_cast<char>(TIME_MIN >> 24));
+    const __m128i time_len = _mm_set1_epi8(static_cast<char>((TIME_MAX >> 24) - (TIME_MIN >> 24)));
+    const bool memory = carve_net_memory;
+    for (; pos + 16 <= end; pos += 16) {
+        const uint8_t *p = buf + pos;
+        const __m128i b0  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i b3  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 3));
+        const __m128i b7  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 7));
+        const __m128i b11 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 11));
+        const __m128i b14 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 14));
+        const __m128i b15 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 15));
+
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(b0, v45), _mm_cmpeq_epi8(_mm_and_si128(b0, vF0), v60));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b14, v45));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_and_si128(b14, vF0), v60));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b0, pcap));
+
+        /* time_lo <= b3 <= time_hi, unsigned, and three zero bytes */
+        const __m128i in_range = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(b3, time_lo), time_len), zero);
+        const __m128i zeros = _mm_cmpeq_epi8(_mm_or_si128(_mm_or_si128(b7, b11), b15), zero);
+        hit = _mm_or_si128(hit, _mm_and_si128(in_range, zeros));
+
+        if (memory) {
+            const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+            const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2));
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b0, af_inet));
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b1, af_inet));
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b2, pool));
+        }
+        const int mask = _mm_movemask_epi8(hit);
+        if (mask) return pos + __builtin_ctz(mask);
+    }
+#endif
+    const unsigned enabled = carve_net_memory ? ~0U : ~(CARVE_SOCKADDR | CARVE_TCPT);
+    for (; pos < end; pos++) {
+        if (carvers_at(buf + pos) & enabled) return pos;
+    }
+    return end;
+}
+
 void scan_net_t::carve(const sbuf_t &sbuf) const
 {
     /* Scan through every byte of the buffer for all possible packets
      * If we find a pcap file or a packet at the present location,
      * don't bother with the remainder.
      *
-     * Please remember that this is called for every byte, so it needs to be fast.
+     * Please remember that this is called for every byte, so it needs to be fast:
+     * each offset is tried with the carvers that carvers_at() says could match there,
+     * and the offsets at which none could are skipped 16 at a time.
      */
+    if (sbuf.bufsize < MIN_SBUF_SIZE) {
+        pwriter.flush();
+        return;
+    }
+    const uint8_t *buf = sbuf.get_buf();
+    const size_t end = std::min<size_t>(sbuf.pagesize, sbuf.bufsize - MIN_SBUF_SIZE);
+    const unsigned enabled = carve_net_memory ? ~0U : ~(CARVE_SOCKADDR | CARVE_TCPT);
     size_t pos = 0;
-    while (pos < sbuf.pagesize && pos < sbuf.bufsize - MIN_SBUF_SIZE) {
+    while (pos < end) {
+        pos = skip_to_candidate(buf, pos, end);
+        if (pos >= end) break;
+        const unsigned carvers = carvers_at(buf + pos) & enabled;
         size_t carved = 0;
 
         /* Look for a PCAPFile header */
-        size_t sfile = carvePCAPFile( sbuf, pos );
-        if (sfile>0) {
-            pos += sfile;
-            continue;
+        if (carvers & CARVE_PCAP_FILE) {
+            size_t sfile = carvePCAPFile( sbuf, pos );
+            if (sfile>0) {
+                pos += sfile;
+                continue;
+            }
         }
         /* Look for a PCAP Packet without a PCAP File header. Could just be floating in space...*/
-        size_t spacket = carvePCAPPacket( sbuf, pos );
-        if (spacket>0) {
-            pos += spacket;
-            continue;
+        if (carvers & CARVE_PCAP_PACKET) {
+            size_t spacket = carvePCAPPacket( sbuf, pos );
+            if (spacket>0) {
+                pos += spacket;
+                continue;
+            }
         }
 
         /* Look for another recognizable structure. If we find it, advance as far as a the biggest one */
         // carve either caused the problems!
-        carved = carveEther( sbuf, pos ); // look for an ethernet packet; true causes the packet to be carved if found
-        if (carved==0){
+        if (carvers & CARVE_ETHER) {
+            carved = carveEther( sbuf, pos ); // look for an ethernet packet; true causes the packet to be carved if found
+        }
+        if (carved==0 && (carvers & CARVE_IP)){
             carved = carveIPFrame( sbuf, pos ); // look for an IP packet
         }
 
-        if (carved==0 && carve_net_memory){
+        if (carved==0 && (carvers & (CARVE_SOCKADDR | CARVE_TCPT))){
             /* If we can't carve a packet, look for these two memory structures */
-            carved = std::max(carveSockAddrIn( sbuf, pos ), carveTCPTOBJ( sbuf, pos ));
+            carved = std::max((carvers & CARVE_SOCKADDR) ? carveSockAddrIn( sbuf, pos ) : 0,
+                              (carvers & CARVE_TCPT) ? carveTCPTOBJ( sbuf, pos ) : 0);
         }
         pos += (carved>0 ? carved : 1);	// advance the pointer
     }
@@ -853,6 +1031,8 @@ void scan_net(scanner_params &sp)
     if (sp.phase==scanner_params::PHASE_INIT){
 
         sp.get_scanner_config("carve_net_memory",&opt_carve_net_memory,"Carve network  memory structures");
+        sp.get_scanner_config("net_flows",&opt_net_flows,"Write each distinct packet once and aggregate the packets into flows in net_flows.txt");
+        sp.get_scanner_config("net_pcap",&opt_net_pcap,"Write the carved packets to packets.pcap");
 
 	assert(sizeof(struct be13::ip4)==20);	// we've had problems on some systems
         sp.info->set_name("net");
@@ -861,8 +1041,8 @@ void scan_net(scanner_params &sp)
         sp.info->scanner_version= "1.0";
         sp.info->min_sbuf_size  = 16;
 
-	sp.info->feature_defs.push_back( feature_recorder_def("ip"));
-	sp.info->feature_defs.push_back( feature_recorder_def("ether"));
+	sp.info->feature_defs.push_back( recorder_handle::make_def("ip"));
+	sp.info->feature_defs.push_back( recorder_handle::make_def("ether"));
 
 	/* changed the pattern to be the entire feature,
 	 * since histogram was not being created with previous pattern
@@ -871,17 +1051,24 @@ void scan_net(scanner_params &sp)
         histogram_def::flags_t f;
         f.require_context = true;
         f.require_feature = false;
-	sp.info->histogram_defs.push_back( histogram_def("ip",  "ip",      "", scan_net_t::CHKSUM_OK, "histogram", f));
-        sp.info->histogram_defs.push_back( histogram_def("ether","ether", "([^\(]+)","", "histogram", histogram_def::flags_t()));
+	heavy_hitters::add_def(sp, histogram_def("ip",  "ip",      "", scan_net_t::CHKSUM_OK, "histogram", f));
+        heavy_hitters::add_def(sp, histogram_def("ether","ether", "([^\(]+)","", "histogram", histogram_def::flags_t()));
 
-        sp.info->feature_defs.push_back( feature_recorder_def("tcp"));
-        sp.info->histogram_defs.push_back(histogram_def("tcp", "tcp", "", "", "histogram", histogram_def::flags_t()));
+        sp.info->feature_defs.push_back( recorder_handle::make_def("tcp"));
+        heavy_hitters::add_def(sp, histogram_def("tcp", "tcp", "", "", "histogram", histogram_def::flags_t()));
+        if (opt_net_flows) {
+            sp.info->feature_defs.push_back( recorder_handle::make_def("net_flows"));
+        }
 
         return;
     }
     if (sp.phase==scanner_params::PHASE_INIT2){
         scanner = new scan_net_t(sp);
         scanner->carve_net_memory = opt_carve_net_memory;
+        scanner->write_pcap = opt_net_pcap;
+        if (opt_net_flows) {
+            scanner->flows_recorder = &sp.named_feature_recorder("net_flows");
+        }
     }
     if (sp.phase==scanner_params::PHASE_SCAN){
         try {
@@ -897,6 +1084,7 @@ void scan_net(scanner_params &sp)
     }
     if (sp.phase==scanner_params::PHASE_SHUTDOWN){
         if (scanner){
+            scanner->write_flows();
             delete scanner;
             scanner = nullptr;
         }
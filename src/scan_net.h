@@ -27,6 +27,7 @@ typedef char sa_family_t;
 #include "be13_api/sbuf.h"
 #include "be13_api/packet_info.h"
 #include "be13_api/feature_recorder.h"
+#include "net_flows.h"
 #include "pcap_writer.h"
 
 struct scan_net_t {
@@ -76,10 +77,24 @@ struct scan_net_t {
     feature_recorder &ether_recorder;
 
 
+    /* one's complement sum of the little-endian 16-bit words of buf, added to sum and folded to 16 bits;
+     * an odd last byte is the low byte of a word. SSE2 or NEON, 16 bytes at a time.
+     */
+    static uint32_t ones_complement_sum(const uint8_t *buf, size_t len, uint64_t sum);
     static uint16_t ip4_cksum(const sbuf_t &sbuf, size_t pos, size_t len);
     static uint16_t IPv6L3Chksum(const sbuf_t &sbuf, size_t pos, u_int chksum_byteoffset);
 
     bool carve_net_memory {false};      // should we carve for network memory?
+    bool write_pcap {true};             // -S net_pcap: write the packets to packets.pcap
+    feature_recorder *flows_recorder {nullptr}; // -S net_flows: aggregate the packets into net_flows.txt
+
+    /* The 5-tuple of the IP datagram at sbuf[ip_pos] with header h; false if it is neither v4 nor v6 */
+    static bool flow_key(const sbuf_t &sbuf, size_t ip_pos, const generic_iphdr_t &h, net_flows::key_t &k);
+    /* pwriter.pcap_writepkt(), unless pcap output is off or, with flows, the datagram at sbuf[ip_pos]
+     * (with header ip, or nullptr if it is not IP) was written before; where is the packet's place */
+    void write_packet(const struct pcap_writer::pcap_hdr &h, const sbuf_t &sbuf, size_t pos, bool add_frame,
+                      uint16_t frame_type, size_t ip_pos, const generic_iphdr_t *ip, const pos0_t &where) const;
+    void write_flows() const;           // at shutdown
 
     /* Header for the PCAP file */
     constexpr static uint8_t PCAP_HEADER[] {
@@ -137,6 +152,17 @@ struct scan_net_t {
     size_t carvePCAPFile(const sbuf_t &sbuf, size_t pos) const;
     size_t carveEther(const sbuf_t &sbuf, size_t pos) const;
     void   carve(const sbuf_t &sbuf) const;
+
+    /* The carvers that could match at an offset, from the bytes that each one requires */
+    static constexpr unsigned CARVE_PCAP_FILE   = 0x01;
+    static constexpr unsigned CARVE_PCAP_PACKET = 0x02;
+    static constexpr unsigned CARVE_ETHER       = 0x04;
+    static constexpr unsigned CARVE_IP          = 0x08;
+    static constexpr unsigned CARVE_SOCKADDR    = 0x10;
+    static constexpr unsigned CARVE_TCPT        = 0x20;
+    static constexpr size_t   CARVERS_BYTES     = 16; // carvers_at() reads p[0] through p[15]
+    unsigned carvers_at(const uint8_t *p) const;
+    size_t   skip_to_candidate(const uint8_t *buf, size_t pos, size_t end) const;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const scan_net_t::generic_iphdr_t &h) {
@@ -17,13 +17,18 @@
 #include "config.h"
 
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 
+#include "recorder_handle.h"
 #include "utf8.h"
+#include "signature_prefilter.h"
 
 #define SECTOR_SIZE 512
 #define CLUSTER_SIZE 4096
 #define FEATURE_FILE_NAME "ntfsindx_carved"
 
+static size_t indx_signature = 0;       // "INDX", in the signature_prefilter
+
 
 // check $INDEX_ALLOCATION INDX Signature
 // return: 1 - valid INDX record, 2 - corrupt INDX record, 0 - not INDX record
@@ -71,6 +76,8 @@ int8_t check_indxrecord_type(size_t offset, const sbuf_t &sbuf) {
         return 0;
 }
 
+static recorder_handle ntfsindx_file {FEATURE_FILE_NAME};
+
 extern "C"
 
 void scan_ntfsindx(scanner_params &sp)
@@ -84,20 +91,28 @@ void scan_ntfsindx(scanner_params &sp)
         sp.info->scanner_flags.scanner_wants_filesystems = true;
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-        sp.info->feature_defs.push_back( feature_recorder_def(FEATURE_FILE_NAME, carve_flag));
+        sp.info->feature_defs.push_back( ntfsindx_file.def(carve_flag));
+        return;
+    }
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        ntfsindx_file.resolve(sp);
+        indx_signature = signature_prefilter::shared().add("INDX", 0, CLUSTER_SIZE);
         return;
     }
     if(sp.phase==scanner_params::PHASE_SCAN){
         const sbuf_t &sbuf = *(sp.sbuf);
-        feature_recorder &ntfsindx_recorder = sp.named_feature_recorder(FEATURE_FILE_NAME);
+        feature_recorder &ntfsindx_recorder = *ntfsindx_file;
 
-        // search for NTFS $INDEX_ALLOCATION INDX record in the sbuf
+        // search for NTFS $INDEX_ALLOCATION INDX record in the sbuf; only the clusters that start with INDX are checked
         size_t offset = 0;
         size_t stop = sbuf.pagesize;
         size_t total_record_size=0;
         int8_t result_type, record_type;
 
-        while (offset < stop) {
+        for (size_t candidate : signature_prefilter::shared().candidates(sbuf, indx_signature)) {
+            if (candidate < offset) // in the records already carved
+                continue;
+            offset = candidate;
 
             result_type = check_indxrecord_signature(offset, sbuf);
             total_record_size = CLUSTER_SIZE;
@@ -124,17 +139,17 @@ void scan_ntfsindx(scanner_params &sp)
                         else
                             break;
                     }
-                    ntfsindx_recorder.carve(sbuf_t(sbuf,offset,total_record_size), ".INDX");
+                    carve_index::carve(ntfsindx_recorder, sbuf_t(sbuf,offset,total_record_size), ".INDX");
                 }
                 else if(record_type == 2) {
-                    ntfsindx_recorder.carve(sbuf_t(sbuf,offset,total_record_size),".INDX_ObjId-O");
+                    carve_index::carve(ntfsindx_recorder, sbuf_t(sbuf,offset,total_record_size),".INDX_ObjId-O");
                 }
                 else { // 0 - Other INDX record (Secure-SDH, Secure-SII, etc.)
-                    ntfsindx_recorder.carve(sbuf_t(sbuf,offset,total_record_size),".INDX_Misc");
+                    carve_index::carve(ntfsindx_recorder, sbuf_t(sbuf,offset,total_record_size),".INDX_Misc");
                 }
             }
             else if (result_type == 2) {
-                ntfsindx_recorder.carve(sbuf_t(sbuf,offset,total_record_size),".INDX_corrupted");
+                carve_index::carve(ntfsindx_recorder, sbuf_t(sbuf,offset,total_record_size),".INDX_corrupted");
             }
             else { // result_type == 0
             }
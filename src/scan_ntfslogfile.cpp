@@ -13,16 +13,26 @@
 //#include <cerrno>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <iterator>
 
 #include "config.h"
 #include "be13_api/scanner_params.h"
+#include "carve_extents.h"
+#include "carve_index.h"
 
+#include "recorder_handle.h"
+#include "scratch_arena.h"
 #include "utf8.h"
+#include "signature_prefilter.h"
 
 #define SECTOR_SIZE 512
 #define CLUSTER_SIZE 4096
 #define FEATURE_FILE_NAME "ntfslogfile_carved"
 
+static size_t rcrd_signature = 0;       // "RCRD" and "RSTR", in the signature_prefilter
+static size_t rstr_signature = 0;
+
 
 // check $LogFile RCRD Signature
 // return: 1 - valid RCRD record, 2 - corrupt RCRD record,
@@ -73,6 +83,8 @@ int8_t check_logfilerecord_signature(size_t offset, const sbuf_t &sbuf) {
     }
 }
 
+static recorder_handle ntfslogfile_file {FEATURE_FILE_NAME};
+
 extern "C"
 
 void scan_ntfslogfile(scanner_params &sp)
@@ -87,20 +99,39 @@ void scan_ntfslogfile(scanner_params &sp)
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
 
-        sp.info->feature_defs.push_back( feature_recorder_def(FEATURE_FILE_NAME, carve_flag));
+        sp.info->feature_defs.push_back( ntfslogfile_file.def(carve_flag));
+        return;
+    }
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        ntfslogfile_file.resolve(sp);
+        rcrd_signature = signature_prefilter::shared().add("RCRD", 0, CLUSTER_SIZE);
+        rstr_signature = signature_prefilter::shared().add("RSTR", 0, CLUSTER_SIZE);
+        return;
+    }
+    if(sp.phase==scanner_params::PHASE_SHUTDOWN){
+        carve_extents::flush(*ntfslogfile_file);  // the runs whose neighbouring pages were not scanned
         return;
     }
     if(sp.phase==scanner_params::PHASE_SCAN){
         const sbuf_t &sbuf = (*sp.sbuf);
-        feature_recorder &ntfslogfile_recorder = sp.named_feature_recorder(FEATURE_FILE_NAME);
+        feature_recorder &ntfslogfile_recorder = *ntfslogfile_file;
+        carve_extents::page extents(ntfslogfile_recorder, sbuf);
 
-        // search for NTFS $LogFile RCRD record in the sbuf
+        // search for NTFS $LogFile RCRD record in the sbuf; only the clusters that start with RCRD or RSTR are checked
         size_t offset = 0;
         size_t stop = sbuf.pagesize;
         size_t total_record_size=0;
         int8_t result_type;
 
-        while (offset < stop) {
+        const std::vector<size_t> &rcrd = signature_prefilter::shared().candidates(sbuf, rcrd_signature);
+        const std::vector<size_t> &rstr = signature_prefilter::shared().candidates(sbuf, rstr_signature);
+        scratch_vector<size_t> candidates;
+        std::merge(rcrd.begin(), rcrd.end(), rstr.begin(), rstr.end(), std::back_inserter(candidates));
+
+        for (size_t candidate : candidates) {
+            if (candidate < offset) // in the records already carved
+                continue;
+            offset = candidate;
 
             result_type = check_logfilerecord_signature(offset, sbuf);
             total_record_size = CLUSTER_SIZE;
@@ -118,20 +149,25 @@ void scan_ntfslogfile(scanner_params &sp)
                     else
                         break;
                 }
-                ntfslogfile_recorder.carve( sbuf_t(sbuf,offset,total_record_size), ".LogFile-RCRD");
+                // a run to the end of the page may go on in the next one: joined with it if the next record is valid
+                const size_t next = offset+total_record_size;
+                const bool continues = next >= stop && next + CLUSTER_SIZE <= sbuf.bufsize &&
+                    check_logfilerecord_signature(next, sbuf) == 1;
+                extents.carve(offset, total_record_size, CLUSTER_SIZE, continues, ".LogFile-RCRD");
             }
             else if (result_type == 2) {
-                ntfslogfile_recorder.carve( sbuf_t(sbuf,offset,total_record_size), ".LogFile-RCRD_corrupted");
+                carve_index::carve(ntfslogfile_recorder, sbuf_t(sbuf,offset,total_record_size), ".LogFile-RCRD_corrupted");
             }
             else if (result_type == 3) {
-                ntfslogfile_recorder.carve( sbuf_t(sbuf,offset,total_record_size), ".LogFile-RSTR");
+                carve_index::carve(ntfslogfile_recorder, sbuf_t(sbuf,offset,total_record_size), ".LogFile-RSTR");
             }
             else if (result_type == 4) {
-                ntfslogfile_recorder.carve( sbuf_t(sbuf,offset,total_record_size),".LogFile-RSTR_corrupted");
+                carve_index::carve(ntfslogfile_recorder, sbuf_t(sbuf,offset,total_record_size),".LogFile-RSTR_corrupted");
             }
             else { // result_type == 0 - not RCRD record
             }
             offset += total_record_size;
         }
+        extents.finish();
     }
 }
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <sstream>
@@ -16,8 +17,13 @@
 
 #include "config.h"
 #include "be13_api/scanner_params.h"
+#include "carve_extents.h"
+#include "carve_index.h"
 
+#include "recorder_handle.h"
 #include "utf8.h"
+#include "sbuf_span.h"
+#include "signature_prefilter.h"
 
 
 #define SECTOR_SIZE 512
@@ -25,36 +31,37 @@
 #define MFT_RECORD_SIZE 1024
 #define FEATURE_FILE_NAME "ntfsmft_carved"
 
+static size_t mft_signature = 0;        // "FILE", in the signature_prefilter
+
 
 // check MFT Record Signature
 // return: 1 - valid MFT record, 2 - corrupt MFT record, 0 - not MFT record
 int8_t check_mftrecord_signature(size_t offset, const sbuf_t &sbuf) {
-    int16_t fixup_offset;
-    int16_t fixup_count;
-    int16_t fixup_value;
+    const sbuf_span_le header(sbuf, offset, 8);
+    if (!header || !header.equals(0, "FILE", 4)) return 0;
 
-    if (sbuf[offset] == 0x46 && sbuf[offset + 1] == 0x49 &&
-        sbuf[offset + 2] == 0x4c  && sbuf[offset + 3] == 0x45) {
+    int16_t fixup_offset = header.get16i(4);
+    if (fixup_offset <= 0 || fixup_offset >= SECTOR_SIZE)
+        return 0;
+    int16_t fixup_count = header.get16i(6);
+    if (fixup_count <= 0 || fixup_count >= SECTOR_SIZE)
+        return 0;
 
-        fixup_offset = sbuf.get16i(offset + 4);
-        if (fixup_offset <= 0 || fixup_offset >= SECTOR_SIZE)
-            return 0;
-        fixup_count = sbuf.get16i(offset + 6);
-        if (fixup_count <= 0 || fixup_count >= SECTOR_SIZE)
-            return 0;
+    // the fixup array and the end of each sector it covers
+    const sbuf_span_le record(sbuf, offset, std::max<size_t>(fixup_offset + 2, SECTOR_SIZE * (fixup_count - 1)));
+    if (!record) return 0;
 
-        fixup_value = sbuf.get16i(offset + fixup_offset);
+    int16_t fixup_value = record.get16i(fixup_offset);
 
-        for(int i=1;i<fixup_count;i++){
-            if (fixup_value != sbuf.get16i(offset + (SECTOR_SIZE * i) - 2))
-                return 2;
-        }
-        return 1;
-    } else {
-        return 0;
+    for(int i=1;i<fixup_count;i++){
+        if (fixup_value != record.get16i((SECTOR_SIZE * i) - 2))
+            return 2;
     }
+    return 1;
 }
 
+static recorder_handle ntfsmft_file {FEATURE_FILE_NAME};
+
 extern "C"
 
 void scan_ntfsmft(scanner_params &sp)
@@ -67,21 +74,34 @@ void scan_ntfsmft(scanner_params &sp)
         sp.info->scanner_version = "1.0";
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-        sp.info->feature_defs.push_back( feature_recorder_def(FEATURE_FILE_NAME, carve_flag));
+        sp.info->feature_defs.push_back( ntfsmft_file.def(carve_flag));
         sp.info->scanner_flags.scanner_wants_filesystems = true;
         return;
     }
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        ntfsmft_file.resolve(sp);
+        mft_signature = signature_prefilter::shared().add("FILE", 0, MFT_RECORD_SIZE);
+        return;
+    }
+    if(sp.phase==scanner_params::PHASE_SHUTDOWN){
+        carve_extents::flush(*ntfsmft_file);    // the runs whose neighbouring pages were not scanned
+        return;
+    }
     if(sp.phase==scanner_params::PHASE_SCAN){
         const sbuf_t &sbuf = (*sp.sbuf);
-        feature_recorder &ntfsmft_recorder = sp.named_feature_recorder(FEATURE_FILE_NAME);
+        feature_recorder &ntfsmft_recorder = *ntfsmft_file;
+        carve_extents::page extents(ntfsmft_recorder, sbuf);
 
-        // search for NTFS MFT record in the sbuf
+        // search for NTFS MFT record in the sbuf; only the record offsets that start with FILE are checked
         size_t offset = 0;
         size_t stop = sbuf.pagesize;
         size_t total_record_size=0;
         int8_t result_type;
 
-        while (offset < stop) {
+        for (size_t candidate : signature_prefilter::shared().candidates(sbuf, mft_signature)) {
+            if (candidate < offset) // in the records already carved
+                continue;
+            offset = candidate;
 
             result_type = check_mftrecord_signature(offset, sbuf);
             total_record_size = MFT_RECORD_SIZE;
@@ -100,14 +120,18 @@ void scan_ntfsmft(scanner_params &sp)
                     else
                         break;
                 }
-                ntfsmft_recorder.carve(sbuf_t(sbuf,offset,total_record_size),".mft");
+                // a table to the end of the page may go on in the next one: joined with it if the next record is valid
+                const bool continues = offset+total_record_size >= stop &&
+                    check_mftrecord_signature(offset+total_record_size, sbuf) == 1;
+                extents.carve(offset, total_record_size, MFT_RECORD_SIZE, continues, ".mft");
             }
             else if (result_type == 2) {
-                ntfsmft_recorder.carve(sbuf_t(sbuf,offset,total_record_size),".mft_corrputed");
+                carve_index::carve(ntfsmft_recorder, sbuf_t(sbuf,offset,total_record_size),".mft_corrputed");
             }
             else { // result_type == 0 - not MFT record
             }
             offset += total_record_size;
         }
+        extents.finish();
     }
 }
@@ -18,13 +18,18 @@
 #include "config.h"
 
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 
+#include "recorder_handle.h"
 #include "utf8.h"
+#include "signature_prefilter.h"
 
 #define SECTOR_SIZE 512
 #define CLUSTER_SIZE 4096
 #define FEATURE_FILE_NAME "ntfsusn_carved"
 
+static size_t usnv2_signature = 0;      // MajorVersion 2, MinorVersion 0, in the signature_prefilter
+
 size_t check_usnrecordv2_signature(size_t offset, const sbuf_t &sbuf) {
     size_t record_size;
     if (sbuf[offset + 2] == 0x00 && sbuf[offset + 3] == 0x00 && sbuf[offset + 4] == 0x02
@@ -66,6 +71,8 @@ size_t check_usnrecordv2_or_v4_signature(size_t offset, const sbuf_t &sbuf) {
     return 0;
 }
 
+static recorder_handle ntfsusn_file {FEATURE_FILE_NAME};
+
 extern "C"
 
 void scan_ntfsusn(scanner_params &sp)
@@ -80,38 +87,46 @@ void scan_ntfsusn(scanner_params &sp)
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
 
-        sp.info->feature_defs.push_back( feature_recorder_def(FEATURE_FILE_NAME, carve_flag));
+        sp.info->feature_defs.push_back( ntfsusn_file.def(carve_flag));
+        return;
+    }
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        ntfsusn_file.resolve(sp);
+        // the high bytes of RecordLength, then MajorVersion and MinorVersion; records are 8-byte aligned
+        usnv2_signature = signature_prefilter::shared().add(std::string("\x00\x00\x02\x00\x00\x00", 6), 2, 8);
         return;
     }
     if(sp.phase==scanner_params::PHASE_SCAN){
         const sbuf_t &sbuf = *(sp.sbuf);
-        feature_recorder &ntfsusn_recorder = sp.named_feature_recorder(FEATURE_FILE_NAME);
+        feature_recorder &ntfsusn_recorder = *ntfsusn_file;
 
         size_t offset = 0;
         size_t stop = sbuf.pagesize;
         size_t record_size=0;
         size_t total_record_size=0;
 
-        // search for USN_RECORD_V2 Structure in the sbuf
-        while (offset < stop) {
+        // search for USN_RECORD_V2 Structure in the sbuf, at the 8-byte boundaries with its version
+        for (size_t candidate : signature_prefilter::shared().candidates(sbuf, usnv2_signature)) {
+            if (candidate < offset) // in the records already carved
+                continue;
+            offset = candidate;
             record_size = check_usnrecordv2_signature(offset,sbuf);
             if (record_size == 0) {
-                offset += 8; // because of USN_RECORD stored at 8 byte boundary
                 continue;
             }
             if (record_size % 8 != 0) { // illegal size
                 uint8_t padding;
                 padding = 8 - (record_size % 8);
-                ntfsusn_recorder.carve( sbuf_t(sbuf,offset,record_size+padding), ".UsnJrnl-J_corrupted");
+                carve_index::carve(ntfsusn_recorder, sbuf_t(sbuf,offset,record_size+padding), ".UsnJrnl-J_corrupted");
                 offset += record_size+padding;
                 continue;
             }
             total_record_size = record_size;
             if (offset+total_record_size > stop) {
                 if(offset+total_record_size < sbuf.bufsize)
-                    ntfsusn_recorder.carve( sbuf_t(sbuf,offset,total_record_size), ".UsnJrnl-J");
+                    carve_index::carve(ntfsusn_recorder, sbuf_t(sbuf,offset,total_record_size), ".UsnJrnl-J");
                 else
-                    ntfsusn_recorder.carve( sbuf_t(sbuf,offset,total_record_size), ".UsnJrnl-J_corrupted");
+                    carve_index::carve(ntfsusn_recorder, sbuf_t(sbuf,offset,total_record_size), ".UsnJrnl-J_corrupted");
                 break;
             }
             // found one record then also checks following valid records and writes all at once
@@ -146,7 +161,7 @@ void scan_ntfsusn(scanner_params &sp)
                     }
                 }
             }
-            ntfsusn_recorder.carve(sbuf_t(sbuf,offset,total_record_size),".UsnJrnl-J");
+            carve_index::carve(ntfsusn_recorder, sbuf_t(sbuf,offset,total_record_size),".UsnJrnl-J");
             offset += total_record_size;
         }
     }
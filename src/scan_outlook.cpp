@@ -6,11 +6,24 @@
 #include "config.h"
 
 #include "be13_api/scanner_params.h"
+#include "byte_map.h"
+#include "memory_governor.h"
 #include "scan_outlook.h"
 #include "utils.h" // needs config.h
 
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
 // This scanner has depth0_only set so that it only runs at top-level. This means we would
 // miss an outlook file that had been zipped and sent by email or archived, but that rarely happens.
+//
+// Only the data blocks of PST and OST files are decrypted. A block is found by its trailer at the end
+// of a 64-byte slot: its cb, a BID with the reserved bit clear, and a CRC of its cb bytes that matches.
+// Blocks whose BID has the internal bit set hold the file's structure and are not encrypted. A file
+// header (!BDN) in the buffer gives the encryption of the blocks after it; those of a file with none
+// (or with cyclic encryption, which this scanner does not decrypt) are left, and the blocks of an ANSI
+// file, whose trailers are too short to find without it, are checked against their wSig.
 
 /*
  * Below is the decoding array, i.e.:
@@ -34,7 +47,7 @@
 
 /* For compressible encryption
  */
-static uint8_t libpff_encryption_compressible[] = {
+static const uint8_t libpff_encryption_compressible[256] = {
 	0x47, 0xf1, 0xb4, 0xe6, 0x0b, 0x6a, 0x72, 0x48, 0x85, 0x4e, 0x9e, 0xeb, 0xe2, 0xf8, 0x94, 0x53,
 	0xe0, 0xbb, 0xa0, 0x02, 0xe8, 0x5a, 0x09, 0xab, 0xdb, 0xe3, 0xba, 0xc6, 0x7c, 0xc3, 0x10, 0xdd,
 	0x39, 0x05, 0x96, 0x30, 0xf5, 0x37, 0x60, 0x82, 0x8c, 0xc9, 0x13, 0x4a, 0x6b, 0x1d, 0xf3, 0xfb,
@@ -56,18 +69,97 @@ static uint8_t libpff_encryption_compressible[] = {
 
 #define SCANNER_NAME "OUTLOOK"
 
+namespace {
+const size_t   BLOCK_ALIGN {64};
+const size_t   MAX_BLOCK {8192};               // bytes in a block, with its trailer
+const size_t   UNICODE_TRAILER {16};           // cb, wSig, dwCRC, bid (64 bits)
+const size_t   ANSI_TRAILER {12};              // cb, wSig, bid (32 bits), dwCRC
+const size_t   HEADER_ALIGN {512};             // a PST starts on a sector of the image
+const size_t   MAX_EXTENT_GAP {4096};          // blocks this close are decrypted and recursed together
+const uint8_t  NDB_CRYPT_PERMUTE {1};
+const uint64_t MAX_BID {1ULL << 40};           // BIDs are allocated in order; larger ones are noise
+
+uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+uint32_t le32(const uint8_t *p) { return le16(p) | (uint32_t(le16(p + 2)) << 16); }
+uint64_t le64(const uint8_t *p) { return le32(p) | (uint64_t(le32(p + 4)) << 32); }
+
+/* MS-PST 5.3: CRC-32 with no initial or final inversion */
+uint32_t pst_crc(const uint8_t *p, size_t len) { return crc32(0xffffffffUL, p, len) ^ 0xffffffffUL; }
+/* MS-PST 5.5: the wSig of a block at file offset ib */
+uint16_t pst_sig(uint64_t ib, uint64_t bid) { ib ^= bid; return uint16_t((ib >> 16) ^ ib); }
+
+struct pst_header {
+    size_t  offset;
+    uint8_t crypt;
+    bool    ansi;
+};
+}
+
+std::vector<pst_extent> pst_extents(const sbuf_t &sbuf)
+{
+    const uint8_t *buf = sbuf.get_buf();
+    const size_t bufsize = sbuf.bufsize;
+
+    std::vector<pst_header> headers;
+    for (size_t h = 0; h + 0x202 <= bufsize && h < sbuf.pagesize; h += HEADER_ALIGN) {
+        if (memcmp(buf + h, "!BDN", 4) != 0) continue;
+        const uint16_t ver = le16(buf + h + 10);
+        if (ver == 14 || ver == 15) headers.push_back(pst_header{h, buf[h + 0x1CD], true});
+        else if (ver >= 23)         headers.push_back(pst_header{h, buf[h + 0x201], false});
+    }
+
+    std::vector<std::pair<size_t, size_t>> blocks;
+    size_t next_header = 0;
+    const pst_header *header = nullptr; // of the file the slot is in, if it is known
+    for (size_t e = BLOCK_ALIGN; e <= bufsize; e += BLOCK_ALIGN) {
+        while (next_header < headers.size() && headers[next_header].offset < e) header = &headers[next_header++];
+        if (header && header->crypt != NDB_CRYPT_PERMUTE) continue;
+        size_t cb = 0, trailer = 0;
+        uint64_t bid = 0;
+        uint32_t crc = 0;
+        if (header && header->ansi) {
+            cb = le16(buf + e - ANSI_TRAILER);
+            bid = le32(buf + e - ANSI_TRAILER + 4);
+            crc = le32(buf + e - ANSI_TRAILER + 8);
+            trailer = ANSI_TRAILER;
+        } else {
+            cb = le16(buf + e - UNICODE_TRAILER);
+            crc = le32(buf + e - UNICODE_TRAILER + 4);
+            bid = le64(buf + e - UNICODE_TRAILER + 8);
+            trailer = UNICODE_TRAILER;
+        }
+        if (cb == 0 || cb + trailer > MAX_BLOCK || bid == 0 || (bid & 1) || bid >= MAX_BID) continue;
+        if (bid & 2) continue;          // internal, so not encrypted
+        const size_t slot = (cb + trailer + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+        if (slot > e) continue;
+        const size_t start = e - slot;
+        if (start >= sbuf.pagesize) break; // the next page's
+        if (header && header->ansi && le16(buf + e - ANSI_TRAILER + 2) != pst_sig(start - header->offset, bid)) continue;
+        if (pst_crc(buf + start, cb) != crc) continue;
+        blocks.emplace_back(start, start + cb);
+    }
+
+    std::vector<pst_extent> extents;
+    for (const auto &b : blocks) {
+        if (extents.empty() || b.first > extents.back().end + MAX_EXTENT_GAP) {
+            extents.push_back(pst_extent{b.first, b.second, {}});
+        }
+        extents.back().end = std::max(extents.back().end, b.second);
+        extents.back().blocks.push_back(b);
+    }
+    return extents;
+}
+
 extern "C"
 void scan_outlook(scanner_params &sp)
 {
     sp.check_version();
     if(sp.phase==scanner_params::PHASE_INIT) {
         sp.info->set_name("outlook" );
-        sp.info->scanner_flags.default_enabled = false;
         sp.info->scanner_flags.depth0_only = true; // only run depth 0
         sp.info->scanner_flags.recurse = true;
-        sp.info->scanner_flags.recurse_always = true;
 	sp.info->author = "Simson L. Garfinkel";
-	sp.info->description = "Outlook Compressible Encryption. Very CPU intensive.";
+	sp.info->description = "Outlook Compressible Encryption, in the data blocks of PST and OST files";
 	return;
     }
     if(sp.phase==scanner_params::PHASE_SCAN) {
@@ -76,11 +168,18 @@ void scan_outlook(scanner_params &sp)
 
         // dodge infinite recursion by refusing to operate on an OFE'd buffer
         if(pos0.lastAddedPart() != SCANNER_NAME) {
-            auto *nbuf = sbuf_t::sbuf_malloc(pos0 + SCANNER_NAME, sbuf.bufsize, sbuf.bufsize);
-            for(size_t ii = 0; ii < nbuf->bufsize; ii++) {
-                nbuf->wbuf(ii, libpff_encryption_compressible[ sbuf[ii] ]);
+            for (const auto &extent : pst_extents(sbuf)) {
+                const size_t len = extent.end - extent.start;
+                memory_governor::wait_for_budget(len, sbuf.depth() + 1);
+                auto *nbuf = sbuf_t::sbuf_malloc((pos0 + extent.start) + SCANNER_NAME, len, len);
+                uint8_t *dst = static_cast<uint8_t *>(nbuf->malloc_buf());
+                memcpy(dst, sbuf.get_buf() + extent.start, len); // trailers and the blocks between
+                for (const auto &b : extent.blocks) {
+                    byte_map(sbuf.get_buf() + b.first, dst + (b.first - extent.start), b.second - b.first,
+                             libpff_encryption_compressible);
+                }
+                sp.recurse(nbuf);
             }
-            sp.recurse(nbuf);
         }
     }
 }
@@ -17,3 +17,24 @@
  * You should have received a copy of the GNU Lesser General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+
+#ifndef SCAN_OUTLOOK_H
+#define SCAN_OUTLOOK_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "be13_api/sbuf.h"
+
+/* The data blocks of PST and OST files (MS-PST 2.2.2.8) that start in the page of sbuf, found by their
+ * trailers, and gathered into the extents that are decrypted and recursed. Offsets are in sbuf.
+ */
+struct pst_extent {
+    size_t start {0};
+    size_t end {0};
+    std::vector<std::pair<size_t, size_t>> blocks {}; // [start, end) of the encrypted data of each block
+};
+std::vector<pst_extent> pst_extents(const sbuf_t &sbuf);
+
+#endif
@@ -13,6 +13,8 @@
  * MIT License, see ../LICENSE.md
  */
 
+#include <algorithm>
+#include <array>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -21,6 +23,7 @@
 
 #include "config.h"
 
+#include "content_cache.h"
 #include "scan_pdf.h"
 #include "sbuf_decompress.h"
 #include "be13_api/scanner_params.h"
@@ -46,15 +49,31 @@ pdf_extractor::~pdf_extractor()
 
 /*
  * Return TRUE if most of the characters (90%) are printable ASCII.
+ * Stops as soon as the answer is known.
  */
 
 bool pdf_extractor::mostly_printable_ascii(const sbuf_t &s)
 {
+    static const auto printable = [] {
+        std::array<bool, 256> t {};
+        for (int i = 0; i < 256; i++) t[i] = isprint(i) || isspace(i);
+        return t;
+    }();
+    const size_t needed = s.pagesize * 9 / 10 + 1;      // count > pagesize*9/10
+    if (needed > s.pagesize) return false;
+    const size_t allowed = s.pagesize - needed;         // unprintable characters that still pass
+    const uint8_t *buf = s.get_buf();
+    const size_t end = std::min(s.pagesize, s.bufsize);
     size_t count = 0;
-    for(u_int i=0; i<s.pagesize; i++){
-        if (isprint(s[i]) || isspace(s[i])) count++;
+    for (size_t i = 0; i < end; i++) {
+        if (printable[buf[i]]) {
+            if (++count >= needed) return true;
+        } else if (i + 1 - count > allowed) {
+            return false;
+        }
     }
-    return count > (s.pagesize * 9 / 10);
+    /* s[i] is 0, which is not printable, past the end of the buffer */
+    return count >= needed;
 }
 
 /*
@@ -82,48 +101,40 @@ bool pdf_extractor::mostly_printable_ascii(const sbuf_t &s)
  */
 std::string  pdf_extractor::extract_text(const sbuf_t &sb)
 {
-    std::string tbuf {};
-    int maxwordsize = 0;
-    bool words_have_spaces = false;
-    /* pass = 0 --- analysis. Find maxwordsize
-     * pass = 1 --- creation.
+    /* Outside a word only '(' is significant, and inside one only ')': the [ and ] of
+     * bracket groups and everything else outside parentheses are ignored.
+     * pass 0 --- analysis. Do the words have spaces?
+     * pass 1 --- creation, a word at a time.
      */
-    for (u_int pass=0;pass<2;pass++){
-        bool in_paren = false;
-        int  wordsize = 0;
-        for (u_int i=0;i<sb.pagesize;i++){
-            const unsigned char cc = sb[i];
-            if(in_paren==false && cc=='[') {
-                /* Beginning of bracket group not in paren; ignore */
-                continue;
-            }
-            if(in_paren==false && cc==']') {
-                /* End of bracket group not in paren; ignore */
-                continue;
-            }
-            if(in_paren==false && cc=='(') {
-                /* beginning of word */
-                wordsize = 0;
-                in_paren = true;
-                continue;
-            }
-            if(in_paren==true &&  cc==')') {
-                /* end of word */
-                in_paren = false;
-                if(pass==0 && (wordsize > maxwordsize))  maxwordsize = wordsize;
-                if(pass==1 && (words_have_spaces==false)){
-                    /* Second pass; words don't have spaces, so add spaces between the parens */
-                    tbuf.push_back(' ');
-                }
-                continue;
-            }
-            if(in_paren){
-                /* in a word */
-                if(cc==' ') words_have_spaces = true;
-                if(pass==1) tbuf.push_back(cc);
-                wordsize+=1;
-            }
+    const char *buf = reinterpret_cast<const char *>(sb.get_buf());
+    const char *end = buf + std::min(sb.pagesize, sb.bufsize);
+    bool words_have_spaces = false;
+    size_t text_size = 0;
+    for (const char *cc = buf; cc < end; ) {
+        const char *open = static_cast<const char *>(memchr(cc, '(', end - cc));
+        if (open == nullptr) break;
+        const char *word = open + 1;
+        const char *close = static_cast<const char *>(memchr(word, ')', end - word));
+        const char *word_end = close ? close : end;
+        if (!words_have_spaces && memchr(word, ' ', word_end - word)) words_have_spaces = true;
+        text_size += (word_end - word) + 1;
+        cc = close ? close + 1 : end;
+    }
+
+    std::string tbuf {};
+    tbuf.reserve(text_size);
+    for (const char *cc = buf; cc < end; ) {
+        const char *open = static_cast<const char *>(memchr(cc, '(', end - cc));
+        if (open == nullptr) break;
+        const char *word = open + 1;
+        const char *close = static_cast<const char *>(memchr(word, ')', end - word));
+        tbuf.append(word, (close ? close : end) - word);
+        if (close == nullptr) break;
+        if (words_have_spaces == false) {
+            /* words don't have spaces, so add spaces between the parens */
+            tbuf.push_back(' ');
         }
+        cc = close + 1;
     }
     return tbuf;
 }
@@ -170,9 +181,8 @@ void pdf_extractor::find_streams()
 
 void pdf_extractor::decompress_streams_extract_text()
 {
-    // note: below we do *not* use a const auto,
-    // because we want to modify the contents of the vector
-    for (const auto &it: streams) {           //
+    texts.reserve(streams.size());
+    for (const auto &it: streams) {
         size_t compr_size = it.endstream_tag - it.stream_start;
         size_t max_uncompr_size = compr_size * 8;       // good assumption for expansion
 
@@ -191,9 +201,7 @@ void pdf_extractor::decompress_streams_extract_text()
 
         if (mostly_printable_ascii(*dbuf)){
             pos0_t pos0 = (sbuf_root.pos0 + it.stream_tag) + "PDF";
-            std::string the_text = extract_text( *dbuf );
-
-            texts.push_back( text(pos0, the_text) );
+            texts.push_back( text(pos0, extract_text( *dbuf )) );
         }
         delete dbuf;
     }
@@ -205,7 +213,7 @@ void pdf_extractor::recurse_texts(scanner_params &sp)
 {
     //std::cerr << "pdf_extractor::recurse_texts\n";
     for (const auto &it: texts) {
-        auto lt = it.txt;
+        const auto &lt = it.txt;
         if (lt.size()>0){
             if (pdf_dump_text){
                 std::cout << "====== pdf_extractor::recurse_texts: " << it.pos0 << "  =====\n";
@@ -214,7 +222,7 @@ void pdf_extractor::recurse_texts(scanner_params &sp)
             auto *nsbuf = sbuf_t::sbuf_malloc( it.pos0, lt);
             //std::cerr << "just made nsbuf:\n" << *nsbuf << "\n";
             //nsbuf->hex_dump(std::cerr);
-            sp.recurse(nsbuf);          // it will delete the sbuf
+            content_cache::recurse(sp, nsbuf);          // it will delete the sbuf
             //std::cerr << "----------------- back from recurse (scan_pdf) -----------------\n";
         }
     }
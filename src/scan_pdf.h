@@ -1,8 +1,10 @@
 #ifndef SCAN_PDF_H
 #define SCAN_PDF_H
 
-#include <vector>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 #include "be13_api/scanner_params.h"
 
 /*
@@ -29,7 +31,7 @@ class pdf_extractor {
     struct text {
         text(pos0_t pos0_, std::string txt_):
             pos0(pos0_),
-            txt(txt_){}
+            txt(std::move(txt_)){}
         // pos0 is the location of where 'stream' appeared.
         pos0_t pos0 {};
         std::string txt {};                      // extracted text from the stream
@@ -37,7 +39,7 @@ class pdf_extractor {
         text(const text &)=delete;
         text(text &&that) noexcept
             :pos0(that.pos0),
-             txt(that.txt){}
+             txt(std::move(that.txt)){}
     };
 public:
     static bool pdf_dump_hex;
@@ -3,13 +3,17 @@
 #include <iostream>
 #include <iomanip>
 #include <cassert>
+#include <memory>
 
 #include "config.h"
 
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 
-#include "utf8.h"
-#include "dfxml_cpp/src/dfxml_writer.h"
+#include "content_cache.h"
+#include "crc32.h"
+#include "recorder_handle.h"
+#include "utf8_text.h"
 
 
 #ifdef USE_RAR
@@ -92,6 +96,10 @@ time_t decode_iso8601(const std::string mtime_iso8601)
 #define METHOD_SMALL 0x34
 #define METHOD_SMALLEST 0x35
 
+// the versions needed to extract that unrar's unpacker handles (1.5 to 3.6)
+#define UNP_VER_MIN 15
+#define UNP_VER_MAX 36
+
 #define OPTIONAL_BIGFILE_LEN 8
 
 #define SUSPICIOUS_HEADER_LEN 1024
@@ -113,48 +121,10 @@ time_t decode_iso8601(const std::string mtime_iso8601)
 #define DOS_SHIFT_YEAR 25
 #define DOS_OFFSET_YEAR 1980
 
-//
-// CRC32
-//
-// generated by pycrc 0.8
-static inline uint32_t crc_init(void)
-{
-    return 0xffffffff;
-}
-static uint32_t crc_reflect(uint32_t data, size_t data_len)
-{
-    unsigned int i;
-    uint32_t ret;
-
-    ret = data & 0x01;
-    for (i = 1; i < data_len; i++) {
-        data >>= 1;
-        ret = (ret << 1) | (data & 0x01);
-    }
-    return ret;
-}
-static inline uint32_t crc_finalize(uint32_t crc)
+// CRC32 of a header; RAR stores its low 16 bits
+static uint32_t header_crc32(const sbuf_t &sbuf)
 {
-    return crc_reflect(crc, 32) ^ 0xffffffff;
-}
-static uint32_t crc_update(uint32_t crc, const sbuf_t &sbuf)
-{
-    for( size_t pos = 0; pos < sbuf.bufsize; pos++){
-        bool bit;
-        unsigned char c = sbuf[pos];
-        for (unsigned int i = 0x01; i & 0xff; i <<= 1) {
-            bit = crc & 0x80000000;
-            if (c & i) {
-                bit = !bit;
-            }
-            crc <<= 1;
-            if (bit) {
-                crc ^= 0x04c11db7;
-            }
-        }
-        crc &= 0xffffffff;
-    }
-    return crc & 0xffffffff;
+    return crc32_update(0, sbuf.get_buf(), sbuf.bufsize);
 }
 
 //
@@ -178,6 +148,11 @@ public:
         compressed_size(compressed_size_), file_attributes(file_attributes_),
         dos_time(dos_time_), host_os(host_os_), crc(crc_) {}
 
+    /* A method and version that unrar can unpack; checked before the output is allocated */
+    bool unpackable() const {
+        return compression_method >= METHOD_FASTEST && compression_method <= METHOD_SMALLEST &&
+            unpack_version >= UNP_VER_MIN && unpack_version <= UNP_VER_MAX;
+    }
     const uint8_t unpack_version_major() const {
         return unpack_version / 10;
     }
@@ -228,16 +203,17 @@ std::string RarComponentInfo::to_xml() const
     char string_buf[STRING_BUF_LEN];
 
     // build XML output
-    std::string filename = dfxml_writer::xmlescape(name);
+    std::string escape_buf;
+    const std::string_view filename = utf8_text::xml_escaped(name, escape_buf);
 
     snprintf(string_buf,sizeof(string_buf),
              "<rar_component>"
-             "<name>%s</name>"
+             "<name>%.*s</name>"
              "<flags>0x%04X</flags><version>%d</version><compression_method>%s</compression_method>"
              "<uncompr_size>%" PRIu64 "</uncompr_size><compr_size>%" PRIu64 "</compr_size><file_attr>0x%X</file_attr>"
              "<lastmoddate>%s</lastmoddate><host_os>%s</host_os><crc32>0x%08X</crc32>"
              "</rar_component>",
-             name.c_str(), flags, unpack_version,
+             int(filename.size()), filename.data(), flags, unpack_version,
              compression_method_label().c_str(), uncompressed_size,
              compressed_size, file_attributes,
              iso_timestamp().c_str(), host_os_label().c_str(), crc);
@@ -317,6 +293,7 @@ std::string RarVolumeInfo::to_xml() const
 // settings - these configuration vars are set when the scanner is created
 static bool record_components = true;
 static bool record_volumes = true;
+static uint64_t rar_max_memory = 1024*1024*1024; // PPM model heaps of all threads together
 
 // component processing (compressed file within an archive)
 static inline bool process_component(const sbuf_t &sbufq, size_t offset, RarComponentInfo &output)
@@ -346,6 +323,16 @@ static inline bool process_component(const sbuf_t &sbufq, size_t offset, RarComp
         return false;
     }
 
+    // header CRC is final validation; RAR stores only the 16 least
+    // significant bytes of a CRC32. It is checked before anything is
+    // taken from the header, as almost every 0x74 byte fails it.
+    // Data accounted for in the CRC begins with the header type magic byte
+    uint16_t header_crc = sbufq.get16u(offset + OFFSET_HEAD_CRC);
+    uint32_t calc_header_crc = header_crc32(sbufq.slice(offset + OFFSET_HEAD_TYPE, header_len - OFFSET_HEAD_TYPE));
+    if (header_crc != (calc_header_crc & 0xFFFF)) {
+        return false;
+    }
+
     // ignore huge filename lengths
     uint16_t filename_bytes_len = (uint16_t) sbufq.get16u(offset + OFFSET_NAME_SIZE);
     if (filename_bytes_len > SUSPICIOUS_HEADER_LEN) {
@@ -413,7 +400,7 @@ static inline bool process_component(const sbuf_t &sbufq, size_t offset, RarComp
             output.name = sbuf.substr(filename_start + null_byte_index + 1, filename_len);
         }
         // validate extracted UTF-8
-        if (utf8::find_invalid(output.name.begin(),output.name.end()) != output.name.end()) {
+        if (!utf8_text::valid(output.name)) {
             return false;
         }
     }
@@ -446,19 +433,6 @@ static inline bool process_component(const sbuf_t &sbufq, size_t offset, RarComp
     output.dos_time = sbuf.get32u(OFFSET_FTIME);
     output.crc = sbuf.get32u(OFFSET_FILE_CRC);
     output.file_attributes = sbuf.get32u(OFFSET_ATTR);
-
-
-    // header CRC is final validation; RAR stores only the 16 least
-    // significant bytes of a CRC32
-    uint16_t header_crc = sbuf.get16u(OFFSET_HEAD_CRC);
-    uint32_t calc_header_crc = crc_init();
-    // Data accounted for in the CRC begins with the header type magic byte
-    calc_header_crc = crc_update(calc_header_crc, sbuf.slice(OFFSET_HEAD_TYPE, header_len - OFFSET_HEAD_TYPE));
-    calc_header_crc = crc_finalize(calc_header_crc);
-    bool head_crc_match = (header_crc == (calc_header_crc & 0xFFFF));
-    if (!head_crc_match) {
-        return false;
-    }
     return true;
 }
 
@@ -493,10 +467,8 @@ static bool process_volume(const sbuf_t &sbuf, RarVolumeInfo &output)
     // header CRC is final validation; RAR stores only the 16 least
     // significant bytes of a CRC32
     uint16_t header_crc = sbuf.get16u(OFFSET_HEAD_CRC);
-    uint32_t calc_header_crc = crc_init();
     // Data accounted for in the CRC begins with the header type magic byte
-    calc_header_crc = crc_update(calc_header_crc, sbuf.slice(OFFSET_HEAD_TYPE, output.len - OFFSET_HEAD_TYPE));
-    calc_header_crc = crc_finalize(calc_header_crc);
+    uint32_t calc_header_crc = header_crc32(sbuf.slice(OFFSET_HEAD_TYPE, output.len - OFFSET_HEAD_TYPE));
     bool head_crc_match = (header_crc == (calc_header_crc & 0xFFFF));
     if (!head_crc_match) {
         return false;
@@ -505,7 +477,12 @@ static bool process_volume(const sbuf_t &sbuf, RarVolumeInfo &output)
     return true;
 }
 
-static void unpack_buf(const uint8_t* input, size_t input_len, uint8_t* output, size_t output_len)
+/* Each thread unpacks in one window, zeroed for each component as a new one would be, so that
+ * corrupt components, which can copy from parts of the window never written, unpack the same.
+ * The PPM model heaps are kept by SubAllocator.
+ * Returns false if unrar gave up, e.g. when the model would not fit in rar_max_memory.
+ */
+static bool unpack_buf(const uint8_t* input, size_t input_len, uint8_t* output, size_t output_len)
 {
     // stupid unrar wants mutable strings for arg inputs
     char arg_bufs[6][32];
@@ -530,7 +507,10 @@ static void unpack_buf(const uint8_t* input, size_t input_len, uint8_t* output,
     const wchar_t* c = L"aRarFile.rar"; //the 'L' prefix tells it to convert an ASCII Literal
     data.AddArcName("aRarFile.rar",c); //sets the name of the file
 
-    CmdExtract extract; //from the extract.cpp file; allows the extraction to occur
+    static thread_local std::unique_ptr<byte[]> window;
+    if (!window) window.reset(new byte[MAXWINSIZE]);
+    memset(window.get(), 0, MAXWINSIZE);
+    CmdExtract extract(window.get()); //from the extract.cpp file; allows the extraction to occur
 
     uint8_t *startingaddress = const_cast<uint8_t*>(input);
 
@@ -540,9 +520,16 @@ static void unpack_buf(const uint8_t* input, size_t input_len, uint8_t* output,
 
     extract.SetComprDataIO(mydataio); //Sets the ComprDataIO variable to the custom one that was just built
 
-    extract.DoExtract(&data, startingaddress, input_len, xmloutput);
+    bool ok = true;
+    try {
+        extract.DoExtract(&data, startingaddress, input_len, xmloutput);
+    }
+    catch (int) {                       // ErrorHandler::Throw()
+        ok = false;
+    }
 
     data.Close();
+    return ok;
 }
 
 static size_t guess_encrypted_len(const sbuf_t &sbuf)
@@ -577,10 +564,10 @@ static inline bool is_mark_block(const sbuf_t &sbuf, size_t pos)
             sbuf[ pos+5 ] == 0x07 &&
             sbuf[ pos+6 ] == 0x00 );
 }
-#endif
 
-feature_recorder *rar_recorder   = nullptr;
-feature_recorder *unrar_recorder = nullptr;
+static recorder_handle rar_recorder   {RAR_RECORDER_NAME};
+static recorder_handle unrar_recorder {UNRAR_RECORDER_NAME};
+#endif
 
 extern "C"
 void scan_rar(scanner_params &sp)
@@ -597,15 +584,17 @@ void scan_rar(scanner_params &sp)
         flags.xml = true;
         flags.carve = true;
 
-        auto rar_def = feature_recorder_def(RAR_RECORDER_NAME, flags);
+        auto rar_def = rar_recorder.def(flags);
         rar_def.default_carve_mode = feature_recorder_def::carve_mode_t::CARVE_ENCODED;
 	sp.info->feature_defs.push_back( rar_def );
 
-        auto unrar_def = feature_recorder_def(UNRAR_RECORDER_NAME, flags);
+        auto unrar_def = unrar_recorder.def(flags);
         unrar_def.default_carve_mode = feature_recorder_def::carve_mode_t::CARVE_ENCODED;
 	sp.info->feature_defs.push_back( unrar_def );
         sp.get_scanner_config("rar_find_components",&record_components,"Search for RAR components");
         sp.get_scanner_config("rar_find_volumes",&record_volumes,"Search for RAR volumes");
+        sp.get_scanner_config("rar_max_memory",&rar_max_memory,"Memory for the PPM models of all threads together; larger models are not unpacked");
+        SubAllocator::SetMemoryLimit(rar_max_memory);
 #else
         sp.info->description = "(disabled in configure)";
         sp.info->flags.default_enabled = false;
@@ -614,8 +603,8 @@ void scan_rar(scanner_params &sp)
     }
 #ifdef USE_RAR
     if (sp.phase==scanner_params::PHASE_INIT2){
-	rar_recorder   = &sp.named_feature_recorder(RAR_RECORDER_NAME);
-	unrar_recorder = &sp.named_feature_recorder(UNRAR_RECORDER_NAME);
+	rar_recorder.resolve(sp);
+	unrar_recorder.resolve(sp);
     }
 
     if (sp.phase==scanner_params::PHASE_SCAN){
@@ -649,7 +638,7 @@ void scan_rar(scanner_params &sp)
                     size_t enc_rar_pos = pos;
                     size_t enc_rar_len = MARK_LEN + volume.len + encrypted_len;
 
-                    rar_recorder->carve(sbuf_t(sbuf, enc_rar_pos, enc_rar_len), ".rar");
+                    carve_index::carve(*rar_recorder, sbuf_t(sbuf, enc_rar_pos, enc_rar_len), ".rar");
                 }
             }
             if (record_components &&
@@ -658,11 +647,14 @@ void scan_rar(scanner_params &sp)
 
                 // only decompress and recur if the component compression isn't
                 // no-op to avoid duplicate features
-                if (component.compression_method != METHOD_UNCOMPRESSED) {
+                if (component.compression_method != METHOD_UNCOMPRESSED && component.unpackable()) {
                     auto *dbuf = sbuf_t::sbuf_malloc((pos0 + pos) + "RAR", component.uncompressed_size, component.uncompressed_size);
                     auto *dbuf_buf = dbuf->malloc_buf();
                     memset(dbuf_buf, 0x00, component.uncompressed_size);
-                    unpack_buf(sbuf.get_buf()+pos, cc_len, reinterpret_cast<uint8_t *>(dbuf_buf), component.uncompressed_size);
+                    if (!unpack_buf(sbuf.get_buf()+pos, cc_len, reinterpret_cast<uint8_t *>(dbuf_buf), component.uncompressed_size)) {
+                        delete dbuf;
+                        continue;
+                    }
 
                     std::string carve_name("_");
                     carve_name += component.name;
@@ -670,8 +662,8 @@ void scan_rar(scanner_params &sp)
                     for(auto &it : carve_name){
                         if (it=='/') it = '_';
                     }
-                    unrar_recorder->carve(*dbuf, carve_name, component.iso_timestamp());
-                    sp.recurse(dbuf);
+                    carve_index::carve(*unrar_recorder, *dbuf, carve_name, component.iso_timestamp());
+                    content_cache::recurse(sp, dbuf);
                 }
             }
 	}
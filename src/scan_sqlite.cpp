@@ -2,8 +2,15 @@
  * Plugin: scan_sqlite
  * Purpose: Find sqlite databases and carve them.
  * File format described at http://www.sqlite.org/fileformat.html
+ *
+ * The header's database size is not trusted: page 1 and a sample of the other pages that are in
+ * the buffer must look like SQLite pages, and the database is cut short at the first sampled
+ * page that does not. With -S sqlite_carve_by_reference=1 the databases are not carved; each is
+ * recorded in sqlite_carved.txt as its forensic path, its length and its page size, and can be
+ * materialized later with bulk_extractor -p <path>:<length>/r <image>.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -15,6 +22,7 @@
 
 #include "config.h"
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 
 
 /**
@@ -29,10 +37,100 @@
  */
 
 
+#include "recorder_handle.h"
 #include "utf8.h"
 
 #define FEATURE_FILE_NAME "sqlite_carved"
 
+static bool     sqlite_carve_by_reference = false;
+static uint32_t sqlite_sample_pages = 16;       // pages checked after page 1
+
+namespace {
+    const size_t HEADER_SIZE = 100;     // the database header, before page 1's b-tree header
+
+    /* the database header, which is at the start of page 1 */
+    struct sqlite_header {
+        uint32_t pagesize {0};
+        uint32_t usable {0};            // pagesize less the reserved space at the end of each page
+        uint64_t pages {0};             // the database size in the header
+    };
+
+    bool read_header(const sbuf_t &sbuf, size_t begin, sqlite_header &h) {
+        h.pagesize = sbuf.get16uBE(begin+16);
+        if (h.pagesize==1) h.pagesize=65536;
+        if (h.pagesize<512 || h.pagesize>65536 || (h.pagesize & (h.pagesize-1))!=0) return false;
+        /* the file format versions, and the payload fractions, which must be 64, 32 and 32 */
+        const uint8_t write_version = sbuf.get8u(begin+18);
+        const uint8_t read_version  = sbuf.get8u(begin+19);
+        if (write_version<1 || write_version>2 || read_version<1 || read_version>2) return false;
+        if (sbuf.get8u(begin+21)!=64 || sbuf.get8u(begin+22)!=32 || sbuf.get8u(begin+23)!=32) return false;
+        h.usable = h.pagesize - sbuf.get8u(begin+20);
+        if (h.usable<480) return false;
+        h.pages = sbuf.get32uBE(begin+28);
+        return h.pages>0;
+    }
+
+    /* The b-tree page header at offset hdr of the page at offset page; the page is in the sbuf. */
+    bool valid_btree_page(const sbuf_t &sbuf, size_t page, size_t hdr, const sqlite_header &h) {
+        const uint8_t type = sbuf.get8u(page+hdr);
+        if (type!=2 && type!=5 && type!=10 && type!=13) return false;
+        const size_t hdr_size  = (type==2 || type==5) ? 12 : 8;
+        const size_t freeblock = sbuf.get16uBE(page+hdr+1);
+        const size_t ncells    = sbuf.get16uBE(page+hdr+3);
+        size_t content         = sbuf.get16uBE(page+hdr+5);
+        if (content==0) content=65536;
+        if (sbuf.get8u(page+hdr+7)>60) return false;            // fragmented free bytes
+        if (content>h.usable) return false;
+        const size_t cells_end = hdr + hdr_size + 2*ncells;     // the end of the cell pointer array
+        if (cells_end>content) return false;
+        if (freeblock!=0 && (freeblock<cells_end || freeblock+4>h.usable)) return false;
+        if (hdr_size==12) {
+            const uint32_t right = sbuf.get32uBE(page+hdr+8);
+            if (right<2 || right>h.pages) return false;
+        }
+        if (ncells>0) {
+            const size_t cell = sbuf.get16uBE(page+hdr+hdr_size);
+            if (cell<content || cell>=h.usable) return false;
+        }
+        return true;
+    }
+
+    /* A page after page 1: a b-tree page, or an overflow or freelist trunk page, which starts
+     * with the number of the next such page, or a pointer map page, which starts with a type.
+     */
+    bool plausible_page(const sbuf_t &sbuf, size_t page, const sqlite_header &h) {
+        if (valid_btree_page(sbuf, page, 0, h)) return true;
+        if (sbuf.get32uBE(page)<=h.pages) return true;
+        const uint8_t ptrmap_type = sbuf.get8u(page);
+        return ptrmap_type>=1 && ptrmap_type<=5;
+    }
+
+    /* The bytes of the database at begin that check out, or 0 if it is not a database.
+     * Only pages in the buffer are checked; the database is cut short at the end of the buffer.
+     */
+    size_t valid_extent(const sbuf_t &sbuf, size_t begin, const sqlite_header &h) {
+        const size_t avail = sbuf.bufsize - begin;
+        const uint64_t dbsize = h.pages * h.pagesize;
+        if (avail < HEADER_SIZE+14) return 0;       // the b-tree header and its first cell pointer
+        if (!valid_btree_page(sbuf, begin, HEADER_SIZE, h)) return 0;
+        const uint64_t npages = std::min<uint64_t>(h.pages, avail / h.pagesize);    // whole pages in the buffer
+        if (npages>=2 && sqlite_sample_pages>0) {
+            const uint64_t others  = npages - 1;
+            const uint64_t samples = std::min<uint64_t>(others, sqlite_sample_pages);
+            for (uint64_t j = 0; j < samples; j++) {
+                /* evenly spaced from page 2 to the last page in the buffer */
+                const uint64_t pageno = (samples==1) ? 2 : 2 + j * (others-1) / (samples-1);
+                if (!plausible_page(sbuf, begin + (pageno-1) * h.pagesize, h)) {
+                    return (pageno-1) * h.pagesize;
+                }
+            }
+        }
+        return std::min<uint64_t>(dbsize, avail);
+    }
+}
+
+static recorder_handle sqlite_file {FEATURE_FILE_NAME};
+
 extern "C"
 void scan_sqlite(scanner_params &sp)
 {
@@ -41,16 +139,23 @@ void scan_sqlite(scanner_params &sp)
         sp.info->set_name("sqlite" );
         sp.info->author          = "Simson Garfinkel";
         sp.info->description     = "Scans for SQLITE3 data";
-        sp.info->scanner_version = "1.1";
+        sp.info->scanner_version = "1.2";
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
 
-	sp.info->feature_defs.push_back( feature_recorder_def(FEATURE_FILE_NAME, carve_flag));
+	sp.info->feature_defs.push_back( sqlite_file.def(carve_flag));
+        sp.get_scanner_config("sqlite_carve_by_reference",&sqlite_carve_by_reference,
+                              "Record the path and length of each database instead of carving it");
+        sp.get_scanner_config("sqlite_sample_pages",&sqlite_sample_pages,
+                              "Pages of each database checked, besides page 1, before it is carved");
 	return;
     }
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        sqlite_file.resolve(sp);
+    }
     if(sp.phase==scanner_params::PHASE_SCAN){
 	const sbuf_t &sbuf = *(sp.sbuf);
-	feature_recorder &sqlite_recorder = sp.named_feature_recorder(FEATURE_FILE_NAME);
+	feature_recorder &sqlite_recorder = *sqlite_file;
 
 	// Search for BEGIN:SQLITE\r in the sbuf
 	// we could do this with a loop, or with
@@ -59,25 +164,20 @@ void scan_sqlite(scanner_params &sp)
 	    if (begin==-1) return;		// no more
 
 	    /* We found the header */
-            uint32_t pagesize = sbuf.get16uBE(begin+16);
-            if (pagesize==1) pagesize=65536;
-
-            /* Pagesize must be a power of two between 512 and 32768 */
-            if ((pagesize == 512) || (pagesize == 1024) || (pagesize == 2048) ||
-                (pagesize == 4096) || (pagesize == 8192) || (pagesize == 16384) ||
-                (pagesize == 32768) || (pagesize == 65536)) {
-
-                uint32_t dbsize_in_pages = sbuf.get32uBE(begin+28);
-                size_t   dbsize = pagesize * dbsize_in_pages;
-
-                if (dbsize>0 && dbsize_in_pages>=1){
-
-                    /* Write it out! */
-                    sqlite_recorder.carve(sbuf_t(sbuf,begin,begin+dbsize),".sqlite3");
-
-                    /* Worry about overflow */
-                    if (( i+begin+dbsize-1) <= i) return; // would send us backwards or avoid movement
-                    i = begin + dbsize;
+            sqlite_header h;
+            if (static_cast<size_t>(begin) + HEADER_SIZE <= sbuf.bufsize && read_header(sbuf, begin, h)) {
+                const size_t dbsize = valid_extent(sbuf, begin, h);
+                if (dbsize>0){
+
+                    /* Write it out, or where it is */
+                    if (sqlite_carve_by_reference) {
+                        sqlite_recorder.write(sbuf.pos0 + begin, std::to_string(dbsize),
+                                              "<sqlite3 pagesize='" + std::to_string(h.pagesize) +
+                                              "' pages='" + std::to_string(h.pages) + "'/>");
+                    } else {
+                        carve_index::carve(sqlite_recorder, sbuf_t(sbuf,begin,dbsize),".sqlite3");
+                    }
+                    i = begin + std::max<size_t>(dbsize, 512);
                     continue;
                 }
             }
@@ -9,6 +9,7 @@
 #include <fstream>
 #include <string>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 //#include <cerrno>
 #include <sstream>
@@ -16,65 +17,85 @@
 
 #include "config.h"
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 
+#include "recorder_handle.h"
 #include "utf8.h"
+#include "signature_prefilter.h"
 
 #define SECTOR_SIZE 512
 #define CLUSTER_SIZE 4096
 #define UTMP_RECORD 384
+#define UTMP_DISK_ALIGNMENT 128 // records are 384 bytes from the start of a block-aligned file
 #define FEATURE_FILE_NAME "utmp_carved"
 
+/* little-endian, as the records are written by x86 and arm hosts */
+static inline int32_t load32i(const uint8_t *p)
+{
+    return static_cast<int32_t>(uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24);
+}
+
+/* true if the len bytes at p are all 0, tested eight at a time */
+static inline bool all_zero(const uint8_t *p, size_t len)
+{
+    uint64_t acc = 0;
+    size_t i = 0;
+    for (; i+8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p+i, 8);
+        acc |= w;
+    }
+    for (; i < len; i++) acc |= p[i];
+    return acc==0;
+}
+
+/* true if a string field is NUL-terminated and padded with NULs to its end (or fills it) */
+static inline bool zero_padded(const uint8_t *p, size_t len)
+{
+    const uint8_t *nul = static_cast<const uint8_t *>(memchr(p, 0, len));
+    return nul==nullptr || all_zero(nul+1, p+len - (nul+1));
+}
+
+/*
+ * The fixed-width fields are tested first, since they reject most candidates;
+ * each string field is then tested once, in time linear in its width.
+ */
 bool check_utmprecord_signature(size_t offset, const sbuf_t &sbuf) {
-    int ut_type; // defined as short at man page but I have seen 4 byte type on real system
-    char line, user, host;
+    if (offset + UTMP_RECORD > sbuf.bufsize) return false;
+    const uint8_t *rec = sbuf.get_buf() + offset;
 
-    ut_type = sbuf.get32i(offset);
+    const int32_t ut_type = load32i(rec); // defined as short at man page but I have seen 4 byte type on real system
     if(ut_type < 1 || ut_type > 8) // not search for ut_type 0 'UT_UNKNOWN' and 9 "ACCOUNTING"
         return false;
 
-    line = sbuf[offset+8];
-    if (line != 0 && (line < 32 || line > 126))
+    if (load32i(rec+340) <= 0) //tv_sec
         return false;
-    for (int i=0; i<32; i++)
-        if (sbuf[offset+8+i] == 0) // 0x00 found then it should be continued 0x00 at the end of string
-            for (int j=0; j<32-i; j++)
-                if (sbuf[offset+8+i+j] != 0)
-                    return false;
 
-    user = sbuf[offset+44];
-    if (user != 0 && (user < 32 || user > 126))
+    const int32_t tv_usec = load32i(rec+344);
+    if (tv_usec < 0 || tv_usec >= 1000000)
         return false;
-    for (int i=0; i<32; i++)
-        if (sbuf[offset+44+i] == 0) // 0x00 found then it should be continued 0x00 at the end of string
-            for (int j=0; j<32-i; j++)
-                if (sbuf[offset+44+i+j] != 0)
-                    return false;
 
-    host = sbuf[offset+76];
-    if (host != 0 && (host < 35 || host > 126)
-        && host != 33 && host != 37 && host != 60 && host != 62 && host != 92
-        && host != 94 && host != 123 && host != 124 && host != 125) // use RFC3986 for soft restriction
+    if (!all_zero(rec+364, 20)) // unused
         return false;
-    for (int i=0; i<256; i++)
-        if (sbuf[offset+76+i] == 0) // 0x00 found then it should be continued 0x00 at the end of string
-            for (int j=0; j<256-i; j++)
-                if (sbuf[offset+76+i+j] != 0)
-                    return false;
 
-    if (sbuf.get32i(offset+340) <= 0) //tv_sec
+    const uint8_t line = rec[8];
+    if (line != 0 && (line < 32 || line > 126))
         return false;
-
-    if (sbuf.get32i(offset+344) < 0 || sbuf.get32i(offset+344) >= 1000000) //tv_usec
+    const uint8_t user = rec[44];
+    if (user != 0 && (user < 32 || user > 126))
+        return false;
+    const uint8_t host = rec[76];
+    if (host != 0 && (host < 35 || host > 126)
+        && host != 33 && host != 37 && host != 60 && host != 62 && host != 92
+        && host != 94 && host != 123 && host != 124 && host != 125) // use RFC3986 for soft restriction
         return false;
 
-    for (int i=0; i<20; i++) {
-        if (sbuf[offset+364+i] != 0) // unused
-            return false;
-    }
-
-    return true;
+    // 0x00 found then it should be continued 0x00 at the end of string
+    return zero_padded(rec+8, 32) && zero_padded(rec+44, 32) && zero_padded(rec+76, 256);
 }
 
+static recorder_handle utmp_file {FEATURE_FILE_NAME};
+
 extern "C"
 
 void scan_utmp(scanner_params &sp)
@@ -87,13 +108,16 @@ void scan_utmp(scanner_params &sp)
         sp.info->scanner_version = "1.1";
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-        sp.info->feature_defs.push_back(feature_recorder_def(FEATURE_FILE_NAME, carve_flag));
+        sp.info->feature_defs.push_back(utmp_file.def(carve_flag));
         return;
     }
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        utmp_file.resolve(sp);
+    }
     if(sp.phase==scanner_params::PHASE_SCAN){
         const sbuf_t &sbuf = *(sp.sbuf);
         //feature_recorder_set &fs = sp.fs;
-        feature_recorder &utmp_recorder = sp.named_feature_recorder(FEATURE_FILE_NAME);
+        feature_recorder &utmp_recorder = *utmp_file;
 
         size_t offset = 0;
         size_t stop = sbuf.pagesize;
@@ -101,13 +125,15 @@ void scan_utmp(scanner_params &sp)
         if(stop < UTMP_RECORD)
             return;
 
-        // search for utmp record in the sbuf
+        // search for utmp record in the sbuf, at every 8 bytes or, on a disk image, where a record can start
+        const signature_prefilter::stride_t stride = signature_prefilter::stride(sbuf, 8, UTMP_DISK_ALIGNMENT);
+        offset = stride.first;
         while (offset < stop-UTMP_RECORD) {
             if (check_utmprecord_signature(offset, sbuf)) {
-                utmp_recorder.carve(sbuf_t(sbuf,offset,UTMP_RECORD),"utmp");
+                carve_index::carve(utmp_recorder, sbuf_t(sbuf,offset,UTMP_RECORD),"utmp");
                 offset += UTMP_RECORD;
             } else {
-                offset += 8;
+                offset += stride.step;
             }
         }
     }
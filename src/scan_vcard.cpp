@@ -33,21 +33,32 @@
 
 #include "config.h"
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
+#include "recorder_handle.h"
 #include "scan_vcard.h"
+#include "signature_prefilter.h"
 
 #include "utf8.h"
+
+/* "BEGIN:VCARD\r" and "END:VCARD\r", in the signature_prefilter */
+static size_t begin_signature = 0;
+static size_t end_signature = 0;
+
 void carve_vcards(const sbuf_t &sbuf, feature_recorder &vcard_recorder)
 {
     size_t end_len = strlen("END:VCARD\r\n");
+    const signature_prefilter &prefilter = signature_prefilter::shared();
+    const std::vector<size_t> &begins = prefilter.candidates(sbuf, begin_signature);
+    const std::vector<size_t> &ends   = prefilter.candidates(sbuf, end_signature);
 
     // Search for BEGIN:VCARD\r in the sbuf
-    // we could do this with a loop, or with
+    // the prefilter found both tags in one pass
     for(size_t i = 0;  i < sbuf.bufsize;i++)	{
-        ssize_t begin = sbuf.find("BEGIN:VCARD\r",i);
+        ssize_t begin = signature_prefilter::next(begins, i);
         if(begin==-1) return;		// no more
 
         /* We found a BEGIN:VCARD\r. Is there an end? */
-        ssize_t end = sbuf.find("END:VCARD\r",begin);
+        ssize_t end = signature_prefilter::next(ends, begin);
 
         if(end!=-1){
             /* We found a beginning and an ending; verify if what's between them is
@@ -62,7 +73,7 @@ void carve_vcards(const sbuf_t &sbuf, feature_recorder &vcard_recorder)
             /* We should probably validate the UTF-8. */
             if(valid){
                 /* got a valid card; I can carve it! */
-                vcard_recorder.carve(sbuf.slice(begin,end-begin+end_len), ".vcf", 0);
+                carve_index::carve(vcard_recorder, sbuf.slice(begin,end-begin+end_len), ".vcf", 0);
                 i = end+end_len;		// skip to the end of the vcard
                 continue;			// loop again!
             }
@@ -74,6 +85,8 @@ void carve_vcards(const sbuf_t &sbuf, feature_recorder &vcard_recorder)
 }
 
 
+static recorder_handle vcard_file {"vcard"};
+
 extern "C"
 void scan_vcard(scanner_params &sp)
 {
@@ -85,12 +98,18 @@ void scan_vcard(scanner_params &sp)
         sp.info->scanner_version= "1.1";
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-        sp.info->feature_defs.push_back( feature_recorder_def("vcard", carve_flag));
+        sp.info->feature_defs.push_back( vcard_file.def(carve_flag));
 	return;
     }
+    if(sp.phase==scanner_params::PHASE_INIT2){
+        vcard_file.resolve(sp);
+        begin_signature = signature_prefilter::shared().add("BEGIN:VCARD\r", 0, 1, 1, true);
+        end_signature   = signature_prefilter::shared().add("END:VCARD\r", 0, 1, 1, true);
+        return;
+    }
     if(sp.phase==scanner_params::PHASE_SCAN){
 	const sbuf_t &sbuf       = *sp.sbuf;
-	feature_recorder &vcard_recorder = sp.named_feature_recorder("vcard");
+	feature_recorder &vcard_recorder = *vcard_file;
         carve_vcards(sbuf, vcard_recorder);
     }
 }
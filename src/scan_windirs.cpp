@@ -21,6 +21,12 @@
 
 #include <sys/time.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "recorder_handle.h"
+#include "scanner_tiles.h"
 #include "tsk3_fatdirs.h"
 #include "utf8.h"
 #include "dfxml_cpp/src/dfxml_writer.h"     // requires config.h
@@ -86,6 +92,42 @@ bool valid_fat_dentry_name(const uint8_t name[8],const uint8_t ext[3])
 }
 
 
+/* False if a 32-byte slot can only be INVALID or ALL_NULL to valid_fat_directory_entry():
+ * it has an attribute bit that FAT does not define, or it is a short entry in use whose 8.3
+ * name or extension has a character that FATFS_IS_83_NAME() or FATFS_IS_83_EXT() rejects
+ * ("." and ".." are left to the full test). The name, extension and attributes are the first
+ * 12 bytes, so SSE2 tests them with one load.
+ */
+bool fat_slot_may_be_valid(const uint8_t *slot)
+{
+    const uint8_t attrib = slot[11];
+    if ((attrib & ~FATFS_ATTR_ALL) != 0) return false;
+    if (attrib == FATFS_ATTR_LFN || slot[0] == 0 || slot[0] == '.') return true;
+#if defined(__SSE2__)
+    /* bytes are compared unsigned by flipping their sign bits */
+    const __m128i flip = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(slot)), flip);
+    auto below = [&](int c) { return _mm_cmplt_epi8(x, _mm_set1_epi8(static_cast<char>(c ^ 0x80))); };
+    auto above = [&](int c) { return _mm_cmpgt_epi8(x, _mm_set1_epi8(static_cast<char>(c ^ 0x80))); };
+    auto equal = [&](int c) { return _mm_cmpeq_epi8(x, _mm_set1_epi8(static_cast<char>(c ^ 0x80))); };
+    auto range = [&](int lo, int hi) { return _mm_andnot_si128(_mm_or_si128(below(lo), above(hi)), _mm_set1_epi8(-1)); };
+    __m128i bad = _mm_or_si128(below(0x20), equal(0x22));
+    bad = _mm_or_si128(bad, _mm_or_si128(range(0x2a, 0x2c), range(0x2e, 0x2f)));
+    bad = _mm_or_si128(bad, _mm_or_si128(range(0x3a, 0x3f), range(0x5b, 0x5d)));
+    bad = _mm_or_si128(bad, equal(0x7c));
+    const int mask = (_mm_movemask_epi8(bad) & 0x7ff) | (_mm_movemask_epi8(above(0x7e)) & 0x700);
+    return mask == 0;
+#else
+    for (int i = 0; i < 8; i++) {
+        if (!FATFS_IS_83_NAME(slot[i])) return false;
+    }
+    for (int i = 8; i < 11; i++) {
+        if (!FATFS_IS_83_EXT(slot[i])) return false;
+    }
+    return true;
+#endif
+}
+
 enum fat_validation_t {
     INVALID=0,
     VALID_DENTRY=1,
@@ -193,18 +235,20 @@ fat_validation_t valid_fat_directory_entry(const sbuf_t &sbuf)
 }
 
 
-void scan_fatdirs(const sbuf_t &sbuf, feature_recorder &wrecorder)
+void scan_fatdirs(const sbuf_t &sbuf, feature_recorder &wrecorder, size_t begin, size_t end)
 {
     /*
      * Directory structures are 32 bytes long and will always be sector-aligned.
      * So try every 512 byte sector, within that try every 32 byte record.
      */
 
-    for(size_t base = 0;base<sbuf.pagesize;base+=512){
-	sbuf_t sector(sbuf,base,512);
-	if (sector.bufsize < 512){
+    for(size_t base = begin;base<sbuf.pagesize && base<end;base+=512){
+	if (base + 512 > sbuf.bufsize){
 	    return;			// no space left
 	}
+	/* nothing is reported for a sector whose first entry is invalid */
+	if (!fat_slot_may_be_valid(sbuf.get_buf() + base)) continue;
+	sbuf_t sector(sbuf,base,512);
 
 	int last_valid_entry_number = -1;
 	int ret1_count = 0;
@@ -254,7 +298,7 @@ void scan_fatdirs(const sbuf_t &sbuf, feature_recorder &wrecorder)
 		sbuf_t n(sector,entry_number*32,32);
 		dfxml_writer::strstrmap_t fatmap;
 
-		if (valid_fat_directory_entry(n)==1){
+		if (slots[entry_number]==VALID_DENTRY){
 		    const fatfs_dentry &dentry = *n.get_struct_ptr<fatfs_dentry>(0);
 		    std::stringstream ss;
 		    for(int j=0;j<8;j++){ if (dentry.name[j]!=' ') ss << dentry.name[j]; }
@@ -279,10 +323,10 @@ void scan_fatdirs(const sbuf_t &sbuf, feature_recorder &wrecorder)
 /**
  * Examine an sbuf and see if it contains an NTFS MFT entry. If it does, then process the entry
  */
-void scan_ntfsdirs(const sbuf_t &sbuf,feature_recorder &wrecorder)
+void scan_ntfsdirs(const sbuf_t &sbuf,feature_recorder &wrecorder, size_t begin, size_t end)
 {
     /* Read the sbuf in 1K chunks, 512 bytes at a time */
-    for(size_t base = 0; base<sbuf.pagesize; base+=512){
+    for(size_t base = begin; base<sbuf.pagesize && base<end; base+=512){
 	sbuf_t n(sbuf, base, 1024);
 	std::string filename;
 	if (n.bufsize!=1024){
@@ -478,6 +522,16 @@ void scan_ntfsdirs(const sbuf_t &sbuf,feature_recorder &wrecorder)
     }
 }
 
+static recorder_handle windirs_file {"windirs"};
+
+/* The directory entries in the sectors that start in [begin, end) */
+static void scan_windirs_range(const scanner_params &sp, size_t begin, size_t end)
+{
+    feature_recorder &wrecorder = *windirs_file;
+    scan_fatdirs(*sp.sbuf, wrecorder, begin, end);
+    scan_ntfsdirs(*sp.sbuf, wrecorder, begin, end);
+}
+
 extern "C"
 void scan_windirs(scanner_params &sp)
 {
@@ -503,7 +557,7 @@ void scan_windirs(scanner_params &sp)
 
 	//info->flags.depth_0 =  true; // only run at top level by default
         sp.info->scanner_version= "1.0";
-	sp.info->feature_defs.push_back( feature_recorder_def("windirs"));
+	sp.info->feature_defs.push_back( windirs_file.def());
 
         sp.get_scanner_config("opt_weird_file_size",&opt_weird_file_size,"Threshold for FAT32 scanner");
         sp.get_scanner_config("opt_weird_file_size2",&opt_weird_file_size2,"Threshold for FAT32 scanner");
@@ -518,9 +572,11 @@ void scan_windirs(scanner_params &sp)
 	return;
     }
     if (sp.phase==scanner_params::PHASE_SHUTDOWN) return;		// no shutdown
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        windirs_file.resolve(sp);
+        scanner_tiles::enable("windirs", scan_windirs_range);
+    }
     if (sp.phase==scanner_params::PHASE_SCAN){
-	feature_recorder &wrecorder = sp.named_feature_recorder("windirs");
-	scan_fatdirs(*sp.sbuf, wrecorder);
-	scan_ntfsdirs(*sp.sbuf, wrecorder);
+	scan_windirs_range(sp, 0, sp.sbuf->bufsize);
     }
 }
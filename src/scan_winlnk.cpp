@@ -27,18 +27,133 @@
 #include <string.h>
 #include <stdint.h>
 #include <sstream>
+#include <string_view>
 #include <vector>
+#include <algorithm>
 
-#include "utf8.h"
+#include "recorder_handle.h"
+#include "utf8_text.h"
 #include "be13_api/utils.h"              // needs config.h
 #include "be13_api/scanner_params.h"
-#include "be13_api/unicode_escape.h"
-#include "dfxml_cpp/src/dfxml_writer.h"
+#include "signature_prefilter.h"
 
 static const size_t SMALLEST_LNK_FILE = 150;  // did you see smaller LNK file?
+static size_t lnk_signature = 0;                // the header size and LinkCLSID, in the signature_prefilter
+static const size_t LNK_DISK_ALIGNMENT = 8;     // small LNK files are resident in their MFT record, 8-byte aligned
+
+/*
+ * The fields of a LNK feature, in the order in which they are written (that of their names, as
+ * dfxml_writer::xmlmap() wrote them). Their values are kept end to end in one buffer that the
+ * thread reuses: the 8-bit strings are copied from the sbuf and the UTF-16 ones are converted into
+ * it, with no string of their own, and the XML is written from it in one pass.
+ */
+enum lnk_field_t {
+    LNK_ATIME, LNK_BIRTH_FILEID, LNK_BIRTH_VOLUMEID, LNK_COMMAND_LINE_ARGUMENTS, LNK_COMMON_PATH_SUFFIX,
+    LNK_COMMON_PATH_SUFFIX_UNICODE, LNK_CTIME, LNK_DEVICE_NAME, LNK_DEVICE_NAME_UNICODE, LNK_DROID_FILEID,
+    LNK_DROID_VOLUMEID, LNK_ERROR, LNK_ICON_LOCATION, LNK_LOCAL_BASE_PATH, LNK_LOCAL_BASE_PATH_UNICODE, LNK_NAME_STRING,
+    LNK_NET_NAME, LNK_NET_NAME_UNICODE, LNK_RELATIVE_PATH, LNK_VOLUME_LABEL, LNK_WORKING_DIR, LNK_WTIME, LNK_FIELDS
+};
+static const char *const lnk_field_names[LNK_FIELDS] = {
+    "atime", "birth_fileid", "birth_volumeid", "command_line_arguments", "common_path_suffix",
+    "common_path_suffix_unicode", "ctime", "device_name", "device_name_unicode", "droid_fileid",
+    "droid_volumeid", "error", "icon_location", "local_base_path", "local_base_path_unicode", "name_string",
+    "net_name", "net_name_unicode", "relative_path", "volume_label", "working_dir", "wtime"
+};
+
+struct lnk_fields_t {
+    struct field_t {
+        size_t start {0};
+        size_t len {0};
+        bool   set {false};
+    };
+    std::string text {};
+    field_t fields[LNK_FIELDS] {};
+
+    void clear() {
+        text.clear();
+        for (auto &f : fields) f = field_t();
+    }
+    void set(lnk_field_t f, std::string_view value) {
+        fields[f] = {text.size(), value.size(), true};
+        text.append(value);
+    }
+    /* Appends count UTF-16LE code units at offset (clipped to the sbuf), as safe_utf16to8() would
+     * convert them: a bad surrogate makes the value empty. Returns the length of the value.
+     */
+    size_t set_utf16(lnk_field_t f, const sbuf_t &sbuf, size_t offset, size_t count) {
+        const size_t start = text.size();
+        const uint8_t *buf = sbuf.get_buf();
+        const size_t units = offset < sbuf.bufsize ? std::min(count, (sbuf.bufsize - offset) / 2) : 0;
+        for (size_t i = 0; i < units; i++) {
+            uint32_t c = buf[offset + i*2] | (buf[offset + i*2 + 1] << 8);
+            if (c >= 0xd800 && c < 0xdc00) {            // a high surrogate must be followed by a low one
+                const uint32_t lo = (i+1 < units) ? buf[offset + i*2 + 2] | (buf[offset + i*2 + 3] << 8) : 0;
+                if (lo < 0xdc00 || lo >= 0xe000) {
+                    text.resize(start);
+                    break;
+                }
+                c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+                i++;
+            } else if (c >= 0xdc00 && c < 0xe000) {
+                text.resize(start);
+                break;
+            }
+            if (c < 0x80) {
+                text.push_back(static_cast<char>(c));
+            } else if (c < 0x800) {
+                text.push_back(static_cast<char>(0xc0 | (c >> 6)));
+                text.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+            } else if (c < 0x10000) {
+                text.push_back(static_cast<char>(0xe0 | (c >> 12)));
+                text.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+                text.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+            } else {
+                text.push_back(static_cast<char>(0xf0 | (c >> 18)));
+                text.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+                text.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+                text.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+            }
+        }
+        fields[f] = {start, text.size() - start, true};
+        return fields[f].len;
+    }
+    std::string_view get(lnk_field_t f) const {
+        return fields[f].set ? std::string_view(text).substr(fields[f].start, fields[f].len) : std::string_view();
+    }
+    /* <lnk><name>value</name>...</lnk>, the values escaped */
+    void to_xml(std::string &xml) const {
+        std::string escape_buf;
+        xml.assign("<lnk>");
+        for (size_t i = 0; i < LNK_FIELDS; i++) {
+            if (!fields[i].set) continue;
+            const lnk_field_t f = static_cast<lnk_field_t>(i);
+            xml.append("<").append(lnk_field_names[i]).append(">").append(utf8_text::xml_escaped(get(f), escape_buf))
+               .append("</").append(lnk_field_names[i]).append(">");
+        }
+        xml.append("</lnk>");
+    }
+};
+
+/* The 8-bit string at offset, to its NUL or the end of the sbuf */
+static std::string_view sbuf_cstring(const sbuf_t &sbuf, size_t offset)
+{
+    if (offset >= sbuf.bufsize) return std::string_view();
+    const char *start = reinterpret_cast<const char *>(sbuf.get_buf()) + offset;
+    const void *nul = memchr(start, 0, sbuf.bufsize - offset);
+    return std::string_view(start, nul ? static_cast<const char *>(nul) - start : sbuf.bufsize - offset);
+}
+
+/* The number of UTF-16 code units at offset, to a NUL one or the end of the sbuf */
+static size_t sbuf_utf16_units(const sbuf_t &sbuf, size_t offset)
+{
+    const uint8_t *buf = sbuf.get_buf();
+    size_t units = 0;
+    while (offset + units*2 + 1 < sbuf.bufsize && (buf[offset + units*2] | buf[offset + units*2 + 1])) units++;
+    return units;
+}
 
 /* Extract and form GUID. Needs 16 bytes */
-std::string get_guid(const sbuf_t &buf, const size_t offset)
+void set_guid(lnk_field_t f, const sbuf_t &buf, const size_t offset, lnk_fields_t& lnk)
 {
     char str[37];
     snprintf(str, 37, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x", \
@@ -46,14 +161,14 @@ std::string get_guid(const sbuf_t &buf, const size_t offset)
         buf[offset+5], buf[offset+4], buf[offset+7], buf[offset+6],    \
         buf[offset+8], buf[offset+9], buf[offset+10], buf[offset+11],    \
         buf[offset+12], buf[offset+13], buf[offset+14], buf[offset+15]);
-    return(std::string(str));
+    lnk.set(f, str);
 }
 
 /*
  * This is called a lot, so we take a const ref to the sbuf and an offset.
  */
-size_t read_StringData(const std::string& tagname, const sbuf_t &sbuf, size_t offset,
-                       const bool is_unicode, dfxml_writer::strstrmap_t& lnkmap)
+size_t read_StringData(lnk_field_t f, const sbuf_t &sbuf, size_t offset,
+                       const bool is_unicode, lnk_fields_t& lnk)
 {
     // get count to read
     const uint16_t count = sbuf.get16u(offset+0);
@@ -66,54 +181,49 @@ size_t read_StringData(const std::string& tagname, const sbuf_t &sbuf, size_t of
 
     if (is_unicode) {
         // get string data from UTF16 input
-        std::wstring utf16_data = sbuf.getUTF16(offset+2, count);
-        std::string data = safe_utf16to8(utf16_data);
-        if (data.size()==0) data="INVALID_DATA";
-        lnkmap[tagname] = data;
+        if (lnk.set_utf16(f, sbuf, offset+2, count) == 0) lnk.set(f, "INVALID_DATA");
     } else {
         // get string data from UTF8 input
-        std::string utf8_string = sbuf.getUTF8(offset+2, count);
-        validateOrEscapeUTF8(utf8_string,true,false,false);
-        if (utf8_string.size()==0) utf8_string="INVALID_DATA";
-        lnkmap[tagname] = utf8_string;
+        const size_t start = offset+2 < sbuf.bufsize ? offset+2 : sbuf.bufsize;
+        const std::string_view utf8_string(reinterpret_cast<const char *>(sbuf.get_buf()) + start,
+                                           std::min<size_t>(count, sbuf.bufsize - start));
+        lnk.set(f, utf8_string.size() ? utf8_string : "INVALID_DATA");
     }
     return size;
 }
 
-void read_utf8(const std::string& tagname, const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_t& lnkmap) {
-    std::string utf8_string = sbuf.getUTF8(offset);
-    validateOrEscapeUTF8(utf8_string,true,false,false);
+void read_utf8(lnk_field_t f, const sbuf_t &sbuf, size_t offset, lnk_fields_t& lnk) {
+    const std::string_view utf8_string = sbuf_cstring(sbuf, offset);
     // there can be fields with size 0 so skip them
     if (utf8_string.size()>0) {
-        lnkmap[tagname] = utf8_string;
+        lnk.set(f, utf8_string);
     }
 }
 
-void read_utf16(const std::string& tagname, const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_t& lnkmap) {
-    std::wstring utf16_string = sbuf.getUTF16(offset);
-    std::string utf8_string = safe_utf16to8(utf16_string);
-    if (utf8_string.size()>0) {
-        lnkmap[tagname] = utf8_string;
+void read_utf16(lnk_field_t f, const sbuf_t &sbuf, size_t offset, lnk_fields_t& lnk) {
+    const lnk_fields_t::field_t before = lnk.fields[f];
+    if (lnk.set_utf16(f, sbuf, offset, sbuf_utf16_units(sbuf, offset)) == 0) {
+        lnk.fields[f] = before;
     }
 }
 
-size_t read_LinkTargetIDList(const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_t& lnkmap) {
+size_t read_LinkTargetIDList(const sbuf_t &sbuf, size_t offset, lnk_fields_t& lnk) {
     // there are no fields to record in this structure so just advance by size
     const uint16_t size = sbuf.get16u(offset+0);
     return (size_t)size;
 }
 
-void read_VolumeID(const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_t& lnkmap) {
+void read_VolumeID(const sbuf_t &sbuf, size_t offset, lnk_fields_t& lnk) {
     const uint32_t VolumeLabelOffset = sbuf.get32u(offset+12);
     if (VolumeLabelOffset == 0x14) {
         const uint32_t VolumeLabelOffsetUnicode = sbuf.get32u(offset+16);
-        read_utf16("volume_label", sbuf, offset+VolumeLabelOffsetUnicode, lnkmap);
+        read_utf16(LNK_VOLUME_LABEL, sbuf, offset+VolumeLabelOffsetUnicode, lnk);
     } else {
-        read_utf8("volume_label", sbuf, offset+VolumeLabelOffset, lnkmap);
+        read_utf8(LNK_VOLUME_LABEL, sbuf, offset+VolumeLabelOffset, lnk);
     }
 }
 
-void read_CommonNetworkRelativeLink(const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_t& lnkmap) {
+void read_CommonNetworkRelativeLink(const sbuf_t &sbuf, size_t offset, lnk_fields_t& lnk) {
 
     // data state
     //const uint32_t CommonNetworkRelativeLinkSize = sbuf.get32u(0);
@@ -121,12 +231,12 @@ void read_CommonNetworkRelativeLink(const sbuf_t &sbuf, size_t offset, dfxml_wri
 
     // NetName
     const uint32_t NetNameOffset = sbuf.get32u(offset+8);
-    read_utf8("net_name", sbuf, offset+NetNameOffset, lnkmap);
+    read_utf8(LNK_NET_NAME, sbuf, offset+NetNameOffset, lnk);
 
     // device name
     if (CommonNetworkRelativeLinkFlags & (1 << 0)) {    // A ValidDevice
         const uint32_t DeviceNameOffset = sbuf.get32u(offset+12);
-        read_utf8("device_name", sbuf, offset+DeviceNameOffset, lnkmap);
+        read_utf8(LNK_DEVICE_NAME, sbuf, offset+DeviceNameOffset, lnk);
     }
 
     // network provider type
@@ -135,17 +245,17 @@ void read_CommonNetworkRelativeLink(const sbuf_t &sbuf, size_t offset, dfxml_wri
     // NetNameOffsetUnicode
     if (NetNameOffset > 0x14) {
         const uint32_t NetNameOffsetUnicode = sbuf.get32u(offset+20);
-        read_utf16("net_name_unicode", sbuf, offset+NetNameOffsetUnicode, lnkmap);
+        read_utf16(LNK_NET_NAME_UNICODE, sbuf, offset+NetNameOffsetUnicode, lnk);
     }
 
     // DeviceNameOffsetUnicode
     if (NetNameOffset > 0x14) {
         const uint32_t DeviceNameOffsetUnicode = sbuf.get32u(offset+24);
-        read_utf16("device_name_unicode", sbuf, offset+DeviceNameOffsetUnicode, lnkmap);
+        read_utf16(LNK_DEVICE_NAME_UNICODE, sbuf, offset+DeviceNameOffsetUnicode, lnk);
     }
 }
 
-size_t read_LinkInfo(const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_t& lnkmap) {
+size_t read_LinkInfo(const sbuf_t &sbuf, size_t offset, lnk_fields_t& lnk) {
 
     // data state
     const uint32_t LinkInfoSize = sbuf.get32u(offset+0);
@@ -156,37 +266,37 @@ size_t read_LinkInfo(const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_
 
     // volume ID
     if (LinkInfoFlags & (1 << 0)) {    // A VolumeIDAndLocalBasePath
-        read_VolumeID(sbuf, offset+VolumeIDOffset, lnkmap);
+        read_VolumeID(sbuf, offset+VolumeIDOffset, lnk);
     }
 
     // local base path
     if (LinkInfoFlags & (1 << 0)) {    // A VolumeIDAndLocalBasePath
         const uint32_t LocalBasePathOffset = sbuf.get32u(offset+16);
-        read_utf8("local_base_path", sbuf, offset+LocalBasePathOffset, lnkmap);
+        read_utf8(LNK_LOCAL_BASE_PATH, sbuf, offset+LocalBasePathOffset, lnk);
     }
 
     // common network relative link
     if (LinkInfoFlags & (1 << 1)) {    // B CommonNetworkRelativeLinkAndPathSuffix
         const uint32_t CommonNetworkRelativeLinkOffset = sbuf.get32u(offset+20);
-        read_CommonNetworkRelativeLink(sbuf, offset+CommonNetworkRelativeLinkOffset, lnkmap);
+        read_CommonNetworkRelativeLink(sbuf, offset+CommonNetworkRelativeLinkOffset, lnk);
     }
 
     // common path suffix
     const uint32_t CommonPathSuffixOffset = sbuf.get32u(offset+24);
-    read_utf8("common_path_suffix", sbuf, offset+CommonPathSuffixOffset, lnkmap);
+    read_utf8(LNK_COMMON_PATH_SUFFIX, sbuf, offset+CommonPathSuffixOffset, lnk);
 
     // local base path unicode
     if (LinkInfoFlags & (1 << 0)) {    // A VolumeIDAndLocalBasePath
         if (LinkInfoHeaderSize >=0x24) {
             const uint32_t LocalBasePathOffsetUnicode = sbuf.get32u(offset+28);
-            read_utf16("local_base_path_unicode", sbuf, offset+LocalBasePathOffsetUnicode, lnkmap);
+            read_utf16(LNK_LOCAL_BASE_PATH_UNICODE, sbuf, offset+LocalBasePathOffsetUnicode, lnk);
         }
     }
 
     // common path suffix unicode
     if (LinkInfoHeaderSize >=0x24) {
         const uint32_t CommonPathSuffixOffsetUnicode = sbuf.get32u(offset+32);
-        read_utf16("common_path_suffix_unicode", sbuf, offset+CommonPathSuffixOffsetUnicode, lnkmap);
+        read_utf16(LNK_COMMON_PATH_SUFFIX_UNICODE, sbuf, offset+CommonPathSuffixOffsetUnicode, lnk);
     }
 
     return LinkInfoSize;
@@ -194,16 +304,16 @@ size_t read_LinkInfo(const sbuf_t &sbuf, size_t offset, dfxml_writer::strstrmap_
 
 // top level data structrue, true if has data
 // This one doesn't take an offset; we make a child sbuf because we use it a lot
-bool read_ShellLinkHeader(const sbuf_t &sbuf, size_t pos, dfxml_writer::strstrmap_t& lnkmap)
+bool read_ShellLinkHeader(const sbuf_t &sbuf, size_t pos, lnk_fields_t& lnk)
 {
     sbuf_t sb2 = sbuf.slice(pos);
     // record fields in this header
     const uint64_t CreationTime   = sb2.get64u(0x001c);
     const uint64_t AccessTime     = sb2.get64u(0x0024);
     const uint64_t WriteTime      = sb2.get64u(0x002c);
-    lnkmap["ctime"] = microsoftDateToISODate(CreationTime);
-    lnkmap["atime"] = microsoftDateToISODate(AccessTime);
-    lnkmap["wtime"] = microsoftDateToISODate(WriteTime);
+    lnk.set(LNK_CTIME, microsoftDateToISODate(CreationTime));
+    lnk.set(LNK_ATIME, microsoftDateToISODate(AccessTime));
+    lnk.set(LNK_WTIME, microsoftDateToISODate(WriteTime));
 
     // flags dictating how the structure will be parsed
     const uint32_t LinkFlags      = sb2.get32u(0x0014);
@@ -212,13 +322,13 @@ bool read_ShellLinkHeader(const sbuf_t &sbuf, size_t pos, dfxml_writer::strstrma
     // read the optional fields
     size_t offset = 0x004c;
     if (LinkFlags & (1 << 0)) {    // LinkFlags A HasLinkTargetIDList
-        offset += read_LinkTargetIDList(sb2, offset, lnkmap) + 2;
+        offset += read_LinkTargetIDList(sb2, offset, lnk) + 2;
     }
 
     // If I return here, it doesn't crash
 
     if (LinkFlags & (1 << 1)) {    // LinkFlags B HasLinkInfo
-        offset += read_LinkInfo(sb2, offset, lnkmap); // causing crash
+        offset += read_LinkInfo(sb2, offset, lnk); // causing crash
     }
 
     // what if we return here?
@@ -226,19 +336,19 @@ bool read_ShellLinkHeader(const sbuf_t &sbuf, size_t pos, dfxml_writer::strstrma
 
 
     if (LinkFlags & (1 << 2)) {    // LinkFlags C HasName
-        offset += read_StringData("name_string", sb2, offset, is_unicode, lnkmap);
+        offset += read_StringData(LNK_NAME_STRING, sb2, offset, is_unicode, lnk);
     }
     if (LinkFlags & (1 << 3)) {    // LinkFlags D HasRelativePath
-        offset += read_StringData("relative_path", sb2, offset, is_unicode, lnkmap);
+        offset += read_StringData(LNK_RELATIVE_PATH, sb2, offset, is_unicode, lnk);
     }
     if (LinkFlags & (1 << 4)) {    // LinkFlags E HasWorkingDir
-        offset += read_StringData("working_dir", sb2, offset, is_unicode, lnkmap);
+        offset += read_StringData(LNK_WORKING_DIR, sb2, offset, is_unicode, lnk);
     }
     if (LinkFlags & (1 << 5)) {    // LinkFlags F HasArguments
-        offset += read_StringData("command_line_arguments", sb2, offset, is_unicode, lnkmap);
+        offset += read_StringData(LNK_COMMAND_LINE_ARGUMENTS, sb2, offset, is_unicode, lnk);
     }
     if (LinkFlags & (1 << 6)) {    // LinkFlags G HasIconLocation
-        offset += read_StringData("icon_location", sb2, offset, is_unicode, lnkmap);
+        offset += read_StringData(LNK_ICON_LOCATION, sb2, offset, is_unicode, lnk);
     }
 
     int lkcount = 0;
@@ -256,11 +366,10 @@ bool read_ShellLinkHeader(const sbuf_t &sbuf, size_t pos, dfxml_writer::strstrma
         if (BlockSize == 0x60 && BlockSignature == 0xa0000003) {
 
             // Tracker Data Block
-            std::string dvolid = get_guid(sb2, offset+32);
-            lnkmap["droid_volumeid"] = dvolid;
-            lnkmap["droid_fileid"] = get_guid(sb2, offset+48);
-            lnkmap["birth_volumeid"] = get_guid(sb2, offset+64);
-            lnkmap["birth_fileid"] = get_guid(sb2, offset+80);
+            set_guid(LNK_DROID_VOLUMEID, sb2, offset+32, lnk);
+            set_guid(LNK_DROID_FILEID, sb2, offset+48, lnk);
+            set_guid(LNK_BIRTH_VOLUMEID, sb2, offset+64, lnk);
+            set_guid(LNK_BIRTH_FILEID, sb2, offset+80, lnk);
         }
 
         offset += BlockSize;
@@ -276,12 +385,12 @@ bool read_ShellLinkHeader(const sbuf_t &sbuf, size_t pos, dfxml_writer::strstrma
     }
 }
 
-// return existing field else ""
-// make this more efficient? It's pretty lame.
-// On the other hand, it works and it should only be envoked for links when we find them.
-std::string get_field(const dfxml_writer::strstrmap_t& lnkmap, const std::string& name) {
-    return lnkmap.find(name) == lnkmap.end() ? "" : lnkmap.find(name)->second;
-}
+// the fields that name the link's target, in the order in which one is picked for the feature
+static const lnk_field_t path_fields[] = {
+    LNK_LOCAL_BASE_PATH, LNK_LOCAL_BASE_PATH_UNICODE, LNK_COMMON_PATH_SUFFIX, LNK_COMMON_PATH_SUFFIX_UNICODE, LNK_NAME_STRING,
+    LNK_RELATIVE_PATH, LNK_NET_NAME, LNK_NET_NAME_UNICODE, LNK_DEVICE_NAME, LNK_DEVICE_NAME_UNICODE, LNK_WORKING_DIR,
+    LNK_COMMAND_LINE_ARGUMENTS, LNK_VOLUME_LABEL, LNK_DROID_VOLUMEID
+};
 
 /**
  * Scanner scan_winlnk scans and extracts windows lnk records.
@@ -294,7 +403,7 @@ std::string get_field(const dfxml_writer::strstrmap_t& lnkmap, const std::string
  *
  * scan_winlnk iterates through each byte of sbuf
  */
-static feature_recorder *winlnk_recorder = nullptr;
+static recorder_handle winlnk_recorder {"winlnk"};
 
 extern "C"
 void scan_winlnk(scanner_params &sp)
@@ -304,13 +413,15 @@ void scan_winlnk(scanner_params &sp)
         sp.info->set_name("winlnk");
         sp.info->author		= "Simson Garfinkel";
         sp.info->description	= "Search for Windows LNK files";
-        sp.info->feature_defs.push_back( feature_recorder_def("winlnk"));
+        sp.info->feature_defs.push_back( winlnk_recorder.def());
         sp.info->scanner_flags.scanner_wants_filesystems = true;
         sp.info->min_sbuf_size = SMALLEST_LNK_FILE;
         return;
     }
     if (sp.phase==scanner_params::PHASE_INIT2){
-        winlnk_recorder = &sp.named_feature_recorder("winlnk");
+        winlnk_recorder.resolve(sp);
+        lnk_signature = signature_prefilter::shared().add(
+            std::string("\x4c\x00\x00\x00\x01\x14\x02\x00\x00\x00\x00\x00\xc0\x00\x00\x00\x00\x00\x00\x46", 20), 0, 1, LNK_DISK_ALIGNMENT);
     }
 
     if (sp.phase==scanner_params::PHASE_SCAN){
@@ -318,53 +429,43 @@ void scan_winlnk(scanner_params &sp)
 	// phase 1: set up the feature recorder and search for winlnk features
 	const sbuf_t &sbuf = *(sp.sbuf);
 
-        for (size_t pos=0;(pos < sbuf.pagesize) &&  (pos + SMALLEST_LNK_FILE < sbuf.bufsize ); pos++){
+        for (size_t pos : signature_prefilter::shared().candidates(sbuf, lnk_signature)) {
+            if (pos + SMALLEST_LNK_FILE >= sbuf.bufsize) break;
 
-            // look for Shell Link (.LNK) binary file format magic number
-            // Move this to a b-m search.
+            // look for Shell Link (.LNK) binary file format magic number; the prefilter found the candidates
             if ( sbuf.get32u(pos+0x00) == 0x0000004c &&      // header size
                  sbuf.get32u(pos+0x04) == 0x00021401 &&      // LinkCLSID 1
                  sbuf.get32u(pos+0x08) == 0x00000000 &&      // LinkCLSID 2
                  sbuf.get32u(pos+0x0c) == 0x000000c0 &&      // LinkCLSID 3
                  sbuf.get32u(pos+0x10) == 0x46000000 ){      // LinkCLSID 4
 
-                // container for reported fields
-		dfxml_writer::strstrmap_t lnkmap;
+                // the fields reported, in the buffers the thread reuses
+                thread_local lnk_fields_t lnk;
+                thread_local std::string xml;
+                lnk.clear();
 
                 // read
                 bool has_data = true;
                 try {
-                    has_data = read_ShellLinkHeader(sbuf, pos, lnkmap);
+                    has_data = read_ShellLinkHeader(sbuf, pos, lnk);
                 } catch (sbuf_t::range_exception_t &e) {
                     // add error field to indicate that the read was not complete
-                    lnkmap["error"] = "LINKINFO_DATA_ERROR";
+                    lnk.set(LNK_ERROR, "LINKINFO_DATA_ERROR");
                 }
 
-                // set path when no data
-                std::string path = "";
+                // set path when no data; else pick a path value from one of the fields
+                std::string_view path;
                 if (!has_data) {
                     path = "NO_LINKINFO";
                 }
-
-                // pick a path value from one of the lnkmap fields
-                if (path == "") path = get_field(lnkmap, "local_base_path");
-                if (path == "") path = get_field(lnkmap, "local_base_path_unicode");
-                if (path == "") path = get_field(lnkmap, "common_path_suffix");
-                if (path == "") path = get_field(lnkmap, "common_path_suffix_unicode");
-                if (path == "") path = get_field(lnkmap, "name_string");
-                if (path == "") path = get_field(lnkmap, "relative_path");
-                if (path == "") path = get_field(lnkmap, "net_name");
-                if (path == "") path = get_field(lnkmap, "net_name_unicode");
-                if (path == "") path = get_field(lnkmap, "device_name");
-                if (path == "") path = get_field(lnkmap, "device_name_unicode");
-                if (path == "") path = get_field(lnkmap, "working_dir");
-                if (path == "") path = get_field(lnkmap, "command_line_arguments");
-                if (path == "") path = get_field(lnkmap, "volume_label");
-                if (path == "") path = get_field(lnkmap, "droid_volumeid");
-                if (path == "") path = "LINKINFO_PATH_EMPTY"; // nothing to assign to path
+                for (size_t i = 0; path.empty() && i < sizeof(path_fields) / sizeof(path_fields[0]); i++) {
+                    path = lnk.get(path_fields[i]);
+                }
+                if (path.empty()) path = "LINKINFO_PATH_EMPTY"; // nothing to assign to path
 
                 // record
-                winlnk_recorder->write(sbuf.pos0+pos, path, dfxml_writer::xmlmap(lnkmap,"lnk",""));
+                lnk.to_xml(xml);
+                winlnk_recorder->write(sbuf.pos0+pos, std::string(path), xml);
             }
         }
     }
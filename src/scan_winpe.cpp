@@ -24,6 +24,8 @@
 #include "config.h"
 #include "be13_api/utils.h"  // needs config.h
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
+#include "recorder_handle.h"
 
 /**
  * XML_SPEC
@@ -496,8 +498,57 @@ static bool valid_section_name(const std::string &sectionName)
     return true;
 }
 
+static bool known_value (const struct flagnames_t flagnames[], const uint32_t needle)
+{
+    for (int i = 0; flagnames[i].flag; i++) {
+        if (needle == flagnames[i].flag) return true;
+    }
+    return false;
+}
+
+/* All the excuses scan_winpe_verify() has to throw out the PE, tested before any XML is built.
+ * Once the optional header is accepted, so is the PE.
+ */
+static bool scan_winpe_header_ok (const sbuf_t &sbuf)
+{
+    const size_t size = sbuf.bufsize;
+    const uint32_t header_offset = sbuf.get32u(PE_FILE_OFFSET) + PE_SIGNATURE_SIZE;
+
+    if (header_offset + sizeof(Pe_FileHeader) > size) return false;
+    if (!known_value(pe_fileheader_machine, sbuf.get16u(header_offset))) return false;
+
+    const uint16_t pe_NumberOfSections     = sbuf.get16u(header_offset + 2);
+    const uint32_t pe_PointerToSymbolTable = sbuf.get32u(header_offset + 8);
+    const uint32_t pe_NumberOfSymbols      = sbuf.get32u(header_offset + 12);
+    const uint16_t pe_SizeOfOptionalHeader = sbuf.get16u(header_offset + 16);
+    if ((pe_NumberOfSections == 0) || (pe_NumberOfSections > 256)) return false;
+    if (((pe_NumberOfSymbols == 0) && (pe_PointerToSymbolTable != 0)) || (pe_NumberOfSymbols > 1000000)) return false;
+    if (pe_SizeOfOptionalHeader & 0x1) return false;
+
+    if (header_offset + sizeof(Pe_FileHeader) + sizeof(Pe_OptionalHeaderStandard) > size) return false;
+    const size_t ohs_offset = header_offset + sizeof(Pe_FileHeader);
+    const uint16_t pe_Magic = sbuf.get16u(ohs_offset);
+    if (pe_Magic != IMAGE_FILE_TYPE_PE32 && pe_Magic != IMAGE_FILE_TYPE_PE32PLUS) return false;
+    if (sbuf.get32u(ohs_offset + 20) > 0x10000000) return false; // BaseOfCode
+    if (sbuf.get32u(ohs_offset + 16) > 0x10000000) return false; // AddressOfEntryPoint
+    return true;
+}
+
+/* The XML is built in one stream per thread, which keeps its buffer from one PE to the next */
+static std::stringstream & xml_buffer ()
+{
+    static thread_local std::stringstream xml;
+    static const std::ios_base::fmtflags default_flags = xml.flags();
+    xml.str(std::string());
+    xml.clear();
+    xml.flags(default_flags);
+    return xml;
+}
+
 static std::string scan_winpe_verify (const sbuf_t &sbuf)
 {
+    if (!scan_winpe_header_ok(sbuf)) return "";
+
     //const uint8_t * data = sbuf.buf;
     size_t size          = sbuf.bufsize;
 
@@ -505,7 +556,7 @@ static std::string scan_winpe_verify (const sbuf_t &sbuf)
     size_t ohw_offset                          = 0;    // OptionalHeaderWindows
     //uint32_t     header_offset;
     int          section_i;
-    std::stringstream xml;
+    std::stringstream &xml = xml_buffer();
     //int dlli;
 
     // set Pe_FileHeader to correct address
@@ -1008,6 +1059,9 @@ static size_t get_carve_size (const sbuf_t& sbuf)
     return carve_size;
 }
 
+static recorder_handle winpe_file {"winpe"};
+static recorder_handle winpe_carved_file {"winpe_carved"};
+
 extern "C"
 void scan_winpe (scanner_params &sp)
 {
@@ -1020,13 +1074,17 @@ void scan_winpe (scanner_params &sp)
         sp.info->scanner_version = "1.1.0";
         struct feature_recorder_def::flags_t carve_flag;
         carve_flag.carve = true;
-        sp.info->feature_defs.push_back( feature_recorder_def("winpe"));
-        sp.info->feature_defs.push_back( feature_recorder_def("winpe_carved", carve_flag));
+        sp.info->feature_defs.push_back( winpe_file.def());
+        sp.info->feature_defs.push_back( winpe_carved_file.def(carve_flag));
         return;
     }
 
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        winpe_file.resolve(sp);
+        winpe_carved_file.resolve(sp);
+    }
     if(sp.phase == scanner_params::PHASE_SCAN){    // phase 1
-	feature_recorder &f = sp.named_feature_recorder("winpe");
+	feature_recorder &f = *winpe_file;
         const sbuf_t &sbuf = *(sp.sbuf);
 
 	/*
@@ -1069,8 +1127,8 @@ void scan_winpe (scanner_params &sp)
 		    f.write(data.pos0, first4k.hash(), xml);
 
                     size_t carve_size = get_carve_size(data);
-                    feature_recorder &f_carved = sp.named_feature_recorder("winpe_carved");
-                    f_carved.carve(data.slice(0, carve_size), ".winpe");
+                    feature_recorder &f_carved = *winpe_carved_file;
+                    carve_index::carve(f_carved, data.slice(0, carve_size), ".winpe");
 		}
 	    }
 	}
@@ -31,14 +31,18 @@
 
 
 #include "config.h"
+#include "recorder_handle.h"
 #include "utf8.h"
-#include "be13_api/utils.h"             // for safe_utf16to8, requires config.h
+#include "be13_api/utils.h"             // for microsoftDateToISODate, requires config.h
 #include "be13_api/scanner_params.h"
-#include "be13_api/sbuf_stream.h"
 #include "dfxml_cpp/src/dfxml_writer.h"     // requires config.h
+#include "signature_prefilter.h"
+#include "utf8_text.h"
 
 /**
  * Instantiates a populated prefetch record from the buffer provided.
+ * The file and directory names are converted from UTF-16 and escaped into the XML as they are read,
+ * and the buffers are kept from one record to the next, so a record costs no allocations once they have grown.
  */
 struct prefetch_record_t {
     bool isvalid {false};
@@ -50,14 +54,19 @@ struct prefetch_record_t {
     std::string   volume_path_name {};
     uint32_t volume_serial_number  {};
     int64_t  volume_creation_time  {};
-    std::vector<std::string> files {};		// files in prefect record
-    std::vector<std::string> directories {};	// directories in prefect
+    std::string files_xml {};           // <file> elements of the files in the prefetch record
+    std::string directories_xml {};     // <dir> elements of its directories
+    std::string xml {};                 // made by to_xml()
 
-    std::string to_xml();		// turns the record to an XML
+    const std::string &to_xml();        // turns the record to an XML
 
     prefetch_record_t(){};
-    bool valid_full_path_name(const std::string &str);
+    static bool valid_full_path_name(const std::string &str);
     bool validate(const sbuf_t &sbuf);  // returns true if sbuf points to a validate record
+
+private:
+    std::string name {};                // the UTF-8 of the name being read
+    bool append_path(const sbuf_t &sbuf, size_t &offset, const char *tag, std::string &out);
 };
 
 bool prefetch_record_t::valid_full_path_name(const std::string &str)
@@ -71,8 +80,67 @@ bool prefetch_record_t::valid_full_path_name(const std::string &str)
     return true;
 }
 
+/*
+ * Convert the NUL-terminated UTF-16LE string at offset to UTF-8 in out, leaving offset after the NUL
+ * (or at the end of the sbuf). Returns false if it is not valid UTF-16; as with safe_utf16to8(), out is then empty.
+ */
+static bool utf16le_to_utf8(const sbuf_t &sbuf, size_t &offset, std::string &out)
+{
+    out.clear();
+    const uint8_t *buf = sbuf.get_buf();
+    while (offset+1 < sbuf.bufsize) {
+        uint32_t c = buf[offset] | (buf[offset+1] << 8);
+        offset += 2;
+        if (c==0) return true;
+        if (c>=0xd800 && c<0xdc00) {                // a high surrogate must be followed by a low one
+            if (offset+1 >= sbuf.bufsize) break;
+            const uint32_t lo = buf[offset] | (buf[offset+1] << 8);
+            if (lo<0xdc00 || lo>=0xe000) break;
+            offset += 2;
+            c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+        } else if (c>=0xdc00 && c<0xe000) {
+            break;
+        }
+        if (c < 0x80) {
+            out.push_back(static_cast<char>(c));
+        } else if (c < 0x800) {
+            out.push_back(static_cast<char>(0xc0 | (c >> 6)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else if (c < 0x10000) {
+            out.push_back(static_cast<char>(0xe0 | (c >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else {
+            out.push_back(static_cast<char>(0xf0 | (c >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        }
+    }
+    if (offset+1 >= sbuf.bufsize) {
+        offset = sbuf.bufsize;
+        return true;                    // ran off the end: what was read is the string
+    }
+    out.clear();
+    return false;
+}
+
+/* Read the path at offset and append it to out as a tag element; false if it is not a valid full path */
+bool prefetch_record_t::append_path(const sbuf_t &sbuf, size_t &offset, const char *tag, std::string &out)
+{
+    if (!utf16le_to_utf8(sbuf, offset, name) || !valid_full_path_name(name)) return false;
+    std::string escape_buf;
+    out.append("<").append(tag).append(">").append(utf8_text::xml_escaped(name, escape_buf)).append("</").append(tag).append(">");
+    return true;
+}
+
 bool prefetch_record_t::validate(const sbuf_t &sbuf)
 {
+    files_xml.clear();
+    directories_xml.clear();
+    execution_filename.clear();
+    volume_path_name.clear();
+
     // read fields in order until done or range exception
     try {
 
@@ -104,8 +172,8 @@ bool prefetch_record_t::validate(const sbuf_t &sbuf)
         uint32_t prefetch_file_length = sbuf.get32u(0x0c);
 
         // get execution file filename
-        std::wstring utf16_execution_filename = sbuf.getUTF16(0x10);
-        execution_filename = safe_utf16to8(utf16_execution_filename);
+        size_t offset = 0x10;
+        utf16le_to_utf8(sbuf, offset, execution_filename);
         if (execution_filename.size()==0) execution_filename="UNKNOWN_FILENAME";
 
         // get the offset to Section A
@@ -126,21 +194,18 @@ bool prefetch_record_t::validate(const sbuf_t &sbuf)
         // get the list of files from Section C
         uint32_t section_c_offset = sbuf.get32u(0x64);
         uint32_t section_c_length = sbuf.get32u(0x68);
-        sbuf_stream filename_stream( sbuf.slice(section_c_offset));
-        while (filename_stream.tell() < section_c_length) {
-            std::cerr << "section_c_offset=" << section_c_offset << " section_c_length=" << section_c_length << " filename_stream.tell()=" << filename_stream.tell() << " sbuf=" << sbuf << "\n";
-            std::wstring utf16_filename = filename_stream.getUTF16();
-            std::string filename = safe_utf16to8(utf16_filename);
-            if (!valid_full_path_name(filename)) return isvalid;
-            files.push_back(filename);
+        if (section_c_offset > sbuf.bufsize) return isvalid;
+        offset = section_c_offset;
+        while (offset - section_c_offset < section_c_length) {
+            if (!append_path(sbuf, offset, "file", files_xml)) return isvalid;
         }
 
         // Process Section D
         uint32_t section_d_offset = sbuf.get32u(0x6c);
 
         uint32_t volume_name_offset = sbuf.get32u(section_d_offset + 0x00);
-        std::wstring utf16_volume_name = sbuf.getUTF16(section_d_offset+volume_name_offset);
-        volume_path_name = safe_utf16to8(utf16_volume_name);
+        offset = size_t(section_d_offset) + volume_name_offset;
+        utf16le_to_utf8(sbuf, offset, volume_path_name);
 
         volume_creation_time = sbuf.get64i(section_d_offset+0x08);
         volume_serial_number = sbuf.get32u(section_d_offset+0x10);
@@ -154,24 +219,22 @@ bool prefetch_record_t::validate(const sbuf_t &sbuf)
             // the offset is out of range so don't get the list of directories
         } else {
             // calculate a rough maximum number of bytes for directory entries
-            size_t      upper_max = prefetch_file_length - directory_offset;
-            sbuf_stream directory_stream = sbuf_stream( sbuf.slice(directory_offset));
+            size_t upper_max = prefetch_file_length - directory_offset;
+            offset = directory_offset;
 
             for (uint32_t i=0; i<num_directory_entries; i++) {
                 // break if obviously out of range
-                if (directory_stream.tell() > upper_max) {
+                if (offset - directory_offset > upper_max) {
                     return isvalid;		// rest of data not good
                 }
 
                 // for directories, the first int16 is the directory name length.
                 // We read to \U0000 instead so we throw away the directory name length.
-                directory_stream.get16u();
+                sbuf.get16u(offset);
+                offset += 2;
 
                 // read the directory name
-                std::wstring utf16_directory_name = directory_stream.getUTF16();
-                std::string directory_name = safe_utf16to8(utf16_directory_name);
-                if (!valid_full_path_name(directory_name)) return isvalid;
-                directories.push_back(directory_name);
+                if (!append_path(sbuf, offset, "dir", directories_xml)) return isvalid;
             }
         }
         return isvalid;
@@ -186,43 +249,34 @@ bool prefetch_record_t::validate(const sbuf_t &sbuf)
  * Returns an XML string from the prefetch record provided.
  */
 // Private helper functions; turn a prefect record into an XML string */
-std::string prefetch_record_t::to_xml()
+const std::string &prefetch_record_t::to_xml()
 {
-    std::stringstream ss;
-
+    xml.clear();
     if (!isvalid) {
-        return "";
-    }
-
-    // generate the prefetch feature in a stringstream
-    ss << "<prefetch>";
-    ss << "<os>"       << dfxml_writer::xmlescape(prefetch_version) << "</os>";
-    ss << "<filename>" << dfxml_writer::xmlescape(execution_filename) << "</filename>";
-    ss << "<header_size>" << header_size << "</header_size>";
-    ss << "<atime>"    << microsoftDateToISODate(execution_time) << "</atime>";
-    ss << "<runs>"     << execution_counter << "</runs>";
-    ss << "<filenames>";
-    for (const auto &it : files) {
-        ss << "<file>" << dfxml_writer::xmlescape(it) << "</file>";
-    }
-    ss << "</filenames>";
-
-    ss << "<volume>";
-    ss << "<path>" << dfxml_writer::xmlescape(volume_path_name) << "</path>";
-    ss << "<creation>" << microsoftDateToISODate(volume_creation_time) << "</creation>";
-    ss << "<serial_number>" << std::hex << volume_serial_number << std::dec << "</serial_number>";
-
-    ss << "<dirnames>";
-    for (const auto &it:directories) {
-        ss << "<dir>" << dfxml_writer::xmlescape(it) << "</dir>";
+        return xml;
     }
-    ss << "</dirnames>";
-    ss << "</volume>";
-    ss << "</prefetch>";
 
-    // return the xml as a string
-    std::string prefetch_xml = ss.str();
-    return prefetch_xml;
+    char serial[16];
+    snprintf(serial, sizeof(serial), "%x", volume_serial_number);
+
+    // generate the prefetch feature
+    std::string escape_buf;
+    xml.append("<prefetch>");
+    xml.append("<os>").append(utf8_text::xml_escaped(prefetch_version, escape_buf)).append("</os>");
+    xml.append("<filename>").append(utf8_text::xml_escaped(execution_filename, escape_buf)).append("</filename>");
+    xml.append("<header_size>").append(std::to_string(header_size)).append("</header_size>");
+    xml.append("<atime>").append(microsoftDateToISODate(execution_time)).append("</atime>");
+    xml.append("<runs>").append(std::to_string(execution_counter)).append("</runs>");
+    xml.append("<filenames>").append(files_xml).append("</filenames>");
+
+    xml.append("<volume>");
+    xml.append("<path>").append(utf8_text::xml_escaped(volume_path_name, escape_buf)).append("</path>");
+    xml.append("<creation>").append(microsoftDateToISODate(volume_creation_time)).append("</creation>");
+    xml.append("<serial_number>").append(serial).append("</serial_number>");
+    xml.append("<dirnames>").append(directories_xml).append("</dirnames>");
+    xml.append("</volume>");
+    xml.append("</prefetch>");
+    return xml;
 }
 
 /**
@@ -244,7 +298,9 @@ std::string prefetch_record_t::to_xml()
  * The second string is the full feature content, in this case, packed in XML.
  * Method dfxml_writer::xml_escape() is used to help format XML output.
  */
-feature_recorder *winprefetch_recorder = nullptr;
+static recorder_handle winprefetch_recorder {"winprefetch"};
+static size_t scca_signature = 0;       // the end of the version and "SCCA", in the signature_prefilter
+static const size_t SECTOR_SIZE = 512;  // prefetch files are too large to be resident in the MFT
 extern "C"
 void scan_winprefetch(scanner_params &sp)
 {
@@ -254,12 +310,13 @@ void scan_winprefetch(scanner_params &sp)
         sp.info->name		= "winprefetch";
         sp.info->author		= "Bruce Allen";
         sp.info->description	= "Search for Windows Prefetch files";
-        sp.info->feature_defs.push_back( feature_recorder_def("winprefetch"));
+        sp.info->feature_defs.push_back( winprefetch_recorder.def());
         sp.info->min_sbuf_size = 64;
         return;
     }
     if (sp.phase==scanner_params::PHASE_INIT2){
-	winprefetch_recorder = &sp.named_feature_recorder("winprefetch");
+	winprefetch_recorder.resolve(sp);
+        scca_signature = signature_prefilter::shared().add(std::string("\x00\x00\x00SCCA", 7), 1, 1, SECTOR_SIZE);
     }
     if (sp.phase==scanner_params::PHASE_SCAN){
 
@@ -268,9 +325,10 @@ void scan_winprefetch(scanner_params &sp)
 
 	size_t stop = (sbuf.pagesize > sbuf.bufsize + 8) ? sbuf.bufsize : sbuf.pagesize - 8;
 
-	// iterate through sbuf searching for winprefetch features
+	// iterate through the offsets of sbuf at which SCCA follows a version, searching for winprefetch features
         prefetch_record_t prefetch_record;
-	for (size_t start=0; start < stop; start++) {
+	for (size_t start : signature_prefilter::shared().candidates(sbuf, scca_signature)) {
+            if (start >= stop) break;
 
 	    // check for probable WindowsXP or Windows7 header
 	    if ((sbuf[start + 0] == 0x11 || sbuf[start + 0] == 0x17)
@@ -283,7 +341,7 @@ void scan_winprefetch(scanner_params &sp)
 		&& sbuf[start + 7] == 0x41) {
 
 		// create the populated prefetch record and see if it validates
-                if (prefetch_record.validate(sbuf)) {
+                if (prefetch_record.validate(sbuf.slice(start))) {
                     // record the winprefetch entry
                     winprefetch_recorder->write(sbuf.pos0+start, prefetch_record.execution_filename, prefetch_record.to_xml());
                     /* Should really skip to the end of the record we just
@@ -1,6 +1,12 @@
 #include <cstdlib>
 #include <cstring>
 #include <cinttypes>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <queue>
+#include <mutex>
+#include <thread>
 
 /*
  * This module creates a wordlist that can be used for password cracking.
@@ -8,11 +14,15 @@
  * Pass 1 - During scanning (phase 1), each word found is written to a word.
  * Pass 2 - the words are read, uniquified, and written out in sorted order,
  *          shortest to longest, in files no longer than 100MB each.
+ *          Runs of words that do not fit in wordlist_sort_memory are sorted
+ *          in parallel, spilled to disk and merged.
  *          This is designed for Elcomsoft's tools, but you may have success
  *          with others.
  *
- * In BE1.6 we also had the ability to use SQLite3 for making the password list.
- * We haven't gotten that working here yet.
+ * With -S wordlist_use_sql=1 (and SQLite3), pass 1 inserts the words into wordlist.sqlite3
+ * instead of the flat file, in large per-thread batches, and pass 2 reads them back sorted.
+ *
+ * With -S wordlist_utf16=1, the words of the UTF-16LE text found by utf16_view are added too.
  */
 
 
@@ -22,35 +32,203 @@
 #include "be13_api/scanner_params.h"
 #include "be13_api/scanner_set.h"
 #include "scan_wordlist.h"
+#include "utf16_view.h"
 
 #if defined(HAVE_LIBSQLITE3) && defined(HAVE_SQLITE3_H)
 #define USE_SQLITE3
 #endif
 
 bool wordlist_strings = false;
+bool wordlist_utf16 = false;
 
-/* Haven't figured out the SQL interface yet. */
-#if 0
 #ifdef USE_SQLITE3
+#include <sqlite3.h>
+
+/* The index on word is only made at shutdown, so the inserts during the scan only append */
 static const char *schema_wordlist[] = {
-    "CREATE TABLE wordlist (word BLOB)",
-    "CREATE UNIQUE INDEX wordlist_i on wordlist(word)",
+    "PRAGMA journal_mode=WAL",
+    "PRAGMA synchronous=OFF",
+    "CREATE TABLE IF NOT EXISTS wordlist (pos TEXT, word BLOB)",
     0};
-static const char *insert_statement = "INSERT OR IGNORE INTO wordlist VALUES (?);";
-static feature_recorder::besql_stmt *wordlist_stmt=0;
+static const char *insert_statement = "INSERT INTO wordlist VALUES (?,?);";
+static const char *index_statement  = "CREATE INDEX IF NOT EXISTS wordlist_word ON wordlist(word);";
 static const char *select_statement = "SELECT DISTINCT word FROM wordlist ORDER BY length(word),word";
 #endif
-#endif
 
+/* The words a thread has found since it last inserted them */
+struct Scan_Wordlist::sql_batch {
+    std::string arena {};
+    struct row {
+        uint64_t offset;                // the forensic path, then the word, in arena
+        uint32_t pos_len;
+        uint32_t len;
+    };
+    std::vector<row> rows {};
+    void add(const pos0_t &pos, std::string_view word) {
+        const std::string path = pos.str();
+        rows.push_back(row{arena.size(), static_cast<uint32_t>(path.size()), static_cast<uint32_t>(word.size())});
+        arena.append(path);
+        arena.append(word);
+    }
+};
+
+static std::atomic<uint64_t> wordlist_instances {0};
 
 Scan_Wordlist::Scan_Wordlist(scanner_params &sp, bool strings_):strings(strings_)
 {
-    // Build the truth table for the wordlist separator values.
-    for(int ch=0; ch<256; ch++){
-        if (strings) {
-            wordchar[ch] = isprint(ch) && ch<128;
+    // Words are runs of printable ASCII; strings may also contain spaces.
+    first_wordchar = strings ? ' ' : '!';
+    instance = ++wordlist_instances;
+}
+
+Scan_Wordlist::~Scan_Wordlist()
+{
+    if (wordlist_out){
+        wordlist_out->close();
+        delete wordlist_out;
+    }
+    sql_close();
+}
+
+#ifdef USE_SQLITE3
+static void sql_check(sqlite3 *db, int rc, const char *what)
+{
+    if (rc != SQLITE_OK && rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        throw std::runtime_error(std::string("scan_wordlist: ") + what + ": " + sqlite3_errmsg(db));
+    }
+}
+#endif
+
+/* Insert a batch in one transaction, opening the database on first use. The caller holds sql_lock. */
+void Scan_Wordlist::sql_insert(sql_batch &b)
+{
+#ifdef USE_SQLITE3
+    if (db == nullptr) {
+        auto db_path = flat_wordlist->fname_in_outdir("", feature_recorder::NO_COUNT).parent_path() / "wordlist.sqlite3";
+        if (sqlite3_open_v2(db_path.string().c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("cannot open: " + db_path.string());
+        }
+        for (int i = 0; schema_wordlist[i]; i++) {
+            sql_check(db, sqlite3_exec(db, schema_wordlist[i], nullptr, nullptr, nullptr), schema_wordlist[i]);
+        }
+        sql_check(db, sqlite3_prepare_v2(db, insert_statement, -1, &insert_stmt, nullptr), insert_statement);
+    }
+    sql_check(db, sqlite3_exec(db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr), "BEGIN TRANSACTION");
+    for (const auto &r : b.rows) {
+        sqlite3_bind_text(insert_stmt, 1, b.arena.data() + r.offset, r.pos_len, SQLITE_STATIC);
+        sqlite3_bind_blob(insert_stmt, 2, b.arena.data() + r.offset + r.pos_len, r.len, SQLITE_STATIC);
+        sql_check(db, sqlite3_step(insert_stmt), insert_statement);
+        sqlite3_reset(insert_stmt);
+    }
+    sql_check(db, sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr), "COMMIT");
+#endif
+    b.rows.clear();
+    b.arena.clear();
+}
+
+/* Queue a word in this thread's batch; insert the batch when it is full */
+void Scan_Wordlist::sql_write(const pos0_t &pos, std::string_view word)
+{
+    if (batch_owner != instance) {
+        const std::lock_guard<std::mutex> lock(sql_lock);
+        sql_batches.push_back(std::make_unique<sql_batch>());
+        batch = sql_batches.back().get();
+        batch_owner = instance;
+    }
+    batch->add(pos, word);
+    if (batch->rows.size() >= SQL_BATCH_ROWS) {
+        const std::lock_guard<std::mutex> lock(sql_lock);
+        sql_insert(*batch);
+    }
+}
+
+void Scan_Wordlist::sql_close()
+{
+#ifdef USE_SQLITE3
+    if (insert_stmt) sqlite3_finalize(insert_stmt);
+    if (db) sqlite3_close(db);
+#endif
+    insert_stmt = nullptr;
+    db = nullptr;
+}
+
+/* A bit for each of the 64 bytes at p that is a word character, in [lo, 0x7e] */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+static inline uint64_t wordchar_mask64(const uint8_t *p, uint8_t lo)
+{
+    const __m128i below = _mm_set1_epi8(lo - 1);
+    const __m128i del   = _mm_set1_epi8(0x7f);
+    uint64_t mask = 0;
+    for (int k = 0; k < 4; k++) {
+        // signed compares: bytes >= 0x80 are negative, so they fail the first
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16*k));
+        const __m128i w = _mm_and_si128(_mm_cmpgt_epi8(c, below), _mm_cmpgt_epi8(del, c));
+        mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(w))) << (16*k);
+    }
+    return mask;
+}
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+static inline uint64_t wordchar_mask64(const uint8_t *p, uint8_t lo)
+{
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bits = vld1q_u8(weights);
+    uint8x16_t m[4];
+    for (int k = 0; k < 4; k++) {
+        const uint8x16_t c = vld1q_u8(p + 16*k);
+        m[k] = vandq_u8(vandq_u8(vcgeq_u8(c, vdupq_n_u8(lo)), vcleq_u8(c, vdupq_n_u8(0x7e))), bits);
+    }
+    // three pairwise adds fold each 8 bytes of weights into one byte of the mask
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(m[0], m[1]), vpaddq_u8(m[2], m[3]));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+#else
+static inline uint64_t wordchar_mask64(const uint8_t *p, uint8_t lo)
+{
+    uint64_t mask = 0;
+    for (int k = 0; k < 64; k++) {
+        mask |= static_cast<uint64_t>(p[k] >= lo && p[k] <= 0x7e) << k;
+    }
+    return mask;
+}
+#endif
+
+/*
+ * Find the words in buf: runs of characters in [first_wordchar, 0x7e] that start at or before
+ * pagesize and end before bufsize (a run that reaches the end of the buffer is not a word).
+ * The word boundaries are found 64 bytes at a time from the bitmask of word characters.
+ */
+void Scan_Wordlist::find_words(const uint8_t *buf, size_t bufsize, size_t pagesize, uint8_t first_wordchar,
+                               std::vector<std::string_view> &words)
+{
+    const char *base = reinterpret_cast<const char *>(buf);
+    bool   in_word   = false;
+    size_t wordstart = 0;
+    for (size_t block = 0; block < bufsize; block += 64) {
+        if (!in_word && block > pagesize) return; // no more words can start
+        uint64_t mask;
+        if (block + 64 <= bufsize) {
+            mask = wordchar_mask64(buf + block, first_wordchar);
         } else {
-            wordchar[ch] = isprint(ch) && ch!=' ' && ch<128;
+            uint8_t tail[64] {};
+            memcpy(tail, buf + block, bufsize - block);
+            mask = wordchar_mask64(tail, first_wordchar) & ((uint64_t(1) << (bufsize - block)) - 1);
+        }
+        /* bit k is set where byte block+k starts or ends a run of word characters */
+        uint64_t transitions = mask ^ ((mask << 1) | (in_word ? 1 : 0));
+        if (block + 64 > bufsize) transitions &= (uint64_t(1) << (bufsize - block)) - 1;
+        while (transitions) {
+            size_t i = block + __builtin_ctzll(transitions);
+            transitions &= transitions - 1;
+            if (!in_word) {
+                if (i > pagesize) return;
+                wordstart = i;
+            } else {
+                words.emplace_back(base + wordstart, i - wordstart);
+            }
+            in_word = !in_word;
         }
     }
 }
@@ -62,93 +240,191 @@ void Scan_Wordlist::process_sbuf(scanner_params &sp)
         flat_wordlist = &sp.named_feature_recorder("wordlist");
     }
 
-    /* Simplified word extractor. It's good enough to pull out stuff for cryptanalysis. */
-    bool in_word     = false;        // true if we are in a word
-    size_t wordstart = 0;            // if we are in the word, where it started
-    for(size_t i=0; i<sbuf.bufsize; i++){
-        bool is_wordchar = wordchar[sbuf[i]];
-        if (!in_word) {
-            /* case 1 - we are not in a word */
-            /* does this character start a word? */
-            if (is_wordchar){
-                in_word = true;
-                wordstart = i;
-            }
-            /* If we are not in a word and we have extended into the margin, quit. */
-            if (i > sbuf.pagesize){
-                return;
-            }
+    /* Simplified word extractor. It's good enough to pull out stuff for cryptanalysis.
+     * Tokenize the whole page into views of the sbuf, then record the words that are long enough.
+     */
+    const uint8_t *buf = sbuf.get_buf();
+    std::vector<std::string_view> words;
+    words.reserve(sbuf.pagesize / 16);
+    find_words(buf, sbuf.bufsize, sbuf.pagesize, first_wordchar, words);
+    record_words(sbuf, words, buf, 0, 1);
+
+    if (utf16) {
+        /* the text of each run is followed by a 0, so a word may end at the end of the run */
+        const utf16_view &view = utf16_view::of(sbuf);
+        for (const auto &r : view.runs) {
+            const std::string_view text = view.text_of(r);
+            words.clear();
+            find_words(reinterpret_cast<const uint8_t *>(text.data()), text.size()+1, text.size(), first_wordchar, words);
+            record_words(sbuf, words, reinterpret_cast<const uint8_t *>(text.data()), r.offset, 2);
         }
-        else {
-            /* case 2 - we are in a word */
-            /* If this is the end of the word, or we are in the word and this is the end of the margin,
-             * do end-of-word processing.
-             */
-            /* Does - we are in a word & this character ends a word. */
-            if (in_word && !is_wordchar){
-                uint32_t len = i - wordstart;
-                if ((word_min <= len) && (len <=  word_max)){
-
-                    /* Save the word that starts at sbuf.buf+wordstart that has a length of len.
-                     * Do we need to keep the position? It might be useful in some applications.
-                     */
-                    std::string word = sbuf.substr(wordstart,len);
-                    flat_wordlist->write(sbuf.pos0+wordstart, word, "");
-
-                    /* check for (word), <word>, and [word] */
-                    if (word.size()>2 && word[0]=='(' && word[word.size()-1]==')') {
-                        flat_wordlist->write(sbuf.pos0+wordstart+1, word.substr(1,word.size()-2), "");
-                    }
-                    if (word.size()>2 && word[0]=='<' && word[word.size()-1]=='>') {
-                        flat_wordlist->write(sbuf.pos0+wordstart+1, word.substr(1,word.size()-2), "");
-                    }
-                    if (word.size()>2 && word[0]=='[' && word[word.size()-1]==']') {
-                        flat_wordlist->write(sbuf.pos0+wordstart+1, word.substr(1,word.size()-2), "");
-                    }
-                }
-#if 0
-#ifdef USE_SQLITE3
-                /* Figure out how to write the wordlist to the SQL later. */
-                if (fs.db) {
-                    const std::lock_guard<std::mutex> lock(wordlist_stmt->Mstmt);
-                    sqlite3_bind_blob(wordlist_stmt->stmt, 1,
-                                      (const char *)word.data(), word.size(), SQLITE_STATIC);
-                    if (sqlite3_step(wordlist_stmt->stmt) != SQLITE_DONE) {
-                        fprintf(stderr,"sqlite3_step failed on scan_wordlist\n");
-                    }
-                    sqlite3_reset(wordlist_stmt->stmt);
-                }
-#endif
-#endif
-                wordstart = 0;
-                in_word = false;
+    }
+}
+
+/*
+ * Record the words that are long enough. The words are views of base; a character at index i of
+ * base is at offset + i*stride in the sbuf.
+ */
+void Scan_Wordlist::record_words(const sbuf_t &sbuf, const std::vector<std::string_view> &words,
+                                 const uint8_t *base, uint64_t offset, size_t stride)
+{
+    std::string word;                   // reused, so words longer than the SSO buffer are not reallocated
+    for (const auto &w : words) {
+        if (w.size() < word_min || w.size() > word_max) continue;
+        const uint64_t wordstart = offset + (reinterpret_cast<const uint8_t *>(w.data()) - base) * stride;
+
+        /* Save the word. Do we need to keep the position? It might be useful in some applications. */
+        if (wordlist_use_sql) {
+            sql_write(sbuf.pos0+wordstart, w);
+        } else {
+            word.assign(w);
+            flat_wordlist->write(sbuf.pos0+wordstart, word, "");
+        }
+
+        /* check for (word), <word>, and [word] */
+        if (w.size()>2 && ((w.front()=='(' && w.back()==')') ||
+                           (w.front()=='<' && w.back()=='>') ||
+                           (w.front()=='[' && w.back()==']'))) {
+            if (wordlist_use_sql) {
+                sql_write(sbuf.pos0+wordstart+stride, w.substr(1, w.size()-2));
+            } else {
+                word.assign(w.substr(1, w.size()-2));
+                flat_wordlist->write(sbuf.pos0+wordstart+stride, word, "");
             }
         }
     }
 }
 
-void Scan_Wordlist::dump_seen_wordlist()
+/* Write a word to the current dedup file, starting the next one when that is full */
+void Scan_Wordlist::write_word(std::string_view word)
 {
-    /* Dump the words so far */
-    for(const auto &it : seen_wordlist){
-        if (it.size()==0) continue;
-        if (wordlist_out == nullptr ){
-            auto wordlist_segment_path = flat_wordlist->fname_in_outdir("dedup", wordlist_segment++);
-            wordlist_out = new std::ofstream( wordlist_segment_path );
-            if (!wordlist_out->is_open()) {
-                throw std::runtime_error("cannot open: " + wordlist_segment_path.string());
-            }
+    if (wordlist_out == nullptr ){
+        auto wordlist_segment_path = flat_wordlist->fname_in_outdir("dedup", wordlist_segment++);
+        wordlist_out = new std::ofstream( wordlist_segment_path );
+        if (!wordlist_out->is_open()) {
+            throw std::runtime_error("cannot open: " + wordlist_segment_path.string());
         }
-        (*wordlist_out) << it << "\n";
+        outfilesize = 0;
     }
+    (*wordlist_out) << word << "\n";
+    outfilesize += word.size() + 1;
+    if (outfilesize >= max_output_file_size) close_wordlist_out();
+}
+
+void Scan_Wordlist::close_wordlist_out()
+{
     if (wordlist_out != nullptr) {
         wordlist_out->close();
         delete wordlist_out;
         wordlist_out = nullptr;
     }
-    seen_wordlist.clear();
 }
 
+/*
+ * Sort and uniquify the words of the current run. The words are already bucketed by length, so
+ * only words of one length are compared, and the buckets are sorted in parallel, largest first.
+ */
+void Scan_Wordlist::sort_run()
+{
+    std::vector<size_t> order;
+    for (size_t len = 0; len < run_words.size(); len++) {
+        if (run_words[len].size() > 1) order.push_back(len);
+    }
+    std::sort(order.begin(), order.end(),
+              [this](size_t a, size_t b) { return run_words[a].size() > run_words[b].size(); });
+
+    std::atomic<size_t> next {0};
+    auto sorter = [this, &order, &next]() {
+        for (size_t n; (n = next++) < order.size(); ) {
+            const size_t len = order[n];
+            auto &bucket = run_words[len];
+            const char *base = run_arena.data();
+            auto word = [base, len](uint64_t off) { return std::string_view(base + off, len); };
+            std::sort(bucket.begin(), bucket.end(), [&word](uint64_t a, uint64_t b) { return word(a) < word(b); });
+            bucket.erase(std::unique(bucket.begin(), bucket.end(),
+                                     [&word](uint64_t a, uint64_t b) { return word(a) == word(b); }),
+                         bucket.end());
+        }
+    };
+    const size_t nthreads = std::min<size_t>(order.size(), std::max(std::thread::hardware_concurrency(), 1U));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nthreads; i++) {
+        threads.emplace_back(sorter);
+    }
+    sorter();
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+/* Emit the sorted run, shortest words first, and empty it */
+template <typename Fn> void Scan_Wordlist::emit_run(Fn fn)
+{
+    for (size_t len = 1; len < run_words.size(); len++) {
+        for (uint64_t off : run_words[len]) {
+            fn(std::string_view(run_arena.data() + off, len));
+        }
+    }
+    run_words.clear();
+    run_arena.clear();
+    run_bytes = 0;
+}
+
+/* Sort the current run and write it to a run file, to be merged at the end */
+void Scan_Wordlist::spill_run()
+{
+    sort_run();
+    auto run_path = flat_wordlist->fname_in_outdir("sortrun", run_files.size() + 1);
+    std::ofstream out( run_path );
+    if (!out.is_open()) {
+        throw std::runtime_error("cannot open: " + run_path.string());
+    }
+    emit_run([&out](std::string_view word) { out << word << "\n"; });
+    out.close();
+    if (out.fail()) {
+        throw std::runtime_error("cannot write: " + run_path.string());
+    }
+    run_files.push_back(run_path);
+}
+
+/* Merge the sorted run files into the dedup files, dropping the words that are in more than one run */
+void Scan_Wordlist::merge_runs()
+{
+    struct run_head {
+        std::string word;
+        size_t run;
+    };
+    auto later = [](const run_head &a, const run_head &b) { return WordlistSorter()(b.word, a.word); };
+    std::priority_queue<run_head, std::vector<run_head>, decltype(later)> heads(later);
+
+    std::vector<std::unique_ptr<std::ifstream>> runs;
+    for (size_t i = 0; i < run_files.size(); i++) {
+        runs.push_back(std::make_unique<std::ifstream>(run_files[i]));
+        if (!runs.back()->is_open()) {
+            throw std::runtime_error("cannot open: " + run_files[i].string());
+        }
+        run_head h {"", i};
+        if (getline(*runs[i], h.word)) heads.push(std::move(h));
+    }
+
+    std::string last;
+    bool first = true;
+    while (!heads.empty()) {
+        run_head h = heads.top();
+        heads.pop();
+        if (first || h.word != last) {
+            write_word(h.word);
+            last = h.word;
+            first = false;
+        }
+        if (getline(*runs[h.run], h.word)) heads.push(std::move(h));
+    }
+    runs.clear();
+    for (const auto &path : run_files) {
+        std::filesystem::remove(path);
+    }
+    run_files.clear();
+}
 
 void Scan_Wordlist::shutdown(scanner_params &sp)
 {
@@ -157,6 +433,10 @@ void Scan_Wordlist::shutdown(scanner_params &sp)
         return;
     }
     flat_wordlist = &sp.named_feature_recorder("wordlist");
+    if (wordlist_use_sql) {
+        sql_shutdown();
+        return;
+    }
 
     flat_wordlist->flush();
     auto feature_recorder_path = flat_wordlist->fname_in_outdir("", feature_recorder::NO_COUNT);
@@ -165,36 +445,61 @@ void Scan_Wordlist::shutdown(scanner_params &sp)
         throw std::runtime_error(std::string("Scan_Wordlist::shutdown: Cannot open ")+feature_recorder_path.string());
     }
 
-    /* Read all of the words and uniquify them */
-    uint64_t outfilesize = 0;
-    while(!f2.eof()){
-        std::string line;
-        getline(f2,line);
-        if (line[0]=='#') continue;	                // ignore comments
+    /* Read the words into runs of at most sort_memory bytes, bucketed by length.
+     * A run that fills the budget is sorted and spilled to disk; the runs are merged at the end.
+     */
+    std::string line;
+    while(getline(f2,line)){
+        if (line.empty() || line[0]=='#') continue;	// ignore comments
         size_t t1 = line.find('\t');		// find the beginning of the feature
-        if (t1!=std::string::npos) line = line.substr(t1+1);
-
         // The end of the feature is the end of the line, since we did not write the context
-        const std::string &word = line;
+        const std::string_view word = (t1==std::string::npos) ? std::string_view(line) : std::string_view(line).substr(t1+1);
+        if (word.empty()) continue;
 
-        // Insert into the hash list. If we ran out of space, dump it all and restart.
-        try {
-            if (word.size()>0) seen_wordlist.insert(word);
-        }
-        catch (std::bad_alloc &er) {
-            std::cerr << er.what() << std::endl;
-            std::cerr << "scan_wordlist:bad_alloc: Dumping current dataset; will then restart dedup." << std::endl;
-            dump_seen_wordlist();
-            outfilesize = 0;
-        }
+        if (run_words.size() <= word.size()) run_words.resize(word.size()+1);
+        run_words[word.size()].push_back(run_arena.size());
+        run_arena.append(word);
+        run_bytes += word.size() + sizeof(uint64_t);
+        if (run_bytes > sort_memory) spill_run();
+    }
+    f2.close();
+
+    if (run_files.empty()) {
+        /* Everything fit in memory: no merge is needed */
+        sort_run();
+        emit_run([this](std::string_view word) { write_word(word); });
+    } else {
+        if (run_bytes > 0) spill_run();
+        merge_runs();
+    }
+    close_wordlist_out();
+}
 
-        if (outfilesize > max_output_file_size ) {
-            dump_seen_wordlist();
-            outfilesize = 0;
+/* Insert what is left in every thread's batch, index the words, and write them out sorted */
+void Scan_Wordlist::sql_shutdown()
+{
+    const std::lock_guard<std::mutex> lock(sql_lock);
+    for (auto &b : sql_batches) {
+        if (!b->rows.empty()) sql_insert(*b);
+    }
+    sql_batches.clear();
+#ifdef USE_SQLITE3
+    if (db) {
+        sql_check(db, sqlite3_exec(db, index_statement, nullptr, nullptr, nullptr), index_statement);
+        sqlite3_stmt *select_stmt = nullptr;
+        sql_check(db, sqlite3_prepare_v2(db, select_statement, -1, &select_stmt, nullptr), select_statement);
+        int rc;
+        while ((rc = sqlite3_step(select_stmt)) == SQLITE_ROW) {
+            const char *base = static_cast<const char *>(sqlite3_column_blob(select_stmt, 0));
+            int len          = sqlite3_column_bytes(select_stmt, 0);
+            if (len > 0) write_word(std::string_view(base, len));
         }
+        sqlite3_finalize(select_stmt);
+        sql_check(db, rc, select_statement);
     }
-    dump_seen_wordlist();
-    f2.close();
+#endif
+    close_wordlist_out();
+    sql_close();
 }
 
 
@@ -205,20 +510,26 @@ extern "C"
 void scan_wordlist(scanner_params &sp)
 {
     bool wordlist_use_flatfiles = true;
+    bool wordlist_use_sql = false;
 
     if (sp.phase==scanner_params::PHASE_INIT){
         uint32_t word_min = Scan_Wordlist::WORD_MIN_DEFAULT;
         uint32_t word_max = Scan_Wordlist::WORD_MAX_DEFAULT;
         uint64_t max_output_file_size = Scan_Wordlist::MAX_OUTPUT_FILE_SIZE;
+        uint64_t sort_memory = Scan_Wordlist::SORT_MEMORY_DEFAULT;
         sp.check_version();
         sp.info->set_name("wordlist" );
         sp.info->scanner_flags.default_enabled = false; // = scanner_info::SCANNER_DISABLED;
         sp.get_scanner_config("word_min",&word_min,"Minimum word size");
         sp.get_scanner_config("word_max",&word_max,"Maximum word size");
         sp.get_scanner_config("max_output_file_size",&max_output_file_size, "Maximum size of the words output file");
+        sp.get_scanner_config("wordlist_sort_memory",&sort_memory, "Memory used to sort the wordlist before spilling to disk");
         //sp.get_scanner_config("wordlist_use_flatfiles",&wordlist_use_flatfiles,"Use flatfiles for wordlist");
-        //sp.get_scanner_config("wordlist_use_sql",&wordlist_use_sql,"Use SQL DB for wordlist");
+#ifdef USE_SQLITE3
+        sp.get_scanner_config("wordlist_use_sql",&wordlist_use_sql,"Write the wordlist to wordlist.sqlite3 instead of a flat file");
+#endif
         sp.get_scanner_config("strings",&wordlist_strings,"Scan for strings instead of words");
+        sp.get_scanner_config("wordlist_utf16",&wordlist_utf16,"Also find the words in UTF-16LE text");
 
         if (wordlist_use_flatfiles){
             auto def = feature_recorder_def(Scan_Wordlist::WORDLIST);
@@ -235,17 +546,9 @@ void scan_wordlist(scanner_params &sp)
         wordlist->word_min = word_min;
         wordlist->word_max = word_max;
         wordlist->max_output_file_size = max_output_file_size;
-
-#if 0
-#ifdef USE_SQLITE3
-    TODO: Do something to send the SQL through
-        if (fs.db) {
-            fs.db_send_sql(fs.db,schema_wordlist);
-            wordlist_stmt = new feature_recorder::besql_stmt(fs.db,insert_statement);
-            return;
-        }
-#endif
-#endif
+        wordlist->sort_memory = sort_memory;
+        wordlist->wordlist_use_sql = wordlist_use_sql;
+        wordlist->utf16 = wordlist_utf16;
     }
 
     if (sp.phase==scanner_params::PHASE_SCAN){
@@ -258,22 +561,3 @@ void scan_wordlist(scanner_params &sp)
         wordlist = nullptr;
     }
 }
-
-
-#if 0
-/* Similar to above; write out the wordlist using SQL.
- * Not-multi-threaded, but threadsafe nonetheless.
- */
-static void wordlist_sql_write(sqlite3 *db)
-{
-#ifdef USE_SQLITE3
-    feature_recorder::besql_stmt s(db,select_statement);
-    while (sqlite3_step(s.stmt) != SQLITE_DONE) {
-        const char *base = (const char *)sqlite3_column_blob(s.stmt,0);
-        int len          = sqlite3_column_bytes(s.stmt,0);
-        wordlist_write_word(std::string(base,len));
-    }
-    if (of2.is_open()) of2.close();
-#endif
-}
-#endif
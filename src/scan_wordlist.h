@@ -2,63 +2,92 @@
 #define SCAN_WORDLIST_H
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
 #include "be13_api/scanner_params.h"
-#include "be13_api/atomic_set.h"
 
 
 /* NOTE: Wordlist is a singleton!
  * It may be called from multiple threads, so we cannot make sp a class variable.
  *
- * However we do not need to make seen_wordlist atomic because it is only used
+ * However we do not need to make the run variables atomic because they are only used
  * during the single-threaded uniquify pass. We use that pass so we do not need to
  * hold the entire wordlist in memory during processing, but it does add to processing time.
  */
 class Scan_Wordlist {
     /* SHUTDOWN PASS - SINGLE-THREADED INSTANCE VARIABLES */
     struct WordlistSorter {
-        bool operator()(const std::string &a,const std::string &b) const {
+        bool operator()(std::string_view a, std::string_view b) const {
             if (a.size() < b.size()) return true;
             if (a.size() > b.size()) return false;
             return a<b;
         }
     };
-    std::set<std::string, WordlistSorter> seen_wordlist {};
+    std::string run_arena {};                           // the words of the current run, end to end
+    std::vector<std::vector<uint64_t>> run_words {};    // [length] -> offsets in run_arena
+    uint64_t run_bytes {0};                             // memory used by the current run
+    std::vector<std::filesystem::path> run_files {};    // sorted runs spilled to disk
+    void sort_run();
+    template <typename Fn> void emit_run(Fn fn);
+    void spill_run();
+    void merge_runs();
+
     int wordlist_segment {1};
+    uint64_t outfilesize {0};
     std::ofstream *wordlist_out {nullptr};
-    void dump_seen_wordlist();
-    bool wordchar[256] {};              // map of characters that break words
+    void write_word(std::string_view word);
+    void close_wordlist_out();
+
+    /* MULTI-THREADED - the SQL batches of every thread, all inserted through one connection */
+    struct sql_batch;
+    static inline thread_local sql_batch *batch {nullptr};  // this thread's batch
+    static inline thread_local uint64_t batch_owner {0};    // the instance that batch belongs to
+    uint64_t instance {0};
+    std::mutex sql_lock {};
+    std::vector<std::unique_ptr<sql_batch>> sql_batches {};
+    struct sqlite3 *db {nullptr};
+    struct sqlite3_stmt *insert_stmt {nullptr};
+    void sql_write(const pos0_t &pos, std::string_view word);
+    void sql_insert(sql_batch &b);
+    void sql_shutdown();
+    void sql_close();
+    uint8_t first_wordchar {'!'};       // words are the characters from first_wordchar through 0x7e
     Scan_Wordlist(const Scan_Wordlist &)=delete; // no copy
     Scan_Wordlist & operator=(const Scan_Wordlist &)=delete; // no assignment
 
 public:;
     inline static const std::string WORDLIST {"wordlist"};
     Scan_Wordlist(scanner_params &sp, bool strings_);
-    ~Scan_Wordlist() {
-        if (wordlist_out){
-            wordlist_out->close();
-            delete wordlist_out;
-        }
-    }
+    ~Scan_Wordlist();
     std::filesystem::path flat_wordlist_path {}; //
     feature_recorder *flat_wordlist = nullptr;
 
     static const inline uint32_t WORD_MIN_DEFAULT = 6;
     static const inline uint32_t WORD_MAX_DEFAULT = 16;
     static const inline uint64_t MAX_OUTPUT_FILE_SIZE = 100*1000*1000;
+    static const inline uint64_t SORT_MEMORY_DEFAULT = 1024*1024*1024;
 
     bool     strings {false};           // report all strings, not words. Do not uniquify
+    bool     utf16 {false};             // also find the words in UTF-16LE text
     uint32_t word_min  {WORD_MIN_DEFAULT};
     uint32_t word_max {WORD_MAX_DEFAULT};
     uint64_t max_output_file_size {MAX_OUTPUT_FILE_SIZE};
+    uint64_t sort_memory {SORT_MEMORY_DEFAULT};
 
-    /* wordlist support for SQL.  Note that the SQL-based wordlist is
-     * faster than the file-based wordlist.
+    /* wordlist support for SQL. Each thread collects SQL_BATCH_ROWS words and inserts
+     * them in one transaction with a prepared statement; the index is made at shutdown.
      */
-
+    static const inline size_t SQL_BATCH_ROWS = 65536;
     bool wordlist_use_flatfiles {true};
     bool wordlist_use_sql {false};
     /* MULTI-THREADED - sp cannot be an class variable */
     void process_sbuf(scanner_params &sp);
+    static void find_words(const uint8_t *buf, size_t bufsize, size_t pagesize, uint8_t first_wordchar,
+                           std::vector<std::string_view> &words);
+    void record_words(const sbuf_t &sbuf, const std::vector<std::string_view> &words,
+                      const uint8_t *base, uint64_t offset, size_t stride);
     /* SINGLE-THREADED */
     void shutdown(scanner_params &sp);
 };
@@ -2,12 +2,128 @@
  * scan_xor: optimistically search for features trivially obfuscated with xor
  * author:   Michael Shick <mfshick@nps.edu>
  * created:  2013-03-18
+ *
+ * Every mask in xor_masks is tried in one pass: the buffer is searched once for the signatures
+ * below XORed with each mask, and only the windows around the hits are deobfuscated and recursed.
+ * -S xor_full=1 deobfuscates the whole buffer for every mask instead.
  */
 #include "config.h"
+
+#include <algorithm>
+#include <bitset>
+
 #include "be13_api/scanner_params.h"
 #include "be13_api/utils.h"
+#include "byte_map.h"
+#include "forensic_path.h"
+#include "memory_governor.h"
+
+static int         xor_mask   = 255;    // the single mask of earlier versions, used if xor_masks is empty
+static std::string xor_masks  = "";     // comma-separated masks, in decimal or 0x hex
+static bool        xor_full   = false;
+static uint32_t    xor_window = 4096;   // bytes deobfuscated on either side of a signature
+
+/* Byte sequences that the recursive scanners start from. XORed, they are rarely found by chance. */
+static const std::vector<std::string> xor_signatures = {
+    "http:", "https:", "HTTP/", "www.", "WWW.", ".com", ".org", ".net", ".edu", ".gov",
+    "From:", "To: ", "Subject:", "mailto:", "<?xml", "<html", "<HTML", "%PDF-",
+    std::string("PK\x03\x04", 4), std::string("\x1f\x8b\x08", 3), std::string("\xff\xd8\xff", 3),
+    "This program", "SQLite format", "BEGIN:VCARD", "password", "Password",
+};
+
+namespace {
+    std::vector<uint8_t> masks {};
+
+    /* A signature XORed with a mask, indexed by its first two bytes */
+    struct xored_signature {
+        std::string bytes;
+        size_t mask;                    // index in masks
+    };
+    std::vector<xored_signature> signatures {};
+    std::vector<std::vector<uint16_t>> by_prefix(65536);
+    std::bitset<65536> prefixes {};
+
+    void parse_masks() {
+        masks.clear();
+        signatures.clear();
+        for (auto &it : by_prefix) it.clear();
+        prefixes.reset();
+        if (xor_masks.empty()) {
+            if (xor_mask<0 || xor_mask>255){
+                throw std::runtime_error("invalid xor_mask");
+            }
+            masks.push_back(xor_mask);
+        }
+        for (const auto &it : split(xor_masks, ',')) {
+            if (it.empty()) continue;
+            size_t end = 0;
+            unsigned long m = std::stoul(it, &end, 0); // throws std::invalid_argument
+            if (end != it.size() || m > 255) {
+                throw std::runtime_error("invalid mask in xor_masks: " + it);
+            }
+            masks.push_back(m);
+        }
+        masks.erase(std::remove(masks.begin(), masks.end(), 0), masks.end()); // XOR 0 would do nothing
+        std::sort(masks.begin(), masks.end());
+        masks.erase(std::unique(masks.begin(), masks.end()), masks.end());
+
+        for (size_t m = 0; m < masks.size(); m++) {
+            for (const auto &sig : xor_signatures) {
+                std::string x(sig);
+                for (auto &ch : x) ch ^= masks[m];
+                const uint16_t prefix = uint8_t(x[0]) | (uint8_t(x[1]) << 8);
+                by_prefix[prefix].push_back(signatures.size());
+                prefixes.set(prefix);
+                signatures.push_back(xored_signature{x, m});
+            }
+        }
+    }
+
+    /* The windows [start, end) of buf around signature hits that start in the page, for each mask; merged */
+    std::vector<std::vector<std::pair<size_t, size_t>>> find_windows(const sbuf_t &sbuf) {
+        std::vector<std::vector<std::pair<size_t, size_t>>> windows(masks.size());
+        const uint8_t *buf = sbuf.get_buf();
+        const size_t limit = std::min(sbuf.pagesize, sbuf.bufsize > 0 ? sbuf.bufsize - 1 : 0);
+        for (size_t i = 0; i < limit; i++) {
+            const uint16_t prefix = buf[i] | (buf[i+1] << 8);
+            if (!prefixes.test(prefix)) continue;
+            for (uint16_t s : by_prefix[prefix]) {
+                const auto &sig = signatures[s];
+                if (i + sig.bytes.size() > sbuf.bufsize ||
+                    memcmp(buf + i, sig.bytes.data(), sig.bytes.size()) != 0) continue;
+                const size_t start = i > xor_window ? i - xor_window : 0;
+                const size_t end   = std::min(sbuf.bufsize, i + sig.bytes.size() + xor_window);
+                auto &w = windows[sig.mask];
+                if (!w.empty() && start <= w.back().second) {
+                    w.back().second = std::max(w.back().second, end);
+                } else {
+                    w.emplace_back(start, end);
+                }
+            }
+        }
+        return windows;
+    }
+
+    /* Deobfuscate buf[start, end) with mask and recurse */
+    void recurse_xor(scanner_params &sp, uint8_t mask, size_t start, size_t end) {
+	const sbuf_t &sbuf = (*sp.sbuf);
+        std::stringstream ss;
+        ss << "XOR(" << uint32_t(mask) << ")";
+        const pos0_t pos0_xor = (sbuf.pos0 + start) + ss.str();
+        const size_t len      = end - start;
+        const size_t pagesize = std::min(len, sbuf.pagesize > start ? sbuf.pagesize - start : 0);
+
+        memory_governor::wait_for_budget(len, sbuf.depth() + 1);
+        // managed_malloc throws an exception if allocation fails.
+        auto *dbuf = sbuf_t::sbuf_malloc(pos0_xor, len, pagesize);
+        assert( dbuf!= nullptr);
+        assert( sbuf.depth() +1 == dbuf->depth());
+
+        byte_map_xor(sbuf.get_buf() + start, static_cast<uint8_t *>(dbuf->malloc_buf()), len, mask);
+        sp.recurse(dbuf);
+    }
+}
 
-static int xor_mask = 255;
 extern "C"
 void scan_xor(scanner_params &sp)
 {
@@ -20,50 +136,42 @@ void scan_xor(scanner_params &sp)
         sp.info->scanner_flags.recurse = true;
         sp.info->scanner_flags.recurse_always = true;
         sp.get_scanner_config("xor_mask",&xor_mask,"XOR mask value, in decimal");
-        if (xor_mask<0 || xor_mask>255){
-            throw std::runtime_error("invalid xor_mask");
-        }
+        sp.get_scanner_config("xor_masks",&xor_masks,"Comma-separated XOR masks to try in one pass, such as 0xff,0x99,0x35 (overrides xor_mask)");
+        sp.get_scanner_config("xor_full",&xor_full,"Deobfuscate whole buffers, not just the windows around signatures");
+        sp.get_scanner_config("xor_window",&xor_window,"Bytes deobfuscated on either side of a signature");
+        parse_masks();
 	return;
     }
     if (sp.phase==scanner_params::PHASE_SCAN) {
 	const sbuf_t &sbuf = (*sp.sbuf);
 	const pos0_t &pos0 = sbuf.pos0;
 
-        if (xor_mask == 0x00){           // this would do nothing
+        if (masks.empty()){              // every mask was 0, which would do nothing
             return;
         }
 
         // dodge infinite recursion by refusing to operate on an XOR'd buffer
-        if (pos0.lastAddedPart() == "XOR" ) {
+        const forensic_path::ancestors ancestors = forensic_path::ancestors_of(pos0);
+        if (ancestors[0].substr(0, 3) == "XOR" ) {
             return;
         }
 
         // dodge running after unzip after self
-        std::vector<std::string> parts = split(pos0.str(),'-');
-        if (parts.size()>4){
-            std::string parent = parts.at(parts.size()-2);
-            std::string grandp = parts.at(parts.size()-4);
-            if (parent.find("ZIP") != std::string::npos && grandp == "XOR"){
-                return;
-            }
+        if (ancestors[0].find("ZIP") != std::string_view::npos && ancestors[1].substr(0, 3) == "XOR"){
+            return;
         }
 
-        std::stringstream ss;
-        ss << "XOR(" << uint32_t(xor_mask) << ")";
-        const pos0_t pos0_xor = pos0 + ss.str();
-
-        // managed_malloc throws an exception if allocation fails.
-        auto *dbuf = sbuf_t::sbuf_malloc(pos0_xor, sbuf.bufsize, sbuf.pagesize);
-        assert( dbuf!= nullptr);
-        if (sbuf.depth()+1 != dbuf->depth()) {
-            std::cerr << "sbuf: " << sbuf << "\n";
-            std::cerr << "dbuf: " << *dbuf << "\n";
+        if (xor_full) {
+            for (uint8_t mask : masks) {
+                recurse_xor(sp, mask, 0, sbuf.bufsize);
+            }
+            return;
         }
-        assert( sbuf.depth() +1 == dbuf->depth());
-
-        for(size_t ii = 0; ii < sbuf.bufsize; ii++) {
-            dbuf->wbuf(ii, sbuf[ii] ^ xor_mask);
+        auto windows = find_windows(sbuf);
+        for (size_t m = 0; m < masks.size(); m++) {
+            for (const auto &w : windows[m]) {
+                recurse_xor(sp, masks[m], w.first, w.second);
+            }
         }
-        sp.recurse(dbuf);
     }
 }
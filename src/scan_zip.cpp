@@ -1,23 +1,34 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <string>
 #include <iostream>
 #include <iomanip>
 #include <cassert>
+#include <thread>
+#include <vector>
 
 
 #include "config.h"
+#include "content_cache.h"
+#include "recorder_handle.h"
 #include "sbuf_decompress.h"
+#include "sbuf_span.h"
 #include "be13_api/scanner_params.h"
+#include "carve_index.h"
 #include "dfxml_cpp/src/dfxml_writer.h"
-#include "utf8.h"
+#include "scan_zip.h"
+#include "utf8_text.h"
 
 
-static const std::string  ZIP_RECORDER_NAME {"zip"};
+static recorder_handle zip_file {"zip"};
 
 // these are not tunable
 static uint32_t  zip_max_uncompr_size = 256*1024*1024; // don't decompress objects larger than this
 static uint32_t  zip_min_uncompr_size = 6;	// don't bother with objects smaller than this
 static uint32_t  zip_name_len_max = 1024;
+static uint32_t  zip_threads = 1;       // decompress the central directory's members on this many threads
+static uint64_t  zip_batch_bytes = 256*1024*1024; // decompressed at a time by zip_threads
 
 /* These are to eliminate compiler warnings */
 #define ZLIB_CONST
@@ -29,15 +40,6 @@ static uint32_t  zip_name_len_max = 1024;
 #endif
 #include <zlib.h>
 
-bool has_control_characters(const std::string &name)
-{
-    for(std::string::const_iterator it = name.begin();it!=name.end();it++){
-	unsigned char ch = *it;
-	if (ch<' ') return true;
-    }
-    return false;
-}
-
 /* We should have a threadsafe set */
 
 /**
@@ -47,38 +49,57 @@ bool has_control_characters(const std::string &name)
 #include "tsk3_fatdirs.h"
 
 const uint32_t   MIN_ZIP_SIZE = 38;     // minimum size of a zip header and file name
+const uint32_t   CD_ENTRY_SIZE = 46;    // of a central directory entry before its name
+const uint32_t   EOCD_SIZE = 22;        // of the end of central directory record before its comment
+static const uint8_t EOCD_SIGNATURE[4] {0x50, 0x4B, 0x05, 0x06};
+
+/* A local file header that passed the validity tests, and what is needed to decompress it */
+struct zip_component {
+    size_t      pos {0};
+    uint16_t    version_needed_to_extract {0};
+    uint32_t    uncompr_size {0};       // the most to decompress
+    size_t      header_size {0};        // how far past 'pos' that the decompress starts
+    std::string name {};                // escaped
+    std::string mtime {};
+    std::string zipinfo {};             // the feature's context, up to the disposition
+};
+
+static bool is_local_header(const sbuf_t &sbuf, size_t pos)
+{
+    return sbuf[pos]==0x50 && sbuf[pos+1]==0x4B && sbuf[pos+2]==0x03 && sbuf[pos+3]==0x04;
+}
+
 /**
  * given a location in an sbuf, determine if it contains a zip component.
- * If it does and if it passes validity tests, unzip and recurse.
+ * Returns true if it passes validity tests.
  */
-inline void scan_zip_component(scanner_params &sp, feature_recorder &zip_recorder, size_t pos)
+static bool parse_zip_component(const sbuf_t &sbuf, size_t pos, zip_component &zc)
 {
-
-    const sbuf_t &sbuf = (*sp.sbuf);
-    const pos0_t &pos0 = sbuf.pos0;
-
     /* Local file header */
-    uint16_t version_needed_to_extract= sbuf.get16u(pos+4);
-    uint16_t general_purpose_bit_flag = sbuf.get16u(pos+6);
-    uint16_t compression_method=sbuf.get16u(pos+8);
-    uint16_t lastmodtime=sbuf.get16u(pos+10);
-    uint16_t lastmoddate=sbuf.get16u(pos+12);
-    uint32_t crc32=sbuf.get32u(pos+14);	        /* not used needed */
-    uint32_t compr_size=sbuf.get32u(pos+18);
-    uint32_t uncompr_size=sbuf.get32u(pos+22);
-    uint16_t name_len=sbuf.get16u(pos+26);
-    uint16_t extra_field_len=sbuf.get16u(pos+28);
-
-    if ((name_len<=0) || (name_len > zip_name_len_max)) return;	 // unreasonable name length
-    if (pos+30+name_len > sbuf.bufsize) return;                  // name is bigger than what's left
+    const sbuf_span_le header(sbuf, pos, 30);
+    if (!header) return false;
+    uint16_t version_needed_to_extract= header.get16u(4);
+    uint16_t general_purpose_bit_flag = header.get16u(6);
+    uint16_t compression_method=header.get16u(8);
+    uint16_t lastmodtime=header.get16u(10);
+    uint16_t lastmoddate=header.get16u(12);
+    uint32_t crc32=header.get32u(14);	        /* not used needed */
+    uint32_t compr_size=header.get32u(18);
+    uint32_t uncompr_size=header.get32u(22);
+    uint16_t name_len=header.get16u(26);
+    uint16_t extra_field_len=header.get16u(28);
+
+    if ((name_len<=0) || (name_len > zip_name_len_max)) return false;	 // unreasonable name length
+    if (pos+30+name_len > sbuf.bufsize) return false;                  // name is bigger than what's left
 
     std::string name = sbuf.substr(pos+30,name_len);
     /* scan for unprintable characters, which means this isn't a validate zip header
      * Name may contain UTF-8
      */
-    if (utf8::find_invalid(name.begin(),name.end()) != name.end()) return; // invalid utf8 in name; not valid zip header
-    if (has_control_characters(name)) return; // no control characters allowed in name.
-    name=dfxml_writer::xmlescape(name);     // make sure it is escaped
+    const unsigned flags = utf8_text::classify(name);
+    if ((flags & utf8_text::NON_ASCII) && !utf8_text::valid(name)) return false; // invalid utf8 in name; not valid zip header
+    if (flags & utf8_text::CONTROL) return false; // no control characters allowed in name.
+    if (flags & utf8_text::XML_SPECIAL) name=dfxml_writer::xmlescape(name);     // make sure it is escaped
 
     if (name.size()==0) name="<NONAME>";    // If no name is provided, use this
 
@@ -95,61 +116,189 @@ inline void scan_zip_component(scanner_params &sp, feature_recorder &zip_recorde
              general_purpose_bit_flag, compression_method,uncompr_size, compr_size,
              mtime.c_str(),
              crc32, extra_field_len);
-    std::stringstream xmlstream;
-    xmlstream << b2;
 
     /* OpenOffice makes invalid ZIP files with compr_size=0 and uncompr_size=0.
      * If compr_size==uncompr_size==0, then assume it may go to the end of the sbuf.
      */
     if (uncompr_size==0 && compr_size==0){
         uncompr_size = zip_max_uncompr_size;
-        compr_size   = zip_max_uncompr_size;
     }
 
     if (uncompr_size > zip_max_uncompr_size){
         uncompr_size = zip_max_uncompr_size; // don't uncompress bigger than 16MB
     }
 
+    zc.pos = pos;
+    zc.version_needed_to_extract = version_needed_to_extract;
+    zc.uncompr_size = uncompr_size;
+    zc.header_size = 30+name_len+extra_field_len;
+    zc.name = name;
+    zc.mtime = mtime;
+    zc.zipinfo = b2;
+    return true;
+}
+
+/* Returns true if the component is to be decompressed. If it is not but is about to be, records why. */
+static bool zip_should_decompress(scanner_params &sp, feature_recorder &zip_recorder, const zip_component &zc)
+{
     /* See if we can decompress */
-    if (version_needed_to_extract==20 && uncompr_size>=zip_min_uncompr_size){
-        // Create an sbuf that contains the source data pointed to by the header that is to be decompressed
-        size_t header_size = 30+name_len+extra_field_len; // how far past 'pos' that the decompress starts
-        const sbuf_t sbuf_src(sbuf, pos+header_size);
-
-        // If there is no data, then just indicate this and return.
-        if (sbuf_src.pagesize==0){
-            xmlstream << "<disposition>end-of-buffer</disposition></zipinfo>";
-            zip_recorder.write(pos0+pos,name,xmlstream.str());
-            return;
+    if (zc.version_needed_to_extract!=20 || zc.uncompr_size<zip_min_uncompr_size) return false;
+
+    // Create an sbuf that contains the source data pointed to by the header that is to be decompressed
+    const sbuf_t &sbuf = (*sp.sbuf);
+    const sbuf_t sbuf_src(sbuf, zc.pos+zc.header_size);
+
+    // If there is no data, then just indicate this and return.
+    if (sbuf_src.pagesize==0){
+        zip_recorder.write(sbuf.pos0+zc.pos,zc.name,zc.zipinfo+"<disposition>end-of-buffer</disposition></zipinfo>");
+        return false;
+    }
+
+    /* If depth is more than 0, don't decompress if we have seen this component before */
+    if (sbuf_src.depth() > 0){
+        if (sp.check_previously_processed(sbuf_src)){
+            zip_recorder.write(sbuf.pos0+zc.pos,zc.name,zc.zipinfo+"<disposition>previously-processed</disposition></zipinfo>");
+            return false;
         }
+    }
+    return true;
+}
+
+static sbuf_t *zip_decompress(const sbuf_t &sbuf, const zip_component &zc)
+{
+    const sbuf_t sbuf_src(sbuf, zc.pos+zc.header_size);
+    return sbuf_decompress::sbuf_new_decompress(sbuf_src, zc.uncompr_size, "ZIP", sbuf_decompress::mode_t::ZIP, zc.header_size);
+}
+
+/* Records the outcome of decompressing a component, then carves and recurses into it */
+static void zip_recurse(scanner_params &sp, feature_recorder &zip_recorder, const zip_component &zc, sbuf_t *decomp)
+{
+    const pos0_t &pos0 = sp.sbuf->pos0;
+    if (decomp!=nullptr) {
+        std::stringstream xmlstream;
+        xmlstream << zc.zipinfo << "<disposition bytes='" << decomp->bufsize << "'>decompressed</disposition></zipinfo>";
+        zip_recorder.write(pos0+zc.pos,zc.name,xmlstream.str());
 
-        /* If depth is more than 0, don't decompress if we have seen this component before */
-        if (sbuf_src.depth() > 0){
-            if (sp.check_previously_processed(sbuf_src)){
-                xmlstream << "<disposition>previously-processed</disposition></zipinfo>";
-                zip_recorder.write(pos0+pos,name,xmlstream.str());
-                return;
+        std::string carve_name("_"); // begin with a _
+        for(auto const &it : zc.name ){
+            carve_name.push_back((it=='/' || it=='\\') ? '_' : it);
+        }
+        carve_index::carve(zip_recorder, *decomp, carve_name, zc.mtime);
+
+        // recurse. Remember that recurse will free the sbuf
+        content_cache::recurse(sp, decomp);
+    } else {
+        zip_recorder.write(pos0+zc.pos,zc.name,zc.zipinfo+"<disposition>decompress-failed</disposition></zipinfo>");
+    }
+}
+
+/**
+ * given a location in an sbuf, determine if it contains a zip component.
+ * If it does and if it passes validity tests, unzip and recurse.
+ */
+inline void scan_zip_component(scanner_params &sp, feature_recorder &zip_recorder, size_t pos)
+{
+    zip_component zc;
+    if (!parse_zip_component(*sp.sbuf, pos, zc)) return;
+    if (!zip_should_decompress(sp, zip_recorder, zc)) return;
+    zip_recurse(sp, zip_recorder, zc, zip_decompress(*sp.sbuf, zc));
+}
+
+std::vector<zip_cd_entry> zip_central_directory(const sbuf_t &sbuf)
+{
+    std::vector<zip_cd_entry> ret;
+    for (size_t start = 0; start + EOCD_SIZE <= sbuf.bufsize; ) {
+        ssize_t found = sbuf.findbin(EOCD_SIGNATURE, sizeof(EOCD_SIGNATURE), start);
+        if (found == -1 || size_t(found) + EOCD_SIZE > sbuf.bufsize) break;
+        const size_t eocd = found;
+        start = eocd + 1;
+
+        /* a single-disk archive whose central directory ends at the end record */
+        const sbuf_span_le end_record(sbuf, eocd, EOCD_SIZE);
+        if (end_record.get16u(4) != 0 || end_record.get16u(6) != 0) continue;
+        const uint16_t entries   = end_record.get16u(10);
+        const uint32_t cd_size   = end_record.get32u(12);
+        const uint32_t cd_offset = end_record.get32u(16);
+        if (cd_size > eocd || cd_offset > eocd - cd_size) continue;
+        const size_t base = eocd - cd_size - cd_offset; // where the archive starts
+
+        size_t p = eocd - cd_size;
+        for (uint16_t k = 0; k < entries && p + CD_ENTRY_SIZE <= eocd; k++) {
+            const sbuf_span_le entry(sbuf, p, CD_ENTRY_SIZE);
+            if (!entry.equals(0, "PK\x01\x02", 4)) break;
+            const size_t local = base + entry.get32u(42);
+            if (local + MIN_ZIP_SIZE <= sbuf.bufsize && is_local_header(sbuf, local)) {
+                ret.push_back(zip_cd_entry{local, entry.get32u(24)});
             }
+            p += CD_ENTRY_SIZE + entry.get16u(28) + entry.get16u(30) + entry.get16u(32);
         }
+    }
+    std::sort(ret.begin(), ret.end(), [](const zip_cd_entry &a, const zip_cd_entry &b) {
+        return a.local_header < b.local_header;
+    });
+    ret.erase(std::unique(ret.begin(), ret.end(), [](const zip_cd_entry &a, const zip_cd_entry &b) {
+        return a.local_header == b.local_header;
+    }), ret.end());
+    return ret;
+}
 
-        auto *decomp = sbuf_decompress::sbuf_new_decompress(sbuf_src, uncompr_size, "ZIP", sbuf_decompress::mode_t::ZIP, header_size);
-        if (decomp!=nullptr) {
-            xmlstream << "<disposition bytes='" << decomp->bufsize << "'>decompressed</disposition></zipinfo>";
-            zip_recorder.write(pos0+pos,name,xmlstream.str());
+/* Decompresses the members of the central directories in batches of about zip_batch_bytes,
+ * each on zip_threads threads, and recurses into them in order. Returns the local headers done.
+ */
+static std::vector<size_t> scan_zip_members(scanner_params &sp, feature_recorder &zip_recorder)
+{
+    const sbuf_t &sbuf = (*sp.sbuf);
+    std::vector<zip_component> members;
+    std::vector<uint64_t> estimates;    // of the decompressed size
+    std::vector<size_t> done;
+    for (const auto &it : zip_central_directory(sbuf)) {
+        /* the ones that the scan of the page would find */
+        if (it.local_header >= sbuf.pagesize || it.local_header >= sbuf.bufsize-MIN_ZIP_SIZE) break;
+        done.push_back(it.local_header);
+        zip_component zc;
+        if (!parse_zip_component(sbuf, it.local_header, zc)) continue;
+        members.push_back(zc);
+        estimates.push_back(std::min(zc.uncompr_size, std::max(it.uncompr_size, zip_min_uncompr_size)));
+    }
 
-            std::string carve_name("_"); // begin with a _
-            for(auto const &it : name ){
-                carve_name.push_back((it=='/' || it=='\\') ? '_' : it);
+    const size_t cores = zip_threads ? zip_threads : std::max(std::thread::hardware_concurrency(), 1U);
+    for (size_t first = 0; first < members.size(); ) {
+        std::vector<size_t> batch;
+        uint64_t bytes = 0;
+        size_t last = first;
+        for (; last < members.size() && (batch.empty() || bytes + estimates[last] <= zip_batch_bytes); last++) {
+            if (zip_should_decompress(sp, zip_recorder, members[last])) {
+                batch.push_back(last);
+                bytes += estimates[last];
             }
-            zip_recorder.carve(*decomp, carve_name, mtime);
+        }
 
-            // recurse. Remember that recurse will free the sbuf
-            sp.recurse( decomp );
-        } else {
-            xmlstream << "<disposition>decompress-failed</disposition></zipinfo>";
-            zip_recorder.write(pos0+pos,name,xmlstream.str());
+        std::vector<sbuf_t *> decomp(batch.size(), nullptr);
+        std::atomic<size_t> next {0};
+        auto worker = [&sbuf, &members, &batch, &decomp, &next]() {
+            for (size_t j; (j = next++) < batch.size(); ) {
+                try {
+                    decomp[j] = zip_decompress(sbuf, members[batch[j]]);
+                }
+                catch (const std::exception &) {
+                    decomp[j] = nullptr; // recorded as decompress-failed
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < std::min(cores, batch.size()); t++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &t : threads) {
+            t.join();
+        }
+        for (size_t j = 0; j < batch.size(); j++) {
+            zip_recurse(sp, zip_recorder, members[batch[j]], decomp[j]);
         }
+        first = last;
     }
+    return done;
 }
 
 extern "C"
@@ -163,23 +312,38 @@ void scan_zip(scanner_params &sp)
         flags.carve = true;
         sp.info->set_name("zip" );
         sp.info->scanner_flags.recurse = true;
-	sp.info->feature_defs.push_back( feature_recorder_def(ZIP_RECORDER_NAME, flags ));
+	sp.info->feature_defs.push_back( zip_file.def(flags));
         sp.get_scanner_config("zip_min_uncompr_size",&zip_min_uncompr_size,"Minimum size of a ZIP uncompressed object");
         sp.get_scanner_config("zip_max_uncompr_size",&zip_max_uncompr_size,"Maximum size of a ZIP uncompressed object");
         sp.get_scanner_config("zip_name_len_max",&zip_name_len_max,"Maximum name of a ZIP component filename");
+        sp.get_scanner_config("zip_threads",&zip_threads,"Threads to decompress the members of a ZIP central directory in parallel (0 for the number of cores, 1 to decompress each component as it is found)");
+        sp.get_scanner_config("zip_batch_bytes",&zip_batch_bytes,"Most ZIP members decompressed at a time by zip_threads");
 	return;
     }
 
+    if (sp.phase==scanner_params::PHASE_INIT2){
+        zip_file.resolve(sp);
+    }
+
     if (sp.phase==scanner_params::PHASE_SCAN){
 	const sbuf_t &sbuf = (*sp.sbuf);
 
         if (sbuf.bufsize < MIN_ZIP_SIZE) return;
 
-        feature_recorder &zip_recorder   = sp.named_feature_recorder(ZIP_RECORDER_NAME);
+        feature_recorder &zip_recorder   = *zip_file;
+
+        /* the members of a central directory are done together; the other components are fragments */
+        std::vector<size_t> members;
+        if (zip_threads != 1) members = scan_zip_members(sp, zip_recorder);
+        auto member = members.begin();
 
 	for(size_t i=0 ; i < sbuf.pagesize && i < sbuf.bufsize-MIN_ZIP_SIZE; i++){
 	    /** Look for signature for beginning of a ZIP component. */
-	    if (sbuf[i]==0x50 && sbuf[i+1]==0x4B && sbuf[i+2]==0x03 && sbuf[i+3]==0x04){
+	    if (is_local_header(sbuf, i)){
+                if (member != members.end() && *member == i) {
+                    ++member;
+                    continue;
+                }
                 scan_zip_component(sp, zip_recorder, i);
 	    }
 	}
@@ -0,0 +1,22 @@
+#ifndef SCAN_ZIP_H
+#define SCAN_ZIP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "be13_api/sbuf.h"
+
+/* A member listed by a ZIP file's central directory */
+struct zip_cd_entry {
+    size_t   local_header {0};          // offset of its local file header in the sbuf
+    uint32_t uncompr_size {0};          // as the central directory gives it
+};
+
+/* The members of the central directories whose end records are in sbuf and whose local headers
+ * are there too, in order of local header and without duplicates. Each end record is taken to be
+ * that of a single-disk archive wholly in the sbuf, so that the directory's offset is from the
+ * start of the archive.
+ */
+std::vector<zip_cd_entry> zip_central_directory(const sbuf_t &sbuf);
+#endif
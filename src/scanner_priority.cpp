@@ -0,0 +1,182 @@
+#include "config.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "scanner_priority.h"
+
+namespace {
+    struct gate {
+        std::mutex M {};
+        std::condition_variable cv {};
+        std::atomic<unsigned> limit {0};
+        unsigned running {0};
+        uint64_t tickets {0};
+        std::set<std::pair<size_t, uint64_t>> waiting {}; // by bytes, then by arrival
+        std::atomic<uint64_t> waits {0};
+        std::atomic<uint64_t> wait_ns {0};
+    };
+    /* one for each class, and one for every call (worker_tuner's active threads) */
+    const size_t ALL = scanner_priority::CLASSES;
+    gate gates[scanner_priority::CLASSES + 1];
+
+    /* Waits for a place in g; the waiting calls are let in smallest first */
+    /* 0 lifts the cap, and lets in the calls that wait */
+    bool has_room(const gate &g) { return g.limit == 0 || g.running < g.limit; }
+
+    void enter(gate &g, size_t bytes) {
+        std::unique_lock<std::mutex> lock(g.M);
+        if (has_room(g) && g.waiting.empty()) {
+            g.running++;
+            return;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const auto me = std::make_pair(bytes, g.tickets++);
+        g.waiting.insert(me);
+        g.cv.wait(lock, [&g, &me]() { return has_room(g) && *g.waiting.begin() == me; });
+        g.waiting.erase(me);
+        g.running++;
+        if (has_room(g) && !g.waiting.empty()) g.cv.notify_all();  // the next smallest may fit too
+        g.waits++;
+        g.wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void leave(gate &g) {
+        std::lock_guard<std::mutex> lock(g.M);
+        g.running--;
+        if (!g.waiting.empty()) g.cv.notify_all();
+    }
+
+    std::map<std::string, scanner_priority::class_t> &declared() {
+        static std::map<std::string, scanner_priority::class_t> classes;
+        return classes;
+    }
+
+    /* the slots this thread holds; the calls recursion makes inside one do not wait, for a
+     * thread of one class waiting for another while the other waits for it would never finish */
+    thread_local unsigned held_slots {0};
+
+    /* NAME:VALUE,... as pairs */
+    std::map<std::string, std::string> pairs_of(const std::string &spec) {
+        std::map<std::string, std::string> ret;
+        std::stringstream ss(spec);
+        for (std::string item; std::getline(ss, item, ',');) {
+            if (item.empty()) continue;
+            const size_t colon = item.find(':');
+            if (colon == std::string::npos) throw std::invalid_argument("scanner_priority: no ':' in " + item);
+            ret[item.substr(0, colon)] = item.substr(colon + 1);
+        }
+        return ret;
+    }
+}
+
+const char *scanner_priority::name(class_t c)
+{
+    switch (c) {
+    case CHEAP: return "cheap";
+    case NORMAL: return "normal";
+    case EXPENSIVE: return "expensive";
+    default: return "unknown";
+    }
+}
+
+scanner_priority::class_t scanner_priority::parse_class(const std::string &name)
+{
+    for (int c = 0; c < CLASSES; c++) {
+        if (name == scanner_priority::name(class_t(c))) return class_t(c);
+    }
+    throw std::invalid_argument("scanner_priority: unknown class " + name);
+}
+
+scanner_priority::class_t scanner_priority::class_of(const std::string &scanner)
+{
+    static const std::map<std::string, class_t> table {
+        {"exif", EXPENSIVE}, {"exiv2", EXPENSIVE}, {"hiberfile", EXPENSIVE}, {"outlook", EXPENSIVE},
+        {"rar", EXPENSIVE}, {"xor", EXPENSIVE},
+        {"accts", CHEAP}, {"email", CHEAP}, {"facebook", CHEAP}, {"gps", CHEAP}, {"httplogs", CHEAP},
+        {"json", CHEAP}, {"kml", CHEAP}, {"vcard", CHEAP},
+        {"accts_lg", CHEAP}, {"email_lg", CHEAP}, {"gps_lg", CHEAP},
+    };
+    auto it = declared().find(scanner);
+    if (it != declared().end()) return it->second;
+    auto jt = table.find(scanner);
+    return jt == table.end() ? NORMAL : jt->second;
+}
+
+void scanner_priority::set_classes(const std::string &classes)
+{
+    for (const auto &[scanner, cls] : pairs_of(classes)) declared()[scanner] = parse_class(cls);
+}
+
+void scanner_priority::set_threads(const std::string &class_threads)
+{
+    for (const auto &[cls, count] : pairs_of(class_threads)) {
+        size_t end = 0;
+        unsigned long n = 0;
+        try {
+            n = std::stoul(count, &end);
+        } catch (const std::exception &) {
+            end = 0;
+        }
+        if (count.empty() || end != count.size()) throw std::invalid_argument("scanner_priority: bad count " + count);
+        gates[parse_class(cls)].limit = n;
+    }
+}
+
+void scanner_priority::set_active_threads(unsigned n)
+{
+    gate &g = gates[ALL];
+    std::lock_guard<std::mutex> lock(g.M);
+    g.limit = n;
+    g.cv.notify_all();                  // the limit may have gone up
+}
+
+unsigned scanner_priority::active_threads()
+{
+    return gates[ALL].limit;
+}
+
+unsigned scanner_priority::threads(class_t c)
+{
+    return gates[c].limit;
+}
+
+uint64_t scanner_priority::waits(class_t c)
+{
+    return gates[c].waits;
+}
+
+double scanner_priority::wait_seconds(class_t c)
+{
+    return gates[c].wait_ns / 1e9;
+}
+
+scanner_priority::slot::slot(class_t c, const scanner_params &sp): cls(c)
+{
+    if (sp.phase != scanner_params::PHASE_SCAN || sp.sbuf == nullptr) return;
+    if (gates[ALL].limit == 0 && gates[cls].limit == 0) return;
+    held = true;
+    if (held_slots++ > 0) return;       // inside a call that has a slot
+    if (gates[ALL].limit) {
+        enter(gates[ALL], sp.sbuf->bufsize);
+        entered_all = true;
+    }
+    if (gates[cls].limit) {
+        enter(gates[cls], sp.sbuf->bufsize);
+        entered_class = true;
+    }
+}
+
+scanner_priority::slot::~slot()
+{
+    if (!held) return;
+    if (--held_slots > 0) return;
+    if (entered_class) leave(gates[cls]);
+    if (entered_all) leave(gates[ALL]);
+}
@@ -0,0 +1,70 @@
+#ifndef SCANNER_PRIORITY_H
+#define SCANNER_PRIORITY_H
+
+#include <cstdint>
+#include <string>
+
+#include "be13_api/scanner_params.h"
+
+/**
+ * scanner_priority:
+ * Classes of scanners by how long their calls take, with a cap on the worker threads in each class,
+ * so that the cheap scanners (email, accts, gps) are not kept from the threads by long calls of the
+ * expensive ones (outlook, xor, exif, hiberfile, rar), and the pages queued behind those calls do
+ * not pile up in memory.
+ *
+ * The class of each built-in scanner is in a table, as content_affinity's accepts() is; plug-ins and
+ * changes are declared with -S scanner_classes=NAME:CLASS,... (cheap, normal or expensive), and the
+ * caps with -S scanner_class_threads=expensive:2,normal:6. A class without a cap is not limited.
+ * Both are set before the scanners are loaded.
+ *
+ * The wrappers in bulk_extractor_scanners.cpp take a slot for each PHASE_SCAN call. When its class
+ * is full, the worker waits, and the waiting calls are let in smallest sbuf first, so the short jobs
+ * go ahead of the long ones. A call made by recursion inside a call that holds a slot does not wait,
+ * as its parent would be waiting on itself (or on a thread that waits for the parent's class). The
+ * scheduling of the sbufs between the workers is in be13_api's scanner_set; this limits the calls
+ * within it.
+ *
+ * There is also a cap on the threads in any scanner call, which worker_tuner moves while the job
+ * runs; a worker over it waits before its next call as it would for a class.
+ */
+
+class scanner_priority {
+public:
+    enum class_t { CHEAP = 0, NORMAL, EXPENSIVE, CLASSES };
+
+    static const char *name(class_t c);
+    static class_t class_of(const std::string &scanner);
+
+    /* Throws std::invalid_argument on a class or count it cannot read */
+    static void set_classes(const std::string &classes);            // NAME:CLASS,...
+    static void set_threads(const std::string &class_threads);      // CLASS:N,...
+
+    /* The cap on the threads in any scanner call (0 for none); may be changed while they run */
+    static void set_active_threads(unsigned n);
+    static unsigned active_threads();
+
+    /* The cap of each class (0 for none), and the calls that waited for a slot */
+    static unsigned threads(class_t c);
+    static uint64_t waits(class_t c);
+    static double wait_seconds(class_t c);
+
+    /* A worker's place in a class, for one scanner call */
+    class slot {
+    public:
+        slot(class_t c, const scanner_params &sp);
+        ~slot();
+        slot(const slot &) = delete;
+        slot &operator=(const slot &) = delete;
+    private:
+        class_t cls;
+        bool held {false};
+        bool entered_all {false};
+        bool entered_class {false};
+    };
+
+private:
+    static class_t parse_class(const std::string &name);
+};
+
+#endif
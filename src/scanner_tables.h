@@ -0,0 +1,162 @@
+#ifndef SCANNER_TABLES_H
+#define SCANNER_TABLES_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * scanner_tables:
+ * Lookup tables used by the scanners, generated at compile time.
+ *
+ * They used to be built at PHASE_INIT by each scanner. As constexpr data they cost nothing at
+ * startup, live in read-only memory shared by every bulk_extractor process, and are ready
+ * before any scanner runs, so the scanners' functions no longer need an initialization call.
+ */
+
+namespace scanner_tables {
+
+/* AES (scan_aes) */
+
+/* 8 bit x 8 bit multiplication in GF(2^8) */
+constexpr uint8_t gmul(uint8_t a, uint8_t b)
+{
+    uint8_t p = 0;
+    for (int counter = 0; counter < 8; counter++) {
+        if (b & 1) p ^= a;
+        const bool hi_bit_set = a & 0x80;
+        a <<= 1;
+        if (hi_bit_set) a ^= 0x1b;
+        b >>= 1;
+    }
+    return p;
+}
+
+constexpr uint8_t gmul_inverse(uint8_t in)
+{
+    if (in == 0) return 0;              // 0 is self inverting
+    for (int x = 1; x < 256; x++) {
+        if (gmul(in, x) == 1) return x;
+    }
+    return 0;
+}
+
+constexpr std::array<uint8_t, 256> make_aes_sbox()
+{
+    std::array<uint8_t, 256> t {};
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = gmul_inverse(i), x = s;
+        for (int c = 0; c < 4; c++) {
+            s = (s << 1) | (s >> 7);    // one bit circular rotate to the left
+            x ^= s;
+        }
+        t[i] = x ^ 0x63;
+    }
+    return t;
+}
+
+/* rcon[i] is 2^(i-1) in GF(2^8); rcon[0] is 0 */
+constexpr std::array<uint8_t, 256> make_aes_rcon()
+{
+    std::array<uint8_t, 256> t {};
+    uint8_t c = 1;
+    for (int i = 1; i < 256; i++) {
+        t[i] = c;
+        c = gmul(c, 2);
+    }
+    return t;
+}
+
+inline constexpr std::array<uint8_t, 256> aes_sbox = make_aes_sbox();
+inline constexpr std::array<uint8_t, 256> aes_rcon = make_aes_rcon();
+
+/* base64 (scan_base64): the character classes of each byte; 0 if it is not a base64 character */
+inline constexpr uint8_t B64_LOWERCASE = 1;
+inline constexpr uint8_t B64_UPPERCASE = 2;
+inline constexpr uint8_t B64_NUMBER    = 4;
+inline constexpr uint8_t B64_SYMBOL    = 8;
+
+constexpr std::array<uint8_t, 256> make_base64_classes()
+{
+    std::array<uint8_t, 256> t {};
+    t['+'] = B64_SYMBOL;
+    t['/'] = B64_SYMBOL;
+    t['-'] = B64_SYMBOL;                // RFC 4648
+    t['_'] = B64_SYMBOL;                // RFC 4648
+    for (int ch = 'a'; ch <= 'z'; ch++) t[ch] = B64_LOWERCASE;
+    for (int ch = 'A'; ch <= 'Z'; ch++) t[ch] = B64_UPPERCASE;
+    for (int ch = '0'; ch <= '9'; ch++) t[ch] = B64_NUMBER;
+    return t;
+}
+
+inline constexpr std::array<uint8_t, 256> base64_classes = make_base64_classes();
+
+/* base64 decoding (base64_forensic): the 6-bit value of each character, accepting the RFC 4648
+ * URL-safe '-' and '_' for '+' and '/'; -1 if it is not a base64 character
+ */
+constexpr std::array<int8_t, 256> make_base64_values()
+{
+    std::array<int8_t, 256> t {};
+    for (auto &v : t) v = -1;
+    for (int ch = 'A'; ch <= 'Z'; ch++) t[ch] = ch - 'A';
+    for (int ch = 'a'; ch <= 'z'; ch++) t[ch] = ch - 'a' + 26;
+    for (int ch = '0'; ch <= '9'; ch++) t[ch] = ch - '0' + 52;
+    t['+'] = t['-'] = 62;
+    t['/'] = t['_'] = 63;
+    return t;
+}
+
+inline constexpr std::array<int8_t, 256> base64_values = make_base64_values();
+
+/* base58 (bitcoin addresses in scan_accts): the value of each character; -1 if it is not base58 */
+inline constexpr char base58_chars[] =
+    "123456789"
+    "ABCDEFGHJKLMNPQRSTUVWXYZ"
+    "abcdefghijkmnopqrstuvwxyz";
+
+constexpr std::array<int8_t, 256> make_base58_values()
+{
+    std::array<int8_t, 256> t {};
+    for (auto &v : t) v = -1;
+    for (int i = 0; base58_chars[i]; i++) t[static_cast<uint8_t>(base58_chars[i])] = i;
+    return t;
+}
+
+inline constexpr std::array<int8_t, 256> base58_values = make_base58_values();
+
+/* CRC-32 (polynomial 0xEDB88320, as used by zip, RAR and EVTX), for slicing by 8 (crc32.cpp):
+ * crc32_slices[0] is the byte-at-a-time table, and crc32_slices[k][i] is the CRC of byte i
+ * followed by k zero bytes.
+ */
+constexpr std::array<std::array<uint32_t, 256>, 8> make_crc32_slices()
+{
+    std::array<std::array<uint32_t, 256>, 8> t {};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++) {
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        }
+        t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            t[k][i] = (t[k-1][i] >> 8) ^ t[0][t[k-1][i] & 0xff];
+        }
+    }
+    return t;
+}
+
+inline constexpr std::array<std::array<uint32_t, 256>, 8> crc32_slices = make_crc32_slices();
+
+/* JSON (scan_json): the characters that may follow the '{' or '[' that starts a JSON block */
+constexpr std::array<bool, 256> make_json_second_chars()
+{
+    std::array<bool, 256> t {};
+    for (const char *p = "0123456789.-{[ \t\n\r\""; *p; p++) t[static_cast<uint8_t>(*p)] = true;
+    return t;
+}
+
+inline constexpr std::array<bool, 256> json_second_chars = make_json_second_chars();
+
+}
+
+#endif
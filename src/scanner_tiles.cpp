@@ -0,0 +1,107 @@
+#include "config.h"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "content_affinity.h"
+#include "scanner_tiles.h"
+#include "scanner_watchdog.h"
+
+namespace {
+    struct member {
+        std::string name;
+        scanner_tiles::range_scanner scan;
+        unsigned accepts;
+    };
+    std::set<std::string> requested;
+    std::vector<member> members;        // the requested scanners that are enabled
+
+    /* The sbuf whose group this thread ran last, and whether it is running it now */
+    struct tiled {
+        const sbuf_t *sbuf {nullptr};
+        uint64_t offset {0};
+        size_t bufsize {0};
+        std::string path {};
+        bool running {false};
+        bool is(const sbuf_t &s) const {
+            return sbuf == &s && offset == s.pos0.offset && bufsize == s.bufsize && path == s.pos0.path;
+        }
+    };
+    thread_local tiled last;
+}
+
+bool scanner_tiles::tile_capable(const std::string &name)
+{
+    static const std::set<std::string> capable {"aes", "windirs"};
+    return capable.count(name) > 0;
+}
+
+void scanner_tiles::set_scanners(const std::string &names)
+{
+    std::set<std::string> ret;
+    std::stringstream ss(names);
+    for (std::string name; std::getline(ss, name, ',');) {
+        if (name.empty()) continue;
+        if (!tile_capable(name)) throw std::invalid_argument("scanner_tiles: " + name + " cannot be tiled");
+        ret.insert(name);
+    }
+    requested = ret;
+    members.clear();
+}
+
+void scanner_tiles::set_tile_bytes(size_t bytes)
+{
+    tile_bytes = std::max((bytes + TILE_ALIGN - 1) / TILE_ALIGN, size_t(1)) * TILE_ALIGN;
+}
+
+std::string scanner_tiles::scanners()
+{
+    std::string ret;
+    for (const auto &m : members) ret += (ret.empty() ? "" : ",") + m.name;
+    return ret;
+}
+
+void scanner_tiles::enable(const char *name, range_scanner scan)
+{
+    if (requested.count(name) == 0) return;
+    for (auto &m : members) {
+        if (m.name == name) {           // a scanner set made again
+            m.scan = scan;
+            return;
+        }
+    }
+    members.push_back(member{name, scan, content_affinity::accepts(name)});
+}
+
+bool scanner_tiles::scanned(const char *name, const scanner_params &sp)
+{
+    if (members.size() < 2 || sp.phase != scanner_params::PHASE_SCAN || sp.sbuf == nullptr) return false;
+    const sbuf_t &sbuf = *sp.sbuf;
+    if (sbuf.bufsize < 2 * tile_bytes || sbuf.depth() > 0 || last.running) return false;
+    if (std::none_of(members.begin(), members.end(), [name](const member &m) { return m.name == name; })) return false;
+    if (last.is(sbuf)) return true;     // an earlier member ran the group
+
+    std::vector<const member *> relevant;
+    for (const auto &m : members) {
+        if (content_affinity::relevant(m.accepts, sp)) relevant.push_back(&m);
+    }
+    last = tiled{&sbuf, sbuf.pos0.offset, sbuf.bufsize, sbuf.pos0.path, true};
+    try {
+        for (size_t begin = 0; begin < sbuf.bufsize; begin += tile_bytes) {
+            const size_t end = std::min(sbuf.bufsize, begin + tile_bytes);
+            for (const member *m : relevant) {
+                scanner_watchdog::invocation inv(m->name.c_str(), sp);
+                m->scan(sp, begin, end);
+            }
+        }
+    } catch (...) {
+        last.running = false;
+        throw;
+    }
+    last.running = false;
+    tiled_sbufs++;
+    return true;
+}
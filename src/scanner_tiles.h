@@ -0,0 +1,48 @@
+#ifndef SCANNER_TILES_H
+#define SCANNER_TILES_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "be13_api/scanner_params.h"
+
+/**
+ * scanner_tiles:
+ * Runs a group of byte-loop scanners over an sbuf a tile at a time (-S tiled_scanners=aes,windirs),
+ * every scanner of the group on one tile while it is in the cache before any goes on to the next. Each
+ * scanner that walks a whole 20 MiB page on its own reads it from DRAM again; a group of them tiled
+ * reads it once.
+ *
+ * A scanner can be tiled if it can scan a range of its sbuf: find the structures that start at the
+ * offsets in [begin, end), reading past end into the rest of the sbuf as far as they go, so that the
+ * tiles report what one call over the sbuf would. Such a scanner registers its range function at
+ * PHASE_INIT2 (which runs only for the enabled scanners) with enable(); tile_capable() lists them.
+ *
+ * The wrapper of each member in bulk_extractor_scanners.cpp asks scanned() for each PHASE_SCAN call.
+ * The first member that scanner_set calls on an sbuf runs the whole group over it, and the members
+ * called after it on the same sbuf find it done. Only the pages of the image (depth 0) of at least two
+ * tiles are grouped; the sbufs that recursion makes are scanned by each scanner on its own. The watchdog times each member on each tile, so
+ * a tiled scanner's calls are counted by the tile.
+ */
+
+class scanner_tiles {
+public:
+    using range_scanner = void (*)(const scanner_params &sp, size_t begin, size_t end);
+
+    static inline size_t tile_bytes {256 * 1024};       // rounded to a multiple of TILE_ALIGN
+    static inline const size_t TILE_ALIGN {4096};       // sectors, and the 32-byte blocks of scan_aes's prefilter
+    static inline std::atomic<uint64_t> tiled_sbufs {0};
+
+    /* Throws std::invalid_argument for a scanner that cannot be tiled; before the scanners are loaded */
+    static void set_scanners(const std::string &names); // NAME,...
+    static void set_tile_bytes(size_t bytes);
+    static bool tile_capable(const std::string &name);
+    static std::string scanners();                      // the enabled members, separated by commas
+
+    static void enable(const char *name, range_scanner scan);
+    static bool scanned(const char *name, const scanner_params &sp);
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "config.h"
+
+#include <algorithm>
+#include <sstream>
+#include <ctime>
+
+#include "alloc_profiler.h"
+#include "queue_stats.h"
+#include "scanner_watchdog.h"
+#include "trace_writer.h"
+
+scanner_watchdog::thread_state &scanner_watchdog::my_state()
+{
+    thread_local std::shared_ptr<thread_state> state;
+    if (!state) {
+        state = std::make_shared<thread_state>();
+        std::lock_guard<std::mutex> lock(Mthreads);
+        threads.push_back(state);
+    }
+    return *state;
+}
+
+scanner_watchdog::invocation::invocation(const char *scanner, const scanner_params &sp)
+{
+    if (sp.phase!=scanner_params::PHASE_SCAN || sp.sbuf==nullptr) return;
+    profiling = alloc_profiler::enabled;
+    const alloc_profiler::counts before = alloc_profiler::current();
+    thread_state &ts = my_state();
+    if (ts.stack.empty()) queue_stats::started(sp.sbuf);
+    frame f;
+    f.scanner = scanner;
+    f.pos0    = &sp.sbuf->pos0;
+    f.bytes   = sp.sbuf->bufsize;
+    f.start   = std::chrono::steady_clock::now();
+    f.cpu_clocked = f.bytes >= CPU_CLOCK_MIN_BYTES;
+    if (f.cpu_clocked) f.cpu_start = thread_cpu_seconds();
+    f.depth   = sp.sbuf->depth();
+    std::lock_guard<std::mutex> lock(ts.M);
+    ts.stack.push_back(std::move(f));
+    active = true;
+    if (profiling) {
+        /* the call starts now; what was allocated to set it up is not the parent's */
+        alloc_profiler::counts &c = alloc_profiler::current();
+        if (ts.stack.size() > 1) {
+            frame &parent = ts.stack[ts.stack.size()-2];
+            parent.peak_seen = std::max(parent.peak_seen, c.peak);
+            parent.child_allocations += c.allocations - before.allocations;
+            parent.child_alloc_bytes += c.bytes - before.bytes;
+        }
+        frame &me = ts.stack.back();
+        me.allocations_start = c.allocations;
+        me.alloc_bytes_start = c.bytes;
+        me.outstanding_start = c.outstanding;
+        alloc_profiler::reset_peak();
+    }
+    if (perf_counters::enabled) {
+        counting = perf_counters::read(ts.stack.back().perf_start);
+    }
+}
+
+scanner_watchdog::invocation::~invocation()
+{
+    if (!active) return;
+    perf_counters::values perf_end;
+    const bool counted = counting && perf_counters::read(perf_end);
+    const alloc_profiler::counts end_counts = alloc_profiler::current();
+    thread_state &ts = my_state();
+    frame f;
+    std::chrono::duration<double> elapsed;
+    const auto end = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(ts.M);
+        f = std::move(ts.stack.back());
+        ts.stack.pop_back();
+        elapsed = end - f.start;
+        const double cpu = f.cpu_clocked ? thread_cpu_seconds() - f.cpu_start : elapsed.count();
+        const uint64_t allocations = end_counts.allocations - f.allocations_start;
+        const uint64_t alloc_bytes = end_counts.bytes - f.alloc_bytes_start;
+        const perf_counters::values perf = counted ? perf_end - f.perf_start : perf_counters::values();
+        if (!ts.stack.empty()) {
+            ts.stack.back().child_cpu  += cpu;
+            ts.stack.back().child_wall += elapsed.count();
+            ts.stack.back().child_perf += perf;
+            if (profiling) {
+                ts.stack.back().child_allocations += allocations;
+                ts.stack.back().child_alloc_bytes += alloc_bytes;
+            }
+        } else {
+            ts.busy_seconds += elapsed.count();
+        }
+        scanner_totals &t = ts.totals[f.scanner];
+        t.calls++;
+        t.bytes += f.bytes;
+        t.cpu_seconds  += std::max(cpu - f.child_cpu, 0.0);
+        t.wall_seconds += std::max(elapsed.count() - f.child_wall, 0.0);
+        t.perf += perf - f.child_perf;
+        if (profiling) {
+            t.allocations     += allocations - std::min(allocations, f.child_allocations);
+            t.allocated_bytes += alloc_bytes - std::min(alloc_bytes, f.child_alloc_bytes);
+            t.peak_outstanding = std::max(t.peak_outstanding,
+                                          std::max(f.peak_seen, end_counts.peak) - f.outstanding_start);
+        }
+        if (ts.depths.size() <= f.depth) ts.depths.resize(f.depth+1);
+        ts.depths[f.depth]++;
+    }
+    if (trace_writer::enabled) {
+        trace_writer::record("scan", f.scanner, f.start, end,
+                             "\"pos0\": " + trace_writer::json_string(f.pos0->str()) +
+                             ", \"depth\": " + std::to_string(f.depth) + ", \"bytes\": " + std::to_string(f.bytes));
+    }
+    if (elapsed.count() >= threshold_seconds) {
+        std::lock_guard<std::mutex> lock(Mfinished);
+        finished.push_back(straggler{f.scanner, f.pos0->str(), f.bytes, elapsed.count()});
+        std::sort(finished.begin(), finished.end(), [](const straggler &a, const straggler &b){ return a.seconds > b.seconds; });
+        if (finished.size() > MAX_STRAGGLERS) finished.resize(MAX_STRAGGLERS);
+    }
+    if (profiling) {
+        /* nor is what was allocated to record the call */
+        const alloc_profiler::counts &c = alloc_profiler::current();
+        std::lock_guard<std::mutex> lock(ts.M);
+        if (!ts.stack.empty()) {
+            ts.stack.back().child_allocations += c.allocations - end_counts.allocations;
+            ts.stack.back().child_alloc_bytes += c.bytes - end_counts.bytes;
+        }
+    }
+}
+
+std::vector<scanner_watchdog::straggler> scanner_watchdog::running_stragglers()
+{
+    std::vector<straggler> ret;
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(Mthreads);
+    for (const auto &ts : threads) {
+        std::lock_guard<std::mutex> lock2(ts->M);
+        for (const auto &f : ts->stack) {
+            std::chrono::duration<double> elapsed = now - f.start;
+            if (elapsed.count() >= threshold_seconds) {
+                ret.push_back(straggler{f.scanner, f.pos0->str(), f.bytes, elapsed.count()});
+            }
+        }
+    }
+    std::sort(ret.begin(), ret.end(), [](const straggler &a, const straggler &b){ return a.seconds > b.seconds; });
+    return ret;
+}
+
+std::vector<std::vector<scanner_watchdog::straggler>> scanner_watchdog::running_calls()
+{
+    std::vector<std::vector<straggler>> ret;
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(Mthreads);
+    for (const auto &ts : threads) {
+        std::lock_guard<std::mutex> lock2(ts->M);
+        ret.emplace_back();
+        for (const auto &f : ts->stack) {
+            std::chrono::duration<double> elapsed = now - f.start;
+            ret.back().push_back(straggler{f.scanner, f.pos0->str(), f.bytes, elapsed.count(), f.depth});
+        }
+    }
+    return ret;
+}
+
+std::vector<scanner_watchdog::straggler> scanner_watchdog::finished_stragglers()
+{
+    std::lock_guard<std::mutex> lock(Mfinished);
+    return finished;
+}
+
+double scanner_watchdog::thread_cpu_seconds()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)==0) return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+    return 0;
+}
+
+std::map<std::string,scanner_watchdog::scanner_totals> scanner_watchdog::totals()
+{
+    std::map<std::string,scanner_totals> ret;
+    std::lock_guard<std::mutex> lock(Mthreads);
+    for (const auto &ts : threads) {
+        std::lock_guard<std::mutex> lock2(ts->M);
+        for (const auto &it : ts->totals) {
+            scanner_totals &t = ret[it.first];
+            t.calls += it.second.calls;
+            t.bytes += it.second.bytes;
+            t.cpu_seconds  += it.second.cpu_seconds;
+            t.wall_seconds += it.second.wall_seconds;
+            t.allocations     += it.second.allocations;
+            t.allocated_bytes += it.second.allocated_bytes;
+            t.peak_outstanding = std::max(t.peak_outstanding, it.second.peak_outstanding);
+            t.perf += it.second.perf;
+        }
+    }
+    return ret;
+}
+
+std::vector<double> scanner_watchdog::thread_busy_seconds()
+{
+    std::vector<double> ret;
+    std::lock_guard<std::mutex> lock(Mthreads);
+    for (const auto &ts : threads) {
+        std::lock_guard<std::mutex> lock2(ts->M);
+        ret.push_back(ts->busy_seconds);
+    }
+    return ret;
+}
+
+std::vector<uint64_t> scanner_watchdog::depth_histogram()
+{
+    std::vector<uint64_t> ret;
+    std::lock_guard<std::mutex> lock(Mthreads);
+    for (const auto &ts : threads) {
+        std::lock_guard<std::mutex> lock2(ts->M);
+        if (ret.size() < ts->depths.size()) ret.resize(ts->depths.size());
+        for (size_t i=0; i<ts->depths.size(); i++) ret[i] += ts->depths[i];
+    }
+    return ret;
+}
+
+/* One line per running straggler, for the notify thread */
+void scanner_watchdog::add_realtime_stats(std::map<std::string,std::string> &stats)
+{
+    int n = 0;
+    for (const auto &s : running_stragglers()) {
+        std::stringstream ss;
+        ss << s.scanner << " " << s.pos0 << " (" << s.bytes << " bytes) for " << int(s.seconds) << "s";
+        stats["straggler_" + std::to_string(n++)] = ss.str();
+        if (n==5) break;                // the slowest five fit on the screen
+    }
+
+    /* The scanners using the most CPU, and the calls at each depth */
+    auto t = totals();
+    std::vector<std::pair<std::string,scanner_totals>> top(t.begin(), t.end());
+    std::sort(top.begin(), top.end(), [](const auto &a, const auto &b){ return a.second.cpu_seconds > b.second.cpu_seconds; });
+    std::stringstream ss;
+    for (size_t i=0; i<top.size() && i<5; i++) {
+        ss << (i ? ", " : "") << top[i].first << " " << int(top[i].second.cpu_seconds) << "s";
+    }
+    if (!top.empty()) stats["scanner_cpu_top"] = ss.str();
+    if (alloc_profiler::enabled) {
+        std::sort(top.begin(), top.end(), [](const auto &a, const auto &b){ return a.second.allocations > b.second.allocations; });
+        std::stringstream as;
+        for (size_t i=0; i<top.size() && i<5; i++) {
+            as << (i ? ", " : "") << top[i].first << " " << top[i].second.allocations;
+        }
+        if (!top.empty()) stats["scanner_allocations_top"] = as.str();
+    }
+    std::stringstream ds;
+    auto depths = depth_histogram();
+    for (size_t i=0; i<depths.size(); i++) ds << (i ? " " : "") << i << ":" << depths[i];
+    if (!depths.empty()) stats["scanner_calls_by_depth"] = ds.str();
+}
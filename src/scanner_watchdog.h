@@ -0,0 +1,122 @@
+#ifndef SCANNER_WATCHDOG_H
+#define SCANNER_WATCHDOG_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "be13_api/scanner_params.h"
+
+#include "perf_counters.h"
+
+/**
+ * scanner_watchdog:
+ * Keeps track of which scanner each worker thread is running, on which sbuf, and since when,
+ * so that stragglers can be reported while they run (by the notify thread) and afterwards (in the DFXML).
+ *
+ * The built-in scanners are wrapped (see bulk_extractor_scanners.cpp) so that each PHASE_SCAN call
+ * creates an invocation. Recursion may run other scanners on the same thread, so each thread keeps a stack.
+ *
+ * Each thread also totals the calls, bytes, CPU time and wall time of each scanner, and the calls at each
+ * recursion depth, for the live statistics of the notify thread. A scanner's times exclude the scanners it
+ * recursed into, so the totals show where the time goes.
+ *
+ * With alloc_profiler enabled (-S profile_allocations=YES), each scanner is also charged with the allocations
+ * made through operator new during its calls, less those of the scanners it recursed into (and of the
+ * watchdog's own bookkeeping), and with the peak of the bytes outstanding during any one call, which
+ * includes the scanners it recursed into.
+ *
+ * With perf_counters enabled (-S perf_counters=YES), each scanner is charged with the cycles, instructions,
+ * cache misses and branch misses of its calls, less those of the scanners it recursed into.
+ *
+ * Reading the thread's CPU clock is a system call, which costs more than scanning the base64 lines and
+ * decompressed fragments that recursion makes, and every scanner is called on each of them. A call on an
+ * sbuf smaller than CPU_CLOCK_MIN_BYTES is charged its wall time as CPU time instead; such calls are short
+ * enough that the difference is the clock's resolution.
+ *
+ * The outermost call on each thread tells queue_stats that its sbuf has left the queue, and its wall time
+ * is the thread's busy time, from which queue_stats derives how long the worker sat idle.
+ */
+
+class scanner_watchdog {
+public:
+    struct frame {
+        const char *scanner {nullptr};
+        const pos0_t *pos0 {nullptr};   // of the sbuf, which outlives the call; formatted only for reports
+        size_t      bytes {0};
+        std::chrono::steady_clock::time_point start {};
+        double      cpu_start {0};
+        bool        cpu_clocked {false};    // cpu_start was read; otherwise the wall time is the CPU time
+        double      child_cpu {0};      // seconds spent in the scanners this call recursed into
+        double      child_wall {0};
+        unsigned    depth {0};
+        uint64_t    allocations_start {0};  // alloc_profiler counts when the call started
+        uint64_t    alloc_bytes_start {0};
+        int64_t     outstanding_start {0};
+        int64_t     peak_seen {0};          // the peak outstanding before the latest child call began
+        uint64_t    child_allocations {0};  // by the scanners this call recursed into
+        uint64_t    child_alloc_bytes {0};
+        perf_counters::values perf_start {}; // the thread's counters when the call started
+        perf_counters::values child_perf {};
+    };
+    struct scanner_totals {
+        uint64_t    calls {0};
+        uint64_t    bytes {0};
+        double      cpu_seconds {0};
+        double      wall_seconds {0};
+        uint64_t    allocations {0};        // these three are counted only with alloc_profiler enabled
+        uint64_t    allocated_bytes {0};
+        int64_t     peak_outstanding {0};   // the most bytes outstanding during one call
+        perf_counters::values perf {};      // counted only with perf_counters enabled
+    };
+    struct straggler {
+        std::string scanner {};
+        std::string pos0 {};
+        size_t      bytes {0};
+        double      seconds {0};
+        unsigned    depth {0};
+    };
+
+    /* RAII: the lifetime of one scanner call */
+    class invocation {
+        bool active {false};
+        bool profiling {false};
+        bool counting {false};          // perf_counters were read when the call started
+    public:
+        invocation(const char *scanner, const scanner_params &sp);
+        ~invocation();
+    };
+
+    static inline std::atomic<double> threshold_seconds {60}; // calls longer than this are stragglers
+    static inline const size_t MAX_STRAGGLERS {100};          // the slowest calls that are kept for the report
+    static inline const size_t CPU_CLOCK_MIN_BYTES {4096};    // smaller sbufs are not timed with the CPU clock
+
+    static std::vector<straggler> running_stragglers();       // calls that are running now and are too slow
+    static std::vector<std::vector<straggler>> running_calls(); // the stack of each thread, outermost first; empty if idle
+    static std::vector<straggler> finished_stragglers();      // the slowest calls that have finished, slowest first
+    static void add_realtime_stats(std::map<std::string,std::string> &stats);
+    static std::map<std::string,scanner_totals> totals();    // for every scanner that has been called
+    static std::vector<uint64_t> depth_histogram();          // calls at each recursion depth
+    static double thread_cpu_seconds();                      // CPU time of this thread; 0 if unknown
+    static std::vector<double> thread_busy_seconds();        // wall time in scanner calls, of each thread that made any
+
+private:
+    struct thread_state {
+        std::mutex M {};
+        std::vector<frame> stack {};
+        std::map<const char *,scanner_totals> totals {};
+        std::vector<uint64_t> depths {};
+        double busy_seconds {0};        // in outermost calls
+    };
+    static inline std::mutex Mthreads {};
+    static inline std::vector<std::shared_ptr<thread_state>> threads {};
+    static inline std::mutex Mfinished {};
+    static inline std::vector<straggler> finished {};
+    static thread_state &my_state();
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "scratch_arena.h"
+
+namespace {
+    struct chunk {
+        std::byte *base;
+        size_t size;
+    };
+
+    struct thread_arena {
+        std::vector<chunk> chunks {};   // the first is kept between scopes
+        size_t used {0};                // of the last chunk
+        size_t total {0};               // of every chunk, in this scope
+        unsigned depth {0};
+        ~thread_arena() { clear(); }
+        void clear() {
+            for (const auto &c : chunks) std::free(c.base);
+            chunks.clear();
+            used = 0;
+        }
+        bool add_chunk(size_t size) {
+            void *base = std::malloc(size);
+            if (base == nullptr) return false;
+            chunks.push_back(chunk{static_cast<std::byte *>(base), size});
+            used = 0;
+            scratch_arena::chunks_allocated++;
+            return true;
+        }
+        bool owns(const void *p) const {
+            for (const auto &c : chunks) {
+                if (p >= c.base && p < c.base + c.size) return true;
+            }
+            return false;
+        }
+    };
+    thread_local thread_arena arena;
+}
+
+void *scratch_arena::allocate(size_t bytes, size_t align)
+{
+    if (arena.depth == 0) return ::operator new(bytes);
+    for (;;) {
+        if (!arena.chunks.empty()) {
+            const chunk &c = arena.chunks.back();
+            const uintptr_t start = (reinterpret_cast<uintptr_t>(c.base) + arena.used + align - 1) & ~(uintptr_t(align) - 1);
+            const size_t offset = start - reinterpret_cast<uintptr_t>(c.base);
+            if (offset + bytes <= c.size) {
+                arena.total += offset + bytes - arena.used;
+                arena.used = offset + bytes;
+                return c.base + offset;
+            }
+        }
+        if (!arena.add_chunk(std::max(CHUNK_BYTES, bytes + align))) throw std::bad_alloc();
+    }
+}
+
+void scratch_arena::deallocate(void *p, size_t bytes)
+{
+    (void)bytes;
+    if (!arena.owns(p)) ::operator delete(p);   // made outside a scope
+}
+
+scratch_arena::scope::scope()
+{
+    arena.depth++;
+}
+
+scratch_arena::scope::~scope()
+{
+    if (--arena.depth > 0) return;
+    for (uint64_t peak = peak_bytes; arena.total > peak && !peak_bytes.compare_exchange_weak(peak, arena.total);) {}
+    if (arena.chunks.size() > 1 || (arena.chunks.size() == 1 && arena.chunks[0].size > MAX_RETAINED)) {
+        /* one chunk as large as this scope needed, so that the next has room without malloc; and
+         * no larger than MAX_RETAINED, even when one large request made the only chunk */
+        size_t size = 0;
+        for (const auto &c : arena.chunks) size += c.size;
+        arena.clear();
+        arena.add_chunk(std::min(size, MAX_RETAINED));
+    }
+    arena.used = 0;
+    arena.total = 0;
+}
+
+size_t scratch_arena::retained_bytes()
+{
+    size_t size = 0;
+    for (const auto &c : arena.chunks) size += c.size;
+    return size;
+}
+
+std::string scratch_arena::xml_attributes()
+{
+    return "chunks_allocated='" + std::to_string(chunks_allocated) +
+        "' peak_bytes='" + std::to_string(peak_bytes) + "'";
+}
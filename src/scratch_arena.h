@@ -0,0 +1,64 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * scratch_arena:
+ * Each worker thread's arena for the temporaries of the scanner calls, let go all at once when the
+ * outermost call on the thread (the sbuf the worker took from the queue, with every child that
+ * recursion scanned inline) returns.
+ *
+ * An allocation is a bump of a pointer in the thread's chunk, and freeing it costs nothing; the memory
+ * comes back when the outermost scope ends. A thread keeps one chunk between calls, as large as the
+ * most its calls have needed (up to MAX_RETAINED), so the steady state makes no calls to malloc, and
+ * the many short-lived vectors of the scanners neither contend in malloc nor fragment its heap.
+ *
+ * The wrappers in bulk_extractor_scanners.cpp open a scope around each scanner call. scratch_vector
+ * is for the locals of a call: not for what outlives it (such as a static or thread_local, or the
+ * buffer of a child sbuf, which sbuf_t frees with free()), nor for what another thread frees.
+ * Outside of a scope it allocates with operator new.
+ *
+ * The buffers of the child sbufs are not put in the arena: sbuf_t owns its buffer and frees it with
+ * free() when whichever worker scans it is done (see page_allocator.h).
+ */
+
+class scratch_arena {
+public:
+    static inline const size_t CHUNK_BYTES {1024 * 1024};
+    static inline const size_t MAX_RETAINED {64 * 1024 * 1024}; // a thread keeps at most this between calls
+    static inline std::atomic<uint64_t> chunks_allocated {0};   // chunks taken from malloc
+    static inline std::atomic<uint64_t> peak_bytes {0};         // the most one outermost call used
+
+    static void *allocate(size_t bytes, size_t align);
+    static void deallocate(void *p, size_t bytes);
+    static size_t retained_bytes();       // of the calling thread's chunks
+    static std::string xml_attributes();  // for the <scratch_arena> report element
+
+    /* The allocations within are let go when the outermost scope on the thread ends */
+    class scope {
+    public:
+        scope();
+        ~scope();
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+    };
+};
+
+template <class T> struct scratch_allocator {
+    using value_type = T;
+    scratch_allocator() = default;
+    template <class U> scratch_allocator(const scratch_allocator<U> &) {}
+    T *allocate(size_t n) { return static_cast<T *>(scratch_arena::allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *p, size_t n) { scratch_arena::deallocate(p, n * sizeof(T)); }
+    template <class U> bool operator==(const scratch_allocator<U> &) const { return true; }
+    template <class U> bool operator!=(const scratch_allocator<U> &) const { return false; }
+};
+
+template <class T> using scratch_vector = std::vector<T, scratch_allocator<T>>;
+
+#endif
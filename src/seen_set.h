@@ -0,0 +1,123 @@
+#ifndef SEEN_SET_H
+#define SEEN_SET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+/**
+ * seen_set:
+ * A set shared by the worker threads for "have we seen this" checks, with the interface of
+ * be13_api's atomic_set (contains, insert, check_for_presence_and_insert) but without its one lock.
+ *
+ * By default the set is exact: the keys are split by hash among SHARDS sets with their own locks,
+ * so threads only wait for each other when they land in the same shard. After set_approximate()
+ * only a 64-bit fingerprint of each key is kept, in an open-addressed table of a fixed size that is
+ * probed and filled with compare-and-swap and no locks at all. Two keys with the same fingerprint
+ * are then taken for one, and once the table is three quarters full (or max_entries is reached)
+ * new keys are not recorded and are counted in dropped(); either way a key that has not been seen
+ * is never said to have been, except by a fingerprint collision.
+ */
+
+template <typename T, typename Hash = std::hash<T>>
+class seen_set {
+public:
+    static inline const size_t SHARDS {64};
+    static inline const size_t MAX_PROBES {64};
+
+    explicit seen_set(size_t max_entries_ = SIZE_MAX): max_entries(max_entries_) {}
+    seen_set(const seen_set &) = delete;
+    seen_set &operator=(const seen_set &) = delete;
+
+    /* Keep fingerprints in a table of at most max_bytes (0 for exact); before the set is used */
+    void set_approximate(size_t max_bytes) {
+        slots = 0;
+        table.reset();
+        if (max_bytes < sizeof(uint64_t)) return;
+        slots = 1;
+        while (slots * 2 * sizeof(uint64_t) <= max_bytes) slots *= 2;
+        table.reset(new std::atomic<uint64_t>[slots]());
+    }
+    bool approximate() const { return table != nullptr; }
+
+    bool contains(const T &key) const {
+        const uint64_t fp = fingerprint(key);
+        if (approximate()) {
+            const size_t mask = slots - 1;
+            for (size_t probe = 0, i = fp & mask; probe < MAX_PROBES; probe++, i = (i + 1) & mask) {
+                const uint64_t cur = table[i].load(std::memory_order_acquire);
+                if (cur == fp) return true;
+                if (cur == 0) return false;
+            }
+            return false;
+        }
+        const shard &s = shards[fp >> 58];
+        std::lock_guard<std::mutex> lock(s.M);
+        return s.seen.count(key) != 0;
+    }
+
+    void insert(const T &key) { check_for_presence_and_insert(key); }
+
+    /* True if key was in the set. Adds it if not, and if there is room. */
+    bool check_for_presence_and_insert(const T &key) {
+        const uint64_t fp = fingerprint(key);
+        if (approximate()) {
+            const size_t mask = slots - 1;
+            for (size_t probe = 0, i = fp & mask; probe < MAX_PROBES; probe++, i = (i + 1) & mask) {
+                uint64_t cur = table[i].load(std::memory_order_acquire);
+                if (cur == 0) {
+                    if (entries.load(std::memory_order_relaxed) >= std::min(max_entries, slots / 4 * 3)) break;
+                    if (table[i].compare_exchange_strong(cur, fp, std::memory_order_acq_rel)) {
+                        entries++;
+                        return false;
+                    }
+                    // cur is now what another thread put there
+                }
+                if (cur == fp) return true;
+            }
+            dropped_++;
+            return false;
+        }
+        shard &s = shards[fp >> 58];
+        std::lock_guard<std::mutex> lock(s.M);
+        if (s.seen.count(key)) return true;
+        if (entries < max_entries) {
+            s.seen.insert(key);
+            entries++;
+        } else {
+            dropped_++;
+        }
+        return false;
+    }
+
+    size_t size() const { return entries; }
+    uint64_t dropped() const { return dropped_; } // keys that were not recorded, for want of room
+
+private:
+    struct shard {
+        mutable std::mutex M {};
+        std::unordered_set<T, Hash> seen {};
+    };
+    /* The key's hash, mixed (splitmix64) so that its high bits pick a shard and its low bits a slot; never 0 */
+    static uint64_t fingerprint(const T &key) {
+        uint64_t x = static_cast<uint64_t>(Hash()(key));
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x ? x : 1;
+    }
+
+    const size_t max_entries;
+    shard shards[SHARDS] {};
+    std::unique_ptr<std::atomic<uint64_t>[]> table {};
+    size_t slots {0};
+    std::atomic<size_t> entries {0};
+    std::atomic<uint64_t> dropped_ {0};
+};
+
+#endif
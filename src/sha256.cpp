@@ -0,0 +1,173 @@
+/*
+ * sha256: the SHA-256 compression function, for messages of one block. See sha256.h.
+ *
+ * x86-64 with the SHA extensions: sha256rnds2 does two rounds and sha256msg1/sha256msg2 the
+ * message schedule, four words at a time (Intel, "Intel SHA Extensions", 2013).
+ * aarch64 with the SHA2 extension: sha256h/sha256h2 four rounds, sha256su0/sha256su1 the schedule.
+ * Otherwise: FIPS 180-4, round by round.
+ */
+
+#include "config.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SHA256_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+#include <arm_neon.h>
+#define SHA256_ARM
+#endif
+
+#include "cpu_dispatch.h"
+#include "sha256.h"
+
+alignas(16) static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static void compress_scalar(uint32_t state[8], const uint8_t *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) w[i] = load_be32(block + 4 * i);
+    for (int i = 16; i < 64; i++) {
+        const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#ifdef SHA256_X86
+/* the state is kept as ABEF and CDGH, the order sha256rnds2 takes it in */
+__attribute__((target("sha,sse4.1")))
+static void compress_shani(uint32_t state[8], const uint8_t *block)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp   = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xb1);     // CDAB
+    __m128i cdgh  = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1b); // EFGH
+    __m128i abef  = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+    const __m128i abef0 = abef;
+    const __m128i cdgh0 = cdgh;
+
+    /* w[g % 4] holds words 4g..4g+3 of the schedule */
+    __m128i w[4];
+#pragma GCC unroll 16
+    for (int g = 0; g < 16; g++) {
+        if (g < 4) {
+            w[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * g)), bswap);
+        } else {
+            const __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(w[g % 4], w[(g + 1) % 4]),
+                                            _mm_alignr_epi8(w[(g + 3) % 4], w[(g + 2) % 4], 4));
+            w[g % 4] = _mm_sha256msg2_epu32(t, w[(g + 3) % 4]);
+        }
+        const __m128i m = _mm_add_epi32(w[g % 4], _mm_load_si128(reinterpret_cast<const __m128i *>(K + 4 * g)));
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, m);
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(m, 0x0e));
+    }
+
+    abef = _mm_add_epi32(abef, abef0);
+    cdgh = _mm_add_epi32(cdgh, cdgh0);
+    tmp  = _mm_shuffle_epi32(abef, 0x1b);                           // FEBA
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);                           // DCHG
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(tmp, cdgh, 0xf0));    // DCBA
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(cdgh, tmp, 8)); // HGFE
+}
+#endif
+
+#ifdef SHA256_ARM
+static void compress_arm(uint32_t state[8], const uint8_t *block)
+{
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32x4_t efgh = vld1q_u32(state + 4);
+    const uint32x4_t abcd0 = abcd;
+    const uint32x4_t efgh0 = efgh;
+
+    uint32x4_t w[4];
+#pragma GCC unroll 16
+    for (int g = 0; g < 16; g++) {
+        if (g < 4) {
+            w[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 16 * g)));
+        } else {
+            w[g % 4] = vsha256su1q_u32(vsha256su0q_u32(w[g % 4], w[(g + 1) % 4]), w[(g + 2) % 4], w[(g + 3) % 4]);
+        }
+        const uint32x4_t m = vaddq_u32(w[g % 4], vld1q_u32(K + 4 * g));
+        const uint32x4_t t = abcd;
+        abcd = vsha256hq_u32(abcd, efgh, m);
+        efgh = vsha256h2q_u32(efgh, t, m);
+    }
+
+    vst1q_u32(state, vaddq_u32(abcd, abcd0));
+    vst1q_u32(state + 4, vaddq_u32(efgh, efgh0));
+}
+#endif
+
+static cpu_dispatch::table<void (*)(uint32_t state[8], const uint8_t *block)> sha_kernels("sha256", {
+#ifdef SHA256_X86
+    {"sha-ni", cpu_dispatch::SHA | cpu_dispatch::SSE41, compress_shani},
+#elif defined(SHA256_ARM)
+    {"armv8-sha2", cpu_dispatch::ARM_SHA2, compress_arm},
+#endif
+    {"scalar", 0, compress_scalar},
+});
+
+static void sha256_block(void (*compress)(uint32_t *, const uint8_t *), const void *buf, size_t len, uint8_t digest[32])
+{
+    if (len > SHA256_SHORT_MAX) throw std::invalid_argument("sha256_short: message longer than one block");
+    uint8_t block[64] = {};
+    memcpy(block, buf, len);
+    block[len] = 0x80;
+    block[62] = static_cast<uint8_t>(len >> 5);             // the length in bits, big-endian
+    block[63] = static_cast<uint8_t>(len << 3);
+    uint32_t state[8];
+    memcpy(state, H0, sizeof(state));
+    compress(state, block);
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i + 0] = state[i] >> 24;
+        digest[4 * i + 1] = state[i] >> 16;
+        digest[4 * i + 2] = state[i] >> 8;
+        digest[4 * i + 3] = state[i];
+    }
+}
+
+void sha256_short(const void *buf, size_t len, uint8_t digest[32])
+{
+    sha256_block(sha_kernels.fn(), buf, len, digest);
+}
+
+void sha256_short_scalar(const void *buf, size_t len, uint8_t digest[32])
+{
+    sha256_block(compress_scalar, buf, len, digest);
+}
+
+const char *sha256_name()
+{
+    return sha_kernels.chosen_name();
+}
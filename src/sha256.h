@@ -0,0 +1,18 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* SHA-256 of messages that fit in one block, for the scanners that validate checksums
+ * (scan_accts's bitcoin addresses). Hashing 21 or 32 bytes with a hash_t generator costs more
+ * in setup than in compression, so these short messages are padded on the stack and compressed
+ * once, with the SHA extensions if the CPU has them.
+ */
+static const size_t SHA256_SHORT_MAX = 55;   // the longest message that fits in one block with its padding
+
+void sha256_short(const void *buf, size_t len, uint8_t digest[32]);        // the fastest kernel this CPU supports
+void sha256_short_scalar(const void *buf, size_t len, uint8_t digest[32]);
+const char *sha256_name();                                                  // the kernel sha256_short() uses
+
+#endif
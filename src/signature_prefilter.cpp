@@ -0,0 +1,216 @@
+/**
+ * signature_prefilter: the magic numbers of the structure carvers and the literals of the text
+ * scanners, in one pass over a page.
+ * See signature_prefilter.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "signature_prefilter.h"
+
+namespace {
+    const size_t BLOCK = 16;            // offsets tested at a time by the vector search
+    const size_t CACHE_DEPTHS = 8;      // deeper sbufs share the last cache entry
+
+    /* the offsets in a block at which a structure can start; step divides BLOCK */
+    uint32_t lane_mask(size_t first, size_t step) {
+        uint32_t mask = 0;
+        for (size_t j = first % step; j < BLOCK; j += step) mask |= 1U << j;
+        return mask;
+    }
+
+    /* the offsets in the block at s0 that are below end */
+    uint32_t below(size_t end, size_t s0) {
+        if (end <= s0) return 0;
+        return (end - s0 >= BLOCK) ? 0xffff : (1U << (end - s0)) - 1;
+    }
+
+    bool power_of_2(size_t n) {
+        return n != 0 && (n & (n - 1)) == 0;
+    }
+
+    /* bit j is set if p1[j]==b1 and p2[j]==b2; p1[j] and p2[j] are in the buffer for j < avail */
+    uint32_t pair_mask_scalar(const uint8_t *p1, const uint8_t *p2, uint8_t b1, uint8_t b2, size_t avail) {
+        uint32_t mask = 0;
+        for (size_t j = 0; j < BLOCK && j < avail; j++) {
+            if (p1[j] == b1 && p2[j] == b2) mask |= 1U << j;
+        }
+        return mask;
+    }
+
+    /* the same, for a whole block */
+    inline uint32_t pair_mask(const uint8_t *p1, const uint8_t *p2, uint8_t b1, uint8_t b2) {
+#if defined(__SSE2__)
+        __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p1)), _mm_set1_epi8(b1));
+        __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p2)), _mm_set1_epi8(b2));
+        return _mm_movemask_epi8(_mm_and_si128(eq1, eq2));
+#elif defined(__aarch64__)
+        uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(p1), vdupq_n_u8(b1)), vceqq_u8(vld1q_u8(p2), vdupq_n_u8(b2)));
+        if (vmaxvq_u8(eq) == 0) return 0; // the common case; a hit is located with the scalar test
+        return pair_mask_scalar(p1, p2, b1, b2, BLOCK);
+#else
+        return pair_mask_scalar(p1, p2, b1, b2, BLOCK);
+#endif
+    }
+
+    struct cache_entry {
+        const signature_prefilter *owner {nullptr};
+        const sbuf_t  *sbuf {nullptr};
+        const uint8_t *buf {nullptr};
+        size_t         bufsize {0};
+        size_t         pagesize {0};
+        uint64_t       offset {0};      // the pos0, compared without formatting it
+        std::string    path {};
+        std::vector<std::vector<size_t>> found {};
+    };
+}
+
+size_t signature_prefilter::add(const std::string &magic, size_t offset, size_t alignment, size_t sector_alignment,
+                                bool margin)
+{
+    if (magic.empty() || !power_of_2(alignment) || !power_of_2(sector_alignment)) {
+        throw std::invalid_argument("signature_prefilter: empty magic or alignment not a power of 2");
+    }
+    /* scanners add their signatures each time they are initialized */
+    for (size_t id = 0; id < signatures.size(); id++) {
+        const signature &it = signatures[id];
+        if (it.magic == magic && it.offset == offset && it.alignment == alignment &&
+            it.sector_alignment == sector_alignment && it.margin == margin) return id;
+    }
+    signature sig {magic, offset, alignment, sector_alignment, margin, 0, 0};
+
+    /* zeros are everywhere; test the first and last other bytes of the magic if there are any */
+    size_t first = magic.find_first_not_of('\000');
+    size_t last  = magic.find_last_not_of('\000');
+    if (first == std::string::npos) {
+        first = 0;
+        last  = magic.size() - 1;
+    } else if (first == last) {
+        last = (first == magic.size() - 1) ? 0 : magic.size() - 1;
+    }
+    sig.anchor1 = first;
+    sig.anchor2 = last;
+
+    signatures.push_back(sig);
+    return signatures.size() - 1;
+}
+
+signature_prefilter::stride_t signature_prefilter::stride(size_t alignment, size_t sector_alignment,
+                                                          bool on_disk, uint64_t image_offset)
+{
+    /* the sector alignment is from the start of the image, the other from the start of the buffer */
+    if (!on_disk || sector_alignment <= alignment) {
+        return stride_t{0, alignment};
+    }
+    return stride_t{static_cast<size_t>((sector_alignment - image_offset % sector_alignment) % sector_alignment),
+                    sector_alignment};
+}
+
+signature_prefilter::stride_t signature_prefilter::stride(const sbuf_t &sbuf, size_t alignment, size_t sector_alignment)
+{
+    return stride(alignment, sector_alignment, sector_aligned && sbuf.depth() == 0, sbuf.pos0.offset);
+}
+
+void signature_prefilter::search(const uint8_t *buf, size_t len, size_t limit,
+                                 std::vector<std::vector<size_t>> &found, bool on_disk, uint64_t image_offset) const
+{
+    found.resize(signatures.size());
+    for (auto &it : found) it.clear();
+    limit = std::min(limit, len);
+
+    /* the sparse signatures are probed where they can start; the others are left to the vector search */
+    std::vector<size_t>   searched;
+    std::vector<uint32_t> lanes;
+    size_t end = 0;                     // of the vector search
+    for (size_t id = 0; id < signatures.size(); id++) {
+        const signature &sig = signatures[id];
+        const size_t sig_limit = sig.margin ? len : limit;
+        const stride_t st = stride(sig.alignment, sig.sector_alignment, on_disk, image_offset);
+        if (st.step < BLOCK) {
+            searched.push_back(id);
+            lanes.push_back(lane_mask(st.first, st.step));
+            end = std::max(end, sig_limit);
+            continue;
+        }
+        const uint8_t first = sig.magic[0];
+        for (size_t s = st.first; s < sig_limit && s + sig.offset + sig.magic.size() <= len; s += st.step) {
+            const uint8_t *p = buf + s + sig.offset;
+            if (*p == first && memcmp(p, sig.magic.data(), sig.magic.size()) == 0) {
+                found[id].push_back(s);
+            }
+        }
+    }
+    if (searched.empty()) return;
+
+    /* one pass over the page: each block is tested for every signature while it is in the cache */
+    for (size_t s0 = 0; s0 < end; s0 += BLOCK) {
+        const uint32_t in_limit  = below(limit, s0);
+        const uint32_t in_margin = below(len, s0);
+        for (size_t k = 0; k < searched.size(); k++) {
+            const size_t id = searched[k];
+            const signature &sig = signatures[id];
+            const uint32_t in_range = sig.margin ? in_margin : in_limit;
+            if (in_range == 0) continue;
+            const size_t p1 = s0 + sig.offset + sig.anchor1;
+            const size_t p2 = s0 + sig.offset + sig.anchor2;
+            const size_t pmax = std::max(p1, p2);
+            if (pmax >= len) continue;
+            const uint8_t b1 = sig.magic[sig.anchor1];
+            const uint8_t b2 = sig.magic[sig.anchor2];
+            uint32_t mask = (pmax + BLOCK <= len) ? pair_mask(buf + p1, buf + p2, b1, b2)
+                                                  : pair_mask_scalar(buf + p1, buf + p2, b1, b2, len - pmax);
+            mask &= lanes[k] & in_range;
+            while (mask) {
+                const size_t s = s0 + __builtin_ctz(mask);
+                mask &= mask - 1;
+                if (s + sig.offset + sig.magic.size() <= len &&
+                    memcmp(buf + s + sig.offset, sig.magic.data(), sig.magic.size()) == 0) {
+                    found[id].push_back(s);
+                }
+            }
+        }
+    }
+}
+
+const std::vector<size_t> &signature_prefilter::candidates(const sbuf_t &sbuf, size_t id) const
+{
+    static thread_local std::array<cache_entry, CACHE_DEPTHS> cache;
+    cache_entry &entry = cache[std::min<size_t>(std::max(sbuf.depth(), 0), CACHE_DEPTHS - 1)];
+    if (entry.owner != this || entry.sbuf != &sbuf || entry.buf != sbuf.get_buf() ||
+        entry.bufsize != sbuf.bufsize || entry.pagesize != sbuf.pagesize ||
+        entry.offset != sbuf.pos0.offset || entry.path != sbuf.pos0.path) {
+        entry.owner    = this;
+        entry.sbuf     = &sbuf;
+        entry.buf      = sbuf.get_buf();
+        entry.bufsize  = sbuf.bufsize;
+        entry.pagesize = sbuf.pagesize;
+        entry.offset   = sbuf.pos0.offset;
+        entry.path     = sbuf.pos0.path;
+        search(sbuf.get_buf(), sbuf.bufsize, sbuf.pagesize, entry.found,
+               sector_aligned && sbuf.depth() == 0, sbuf.pos0.offset);
+    }
+    return entry.found.at(id);
+}
+
+ssize_t signature_prefilter::next(const std::vector<size_t> &found, size_t start)
+{
+    auto it = std::lower_bound(found.begin(), found.end(), start);
+    return it == found.end() ? -1 : static_cast<ssize_t>(*it);
+}
+
+signature_prefilter &signature_prefilter::shared()
+{
+    static signature_prefilter instance;
+    return instance;
+}
@@ -0,0 +1,94 @@
+#ifndef SIGNATURE_PREFILTER_H
+#define SIGNATURE_PREFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * signature_prefilter:
+ * The magic numbers of the structure carvers (scan_ntfsmft, scan_ntfsindx, scan_ntfslogfile,
+ * scan_ntfsusn, scan_winprefetch, scan_evtx, scan_winlnk, scan_exif) and the literals of the
+ * text scanners (scan_facebook, scan_kml, scan_vcard, scan_httplogs), found for all of them in
+ * one pass over a page.
+ *
+ * Each scanner adds its signatures in PHASE_INIT2 and in PHASE_SCAN asks for the candidates of
+ * each one: the offsets in the page at which the magic is present. It then runs its own
+ * validator (check_mftrecord_signature() and so on) on those offsets only. The first scanner
+ * to ask about an sbuf searches for every signature; the others reuse the result.
+ *
+ * A signature has two alignments. The structure always starts at a multiple of alignment from
+ * the start of the buffer it is in (an MFT record in the MFT). On a disk image it also starts
+ * at a multiple of sector_alignment from the start of the image (a prefetch or LNK file is
+ * at a sector boundary). The sector alignment is used for the depth-0 sbufs only, and only if
+ * sector_aligned is set (-S sector_aligned=1, a fast mode for disk images); a recursive buffer,
+ * a memory image or unallocated space that is not partition-aligned can have a structure at any
+ * offset, so by default every offset that alignment allows is tested.
+ *
+ * The structures start in the page; a signature added with margin can also start in the margin,
+ * for the text scanners, which look for their literals in the whole buffer.
+ *
+ * A signature that can only start at a multiple of 16 or more is probed at those offsets.
+ * The others are searched 16 offsets at a time for two of their bytes (SSE2 or NEON), and the
+ * magic is compared where both are present.
+ */
+
+class signature_prefilter {
+public:
+    struct signature {
+        std::string magic {};
+        size_t offset {0};              // of the magic in the structure
+        size_t alignment {1};           // the structure starts at a multiple of this
+        size_t sector_alignment {1};    // on a disk image, and at a multiple of this in the image
+        bool   margin {false};          // it can start in the margin too
+        size_t anchor1 {0};             // the two bytes of the magic that the vector search tests
+        size_t anchor2 {0};
+    };
+
+    /* The offsets at which a structure can start in an sbuf: first, first+step, ... */
+    struct stride_t {
+        size_t first {0};
+        size_t step {1};
+    };
+
+    static inline bool sector_aligned {false}; // depth-0 sbufs are of a disk image (-S sector_aligned=1)
+
+    /* Returns the id of the signature; adding it again returns the same id. The alignments must be
+     * powers of 2; throws std::invalid_argument. Not thread-safe; call before scanning starts.
+     */
+    size_t add(const std::string &magic, size_t offset = 0, size_t alignment = 1, size_t sector_alignment = 1,
+               bool margin = false);
+    size_t size() const { return signatures.size(); }
+    const signature &get(size_t id) const { return signatures.at(id); }
+
+    /* found[id] is the starts s < limit (s < len with margin) of the structures with signature id, in order,
+     * where buf[s+offset, s+offset+magic.size()) is the magic and is in buf[0, len).
+     * If on_disk, buf is at image_offset in a disk image and sector_alignment applies.
+     */
+    void search(const uint8_t *buf, size_t len, size_t limit, std::vector<std::vector<size_t>> &found,
+                bool on_disk = false, uint64_t image_offset = 0) const;
+
+    /* The starts of signature id in sbuf's page. The result is cached per thread and recursion
+     * depth; it is valid until the next call for another sbuf at the same depth.
+     */
+    const std::vector<size_t> &candidates(const sbuf_t &sbuf, size_t id) const;
+
+    /* The first of found at or after start, or -1, as sbuf_t::find() returns */
+    static ssize_t next(const std::vector<size_t> &found, size_t start);
+
+    /* Where a structure with these alignments can start in sbuf, for the scanners that test
+     * offsets themselves (scan_utmp, whose records have no magic number).
+     */
+    static stride_t stride(const sbuf_t &sbuf, size_t alignment, size_t sector_alignment);
+
+    static signature_prefilter &shared(); // the instance the scanners share
+
+private:
+    std::vector<signature> signatures {};
+    static stride_t stride(size_t alignment, size_t sector_alignment, bool on_disk, uint64_t image_offset);
+};
+
+#endif
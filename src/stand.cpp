@@ -1,47 +1,55 @@
 /**
  *
  * ABOUT:
- *	A standalone program debug scanner.
- *      Solely for testing.
- *      Compile in the scanner you want.
- *
+ *	A standalone scanner benchmark.
+ *      Runs the enabled scanners over one file, single threaded, a number of times,
+ *      and reports what each run cost, so that a change to a scanner can be measured
+ *      without running a whole image. Build it with "make stand".
  *
  */
 
 
 #include "config.h"
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
-#include <string>
-#include <stdlib.h>
-#include <strings.h>
-#include <string.h>
-#include <stdint.h>
+#include <iomanip>
+#include <iostream>
 #include <sstream>
+#include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
 #include "be13_api/scanner_set.h"
 #include "be13_api/utils.h"
 
+#include "alloc_profiler.h"
+#include "bulk_extractor_scanners.h"
+#include "feature_files.h"
+#include "scanner_watchdog.h"
+
 /**
- * Stand alone tester.
- * 1. allocate an sbuf for the file.
- * 2. Initialize the scanner.
- * 3. Call the scanner.
- * 4. Shut down the scanner.
+ * Stand alone benchmark. For each of -n runs:
+ * 1. make a scanner_set with the enabled scanners, writing to a directory of its own.
+ * 2. map the file into an sbuf (after dropping it from the page cache, with -c).
+ * 3. time the scan of the sbuf, counting the allocations made by operator new (with alloc_profiler).
+ * 4. shut down the scanners and count the features they wrote.
+ * A run that is not timed warms the cache (unless -c) and the scanners first.
  */
-int debug=0;
-const char *image_fname = 0;
-
-/* Bring in the definitions for the  */
-#define SCANNER(scanner) extern "C" scanner_t scan_ ## scanner;
-#include "bulk_extractor_scanners.h"
-#undef SCANNER
 
-scanner_t *scanners_builtin[] = {
-    scan_json,                          // the only built-in scanner for now
-    0
+struct run_t {
+    double   seconds {0};
+    uint64_t features {0};
+    uint64_t allocations {0};
+    uint64_t allocated_bytes {0};
 };
 
 void usage(scanner_set &ss)
@@ -50,27 +58,117 @@ void usage(scanner_set &ss)
     std::cerr << "Options:\n";
     std::cerr << "   -h           - print this message\n";
     std::cerr << "  -e scanner    - enable scanner\n";
-    std::cerr << "  -o outdir     - specify output directory\n";
+    std::cerr << "  -x scanner    - disable scanner\n";
+    std::cerr << "  -s name=value - set a scanner parameter\n";
+    std::cerr << "  -o outdir     - specify output directory (default: a temporary one, removed afterwards)\n";
+    std::cerr << "  -n runs       - number of timed runs (default 5)\n";
+    std::cerr << "  -c            - cold cache: drop the file from the page cache before each run\n";
+    std::cerr << "  -J            - report in JSON\n";
     ss.info_scanners(std::cerr, false, true, 'e','x');
 }
 
+/* Feature lines in the feature files of outdir */
+static uint64_t count_features(const std::filesystem::path &outdir)
+{
+    uint64_t count = 0;
+    for (const auto &txt : output_text_files(outdir, true)) {
+        std::ifstream in(txt);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line[0] != '#') count++;
+        }
+    }
+    return count;
+}
+
+static void drop_from_cache(const std::string &fname)
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static uint64_t peak_rss_bytes()
+{
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss;                // bytes
+#else
+    return uint64_t(ru.ru_maxrss) * 1024; // KiB
+#endif
+}
+
+static std::string json_string(const std::string &s)
+{
+    std::stringstream ss;
+    ss << '"';
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\') ss << '\\' << ch;
+        else if (ch < ' ') ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(ch) << std::dec;
+        else ss << ch;
+    }
+    ss << '"';
+    return ss.str();
+}
+
+static run_t run_once(const scanner_config &sc_template, const std::filesystem::path &outdir,
+                      const std::string &fname, bool cold)
+{
+    scanner_config sc = sc_template;
+    sc.outdir = outdir.string();
+    std::filesystem::create_directories(outdir);
+    struct feature_recorder_set::flags_t f;
+    scanner_set ss(sc, f, nullptr);
+    ss.add_scanners(scanners_builtin);
+    ss.apply_scanner_commands();
+    ss.phase_scan();
+
+    if (cold) drop_from_cache(fname);
+    sbuf_t *sbuf = sbuf_t::map_file(fname);
+
+    run_t run;
+    const alloc_profiler::counts c0 = alloc_profiler::current();
+    const auto t0 = std::chrono::steady_clock::now();
+    ss.schedule_sbuf(sbuf);             // scans on this thread and deletes the sbuf
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    run.allocations     = alloc_profiler::current().allocations - c0.allocations;
+    run.allocated_bytes = alloc_profiler::current().bytes - c0.bytes;
+
+    ss.shutdown();
+    run.features = count_features(outdir);
+    return run;
+}
+
 int main(int argc,char **argv)
 {
     scanner_config   sc;
     struct feature_recorder_set::flags_t f;
-    sc.outdir =  std::filesystem::temp_directory_path().string(); // default
+    std::string outdir;
+    int  runs = 5;
+    bool cold = false;
+    bool json = false;
 
     /* look for usage first */
     if(argc==1 || (strcmp(argv[1],"-h")==0)){
-        scanner_set ss(sc, f);    // great a bogus scanner_set for help info
+        scanner_set ss(sc, f, nullptr);    // great a bogus scanner_set for help info
+        ss.add_scanners(scanners_builtin);
 	usage(ss);
 	return(1);
     }
 
     int ch;
-    while ((ch = getopt(argc, argv, "e:o:s:x:h?")) != -1) {
+    while ((ch = getopt(argc, argv, "ce:Jn:o:s:x:h?")) != -1) {
 	switch (ch) {
-	case 'o': sc.outdir = optarg;break;
+	case 'c': cold = true; break;
+	case 'J': json = true; break;
+	case 'n': runs = std::max(atoi(optarg), 1); break;
+	case 'o': outdir = optarg;break;
 	case 'e': sc.push_scanner_command(optarg, scanner_config::scanner_command::ENABLE);break;
 	case 'x': sc.push_scanner_command(optarg, scanner_config::scanner_command::DISABLE); break;
 	case 's':
@@ -85,7 +183,8 @@ int main(int argc,char **argv)
 	    }
 	case 'h': case '?':default:
             {
-                scanner_set ss(sc, f);    // great a bogus scanner_set for help info
+                scanner_set ss(sc, f, nullptr);    // great a bogus scanner_set for help info
+                ss.add_scanners(scanners_builtin);
                 usage(ss);
                 exit(1);
             }
@@ -95,16 +194,94 @@ int main(int argc,char **argv)
     argc -= optind;
     argv += optind;
 
-    scanner_set ss(sc, f);
-    if(argc!=1) usage(ss);
+    if(argc!=1){
+        scanner_set ss(sc, f, nullptr);
+        ss.add_scanners(scanners_builtin);
+        usage(ss);
+        exit(1);
+    }
+    const std::string fname = argv[0];
+    const uint64_t bytes = std::filesystem::file_size(fname);
+    const bool temporary = outdir.empty();
+    const std::filesystem::path root = temporary ?
+        std::filesystem::temp_directory_path() / ("stand-" + std::to_string(getpid())) : std::filesystem::path(outdir);
 
-    ss.apply_scanner_commands();        // applied after all scanners are added
+    std::vector<std::string> enabled;
+    {
+        scanner_set ss(sc, f, nullptr);
+        ss.add_scanners(scanners_builtin);
+        ss.apply_scanner_commands();
+        enabled = ss.get_enabled_scanners();
+    }
 
+    alloc_profiler::enabled = true;
+    /* the first run warms the scanners, and the cache unless it is to be cold */
+    run_once(sc, root / "warmup", fname, cold);
+    std::vector<run_t> results;
+    for (int i = 0; i < runs; i++) {
+        results.push_back(run_once(sc, root / ("run-" + std::to_string(i)), fname, cold));
+    }
+    if (temporary) std::filesystem::remove_all(root);
 
-    /* Make an sbuf for the file. */
-    sbuf_t *sbuf = sbuf_t::map_file(argv[0]);
-    ss.phase_scan();                    // start the scanner phase
-    ss.process_sbuf( sbuf );
-    ss.shutdown();
+    std::vector<double> ns_per_byte;
+    uint64_t features = 0, allocs = 0, alloc_bytes = 0;
+    double seconds = 0;
+    for (const auto &it : results) {
+        ns_per_byte.push_back(it.seconds * 1e9 / std::max<uint64_t>(bytes, 1));
+        seconds     += it.seconds;
+        features    += it.features;
+        allocs      += it.allocations;
+        alloc_bytes += it.allocated_bytes;
+    }
+    std::sort(ns_per_byte.begin(), ns_per_byte.end());
+    const double median = ns_per_byte[ns_per_byte.size() / 2];
+    const double mb = double(bytes) * runs / 1e6;
+    const double mb_per_sec = 1e3 / median;          // 1e9 ns / (median ns/byte) / 1e6
+    const double features_per_sec = seconds > 0 ? features / seconds : 0;
+    const double allocations_per_mb = mb > 0 ? allocs / mb : 0;
+    const double allocated_bytes_per_mb = mb > 0 ? alloc_bytes / mb : 0;
+    /* every run, the warm-up too, was counted by scanner */
+    const auto by_scanner = scanner_watchdog::totals();
+
+    if (json) {
+        std::cout << "{\"file\": " << json_string(fname) << ", \"bytes\": " << bytes
+                  << ", \"scanners\": [";
+        for (size_t i = 0; i < enabled.size(); i++) std::cout << (i ? ", " : "") << json_string(enabled[i]);
+        std::cout << "], \"runs\": " << runs << ", \"cache\": \"" << (cold ? "cold" : "warm") << "\""
+                  << ", \"ns_per_byte\": {\"min\": " << ns_per_byte.front() << ", \"median\": " << median
+                  << ", \"max\": " << ns_per_byte.back() << "}"
+                  << ", \"mb_per_sec\": " << mb_per_sec
+                  << ", \"features_per_run\": " << features / runs
+                  << ", \"features_per_sec\": " << features_per_sec
+                  << ", \"allocations_per_mb\": " << allocations_per_mb
+                  << ", \"allocated_bytes_per_mb\": " << allocated_bytes_per_mb
+                  << ", \"scanner_allocations_per_run\": {";
+        bool first = true;
+        for (const auto &it : by_scanner) {
+            std::cout << (first ? "" : ", ") << json_string(it.first) << ": {\"allocations\": "
+                      << it.second.allocations / (runs + 1) << ", \"bytes\": " << it.second.allocated_bytes / (runs + 1)
+                      << ", \"peak_outstanding_bytes\": " << it.second.peak_outstanding << "}";
+            first = false;
+        }
+        std::cout << "}"
+                  << ", \"peak_rss_bytes\": " << peak_rss_bytes() << "}\n";
+    } else {
+        std::cout << "file: " << fname << " (" << bytes << " bytes)\n";
+        std::cout << "scanners:";
+        for (const auto &it : enabled) std::cout << " " << it;
+        std::cout << "\n";
+        std::cout << "runs: " << runs << " (" << (cold ? "cold" : "warm") << " cache)\n";
+        std::cout << "ns/byte: min " << ns_per_byte.front() << " median " << median
+                  << " max " << ns_per_byte.back() << " (" << mb_per_sec << " MB/s)\n";
+        std::cout << "features: " << features / runs << " per run, " << features_per_sec << " per second\n";
+        std::cout << "allocations: " << allocations_per_mb << " per MB, "
+                  << allocated_bytes_per_mb << " bytes per MB\n";
+        for (const auto &it : by_scanner) {
+            std::cout << "  " << it.first << ": " << it.second.allocations / (runs + 1) << " allocations, "
+                      << it.second.allocated_bytes / (runs + 1) << " bytes per run, peak outstanding "
+                      << it.second.peak_outstanding << " bytes\n";
+        }
+        std::cout << "peak RSS: " << peak_rss_bytes() << " bytes\n";
+    }
     return(0);
 }
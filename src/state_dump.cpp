@@ -0,0 +1,163 @@
+/**
+ * state_dump.cpp:
+ * Writing a snapshot of the running job on SIGUSR1 or when asked by a file; see state_dump.h.
+ */
+
+#include "config.h"
+
+#include <csignal>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+#include "memory_governor.h"
+#include "notify_thread.h"
+#include "queue_stats.h"
+#include "scanner_watchdog.h"
+#include "state_dump.h"
+#include "trace_writer.h"
+
+namespace {
+    using handler_t = void (*)(int);
+
+    std::atomic<bool> requested {false};
+    handler_t previous_handler {SIG_DFL};
+    std::once_flag installed {};
+
+    extern "C" void on_sigusr1(int sig) {
+        requested = true;
+        if (previous_handler != SIG_DFL && previous_handler != SIG_IGN && previous_handler != SIG_ERR) {
+            previous_handler(sig);
+        }
+    }
+
+    void write_residences(std::ostream &os, const std::vector<queue_stats::residence> &r) {
+        os << "[";
+        for (size_t i=0; i<r.size(); i++) {
+            os << (i ? ", " : "") << "{\"depth\": " << i << ", \"sbufs\": " << r[i].sbufs
+               << ", \"mean_seconds\": " << r[i].mean_seconds() << ", \"max_seconds\": " << r[i].max_seconds << "}";
+        }
+        os << "]";
+    }
+}
+
+state_dump::state_dump(const std::filesystem::path &outdir_, stats_fn stats_):
+    outdir(outdir_), stats(std::move(stats_))
+{
+    std::call_once(installed, []{ previous_handler = std::signal(SIGUSR1, on_sigusr1); });
+    thread = std::thread(&state_dump::run, this);
+}
+
+state_dump::~state_dump()
+{
+    stop();
+}
+
+void state_dump::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(M);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void state_dump::request()
+{
+    requested = true;
+}
+
+void state_dump::run()
+{
+    const std::filesystem::path trigger = outdir / TRIGGER_FILE;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(M);
+            cv.wait_for(lock, POLL_INTERVAL, [this]{ return stopping; });
+            if (stopping) return;
+        }
+        std::error_code ec;
+        const bool asked = std::filesystem::remove(trigger, ec);
+        if (!requested.exchange(false) && !asked) continue;
+        try {
+            const std::filesystem::path path = write(outdir, stats ? stats() : std::map<std::string,std::string>());
+            std::cerr << "state dump written to " << path.string() << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "state dump: " << e.what() << std::endl;
+        }
+    }
+}
+
+void state_dump::write_json(std::ostream &os, const std::map<std::string,std::string> &stats)
+{
+    os << "{\"time\": " << ::time(nullptr) << ", \"elapsed_seconds\": " << queue_stats::elapsed_seconds() << ",\n";
+
+    os << " \"threads\": [";
+    const char *sep = "";
+    for (const auto &calls : scanner_watchdog::running_calls()) {
+        os << sep << "[";
+        for (size_t i=0; i<calls.size(); i++) {
+            const auto &c = calls[i];
+            os << (i ? ", " : "") << "{\"scanner\": " << trace_writer::json_string(c.scanner)
+               << ", \"pos0\": " << trace_writer::json_string(c.pos0)
+               << ", \"depth\": " << c.depth << ", \"bytes\": " << c.bytes << ", \"seconds\": " << c.seconds << "}";
+        }
+        os << "]";
+        sep = ",\n  ";
+    }
+    os << "],\n \"queued_by_depth\": ";
+    write_residences(os, queue_stats::queued_by_depth());
+    os << ",\n \"residence_by_depth\": ";
+    write_residences(os, queue_stats::residence_by_depth());
+
+    os << ",\n \"memory_governor\": {\"budget\": " << memory_governor::get_budget()
+       << ", \"resident_bytes\": " << memory_governor::resident_bytes()
+       << ", \"used_bytes\": " << memory_governor::used_bytes()
+       << ", \"depth_reserve\": " << memory_governor::get_depth_reserve()
+       << ", \"waits\": " << memory_governor::waits << ", \"timeouts\": " << memory_governor::timeouts
+       << ", \"reader_timeouts\": " << memory_governor::reader_timeouts
+       << ", \"budget_by_depth\": [";
+    if (memory_governor::get_budget()) {
+        for (unsigned d=0; d<4; d++) os << (d ? ", " : "") << memory_governor::budget_at(d);
+    }
+    os << "]},\n \"producer_wait_seconds\": {";
+    for (int w=0; w<queue_stats::WAITS; w++) {
+        const auto wt = static_cast<queue_stats::wait_t>(w);
+        os << (w ? ", " : "") << trace_writer::json_string(queue_stats::wait_name(wt)) << ": " << queue_stats::wait_seconds(wt);
+    }
+
+    /* the rest is what the notify thread writes to stats.json */
+    std::map<std::string,std::string> all(stats);
+    scanner_watchdog::add_realtime_stats(all);
+    queue_stats::add_realtime_stats(all);
+    os << "},\n \"live\": ";
+    notify_thread::write_json(os, all, scanner_watchdog::totals(), scanner_watchdog::depth_histogram());
+    os << "}\n";
+}
+
+std::filesystem::path state_dump::write(const std::filesystem::path &outdir, const std::map<std::string,std::string> &stats)
+{
+    std::filesystem::path path;
+    for (uint64_t n = dumps + 1; ; n++) {
+        path = outdir / (PREFIX + std::to_string(n) + ".json");
+        if (!std::filesystem::exists(path)) break;
+    }
+    const std::filesystem::path tmp = path.string() + ".tmp";
+    {
+        std::ofstream os(tmp);
+        if (!os.is_open()) {
+            throw std::runtime_error("cannot create " + tmp.string());
+        }
+        write_json(os, stats);
+        os.close();
+        if (!os) {
+            throw std::runtime_error("cannot write " + tmp.string());
+        }
+    }
+    std::filesystem::rename(tmp, path);
+    dumps++;
+    return path;
+}
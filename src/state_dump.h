@@ -0,0 +1,69 @@
+#ifndef STATE_DUMP_H
+#define STATE_DUMP_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/**
+ * state_dump:
+ * A snapshot of what a running job is doing, written on demand (-S state_dump=YES, the default) to
+ * state_dump-N.json in the output directory, for finding out why a long run is slow or stuck without
+ * attaching a debugger to it. A dump is asked for with SIGUSR1 or by creating the file TRIGGER_FILE in
+ * the output directory, which is removed when the dump is written:
+ *
+ *     kill -USR1 <pid>        or        touch <outdir>/dump_state
+ *
+ * The dump has the stack of scanner calls of each worker thread (scanner, pos0, depth, bytes and how
+ * long the call has run), the sbufs waiting in the queue at each depth (as queue_stats stamps them, so
+ * depth 0), the memory governor's state, and the live statistics of stats.json: the realtime stats and
+ * each scanner's cumulative totals.
+ *
+ * The scanners are not paused: the dump is taken from its own thread, which checks for a request every
+ * POLL_INTERVAL, with the same locks that the notify thread takes, and is written to a temporary file
+ * and renamed so that a reader never sees part of it. The SIGUSR1 handler only sets a flag; a handler
+ * installed before it (io_throttle's, which reloads the control file) is called from it as well.
+ */
+
+class state_dump {
+public:
+    static inline const std::string TRIGGER_FILE {"dump_state"};
+    static inline const std::string PREFIX {"state_dump-"};     // state_dump-1.json, state_dump-2.json, ...
+    static inline const std::chrono::milliseconds POLL_INTERVAL {1000};
+
+    using stats_fn = std::function<std::map<std::string,std::string>()>;
+
+    /* Starts waiting for requests for outdir; stats gives the realtime stats of the scanner set */
+    state_dump(const std::filesystem::path &outdir, stats_fn stats);
+    ~state_dump();                      // stop()
+    state_dump(const state_dump &)=delete;
+    state_dump &operator=(const state_dump &)=delete;
+
+    void stop();
+    static void request();              // as SIGUSR1 does
+
+    /* Writes a dump with stats to outdir at the next free state_dump-N.json and returns its path */
+    static std::filesystem::path write(const std::filesystem::path &outdir, const std::map<std::string,std::string> &stats);
+    static void write_json(std::ostream &os, const std::map<std::string,std::string> &stats);
+
+    static inline std::atomic<uint64_t> dumps {0};
+
+private:
+    const std::filesystem::path outdir;
+    const stats_fn stats;
+    std::thread thread {};
+    std::mutex M {};
+    std::condition_variable cv {};
+    bool stopping {false};
+    void run();
+};
+
+#endif
@@ -0,0 +1,479 @@
+/**
+ * synthetic_image: a deterministic disk image that is generated as it is read.
+ * See synthetic_image.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "be13_api/utils.h"
+
+#include "synthetic_image.h"
+
+namespace {
+    const char *KIND_NAMES[synthetic_image::KINDS] =
+        {"email", "url", "ccn", "base64", "gzip", "zip", "jpeg", "ntfs", "packet", "aes"};
+
+    /* items per MiB when the specification does not give a density */
+    const double DEFAULT_DENSITY[synthetic_image::KINDS] = {64, 64, 8, 2, 2, 1, 1, 4, 8, 0.5};
+
+    const uint64_t MIB {1024 * 1024};
+    const size_t   NTFS_ALIGN {1024};
+
+    const char *WORDS[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+                           "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa"};
+    const size_t NWORDS {sizeof(WORDS) / sizeof(WORDS[0])};
+
+    /* splitmix64: small, fast, and seeded per slot without any setup cost */
+    class rng_t {
+        uint64_t state;
+    public:
+        explicit rng_t(uint64_t seed) : state(seed) {}
+        uint64_t next() {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+        uint64_t below(uint64_t n) { return n ? next() % n : 0; }
+        double   uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+        const char *word() { return WORDS[below(NWORDS)]; }
+    };
+
+    void put16(std::string &s, uint16_t v) { s.push_back(char(v)); s.push_back(char(v >> 8)); }
+    void put32(std::string &s, uint32_t v) { put16(s, v); put16(s, v >> 16); }
+    void put16be(std::string &s, uint16_t v) { s.push_back(char(v >> 8)); s.push_back(char(v)); }
+    void put32be(std::string &s, uint32_t v) { put16be(s, v >> 16); put16be(s, v); }
+    void set16(std::string &s, size_t at, uint16_t v) { s[at] = char(v); s[at + 1] = char(v >> 8); }
+    void set32(std::string &s, size_t at, uint32_t v) { set16(s, at, v); set16(s, at + 2, v >> 16); }
+
+    /* The operands of + are evaluated in no particular order, so every draw is a statement of its own:
+     * the image must not depend on the compiler.
+     */
+    std::string email(rng_t &rng) {
+        std::string ret = rng.word();
+        ret += std::to_string(rng.below(10000));
+        ret += "@example";
+        ret += std::to_string(rng.below(100));
+        return ret + ".com";
+    }
+    std::string url(rng_t &rng) {
+        std::string ret = "http://www.example";
+        ret += std::to_string(rng.below(100));
+        ret += ".com/";
+        ret += rng.word();
+        ret += "/";
+        ret += std::to_string(rng.below(100000));
+        return ret + ".html";
+    }
+    std::string ccn(rng_t &rng) {
+        /* a Visa-style number with a valid Luhn check digit */
+        std::string digits = "4";
+        while (digits.size() < 15) digits.push_back(char('0' + rng.below(10)));
+        int sum = 0;
+        for (size_t i = 0; i < digits.size(); i++) {
+            int d = digits[digits.size() - 1 - i] - '0';
+            if (i % 2 == 0) d = d * 2 > 9 ? d * 2 - 9 : d * 2;
+            sum += d;
+        }
+        digits.push_back(char('0' + (10 - sum % 10) % 10));
+        return digits;
+    }
+
+    /* Lines of text with an email and a URL each, for the containers to hold */
+    std::string feature_text(rng_t &rng, int lines) {
+        std::string ret;
+        for (int i = 0; i < lines; i++) {
+            ret += "From: " + email(rng);
+            ret += " see " + url(rng);
+            ret += std::string(" ") + rng.word();
+            ret += std::string(" ") + rng.word() + "\n";
+        }
+        return ret;
+    }
+
+    std::string deflated(const std::string &in, int window_bits) {
+        z_stream zs {};
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("synthetic_image: deflateInit2 failed");
+        }
+        std::string out(deflateBound(&zs, in.size()), '\0');
+        zs.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+        zs.avail_in  = in.size();
+        zs.next_out  = reinterpret_cast<Bytef *>(out.data());
+        zs.avail_out = out.size();
+        const int r = ::deflate(&zs, Z_FINISH);
+        out.resize(out.size() - zs.avail_out);
+        deflateEnd(&zs);
+        if (r != Z_STREAM_END) throw std::runtime_error("synthetic_image: deflate failed");
+        return out;
+    }
+
+    std::string base64(rng_t &rng) {
+        static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const std::string in = feature_text(rng, 8);
+        std::string ret = "\nContent-Transfer-Encoding: base64\n\n";
+        std::string line;
+        for (size_t i = 0; i < in.size(); i += 3) {
+            uint32_t v = uint8_t(in[i]) << 16;
+            if (i + 1 < in.size()) v |= uint8_t(in[i + 1]) << 8;
+            if (i + 2 < in.size()) v |= uint8_t(in[i + 2]);
+            line.push_back(ALPHABET[(v >> 18) & 63]);
+            line.push_back(ALPHABET[(v >> 12) & 63]);
+            line.push_back(i + 1 < in.size() ? ALPHABET[(v >> 6) & 63] : '=');
+            line.push_back(i + 2 < in.size() ? ALPHABET[v & 63] : '=');
+            if (line.size() == 76) { ret += line + "\n"; line.clear(); }
+        }
+        return ret + line + "\n\n";
+    }
+
+    std::string zip(rng_t &rng) {
+        const std::string text = feature_text(rng, 32);
+        const std::string data = deflated(text, -15);
+        std::string name = rng.word();
+        name += std::to_string(rng.below(1000)) + ".txt";
+        const uint32_t crc = crc32(0, reinterpret_cast<const Bytef *>(text.data()), text.size());
+        auto header = [&](std::string &s) {
+            put16(s, 20); put16(s, 0); put16(s, 8);     // version needed, flags, deflate
+            put16(s, 0x6000); put16(s, 0x4a21);         // 12:00:00 2017-01-01
+            put32(s, crc); put32(s, data.size()); put32(s, text.size());
+            put16(s, name.size());
+        };
+        std::string ret = "PK\x03\x04";
+        header(ret);
+        put16(ret, 0);                                  // extra length
+        ret += name + data;
+        const uint32_t cd_offset = ret.size();
+        ret += "PK\x01\x02";
+        put16(ret, 20);                                 // version made by
+        header(ret);
+        put16(ret, 0); put16(ret, 0); put16(ret, 0); put16(ret, 0); // extra, comment, disk, internal attributes
+        put32(ret, 0); put32(ret, 0);                   // external attributes, local header offset
+        ret += name;
+        const uint32_t cd_size = ret.size() - cd_offset;
+        ret += "PK\x05\x06";
+        put16(ret, 0); put16(ret, 0); put16(ret, 1); put16(ret, 1);
+        put32(ret, cd_size); put32(ret, cd_offset); put16(ret, 0);
+        return ret;
+    }
+
+    /* Enough of a JPEG for jpeg_validator: JFIF, an EXIF segment, a quantization table, a frame and a scan */
+    std::string jpeg(rng_t &rng) {
+        std::string ret("\xff\xd8", 2);
+        ret += std::string("\xff\xe0\x00\x10JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00", 18);
+
+        std::vector<std::pair<uint16_t, std::string>> ascii = {
+            {0x010f, "Synthetic"},                                          // Make
+            {0x0110, std::string("Camera ") + rng.word()},                  // Model
+            {0x0132, "2017:0" + std::to_string(1 + rng.below(9))}};        // DateTime, below
+        ascii[2].second += ":1" + std::to_string(rng.below(10));
+        ascii[2].second += " 12:" + std::to_string(10 + rng.below(50)) + ":00";
+        std::string tiff = "II*";
+        tiff.push_back('\0');
+        put32(tiff, 8);
+        put16(tiff, ascii.size());
+        uint32_t value_offset = 8 + 2 + 12 * ascii.size() + 4;
+        std::string values;
+        for (auto &it : ascii) {
+            it.second.push_back('\0');
+            put16(tiff, it.first); put16(tiff, 2); put32(tiff, it.second.size());
+            put32(tiff, value_offset + values.size());
+            values += it.second;
+        }
+        put32(tiff, 0);                                 // no next IFD
+        tiff += values;
+        ret += "\xff\xe1";
+        put16be(ret, 2 + 6 + tiff.size());
+        ret += std::string("Exif\0\0", 6) + tiff;
+
+        ret += std::string("\xff\xdb\x00\x43\x00", 5);
+        for (int i = 0; i < 64; i++) ret.push_back(char(1 + rng.below(64)));
+        ret += std::string("\xff\xc0\x00\x0b\x08", 5);
+        put16be(ret, 8 + rng.below(1000));             // height
+        put16be(ret, 8 + rng.below(1000));             // width
+        ret += std::string("\x01\x01\x11\x00", 4);
+        ret += std::string("\xff\xda\x00\x08\x01\x01\x00\x00\x3f\x00", 10);
+        for (int i = 0; i < 256; i++) ret.push_back(char(rng.below(255)));  // no 0xff in the scan
+        ret += "\xff\xd9";
+        return ret;
+    }
+
+    /* An in-use MFT FILE record with $STANDARD_INFORMATION and $FILE_NAME, with its fixups applied */
+    std::string ntfs(rng_t &rng) {
+        std::string name = rng.word();
+        name += std::to_string(rng.below(1000)) + ".doc";
+        const uint64_t filetime = 131000000000000000ULL + rng.below(10000000000000000ULL);
+        std::string r(NTFS_ALIGN, '\0');
+        memcpy(&r[0], "FILE", 4);
+        set16(r, 0x04, 0x30);                          // update sequence offset
+        set16(r, 0x06, 3);                             // update sequence count: the number and 2 sectors
+        set16(r, 0x10, 1);                             // sequence number
+        set16(r, 0x12, 1);                             // link count
+        set16(r, 0x14, 0x38);                          // first attribute
+        set16(r, 0x16, 1);                             // in use
+        set32(r, 0x1c, NTFS_ALIGN);                    // bytes allocated
+        set32(r, 0x2c, rng.below(1000000));            // record number
+
+        std::string attrs;
+        auto attribute = [&](uint32_t type, const std::string &content) {
+            const size_t len = (0x18 + content.size() + 7) & ~size_t(7);
+            std::string a;
+            put32(a, type); put32(a, len);
+            a.push_back(0); a.push_back(0); put16(a, 0);            // resident, no name
+            put16(a, 0); put16(a, attrs.size() / 8);                // flags, id
+            put32(a, content.size()); put16(a, 0x18); put16(a, 0);  // content size and offset
+            a += content;
+            a.resize(len, '\0');
+            attrs += a;
+        };
+        std::string si;
+        for (int i = 0; i < 4; i++) { put32(si, uint32_t(filetime)); put32(si, uint32_t(filetime >> 32)); }
+        si.resize(0x48, '\0');
+        attribute(0x10, si);
+        std::string fn;
+        put32(fn, 5); put32(fn, 0x00010000);            // parent: the root directory, sequence 1
+        for (int i = 0; i < 4; i++) { put32(fn, uint32_t(filetime)); put32(fn, uint32_t(filetime >> 32)); }
+        put32(fn, 4096); put32(fn, 0); put32(fn, 1000 + rng.below(3000)); put32(fn, 0);
+        put32(fn, 0x20); put32(fn, 0);                  // archive, no reparse point
+        fn.push_back(char(name.size()));
+        fn.push_back(1);                                // Win32 namespace
+        for (char ch : name) { fn.push_back(ch); fn.push_back(0); }
+        attribute(0x30, fn);
+        put32(attrs, 0xffffffff);
+        memcpy(&r[0x38], attrs.data(), attrs.size());
+        set32(r, 0x18, 0x38 + attrs.size());           // bytes in use
+
+        const uint16_t usn = 1 + rng.below(0xfffe);
+        set16(r, 0x30, usn);
+        for (int s = 1; s <= 2; s++) {
+            r[0x30 + 2 * s]     = r[512 * s - 2];
+            r[0x30 + 2 * s + 1] = r[512 * s - 1];
+            set16(r, 512 * s - 2, usn);
+        }
+        return r;
+    }
+
+    /* A pcap record of an Ethernet frame with an IPv4/TCP HTTP request */
+    std::string packet(rng_t &rng) {
+        std::string payload = "GET /" + std::string(rng.word());
+        payload += ".html HTTP/1.1\r\nHost: www.example" + std::to_string(rng.below(100)) + ".com\r\n\r\n";
+        std::string ip;
+        ip.push_back(0x45); ip.push_back(0);
+        put16be(ip, 20 + 20 + payload.size());
+        put16be(ip, rng.below(65536)); put16be(ip, 0x4000);
+        ip.push_back(64); ip.push_back(6);             // TTL, TCP
+        put16be(ip, 0);                                 // checksum, below
+        put32be(ip, 0x0a000000 | rng.below(1 << 24));   // 10.x.x.x
+        put32be(ip, 0xc0a80000 | rng.below(1 << 16));   // 192.168.x.x
+        uint32_t sum = 0;
+        for (size_t i = 0; i < 20; i += 2) sum += (uint8_t(ip[i]) << 8) | uint8_t(ip[i + 1]);
+        while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+        ip[10] = char(~sum >> 8);
+        ip[11] = char(~sum);
+        put16be(ip, 1024 + rng.below(60000)); put16be(ip, 80);
+        put32be(ip, rng.next()); put32be(ip, 0);
+        ip.push_back(0x50); ip.push_back(0x18);        // header length, PSH ACK
+        put16be(ip, 65535); put16be(ip, 0); put16be(ip, 0);
+        ip += payload;
+
+        std::string frame;
+        frame += std::string("\x00\x1b\x21", 3);
+        for (int i = 0; i < 3; i++) frame.push_back(char(rng.below(256)));
+        frame += std::string("\x00\x0c\x29", 3);
+        for (int i = 0; i < 3; i++) frame.push_back(char(rng.below(256)));
+        frame += std::string("\x08\x00", 2);
+        frame += ip;
+
+        std::string ret;
+        put32(ret, 1420070400 + rng.below(100000000)); put32(ret, rng.below(1000000));
+        put32(ret, frame.size()); put32(ret, frame.size());
+        return ret + frame;
+    }
+
+    /* The 176-byte AES-128 key schedule of a random key */
+    std::string aes(rng_t &rng) {
+        static uint8_t sbox[256];
+        static bool have_sbox = [] {
+            /* the S-box from the multiplicative inverse in GF(2^8) and the affine transform */
+            uint8_t p = 1, q = 1;
+            do {
+                p = p ^ uint8_t(p << 1) ^ (p & 0x80 ? 0x1b : 0);
+                q ^= q << 1; q ^= q << 2; q ^= q << 4;
+                if (q & 0x80) q ^= 0x09;
+                auto rotl = [](uint8_t x, int s) { return uint8_t((x << s) | (x >> (8 - s))); };
+                sbox[p] = q ^ rotl(q, 1) ^ rotl(q, 2) ^ rotl(q, 3) ^ rotl(q, 4) ^ 0x63;
+            } while (p != 1);
+            sbox[0] = 0x63;
+            return true;
+        }();
+        (void)have_sbox;
+        uint8_t w[176];
+        for (int i = 0; i < 16; i++) w[i] = uint8_t(rng.below(256));
+        uint8_t rcon = 1;
+        for (int i = 16; i < 176; i += 4) {
+            uint8_t t[4] = {w[i - 4], w[i - 3], w[i - 2], w[i - 1]};
+            if (i % 16 == 0) {
+                const uint8_t t0 = t[0];
+                t[0] = sbox[t[1]] ^ rcon; t[1] = sbox[t[2]]; t[2] = sbox[t[3]]; t[3] = sbox[t0];
+                rcon = uint8_t(rcon << 1) ^ (rcon & 0x80 ? 0x1b : 0);
+            }
+            for (int j = 0; j < 4; j++) w[i + j] = w[i + j - 16] ^ t[j];
+        }
+        return std::string(reinterpret_cast<const char *>(w), sizeof(w));
+    }
+
+    std::string item(synthetic_image::kind_t k, rng_t &rng) {
+        switch (k) {
+        case synthetic_image::EMAIL:  return "\nTo: " + email(rng) + "\n";
+        case synthetic_image::URL:    return "\n<a href=\"" + url(rng) + "\">\n";
+        case synthetic_image::CCN: {
+            const std::string number = ccn(rng);
+            return "\nCard: " + number + " exp 0" + std::to_string(1 + rng.below(9)) + "/29\n";
+        }
+        case synthetic_image::BASE64: return base64(rng);
+        case synthetic_image::GZIP:   return deflated(feature_text(rng, 32), 15 + 16);
+        case synthetic_image::ZIP:    return zip(rng);
+        case synthetic_image::JPEG:   return jpeg(rng);
+        case synthetic_image::NTFS:   return ntfs(rng);
+        case synthetic_image::PACKET: return packet(rng);
+        case synthetic_image::AES:    return aes(rng);
+        case synthetic_image::KINDS:  break;
+        }
+        return std::string();
+    }
+}
+
+const char *synthetic_image::kind_name(kind_t k)
+{
+    return k < KINDS ? KIND_NAMES[k] : "";
+}
+
+synthetic_image::synthetic_image(const std::string &spec)
+{
+    if (!is_synthetic(spec)) throw std::invalid_argument("not a synthetic image: " + spec);
+    std::copy(DEFAULT_DENSITY, DEFAULT_DENSITY + KINDS, density_);
+    std::vector<std::string> parts = split(spec.substr(PREFIX.size()), ',');
+    if (parts.empty() || parts[0].empty()) throw std::invalid_argument(spec + ": no image size");
+    try {
+        const int64_t size = scaled_stoi64(parts[0]);
+        if (size <= 0) throw std::invalid_argument("size");
+        size_ = size;
+        double scale = 1;
+        for (size_t i = 1; i < parts.size(); i++) {
+            const size_t eq = parts[i].find('=');
+            if (eq == std::string::npos) throw std::invalid_argument(parts[i]);
+            const std::string name = parts[i].substr(0, eq), value = parts[i].substr(eq + 1);
+            if (name == "seed") { seed_ = std::stoull(value); continue; }
+            if (name == "scale") {
+                scale = std::stod(value);
+                if (!(scale >= 0)) throw std::invalid_argument(parts[i]);
+                continue;
+            }
+            if (name == "fill") {
+                if      (value == "random") fill_ = FILL_RANDOM;
+                else if (value == "zero")   fill_ = FILL_ZERO;
+                else if (value == "text")   fill_ = FILL_TEXT;
+                else throw std::invalid_argument(parts[i]);
+                continue;
+            }
+            const char **k = std::find_if(KIND_NAMES, KIND_NAMES + KINDS, [&](const char *n) { return name == n; });
+            if (k == KIND_NAMES + KINDS) throw std::invalid_argument(parts[i]);
+            const double d = std::stod(value);
+            if (!(d >= 0)) throw std::invalid_argument(parts[i]);
+            density_[k - KIND_NAMES] = d;
+        }
+        for (auto &it : density_) it *= scale;
+    }
+    catch (const std::logic_error &e) {         // std::invalid_argument and std::out_of_range
+        throw std::invalid_argument(spec + ": invalid synthetic image specification (" + e.what() + ")");
+    }
+}
+
+std::string synthetic_image::str() const
+{
+    std::stringstream ss;
+    ss << PREFIX << size_ << ",seed=" << seed_ << ",fill="
+       << (fill_ == FILL_ZERO ? "zero" : fill_ == FILL_TEXT ? "text" : "random");
+    for (int k = 0; k < KINDS; k++) ss << "," << KIND_NAMES[k] << "=" << density_[k];
+    return ss.str();
+}
+
+void synthetic_image::slot(uint64_t n, uint8_t *out, uint64_t *counts) const
+{
+    rng_t rng(seed_ * 0x2545f4914f6cdd1dULL ^ (n + 1) * 0x9e3779b97f4a7c15ULL);
+
+    switch (fill_) {
+    case FILL_ZERO:
+        memset(out, 0, SLOT_SIZE);
+        break;
+    case FILL_RANDOM:
+        for (size_t i = 0; i < SLOT_SIZE; i += 8) {
+            const uint64_t v = rng.next();
+            memcpy(out + i, &v, 8);
+        }
+        break;
+    case FILL_TEXT:
+        for (size_t i = 0; i < SLOT_SIZE;) {
+            const char *w = rng.word();
+            const size_t len = std::min(strlen(w), SLOT_SIZE - i);
+            memcpy(out + i, w, len);
+            i += len;
+            if (i < SLOT_SIZE) out[i++] = rng.below(8) ? ' ' : '\n';
+        }
+        break;
+    }
+
+    /* the items of this slot, in a random order, placed with random gaps that leave room for the rest */
+    std::vector<std::pair<kind_t, std::string>> items;
+    for (int k = 0; k < KINDS; k++) {
+        const double expected = density_[k] * SLOT_SIZE / MIB;
+        uint64_t count = uint64_t(expected);
+        if (rng.uniform() < expected - std::floor(expected)) count++;
+        for (uint64_t i = 0; i < count; i++) items.emplace_back(kind_t(k), item(kind_t(k), rng));
+    }
+    for (size_t i = items.size(); i > 1; i--) std::swap(items[i - 1], items[rng.below(i)]);
+
+    size_t remaining = 0;
+    for (const auto &it : items) remaining += it.second.size() + (it.first == NTFS ? NTFS_ALIGN : 0);
+    size_t pos = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        const std::string &bytes = items[i].second;
+        remaining -= bytes.size() + (items[i].first == NTFS ? NTFS_ALIGN : 0);
+        const size_t room = SLOT_SIZE - pos > remaining ? SLOT_SIZE - pos - remaining : 0;
+        size_t at = pos + std::min(room, size_t(rng.below(2 * room / (items.size() - i) + 1)));
+        if (items[i].first == NTFS) at = (at + NTFS_ALIGN - 1) / NTFS_ALIGN * NTFS_ALIGN;
+        if (at + bytes.size() > SLOT_SIZE) continue;    // too dense for the slot
+        memcpy(out + at, bytes.data(), bytes.size());
+        pos = at + bytes.size();
+        if (counts) counts[items[i].first]++;
+    }
+}
+
+size_t synthetic_image::read(uint8_t *buf, size_t len, uint64_t offset) const
+{
+    if (offset >= size_) return 0;
+    len = std::min<uint64_t>(len, size_ - offset);
+    thread_local std::vector<uint8_t> slot_buf;
+    slot_buf.resize(SLOT_SIZE);
+    size_t done = 0;
+    while (done < len) {
+        const uint64_t pos = offset + done;
+        const size_t in_slot = pos % SLOT_SIZE;
+        const size_t n = std::min(len - done, SLOT_SIZE - in_slot);
+        if (in_slot == 0 && n == SLOT_SIZE) {
+            slot(pos / SLOT_SIZE, buf + done);          // a whole slot goes straight into the buffer
+        } else {
+            slot(pos / SLOT_SIZE, slot_buf.data());
+            memcpy(buf + done, slot_buf.data() + in_slot, n);
+        }
+        done += n;
+    }
+    return done;
+}
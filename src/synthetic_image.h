@@ -0,0 +1,66 @@
+#ifndef SYNTHETIC_IMAGE_H
+#define SYNTHETIC_IMAGE_H
+
+/**
+ * synthetic_image: a deterministic disk image that is generated as it is read, for benchmarking
+ * scanners against the density of the features they find.
+ *
+ * The image is named by a specification rather than a file:
+ *
+ *     synthetic:SIZE[,seed=N][,fill=random|zero|text][,scale=X][,KIND=PER_MIB ...]
+ *
+ * SIZE takes the k, m, g and t suffixes of -G. The image is cut into slots of SLOT_SIZE bytes; each slot
+ * is filled with the background and then given items of each KIND at a rate of PER_MIB items per MiB
+ * (fractions are allowed; scale multiplies every density, given or default), at random positions that
+ * do not overlap; a slot that cannot hold them all drops the rest. A slot depends only on the seed,
+ * the specification and its number, so any byte of a terabyte image can be read without generating
+ * what is before it, and the same specification always gives the same image.
+ *
+ * The kinds are the feature types the scanners look for:
+ *   email, url, ccn       - lines of text (scan_email, scan_accts)
+ *   base64                - base64 of text with emails and URLs (scan_base64)
+ *   gzip, zip             - a gzip member and a one-member zip file of such text (scan_gzip, scan_zip)
+ *   jpeg                  - a JPEG with an EXIF segment (scan_exif)
+ *   ntfs                  - an MFT FILE record, 1024-byte aligned (scan_ntfsmft)
+ *   packet                - a pcap record of an Ethernet/IPv4/TCP packet (scan_net)
+ *   aes                   - an AES-128 key schedule (scan_aes)
+ */
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class synthetic_image {
+public:
+    enum kind_t { EMAIL, URL, CCN, BASE64, GZIP, ZIP, JPEG, NTFS, PACKET, AES, KINDS };
+    enum fill_t { FILL_RANDOM, FILL_ZERO, FILL_TEXT };
+
+    static inline const std::string PREFIX {"synthetic:"};
+    static inline const size_t SLOT_SIZE {65536};
+    static const char *kind_name(kind_t k);
+    static bool is_synthetic(const std::string &fname) { return fname.compare(0, PREFIX.size(), PREFIX) == 0; }
+
+    /* Parses a specification; throws std::invalid_argument if it is malformed */
+    explicit synthetic_image(const std::string &spec);
+
+    uint64_t size() const { return size_; }
+    uint64_t seed() const { return seed_; }
+    fill_t   fill() const { return fill_; }
+    double   density(kind_t k) const { return density_[k]; } // items per MiB
+    std::string str() const;                                 // the specification, with every default filled in
+
+    /* Copies bytes [offset, offset+len) of the image into buf; returns the bytes copied (short at the end) */
+    size_t read(uint8_t *buf, size_t len, uint64_t offset) const;
+
+    /* Generates one slot; out must hold SLOT_SIZE bytes. counts, if given, gets the items of each kind placed */
+    void slot(uint64_t n, uint8_t *out, uint64_t *counts = nullptr) const;
+
+private:
+    uint64_t size_ {0};
+    uint64_t seed_ {2010};
+    fill_t   fill_ {FILL_RANDOM};
+    double   density_[KINDS] {};
+};
+
+#endif
@@ -5,15 +5,22 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <filesystem>
+#include <fstream>
 #include <cstdio>
 #include <stdexcept>
+#include <fcntl.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <zlib.h>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <sstream>
 
 #include "be13_api/catch.hpp"
@@ -22,6 +29,10 @@
 #include "mach-o/dyld.h"         // Needed for _NSGetExecutablePath
 #endif
 
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
 #include "dfxml_cpp/src/dfxml_writer.h"
 #include "be13_api/path_printer.h"
 #include "be13_api/scanner_set.h"
@@ -29,21 +40,82 @@
 
 #include "bulk_extractor.h"
 #include "base64_forensic.h"
+#include "bulk_diff.h"
 #include "bulk_extractor_restarter.h"
+#include "bulk_extractor_batch.h"
+#include "bulk_extractor_scaling.h"
 #include "bulk_extractor_scanners.h"
+#include "bulk_extractor_server.h"
+#include "byte_map.h"
+#include "candidate_offload.h"
+#include "carve_extents.h"
+#include "container_limits.h"
+#include "content_affinity.h"
+#include "content_cache.h"
+#include "cpu_dispatch.h"
+#include "crc32.h"
 #include "exif_reader.h"
+#include "feature_census.h"
+#include "feature_file_columnar.h"
+#include "feature_file_gzip.h"
+#include "feature_file_index.h"
+#include "feature_file_sort.h"
+#include "feature_quotas.h"
+#include "feature_shards.h"
+#include "feature_stream.h"
+#include "file_copy.h"
+#include "find_patterns.h"
+#include "forensic_path.h"
+#include "identify_filenames.h"
 #include "image_process.h"
+#include "io_throttle.h"
+#include "jpeg_candidates.h"
 #include "jpeg_validator.h"
+#include "notify_thread.h"
+#include "output_checkpoint.h"
+#include "fs_map.h"
+#include "heavy_hitters.h"
+#include "hex_runs.h"
+#include "known_blocks.h"
+#include "memory_dump.h"
+#include "memory_governor.h"
+#include "net_flows.h"
+#include "page_classifier.h"
+#include "page_dedup.h"
+#include "page_stash.h"
+#include "recorder_handle.h"
+#include "recursion_spill.h"
+#include "remote_workers.h"
+#include "page_ranges.h"
+#include "path_batch.h"
 #include "phase1.h"
 #include "sbuf_decompress.h"
+#include "sbuf_span.h"
 #include "scan_aes.h"
 #include "scan_base64.h"
+#include "scan_ccns2.h"
 #include "scan_email.h"
 #include "scan_msxml.h"
 #include "scan_net.h"
+#include "scan_outlook.h"
 #include "scan_pdf.h"
 #include "scan_vcard.h"
 #include "scan_wordlist.h"
+#include "scan_zip.h"
+#include "scanner_priority.h"
+#include "scanner_tiles.h"
+#include "scratch_arena.h"
+#include "seen_set.h"
+#include "sha256.h"
+#include "triage_planner.h"
+#include "signature_prefilter.h"
+#include "state_dump.h"
+#include "synthetic_image.h"
+#include "tld.h"
+#include "trace_writer.h"
+#include "utf16_view.h"
+#include "utf8_text.h"
+#include "worker_tuner.h"
 
 const std::string JSON1 {"[{\"1\": \"one@company.com\"}, {\"2\": \"two@company.com\"}, {\"3\": \"two@company.com\"}]"};
 const std::string JSON2 {"[{\"1\": \"one@base64.com\"}, {\"2\": \"two@base64.com\"}, {\"3\": \"three@base64.com\"}]\n"};
@@ -181,10 +253,31 @@ TEST_CASE("base64_forensic", "[support]") {
     size_t result = b64_pton_forensic(encoded, strlen(encoded), output, sizeof(output));
     REQUIRE( result == strlen(decoded) );
     REQUIRE( strncmp( (char *)output, decoded, strlen(decoded))==0 );
+
+    /* Long runs go through the 16-at-a-time decoder; line breaks, URL-safe characters and
+     * padding must decode as they do one at a time.
+     */
+    const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string data, b64, b64_url;
+    for (int i=0; i<256; i++) data += static_cast<char>(i);
+    for (size_t i=0; i<data.size(); i+=3) {
+        uint32_t v = uint8_t(data[i]) << 16 | (i+1<data.size() ? uint8_t(data[i+1]) << 8 : 0)
+                   | (i+2<data.size() ? uint8_t(data[i+2]) : 0);
+        for (size_t j=0; j<4; j++) {
+            b64 += (i+j <= data.size()) ? alphabet[(v >> (18-6*j)) & 0x3f] : '=';
+        }
+        if ((i/3) % 19 == 18) b64 += "\r\n";         // 76 characters a line
+    }
+    for (char ch : b64) b64_url += (ch=='+') ? '-' : (ch=='/') ? '_' : ch;
+    unsigned char output2[512];
+    for (const auto &s : {b64, b64_url}) {
+        result = b64_pton_forensic(s.c_str(), s.size(), output2, sizeof(output2));
+        REQUIRE( result == data.size() );
+        REQUIRE( memcmp(output2, data.data(), data.size()) == 0 );
+    }
 }
 
 TEST_CASE("scan_base64_functions", "[support]" ){
-    base64array_initialize();
     sbuf_t sbuf1("W3siMSI6ICJvbmVAYmFzZTY0LmNvbSJ9LCB7IjIiOiAidHdvQGJhc2U2NC5jb20i");
     bool found_equal = false;
     REQUIRE(sbuf_line_is_base64(sbuf1, 0, sbuf1.bufsize, found_equal) == true);
@@ -202,6 +295,670 @@ TEST_CASE("scan_base64_functions", "[support]" ){
     delete sbuf3;
 }
 
+TEST_CASE("byte_map", "[support]") {
+    uint8_t table[256];
+    for (int i = 0; i < 256; i++) {
+        table[i] = (i * 167 + 13) & 0xff;
+    }
+    /* every length up to a few vectors, so the tails are covered too */
+    for (size_t len = 0; len < 200; len++) {
+        std::vector<uint8_t> src(len), fast(len), slow(len);
+        for (size_t i = 0; i < len; i++) {
+            src[i] = (i * 31 + len) & 0xff;
+        }
+        byte_map(src.data(), fast.data(), len, table);
+        byte_map_scalar(src.data(), slow.data(), len, table);
+        REQUIRE( fast == slow );
+        byte_map_xor(src.data(), fast.data(), len, 0x99);
+        for (size_t i = 0; i < len; i++) {
+            REQUIRE( fast[i] == (src[i] ^ 0x99) );
+        }
+    }
+}
+
+TEST_CASE("crc32", "[support]") {
+    REQUIRE( crc32_update(0, "123456789", 9) == 0xCBF43926 );
+    /* every length up to a few folds, in two pieces, so the tails are covered too */
+    std::vector<uint8_t> buf(300);
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = (i * 131 + 7) & 0xff;
+    }
+    for (size_t len = 0; len < buf.size(); len++) {
+        const uint32_t whole = crc32_slice8(0, buf.data(), len);
+        REQUIRE( crc32_update(0, buf.data(), len) == whole );
+        REQUIRE( crc32_update(crc32_update(0, buf.data(), len / 3), buf.data() + len / 3, len - len / 3) == whole );
+    }
+}
+
+TEST_CASE("cpu_dispatch", "[support]") {
+    REQUIRE_THROWS_AS( cpu_dispatch::set_isa("pentium"), std::invalid_argument );
+    /* each level's kernels give what the scalar ones do */
+    std::vector<uint8_t> buf(300);
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = (i * 131 + 7) & 0xff;
+    }
+    const std::string text = std::string(100, 'a') + "<\xc3\xa9>" + std::string(40, 'b');
+    for (std::string level : {"scalar", "sse2", "ssse3", "sse4.1", "avx2", "avx512", "neon"}) {
+        try {
+            cpu_dispatch::set_isa(level);
+        } catch (const std::invalid_argument &) {
+            continue;                   // another architecture's
+        }
+        REQUIRE( cpu_dispatch::xml_attributes().find("cpu_isa='" + level + "'") != std::string::npos );
+        /* a level is its instruction set, without the hash and AES extensions */
+        REQUIRE( !cpu_dispatch::has(cpu_dispatch::SHA) );
+        REQUIRE( !cpu_dispatch::has(cpu_dispatch::AESNI) );
+        REQUIRE( !cpu_dispatch::has(cpu_dispatch::PCLMUL) );
+        REQUIRE( !cpu_dispatch::has(cpu_dispatch::ARM_SHA2) );
+        REQUIRE( cpu_dispatch::xml_attributes().find("sha256='sha-ni'") == std::string::npos );
+        if (level == "scalar") {
+            REQUIRE( cpu_dispatch::isa() == "scalar" );
+            REQUIRE( std::string(crc32_name()) == "slice8" );
+            REQUIRE( std::string(byte_map_name()) == "scalar" );
+        }
+        REQUIRE( crc32_update(0, buf.data(), buf.size()) == crc32_slice8(0, buf.data(), buf.size()) );
+        REQUIRE( utf8_text::classify(text) == (utf8_text::NON_ASCII | utf8_text::XML_SPECIAL) );
+        REQUIRE( utf8_text::valid(text) );
+        REQUIRE( !utf8_text::valid(text.substr(0, 102)) );
+    }
+    cpu_dispatch::set_isa("native");
+    REQUIRE( cpu_dispatch::features() == cpu_dispatch::detected() );
+}
+
+TEST_CASE("gzip_feature_file", "[support]") {
+    auto txt = std::filesystem::path(NamedTemporaryDirectory()) / "email.txt";
+    std::string lines = "# comment\n";
+    for (int i = 0; i < 200; i++) {
+        lines += std::to_string(i * 4096) + "\tuser" + std::to_string(i) + "@example.com\t" + std::string(i % 50, 'x') + "\n";
+    }
+    lines += "no newline at the end";
+    std::ofstream(txt, std::ios::binary) << lines;
+    gzip_feature_file(txt, 1000);
+    REQUIRE( std::filesystem::exists(txt) == false );
+
+    /* each frame is whole lines and decompresses by itself */
+    auto frames = read_gzip_index(txt.string() + ".gz.idx");
+    std::ifstream gz_in(txt.string() + ".gz", std::ios::binary);
+    std::string gz((std::istreambuf_iterator<char>(gz_in)), std::istreambuf_iterator<char>());
+    REQUIRE( frames.size() > 2 );
+    REQUIRE( frames.front().offset == 0 );
+    REQUIRE( frames.back().offset == lines.size() );
+    REQUIRE( frames.back().gz_offset == gz.size() );
+    for (size_t i = 0; i + 1 < frames.size(); i++) {
+        const size_t len = frames[i+1].offset - frames[i].offset;
+        std::string frame(len, '\0');
+        z_stream zs {};
+        REQUIRE( inflateInit2(&zs, 15 + 16) == Z_OK );
+        zs.next_in   = reinterpret_cast<Bytef *>(gz.data() + frames[i].gz_offset);
+        zs.avail_in  = frames[i+1].gz_offset - frames[i].gz_offset;
+        zs.next_out  = reinterpret_cast<Bytef *>(frame.data());
+        zs.avail_out = len;
+        REQUIRE( inflate(&zs, Z_FINISH) == Z_STREAM_END );
+        REQUIRE( zs.avail_out == 0 );
+        inflateEnd(&zs);
+        REQUIRE( frame == lines.substr(frames[i].offset, len) );
+        if (i + 2 < frames.size()) REQUIRE( frame.back() == '\n' );
+    }
+}
+
+TEST_CASE("columnar_feature_file", "[support]") {
+    auto txt = std::filesystem::path(NamedTemporaryDirectory()) / "email.txt";
+    std::vector<std::string> lines;
+    std::string text = "# comment\n";
+    for (int i = 0; i < 100000; i++) {
+        switch (i % 5) {
+        case 0: lines.push_back(std::to_string(i * 512) + "-GZIP-" + std::to_string(i % 7) + "\tuser" +
+                                std::to_string(i % 100) + "@example.com\tctx\\x00\t" + std::to_string(i)); break;
+        case 1: lines.push_back(std::to_string(i) + "\tno context"); break;
+        case 2: lines.push_back("0012\tleading zeros\t"); break;
+        case 3: lines.push_back("no tab"); break;
+        default: lines.push_back(std::to_string(i) + "\tf" + std::to_string(i % 3) + "\tc"); break;
+        }
+        text += lines.back() + "\n";
+    }
+    std::ofstream(txt, std::ios::binary) << text;
+    REQUIRE( columnar_feature_file(txt, 1000) == lines.size() );
+
+    auto cols = read_columnar_features(txt.parent_path() / "email.col");
+    REQUIRE( cols.rows() == lines.size() );
+    for (size_t i = 0; i < lines.size(); i++) {
+        REQUIRE( cols.line(i) == lines[i] );
+    }
+    REQUIRE( cols.pos0[0] == 0 );
+    REQUIRE( cols.pos0[2] == COLUMNAR_NO_POS0 );
+    REQUIRE( cols.feature[3] == COLUMNAR_NONE );
+    REQUIRE( cols.context[1] == COLUMNAR_NONE );
+    REQUIRE( cols.path_dict.size() == 10 );     // "-GZIP-0" to "-GZIP-6", "", "0012" and "no tab"
+}
+
+TEST_CASE("feature_file_sort", "[support]") {
+    REQUIRE( feature_line_before("1000\ta", "1000-GZIP-0\ta") );
+    REQUIRE( feature_line_before("1000-GZIP-9\tz", "1000-GZIP-10\ta") );
+    REQUIRE( feature_line_before("999\tz", "1000\ta") );
+    REQUIRE( feature_line_before("1000\ta", "dir/file.txt-0\ta") );
+    REQUIRE( !feature_line_before("1000\ta", "1000\ta") );
+
+    auto txt = std::filesystem::path(NamedTemporaryDirectory()) / "email.txt";
+    std::vector<std::string> lines;
+    std::string text = "# banner\n";
+    for (int i = 0; i < 20000; i++) {
+        lines.push_back(std::to_string((i * 7919) % 20000 * 512) + ((i % 3) ? "" : "-GZIP-" + std::to_string(i % 11)) +
+                        "\tuser" + std::to_string(i % 50) + "@example.com\tctx");
+        text += lines.back() + "\n";
+    }
+    std::sort(lines.begin(), lines.end(), feature_line_before);
+    for (unsigned threads : {1U, 4U}) {
+        std::ofstream(txt, std::ios::binary) << text;
+        sort_feature_file(txt, 64 * 1024, threads);  // in runs
+        std::ifstream in(txt, std::ios::binary);
+        std::string line;
+        REQUIRE( std::getline(in, line) );
+        REQUIRE( line == "# banner" );
+        for (const auto &expected : lines) {
+            REQUIRE( std::getline(in, line) );
+            REQUIRE( line == expected );
+        }
+        REQUIRE( !std::getline(in, line) );
+    }
+    REQUIRE( std::distance(std::filesystem::directory_iterator(txt.parent_path()), {}) == 1 ); // no runs left
+}
+
+TEST_CASE("bulk_diff", "[support]") {
+    auto pre = std::filesystem::path(NamedTemporaryDirectory());
+    auto post = std::filesystem::path(NamedTemporaryDirectory());
+    std::ofstream(pre / "email.txt") << "# banner\n2000\tb@x.com\tc\n1000\ta@x.com\tc\n3000\tc@x.com\tc\n"; // not sorted
+    std::ofstream(post / "email.txt") << "# banner\n1000\ta@x.com\tc\n3000\tc@x.com\tc\n3000-GZIP-5\td@x.com\tc\n";
+    std::ofstream(pre / "email_histogram.txt") << "n=3\ta@x.com\nn=1\tb@x.com\n";
+    std::ofstream(post / "email_histogram.txt") << "n=5\ta@x.com\nn=1\tb@x.com\nn=2\td@x.com\n";
+    std::ofstream(post / "only.txt") << "1\tx\n";
+    REQUIRE( !bulk_diff::is_sorted(pre / "email.txt") );
+    REQUIRE( bulk_diff::is_sorted(post / "email.txt") );
+
+    bulk_diff::options opts;
+    opts.features = true;
+    std::stringstream ss;
+    bulk_diff::diff(pre, post, opts, ss);
+    const std::string out = ss.str();
+    REQUIRE( out.find("only.txt (1 lines)") != std::string::npos );
+    REQUIRE( out.find("3\t5\t2\ta@x.com\n0\t2\t2\td@x.com\n") != std::string::npos );
+    REQUIRE( out.find("\tb@x.com\n") == std::string::npos ); // its count did not change
+    REQUIRE( out.find("2000 b@x.com is only in " + pre.string()) != std::string::npos );
+    REQUIRE( out.find("3000-GZIP-5 d@x.com is only in " + post.string()) != std::string::npos );
+    REQUIRE( out.find("IN BOTH") == std::string::npos );
+}
+
+TEST_CASE("carve_extents", "[support]") {
+    auto piece = [](uint64_t start, uint64_t end, uint64_t page, bool open_start, bool open_end) {
+        carve_extents::extent e;
+        e.start = start;
+        e.end = end;
+        e.first_page = page;
+        e.last_page_end = page + 4096;
+        e.open_start = open_start;
+        e.open_end = open_end;
+        e.ext = ".mft";
+        e.data.assign(end - start, 'A' + page / 4096);
+        return e;
+    };
+    /* the second page is scanned first; the run is joined when the first is */
+    carve_extents::registry r;
+    REQUIRE( r.add(piece(8192, 9216, 8192, true, false)).empty() );
+    REQUIRE( r.page_done(8192, 12288).empty() );
+    auto whole = r.add(piece(6144, 8192, 4096, false, true));
+    REQUIRE( whole.size() == 1 );
+    REQUIRE( whole[0].start == 6144 );
+    REQUIRE( whole[0].end == 9216 );
+    REQUIRE( whole[0].pieces == 2 );
+    REQUIRE( whole[0].data.size() == 3072 );
+    REQUIRE( whole[0].data[0] == 'B' );
+    REQUIRE( whole[0].data[3071] == 'C' );
+    REQUIRE( r.page_done(4096, 8192).empty() );
+
+    /* and in the other order, the run waits for the page after it */
+    REQUIRE( r.add(piece(36864, 40960, 36864, false, true)).empty() );
+    REQUIRE( r.page_done(36864, 40960).empty() );
+    whole = r.add(piece(40960, 41984, 40960, true, false));
+    REQUIRE( whole.size() == 1 );
+    REQUIRE( whole[0].pieces == 2 );
+    REQUIRE( r.size() == 0 );
+
+    /* a run at the start of a page after one scanned without a run into it is whole by itself */
+    REQUIRE( r.page_done(16384, 20480).empty() );
+    whole = r.add(piece(20480, 21504, 20480, true, false));
+    REQUIRE( whole.size() == 1 );
+    REQUIRE( whole[0].pieces == 1 );
+
+    /* what is left next to a page never scanned comes out at the end */
+    REQUIRE( r.add(piece(28672, 32768, 28672, false, true)).empty() );
+    REQUIRE( r.take_all().size() == 1 );
+}
+
+TEST_CASE("io_throttle", "[support]") {
+    uint64_t bandwidth = 1, iops = 2;
+    io_throttle::parse_control("# 70% of the array\nbandwidth = 700M\n\n", bandwidth, iops);
+    REQUIRE( bandwidth == 700ULL << 20 );
+    REQUIRE( iops == 2 );                     // left as it was
+    REQUIRE_THROWS_AS( io_throttle::parse_control("iops=fast", bandwidth, iops), std::invalid_argument );
+    REQUIRE_THROWS_AS( io_throttle::parse_control("latency=1", bandwidth, iops), std::invalid_argument );
+
+    /* a second of the rate goes by at once; the next reads wait */
+    io_throttle::set_limits(0, 20);
+    REQUIRE( io_throttle::enabled() );
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 30; i++) io_throttle::charge(4096);
+    REQUIRE( std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(400) );
+    io_throttle::set_limits(0, 0);
+    REQUIRE( !io_throttle::enabled() );
+}
+
+TEST_CASE("net_flows", "[support]") {
+    const uint8_t a[] = "a datagram", b[] = "another datagram";
+    net_flows::key_t k;
+    k.family = AF_INET;
+    k.proto = IPPROTO_TCP;
+    k.sport = 80;
+    k.dport = 5555;
+
+    /* a copy is counted in its flow but not written again */
+    REQUIRE( net_flows::add(a, sizeof(a), pos0_t("", 4096), &k) );
+    REQUIRE( !net_flows::add(a, sizeof(a), pos0_t("", 100), &k) );
+    REQUIRE( net_flows::add(b, sizeof(b), pos0_t("", 9000), &k) );
+    k.dport = 5556;
+    REQUIRE( !net_flows::add(b, sizeof(b), pos0_t("", 200), &k) );
+    REQUIRE( !net_flows::add(b, sizeof(b), pos0_t("", 300), nullptr) );
+
+    auto flows = net_flows::take();
+    REQUIRE( flows.size() == 2 );
+    REQUIRE( flows[0].first.dport == 5555 );
+    REQUIRE( flows[0].second.packets == 2 );
+    REQUIRE( flows[0].second.copies == 1 );
+    REQUIRE( flows[0].second.bytes == sizeof(a) + sizeof(b) );
+    REQUIRE( flows[0].second.first.offset == 100 );
+    REQUIRE( flows[0].second.last.offset == 9000 );
+    REQUIRE( flows[1].second.packets == 0 );
+    REQUIRE( flows[1].second.copies == 1 );
+    REQUIRE( net_flows::take().empty() );
+}
+
+TEST_CASE("state_dump", "[support]") {
+    auto outdir = std::filesystem::path(NamedTemporaryDirectory());
+    const auto first = state_dump::write(outdir, {{"tasks_queued", "3"}});
+    REQUIRE( first.filename() == "state_dump-" + std::to_string(state_dump::dumps) + ".json" );
+    const auto second = state_dump::write(outdir, {});
+    REQUIRE( second != first );
+    REQUIRE( std::filesystem::exists(first) );
+    REQUIRE( !std::filesystem::exists(second.string() + ".tmp") );
+
+    std::ifstream in(first);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    REQUIRE( text.find("\"threads\": [") != std::string::npos );
+    REQUIRE( text.find("\"memory_governor\": {") != std::string::npos );
+    REQUIRE( text.find("\"tasks_queued\": 3") != std::string::npos );
+}
+
+TEST_CASE("feature_quotas", "[support]") {
+    REQUIRE_THROWS_AS( feature_quotas::set("url", "", ""), std::invalid_argument );
+    REQUIRE_THROWS_AS( feature_quotas::set("", "url:many", ""), std::invalid_argument );
+    REQUIRE( feature_quotas::page_of("8192-GZIP-10\tfeature\tcontext", 4096) == 2 );
+
+    feature_quotas::set("", "url:100", "url:2");
+    feature_quotas::set_pagesize(4096);
+    REQUIRE( feature_quotas::any() );
+    REQUIRE( feature_quotas::streamed_recorders() == std::set<std::string>{"url"} );
+    feature_quotas::stream_sink sink;
+    sink.write("url", "10\ta\tx\n20\tb\tx\n30\tc\tx\n5000\td\tx\n");   // 3 on page 0, 1 on page 1
+    auto attrs = feature_quotas::xml_attributes()["url"];
+    REQUIRE( attrs.find("bytes='30'") != std::string::npos );
+    REQUIRE( attrs.find("pages_over='1' lines_over_page='1'") != std::string::npos );
+    REQUIRE( attrs.find("reached=") == std::string::npos );
+
+    sink.write("url", std::string("9000\t") + std::string(80, 'u') + "\tx\n12000\te\tx\n");
+    attrs = feature_quotas::xml_attributes()["url"];
+    REQUIRE( attrs.find("reached='bytes' cutoff='9000'") != std::string::npos );
+    feature_quotas::set("", "", "");
+    REQUIRE( !feature_quotas::any() );
+}
+
+TEST_CASE("feature_shards", "[support]") {
+    feature_shards::set_recorders("email", 2);
+    std::string merged;
+    REQUIRE( feature_shards::shard_name("email", 3) == "email.t03" );
+    REQUIRE( feature_shards::merged_name("email.t03.txt", merged) );
+    REQUIRE( merged == "email.txt" );
+    REQUIRE( feature_shards::merged_name("email.t10_domain_histogram.txt", merged) );
+    REQUIRE( merged == "email_domain_histogram.txt" );
+    REQUIRE( !feature_shards::merged_name("email.txt", merged) );
+    REQUIRE( !feature_shards::merged_name("url.t00.txt", merged) );   // not sharded
+    REQUIRE( feature_shards::recorder_of("email.t01") == "email" );
+
+    auto outdir = std::filesystem::path(NamedTemporaryDirectory());
+    auto write = [&](const std::string &fname, const std::string &text) {
+        std::ofstream os(outdir / fname);
+        os << text;
+    };
+    write("email.txt", "# Feature-Recorder: email\n");
+    write("email.t00.txt", "# Feature-Recorder: email.t00\n100\ta@b.com\tctx\n");
+    write("email.t01.txt", "# Feature-Recorder: email.t01\n200\tc@d.com\tctx\n");
+    write("email_histogram.txt", "# Feature-Recorder: email\n");
+    write("email.t00_histogram.txt", "n=2\ta@b.com\nn=1\tc@d.com\t(utf16=1)\n");
+    write("email.t01_histogram.txt", "n=3\tc@d.com\t(utf16=2)\n");
+    feature_shards::merge(outdir);
+    feature_shards::set_recorders("", 1);
+
+    REQUIRE( !std::filesystem::exists(outdir / "email.t00.txt") );
+    REQUIRE( !std::filesystem::exists(outdir / "email.t01_histogram.txt") );
+    auto read = [&](const std::string &fname) {
+        std::ifstream in(outdir / fname);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    };
+    REQUIRE( read("email.txt") == "# Feature-Recorder: email\n100\ta@b.com\tctx\n200\tc@d.com\tctx\n" );
+    REQUIRE( read("email_histogram.txt") == "# Feature-Recorder: email\nn=4\tc@d.com\t(utf16=3)\nn=2\ta@b.com\n" );
+}
+
+TEST_CASE("remote_workers", "[support]") {
+    const std::string a("page one"), b("two");
+    auto payload = remote_workers::encode_pages({
+            remote_workers::encode_page(0, 4, reinterpret_cast<const uint8_t *>(a.data()), a.size()),
+            remote_workers::encode_page(1ULL << 40, 3, reinterpret_cast<const uint8_t *>(b.data()), b.size())});
+    auto pages = remote_workers::decode_pages(payload);
+    REQUIRE( pages.size() == 2 );
+    REQUIRE( pages[0].offset == 0 );
+    REQUIRE( pages[0].pagesize == 4 );
+    REQUIRE( std::string(pages[0].buf.begin(), pages[0].buf.end()) == a );
+    REQUIRE( pages[1].offset == 1ULL << 40 );
+    REQUIRE( std::string(pages[1].buf.begin(), pages[1].buf.end()) == b );
+    REQUIRE_THROWS_AS( remote_workers::decode_pages(payload.substr(0, payload.size() - 1)), std::runtime_error );
+
+    std::string host, port;
+    remote_workers::split_hostport("example.com:7000", host, port);
+    REQUIRE( host == "example.com" );
+    REQUIRE( port == "7000" );
+    remote_workers::split_hostport("[::1]:7000", host, port);
+    REQUIRE( host == "::1" );
+    remote_workers::split_hostport("7000", host, port);
+    REQUIRE( host == "" );
+    REQUIRE( port == "7000" );
+    REQUIRE_THROWS_AS( remote_workers::split_hostport("host:", host, port), std::invalid_argument );
+
+    REQUIRE( remote_workers::safe_relpath("jpeg_carved/000/1-0.jpg") );
+    REQUIRE( !remote_workers::safe_relpath("../report.xml") );
+    REQUIRE( !remote_workers::safe_relpath("/etc/passwd") );
+    REQUIRE( !remote_workers::safe_relpath("jpeg_carved/../../x") );
+
+    remote_workers::set_token("secret");
+    REQUIRE( remote_workers::hello_valid(remote_workers::PROTOCOL + "\nsecret") );
+    REQUIRE( !remote_workers::hello_valid(remote_workers::PROTOCOL + "\nsecreT") );
+    REQUIRE( !remote_workers::hello_valid(remote_workers::PROTOCOL) );
+    REQUIRE( !remote_workers::hello_valid("bulk_extractor remote 1") );
+    remote_workers::set_token("");
+
+    /* before HELLO, a frame may be no longer than a HELLO; it is refused before it is allocated */
+    int fds[2];
+    REQUIRE( socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0 );
+    remote_workers::connection from(fds[0]), to(fds[1]);
+    const std::string big(remote_workers::MAX_HELLO + 1, 'x');
+    remote_workers::frame_t type;
+    std::string got;
+    from.send(remote_workers::HELLO, big);
+    REQUIRE( to.recv(type, got) );
+    REQUIRE( got == big );
+    from.send(remote_workers::HELLO, big);
+    REQUIRE_THROWS_AS( to.recv(type, got, remote_workers::MAX_HELLO), std::runtime_error );
+
+    /* the deadline is for the whole frame, however slowly its bytes arrive */
+    int slow[2];
+    REQUIRE( socketpair(AF_UNIX, SOCK_STREAM, 0, slow) == 0 );
+    remote_workers::connection client(slow[0]), server(slow[1]);
+    server.set_deadline(1);
+    REQUIRE( ::send(slow[0], "H", 1, 0) == 1 );
+    REQUIRE_THROWS_AS( server.recv(type, got, remote_workers::MAX_HELLO), std::runtime_error );
+}
+
+TEST_CASE("bulk_extractor_scaling", "[support]") {
+    REQUIRE( bulk_extractor_scaling::default_threads(6) == std::vector<unsigned>({1, 2, 4, 6}) );
+    REQUIRE( bulk_extractor_scaling::default_threads(8) == std::vector<unsigned>({1, 2, 4, 8}) );
+    REQUIRE( bulk_extractor_scaling::default_threads(1) == std::vector<unsigned>({1}) );
+    REQUIRE( bulk_extractor_scaling::parse_list("65536,4m", true) == std::vector<uint64_t>({65536, 4 * 1024 * 1024}) );
+    REQUIRE_THROWS_AS( bulk_extractor_scaling::parse_list("4m", false), std::invalid_argument );
+    REQUIRE_THROWS_AS( bulk_extractor_scaling::parse_list("1,,2", false), std::invalid_argument );
+    REQUIRE_THROWS_AS( bulk_extractor_scaling::parse_list("0", false), std::invalid_argument );
+
+    bulk_extractor_scaling::point p;
+    p.threads = 4;
+    bulk_extractor_scaling::read_report("<dfxml><runtime><total_bytes>20000000</total_bytes><elapsed_seconds>2.5</elapsed_seconds>"
+                                        "<producer_wait read_seconds='0.5' decompress_seconds='0.25'/></runtime>"
+                                        "<scanner_times><scanner_time name='email' calls='3' cpu_seconds='3' wall_seconds='1'/>"
+                                        "<scanner_time name='zip' calls='1' cpu_seconds='1' wall_seconds='1'/></scanner_times></dfxml>", p);
+    REQUIRE( p.bytes == 20000000 );
+    REQUIRE( p.seconds == 2.5 );
+    REQUIRE( p.producer_wait == 0.75 );
+    REQUIRE( p.scanner_seconds == std::map<std::string, double>({{"email", 3}, {"zip", 1}}) );
+    REQUIRE( p.mb_per_sec() == 8 );
+
+    bulk_extractor_scaling::point baseline = p;
+    baseline.threads = 1;
+    baseline.seconds = 10;
+    const std::string attrs = bulk_extractor_scaling::xml_attributes(p, baseline);
+    REQUIRE( attrs.find("threads='4' ") == 0 );
+    REQUIRE( attrs.find(" speedup='4' efficiency='1' ") != std::string::npos );
+}
+
+TEST_CASE("identify_filenames", "[support]") {
+    std::stringstream dfxml("<?xml version='1.0'?>\n<dfxml><fileobject>\n"
+                            "  <filename>dir/a&amp;b.txt</filename><alloc>1</alloc><hashdigest type='md5'>aaaa</hashdigest>\n"
+                            "  <byte_runs><byte_run file_offset='0' img_offset='1000' len='512'/></byte_runs>\n"
+                            "</fileobject><fileobject>\n"
+                            "  <filename>deleted.doc</filename><unalloc>1</unalloc><hashdigest type='MD5'>bbbb</hashdigest>\n"
+                            "  <byte_runs><byte_run img_offset='1200' len='10000'/></byte_runs>\n"
+                            "</fileobject><fileobject>\n"
+                            "  <filename>big</filename><byte_runs><byte_run img_offset='0' len='100000'/></byte_runs>\n"
+                            "</fileobject></dfxml>\n");
+    identify_filenames map;
+    map.read_dfxml(dfxml);
+    REQUIRE( map.files.size() == 3 );
+    REQUIRE( map.locate(1000)->filename == "dir/a&b.txt" );  // the latest run that holds it
+    REQUIRE( map.locate(1000)->md5 == "aaaa" );
+    REQUIRE( map.locate(1512)->filename == "big" );          // allocated before unallocated
+    REQUIRE( map.locate(100000) == nullptr );
+
+    uint64_t offset = 0;
+    REQUIRE( identify_filenames::offset_of("1000-XOR-30", offset) );
+    REQUIRE( offset == 1030 );
+    REQUIRE( identify_filenames::offset_of("1000-GZIP-30", offset) );
+    REQUIRE( offset == 1000 );
+    REQUIRE( !identify_filenames::offset_of("dir/file.txt-0", offset) );
+
+    auto report = std::filesystem::path(NamedTemporaryDirectory());
+    std::ofstream(report / "email.txt") << "# banner\n1010\ta@x.com\tc\n200000-GZIP-4\tb@x.com\tc\n";
+    const auto counts = map.annotate_files(report, report / "annotated", {}, false, 2, "test");
+    REQUIRE( counts.features == 2 );
+    REQUIRE( counts.located == 1 );
+    REQUIRE( counts.encoded == 1 );
+    std::ifstream in(report / "annotated" / "annotated_email.txt");
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    REQUIRE( text.find("# Position\tFeature\tFilename\tMD5\n# test\n# banner\n") == 0 );
+    REQUIRE( text.find("\n1010\ta@x.com\tdir/a&b.txt\taaaa\n200000-GZIP-4\tb@x.com\n") != std::string::npos );
+}
+
+TEST_CASE("path_batch", "[support]") {
+    REQUIRE( path_batch::path_of("1000-GZIP-0:512/h") == "1000-GZIP-0" );
+    REQUIRE( path_batch::path_of("dir/file.txt-0/r") == "dir/file.txt-0" );
+    REQUIRE( path_batch::path_of("4096") == "4096" );
+
+    std::stringstream in("8192\n# comment\n1000-GZIP-512\n\n1000:16/h\n8192\n1000-GZIP-0\n");
+    std::stringstream out;
+    std::vector<std::string> printed;
+    REQUIRE( path_batch::run(in, out, [&printed](const std::string &path, std::ostream &os) {
+        printed.push_back(path);
+        os << "<" << path << ">\n";
+    }) == 5 );
+    REQUIRE( printed == std::vector<std::string>{"1000:16/h", "1000-GZIP-0", "1000-GZIP-512", "8192"} );
+    REQUIRE( out.str() == "<8192>\n<1000-GZIP-512>\n<1000:16/h>\n<8192>\n<1000-GZIP-0>\n" );
+}
+
+TEST_CASE("feature_file_index", "[support]") {
+    auto txt = std::filesystem::path(NamedTemporaryDirectory()) / "email.txt";
+    std::string text = "# banner\n";
+    for (int i = 0; i < 5000; i++) {
+        text += std::to_string(i * 4096) + ((i % 10) ? "" : "-GZIP-12") + "\tuser" + std::to_string(i) + "@example.com\tctx\n";
+        if (i % 1000 == 999) text += "dir/file.txt-0\tuser@example.com\tctx\n";
+    }
+    text += "20480000\tno newline";
+    std::ofstream(txt, std::ios::binary) << text;
+    const auto blocks = index_feature_file(txt, 4096);
+    REQUIRE( blocks == read_feature_index(txt.string() + ".index") );
+
+    /* the blocks cover the file, each is whole lines, and each line is where the index says */
+    REQUIRE( blocks.size() > 10 );
+    uint64_t offset = 0, lines = 0, other_lines = 0;
+    for (const auto &b : blocks) {
+        REQUIRE( b.offset == offset );
+        offset += b.length;
+        lines += b.lines;
+        other_lines += b.other_lines;
+        REQUIRE( text[b.offset + b.length - 1] == (&b == &blocks.back() ? 'e' : '\n') );
+    }
+    REQUIRE( offset == text.size() );
+    REQUIRE( lines == 5001 );
+    REQUIRE( other_lines == 5 );
+    for (const uint64_t pos0 : {0UL, 40960UL, 4096UL * 2500, 4096UL * 4999, 20480000UL}) {
+        size_t found = 0;
+        for (const auto &b : blocks) {
+            if (!b.overlaps(pos0, pos0 + 1)) continue;
+            const std::string block = text.substr(b.offset, b.length);
+            found += (block.compare(0, std::to_string(pos0).size() + 1, std::to_string(pos0) + "\t") == 0 ||
+                      block.compare(0, std::to_string(pos0).size() + 1, std::to_string(pos0) + "-") == 0 ||
+                      block.find("\n" + std::to_string(pos0) + "\t") != std::string::npos ||
+                      block.find("\n" + std::to_string(pos0) + "-") != std::string::npos);
+        }
+        REQUIRE( found == 1 );
+    }
+}
+
+TEST_CASE("sha256", "[support]") {
+    uint8_t digest[32];
+    sha256_short("abc", 3, digest);
+    const uint8_t abc[32] = {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+                             0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+    REQUIRE( memcmp(digest, abc, sizeof(abc)) == 0 );
+    /* every length that fits in one block */
+    uint8_t buf[SHA256_SHORT_MAX];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (i * 29 + 3) & 0xff;
+    }
+    for (size_t len = 0; len <= SHA256_SHORT_MAX; len++) {
+        uint8_t scalar[32];
+        sha256_short_scalar(buf, len, scalar);
+        sha256_short(buf, len, digest);
+        REQUIRE( memcmp(digest, scalar, sizeof(digest)) == 0 );
+    }
+    REQUIRE_THROWS_AS( sha256_short(buf, SHA256_SHORT_MAX + 1, digest), std::invalid_argument );
+}
+
+TEST_CASE("sbuf_span", "[support]") {
+    const uint8_t buf[] = {0x46, 0x49, 0x4c, 0x45, 0x30, 0x00, 0x03, 0x00, 0xfe, 0xff, 0x01, 0x02, 0x03, 0x04};
+    sbuf_t sbuf(pos0_t(), buf, sizeof(buf));
+    sbuf_span_le le(sbuf, 4, 10);
+    REQUIRE( le );
+    REQUIRE( le.size() == 10 );
+    REQUIRE( le.get16u(0) == sbuf.get16u(4) );
+    REQUIRE( le.get16i(4) == -2 );
+    REQUIRE( le.get32u(6) == sbuf.get32u(10) );
+    REQUIRE( le.get64u(2) == sbuf.get64u(6) );
+    sbuf_span_be be(sbuf, 10, 4);
+    REQUIRE( be.get32u(0) == 0x01020304 );
+    REQUIRE( be.get16u(2) == 0x0304 );
+    REQUIRE( sbuf_span_le(sbuf, 0, 4).equals(0, "FILE", 4) );
+
+    /* a range that does not fit is empty, as is a sub-span of one */
+    REQUIRE( !sbuf_span_le(sbuf, 4, 11) );
+    REQUIRE( !sbuf_span_le(sbuf, 15, 0) );
+    REQUIRE( sbuf_span_le(sbuf, 14, 0) );
+    REQUIRE( !le.sub(8, 3) );
+    REQUIRE( le.sub(8, 2).get16u(0) == 0x0403 );
+    REQUIRE( !le.fits(9, 2) );
+}
+
+TEST_CASE("find_patterns", "[support]") {
+    find_patterns fp;
+    fp.add("he");
+    fp.add("she");
+    fp.add("hers");
+    fp.add("ab[0-9]+");
+    fp.compile();
+    REQUIRE( fp.size() == 4 );
+    REQUIRE( fp.literal_count() == 3 );
+
+    const std::string text("uSHErs ab123\0ab9 he", 19);
+    auto found = fp.search(reinterpret_cast<const uint8_t *>(text.data()), text.size(), text.size());
+    REQUIRE( found.size() == 6 );
+    REQUIRE( found[0].pos == 1 ); REQUIRE( found[0].len == 3 ); REQUIRE( found[0].id == 1 ); // SHE
+    REQUIRE( found[1].pos == 2 ); REQUIRE( found[1].len == 2 ); REQUIRE( found[1].id == 0 ); // HE
+    REQUIRE( found[2].pos == 2 ); REQUIRE( found[2].len == 4 ); REQUIRE( found[2].id == 2 ); // HErs
+    REQUIRE( found[3].pos == 7 ); REQUIRE( found[3].len == 5 ); REQUIRE( found[3].id == 3 ); // ab123
+    REQUIRE( found[4].pos == 13 ); REQUIRE( found[4].len == 3 ); REQUIRE( found[4].id == 3 ); // ab9, after the NUL
+    REQUIRE( found[5].pos == 17 ); REQUIRE( found[5].id == 0 );
+
+    /* matches must start before the limit, but may run past it */
+    found = fp.search(reinterpret_cast<const uint8_t *>(text.data()), text.size(), 3);
+    REQUIRE( found.size() == 3 );
+    REQUIRE( found[2].len == 4 );
+}
+
+TEST_CASE("signature_prefilter", "[support]") {
+    signature_prefilter sp;
+    size_t file = sp.add("FILE", 0, 1024);
+    size_t scca = sp.add(std::string("\x00\x00\x00SCCA", 7), 1);
+    REQUIRE( sp.add("FILE", 0, 1024) == file );
+    REQUIRE_THROWS( sp.add("FILE", 0, 1000) );
+
+    /* FILE only counts at a multiple of 1024; SCCA anywhere, including past a vector block */
+    std::vector<uint8_t> buf(5000, 'x');
+    memcpy(&buf[1024], "FILE", 4);
+    memcpy(&buf[2000], "FILE", 4);
+    memcpy(&buf[4096], "FILE", 4);
+    memcpy(&buf[37], "\x11\x00\x00\x00SCCA", 8);
+    memcpy(&buf[4990], "\x17\x00\x00\x00SCCA", 8);
+    std::vector<std::vector<size_t>> found;
+    sp.search(buf.data(), buf.size(), 4096, found);
+    REQUIRE( found.size() == 2 );
+    REQUIRE( found[file] == std::vector<size_t>{1024} );
+    REQUIRE( found[scca] == std::vector<size_t>{37} );
+    sp.search(buf.data(), buf.size(), buf.size(), found);
+    REQUIRE( found[file] == (std::vector<size_t>{1024, 4096}) );
+    REQUIRE( found[scca] == (std::vector<size_t>{37, 4990}) );
+
+    /* on a disk image, a sector-aligned signature starts at a sector boundary of the image */
+    size_t lnk = sp.add("LNK", 0, 1, 512);
+    memcpy(&buf[100], "LNK", 3);
+    memcpy(&buf[412], "LNK", 3);
+    sp.search(buf.data(), buf.size(), buf.size(), found);
+    REQUIRE( found[lnk] == (std::vector<size_t>{100, 412}) );
+    sp.search(buf.data(), buf.size(), buf.size(), found, true, 100);
+    REQUIRE( found[lnk] == std::vector<size_t>{412} );
+    REQUIRE( found[file] == (std::vector<size_t>{1024, 4096}) ); // the alignment in the buffer is unchanged
+
+    /* by default (-S sector_aligned=0) a prefetch signature off a sector boundary of a depth-0 sbuf is found */
+    size_t prefetch = sp.add(std::string("\x00\x00\x00SCCA", 7), 1, 1, 512);
+    sbuf_t page(pos0_t(), buf.data(), buf.size());
+    REQUIRE( signature_prefilter::sector_aligned == false );
+    REQUIRE( sp.candidates(page, prefetch) == (std::vector<size_t>{37, 4990}) );
+    signature_prefilter::sector_aligned = true;
+    sbuf_t disk_page(pos0_t(), buf.data(), buf.size());
+    REQUIRE( sp.candidates(disk_page, prefetch).empty() );
+    signature_prefilter::sector_aligned = false;
+
+    /* a text literal added with margin is found past the limit too */
+    size_t kml = sp.add("</kml>", 0, 1, 1, true);
+    memcpy(&buf[200], "</kml>", 6);
+    memcpy(&buf[4500], "</kml>", 6);
+    sp.search(buf.data(), buf.size(), 4096, found);
+    REQUIRE( found[kml] == (std::vector<size_t>{200, 4500}) );
+    REQUIRE( found[file] == std::vector<size_t>{1024} );
+    REQUIRE( signature_prefilter::next(found[kml], 201) == 4500 );
+    REQUIRE( signature_prefilter::next(found[kml], 4501) == -1 );
+}
+
 /* scan_email.flex checks */
 TEST_CASE("scan_email1", "[support]") {
     REQUIRE( extra_validate_email("this@that.com")==true);
@@ -215,6 +972,17 @@ TEST_CASE("scan_email1", "[support]") {
     size_t domain_len = 0;
     REQUIRE( find_host_in_url(s3, &domain_len)==8);
     REQUIRE( domain_len == 10);
+
+    /* The top level domain is checked after the match, and the match cut back to one */
+    REQUIRE( tld::is_tld("com", 3) );
+    REQUIRE( tld::is_tld("MUSEUM", 6) );
+    REQUIRE( tld::is_tld("u\0k\0", 2, 2) );
+    REQUIRE( !tld::is_tld("zz", 2) );
+    REQUIRE( !tld::is_tld("example", 7) );
+    REQUIRE( email_length("bob@example.com", 15, 1, 2) == 15 );
+    REQUIRE( email_length("bob@example.com.evil", 20, 1, 2) == 15 );
+    REQUIRE( email_length("bob@example.invalid", 19, 1, 2) == 0 );
+    REQUIRE( email_length("b\0@\0x\0.\0u\0k\0", 12, 2, 1) == 12 );
 }
 
 TEST_CASE("scan_email2", "[support]") {
@@ -254,6 +1022,65 @@ TEST_CASE("sbuf_decompress_zlib_new", "[support]") {
     delete sbufp;
 }
 
+TEST_CASE("sbuf_decompress_gzip_plausible", "[support]") {
+    auto *sbufp = map_file("test_hello.gz");
+    std::vector<uint8_t> gz(sbufp->get_buf(), sbufp->get_buf() + sbufp->bufsize);
+    delete sbufp;
+    REQUIRE( sbuf_decompress::gzip_plausible(gz.data(), gz.size()) );
+    REQUIRE( !sbuf_decompress::gzip_plausible(gz.data(), 17) );  // no room for a block and the trailer
+
+    auto changed = [&gz](size_t i, uint8_t v) {
+        std::vector<uint8_t> c(gz);
+        c[i] = v;
+        return sbuf_decompress::gzip_plausible(c.data(), c.size());
+    };
+    REQUIRE( !changed(3, 0x20) );       // a reserved flag
+    REQUIRE( !changed(3, 0x08) );       // FNAME: the block would be what follows the first NUL
+    REQUIRE( !changed(7, 0xff) );       // modified in 2105
+    REQUIRE( !changed(8, 0x01) );       // XFL
+    REQUIRE( !changed(9, 0x40) );       // OS
+    REQUIRE( !changed(10, 0x07) );      // the reserved block type
+    REQUIRE( changed(9, 0xff) );        // unknown OS
+}
+
+TEST_CASE("scan_ccns2", "[scanners]") {
+    /* each buffer has a number at 5, of 16 characters; valid_ccns() agrees with valid_ccn() */
+    const char *bufs[] = {"1234 4532015112830366 ",   // Visa test number
+                          "1234 4532015112830367 ",   // Luhn
+                          "abcd 4532015112830366 ",   // the window is "bcd ", not all hex
+                          "1abcd4532015112830366 ",   // hex before
+                          "1234 4532015112830366abcd",// hex after
+                          "1234 4532015112830366\0ab",
+                          "1234 4532 0151 1283 0366"};
+    const bool expected[] = {true, false, true, false, false, true, false};
+    const size_t n = sizeof(bufs) / sizeof(bufs[0]);
+    ccn_candidate candidates[n];
+    bool valid[n];
+    for (size_t i = 0; i < n; i++) {
+        const int len = (i == n - 1) ? 19 : 16;
+        REQUIRE( valid_ccn(bufs[i] + 5, len) == expected[i] );
+        candidates[i].set(bufs[i] + 5, len);
+    }
+    valid_ccns(candidates, n, valid);
+    for (size_t i = 0; i < n; i++) {
+        REQUIRE( valid[i] == expected[i] );
+    }
+    REQUIRE( valid_ccn(bufs[0] + 5, 20) == false );
+
+    const std::string genesis = "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa";
+    REQUIRE( valid_bitcoin_address(genesis.c_str(), genesis.size()) == true );
+    REQUIRE( valid_bitcoin_address("1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNb", genesis.size()) == false );
+    REQUIRE( valid_bitcoin_address("1A1zP1eP5QGefi2DMPTfTL5SLmv7DIvfNa", genesis.size()) == false ); // I is not base58
+    REQUIRE( valid_bitcoin_address("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNLy", 34) == true );
+    uint8_t dec[25];
+    REQUIRE( unbase58(genesis.c_str(), dec, genesis.size()) == true );
+    const uint8_t genesis_dec[25] = {0x00, 0x62, 0xe9, 0x07, 0xb1, 0x5c, 0xbf, 0x27, 0xd5, 0x42, 0x53, 0x99, 0xeb,
+                                     0xf6, 0xf0, 0xfb, 0x50, 0xeb, 0xb8, 0x8f, 0x18, 0xc2, 0x9b, 0x7d, 0x93};
+    REQUIRE( memcmp(dec, genesis_dec, sizeof(dec)) == 0 );
+    REQUIRE( unbase58("zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz", dec, 34) == true );               // 58^34-1 < 2^200
+    REQUIRE( unbase58("zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz", dec, 35) == false );              // too long
+}
+
 TEST_CASE("scan_email16", "[scanners]") {
     /* utf-16 tests */
     {
@@ -269,20 +1096,90 @@ TEST_CASE("scan_email16", "[scanners]") {
     }
 }
 
+TEST_CASE("scan_email_page_dedup", "[scanners]") {
+    /* The same address, in the same surroundings, four times in the page */
+    std::string text;
+    for (int i=0; i<4; i++) text += "xxxxxxxxxxxxxxxxxxxx bob@example.com yyyyyyyyyyyyyyyyyyyy\n";
+    text += "mail alice@example.com\n";
+    page_dedup::set_recorders("email", 16);
+    auto outdir = test_scanner(scan_email, new sbuf_t(text));
+    page_dedup::set_recorders("", 16);
+    auto email_txt = getLines( outdir / "email.txt" );
+    size_t bob = 0;
+    for (const auto &line : email_txt) bob += line.find("bob@example.com") != std::string::npos;
+    REQUIRE( bob == 1 );
+    REQUIRE( requireFeature(email_txt, "21\tbob@example.com\t"));
+    REQUIRE( requireFeature(email_txt, "<page_duplicates count='4'/>"));
+    REQUIRE( requireFeature(email_txt, "alice@example.com"));
+    REQUIRE( page_dedup::collapsed >= 3 );
+}
+
+TEST_CASE("scan_gps", "[scanners]") {
+    auto *sbufp = new sbuf_t("<trkpt lat=\"38.866110\" lon=\"-77.136286\"><ele>90.98</ele><time>2010-10-16T20:46:52Z</time>"
+                             "<extensions><gpxtpx:TrackPointExtension><gpxtpx:speed>21.96</gpxtpx:speed>"
+                             "<gpxtpx:course>87.53</gpxtpx:course></gpxtpx:TrackPointExtension></extensions></trkpt>");
+    auto outdir = test_scanner(scan_gps, sbufp);
+    auto gps_txt = getLines( outdir / "gps.txt" );
+    REQUIRE( requireFeature(gps_txt, "\t2010-10-16T20:46:52Z,38.866110,-77.136286,90.98,21.96,87.53"));
+}
+
 TEST_CASE("scan_exif", "[scanners]") {
     auto *sbufp = map_file("1.jpg");
     REQUIRE( sbufp->bufsize == 7323 );
     auto res = jpeg_validator::validate_jpeg(*sbufp);
     REQUIRE( res.how == jpeg_validator::COMPLETE );
+
+    /* the shared validation gives the same answers */
+    REQUIRE( jpeg_candidates::validate(*sbufp, 0).len == res.len );
+    REQUIRE( jpeg_candidates::validate(*sbufp, 0).how == jpeg_validator::COMPLETE );
+    REQUIRE( jpeg_candidates::headers_valid(*sbufp, 0) );
+    REQUIRE( !jpeg_candidates::headers_valid(*sbufp, 1) );
+    REQUIRE( jpeg_candidates::validate(*sbufp, 1).len <= 0 );
+    size_t tiff = exif_reader::get_tiff_offset_from_exif(*sbufp);
+    if (tiff != 0 && !tiff_reader::is_maybe_valid_tiff(sbufp->slice(tiff))) tiff = 0;
+    REQUIRE( jpeg_candidates::tiff_offset(*sbufp, 0) == tiff );
     delete sbufp;
 }
 
+TEST_CASE("exif_entry_list", "[scanners]") {
+    entry_list_t entries;
+    const std::string big(entry_list_t::BLOCK_SIZE + 10, 'x');
+    entries.add(IFD0_TIFF, 0x010f, "Make", "Canon");
+    entries.add(IFD0_EXIF, 0x1234, "", "1/2 3/4");
+    entries.add(IFD1_GPS, 0x0002, "GPSLatitude", big);
+    entries.add(IFD0_TIFF, 0x0110, "Model", "EOS");
+    REQUIRE( entries.size() == 4 );
+    REQUIRE( entries[0].value == "Canon" );       // not moved by the later blocks
+    REQUIRE( entries[0].get_full_name() == "ifd0.tiff.Make" );
+    REQUIRE( entries[1].get_full_name() == "ifd0.exif.entry_0x1234" );
+    REQUIRE( entries[2].value == big );
+    REQUIRE( entries[3].value == "EOS" );
+
+    entries.clear();
+    REQUIRE( entries.empty() );
+    entries.add(IFD0_GPS, 0x0001, "GPSLatitudeRef", "N");
+    REQUIRE( entries[0].get_full_name() == "ifd0.gps.GPSLatitudeRef" );
+    REQUIRE( entries[0].value == "N" );
+
+    /* Copyright keeps the name that earlier versions gave it; elsewhere its tag is an unnamed entry */
+    entries.add(IFD0_TIFF, 0x8298, "", "(c) someone");
+    entries.add(IFD0_EXIF, 0x8298, "", "x");
+    REQUIRE( entries[1].get_full_name() == "ifd0.tiff." );
+    REQUIRE( entries[2].get_full_name() == "ifd0.exif.entry_0x8298" );
+}
+
 TEST_CASE("scan_msxml","[scanners]") {
     auto *sbufp = map_file("KML_Samples.kml");
     std::string bufstr = msxml_extract_text(*sbufp);
     REQUIRE( bufstr.find("http://maps.google.com/mapfiles/kml/pal3/icon19.png") != std::string::npos);
     REQUIRE( bufstr.find("A collection showing how easy it is to create 3-dimensional") != std::string::npos);
+    REQUIRE( msxml_is_binary(*sbufp) == false );
     delete sbufp;
+
+    auto para = sbuf_t("<?xml ?><w:p><w:t>one</w:t></w:p><w:p><w:t>two</w:t></w:p>");
+    REQUIRE( msxml_extract_text(para) == "one\ntwo\n" );
+    auto binary = sbuf_t("<?xml \x01\x02\x03\x04\x05\x06\x07\x08");
+    REQUIRE( msxml_is_binary(binary) == true );
 }
 
 TEST_CASE("scan_json1", "[scanners]") {
@@ -299,6 +1196,15 @@ TEST_CASE("scan_json1", "[scanners]") {
     REQUIRE(true);
 }
 
+TEST_CASE("scan_json2", "[scanners]") {
+    /* false starts, then strings and whitespace long enough to be skipped 16 bytes at a time */
+    auto *sbufp = new sbuf_t("x{not json [1,2 x {\"name\": \"a string that is longer than sixteen bytes\",   "
+                             "\"list\": [1, 2, 3],    \"esc\": \"\\\" \\\\ \\u00e9\"} end");
+    auto outdir = test_scanner(scan_json, sbufp); // delete sbufp
+    auto json_txt = getLines( outdir / "json.txt" );
+    REQUIRE( requireFeature(json_txt, "18\t{\"name\": \"a string that is longer than sixteen bytes\",   \"list\": [1, 2, 3],") );
+}
+
 
 
 /****************************************************************
@@ -424,6 +1330,80 @@ TEST_CASE("scan_net", "[scanners]") {
     REQUIRE( scan_net_t::sanityCheckIP46Header( sbufip, 0 , &h) == false );
 }
 
+/* IPv6 UDP from 2001:db8::1 port 5353 to 2001:db8::2 port 53, with the payload "abcd" */
+uint8_t packet_ip6_udp[] = {
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x11, 0x40, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x14, 0xe9, 0x00, 0x35, 0x00, 0x0c, 0xca, 0x7c,
+    0x61, 0x62, 0x63, 0x64
+};
+
+TEST_CASE("scan_net_checksums", "[scanners]") {
+    /* the vector sum is the same as word by word, at any alignment and length */
+    uint8_t data[1000];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (i * 37 + 11) & 0xff;
+    for (size_t start : {0, 1, 7}) {
+        for (size_t len : {0, 1, 15, 16, 33, 990}) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i + 1 < len; i += 2) sum += data[start + i] | (data[start + i + 1] << 8);
+            if (len % 2) sum += data[start + len - 1];
+            while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+            REQUIRE( scan_net_t::ones_complement_sum(data + start, len, 0) == sum );
+        }
+    }
+
+    uint8_t buf[256];
+    memset(buf, 0xee, sizeof(buf));
+    memcpy(buf + 3, packet_ip6_udp, sizeof(packet_ip6_udp));
+    sbuf_t sbuf(pos0_t(), buf, sizeof(buf));
+    scan_net_t::generic_iphdr_t h;
+    REQUIRE( scan_net_t::sanityCheckIP46Header( sbuf, 3, &h) == true );
+    REQUIRE( h.checksum_valid == true );
+
+    buf[3 + 48]++;                      // change the payload
+    REQUIRE( scan_net_t::sanityCheckIP46Header( sbuf, 3, &h) == true );
+    REQUIRE( h.checksum_valid == false );
+}
+
+TEST_CASE("pdf_extract_text", "[scanners]") {
+    /* words without spaces are separated; an unclosed word runs to the end */
+    sbuf_t sbuf1("BT [(Hel)-20(lo)] TJ (wor)(ld) [ignored] (a");
+    REQUIRE( pdf_extractor::extract_text(sbuf1) == "Hel lo wor ld a" );
+    sbuf_t sbuf2("[(Hello )(world)] ((nested) x");
+    REQUIRE( pdf_extractor::extract_text(sbuf2) == "Hello world(nested" );
+    REQUIRE( pdf_extractor::mostly_printable_ascii(sbuf1) == true );
+    std::string binary(100, '\001');
+    binary.replace(0, 90, 90, 'x');
+    REQUIRE( pdf_extractor::mostly_printable_ascii(sbuf_t(binary.c_str())) == false ); // 90 of 100 is not more than 90%
+}
+
+TEST_CASE("scan_outlook_extents", "[scanners]") {
+    /* Two data blocks 64 bytes apart, an internal block, and a trailer whose CRC does not match */
+    std::string buf(16384, '\xee');
+    auto put_le = [&buf](size_t off, uint64_t v, int n) {
+        for (int i=0; i<n; i++) buf[off+i] = char(v >> (8*i));
+    };
+    auto block = [&](size_t start, size_t cb, uint64_t bid, bool good) {
+        for (size_t i=0; i<cb; i++) buf[start+i] = char(i * 7);
+        const size_t e = start + (cb + 16 + 63) / 64 * 64;
+        const uint32_t crc = crc32(0xffffffffUL, reinterpret_cast<const Bytef *>(&buf[start]), cb) ^ 0xffffffffUL;
+        put_le(e - 16, cb, 2);
+        put_le(e - 12, good ? crc : crc + 1, 4);
+        put_le(e - 8, bid, 8);
+        return e;
+    };
+    size_t e = block(1024, 100, 4, true);
+    block(e + 64, 300, 8, true);
+    block(4096, 200, 6, true);          // internal
+    block(8192, 200, 12, false);
+    sbuf_t sbuf(pos0_t(), reinterpret_cast<const uint8_t *>(buf.data()), buf.size());
+    auto extents = pst_extents(sbuf);
+    REQUIRE( extents.size() == 1 );
+    REQUIRE( extents[0].start == 1024 );
+    REQUIRE( extents[0].end == e + 64 + 300 );
+    REQUIRE( extents[0].blocks.size() == 2 );
+}
+
 TEST_CASE("scan_pdf", "[scanners]") {
     auto *sbufp = map_file("pdf_words2.pdf");
     pdf_extractor pe(*sbufp);
@@ -438,6 +1418,37 @@ TEST_CASE("scan_pdf", "[scanners]") {
 }
 
 
+TEST_CASE("scan_sqlite", "[scanners]") {
+    /* a database of three 512-byte pages: page 1 and page 2 are table leaves, page 3 is an overflow page */
+    auto make_db = [](uint8_t *db) {
+        memset(db, 0, 3 * 512);
+        memcpy(db, "SQLite format 3\000", 16);
+        db[16] = 0x02;                                  // page size 512
+        db[18] = db[19] = 1;
+        db[21] = 64; db[22] = 32; db[23] = 32;
+        db[31] = 3;                                     // 3 pages
+        const uint8_t page1[] = {13, 0, 0, 0, 1, 0x01, 0xf4, 0, 0x01, 0xf4};  // one cell at 500
+        memcpy(db + 100, page1, sizeof(page1));
+        const uint8_t page2[] = {13, 0, 0, 0, 0, 0x02, 0x00, 0};               // no cells
+        memcpy(db + 512, page2, sizeof(page2));
+    };
+    static uint8_t buf[4 * 1536];
+    make_db(buf);
+    make_db(buf + 1536);
+    memset(buf + 1536 + 1024, 0xff, 512);               // page 3 of the second is not a page
+    make_db(buf + 3072);
+    buf[3072 + 22] = 33;                                // not a database
+    memset(buf + 4608, 0, 1536);
+
+    auto *sbufp = new sbuf_t(pos0_t(), buf, sizeof(buf));
+    auto outdir = test_scanner(scan_sqlite, sbufp);
+    auto sqlite_txt = getLines( outdir / "sqlite_carved.txt" );
+    REQUIRE( requireFeature(sqlite_txt, "<filesize>1536</filesize>"));
+    REQUIRE( requireFeature(sqlite_txt, "<filesize>1024</filesize>"));
+    REQUIRE( std::none_of(sqlite_txt.begin(), sqlite_txt.end(),
+                          [](const std::string &line) { return line.find("3072\t") == 0; }));
+}
+
 TEST_CASE("scan_vcard", "[scanners]") {
     /* Make a scanner set with a single scanner and a single command to enable all the scanners.
      */
@@ -465,6 +1476,118 @@ TEST_CASE("scan_wordlist", "[scanners]") {
     REQUIRE( wordlist_txt[2] == "Company" );
 }
 
+TEST_CASE("scan_wordlist_find_words", "[support]") {
+    /* longer than one 64-byte block, with a word across the block boundary and one left open at the end */
+    std::string text = std::string(60, ' ') + "boundary\x01 <term>\tstrings with spaces\n" + std::string(40, '.') + " open";
+    const uint8_t *buf = reinterpret_cast<const uint8_t *>(text.data());
+    std::vector<std::string_view> words;
+    Scan_Wordlist::find_words(buf, text.size(), text.size(), '!', words);
+    REQUIRE( words.size() == 6 );
+    REQUIRE( words[0] == "boundary" );
+    REQUIRE( words[0].data() - text.data() == 60 );
+    REQUIRE( words[1] == "<term>" );
+    REQUIRE( words[4] == "spaces" );
+    REQUIRE( words[5] == std::string(40, '.') );
+
+    /* strings keep their spaces; no word may start after the page */
+    words.clear();
+    Scan_Wordlist::find_words(buf, text.size(), 70, ' ', words);
+    REQUIRE( words.size() == 2 );
+    REQUIRE( words[0] == std::string(60, ' ') + "boundary" );
+    REQUIRE( words[1] == " <term>" );
+}
+
+TEST_CASE("utf8_text", "[support]") {
+    const std::string name("Documents/report-2021.docx and spreadsheets.xlsx");   // more than a block
+    REQUIRE( utf8_text::classify(name) == 0 );
+    REQUIRE( utf8_text::valid(name) );
+    std::string buf;
+    REQUIRE( utf8_text::xml_escaped(name, buf).data() == name.data() );   // not copied
+    REQUIRE( utf8_text::xml_escaped("a<b & \"c\"", buf) == "a&lt;b &amp; &quot;c&quot;" );
+    REQUIRE( utf8_text::classify("caf\xc3\xa9\tx") == (utf8_text::NON_ASCII | utf8_text::CONTROL) );
+    REQUIRE( utf8_text::valid("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 and the rest of the line") );
+    REQUIRE( !utf8_text::valid("\xc0\xaf") );                 // overlong
+    REQUIRE( !utf8_text::valid("\xed\xa0\x80") );            // surrogate
+    REQUIRE( !utf8_text::valid("\xf4\x90\x80\x80") );       // past U+10FFFF
+    REQUIRE( !utf8_text::valid("sixteen bytes...\xe2\x82") ); // cut short
+}
+
+TEST_CASE("utf16_view", "[support]") {
+    /* "password" at an odd offset after 100 bytes of binary, then one at an even offset that is too short */
+    std::string buf(100, '\xff');
+    buf += '\x01';
+    for (char ch : std::string("password")) { buf += ch; buf += '\0'; }
+    buf += std::string(99, '\xff');
+    for (char ch : std::string("ab")) { buf += ch; buf += '\0'; }
+    buf += '\xff';
+    utf16_view view;
+    utf16_view::find(reinterpret_cast<const uint8_t *>(buf.data()), buf.size(), buf.size(), view);
+    REQUIRE( view.runs.size() == 1 );
+    REQUIRE( view.runs[0].offset == 101 );
+    REQUIRE( view.text_of(view.runs[0]) == "password" );
+
+    /* of() sees what is in the buffer now, as when a freed child's buffer is reused for the next child */
+    sbuf_t *child = sbuf_t::sbuf_malloc(pos0_t("0-XOR(1)", 0), buf.size(), buf.size());
+    uint8_t *cbuf = static_cast<uint8_t *>(child->malloc_buf());
+    memcpy(cbuf, buf.data(), buf.size());
+    REQUIRE( utf16_view::of(*child).runs.size() == 1 );
+    memset(cbuf, 0xff, buf.size());
+    REQUIRE( utf16_view::of(*child).runs.empty() );
+    delete child;
+}
+
+TEST_CASE("heavy_hitters", "[support]") {
+    heavy_hitters hh(4);
+    for (int i = 0; i < 100; i++) hh.add("a");
+    for (int i = 0; i < 50; i++) hh.add("b");
+    for (int i = 0; i < 20; i++) hh.add("x" + std::to_string(i)); // each once, through the other two counters
+    auto top = hh.top(2);
+    REQUIRE( hh.total() == 170 );
+    REQUIRE( top.size() == 2 );
+    REQUIRE( top[0].key == "a" );
+    REQUIRE( top[0].count == 100 );
+    REQUIRE( top[0].error == 0 );
+    REQUIRE( top[1].key == "b" );
+    REQUIRE( top[1].count - top[1].error <= 50 ); // never under the true count
+    REQUIRE( top[1].count >= 50 );
+}
+
+TEST_CASE("heavy_hitters_compiled_defs", "[support]") {
+    auto lowercase = histogram_def::flags_t(); lowercase.lowercase = true;
+    auto numeric = histogram_def::flags_t(); numeric.numeric = true;
+    heavy_hitters::compiled_defs defs({histogram_def("email1", "email", "", "", "histogram", lowercase),
+                                       histogram_def("email2", "email", "(@.*)", "", "domain_histogram", lowercase),
+                                       histogram_def("email4", "email", "(@.*)", "", "domains", lowercase),
+                                       histogram_def("email5", "email", "(@.*)", "", "domains_as_written", histogram_def::flags_t()),
+                                       histogram_def("email6", "email", "", "555", "digits", numeric)});
+    REQUIRE( defs.size() == 5 );
+    REQUIRE( defs.patterns() == 2 );    // one for each form it is searched in
+    std::vector<std::string> keys;
+    defs.keys("User@Example.COM", "context", keys);
+    REQUIRE( keys == std::vector<std::string>{"user@example.com", "@example.com", "@example.com", "@Example.COM", ""} );
+    defs.keys("(555) 123-4567", "context", keys);
+    REQUIRE( keys == std::vector<std::string>{"(555) 123-4567", "", "", "", "5551234567"} );
+}
+
+TEST_CASE("hex_runs", "[support]") {
+    /* A run of 40 digits with CRLF in it, after text whose hex words are too short, then five pairs that are too few */
+    std::string buf = "a bad cafe " + std::string(100, 'x');
+    buf += "00112233445566778899\r\nAABBCCDDEEFF00112233 z";
+    buf += std::string(100, 'x') + " 01 02 03 04 05 ";
+    std::vector<hex_runs::run> runs;
+    hex_runs::find(reinterpret_cast<const uint8_t *>(buf.data()), buf.size(), buf.size(), runs);
+    REQUIRE( runs.size() == 1 );
+    REQUIRE( runs[0].offset == 111 );
+    REQUIRE( runs[0].len == 42 );
+    REQUIRE( runs[0].pairs == 20 );
+    uint8_t out[20];
+    hex_runs::decode(reinterpret_cast<const uint8_t *>(buf.data()), runs[0], out);
+    REQUIRE( out[0] == 0x00 );
+    REQUIRE( out[9] == 0x99 );
+    REQUIRE( out[10] == 0xaa );
+    REQUIRE( out[19] == 0x33 );
+}
+
 TEST_CASE("scan_zip", "[scanners]") {
     std::vector<scanner_t *>scanners = {scan_email, scan_zip };
     auto *sbufp = map_file( "testfilex.docx" );
@@ -473,6 +1596,15 @@ TEST_CASE("scan_zip", "[scanners]") {
     REQUIRE( std::filesystem::exists( outdir / "zip/000/testfilex.docx____-0-ZIP-0__Content_Types_.xml") == true);
     REQUIRE( requireFeature(email_txt,"1771-ZIP-402\tuser_docx@microsoftword.com"));
     REQUIRE( requireFeature(email_txt,"2396-ZIP-1012\tuser_docx@microsoftword.com"));
+
+    /* the members of the central directory, by local header */
+    sbufp = map_file( "testfilex.docx" );
+    auto members = zip_central_directory(*sbufp);
+    REQUIRE( members.size() == 12 );
+    REQUIRE( members[0].local_header == 0 );
+    REQUIRE( members[2].local_header == 1771 );
+    REQUIRE( members[2].uncompr_size == 993 );
+    delete sbufp;
 }
 
 
@@ -716,6 +1848,50 @@ TEST_CASE("test_aes", "[phase1]") {
     validate("ram_2pages.bin", ex3);
 }
 
+TEST_CASE("aes_prefilter", "[phase1]") {
+    /* The kernel in use agrees with the scalar kernel, and keeps the schedules that test_aes finds */
+    auto *sbufp = map_file("ram_2pages.bin");
+    const uint8_t *buf = sbufp->get_buf();
+    const unsigned sizes = AES_PREFILTER_128 | AES_PREFILTER_192 | AES_PREFILTER_256;
+    std::set<size_t> candidates;
+    for (size_t pos = 0; pos + AES_PREFILTER_READ_SIZE <= sbufp->bufsize; pos += AES_PREFILTER_OFFSETS) {
+        uint32_t m = aes_prefilter(buf + pos, sizes);
+        REQUIRE( m == aes_prefilter_scalar(buf + pos, sizes) );
+        for (size_t i = 0; i < AES_PREFILTER_OFFSETS; i++) {
+            if ((m >> i) & 1) candidates.insert(pos + i);
+        }
+    }
+    for (size_t offset : {496, 1120, 7008, 7304}) {
+        REQUIRE( candidates.count(offset) == 1 );
+    }
+
+    /* The offload search gives back the same offsets in a range, and the last ones, which the prefilter
+     * cannot read far enough for; a backend that is not built in leaves the search on the cpu */
+    REQUIRE( candidate_offload::set_backend("no-such-device") == "cpu" );
+    std::vector<size_t> offsets;
+    candidate_offload::aes_candidates(buf, sbufp->bufsize, 1000, 7100, sizes, 0, offsets);
+    REQUIRE( std::set<size_t>(offsets.begin(), offsets.end()) ==
+             std::set<size_t>(candidates.lower_bound(1000), candidates.lower_bound(7100)) );
+    offsets.clear();
+    candidate_offload::aes_candidates(buf, sbufp->bufsize, sbufp->bufsize - 40, sbufp->bufsize, sizes, 0, offsets);
+    REQUIRE( offsets.size() == 40 );
+    delete sbufp;
+}
+
+TEST_CASE("aes_key_expansion", "[phase1]") {
+    /* The hardware validators need no tables, so they can be checked without running PHASE_INIT */
+    if (std::string(aes_key_expansion_name())=="software") return;
+    auto *sbufp = map_file("ram_2pages.bin");
+    const uint8_t *buf = sbufp->get_buf();
+    REQUIRE( valid_aes128_schedule_fast(buf + 496) );
+    REQUIRE( valid_aes128_schedule_fast(buf + 1120) );
+    REQUIRE( valid_aes256_schedule_fast(buf + 7008) );
+    REQUIRE( valid_aes256_schedule_fast(buf + 7304) );
+    REQUIRE( !valid_aes128_schedule_fast(buf + 497) );
+    REQUIRE( !valid_aes256_schedule_fast(buf + 7009) );
+    delete sbufp;
+}
+
 
 TEST_CASE("test_base16json", "[phase1]") {
     std::vector<Check> ex2 {
@@ -917,6 +2093,1056 @@ TEST_CASE("image_process", "[phase1]") {
     delete p;
 }
 
+TEST_CASE("image_process_mmap", "[phase1]") {
+    image_process *p = image_process::open( test_dir() / "test_json.txt", false, 65536, 65536);
+    p->set_use_mmap(true);
+    int times = 0;
+    for(auto it = p->begin(); it!=p->end(); ++it){
+        sbuf_t *sbufp = it.sbuf_alloc();
+        REQUIRE( sbufp->bufsize == 79 );
+        REQUIRE( sbufp->pagesize == 79 );
+        REQUIRE( sbufp->asString().substr(0, JSON1.size()) == JSON1 );
+        delete sbufp;
+        times += 1;
+    }
+    REQUIRE(times==1);
+
+    /* pread() through the mapping */
+    char buf[8];
+    REQUIRE( p->pread(buf, 3, 1) == 3 );
+    REQUIRE( std::string(buf, 3) == "{\"1" );
+    delete p;
+}
+
+TEST_CASE("image_process_margins", "[phase1]") {
+    /* Several pages, so that margins are reused, both buffered and from the direct window */
+    std::filesystem::path fname = NamedTemporaryDirectory() / "direct.raw";
+    std::string data;
+    for (int i=0; data.size() < 3*8192+100; i++) {
+        data += std::to_string(i) + " ";
+    }
+    std::ofstream(fname, std::ios::binary) << data;
+    for (bool direct : {false, true}) {
+        image_process *p = image_process::open( fname, false, 8192, 4096);
+        p->set_use_direct(direct);
+        for(auto it = p->begin(); it!=p->end(); ++it){
+            sbuf_t *sbufp = it.sbuf_alloc();
+            REQUIRE( sbufp->asString() == data.substr(sbufp->pos0.offset, sbufp->bufsize) );
+            delete sbufp;
+        }
+        delete p;
+    }
+}
+
+TEST_CASE("image_process_split", "[phase1]") {
+    /* Segments of several sizes, one of them empty, read across their boundaries by several threads */
+    std::filesystem::path dir = NamedTemporaryDirectory();
+    std::string data;
+    for (int i=0; data.size() < 40000; i++) {
+        data += std::to_string(i) + " ";
+    }
+    const std::vector<size_t> sizes {10000, 1, 0, 12345, 4096};
+    size_t start = 0;
+    for (size_t i=0; i<sizes.size(); i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "split.%03zu", i+1);
+        const size_t len = (i+1 == sizes.size()) ? data.size() - start : sizes[i];
+        std::ofstream(dir / name, std::ios::binary) << data.substr(start, len);
+        start += len;
+    }
+    image_process *p = image_process::open( dir / "split.001", false, 8192, 4096);
+    REQUIRE( p->image_size() == int64_t(data.size()) );
+    REQUIRE( p->concurrent_reads() );
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches {0};
+    for (int t=0; t<4; t++) {
+        threads.emplace_back([&, t]{
+            char buf[20000];
+            for (uint64_t off = t; off < data.size(); off += 997) {
+                const size_t want = std::min<size_t>(sizeof(buf), data.size() - off);
+                if (p->pread(buf, sizeof(buf), off) != ssize_t(want) || std::string(buf, want) != data.substr(off, want)) {
+                    mismatches++;
+                }
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+    REQUIRE( mismatches == 0 );
+    char buf[4];
+    REQUIRE( p->pread(buf, sizeof(buf), data.size()) == 0 );
+    for(auto it = p->begin(); it!=p->end(); ++it){
+        sbuf_t *sbufp = it.sbuf_alloc();
+        REQUIRE( sbufp->asString() == data.substr(sbufp->pos0.offset, sbufp->bufsize) );
+        delete sbufp;
+    }
+    delete p;
+}
+
+#ifdef HAVE_SYS_RESOURCE_H
+TEST_CASE("image_process_split_many", "[phase1]") {
+    /* More segments than descriptors: the least recently read are closed and opened again */
+    struct rlimit saved;
+    REQUIRE( getrlimit(RLIMIT_NOFILE, &saved) == 0 );
+    struct rlimit low = saved;
+    low.rlim_cur = std::min<rlim_t>(saved.rlim_cur, 128);
+    REQUIRE( setrlimit(RLIMIT_NOFILE, &low) == 0 );
+
+    std::filesystem::path dir = NamedTemporaryDirectory();
+    std::string data;
+    for (int i=0; i<300; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "many.%03d", i+1);
+        const std::string segment = std::to_string(i) + std::string(97 - std::to_string(i).size(), '.');
+        std::ofstream(dir / name, std::ios::binary) << segment;
+        data += segment;
+    }
+    image_process *p = image_process::open( dir / "many.001", false, 4096, 1024);
+    REQUIRE( p->image_size() == int64_t(data.size()) );
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches {0};
+    for (int t=0; t<4; t++) {
+        threads.emplace_back([&, t]{
+            char buf[500];
+            for (int pass=0; pass<2; pass++) {
+                for (uint64_t off = t * 7; off < data.size(); off += 293) {
+                    const size_t want = std::min<size_t>(sizeof(buf), data.size() - off);
+                    if (p->pread(buf, sizeof(buf), off) != ssize_t(want) || std::string(buf, want) != data.substr(off, want)) {
+                        mismatches++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+    delete p;
+    setrlimit(RLIMIT_NOFILE, &saved);
+    REQUIRE( mismatches == 0 );
+}
+#endif
+
+TEST_CASE("image_process_synthetic", "[phase1]") {
+    REQUIRE( image_process::is_synthetic("synthetic:1m,seed=3") );
+    REQUIRE_THROWS_AS( synthetic_image("synthetic:1m,nosuchkind=1"), std::invalid_argument );
+    REQUIRE_THROWS_AS( synthetic_image("synthetic:"), std::invalid_argument );
+
+    /* the pages agree with reads at any offset, and the same specification gives the same image */
+    const std::string spec = "synthetic:1m,seed=3,fill=zero,email=200,ntfs=16";
+    std::string whole(1024*1024, '\0');
+    REQUIRE( synthetic_image(spec).read(reinterpret_cast<uint8_t *>(whole.data()), whole.size(), 0) == whole.size() );
+    image_process *p = image_process::open( spec, false, 65536, 4096);
+    REQUIRE( p->image_size() == 1024*1024 );
+    REQUIRE( p->concurrent_reads() );
+    int pages = 0;
+    for(auto it = p->begin(); it!=p->end(); ++it){
+        sbuf_t *sbufp = it.sbuf_alloc();
+        REQUIRE( sbufp->asString() == whole.substr(sbufp->pos0.offset, sbufp->bufsize) );
+        delete sbufp;
+        pages++;
+    }
+    REQUIRE( pages == 16 );
+    char buf[100];
+    REQUIRE( p->pread(buf, sizeof(buf), 100000) == sizeof(buf) );
+    REQUIRE( std::string(buf, sizeof(buf)) == whole.substr(100000, sizeof(buf)) );
+    delete p;
+    REQUIRE( whole.find("@example") != std::string::npos );
+    REQUIRE( whole.find("FILE") % 1024 == 0 );
+}
+
+TEST_CASE("image_process_vdisk", "[phase1]") {
+    /* A QCOW2 version 3 disk of 16 64 KiB clusters: cluster 3 is stored and cluster 5 is marked as zeros */
+    auto put_be = [](std::string &s, size_t off, uint64_t v, int n) {
+        for (int i=0; i<n; i++) s[off+i] = char(v >> (8*(n-1-i)));
+    };
+    std::string f(6*65536, '\0');
+    f.replace(0, 4, "QFI\xfb");
+    put_be(f, 4, 3, 4);                 // version
+    put_be(f, 20, 16, 4);               // cluster_bits
+    put_be(f, 24, 1024*1024, 8);        // size
+    put_be(f, 36, 1, 4);                // l1_size
+    put_be(f, 40, 2*65536, 8);          // l1_table_offset
+    put_be(f, 2*65536, 3*65536, 8);     // the L2 table
+    put_be(f, 3*65536 + 3*8, 4*65536, 8);
+    put_be(f, 3*65536 + 5*8, 5*65536 | 1, 8);
+    std::fill(f.begin() + 4*65536, f.begin() + 5*65536, 'Q');
+    std::fill(f.begin() + 5*65536, f.end(), 'X');
+    std::filesystem::path fname = NamedTemporaryDirectory() / "disk.qcow2";
+    std::ofstream(fname, std::ios::binary) << f;
+
+    REQUIRE( virtual_disk::detect(fname) == virtual_disk::QCOW2 );
+    image_process *p = image_process::open( fname, false, 65536, 4096);
+    REQUIRE( p->image_size() == 1024*1024 );
+    int pages = 0, stored = 0;
+    for(auto it = p->begin(); it!=p->end(); ++it){
+        sbuf_t *sbufp = it.sbuf_alloc();
+        const size_t q = sbufp->asString().find('Q');
+        REQUIRE( sbufp->asString().find('X') == std::string::npos );
+        if (q != std::string::npos) {
+            REQUIRE( sbufp->pos0.offset + q == 3*65536 );
+            stored++;
+        }
+        delete sbufp;
+        pages++;
+    }
+    REQUIRE( pages == 16 );
+    REQUIRE( stored == 2 );             // cluster 3, and the margin of cluster 2
+    delete p;
+
+    put_be(f, 3*65536 + 7*8, 1ULL << 62, 8); // a compressed cluster
+    std::ofstream(fname, std::ios::binary) << f;
+    REQUIRE_THROWS_AS( image_process::open( fname, false, 65536, 4096), std::runtime_error );
+
+    /* VMDK headers whose sizes would overflow are refused rather than read past */
+    auto put_le = [](std::string &s, size_t off, uint64_t v, int n) {
+        for (int i=0; i<n; i++) s[off+i] = char(v >> (8*i));
+    };
+    std::string v(8*512, '\0');
+    v.replace(0, 4, "KDMV");
+    put_le(v, 12, 2048, 8);             // capacity, in sectors
+    put_le(v, 20, 128, 8);              // grain size, in sectors
+    put_le(v, 44, 0x40000001, 4);       // grain table entries; 4 bytes of table in 32 bits
+    put_le(v, 56, 1, 8);                // grain directory sector
+    put_le(v, 512, 2, 4);               // the one grain table
+    std::filesystem::path vname = NamedTemporaryDirectory() / "disk.vmdk";
+    std::ofstream(vname, std::ios::binary) << v;
+    REQUIRE( virtual_disk::detect(vname) == virtual_disk::VMDK );
+    REQUIRE_THROWS_AS( virtual_disk(vname), std::runtime_error );
+    put_le(v, 44, 512, 4);
+    put_le(v, 12, 1ULL << 56, 8);       // capacity * 512 wraps to 0
+    std::ofstream(vname, std::ios::binary) << v;
+    REQUIRE_THROWS_AS( virtual_disk(vname), std::runtime_error );
+    put_le(v, 12, 2048, 8);
+    std::ofstream(vname, std::ios::binary) << v;
+    REQUIRE( virtual_disk(vname).size() == 2048*512 );
+
+    /* a VHDX metadata region past the end of the file is refused before it is allocated */
+    auto put_guid = [](std::string &s, size_t off, const std::string &text) {
+        static const int order[16] = {3,2,1,0, 5,4, 7,6, 8,9, 10,11,12,13,14,15};
+        std::string hex;
+        for (char c : text) if (c != '-') hex += c;
+        for (int i=0; i<16; i++) s[off+order[i]] = char(std::stoul(hex.substr(2*i, 2), nullptr, 16));
+    };
+    std::string x(1024*1024, '\0');
+    x.replace(0, 8, "vhdxfile");
+    x.replace(64*1024, 4, "head");
+    put_le(x, 64*1024 + 66, 1, 2);      // version
+    x.replace(192*1024, 4, "regi");
+    put_le(x, 192*1024 + 8, 2, 4);      // regions
+    put_guid(x, 192*1024 + 16, "2DC27766-F623-4200-9D64-115E9BFD4A08");
+    put_le(x, 192*1024 + 32, 512*1024, 8);
+    put_le(x, 192*1024 + 40, 256*1024, 4);
+    put_guid(x, 192*1024 + 48, "8B7CA206-4790-4B9A-B8FE-575F050F886E");
+    put_le(x, 192*1024 + 64, 768*1024, 8);
+    put_le(x, 192*1024 + 72, 0xfff00000, 4); // 4 GiB of metadata
+    std::filesystem::path xname = NamedTemporaryDirectory() / "disk.vhdx";
+    std::ofstream(xname, std::ios::binary) << x;
+    REQUIRE( virtual_disk::detect(xname) == virtual_disk::VHDX );
+    REQUIRE_THROWS_AS( virtual_disk(xname), std::runtime_error );
+}
+
+TEST_CASE("image_process_memdump", "[phase1]") {
+    /* A LiME image of physical [0x1000,0x3000) and [0x10000,0x11000) */
+    auto put_le = [](std::string &s, uint64_t v, int n) {
+        for (int i=0; i<n; i++) s += char(v >> (8*i));
+    };
+    std::string f;
+    for (auto range : {std::make_pair(0x1000, 0x2000), std::make_pair(0x10000, 0x1000)}) {
+        put_le(f, 0x4C694D45, 4);
+        put_le(f, 1, 4);
+        put_le(f, range.first, 8);
+        put_le(f, range.first + range.second - 1, 8);
+        put_le(f, 0, 8);
+        f += std::string(range.second, range.first==0x1000 ? 'A' : 'B');
+    }
+    std::filesystem::path fname = NamedTemporaryDirectory() / "mem.lime";
+    std::ofstream(fname, std::ios::binary) << f;
+
+    REQUIRE( memory_dump::detect(fname) == memory_dump::LIME );
+    image_process *p = image_process::open( fname, false, 4096, 4096);
+    REQUIRE( p->image_size() == 0x11000 );
+    std::vector<uint64_t> pages;
+    for(auto it = p->begin(); it!=p->end(); ++it){
+        sbuf_t *sbufp = it.sbuf_alloc();
+        pages.push_back(sbufp->pos0.offset);
+        REQUIRE( sbufp->asString()[0] == (sbufp->pos0.offset < 0x10000 ? 'A' : 'B') );
+        delete sbufp;
+    }
+    REQUIRE( pages == std::vector<uint64_t>{0x1000, 0x2000, 0x10000} );
+    char buf[2];
+    REQUIRE( p->pread(buf, 2, 0x2fff) == 2 );
+    REQUIRE( buf[0] == 'A' );
+    REQUIRE( buf[1] == 0 );
+    delete p;
+
+    /* runs that wrap the address space or overlap are refused */
+    for (auto range : std::vector<std::pair<uint64_t, uint64_t>>{{0x1000, UINT64_MAX}, {0x1800, 0x1fff}}) {
+        std::string g = f.substr(0, 32 + 0x2000);
+        put_le(g, 0x4C694D45, 4);
+        put_le(g, 1, 4);
+        put_le(g, range.first, 8);
+        put_le(g, range.second, 8);
+        put_le(g, 0, 8);
+        g += std::string(0x1000, 'C');
+        std::ofstream(fname, std::ios::binary) << g;
+        REQUIRE_THROWS_AS( memory_dump(fname), std::runtime_error );
+    }
+
+    /* a full crash dump whose second run's BasePage * PAGE_SIZE wraps */
+    std::string d(0x2000, '\0');
+    d.replace(0, 8, "PAGEDU64");
+    auto set_le = [](std::string &s, size_t off, uint64_t v) {
+        for (int i=0; i<8; i++) s[off+i] = char(v >> (8*i));
+    };
+    set_le(d, 0xF98, 1);                // a full dump
+    set_le(d, 0x88, 2);                 // NumberOfRuns
+    set_le(d, 0x98, 1);                 // BasePage, PageCount
+    set_le(d, 0xA0, 1);
+    set_le(d, 0xA8, 1ULL << 60);
+    set_le(d, 0xB0, 1);
+    d += std::string(2*4096, 'D');
+    std::filesystem::path dname = NamedTemporaryDirectory() / "mem.dmp";
+    std::ofstream(dname, std::ios::binary) << d;
+    REQUIRE( memory_dump::detect(dname) == memory_dump::CRASHDUMP );
+    REQUIRE_THROWS_AS( memory_dump(dname), std::runtime_error );
+    set_le(d, 0xA8, 4);
+    std::ofstream(dname, std::ios::binary) << d;
+    REQUIRE( memory_dump(dname).size() == 5*4096 );
+}
+
+TEST_CASE("image_process_url", "[phase1]") {
+    REQUIRE( image_process::is_url("https://example.com/disk.raw") );
+    REQUIRE( image_process::is_url("s3://bucket/cases/disk.raw") );
+    REQUIRE( image_process::is_url("/tmp/disk.raw") == false );
+#ifdef HAVE_LIBCURL
+    REQUIRE( process_http::s3_to_https("s3://bucket/cases/disk.raw") == "https://bucket.s3.amazonaws.com/cases/disk.raw" );
+#endif
+}
+
+TEST_CASE("process_dir_walk", "[phase1]") {
+    std::filesystem::path root = NamedTemporaryDirectory();
+    std::filesystem::create_directories( root / "a" / "b" );
+    std::filesystem::create_directories( root / "c" );
+    for (auto fname : {"a/1.txt", "a/b/2.txt", "c/3.txt", "4.txt"}) {
+        std::ofstream( root / fname ) << fname;
+    }
+    auto files = process_dir::walk( root, 4 );
+    REQUIRE( files.size() == 4 );
+    REQUIRE( std::is_sorted( files.begin(), files.end()) );
+    REQUIRE( files[0] == root / "4.txt" );
+    REQUIRE( std::find( files.begin(), files.end(), root / "a" / "b" / "2.txt") != files.end() );
+}
+
+TEST_CASE("content_cache", "[phase1]") {
+    std::string a(1000, 'a');
+    std::string b = a;
+    b[999] = 'b';
+    auto ha = content_cache::hash(reinterpret_cast<const uint8_t *>(a.data()), a.size(), 1);
+    REQUIRE( ha == content_cache::hash(reinterpret_cast<const uint8_t *>(a.data()), a.size(), 1) );
+    REQUIRE( !(ha == content_cache::hash(reinterpret_cast<const uint8_t *>(b.data()), b.size(), 1)) );
+    REQUIRE( !(ha == content_cache::hash(reinterpret_cast<const uint8_t *>(a.data()), a.size(), 2)) ); // depth is part of the key
+    REQUIRE( !(ha == content_cache::hash(reinterpret_cast<const uint8_t *>(a.data()), a.size()-1, 1)) );
+}
+
+TEST_CASE("seen_set", "[phase1]") {
+    for (size_t bytes : {size_t(0), size_t(64 * 1024)}) {
+        seen_set<uint64_t> seen;
+        seen.set_approximate(bytes);
+        REQUIRE( seen.approximate() == (bytes != 0) );
+        std::atomic<int> first {0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&seen, &first, t] {
+                for (uint64_t i = 0; i < 2000; i++) {
+                    if (!seen.check_for_presence_and_insert(i + t * 1000)) first++; // the threads overlap
+                }
+            });
+        }
+        for (auto &th : threads) th.join();
+        REQUIRE( first == 5000 );
+        REQUIRE( seen.size() == 5000 );
+        REQUIRE( seen.contains(4999) );
+        REQUIRE( !seen.contains(5000) );
+    }
+    seen_set<std::string> small(2);
+    small.set_approximate(1024);
+    small.insert("a");
+    small.insert("b");
+    REQUIRE( !small.check_for_presence_and_insert("c") );
+    REQUIRE( !small.contains("c") );
+    REQUIRE( small.dropped() == 1 );
+}
+
+TEST_CASE("content_affinity", "[phase1]") {
+    const uint8_t buf[16] {};
+    REQUIRE( content_affinity::content_of(sbuf_t(pos0_t(), buf, sizeof(buf))) == content_affinity::ANY );
+    REQUIRE( content_affinity::content_of(sbuf_t(pos0_t("1000-ZIP-30-MSXML-0"), buf, sizeof(buf))) == content_affinity::TEXT );
+    REQUIRE( content_affinity::content_of(sbuf_t(pos0_t("1000-MSXML-30-GZIP-0"), buf, sizeof(buf))) == content_affinity::ANY );
+    REQUIRE( (content_affinity::accepts("ntfsmft") & content_affinity::TEXT) == 0 );
+    REQUIRE( content_affinity::accepts("email") == content_affinity::TEXT );
+}
+
+TEST_CASE("memory_governor", "[phase1]") {
+    memory_governor::set_budget(1000 * 1000 * 1000);
+    REQUIRE( memory_governor::budget_at(0) == 1000 * 1000 * 1000 );  // no reserve: every depth has it all
+    REQUIRE( memory_governor::budget_at(3) == 1000 * 1000 * 1000 );
+    memory_governor::set_depth_reserve(0.25);
+    REQUIRE( memory_governor::budget_at(0) == 750 * 1000 * 1000 );
+    REQUIRE( memory_governor::budget_at(1) == 937500000 );
+    REQUIRE( memory_governor::budget_at(2) > memory_governor::budget_at(1) );
+    memory_governor::set_depth_reserve(0);
+    memory_governor::set_budget(0);
+    REQUIRE( !memory_governor::over_budget(1ULL << 40, 0) );
+#ifdef HAVE_MALLINFO2
+    /* an sbuf's buffer is held against the budget until the sbuf is deleted, and no longer */
+    const uint64_t before = memory_governor::allocated_bytes();
+    sbuf_t *sbuf = sbuf_t::sbuf_malloc(pos0_t(), 64 << 20, 64 << 20);
+    REQUIRE( memory_governor::allocated_bytes() >= before + (64 << 20) );
+    delete sbuf;
+    REQUIRE( memory_governor::allocated_bytes() < before + (64 << 20) );
+#endif
+}
+
+TEST_CASE("page_stash", "[phase1]") {
+    const size_t len = 65536;
+    sbuf_t *text = sbuf_t::sbuf_malloc(pos0_t("", 1 << 20), len + 4096, len);
+    uint8_t *buf = static_cast<uint8_t *>(text->malloc_buf());
+    for (size_t i = 0; i < len + 4096; i++) buf[i] = "the quick brown fox "[i % 20];
+    REQUIRE( !page_stash::put(text) );                   // not enabled
+    page_stash::set_max_bytes(1 << 20);
+    REQUIRE( page_stash::put(text) );                    // takes and deletes it
+
+    sbuf_t *noise = sbuf_t::sbuf_malloc(pos0_t("", 2 << 20), len, len);
+    buf = static_cast<uint8_t *>(noise->malloc_buf());
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < len; i++) { x ^= x << 13; x ^= x >> 7; x ^= x << 17; buf[i] = x; }
+    REQUIRE( !page_stash::put(noise) );                  // does not compress: queued as it is
+    delete noise;
+    REQUIRE( page_stash::size() == 1 );
+
+    sbuf_t *back = page_stash::take();
+    REQUIRE( back != nullptr );
+    REQUIRE( back->pos0.offset == 1 << 20 );
+    REQUIRE( back->bufsize == len + 4096 );
+    REQUIRE( back->pagesize == len );
+    REQUIRE( (*back)[len + 4095] == "the quick brown fox "[(len + 4095) % 20] );
+    delete back;
+    REQUIRE( page_stash::take() == nullptr );
+    page_stash::set_max_bytes(0);
+}
+
+TEST_CASE("recursion_spill", "[phase1]") {
+    const auto dir = std::filesystem::path(NamedTemporaryDirectory()) / "spill";
+    recursion_spill::set_directory(dir);
+    REQUIRE( recursion_spill::enabled() );
+    const size_t len = 2 * memory_governor::MIN_GOVERNED;
+    sbuf_t *child = sbuf_t::sbuf_malloc(pos0_t("1000-GZIP", 0), len, len);
+    memset(child->malloc_buf(), 0x5a, len);
+    REQUIRE( !recursion_spill::spill(*child) );          // no budget: scanned as it is
+
+    memory_governor::set_budget(1);                      // everything is over it
+    REQUIRE( recursion_spill::spill(*child) );
+    delete child;
+    REQUIRE( recursion_spill::pending() == 1 );
+    REQUIRE( recursion_spill::resume(false) == nullptr ); // still no memory
+    memory_governor::set_budget(0);
+    sbuf_t *back = recursion_spill::resume(false);
+    REQUIRE( back != nullptr );
+    REQUIRE( back->bufsize == len );
+    REQUIRE( back->pos0.path == "1000-GZIP" );
+    REQUIRE( back->depth() == 1 );
+    REQUIRE( (*back)[len - 1] == 0x5a );
+    delete back;
+    REQUIRE( recursion_spill::pending() == 0 );
+    REQUIRE( std::filesystem::is_empty(dir) );
+    recursion_spill::set_directory("");
+}
+
+TEST_CASE("scratch_arena", "[phase1]") {
+    scratch_vector<int> outside(1000, 1);  // with operator new
+    const uint64_t chunks = scratch_arena::chunks_allocated;
+    for (int call = 0; call < 3; call++) {
+        scratch_arena::scope scope;
+        scratch_vector<uint64_t> v;
+        for (uint64_t i = 0; i < 300000; i++) v.push_back(i);   // more than a chunk
+        REQUIRE( v[299999] == 299999 );
+        REQUIRE( reinterpret_cast<uintptr_t>(v.data()) % alignof(uint64_t) == 0 );
+    }
+    /* the first call grew the chunk; the others fit in what it kept */
+    const uint64_t after_first = scratch_arena::chunks_allocated - chunks;
+    {
+        scratch_arena::scope scope;
+        scratch_vector<uint64_t> v(300000);
+    }
+    REQUIRE( scratch_arena::chunks_allocated - chunks == after_first );
+    REQUIRE( scratch_arena::peak_bytes >= 300000 * sizeof(uint64_t) );
+    outside.resize(100000);
+
+    /* on a new thread, one request larger than MAX_RETAINED makes the only chunk, which is not kept whole */
+    size_t retained = 0;
+    std::thread([&retained]() {
+        {
+            scratch_arena::scope scope;
+            scratch_vector<char> big(scratch_arena::MAX_RETAINED + 1);
+        }
+        retained = scratch_arena::retained_bytes();
+    }).join();
+    REQUIRE( retained <= scratch_arena::MAX_RETAINED );
+}
+
+TEST_CASE("scanner_tiles", "[phase1]") {
+    REQUIRE( scanner_tiles::tile_capable("aes") );
+    REQUIRE( !scanner_tiles::tile_capable("zip") );
+    REQUIRE_THROWS_AS( scanner_tiles::set_scanners("aes,zip"), std::invalid_argument );
+    const size_t tile_bytes = scanner_tiles::tile_bytes;
+    scanner_tiles::set_tile_bytes(100000);
+    REQUIRE( scanner_tiles::tile_bytes == 25 * scanner_tiles::TILE_ALIGN );
+    scanner_tiles::set_tile_bytes(tile_bytes);
+    scanner_tiles::set_scanners("");
+    REQUIRE( scanner_tiles::scanners() == "" );
+}
+
+TEST_CASE("builtin_scanners", "[phase1]") {
+    size_t n = 0;
+    while (scanners_builtin[n]) n++;
+    size_t m = 0;
+    for (const builtin_scanner *b = builtin_scanners; b->name; b++, m++) {
+        REQUIRE( b->call == scanners_builtin[m] );
+    }
+    REQUIRE( m == n );
+    REQUIRE( builtin_scanner::find("email") != nullptr );
+    REQUIRE( builtin_scanner::find("email")->scan != builtin_scanner::find("email")->call );
+    REQUIRE( builtin_scanner::find("no_such_scanner") == nullptr );
+}
+
+TEST_CASE("scanner_priority", "[phase1]") {
+    REQUIRE( scanner_priority::class_of("outlook") == scanner_priority::EXPENSIVE );
+    REQUIRE( scanner_priority::class_of("email") == scanner_priority::CHEAP );
+    REQUIRE( scanner_priority::class_of("zip") == scanner_priority::NORMAL );
+    REQUIRE_THROWS_AS( scanner_priority::set_classes("zip:slow"), std::invalid_argument );
+    REQUIRE_THROWS_AS( scanner_priority::set_threads("expensive:two"), std::invalid_argument );
+    REQUIRE( scanner_priority::threads(scanner_priority::EXPENSIVE) == 0 ); // not limited unless asked
+}
+
+TEST_CASE("small_input", "[phase1]") {
+    Phase1::Config cfg;
+    REQUIRE( cfg.small_input(1000) );
+    REQUIRE( cfg.small_input(cfg.opt_pagesize) );
+    REQUIRE( !cfg.small_input(cfg.opt_pagesize + 1) );
+    REQUIRE( !cfg.small_input(0) );         // not known
+    cfg.small_input_pages = 0;
+    REQUIRE( !cfg.small_input(1000) );
+    cfg.num_threads = 8;
+    cfg.use_main_thread();
+    REQUIRE( cfg.num_threads == 0 );
+    REQUIRE( cfg.read_ahead_pages == 0 );
+    REQUIRE( !cfg.opt_notification );
+}
+
+TEST_CASE("container_limits", "[phase1]") {
+    std::filesystem::path dir = NamedTemporaryDirectory();
+    /* cgroup v2, with a tighter CPU quota on the parent than on the pod */
+    std::filesystem::create_directories( dir / "v2" / "kubepods" / "pod1" );
+    std::ofstream( dir / "v2" / "cgroup.controllers" ) << "cpu memory\n";
+    std::ofstream( dir / "v2" / "kubepods" / "cpu.max" ) << "150000 100000\n";
+    std::ofstream( dir / "v2" / "kubepods" / "pod1" / "cpu.max" ) << "max 100000\n";
+    std::ofstream( dir / "v2" / "kubepods" / "pod1" / "memory.max" ) << "1073741824\n";
+    std::ofstream( dir / "self2" ) << "0::/kubepods/pod1\n";
+    container_limits l = container_limits::read( dir / "self2", dir / "v2" );
+    REQUIRE( l.source == "cgroup2" );
+    REQUIRE( l.cpus == 1.5 );
+    REQUIRE( l.memory_bytes == 1073741824 );
+    REQUIRE( l.threads(64) <= 2 );
+
+    /* cgroup v1, where the container sees its own cgroup at the root of each controller */
+    std::filesystem::create_directories( dir / "v1" / "cpu,cpuacct" );
+    std::filesystem::create_directories( dir / "v1" / "memory" );
+    std::ofstream( dir / "v1" / "cpu,cpuacct" / "cpu.cfs_quota_us" ) << "400000\n";
+    std::ofstream( dir / "v1" / "cpu,cpuacct" / "cpu.cfs_period_us" ) << "100000\n";
+    std::ofstream( dir / "v1" / "memory" / "memory.limit_in_bytes" ) << "9223372036854771712\n"; // none
+    std::ofstream( dir / "self1" ) << "4:memory:/docker/abc\n3:cpu,cpuacct:/docker/abc\n";
+    l = container_limits::read( dir / "self1", dir / "v1" );
+    REQUIRE( l.source == "cgroup1" );
+    REQUIRE( l.cpus == 4 );
+    REQUIRE( l.memory_bytes == 0 );
+
+    Phase1::Config cfg;
+    cfg.num_threads = 32;
+    l.cpus = 2;
+    l.affinity_cpus = 0;
+    l.memory_bytes = 256 * 1024 * 1024;
+    cfg.apply_container_limits(l);
+    REQUIRE( cfg.num_threads == 2 );
+    REQUIRE( cfg.memory_budget == uint64_t(256 * 1024 * 1024 * Phase1::Config::CONTAINER_BUDGET_FRACTION) );
+    REQUIRE( (2 + cfg.read_ahead_pages + cfg.read_threads + 1) * (cfg.opt_pagesize + cfg.opt_marginsize) <= 128 * 1024 * 1024 );
+}
+
+TEST_CASE("worker_tuner", "[phase1]") {
+    worker_tuner::sample s;
+    s.seconds = 10;
+    s.busy_seconds = 8 * 10 * 0.95;
+    s.cpu_seconds = s.wall_seconds = 76;
+    s.queue_wait_seconds = 8;          // the producer waits on busy workers
+    REQUIRE( worker_tuner::decide(8, 16, s) == 10 );
+    REQUIRE( worker_tuner::decide(8, 8, s) == 8 );   // no more than -j
+    s.queue_wait_seconds = 0;
+    REQUIRE( worker_tuner::decide(8, 16, s) == 8 );
+    s.busy_seconds = 8 * 10 * 0.2;     // idle
+    s.cpu_seconds = s.wall_seconds = 16;
+    REQUIRE( worker_tuner::decide(8, 16, s) == 7 );
+    REQUIRE( worker_tuner::decide(1, 16, s) == 1 );
+    s.busy_seconds = 8 * 10 * 0.95;
+    s.wall_seconds = 76;
+    s.cpu_seconds = 20;                // the calls stall
+    REQUIRE( worker_tuner::decide(8, 16, s) == 7 );
+    s.cpu_seconds = 76;
+    s.budget = 1000;
+    s.resident_bytes = 950;
+    REQUIRE( worker_tuner::decide(8, 16, s) == 6 );
+}
+
+TEST_CASE("forensic_path", "[phase1]") {
+    const std::string path("1000-XOR(255)-0-ZIP");
+    forensic_path::ancestors a = forensic_path::ancestors_of(path);
+    REQUIRE( a.size() == 2 );
+    REQUIRE( a[0] == "ZIP" );
+    REQUIRE( a[1] == "XOR(255)" );
+    REQUIRE( a[2].empty() );
+    const std::string empty, offset("4096");
+    REQUIRE( forensic_path::ancestors_of(empty).size() == 0 );
+    REQUIRE( forensic_path::ancestors_of(offset).size() == 0 );
+}
+
+TEST_CASE("page_classifier", "[phase1]") {
+    std::vector<uint8_t> random(65536);
+    uint64_t x = 1;
+    for (auto &b : random) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        b = x >> 56;
+    }
+    REQUIRE( page_classifier::classify(random.data(), random.size()).high_entropy() );
+
+    std::string text;
+    while (text.size() < 65536) text += "From: someone@example.com\nThe quick brown fox jumps over the lazy dog.\n";
+    auto pc = page_classifier::classify(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+    REQUIRE( !pc.high_entropy() );
+    REQUIRE( pc.ascii_fraction == 1.0 );
+    REQUIRE( pc.utf16_fraction == 0.0 );
+
+    random[8191] = random[8192+10] = 0;             // so the run is no longer than what was copied
+    memcpy(random.data() + 8192, text.data(), 10);  // ten bytes of text among random data are still high entropy...
+    REQUIRE( page_classifier::classify(random.data(), random.size()).high_entropy() );
+    memcpy(random.data() + 8192, text.data(), 100); // ...but a line of it is not
+    REQUIRE( !page_classifier::classify(random.data(), random.size()).high_entropy() );
+}
+
+TEST_CASE("fs_map", "[phase1]") {
+    /* An MBR with a FAT16 partition at sector 2048, whose first 100 clusters are allocated */
+    auto le = [](std::string &s, size_t off, uint64_t v, int n) {
+        for (int i=0; i<n; i++) s[off+i] = char(v >> (8*i));
+    };
+    std::string d((2048 + 40000) * 512 + 1024 * 1024, '\0');
+    d[510] = 0x55; d[511] = char(0xaa);
+    d[446 + 4] = 0x06;
+    le(d, 446 + 8, 2048, 4);
+    le(d, 446 + 12, 40000, 4);
+    const size_t v = 2048 * 512;
+    le(d, v + 11, 512, 2);              // bytes per sector
+    d[v + 13] = 4;                      // sectors per cluster
+    le(d, v + 14, 1, 2);                // reserved sectors
+    d[v + 16] = 2;                      // FATs
+    le(d, v + 17, 512, 2);              // root directory entries
+    le(d, v + 19, 40000, 2);            // sectors
+    le(d, v + 22, 40, 2);               // sectors per FAT
+    d[v + 510] = 0x55; d[v + 511] = char(0xaa);
+    for (int n=2; n<102; n++) le(d, v + 512 + n*2, 0xffff, 2);
+    std::filesystem::path fname = NamedTemporaryDirectory() / "fat16.raw";
+    std::ofstream(fname, std::ios::binary) << d;
+
+    image_process *p = image_process::open( fname, false, 1024*1024, 4096);
+    fs_map m = fs_map::read(*p);
+    REQUIRE( m.volumes.size() == 1 );
+    REQUIRE( m.volumes[0].type == "FAT16" );
+    const uint64_t data = v + (1 + 2*40 + 32) * 512;
+    REQUIRE( m.volumes[0].clusters_start == data );
+    REQUIRE( m.classes(0, 512) == 1U << fs_map::OTHER );
+    REQUIRE( m.classes(data, 2048) == 1U << fs_map::ALLOCATED );
+    REQUIRE( m.classes(data + 100*2048, 2048) == 1U << fs_map::UNALLOCATED );
+    const auto bytes = m.class_bytes(p->image_size());
+    REQUIRE( bytes[fs_map::ALLOCATED] + bytes[fs_map::UNALLOCATED] + bytes[fs_map::OTHER] == uint64_t(p->image_size()) );
+    REQUIRE( m.page_order(p->image_size(), 1024*1024, fs_map::parse_priority("allocated")) == std::vector<uint64_t>{1} );
+    REQUIRE_THROWS_AS( fs_map::parse_priority("deleted"), std::invalid_argument );
+    delete p;
+}
+
+TEST_CASE("histogram_only", "[phase1]") {
+    static recorder_handle url_handle {"url"};
+    recorder_handle::set_histogram_only("domain,url");
+    REQUIRE(url_handle.def().flags.no_features);
+    REQUIRE(recorder_handle::make_def("domain").flags.no_features);
+    REQUIRE(!recorder_handle::make_def("email").flags.no_features);
+    feature_recorder_def::flags_t carve;
+    carve.carve = true;
+    REQUIRE(url_handle.def(carve).flags.carve);
+    recorder_handle::set_histogram_only("");
+    REQUIRE(!url_handle.def().flags.no_features);
+}
+
+TEST_CASE("file_copy", "[phase1]") {
+    std::string data(100000, '\0');
+    for (size_t i = 0; i < data.size(); i++) data[i] = 'a' + i % 26;
+    std::filesystem::path dir = NamedTemporaryDirectory();
+    std::ofstream(dir / "from.bin", std::ios::binary) << data;
+    clone_file(dir / "from.bin", dir / "to.bin");
+    REQUIRE(std::filesystem::file_size(dir / "to.bin") == data.size());
+
+    /* a range that is not block-aligned cannot be cloned, and is copied */
+    const int in = ::open((dir / "from.bin").c_str(), O_RDONLY);
+    const int out = ::open((dir / "part.bin").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    REQUIRE(clone_fd_range(in, 8192, out, 100, 5000) != copy_method::clone);
+    char buf[5000];
+    REQUIRE(::pread(out, buf, sizeof(buf), 100) == 5000);
+    REQUIRE(std::string(buf, sizeof(buf)) == data.substr(8192, 5000));
+    ::close(in);
+    ::close(out);
+    REQUIRE_THROWS_AS(clone_file(dir / "missing.bin", dir / "x.bin"), std::runtime_error);
+}
+
+TEST_CASE("feature_census", "[phase1]") {
+    hyperloglog hll;
+    for (int i = 0; i < 100000; i++) hll.add(std::to_string(i % 20000));
+    REQUIRE( hll.estimate() > 20000 * 0.95 );
+    REQUIRE( hll.estimate() < 20000 * 1.05 );
+
+    REQUIRE( feature_census::feature_of("100\tuser@example.com\tcontext") == "user@example.com" );
+    REQUIRE( feature_census::feature_of("100\tuser@example.com") == "user@example.com" );
+    feature_census census;
+    REQUIRE( census.write("email", "0\ta@b.com\tx\n10\ta@b.com\ty\n20\tc@d.com\tz\n") );
+    REQUIRE( census.xml_attributes().at("email") == "features='3' distinct='2'" );
+    std::map<std::string, std::string> stats;
+    feature_census::add_realtime_stats(stats);
+    REQUIRE( stats.at("census_email") == "3 features, ~2 distinct" );
+}
+
+TEST_CASE("feature_stream", "[phase1]") {
+    std::string partial;
+    std::vector<std::string> lines;
+    const std::string a = "# Feature-Recorder: alerts\n100\tfoo@bar.com\tctx\n2";
+    feature_stream::split_lines(partial, a.data(), a.size(), lines);
+    REQUIRE(lines.size() == 1);
+    REQUIRE(lines[0] == "100\tfoo@bar.com\tctx\n");
+    REQUIRE(partial == "2");
+    const std::string b = "00\tbaz\tctx\n\n";
+    feature_stream::split_lines(partial, b.data(), b.size(), lines);
+    REQUIRE(lines.size() == 2);
+    REQUIRE(lines[1] == "200\tbaz\tctx\n");
+    REQUIRE(partial.empty());
+    REQUIRE_THROWS_AS(feature_sink::make("tcp:localhost", false), std::invalid_argument);
+
+    /* a dir: sink gets the lines of the feature files written before and after the stream starts */
+    std::filesystem::path dir = NamedTemporaryDirectory();
+    std::filesystem::create_directory(dir / "out");
+    std::ofstream(dir / "out" / "email.txt") << "# comment\n10\ta@b.com\tctx\n";
+    feature_stream stream(feature_sink::make("dir:" + (dir / "sink").string(), true), dir / "out");
+    std::ofstream(dir / "out" / "url.txt") << "20\thttp://x/\tctx\n30\thttp://y/";
+    std::filesystem::create_directories(dir / "out" / "jpeg_carved" / "000");
+    std::ofstream(dir / "out" / "jpeg_carved" / "000" / "40.jpg") << "JFIF";
+    feature_stream::carved("jpeg_carved", "jpeg_carved/000/40.jpg");
+    stream.stop();
+    REQUIRE(stream.lines_sent() == 2);
+    REQUIRE(stream.carves_sent() == 1);
+    REQUIRE(getLines(dir / "sink" / "email.txt") == std::vector<std::string>{"10\ta@b.com\tctx"});
+    REQUIRE(getLines(dir / "sink" / "url.txt") == std::vector<std::string>{"20\thttp://x/\tctx"});
+    REQUIRE(std::filesystem::file_size(dir / "sink" / "jpeg_carved" / "000" / "40.jpg") == 4);
+
+    /* a line that is still in the writer's buffer reaches the sink, before the stream stops, by the flush */
+    std::ofstream alerts(dir / "out" / "alerts.txt");
+    alerts << "50\tfoo@bar.com\tctx\n";
+    feature_stream alert_stream(feature_sink::make("dir:" + (dir / "alert_sink").string(), false), dir / "out",
+                                std::set<std::string>{"alerts"}, [&]{ alerts.flush(); });
+    for (int i = 0; i < 100 && alert_stream.lines_sent() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    REQUIRE(alert_stream.lines_sent() == 1);
+    REQUIRE(getLines(dir / "alert_sink" / "alerts.txt") == std::vector<std::string>{"50\tfoo@bar.com\tctx"});
+    alert_stream.stop();
+}
+
+TEST_CASE("triage_planner", "[phase1]") {
+    triage_planner plan(1000, 10);
+    REQUIRE(plan.regions() == 10);
+    REQUIRE(plan.region_blocks() == 100);
+    REQUIRE(plan.region_of(250) == 2);
+    REQUIRE(plan.region_end(9) == 1000);
+    for (uint64_t r = 0; r < 10; r++) {
+        plan.add_sampled(r * 100, 4096);
+        plan.add_sampled(r * 100 + 50, 4096);
+    }
+    /* region 7 has the one ccn; region 3 has more urls than region 5, which has more than the rest */
+    plan.add_hit(7, "ccn");
+    plan.add_hit(3, "url", 20);
+    plan.add_hit(5, "url", 10);
+    plan.add_hit(1, "url", 1);
+    REQUIRE(plan.score(7) > plan.score(3));
+    REQUIRE(plan.score(0) == 0);
+    auto order = plan.ranked_regions();
+    REQUIRE(order.size() == 10);
+    REQUIRE(order[0] == 7);
+    REQUIRE(order[1] == 3);
+    REQUIRE(order[2] == 5);
+    REQUIRE(order[3] == 1);
+    REQUIRE(order[4] == 0);
+    REQUIRE(order[5] == 2);
+
+    /* a line that the recorder has not finished writing is not counted */
+    auto outdir = std::filesystem::path(NamedTemporaryDirectory());
+    std::ofstream(outdir / "ccn.txt") << "# banner\n409600\t4111\tctx\n819200\t41";
+    triage_planner counted(1000, 10);
+    REQUIRE(counted.count_features(outdir, 4096) == 1);
+    counted.add_sampled(100, 4096);
+    counted.add_sampled(200, 4096);
+    REQUIRE(counted.ranked_regions()[0] == 1);
+}
+
+TEST_CASE("known_blocks", "[phase1]") {
+    std::string known(40 * known_blocks::BLOCK_SIZE, '\0');
+    uint64_t x = 1;
+    for (auto &c : known) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        c = x >> 56;
+    }
+    std::filesystem::path dir = NamedTemporaryDirectory();
+    std::ofstream(dir / "known.bin", std::ios::binary) << known;
+    REQUIRE( known_blocks::build({dir / "known.bin"}, dir / "known.db", std::cerr) == 40 );
+    known_blocks kb(dir / "known.db");
+    REQUIRE( kb.contains(known_blocks::hash(reinterpret_cast<const uint8_t *>(known.data()))) );
+
+    /* three unknown blocks, twenty known ones, and 5000 unknown bytes */
+    std::string image = std::string(3 * known_blocks::BLOCK_SIZE, 'a') + known.substr(5 * known_blocks::BLOCK_SIZE, 20 * known_blocks::BLOCK_SIZE)
+        + std::string(5000, 'b');
+    auto runs = kb.known_runs(reinterpret_cast<const uint8_t *>(image.data()), image.size(), 0);
+    REQUIRE( runs.size() == 1 );
+    REQUIRE( runs[0].first == 3 * known_blocks::BLOCK_SIZE );
+    REQUIRE( runs[0].second == 23 * known_blocks::BLOCK_SIZE );
+    /* the blocks are aligned in the image, not in the buffer */
+    REQUIRE( kb.known_runs(reinterpret_cast<const uint8_t *>(image.data()) + 1, image.size() - 1, 1).size() == 1 );
+    REQUIRE( kb.known_runs(reinterpret_cast<const uint8_t *>(image.data()) + 1, image.size() - 1, 0).empty() );
+}
+
+TEST_CASE("parse_cpulist", "[phase1]") {
+    REQUIRE( Phase1::parse_cpulist("0-3,8,10-11\n") == std::vector<int>({0,1,2,3,8,10,11}) );
+    REQUIRE( Phase1::parse_cpulist("5") == std::vector<int>({5}) );
+}
+
+TEST_CASE("auto_pagesize", "[phase1]") {
+    const size_t MiB = 1024*1024;
+    REQUIRE( Phase1::Config::auto_pagesize(100000ULL*MiB, 8, 40, 4*MiB) == 16*MiB ); // large image: the default
+    REQUIRE( Phase1::Config::auto_pagesize(1024*MiB, 8, 40, 1*MiB) == 8*MiB );       // 1 GiB / (8*16)
+    REQUIRE( Phase1::Config::auto_pagesize(10*MiB, 8, 40, 1*MiB) == 1*MiB );         // the minimum
+    REQUIRE( Phase1::Config::auto_pagesize(10*MiB, 8, 2, 1*MiB) == 4*MiB );          // few scanners
+    REQUIRE( Phase1::Config::auto_pagesize(10*MiB, 8, 40, 2*MiB) == 2*MiB );         // never below the margin
+
+    Phase1::Config cfg;
+    cfg.opt_auto_pagesize = true;
+    cfg.num_threads = 4;
+    cfg.opt_marginsize = 1*MiB;
+    REQUIRE( cfg.split_pieces(0, 16*MiB, 1024*MiB) == 1 );
+    REQUIRE( cfg.split_pieces(1000*MiB, 16*MiB, 1024*MiB) == 4 );
+    cfg.opt_auto_pagesize = false;
+    REQUIRE( cfg.split_pieces(1000*MiB, 16*MiB, 1024*MiB) == 1 );
+
+    REQUIRE( Phase1::Config::auto_marginsize({"ntfsmft", "utmp"}, 4*MiB) == Phase1::Config::MIN_AUTO_MARGINSIZE );
+    REQUIRE( Phase1::Config::auto_marginsize({"ntfsmft", "net"}, 4*MiB) == 128*1024 );
+    REQUIRE( Phase1::Config::auto_marginsize({"ntfsmft", "zip"}, 4*MiB) == 4*MiB );  // zip needs the default
+    REQUIRE( Phase1::Config::auto_marginsize({"net"}, 64*1024) == 64*1024 );         // never above the default
+}
+
+TEST_CASE("batch", "[phase1]") {
+    const uint64_t MiB = 1024*1024;
+    bulk_extractor_batch::job j;
+    REQUIRE( !bulk_extractor_batch::parse_line("# a comment", j) );
+    REQUIRE( !bulk_extractor_batch::parse_line("", j) );
+    REQUIRE( bulk_extractor_batch::parse_line("disk 1.E01\tout/disk 1\t-x\tnet\r", j) );
+    REQUIRE( j.image == "disk 1.E01" );
+    REQUIRE( j.outdir == "out/disk 1" );
+    REQUIRE( j.options == std::vector<std::string>({"-x", "net"}) );
+    REQUIRE_THROWS_AS( bulk_extractor_batch::parse_line("image.raw", j), std::invalid_argument );
+
+    REQUIRE( bulk_extractor_batch::threads_for(10*MiB, 32) == 1 );
+    REQUIRE( bulk_extractor_batch::threads_for(2048*MiB, 32) == 8 );      // 16 pages of 16 MiB per thread
+    REQUIRE( bulk_extractor_batch::threads_for(1000000*MiB, 32) == 32 );
+
+    std::vector<bulk_extractor_batch::job> pending(3);
+    pending[0].threads = 8;
+    pending[1].threads = 4;
+    pending[2].threads = 1;
+    REQUIRE( bulk_extractor_batch::next_job(pending, 32) == 0 );
+    REQUIRE( bulk_extractor_batch::next_job(pending, 5) == 1 );   // the largest that fits
+    REQUIRE( bulk_extractor_batch::next_job(pending, 0) == -1 );
+}
+
+TEST_CASE("server_request", "[phase1]") {
+    std::vector<std::string> args;
+    REQUIRE( bulk_extractor_server::parse_request(std::string("-o\0out\0image.raw\0\0", 18), args) );
+    REQUIRE( args == std::vector<std::string>({"-o", "out", "image.raw"}) );
+    REQUIRE( !bulk_extractor_server::parse_request(std::string("-o\0out\0", 7), args) ); // not ended
+    REQUIRE( args.empty() );
+    REQUIRE_THROWS_AS( bulk_extractor_server::parse_request(std::string(bulk_extractor_server::MAX_REQUEST_BYTES+1, 'a'), args),
+                       std::invalid_argument );
+}
+
+TEST_CASE("live_stats", "[phase1]") {
+    std::map<std::string,std::string> stats {{"fraction_read", "50.000000 %"}, {"max_offset", "1024"}, {"elapsed_time", "0:01:00"}};
+    std::map<std::string,scanner_watchdog::scanner_totals> totals;
+    totals["email"] = scanner_watchdog::scanner_totals{3, 300, 1.5, 2.0};
+    std::vector<uint64_t> depths {3, 1};
+
+    std::stringstream js;
+    notify_thread::write_json(js, stats, totals, depths);
+    REQUIRE( js.str().find("\"max_offset\": 1024") != std::string::npos );
+    REQUIRE( js.str().find("\"elapsed_time\": \"0:01:00\"") != std::string::npos );
+    REQUIRE( js.str().find("\"email\": {\"calls\": 3, \"bytes\": 300, \"cpu_seconds\": 1.5") != std::string::npos );
+    REQUIRE( js.str().find("\"calls_by_depth\": [3, 1]") != std::string::npos );
+
+    std::stringstream ps;
+    notify_thread::write_prometheus(ps, stats, totals, depths);
+    REQUIRE( ps.str().find("bulk_extractor_max_offset 1024\n") != std::string::npos );
+    REQUIRE( ps.str().find("bulk_extractor_fraction_read 0.5\n") != std::string::npos );
+    REQUIRE( ps.str().find("bulk_extractor_scanner_cpu_seconds_total{scanner=\"email\"} 1.5\n") != std::string::npos );
+    REQUIRE( ps.str().find("bulk_extractor_scanner_calls_by_depth_total{depth=\"1\"} 1\n") != std::string::npos );
+    REQUIRE( ps.str().find("elapsed_time") == std::string::npos );
+}
+
+TEST_CASE("trace_writer", "[phase1]") {
+    trace_writer::enabled = true;
+    {
+        trace_writer::span span("read", "sbuf_alloc");
+        span.set_args("\"pos0\": " + trace_writer::json_string("1000-GZIP-\"x\""));
+    }
+    trace_writer::enabled = false;
+    { trace_writer::span span("read", "not recorded"); }
+    std::stringstream ss;
+    trace_writer::write(ss);
+    REQUIRE( ss.str().find("\"cat\": \"read\", \"name\": \"sbuf_alloc\"") != std::string::npos );
+    REQUIRE( ss.str().find("\"args\": {\"pos0\": \"1000-GZIP-\\\"x\\\"\"}") != std::string::npos );
+    REQUIRE( ss.str().find("not recorded") == std::string::npos );
+}
+
+TEST_CASE("shard_range", "[phase1]") {
+    Phase1::Config cfg;
+    cfg.opt_pagesize = 100;
+    cfg.set_shard_parameters("1/3");
+    cfg.set_shard_range(1050);          // 11 pages
+    REQUIRE( cfg.opt_scan_start == 300 );
+    REQUIRE( cfg.opt_scan_end == 700 );
+    cfg.set_shard_parameters("2/3");
+    cfg.set_shard_range(1050);
+    REQUIRE( cfg.opt_scan_start == 700 );
+    REQUIRE( cfg.opt_scan_end == 0 );   // to the end of the image
+    REQUIRE_THROWS( cfg.set_shard_parameters("3/3") );
+}
+
+TEST_CASE("block_sampler", "[phase1]") {
+    constexpr uint64_t MAX_BLOCKS = 10000;
+    std::set<uint64_t> seen;
+    for (u_int pass=0; pass<3; pass++){
+        Phase1::block_sampler bs(MAX_BLOCKS, 0.25, 42, pass, 0);
+        uint64_t block = 0, last = 0, count = 0;
+        while (bs.next(block)){
+            REQUIRE( block < MAX_BLOCKS );
+            REQUIRE( (count==0 || block > last) ); // blocks come out in order
+            REQUIRE( seen.count(block) == 0 );     // and are never repeated between passes
+            seen.insert(block);
+            last = block;
+            count++;
+        }
+        REQUIRE( count > MAX_BLOCKS * 0.20 );
+        REQUIRE( count < MAX_BLOCKS * 0.30 );
+    }
+
+    /* Stratified sampling takes the same share from every region */
+    Phase1::block_sampler bs(MAX_BLOCKS, 0.01, 42, 0, 10);
+    std::vector<int> per_stratum(10);
+    uint64_t block = 0;
+    while (bs.next(block)){
+        per_stratum[block / 1000]++;
+    }
+    for (auto n : per_stratum){
+        REQUIRE( n == 10 );
+    }
+
+    /* and its passes take different blocks */
+    std::set<uint64_t> stratified;
+    for (u_int pass=0; pass<3; pass++){
+        Phase1::block_sampler sbs(MAX_BLOCKS, 0.25, 42, pass, 4);
+        while (sbs.next(block)){
+            REQUIRE( stratified.count(block) == 0 );
+            stratified.insert(block);
+        }
+    }
+    REQUIRE( stratified.size() == 3 * MAX_BLOCKS / 4 );
+
+    Phase1::Config cfg;
+    REQUIRE_THROWS( cfg.set_sampling_parameters("0.1:1:0") );
+    REQUIRE_THROWS( cfg.set_sampling_parameters("0.1:1:-4") );
+    cfg.set_sampling_parameters("0.1:1:8");
+    REQUIRE( cfg.sampling_strata == 8 );
+}
+
+TEST_CASE("page_ranges", "[phase1]") {
+    page_ranges pr;
+    pr.add(0, 100);
+    pr.add(200, 100);
+    pr.add(100, 100);                   // fills the gap
+    pr.add("1000-GZIP-0", 0);
+    REQUIRE( pr.range_count() == 1 );
+    REQUIRE( pr.contains(0) );
+    REQUIRE( pr.contains(299) );
+    REQUIRE( pr.contains(300) == false );
+    REQUIRE( pr.contains("250") );
+    REQUIRE( pr.contains("1000-GZIP-0") );
+    REQUIRE( pr.contains("1000-GZIP-10") == false );
+
+    std::stringstream ss;
+    pr.write(ss);
+    page_ranges pr2;
+    pr2.read(ss);
+    REQUIRE( pr2.range_count() == 1 );
+    REQUIRE( pr2.other_count() == 1 );
+    REQUIRE( pr2.contains(150) );
+    REQUIRE( pr2.contains("1000-GZIP-0") );
+}
+
+TEST_CASE("output_checkpoint", "[phase1]") {
+    auto outdir = std::filesystem::path(NamedTemporaryDirectory());
+    {
+        std::ofstream email(outdir / "email.txt");
+        email << "# header\n100\tuser@example.com\tcontext\n200\tpartial";
+    }
+    REQUIRE( output_checkpoint::whole_lines_length(outdir / "email.txt") == 38 );
+    REQUIRE( output_checkpoint::whole_lines_length(outdir / "url.txt") == 0 );
+
+    page_ranges pages;
+    pages.add(0, 4096);
+    output_checkpoint::save(outdir, {"email", "url"}, pages);
+
+    /* what was written after the checkpoint is cut off, and the files made since are removed */
+    {
+        std::ofstream email(outdir / "email.txt", std::ios::app);
+        email << " line\n9000\tlater@example.com\tcontext\n";
+        std::ofstream url(outdir / "url.txt");
+        url << "9000\thttp://later.example.com/\tcontext\n";
+    }
+    page_ranges seen;
+    output_checkpoint::restore(outdir, seen);
+    REQUIRE( seen.contains(4095) );
+    REQUIRE( !seen.contains(4096) );
+    REQUIRE( std::filesystem::file_size(outdir / "email.txt") == 38 );
+    REQUIRE( !std::filesystem::exists(outdir / "url.txt") );
+
+    /* a file that was not on the disk is not cut */
+    std::filesystem::resize_file(outdir / "email.txt", 10);
+    REQUIRE_THROWS_AS( output_checkpoint::restore(outdir, seen), std::runtime_error );
+}
+
 /****************************************************************
  ** Test the path printer
  **/
@@ -33,6 +33,8 @@
 #include "bulk_extractor_restarter.h"
 #include "bulk_extractor_scanners.h"
 #include "exif_reader.h"
+#include "feature_quotas.h"
+#include "feature_shards.h"
 #include "image_process.h"
 #include "jpeg_validator.h"
 #include "phase1.h"
@@ -210,6 +212,48 @@ TEST_CASE("path-printer", "[end-to-end]") {
     REQUIRE( ss.str() == EXPECTED);
 }
 
+TEST_CASE("e2e-auto-pagesize-quotas", "[end-to-end]") {
+    /* the page quotas count by the page size that -G auto chose, not by the default */
+    std::filesystem::path inpath = test_dir() / "test_base64json.txt";
+    std::string inpath_string = inpath.string();
+    std::filesystem::path outdir = NamedTemporaryDirectory();
+    std::string outdir_string = outdir.string();
+    std::stringstream ss;
+    const char *argv[] = {"bulk_extractor","-G","auto","-S","feature_page_quotas=email:1",
+                          "-o",outdir_string.c_str(), inpath_string.c_str(), nullptr};
+    int ret = bulk_extractor_main(ss, std::cerr,
+                                  argv_count(const_cast<char * const *>(argv)),
+                                  const_cast<char * const *>(argv));
+    REQUIRE( ret==0 );
+    const std::string out = ss.str();
+    const size_t at = out.find("Page size: ");
+    REQUIRE( at != std::string::npos );
+    const size_t pagesize = std::stoull(out.substr(at + 11));
+    REQUIRE( pagesize != Phase1::Config().opt_pagesize );
+    REQUIRE( feature_quotas::pagesize() == pagesize );
+    feature_quotas::set("", "", "");
+}
+
+TEST_CASE("e2e-small-input-shards", "[end-to-end]") {
+    /* a small input is scanned in the main thread, so it gets one shard however many threads -j asked for */
+    std::filesystem::path inpath = test_dir() / "test_base64json.txt";
+    std::string inpath_string = inpath.string();
+    std::filesystem::path outdir = NamedTemporaryDirectory();
+    std::string outdir_string = outdir.string();
+    std::stringstream ss;
+    const char *argv[] = {"bulk_extractor","-j","4","-S","feature_shards=email","-S","feature_shards_merge=NO",
+                          "-o",outdir_string.c_str(), inpath_string.c_str(), nullptr};
+    int ret = bulk_extractor_main(ss, std::cerr,
+                                  argv_count(const_cast<char * const *>(argv)),
+                                  const_cast<char * const *>(argv));
+    REQUIRE( ret==0 );
+    REQUIRE( ss.str().find("Small input") != std::string::npos );
+    REQUIRE( feature_shards::shards() == 1 );
+    REQUIRE( std::filesystem::exists( outdir / "email.t00.txt" ));
+    REQUIRE( !std::filesystem::exists( outdir / "email.t01.txt" ));
+    feature_shards::set_recorders("", 1);
+}
+
 TEST_CASE("e2e-CFReDS001", "[end-to-end]") {
     std::filesystem::path inpath = test_dir() / "CFReDS001.E01";
     std::string inpath_string = inpath.string();
@@ -289,6 +333,26 @@ TEST_CASE("restarter", "[restarter]") {
     REQUIRE( std::filesystem::exists( out_xml ) == true); // because it has not been renamed yet
     r.restart();
     REQUIRE( std::filesystem::exists( out_xml ) == false); // because now it has been renamed
-    REQUIRE( cfg.seen_page_ids.find("369098752") != cfg.seen_page_ids.end() );
-    REQUIRE( cfg.seen_page_ids.find("369098752+") == cfg.seen_page_ids.end() );
+    REQUIRE( cfg.seen_pages.contains("369098752") );
+    REQUIRE( cfg.seen_pages.contains("369098752+") == false );
+}
+
+TEST_CASE("restarter_scan_report", "[restarter]") {
+    std::stringstream report;
+    report << "<dfxml>\n<provided_filename>/cases/a &amp; b.raw</provided_filename>\n";
+    for (int i = 0; i < 100; i++) {
+        report << "<debug:work_start threadid='0x1' pos0='" << i * 2 * 4096 << "' pagesize='4096' t='1'/>\n";
+    }
+    report << "<debug:work_start threadid='0x1' pos0='dir/f&amp;g.txt' pagesize='10'/>\n"
+           << "<debug:restart_range start='4096' end='8192'/>\n"
+           << "<debug:work_start threadid='0x1' pos0='1000000000' pages"; // cut off
+    page_ranges pages;
+    std::string provided_filename;
+    bulk_extractor_restarter::scan_report(report, pages, &provided_filename);
+    REQUIRE( provided_filename == "/cases/a & b.raw" );
+    REQUIRE( pages.range_count() == 99 );         // 0 and 4096 join with the restart_range
+    REQUIRE( pages.contains("4096") );
+    REQUIRE( pages.contains("12288") == false );
+    REQUIRE( pages.contains("dir/f&g.txt") );
+    REQUIRE( pages.contains("1000000000") == false );
 }
@@ -0,0 +1,102 @@
+#ifndef TLD_H
+#define TLD_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * tld:
+ * The top level domains that scan_email accepts at the end of an email address, looked up with a
+ * perfect hash made by the compiler. The scanner's rules match any label of letters after the last
+ * dot and ask is_tld() about it; with the list out of the regular expressions the DFA is a fraction
+ * of the size, and the list can change without the scanner being regenerated.
+ *
+ * A name is packed into a key of five bits a letter. The two-letter names (the countries) are a bit
+ * in a 1024-bit map indexed by the key; the longer ones, of which there are few, are in a table of
+ * LONG_SLOTS whose multiplier is found at compile time so that no two of them share a slot.
+ */
+
+namespace tld {
+inline constexpr const char *LONG_NAMES[] {
+    "AERO", "ARPA", "ASIA", "BIZ", "CAT", "COM", "COOP", "EDU", "GOV", "INFO", "INT", "JOBS", "MIL",
+    "MOBI", "MUSEUM", "NAME", "NET", "ORG", "PRO", "TEL", "TRAVEL"
+};
+inline constexpr const char COUNTRY_NAMES[] {
+    "AC AD AE AF AG AI AL AM AN AO AQ AR AS AT AU AW AX AZ BA BB BD BE BF BG BH BI BJ BL BM BN BO BR BS BT BV BW "
+    "BY BZ CA CC CD CF CG CH CI CK CL CM CN CO CR CU CV CX CY CZ DE DJ DK DM DO DZ EC EE EG EH ER ES ET EU FI FJ "
+    "FK FM FO FR GA GB GD GE GF GG GH GI GL GM GN GP GQ GR GS GT GU GW GY HK HM HN HR HT HU ID IE IL IM IN IO IQ "
+    "IR IS IT JE JM JO JP KE KG KH KI KM KN KP KR KW KY KZ LA LB LC LI LK LR LS LT LU LV LY MA MC MD ME MF MG MH "
+    "MK ML MM MN MO MP MQ MR MS MT MU MV MW MX MY MZ NA NC NE NF NG NI NL NO NP NR NU NZ OM PA PE PF PG PH PK PL "
+    "PM PN PR PS PT PW PY QA RE RO RS RU RW SA SB SC SD SE SG SH SI SJ SK SL SM SN SO SR ST SU SV SY SZ TC TD TF "
+    "TG TH TJ TK TL TM TN TO TP TR TT TV TW TZ UA UG UK UM US UY UZ VA VC VE VG VI VN VU WF WS YE YT YU ZA ZM ZW"
+};
+inline constexpr size_t MAX_LEN {6};
+inline constexpr unsigned LONG_BITS {6};
+inline constexpr size_t LONG_SLOTS {size_t(1) << LONG_BITS};
+
+/* The key of the len letters at text, every stride bytes, in either case; 0 if one is not a letter */
+constexpr uint32_t key(const char *text, size_t len, size_t stride = 1) {
+    uint32_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+        const char ch = text[i * stride];
+        const uint32_t v = (ch >= 'A' && ch <= 'Z') ? ch - 'A' + 1 : (ch >= 'a' && ch <= 'z') ? ch - 'a' + 1 : 0;
+        if (v == 0) return 0;
+        k |= v << (5 * i);
+    }
+    return k;
+}
+
+constexpr size_t length(const char *s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+constexpr uint32_t slot(uint32_t k, uint32_t multiplier) {
+    return uint32_t(k * multiplier) >> (32 - LONG_BITS);
+}
+
+struct table {
+    uint32_t multiplier {0};
+    uint32_t long_keys[LONG_SLOTS] {};
+    uint64_t countries[1024 / 64] {};
+};
+
+constexpr table make_table() {
+    table t {};
+    for (size_t i = 0; i + 1 < sizeof(COUNTRY_NAMES); i += 3) {
+        const uint32_t k = key(COUNTRY_NAMES + i, 2);
+        t.countries[k / 64] |= uint64_t(1) << (k % 64);
+    }
+    for (uint32_t m = 0x9e3779b1; ; m += 2) {
+        bool ok = true;
+        for (auto &it : t.long_keys) it = 0;
+        for (const char *name : LONG_NAMES) {
+            const uint32_t k = key(name, length(name));
+            uint32_t &s = t.long_keys[slot(k, m)];
+            if (s != 0) {
+                ok = false;
+                break;
+            }
+            s = k;
+        }
+        if (ok) {
+            t.multiplier = m;
+            return t;
+        }
+    }
+}
+
+inline constexpr table TABLE = make_table();
+
+/* True if the len letters at text (every stride bytes, so 2 for UTF-16LE) are a top level domain */
+constexpr bool is_tld(const char *text, size_t len, size_t stride = 1) {
+    if (len < 2 || len > MAX_LEN) return false;
+    const uint32_t k = key(text, len, stride);
+    if (k == 0) return false;
+    if (len == 2) return TABLE.countries[k / 64] & (uint64_t(1) << (k % 64));
+    return TABLE.long_keys[slot(k, TABLE.multiplier)] == k;
+}
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include "config.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "trace_writer.h"
+
+trace_writer::thread_events &trace_writer::my_events()
+{
+    thread_local std::shared_ptr<thread_events> te;
+    if (!te) {
+        te = std::make_shared<thread_events>();
+        std::lock_guard<std::mutex> lock(Mthreads);
+        te->tid = threads.size() + 1;
+        threads.push_back(te);
+    }
+    return *te;
+}
+
+trace_writer::span::span(const char *category_, const std::string &name_):
+    category(category_), name(enabled ? name_ : std::string())
+{
+    if (enabled) start = clock::now();
+}
+
+trace_writer::span::~span()
+{
+    if (enabled && start != clock::time_point()) record(category, name, start, clock::now(), args);
+}
+
+void trace_writer::record(const char *category, const std::string &name, clock::time_point start,
+                          clock::time_point end, const std::string &args)
+{
+    if (!enabled) return;
+    if (total_events++ >= MAX_EVENTS) {
+        dropped_events++;
+        return;
+    }
+    thread_events &te = my_events();
+    event e;
+    e.category    = category;
+    e.name        = name;
+    e.start_us    = std::chrono::duration_cast<std::chrono::microseconds>(start - epoch).count();
+    e.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    e.args        = args;
+    std::lock_guard<std::mutex> lock(te.M);
+    te.events.push_back(std::move(e));
+}
+
+std::string trace_writer::json_string(const std::string &s)
+{
+    std::stringstream ss;
+    ss << '"';
+    for (unsigned char ch : s) {
+        if (ch=='"' || ch=='\\') ss << '\\' << ch;
+        else if (ch < 0x20) ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(ch) << std::dec;
+        else ss << ch;
+    }
+    ss << '"';
+    return ss.str();
+}
+
+void trace_writer::write(std::ostream &os)
+{
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    const char *sep = "";
+    std::lock_guard<std::mutex> lock(Mthreads);
+    for (const auto &te : threads) {
+        std::lock_guard<std::mutex> lock2(te->M);
+        for (const auto &e : te->events) {
+            os << sep << "{\"ph\": \"X\", \"pid\": 1, \"tid\": " << te->tid
+               << ", \"cat\": " << json_string(e.category) << ", \"name\": " << json_string(e.name)
+               << ", \"ts\": " << e.start_us << ", \"dur\": " << e.duration_us
+               << ", \"args\": {" << e.args << "}}";
+            sep = ",\n";
+        }
+    }
+    os << "\n], \"otherData\": {\"dropped_events\": " << dropped_events << "}}\n";
+}
+
+void trace_writer::save(const std::filesystem::path &fname)
+{
+    std::ofstream os(fname);
+    if (!os.is_open()) throw std::runtime_error("cannot open " + fname.string());
+    write(os);
+}
@@ -0,0 +1,75 @@
+#ifndef TRACE_WRITER_H
+#define TRACE_WRITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * trace_writer:
+ * Records what each thread does, and when, and writes it as a Chrome trace (JSON trace event format),
+ * which can be loaded into perfetto (ui.perfetto.dev) or chrome://tracing. Enabled with -S trace=YES;
+ * the trace is written to trace.json in the output directory at the end of phase 1.
+ *
+ * Events are "complete" events: a category, a name, a start, a duration and arguments:
+ *   scan    - one scanner call (scanner_watchdog); args are pos0, depth and bytes
+ *   read    - reading one page from the image
+ *   wait    - the reader waiting for queue capacity or memory
+ * Each thread appends to its own buffer, so recording takes no shared lock. At most MAX_EVENTS are kept.
+ */
+
+class trace_writer {
+public:
+    using clock = std::chrono::steady_clock;
+    struct event {
+        const char *category {nullptr};
+        std::string name {};
+        uint64_t    start_us {0};
+        uint64_t    duration_us {0};
+        std::string args {};            // the members of a JSON object, e.g. "\"bytes\": 10"
+    };
+
+    /* RAII: records an event for its lifetime */
+    class span {
+        const char *category;
+        std::string name;
+        std::string args {};
+        clock::time_point start {};
+    public:
+        span(const char *category_, const std::string &name_);
+        void set_args(const std::string &args_) { args = args_; }
+        ~span();
+    };
+
+    static inline std::atomic<bool> enabled {false};
+    static inline const size_t MAX_EVENTS {10*1000*1000};
+    static inline const std::string TRACE_FILENAME {"trace.json"};
+
+    static void record(const char *category, const std::string &name, clock::time_point start,
+                       clock::time_point end, const std::string &args);
+    static std::string json_string(const std::string &s);
+    static void write(std::ostream &os);
+    static void save(const std::filesystem::path &fname);
+    static size_t dropped() { return dropped_events; }
+
+private:
+    struct thread_events {
+        unsigned tid {0};
+        std::mutex M {};                // taken by the writer, and by the thread only to append
+        std::vector<event> events {};
+    };
+    static inline const clock::time_point epoch {clock::now()};
+    static inline std::mutex Mthreads {};
+    static inline std::vector<std::shared_ptr<thread_events>> threads {};
+    static inline std::atomic<size_t> total_events {0};
+    static inline std::atomic<size_t> dropped_events {0};
+    static thread_events &my_events();
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * triage_planner.cpp:
+ * Ranking the regions of an image by the features of a sample; see triage_planner.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <numeric>
+
+#include "feature_files.h"
+#include "triage_planner.h"
+
+triage_planner::triage_planner(uint64_t max_blocks_, uint64_t regions_): max_blocks(max_blocks_)
+{
+    const uint64_t strata = std::max<uint64_t>(1, std::min(regions_, max_blocks));
+    region_blocks_ = std::max<uint64_t>(1, (max_blocks + strata - 1) / strata);
+    n_regions = (max_blocks + region_blocks_ - 1) / region_blocks_;
+    sampled_bytes.assign(n_regions, 0);
+}
+
+uint64_t triage_planner::region_end(uint64_t region) const
+{
+    return std::min(max_blocks, (region + 1) * region_blocks_);
+}
+
+void triage_planner::add_sampled(uint64_t block, uint64_t bytes)
+{
+    if (region_of(block) < n_regions) sampled_bytes[region_of(block)] += bytes;
+}
+
+void triage_planner::add_hit(uint64_t region, const std::string &feature_file, uint64_t count)
+{
+    if (region >= n_regions) return;
+    auto &v = hits[feature_file];
+    if (v.empty()) v.assign(n_regions, 0);
+    v[region] += count;
+}
+
+uint64_t triage_planner::count_features(const std::filesystem::path &outdir, uint64_t pagesize)
+{
+    uint64_t total = 0;
+    for (const auto &txt : output_text_files(outdir, true)) {
+        std::ifstream in(txt, std::ios::binary);
+        const std::string name = txt.stem().string();
+        std::string line;
+        while (std::getline(in, line)) {
+            if (in.eof()) break;        // not ended yet; the recorder is still writing it
+            if (line.empty() || line[0] < '0' || line[0] > '9') continue; // comments
+            const uint64_t offset = strtoull(line.c_str(), nullptr, 10); // of the depth-0 page it was found under
+            add_hit(region_of(offset / pagesize), name);
+            total++;
+        }
+    }
+    return total;
+}
+
+double triage_planner::score(uint64_t region) const
+{
+    if (region >= n_regions || sampled_bytes[region] == 0) return 0;
+    const double all_sampled = std::accumulate(sampled_bytes.begin(), sampled_bytes.end(), 0.0);
+    double s = 0;
+    for (const auto &it : hits) {
+        const double all_hits = std::accumulate(it.second.begin(), it.second.end(), 0.0);
+        if (all_hits == 0) continue;
+        s += (it.second[region] / double(sampled_bytes[region])) / (all_hits / all_sampled);
+    }
+    return s;
+}
+
+std::vector<uint64_t> triage_planner::ranked_regions() const
+{
+    std::vector<std::pair<double, uint64_t>> scored;
+    for (uint64_t r = 0; r < n_regions; r++) scored.emplace_back(score(r), r);
+    std::stable_sort(scored.begin(), scored.end(), [](const auto &a, const auto &b){ return a.first > b.first; });
+    std::vector<uint64_t> order;
+    for (const auto &it : scored) order.push_back(it.second);
+    return order;
+}
@@ -0,0 +1,51 @@
+#ifndef TRIAGE_PLANNER_H
+#define TRIAGE_PLANNER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * triage_planner:
+ * The plan of -S triage_minutes=N, which gets the most features it can from an image in N minutes.
+ *
+ * The image's pages are cut into regions, as the strata of -S sampling_strata. Phase 1 first scans a
+ * sample of the pages of every region (-S triage_sample=FRACTION, and at least one page a region), and
+ * waits for the scanners to finish them; then the features of each feature file are counted by the
+ * region their depth-0 offset is in. A region's score is the sum, over the feature files, of its density
+ * of that file's features (hits per sampled byte) over the file's density in the whole sample, so that a
+ * region dense in rare features (ccn) ranks with one dense in common ones (url). Phase 1 then scans the
+ * rest of the regions whole, highest score first and the regions without hits in order, until the budget
+ * runs out. The pages still queued when it runs out are scanned, and what was covered is in the report.
+ */
+
+class triage_planner {
+public:
+    triage_planner(uint64_t max_blocks, uint64_t regions);
+
+    uint64_t regions() const { return n_regions; }
+    uint64_t region_blocks() const { return region_blocks_; } // as block_sampler's strata
+    uint64_t region_of(uint64_t block) const { return block / region_blocks_; }
+    uint64_t region_start(uint64_t region) const { return region * region_blocks_; } // first block
+    uint64_t region_end(uint64_t region) const;                                        // after the last block
+
+    void     add_sampled(uint64_t block, uint64_t bytes);
+    void     add_hit(uint64_t region, const std::string &feature_file, uint64_t hits = 1);
+
+    /* Counts the features in the feature files of outdir by region; lines that are not complete yet are left */
+    uint64_t count_features(const std::filesystem::path &outdir, uint64_t pagesize);
+
+    double   score(uint64_t region) const;
+    std::vector<uint64_t> ranked_regions() const; // highest score first, then the regions with none in order
+
+private:
+    const uint64_t max_blocks;
+    uint64_t region_blocks_ {1};
+    uint64_t n_regions {0};
+    std::vector<uint64_t> sampled_bytes {}; // of each region
+    std::map<std::string, std::vector<uint64_t>> hits {}; // of each feature file in each region
+};
+
+#endif
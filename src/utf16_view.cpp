@@ -0,0 +1,108 @@
+#include "config.h"
+
+#include <cstring>
+
+#include "utf16_view.h"
+
+namespace {
+    inline bool text_char(uint8_t ch) {
+        return (ch>=0x20 && ch<0x7f) || ch=='\t' || ch=='\n' || ch=='\r';
+    }
+}
+
+/* A bit for each of the 64 bytes at p that may be the low byte of a character: printable, and the next byte 0 */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+static inline uint64_t candidate_mask64(const uint8_t *p, uint8_t next)
+{
+    const __m128i below = _mm_set1_epi8(0x1f);
+    const __m128i del   = _mm_set1_epi8(0x7f);
+    const __m128i zero  = _mm_setzero_si128();
+    uint64_t low = 0, zeros = 0;
+    for (int k = 0; k < 4; k++) {
+        // signed compares: bytes >= 0x80 are negative, so they fail the first; 9 to 13 include tab, LF and CR
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16*k));
+        const __m128i w = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(c, below), _mm_cmpgt_epi8(del, c)),
+                                       _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(8)), _mm_cmpgt_epi8(_mm_set1_epi8(14), c)));
+        low   |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(w))) << (16*k);
+        zeros |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero)))) << (16*k);
+    }
+    return low & ((zeros >> 1) | (uint64_t(next==0) << 63));
+}
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+static inline uint64_t candidate_mask64(const uint8_t *p, uint8_t next)
+{
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bits = vld1q_u8(weights);
+    uint8x16_t l[4], z[4];
+    for (int k = 0; k < 4; k++) {
+        const uint8x16_t c = vld1q_u8(p + 16*k);
+        const uint8x16_t w = vorrq_u8(vandq_u8(vcgeq_u8(c, vdupq_n_u8(0x20)), vcleq_u8(c, vdupq_n_u8(0x7e))),
+                                      vandq_u8(vcgeq_u8(c, vdupq_n_u8(9)), vcleq_u8(c, vdupq_n_u8(13))));
+        l[k] = vandq_u8(w, bits);
+        z[k] = vandq_u8(vceqq_u8(c, vdupq_n_u8(0)), bits);
+    }
+    // three pairwise adds fold each 8 bytes of weights into one byte of the mask
+    uint8x16_t ls = vpaddq_u8(vpaddq_u8(l[0], l[1]), vpaddq_u8(l[2], l[3]));
+    uint8x16_t zs = vpaddq_u8(vpaddq_u8(z[0], z[1]), vpaddq_u8(z[2], z[3]));
+    ls = vpaddq_u8(ls, ls);
+    zs = vpaddq_u8(zs, zs);
+    const uint64_t low   = vgetq_lane_u64(vreinterpretq_u64_u8(ls), 0);
+    const uint64_t zeros = vgetq_lane_u64(vreinterpretq_u64_u8(zs), 0);
+    return low & ((zeros >> 1) | (uint64_t(next==0) << 63));
+}
+#else
+static inline uint64_t candidate_mask64(const uint8_t *p, uint8_t next)
+{
+    uint64_t mask = 0;
+    for (int k = 0; k < 64; k++) {
+        const uint8_t following = k < 63 ? p[k+1] : next;
+        mask |= static_cast<uint64_t>(text_char(p[k]) && following==0) << k;
+    }
+    return mask;
+}
+#endif
+
+/*
+ * Candidates are found a block at a time; a run is then followed one character at a time from
+ * the first candidate, at that candidate's alignment, and the scan resumes after it.
+ */
+void utf16_view::find(const uint8_t *buf, size_t bufsize, size_t pagesize, utf16_view &view)
+{
+    view.runs.clear();
+    view.text.clear();
+    size_t i = 0;
+    while (i + 1 < bufsize && i < pagesize) {
+        /* skip the blocks without a candidate */
+        if (i + 65 <= bufsize) {
+            const uint64_t mask = candidate_mask64(buf + i, buf[i+64]);
+            if (mask==0) {
+                i += 64;
+                continue;
+            }
+            i += __builtin_ctzll(mask);
+            if (i >= pagesize) break;
+        }
+        size_t end = i;
+        while (end + 1 < bufsize && buf[end+1]==0 && text_char(buf[end])) end += 2;
+        const size_t chars = (end - i) / 2;
+        if (chars >= MIN_CHARS) {
+            view.runs.push_back(run{i, view.text.size(), chars});
+            for (size_t j = i; j < end; j += 2) view.text.push_back(static_cast<char>(buf[j]));
+            view.text.push_back('\0');
+            i = end;
+        } else {
+            i++;
+        }
+    }
+}
+
+const utf16_view &utf16_view::of(const sbuf_t &sbuf)
+{
+    /* found again for every call: an sbuf's address and place do not identify it, since a freed
+     * buffer is reused for the next child of the same size, which may also be at offset 0 */
+    thread_local utf16_view view {};
+    find(sbuf.get_buf(), sbuf.bufsize, sbuf.pagesize, view);
+    return view;
+}
@@ -0,0 +1,44 @@
+#ifndef UTF16_VIEW_H
+#define UTF16_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "be13_api/sbuf.h"
+
+/**
+ * utf16_view:
+ * The UTF-16LE text of an sbuf, found once and narrowed to ASCII, for the text scanners.
+ *
+ * A run is at least MIN_CHARS consecutive characters that are printable ASCII (or tab, CR, LF)
+ * followed by a zero byte, at either alignment; Windows memory, registry hives and NTFS metadata are
+ * mostly this. The candidates are found 64 bytes at a time with SSE2 or NEON, so binary and ASCII
+ * data cost a compare per byte, and only the blocks with candidates are looked at one byte at a time.
+ *
+ * of() finds the view of an sbuf in a buffer of the thread's, which is valid until the thread's next
+ * call. A character at index i of a run's text is at byte offset + 2*i of the sbuf.
+ */
+
+class utf16_view {
+public:
+    static inline const size_t MIN_CHARS {4};
+
+    struct run {
+        size_t offset {0};              // of the first character, in the sbuf
+        size_t start  {0};              // of its text, in text
+        size_t chars  {0};
+    };
+    std::vector<run> runs {};
+    std::string text {};                // the narrowed characters of every run, each followed by a 0
+
+    std::string_view text_of(const run &r) const { return std::string_view(text).substr(r.start, r.chars); }
+
+    /* Finds the runs that start before pagesize; a run may continue into the margin */
+    static void find(const uint8_t *buf, size_t bufsize, size_t pagesize, utf16_view &view);
+    static const utf16_view &of(const sbuf_t &sbuf);
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "config.h"
+
+#include <cstdint>
+
+#include "cpu_dispatch.h"
+#include "dfxml_cpp/src/dfxml_writer.h"
+#include "utf8_text.h"
+
+namespace {
+    inline unsigned flags_of(uint8_t ch) {
+        if (ch >= 0x80) return utf8_text::NON_ASCII;
+        if (ch < 0x20) return utf8_text::CONTROL;
+        switch (ch) {
+        case '<': case '>': case '&': case '\'': case '"': return utf8_text::XML_SPECIAL;
+        default: return 0;
+        }
+    }
+
+    /* The length of the well-formed sequence that starts at p (RFC 3629: no overlong forms, surrogates
+     * or code points past U+10FFFF), or 0 */
+    size_t sequence_length(const uint8_t *p, const uint8_t *end) {
+        const uint8_t c = p[0];
+        size_t len = 0;
+        uint8_t lo = 0x80, hi = 0xbf;   // of the second byte
+        if (c >= 0xc2 && c <= 0xdf) len = 2;
+        else if (c >= 0xe0 && c <= 0xef) {
+            len = 3;
+            if (c == 0xe0) lo = 0xa0;
+            if (c == 0xed) hi = 0x9f;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            len = 4;
+            if (c == 0xf0) lo = 0x90;
+            if (c == 0xf4) hi = 0x8f;
+        } else {
+            return 0;
+        }
+        if (size_t(end - p) < len) return 0;
+        if (p[1] < lo || p[1] > hi) return 0;
+        for (size_t i = 2; i < len; i++) {
+            if (p[i] < 0x80 || p[i] > 0xbf) return 0;
+        }
+        return len;
+    }
+}
+
+/* The scalar kernels, which the others use for the ends of the text */
+static unsigned block_flags_scalar(const uint8_t *p)
+{
+    unsigned flags = 0;
+    for (int k = 0; k < 16; k++) flags |= flags_of(p[k]);
+    return flags;
+}
+
+static bool block_ascii_scalar(const uint8_t *p)
+{
+    for (int k = 0; k < 16; k++) {
+        if (p[k] >= 0x80) return false;
+    }
+    return true;
+}
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define UTF8_TEXT_X86
+/* The flags of the 16 bytes at p */
+static inline unsigned block_flags_sse2(const uint8_t *p)
+{
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // signed compares: the bytes >= 0x80 are negative, so they are below 0x20 too and are masked out
+    const int high = _mm_movemask_epi8(c);
+    const int low  = _mm_movemask_epi8(_mm_cmplt_epi8(c, _mm_set1_epi8(0x20))) & ~high;
+    const __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('<')), _mm_cmpeq_epi8(c, _mm_set1_epi8('>'))),
+                                         _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('&')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\''))),
+                                                      _mm_cmpeq_epi8(c, _mm_set1_epi8('"'))));
+    return (high ? utf8_text::NON_ASCII : 0) | (low ? utf8_text::CONTROL : 0) |
+        (_mm_movemask_epi8(special) ? utf8_text::XML_SPECIAL : 0);
+}
+
+static inline bool block_ascii_sse2(const uint8_t *p)
+{
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) == 0;
+}
+
+/* As the SSE2 kernels, 32 bytes at a time */
+__attribute__((target("avx2")))
+static unsigned classify_avx2(const uint8_t *p, size_t n)
+{
+    __m256i high = _mm256_setzero_si256(), low = high, special = high;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        high = _mm256_or_si256(high, c);
+        low = _mm256_or_si256(low, _mm256_andnot_si256(c, _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), c)));
+        special = _mm256_or_si256(special,
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('<')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('>'))),
+                            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('&')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\''))),
+                                            _mm256_cmpeq_epi8(c, _mm256_set1_epi8('"')))));
+    }
+    unsigned flags = (_mm256_movemask_epi8(high) ? utf8_text::NON_ASCII : 0) |
+        (_mm256_movemask_epi8(low) ? utf8_text::CONTROL : 0) |
+        (_mm256_movemask_epi8(special) ? utf8_text::XML_SPECIAL : 0);
+    for (; i < n; i++) flags |= flags_of(p[i]);
+    return flags;
+}
+
+__attribute__((target("avx2")))
+static bool valid_avx2(const uint8_t *p, size_t n)
+{
+    const uint8_t *end = p + n;
+    while (p < end) {
+        if (end - p >= 32 && _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))) == 0) {
+            p += 32;
+            continue;
+        }
+        if (*p < 0x80) {
+            p++;
+            continue;
+        }
+        const size_t len = sequence_length(p, end);
+        if (len == 0) return false;
+        p += len;
+    }
+    return true;
+}
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define UTF8_TEXT_NEON
+static inline unsigned block_flags_neon(const uint8_t *p)
+{
+    const uint8x16_t c = vld1q_u8(p);
+    const uint8x16_t high = vcgeq_u8(c, vdupq_n_u8(0x80));
+    const uint8x16_t low  = vcltq_u8(c, vdupq_n_u8(0x20));
+    const uint8x16_t special = vorrq_u8(vorrq_u8(vceqq_u8(c, vdupq_n_u8('<')), vceqq_u8(c, vdupq_n_u8('>'))),
+                                        vorrq_u8(vorrq_u8(vceqq_u8(c, vdupq_n_u8('&')), vceqq_u8(c, vdupq_n_u8('\''))),
+                                                 vceqq_u8(c, vdupq_n_u8('"'))));
+    return (vmaxvq_u8(high) ? utf8_text::NON_ASCII : 0) | (vmaxvq_u8(low) ? utf8_text::CONTROL : 0) |
+        (vmaxvq_u8(special) ? utf8_text::XML_SPECIAL : 0);
+}
+
+static inline bool block_ascii_neon(const uint8_t *p)
+{
+    return vmaxvq_u8(vld1q_u8(p)) < 0x80;
+}
+#endif
+
+template <unsigned (*BLOCK_FLAGS)(const uint8_t *)>
+static unsigned classify_16(const uint8_t *p, size_t n)
+{
+    unsigned flags = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) flags |= BLOCK_FLAGS(p + i);
+    for (; i < n; i++) flags |= flags_of(p[i]);
+    return flags;
+}
+
+template <bool (*BLOCK_ASCII)(const uint8_t *)>
+static bool valid_16(const uint8_t *p, size_t n)
+{
+    const uint8_t *end = p + n;
+    while (p < end) {
+        if (end - p >= 16 && BLOCK_ASCII(p)) {
+            p += 16;
+            continue;
+        }
+        if (*p < 0x80) {
+            p++;
+            continue;
+        }
+        const size_t len = sequence_length(p, end);
+        if (len == 0) return false;
+        p += len;
+    }
+    return true;
+}
+
+struct utf8_kernel {
+    unsigned (*classify)(const uint8_t *p, size_t n);
+    bool (*valid)(const uint8_t *p, size_t n);
+};
+
+static cpu_dispatch::table<utf8_kernel> utf8_kernels("utf8_text", {
+#ifdef UTF8_TEXT_X86
+    {"avx2", cpu_dispatch::AVX2, {classify_avx2, valid_avx2}},
+    {"sse2", cpu_dispatch::SSE2, {classify_16<block_flags_sse2>, valid_16<block_ascii_sse2>}},
+#elif defined(UTF8_TEXT_NEON)
+    {"neon", cpu_dispatch::NEON, {classify_16<block_flags_neon>, valid_16<block_ascii_neon>}},
+#endif
+    {"scalar", 0, {classify_16<block_flags_scalar>, valid_16<block_ascii_scalar>}},
+});
+
+unsigned utf8_text::classify(std::string_view s)
+{
+    return utf8_kernels.fn().classify(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+}
+
+bool utf8_text::valid(std::string_view s)
+{
+    return utf8_kernels.fn().valid(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+}
+
+const char *utf8_text::kernel_name()
+{
+    return utf8_kernels.chosen_name();
+}
+
+/* xmlescape() replaces the five specials, and may replace control characters */
+std::string_view utf8_text::xml_escaped(std::string_view s, std::string &buf)
+{
+    if ((classify(s) & (XML_SPECIAL | CONTROL)) == 0) return s;
+    buf = dfxml_writer::xmlescape(std::string(s));
+    return buf;
+}
+
+std::string utf8_text::xml_escape(std::string_view s)
+{
+    if ((classify(s) & (XML_SPECIAL | CONTROL)) == 0) return std::string(s);
+    return dfxml_writer::xmlescape(std::string(s));
+}
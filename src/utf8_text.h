@@ -0,0 +1,33 @@
+#ifndef UTF8_TEXT_H
+#define UTF8_TEXT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * utf8_text:
+ * The checks that the structured scanners make on the names and values they report: that the text is
+ * UTF-8, that it has no control characters, and whether it must be escaped for XML. Each is a pass
+ * over 32 bytes at a time with AVX2, or 16 with SSE2 or NEON (see cpu_dispatch.h); the ASCII stretches
+ * of valid() cost a compare per block, and only the multi-byte sequences are decoded one byte at a time.
+ *
+ * xml_escaped() returns the text itself when it has none of the characters dfxml_writer::xmlescape()
+ * replaces, so that the usual name (or value) is not copied, and only escapes those that do.
+ */
+
+class utf8_text {
+public:
+    enum flags_t { NON_ASCII = 1, CONTROL = 2, XML_SPECIAL = 4 };
+
+    static unsigned classify(std::string_view s);  // the flags of every byte of s, in one pass
+    static bool valid(std::string_view s);         // well-formed UTF-8, as utf8::find_invalid() would have it
+    static bool has_control(std::string_view s) { return classify(s) & CONTROL; }  // bytes below 0x20
+
+    /* s, or its escape in buf (with dfxml_writer::xmlescape) if it has characters that must be escaped */
+    static std::string_view xml_escaped(std::string_view s, std::string &buf);
+    static std::string xml_escape(std::string_view s);
+    static const char *kernel_name();              // the kernels classify() and valid() use
+};
+
+#endif
@@ -0,0 +1,347 @@
+/**
+ * virtual_disk.cpp:
+ * The block tables of VMDK sparse extents, VHDX and QCOW2; see virtual_disk.h.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "virtual_disk.h"
+
+namespace {
+const uint64_t MAX_BLOCKS {1ULL << 28}; // 2 GiB of table; 16 TiB of 64 KiB blocks
+const uint32_t MAX_GTES_PER_GT {4096};  // VMware writes 512
+const uint64_t MAX_VHDX_METADATA {1024 * 1024}; // of the metadata region that is read
+
+uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+uint32_t le32(const uint8_t *p) { return le16(p) | (uint32_t(le16(p + 2)) << 16); }
+uint64_t le64(const uint8_t *p) { return le32(p) | (uint64_t(le32(p + 4)) << 32); }
+uint32_t be32(const uint8_t *p) { return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+uint64_t be64(const uint8_t *p) { return (uint64_t(be32(p)) << 32) | be32(p + 4); }
+
+bool all_zero(const uint8_t *p, size_t len) { return std::all_of(p, p + len, [](uint8_t c){ return c==0; }); }
+
+/* VHDX GUIDs are stored with their first three fields little-endian */
+bool is_guid(const uint8_t *p, const char *text)
+{
+    static const int order[16] = {3,2,1,0, 5,4, 7,6, 8,9, 10,11,12,13,14,15};
+    std::string hex;
+    for (const char *t = text; *t; t++) if (*t != '-') hex += *t;
+    for (int i=0; i<16; i++) {
+        if (p[order[i]] != std::stoul(hex.substr(2*i, 2), nullptr, 16)) return false;
+    }
+    return true;
+}
+
+const char *VHDX_BAT_REGION      = "2DC27766-F623-4200-9D64-115E9BFD4A08";
+const char *VHDX_METADATA_REGION = "8B7CA206-4790-4B9A-B8FE-575F050F886E";
+const char *VHDX_FILE_PARAMETERS = "CAA16737-FA36-4D43-B3B6-33F0AA44E76B";
+const char *VHDX_DISK_SIZE       = "2FA54224-CD1B-4876-B211-5DBED83BF4B8";
+const char *VHDX_SECTOR_SIZE     = "8141BF1D-A96F-4709-BA47-F233A8FAAB5F";
+}
+
+const char *virtual_disk::format_name(format_t f)
+{
+    switch (f) {
+    case VMDK:  return "VMDK";
+    case VHDX:  return "VHDX";
+    case QCOW2: return "QCOW2";
+    default:    return "none";
+    }
+}
+
+virtual_disk::format_t virtual_disk::detect(const std::filesystem::path &fn)
+{
+    int f = ::open(fn.string().c_str(), O_RDONLY|O_BINARY);
+    if (f < 0) return NONE;
+    uint8_t magic[8] {};
+    const ssize_t n = ::pread(f, magic, sizeof(magic), 0);
+    ::close(f);
+    if (n != sizeof(magic)) return NONE;
+    if (memcmp(magic, "KDMV", 4)==0) return VMDK;
+    if (memcmp(magic, "vhdxfile", 8)==0) return VHDX;
+    if (memcmp(magic, "QFI\xfb", 4)==0) return QCOW2;
+    return NONE;
+}
+
+virtual_disk::virtual_disk(const std::filesystem::path &fn): fname(fn)
+{
+    format_ = detect(fn);
+    fd = ::open(fn.string().c_str(), O_RDONLY|O_BINARY);
+    if (fd < 0 || format_ == NONE) {
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error(fn.string() + ": not a VMDK, VHDX or QCOW2 image");
+    }
+    try {
+        file_size = std::filesystem::file_size(fn);
+        switch (format_) {
+        case VMDK:  open_vmdk(); break;
+        case VHDX:  open_vhdx(); break;
+        case QCOW2: open_qcow2(); break;
+        default: break;
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+virtual_disk::~virtual_disk()
+{
+    ::close(fd);
+}
+
+void virtual_disk::read_file(void *buf, size_t len, uint64_t offset) const
+{
+    for (size_t done = 0; done < len; ) {
+        const ssize_t n = ::pread(fd, static_cast<uint8_t *>(buf) + done, len - done, offset + done);
+        if (n <= 0) {
+            throw std::runtime_error(fname.string() + ": cannot read " + std::to_string(len)
+                                     + " bytes at " + std::to_string(offset));
+        }
+        done += n;
+    }
+}
+
+void virtual_disk::set_geometry(uint64_t size, uint64_t block_size)
+{
+    if (block_size == 0 || (block_size & (block_size - 1)) != 0) {
+        throw std::runtime_error(fname.string() + ": block size " + std::to_string(block_size) + " is not a power of two");
+    }
+    const uint64_t nblocks = size / block_size + (size % block_size ? 1 : 0);
+    if (nblocks > MAX_BLOCKS) {
+        throw std::runtime_error(fname.string() + ": " + std::to_string(nblocks) + " blocks are too many");
+    }
+    size_ = size;
+    block_size_ = block_size;
+    blocks.assign(nblocks, UNSTORED);
+}
+
+void virtual_disk::check_offset(uint64_t offset) const
+{
+    if (offset >= file_size) {
+        throw std::runtime_error(fname.string() + ": a block table points past the end of the file");
+    }
+}
+
+/* A hosted sparse extent: the grain directory is a list of grain tables, which are lists of grains.
+ * A grain table entry is the sector of the grain; 0 is not stored and 1 is a grain of zeros.
+ */
+void virtual_disk::open_vmdk()
+{
+    uint8_t h[512];
+    read_file(h, sizeof(h), 0);
+    const uint32_t flags          = le32(h + 8);
+    const uint64_t capacity       = le64(h + 12); // sectors
+    const uint64_t grain_sectors  = le64(h + 20);
+    const uint32_t gtes_per_gt    = le32(h + 44);
+    const uint64_t gd_sector      = le64(h + 56);
+    static const uint32_t COMPRESSED_GRAINS {1U << 16};
+    if ((flags & COMPRESSED_GRAINS) || gd_sector == UINT64_MAX) {
+        throw std::runtime_error(fname.string() + ": compressed (streamOptimized) VMDK extents are not supported");
+    }
+    if (gtes_per_gt == 0 || gtes_per_gt > MAX_GTES_PER_GT) {
+        throw std::runtime_error(fname.string() + ": " + std::to_string(gtes_per_gt) + " grain table entries");
+    }
+    if (capacity > UINT64_MAX / 512 || grain_sectors > UINT64_MAX / 512 || gd_sector > UINT64_MAX / 512) {
+        throw std::runtime_error(fname.string() + ": VMDK header sizes are out of range");
+    }
+    set_geometry(capacity * 512, grain_sectors * 512);
+
+    const uint64_t ngts = (blocks.size() + gtes_per_gt - 1) / gtes_per_gt;
+    std::vector<uint8_t> gd(ngts * 4);
+    read_file(gd.data(), gd.size(), gd_sector * 512);
+    std::vector<uint8_t> gt(uint64_t(gtes_per_gt) * 4);
+    for (uint64_t i = 0; i < ngts; i++) {
+        const uint64_t gt_sector = le32(&gd[i * 4]);
+        if (gt_sector == 0) continue;
+        read_file(gt.data(), gt.size(), gt_sector * 512);
+        for (uint64_t j = 0; j < gtes_per_gt && i * gtes_per_gt + j < blocks.size(); j++) {
+            const uint64_t sector = le32(&gt[j * 4]);
+            if (sector <= 1) continue;
+            check_offset(sector * 512);
+            blocks[i * gtes_per_gt + j] = sector * 512;
+        }
+    }
+}
+
+/* The active header (of two) gives the log; the region table gives the metadata and the block allocation
+ * table (BAT). After every chunk_ratio payload blocks, the BAT has an entry for a sector bitmap block,
+ * which only a differencing disk uses.
+ */
+void virtual_disk::open_vhdx()
+{
+    static const uint64_t KiB {1024}, MiB {1024 * 1024};
+    uint64_t best_sequence = 0;
+    bool have_header = false;
+    for (uint64_t offset : {64 * KiB, 128 * KiB}) {
+        uint8_t h[4096];
+        read_file(h, sizeof(h), offset);
+        if (memcmp(h, "head", 4) != 0 || le16(h + 66) != 1) continue;
+        const uint64_t sequence = le64(h + 8);
+        if (have_header && sequence <= best_sequence) continue;
+        have_header = true;
+        best_sequence = sequence;
+        if (!all_zero(h + 48, 16)) {
+            throw std::runtime_error(fname.string() + ": the VHDX log must be replayed first (attach the disk to Hyper-V once)");
+        }
+    }
+    if (!have_header) throw std::runtime_error(fname.string() + ": no VHDX header");
+
+    uint8_t r[64 * 1024];
+    read_file(r, sizeof(r), 192 * KiB);
+    if (memcmp(r, "regi", 4) != 0) throw std::runtime_error(fname.string() + ": no VHDX region table");
+    const uint32_t nregions = std::min<uint32_t>(le32(r + 8), (sizeof(r) - 16) / 32);
+    uint64_t bat_offset = 0, bat_length = 0, metadata_offset = 0, metadata_length = 0;
+    for (uint32_t i = 0; i < nregions; i++) {
+        const uint8_t *e = r + 16 + 32 * i;
+        if (is_guid(e, VHDX_BAT_REGION))      { bat_offset = le64(e + 16); bat_length = le32(e + 24); }
+        if (is_guid(e, VHDX_METADATA_REGION)) { metadata_offset = le64(e + 16); metadata_length = le32(e + 24); }
+    }
+    if (bat_offset == 0 || metadata_offset == 0 || metadata_length < 64 * KiB) {
+        throw std::runtime_error(fname.string() + ": no VHDX BAT or metadata region");
+    }
+    /* Hyper-V makes the metadata region 1 MiB; the table and its items are at its start */
+    metadata_length = std::min(metadata_length, MAX_VHDX_METADATA);
+    if (metadata_offset > file_size || metadata_length > file_size - metadata_offset) {
+        throw std::runtime_error(fname.string() + ": the VHDX metadata region is past the end of the file");
+    }
+
+    std::vector<uint8_t> m(metadata_length);
+    read_file(m.data(), m.size(), metadata_offset);
+    if (memcmp(m.data(), "metadata", 8) != 0) throw std::runtime_error(fname.string() + ": no VHDX metadata table");
+    uint32_t block_size = 0, sector_size = 0, metadata_flags = 0;
+    uint64_t disk_size = 0;
+    const uint16_t nitems = std::min<uint16_t>(le16(&m[10]), 2047);
+    for (uint16_t i = 0; i < nitems; i++) {
+        const uint8_t *e = &m[32 + 32 * i];
+        const uint32_t item = le32(e + 16);
+        if (uint64_t(item) + 8 > m.size()) continue;
+        if (is_guid(e, VHDX_FILE_PARAMETERS)) { block_size = le32(&m[item]); metadata_flags = le32(&m[item + 4]); }
+        if (is_guid(e, VHDX_DISK_SIZE))       disk_size = le64(&m[item]);
+        if (is_guid(e, VHDX_SECTOR_SIZE))     sector_size = le32(&m[item]);
+    }
+    static const uint32_t HAS_PARENT {2};
+    if (metadata_flags & HAS_PARENT) throw std::runtime_error(fname.string() + ": differencing VHDX disks are not supported");
+    if (sector_size == 0 || block_size == 0) throw std::runtime_error(fname.string() + ": no VHDX block or sector size");
+    set_geometry(disk_size, block_size);
+
+    const uint64_t chunk_ratio = (uint64_t(1) << 23) * sector_size / block_size;
+    if (chunk_ratio == 0) throw std::runtime_error(fname.string() + ": VHDX block size too large");
+    const uint64_t nentries = blocks.size() + (blocks.size() ? (blocks.size() - 1) / chunk_ratio : 0);
+    if (nentries * 8 > bat_length) throw std::runtime_error(fname.string() + ": VHDX BAT too short");
+    if (bat_offset > file_size || nentries * 8 > file_size - bat_offset) {
+        throw std::runtime_error(fname.string() + ": the VHDX BAT is past the end of the file");
+    }
+    std::vector<uint8_t> bat(nentries * 8);
+    read_file(bat.data(), bat.size(), bat_offset);
+    static const uint64_t PAYLOAD_BLOCK_FULLY_PRESENT {6}, PAYLOAD_BLOCK_PARTIALLY_PRESENT {7};
+    for (uint64_t i = 0; i < blocks.size(); i++) {
+        const uint64_t e = le64(&bat[8 * (i + i / chunk_ratio)]);
+        const uint64_t state = e & 7;
+        if (state == PAYLOAD_BLOCK_PARTIALLY_PRESENT) {
+            throw std::runtime_error(fname.string() + ": partially present VHDX blocks are not supported");
+        }
+        if (state != PAYLOAD_BLOCK_FULLY_PRESENT) continue; // not present, undefined, zero or unmapped
+        const uint64_t offset = e & ~(MiB - 1);
+        check_offset(offset);
+        blocks[i] = offset;
+    }
+}
+
+/* The L1 table is a list of L2 tables, which are lists of clusters. An L2 entry is the file offset of
+ * the cluster; bit 62 marks a compressed cluster, and in version 3 bit 0 marks a cluster of zeros.
+ */
+void virtual_disk::open_qcow2()
+{
+    uint8_t h[104] {};
+    read_file(h, 72, 0);
+    const uint32_t version = be32(h + 4);
+    if (version != 2 && version != 3) throw std::runtime_error(fname.string() + ": QCOW version " + std::to_string(version) + " is not supported");
+    if (version == 3) read_file(h + 72, 32, 72);
+    const uint64_t backing_file    = be64(h + 8);
+    const uint32_t cluster_bits    = be32(h + 20);
+    const uint64_t disk_size       = be64(h + 24);
+    const uint32_t crypt_method    = be32(h + 32);
+    const uint32_t l1_size         = be32(h + 36);
+    const uint64_t l1_offset       = be64(h + 40);
+    const uint64_t incompatible    = version == 3 ? be64(h + 72) : 0;
+    static const uint64_t DIRTY {1}, CORRUPT {2}, COMPRESSION_TYPE {8}; // the others change how clusters are found
+    if (backing_file) throw std::runtime_error(fname.string() + ": QCOW2 images with a backing file are not supported");
+    if (crypt_method) throw std::runtime_error(fname.string() + ": encrypted QCOW2 images are not supported");
+    if (incompatible & ~(DIRTY | CORRUPT | COMPRESSION_TYPE)) {
+        throw std::runtime_error(fname.string() + ": QCOW2 external data files and extended L2 entries are not supported");
+    }
+    if (cluster_bits < 9 || cluster_bits > 21) throw std::runtime_error(fname.string() + ": bad QCOW2 cluster size");
+    set_geometry(disk_size, uint64_t(1) << cluster_bits);
+
+    static const uint64_t OFFSET_MASK {0x00fffffffffffe00ULL}, COMPRESSED {1ULL << 62}, ZERO {1};
+    const uint64_t l2_entries = block_size_ / 8;
+    const uint64_t nl1 = (blocks.size() + l2_entries - 1) / l2_entries;
+    if (nl1 > l1_size) throw std::runtime_error(fname.string() + ": QCOW2 L1 table too short");
+    std::vector<uint8_t> l1(nl1 * 8);
+    read_file(l1.data(), l1.size(), l1_offset);
+    std::vector<uint8_t> l2(block_size_);
+    for (uint64_t i = 0; i < nl1; i++) {
+        const uint64_t l2_offset = be64(&l1[i * 8]) & OFFSET_MASK;
+        if (l2_offset == 0) continue;
+        read_file(l2.data(), l2.size(), l2_offset);
+        for (uint64_t j = 0; j < l2_entries && i * l2_entries + j < blocks.size(); j++) {
+            const uint64_t e = be64(&l2[j * 8]);
+            if (e & COMPRESSED) throw std::runtime_error(fname.string() + ": compressed QCOW2 clusters are not supported");
+            if (version == 3 && (e & ZERO)) continue;
+            const uint64_t offset = e & OFFSET_MASK;
+            if (offset == 0) continue;
+            check_offset(offset);
+            blocks[i * l2_entries + j] = offset;
+        }
+    }
+}
+
+uint64_t virtual_disk::stored_blocks() const
+{
+    return blocks.size() - std::count(blocks.begin(), blocks.end(), UNSTORED);
+}
+
+bool virtual_disk::stored(uint64_t offset, uint64_t len) const
+{
+    if (len == 0 || offset >= size_) return false;
+    const uint64_t last = std::min(offset + len, size_) - 1;
+    for (uint64_t b = offset / block_size_; b <= last / block_size_; b++) {
+        if (blocks[b] != UNSTORED) return true;
+    }
+    return false;
+}
+
+ssize_t virtual_disk::read(uint8_t *buf, size_t len, uint64_t offset) const
+{
+    if (offset >= size_) return 0;
+    len = std::min<uint64_t>(len, size_ - offset);
+    for (size_t done = 0; done < len; ) {
+        const uint64_t pos    = offset + done;
+        const uint64_t within = pos % block_size_;
+        const size_t   count  = std::min<uint64_t>(len - done, block_size_ - within);
+        const uint64_t block  = blocks[pos / block_size_];
+        size_t got = 0;
+        while (block != UNSTORED && got < count) {
+            const ssize_t n = ::pread(fd, buf + done + got, count - got, block + within + got);
+            if (n < 0) return -1;
+            if (n == 0) break;          // a block cut short by the end of the file reads as zeros
+            got += n;
+        }
+        memset(buf + done + got, 0, count - got);
+        done += count;
+    }
+    return len;
+}
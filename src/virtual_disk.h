@@ -0,0 +1,74 @@
+#ifndef VIRTUAL_DISK_H
+#define VIRTUAL_DISK_H
+
+/**
+ * virtual_disk: the sparse virtual disk formats of hypervisors and clouds, read in place rather than
+ * converted to raw first (see process_vdisk in image_process.h):
+ *
+ *   VMDK  - a VMware hosted sparse extent (monolithicSparse)
+ *   VHDX  - a Hyper-V fixed or dynamic disk
+ *   QCOW2 - a QEMU/KVM image, version 2 or 3
+ *
+ * Each format keeps the disk in blocks (VMDK grains, VHDX payload blocks, QCOW2 clusters), and only the
+ * blocks that have been written are in the file. The constructor reads the format's block table into
+ * blocks, the file offset of each block or UNSTORED, so stored() and read() are lookups. The table costs
+ * 8 bytes a block: 128 MiB for a 1 TiB disk of 64 KiB blocks.
+ *
+ * Blocks that are not stored, or that the format marks as zeros, read as zeros. What needs more than
+ * the image's own file is not supported and throws std::runtime_error: compressed grains or clusters
+ * (streamOptimized VMDK), differencing disks (a QCOW2 backing file, a VHDX parent), encryption, a QCOW2
+ * external data file or extended L2 entries, and a VHDX whose log has not been replayed.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <sys/types.h>
+
+class virtual_disk {
+public:
+    enum format_t { NONE, VMDK, VHDX, QCOW2 };
+    static const char *format_name(format_t f);
+    static inline const uint64_t UNSTORED {0}; // no block is stored at offset 0; every format has a header there
+
+    /* The format of a file, from its magic number; NONE if it is none of them */
+    static format_t detect(const std::filesystem::path &fn);
+
+    /* Opens fn and reads its block table; throws std::runtime_error if it is malformed or not supported */
+    explicit virtual_disk(const std::filesystem::path &fn);
+    ~virtual_disk();
+    virtual_disk(const virtual_disk &)=delete;
+    virtual_disk &operator=(const virtual_disk &)=delete;
+
+    format_t format() const { return format_; }
+    uint64_t size() const { return size_; } // of the virtual disk
+    uint64_t block_size() const { return block_size_; }
+    uint64_t stored_blocks() const;
+
+    /* true if any byte of [offset, offset+len) is stored; false if they all read as zeros */
+    bool     stored(uint64_t offset, uint64_t len) const;
+
+    /* Copies bytes [offset, offset+len) of the disk into buf; returns the bytes copied (short at the end),
+     * or -1 if the file cannot be read. May be called from several threads at once.
+     */
+    ssize_t  read(uint8_t *buf, size_t len, uint64_t offset) const;
+
+private:
+    void     open_vmdk();
+    void     open_vhdx();
+    void     open_qcow2();
+    void     read_file(void *buf, size_t len, uint64_t offset) const; // all of it, or throws
+    void     set_geometry(uint64_t size, uint64_t block_size);
+    void     check_offset(uint64_t offset) const;
+
+    const std::filesystem::path fname;
+    int      fd {-1};
+    uint64_t file_size {0};
+    format_t format_ {NONE};
+    uint64_t size_ {0};
+    uint64_t block_size_ {0};
+    std::vector<uint64_t> blocks {};    // the file offset of each block, or UNSTORED
+};
+
+#endif
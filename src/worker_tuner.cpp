@@ -0,0 +1,132 @@
+#include "config.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include "memory_governor.h"
+#include "queue_stats.h"
+#include "scanner_priority.h"
+#include "scanner_watchdog.h"
+#include "worker_tuner.h"
+
+namespace {
+    std::mutex M;
+    std::condition_variable cv;
+    std::thread controller;
+    bool stopping {false};
+    std::atomic<unsigned> max_active {0};
+    std::atomic<unsigned> last_active {0};
+
+    /* The running totals that a sample is the difference of */
+    struct totals {
+        std::chrono::steady_clock::time_point when {};
+        double queue_wait {0};
+        double busy {0};
+        double cpu {0};
+        double wall {0};
+    };
+
+    totals measure() {
+        totals t;
+        t.when = std::chrono::steady_clock::now();
+        t.queue_wait = queue_stats::wait_seconds(queue_stats::QUEUE_CAPACITY);
+        const auto busy = scanner_watchdog::thread_busy_seconds();
+        t.busy = std::accumulate(busy.begin(), busy.end(), 0.0);
+        for (const auto &it : scanner_watchdog::totals()) {
+            t.cpu += it.second.cpu_seconds;
+            t.wall += it.second.wall_seconds;
+        }
+        return t;
+    }
+
+    void run(unsigned max_threads, std::chrono::milliseconds interval) {
+        unsigned active = max_threads;
+        totals last = measure();
+        std::unique_lock<std::mutex> lock(M);
+        while (!cv.wait_for(lock, interval, [] { return stopping; })) {
+            const totals now = measure();
+            worker_tuner::sample s;
+            s.seconds = std::chrono::duration<double>(now.when - last.when).count();
+            s.queue_wait_seconds = now.queue_wait - last.queue_wait;
+            s.busy_seconds = now.busy - last.busy;
+            s.cpu_seconds = now.cpu - last.cpu;
+            s.wall_seconds = now.wall - last.wall;
+            s.resident_bytes = memory_governor::used_bytes();
+            s.budget = memory_governor::get_budget();
+            last = now;
+            const unsigned next = worker_tuner::decide(active, max_threads, s);
+            if (next == active) continue;
+            active = next;
+            last_active = active;
+            scanner_priority::set_active_threads(active);
+            worker_tuner::changes++;
+            if (active < worker_tuner::min_active) worker_tuner::min_active = active;
+        }
+    }
+}
+
+unsigned worker_tuner::decide(unsigned active, unsigned max_threads, const sample &s)
+{
+    max_threads = std::max(max_threads, 1U);
+    active = std::clamp(active, 1U, max_threads);
+    if (s.seconds <= 0) return active;
+    if (s.budget && s.resident_bytes > s.budget * MEMORY_HIGH) {
+        return std::max(active - std::max(active / 4, 1U), 1U);
+    }
+    const double busy = s.busy_seconds / (s.seconds * active);
+    if (s.wall_seconds > s.seconds && s.cpu_seconds < s.wall_seconds * CPU_EFFICIENCY_LOW) {
+        return std::max(active - 1, 1U);
+    }
+    if (s.queue_wait_seconds > s.seconds * QUEUE_WAIT_HIGH && busy > BUSY_HIGH) {
+        return std::min(active + std::max(active / 4, 1U), max_threads);
+    }
+    if (busy < BUSY_LOW) return std::max(active - 1, 1U);
+    return active;
+}
+
+void worker_tuner::start(unsigned max_threads, std::chrono::milliseconds interval)
+{
+    stop();
+    max_threads = std::max(max_threads, 1U);
+    max_active = max_threads;
+    min_active = max_threads;
+    last_active = max_threads;
+    changes = 0;
+    scanner_priority::set_active_threads(max_threads);
+    stopping = false;
+    controller = std::thread(run, max_threads, interval);
+}
+
+void worker_tuner::stop()
+{
+    if (!controller.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(M);
+        stopping = true;
+    }
+    cv.notify_all();
+    controller.join();
+    scanner_priority::set_active_threads(0);
+}
+
+bool worker_tuner::running()
+{
+    return controller.joinable();
+}
+
+std::string worker_tuner::xml_attributes()
+{
+    return "max='" + std::to_string(max_active) +
+        "' min='" + std::to_string(min_active) +
+        "' final='" + std::to_string(last_active) +
+        "' changes='" + std::to_string(changes) + "'";
+}
+
+void worker_tuner::add_realtime_stats(std::map<std::string,std::string> &stats)
+{
+    if (!running()) return;
+    stats["active_threads"] = std::to_string(last_active) + " of " + std::to_string(max_active);
+}
@@ -0,0 +1,60 @@
+#ifndef WORKER_TUNER_H
+#define WORKER_TUNER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * worker_tuner:
+ * With -S auto_threads=YES, a controller that moves the number of workers scanning at once between
+ * 1 and -j while phase 1 runs, from what queue_stats, scanner_watchdog and memory_governor measured
+ * over the last interval:
+ *   - the producer waited for queue capacity while the active workers were busy: one more worker
+ *     (or a quarter more) would have kept up, so grow;
+ *   - the active workers sat idle: there is not enough work for them, so shrink by one;
+ *   - the scanner calls got less CPU than wall time (the host is oversubscribed, or the calls stall
+ *     on the disk or on each other): shrink;
+ *   - the process is near its memory budget: shrink by a quarter, as each worker holds its pages.
+ *
+ * be13_api's scanner set starts -j threads and keeps them; the tuner caps the threads in any scanner
+ * call instead (scanner_priority::set_active_threads), so a worker over the cap waits at the wrapper in
+ * bulk_extractor_scanners.cpp before its next call. It starts at -j.
+ */
+
+class worker_tuner {
+public:
+    /* What was measured over one interval */
+    struct sample {
+        double   seconds {0};
+        double   queue_wait_seconds {0};    // the producer waited for queue capacity
+        double   busy_seconds {0};          // of all the workers, in scanner calls
+        double   cpu_seconds {0};           // of the scanner calls
+        double   wall_seconds {0};
+        uint64_t resident_bytes {0};        // memory_governor::used_bytes()
+        uint64_t budget {0};                // memory_governor's; 0 for none
+    };
+
+    static inline const auto INTERVAL = std::chrono::seconds(5);
+    static inline const double MEMORY_HIGH {0.90};       // of the budget
+    static inline const double CPU_EFFICIENCY_LOW {0.60}; // cpu/wall of the scanner calls
+    static inline const double QUEUE_WAIT_HIGH {0.50};   // of the interval
+    static inline const double BUSY_HIGH {0.90};         // of the active workers' time
+    static inline const double BUSY_LOW {0.50};
+
+    static inline std::atomic<uint64_t> changes {0};
+    static inline std::atomic<unsigned> min_active {0};
+
+    /* The number of active workers for the next interval */
+    static unsigned decide(unsigned active, unsigned max_threads, const sample &s);
+
+    static void start(unsigned max_threads, std::chrono::milliseconds interval = INTERVAL);
+    static void stop();                 // and lifts the cap
+    static bool running();
+    static std::string xml_attributes(); // for the <worker_tuner> report element
+    static void add_realtime_stats(std::map<std::string,std::string> &stats);
+};
+
+#endif
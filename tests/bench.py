@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+# coding=UTF-8
+"""
+Reproducible bulk_extractor benchmark.
+
+Runs a fixed matrix (thread counts x page sizes x scanner sets) over a synthetic image, which is
+generated from a fixed seed, and the images bundled in src/tests. Writes a JSON summary with the
+MB/s, peak RSS and per-scanner CPU time of each run, which can be compared between builds:
+
+    bench.py [--quick] [--densities] [--image IMAGE ...] [--json bench.json]
+    bench.py --compare old.json new.json [--tolerance 0.10]
+
+--densities adds images generated by bulk_extractor itself (synthetic:SIZE,..., see src/synthetic_image.h)
+at multiples of the default feature densities, to measure how the scanners scale with what they find.
+--compare exits 1 if any run is slower (MB/s) or larger (peak RSS) than it was by more than the tolerance.
+Run benchmarks to be compared on the same, otherwise idle, machine.
+"""
+
+__version__ = "2.0.0-dev"
+
+import argparse
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import xml.etree.ElementTree as ET
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC  = os.path.join(HERE, "..", "src")
+
+BUNDLED_IMAGES = ["tests/nps-2010-emails.100k.raw", "tests/email_test.E01", "tests/CFReDS001.E01"]
+
+SYNTHETIC_NAME = "synthetic-64m.raw"
+SYNTHETIC_SIZE = 64 * 1024 * 1024
+SYNTHETIC_SEED = 2010
+
+DENSITY_SIZE   = "256m"
+DENSITY_SCALES = [0, 1, 10, 100]        # multiples of synthetic_image's default densities
+
+# The matrix. Each scanner set is a list of bulk_extractor arguments.
+THREADS   = [1, 4, 0]                   # 0 is the number of cores
+PAGESIZES = ["16777216", "4194304", "auto"]
+SCANNERS  = {"default": [],
+             "email":   ["-x", "all", "-e", "email", "-e", "accts"],
+             "all":     ["-e", "all"]}
+QUICK     = {"threads": [0], "pagesizes": ["16777216"], "scanners": ["default"]}
+
+def find_exe():
+    for exe in [os.path.join(SRC, "bulk_extractor"), shutil.which("bulk_extractor")]:
+        if exe and os.path.exists(exe):
+            return exe
+    raise RuntimeError("bulk_extractor not found; build it first")
+
+def make_synthetic(path):
+    """Random data with runs of text containing features, and zero pages. The same seed makes the same image."""
+    if os.path.exists(path) and os.path.getsize(path) == SYNTHETIC_SIZE:
+        return path
+    rng = random.Random(SYNTHETIC_SEED)
+    words = ["alpha", "bravo", "charlie", "delta", "echo", "foxtrot"]
+    with open(path, "wb") as f:
+        written = 0
+        while written < SYNTHETIC_SIZE:
+            kind = rng.randrange(4)
+            if kind == 0:
+                block = rng.getrandbits(8 * 4096).to_bytes(4096, "little")
+            elif kind == 1:
+                lines = []
+                for i in range(64):
+                    name = rng.choice(words) + str(rng.randrange(1000))
+                    lines.append("From: {}@example{}.com http://www.example{}.com/{}?q={} 4111-1111-1111-{:04d}\n"
+                                 .format(name, i % 7, i % 5, name, rng.randrange(10**6), rng.randrange(10**4)))
+                block = "".join(lines).encode("utf-8")
+            elif kind == 2:
+                block = bytes(65536)
+            else:
+                block = rng.getrandbits(8 * 1024).to_bytes(1024, "little") * 16
+            block = block[:SYNTHETIC_SIZE - written]
+            f.write(block)
+            written += len(block)
+    return path
+
+def report_values(outdir):
+    """Scanner times and bytes from report.xml"""
+    ret = {"scanner_seconds": {}, "bytes": 0}
+    root = ET.parse(os.path.join(outdir, "report.xml")).getroot()
+    for st in root.iter("scanner_time"):
+        ret["scanner_seconds"][st.get("name")] = float(st.get("cpu_seconds", 0))
+    for tb in root.iter("total_bytes"):
+        ret["bytes"] = int(tb.text)
+    return ret
+
+def run_one(exe, image, threads, pagesize, scanners, workdir):
+    outdir = tempfile.mkdtemp(prefix="bench-", dir=workdir)
+    shutil.rmtree(outdir)
+    cmd = [exe, "-q", "-0", "-o", outdir, "-G", pagesize] + SCANNERS[scanners]
+    if threads:
+        cmd += ["-j", str(threads)]
+    cmd.append(image)
+    with tempfile.TemporaryFile(dir=workdir) as errors:
+        t0 = time.time()
+        proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=errors)
+        _, status, rusage = os.wait4(proc.pid, 0)   # the rusage of this run alone
+        seconds = time.time() - t0
+        if status != 0:
+            errors.seek(0)
+            raise RuntimeError("failed: " + " ".join(cmd) + "\n" + errors.read().decode("utf-8", "replace"))
+    values = report_values(outdir)
+    shutil.rmtree(outdir)
+    nbytes = values["bytes"] or os.path.getsize(image)
+    # ru_maxrss is in KiB on Linux and bytes on macOS
+    peak_rss = rusage.ru_maxrss if sys.platform == "darwin" else rusage.ru_maxrss * 1024
+    return {"image": os.path.basename(image), "threads": threads, "pagesize": pagesize, "scanners": scanners,
+            "bytes": nbytes, "seconds": round(seconds, 3), "mb_per_sec": round(nbytes / 1e6 / seconds, 3),
+            "peak_rss_bytes": peak_rss, "scanner_seconds": values["scanner_seconds"]}
+
+def key(run):
+    return "{image} threads={threads} pagesize={pagesize} scanners={scanners}".format(**run)
+
+def compare(old_fname, new_fname, tolerance):
+    with open(old_fname) as f:
+        old = {key(r): r for r in json.load(f)["runs"]}
+    with open(new_fname) as f:
+        new = {key(r): r for r in json.load(f)["runs"]}
+    regressions = 0
+    for k in sorted(set(old) & set(new)):
+        speed = new[k]["mb_per_sec"] / old[k]["mb_per_sec"] - 1 if old[k]["mb_per_sec"] else 0
+        rss   = new[k]["peak_rss_bytes"] / old[k]["peak_rss_bytes"] - 1 if old[k]["peak_rss_bytes"] else 0
+        flag = ""
+        if speed < -tolerance or rss > tolerance:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("{:70s} MB/s {:+6.1%}  peak RSS {:+6.1%}{}".format(k, speed, rss, flag))
+    for k in sorted(set(old) ^ set(new)):
+        print("{:70s} only in {}".format(k, old_fname if k in old else new_fname))
+    return regressions
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="bulk_extractor benchmark",
+                                     formatter_class=argparse.RawDescriptionHelpFormatter, epilog=__doc__)
+    parser.add_argument("--image", action="append", default=[], help="also benchmark this image")
+    parser.add_argument("--json", default="bench.json", help="where the summary is written")
+    parser.add_argument("--quick", action="store_true", help="only the default scanners on all threads")
+    parser.add_argument("--densities", action="store_true", help="also benchmark generated images of rising feature density")
+    parser.add_argument("--workdir", default=tempfile.gettempdir(), help="where images and output directories go")
+    parser.add_argument("--compare", nargs=2, metavar=("OLD", "NEW"), help="compare two summaries")
+    parser.add_argument("--tolerance", type=float, default=0.10, help="allowed change before a regression")
+    args = parser.parse_args()
+
+    if args.compare:
+        sys.exit(1 if compare(args.compare[0], args.compare[1], args.tolerance) else 0)
+
+    exe = find_exe()
+    images = [make_synthetic(os.path.join(args.workdir, SYNTHETIC_NAME))]
+    images += [os.path.join(SRC, img) for img in BUNDLED_IMAGES if os.path.exists(os.path.join(SRC, img))]
+    if args.densities:
+        images += ["synthetic:{},seed={},scale={}".format(DENSITY_SIZE, SYNTHETIC_SEED, s) for s in DENSITY_SCALES]
+    images += args.image
+    threads   = QUICK["threads"] if args.quick else THREADS
+    pagesizes = QUICK["pagesizes"] if args.quick else PAGESIZES
+    scanners  = QUICK["scanners"] if args.quick else list(SCANNERS)
+
+    version = subprocess.run([exe, "-V"], stdout=subprocess.PIPE).stdout.decode("utf-8").strip()
+    runs = []
+    for image in images:
+        for t in threads:
+            for ps in pagesizes:
+                for sc in scanners:
+                    run = run_one(exe, image, t, ps, sc, args.workdir)
+                    print("{:70s} {:8.1f} MB/s {:6d} MiB".format(key(run), run["mb_per_sec"],
+                                                                 run["peak_rss_bytes"] // (1024*1024)))
+                    runs.append(run)
+    with open(args.json, "w") as f:
+        json.dump({"version": version, "cpus": os.cpu_count(), "runs": runs}, f, indent=2, sort_keys=True)
+    print("wrote", args.json)
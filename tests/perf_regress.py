@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# coding=UTF-8
+"""
+Scanner performance regression check.
+
+Runs each scanner over its fixture in src/tests with src/stand (built with "make stand"), single threaded,
+and compares the median throughput and the allocations per MB with a baseline recorded on the same host:
+
+    perf_regress.py --record            # write tests/perf_baselines/HOST.json
+    perf_regress.py [--tolerance 0.15]  # compare with it; exits 1 on any regression
+
+A case regresses if its MB/s falls, or its allocations per MB rise, by more than the tolerance.
+Throughput is only comparable on the same, otherwise idle, machine, so each host keeps its own baseline;
+commit the baseline of the machine that checks a branch. Allocations per MB do not depend on the machine.
+"""
+
+__version__ = "2.0.0-dev"
+
+import argparse
+import json
+import math
+import os
+import platform
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC  = os.path.join(HERE, "..", "src")
+BASELINES = os.path.join(HERE, "perf_baselines")
+
+# name: (scanners to enable, fixture in src/tests)
+CASES = {
+    "email":   (["email"],                    "tests/nps-2010-emails.100k.raw"),
+    "accts":   (["accts"],                    "tests/nps-2010-emails.100k.raw"),
+    "base64":  (["base64", "json"],           "tests/test_base64json.txt"),
+    "gzip":    (["gzip", "email"],            "tests/test_hello.gz"),
+    "zip":     (["zip", "msxml", "email"],    "tests/testfilex.docx"),
+    "rar":     (["rar", "exif"],              "tests/jpegs.rar"),
+    "exif":    (["exif"],                     "tests/1.jpg"),
+    "net":     (["net"],                      "tests/ntlm80.pcap"),
+    "pdf":     (["pdf", "email"],             "tests/pdf_words2.pdf"),
+    "kml":     (["kml"],                      "tests/KML_Samples.kml"),
+    "vcard":   (["vcard"],                    "tests/john_jakes.vcf"),
+    "windirs": (["windirs"],                  "tests/1mb_fat32.dmg"),
+    "elf":     (["elf"],                      "tests/hello_elf"),
+}
+
+BYTES_PER_CASE = 16 * 1024 * 1024       # small fixtures are run more times, so each case scans about this much
+MIN_RUNS, MAX_RUNS = 5, 200
+
+def find_stand():
+    exe = os.path.join(SRC, "stand")
+    if not os.path.exists(exe):
+        raise RuntimeError("{} not found; build it with: make -C src stand".format(exe))
+    return exe
+
+def baseline_path():
+    return os.path.join(BASELINES, platform.node().split(".")[0] + ".json")
+
+def run_case(stand, name):
+    scanners, fixture = CASES[name]
+    path = os.path.join(SRC, fixture)
+    runs = max(MIN_RUNS, min(MAX_RUNS, math.ceil(BYTES_PER_CASE / max(os.path.getsize(path), 1))))
+    cmd = [stand, "-J", "-n", str(runs), "-x", "all"]
+    for sc in scanners:
+        cmd += ["-e", sc]
+    cmd.append(path)
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if proc.returncode != 0:
+        raise RuntimeError("failed: " + " ".join(cmd) + "\n" + proc.stderr.decode("utf-8", "replace"))
+    result = json.loads(proc.stdout.decode("utf-8").strip().splitlines()[-1])
+    return {"fixture": fixture, "runs": runs, "mb_per_sec": result["mb_per_sec"],
+            "allocations_per_mb": result["allocations_per_mb"], "features_per_run": result["features_per_run"]}
+
+def check(baseline, current, tolerance):
+    regressions = 0
+    for name in sorted(current):
+        new = current[name]
+        old = baseline["cases"].get(name)
+        if old is None:
+            print("{:10s} {:9.1f} MB/s  no baseline".format(name, new["mb_per_sec"]))
+            continue
+        speed  = new["mb_per_sec"] / old["mb_per_sec"] - 1 if old["mb_per_sec"] else 0
+        allocs = new["allocations_per_mb"] / old["allocations_per_mb"] - 1 if old["allocations_per_mb"] else 0
+        flags = []
+        if speed < -tolerance:
+            flags.append("SLOWER")
+        if allocs > tolerance:
+            flags.append("MORE ALLOCATIONS")
+        if new["features_per_run"] != old["features_per_run"]:
+            flags.append("FEATURES {} -> {}".format(old["features_per_run"], new["features_per_run"]))
+        if flags:
+            regressions += 1
+        print("{:10s} {:9.1f} MB/s {:+6.1%}  {:9.1f} allocs/MB {:+6.1%}  {}".format(
+            name, new["mb_per_sec"], speed, new["allocations_per_mb"], allocs, " ".join(flags)))
+    return regressions
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="bulk_extractor scanner performance regression check",
+                                     formatter_class=argparse.RawDescriptionHelpFormatter, epilog=__doc__)
+    parser.add_argument("--record", action="store_true", help="record the baseline of this host")
+    parser.add_argument("--baseline", default=baseline_path(), help="baseline to record or compare with")
+    parser.add_argument("--tolerance", type=float, default=0.15, help="allowed change before a regression")
+    parser.add_argument("--case", action="append", choices=sorted(CASES), help="only these cases")
+    args = parser.parse_args()
+
+    stand = find_stand()
+    names = args.case or sorted(CASES)
+    missing = [n for n in names if not os.path.exists(os.path.join(SRC, CASES[n][1]))]
+    for n in missing:
+        print("{:10s} skipped: {} not found".format(n, CASES[n][1]))
+    current = {n: run_case(stand, n) for n in names if n not in missing}
+
+    if args.record:
+        os.makedirs(os.path.dirname(args.baseline), exist_ok=True)
+        with open(args.baseline, "w") as f:
+            json.dump({"host": platform.node(), "cpus": os.cpu_count(), "cases": current}, f, indent=2, sort_keys=True)
+        print("wrote", args.baseline)
+        sys.exit(0)
+
+    if not os.path.exists(args.baseline):
+        print("no baseline at {}; record one with --record".format(args.baseline), file=sys.stderr)
+        sys.exit(2)
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    regressions = check(baseline, current, args.tolerance)
+    if regressions:
+        print("PERFORMANCE REGRESSION: {} of {} cases (tolerance {:.0%}, baseline {})".format(
+            regressions, len(current), args.tolerance, args.baseline), file=sys.stderr)
+        sys.exit(1)
+    print("no regressions")